@@ -31,22 +31,40 @@ namespace android {
 typedef Parcel::WritableBlob WritableBlob;
 typedef Parcel::ReadableBlob ReadableBlob;
 
+// Copy a metadata buffer with the same capacity as the original, so that a
+// copied-on-write buffer keeps any headroom for further updates.
+static camera_metadata_t* copyMetadataBuffer(const camera_metadata_t *buffer) {
+    camera_metadata_t *copy = allocate_camera_metadata(
+            get_camera_metadata_entry_capacity(buffer),
+            get_camera_metadata_data_capacity(buffer));
+    if (copy == NULL) {
+        return NULL;
+    }
+    if (append_camera_metadata(copy, buffer) != OK) {
+        free_camera_metadata(copy);
+        return NULL;
+    }
+    set_camera_metadata_vendor_id(copy, get_camera_metadata_vendor_id(buffer));
+    return copy;
+}
+
 CameraMetadata::CameraMetadata() :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mShareCount(nullptr), mWritable(false) {
 }
 
 CameraMetadata::CameraMetadata(size_t entryCapacity, size_t dataCapacity) :
-        mLocked(false)
+        mLocked(false), mShareCount(nullptr), mWritable(false)
 {
     mBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
 }
 
 CameraMetadata::CameraMetadata(const CameraMetadata &other) :
-        mLocked(false) {
-    mBuffer = clone_camera_metadata(other.mBuffer);
+        mBuffer(NULL), mLocked(false), mShareCount(nullptr), mWritable(false) {
+    shareFrom(other);
 }
 
-CameraMetadata::CameraMetadata(CameraMetadata &&other) :mBuffer(NULL),  mLocked(false) {
+CameraMetadata::CameraMetadata(CameraMetadata &&other) :
+        mBuffer(NULL), mLocked(false), mShareCount(nullptr), mWritable(false) {
     acquire(other);
 }
 
@@ -56,12 +74,21 @@ CameraMetadata &CameraMetadata::operator=(CameraMetadata &&other) {
 }
 
 CameraMetadata::CameraMetadata(camera_metadata_t *buffer) :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mShareCount(nullptr), mWritable(false) {
     acquire(buffer);
 }
 
 CameraMetadata &CameraMetadata::operator=(const CameraMetadata &other) {
-    return operator=(other.mBuffer);
+    if (mLocked) {
+        ALOGE("%s: Assignment to a locked CameraMetadata!", __FUNCTION__);
+        return *this;
+    }
+
+    if (CC_LIKELY(other.mBuffer != mBuffer)) {
+        clear();
+        shareFrom(other);
+    }
+    return *this;
 }
 
 CameraMetadata &CameraMetadata::operator=(const camera_metadata_t *buffer) {
@@ -88,6 +115,16 @@ const camera_metadata_t* CameraMetadata::getAndLock() const {
     return mBuffer;
 }
 
+camera_metadata_t* CameraMetadata::getAndLockForUpdate() {
+    // An already locked buffer may be in use by the caller, so it can't be replaced.
+    if (!mLocked && unshare() != OK) {
+        ALOGE("%s: Unable to copy shared metadata buffer", __FUNCTION__);
+    }
+    mLocked = true;
+    mWritable = true;
+    return mBuffer;
+}
+
 status_t CameraMetadata::unlock(const camera_metadata_t *buffer) const {
     if (!mLocked) {
         ALOGE("%s: Can't unlock a non-locked CameraMetadata!", __FUNCTION__);
@@ -107,6 +144,11 @@ camera_metadata_t* CameraMetadata::release() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return NULL;
     }
+    // The caller takes ownership, so other objects sharing the buffer keep the original.
+    if (unshare() != OK) {
+        ALOGE("%s: Unable to copy shared metadata buffer", __FUNCTION__);
+        return NULL;
+    }
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
     return released;
@@ -117,6 +159,72 @@ void CameraMetadata::clear() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return;
     }
+    releaseBuffer();
+}
+
+void CameraMetadata::shareFrom(const CameraMetadata &other) {
+    if (other.mBuffer == NULL) {
+        return;
+    }
+    if (other.mLocked || other.mWritable) {
+        // The holder of the lock or of writable entries may modify the buffer in place
+        mBuffer = clone_camera_metadata(other.mBuffer);
+        return;
+    }
+
+    ShareCount *count = other.mShareCount.load(std::memory_order_acquire);
+    if (count == nullptr) {
+        // First copy of other's buffer. Concurrent copies of the same const object
+        // race to install the count; the losers use the winner's.
+        ShareCount *newCount = new ShareCount(1);
+        if (other.mShareCount.compare_exchange_strong(count, newCount,
+                std::memory_order_acq_rel)) {
+            count = newCount;
+        } else {
+            delete newCount;
+        }
+    }
+    count->fetch_add(1, std::memory_order_relaxed);
+    mBuffer = other.mBuffer;
+    mShareCount.store(count, std::memory_order_relaxed);
+}
+
+status_t CameraMetadata::unshare() {
+    // Called by every modification, which may move the buffer and so ends
+    // the validity of entries handed out before.
+    mWritable = false;
+    ShareCount *count = mShareCount.load(std::memory_order_relaxed);
+    if (count == nullptr) {
+        return OK;
+    }
+    if (count->load(std::memory_order_acquire) == 1) {
+        // All other objects have dropped the buffer already
+        mShareCount.store(nullptr, std::memory_order_relaxed);
+        delete count;
+        return OK;
+    }
+
+    camera_metadata_t *copy = copyMetadataBuffer(mBuffer);
+    if (copy == NULL) {
+        return NO_MEMORY;
+    }
+    releaseBuffer();
+    mBuffer = copy;
+    return OK;
+}
+
+void CameraMetadata::releaseBuffer() {
+    mWritable = false;
+    ShareCount *count = mShareCount.load(std::memory_order_relaxed);
+    if (count != nullptr) {
+        mShareCount.store(nullptr, std::memory_order_relaxed);
+        if (count->fetch_sub(1, std::memory_order_acq_rel) > 1) {
+            // Still in use by other objects
+            mBuffer = NULL;
+            return;
+        }
+        delete count;
+    }
     if (mBuffer) {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
@@ -141,7 +249,29 @@ void CameraMetadata::acquire(CameraMetadata &other) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return;
     }
-    acquire(other.release());
+    if (&other == this) {
+        return;
+    }
+    if (other.mLocked) {
+        ALOGE("%s: Other CameraMetadata is locked", __FUNCTION__);
+        clear();
+        return;
+    }
+
+    // Take over other's buffer along with its share count, if any
+    clear();
+    mBuffer = other.mBuffer;
+    mShareCount.store(other.mShareCount.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    mWritable = other.mWritable;
+    other.mBuffer = NULL;
+    other.mShareCount.store(nullptr, std::memory_order_relaxed);
+    other.mWritable = false;
+
+    ALOGE_IF(mBuffer != NULL &&
+             validate_camera_metadata_structure(mBuffer, /*size*/NULL) != OK,
+             "%s: Failed to validate metadata structure %p",
+             __FUNCTION__, mBuffer);
 }
 
 status_t CameraMetadata::append(const CameraMetadata &other) {
@@ -156,6 +286,10 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraEntries = get_camera_metadata_entry_count(other);
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
+    status_t res = unshare();
+    if (res != OK) {
+        return res;
+    }
 
     return append_camera_metadata(mBuffer, other);
 }
@@ -179,6 +313,10 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    status_t res = unshare();
+    if (res != OK) {
+        return res;
+    }
     return sort_camera_metadata(mBuffer);
 }
 
@@ -315,6 +453,18 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
         ALOGE("%s: Tag %d not found", __FUNCTION__, tag);
         return BAD_VALUE;
     }
+    // Data may come from another object sharing this buffer; it stays valid
+    // there once this object has its own copy.
+    uintptr_t sharedAddr = reinterpret_cast<uintptr_t>(mBuffer);
+    uintptr_t sourceAddr = reinterpret_cast<uintptr_t>(data);
+    if (mShareCount.load(std::memory_order_relaxed) != nullptr && sourceAddr > sharedAddr &&
+            sourceAddr < sharedAddr + get_camera_metadata_size(mBuffer)) {
+        res = unshare();
+        if (res != OK) {
+            return res;
+        }
+    }
+
     // Safety check - ensure that data isn't pointing to this metadata, since
     // that would get invalidated if a resize is needed
     size_t bufferSize = get_camera_metadata_size(mBuffer);
@@ -329,10 +479,26 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
     size_t data_size = calculate_camera_metadata_entry_data_size(type,
             data_count);
 
-    res = resizeIfNeeded(1, data_size);
+    // An existing entry is updated in place. Only a change in its data size
+    // may need more room; an entry with inline data or of the same size never
+    // does.
+    camera_metadata_entry_t entry;
+    size_t extraEntries = 1;
+    size_t extraData = data_size;
+    if (mBuffer != NULL && find_camera_metadata_entry(mBuffer, tag, &entry) == OK) {
+        extraEntries = 0;
+        if (data_size == calculate_camera_metadata_entry_data_size(type, entry.count)) {
+            extraData = 0;
+        }
+    }
+
+    // Resizing copies the buffer, which also ends any sharing of it
+    res = resizeIfNeeded(extraEntries, extraData);
+    if (res == OK) {
+        res = unshare();
+    }
 
     if (res == OK) {
-        camera_metadata_entry_t entry;
         res = find_camera_metadata_entry(mBuffer, tag, &entry);
         if (res == NAME_NOT_FOUND) {
             res = add_camera_metadata_entry(mBuffer,
@@ -374,10 +540,19 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
+    // The caller may write through the entry
+    if (unshare() != OK) {
+        ALOGE("%s: Unable to copy shared metadata buffer", __FUNCTION__);
+        entry.count = 0;
+        entry.data.u8 = NULL;
+        return entry;
+    }
     res = find_camera_metadata_entry(mBuffer, tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
+    } else {
+        mWritable = true;
     }
     return entry;
 }
@@ -411,6 +586,11 @@ status_t CameraMetadata::erase(uint32_t tag) {
                 tag, strerror(-res), res);
         return res;
     }
+    // Entry indices are preserved by the copy
+    res = unshare();
+    if (res != OK) {
+        return res;
+    }
     res = delete_camera_metadata_entry(mBuffer, entry.index);
     if (res != OK) {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d",
@@ -523,15 +703,16 @@ status_t CameraMetadata::resizeIfNeeded(size_t extraEntries, size_t extraData) {
 
         if (newEntryCount > currentEntryCap ||
                 newDataCount > currentDataCap) {
-            camera_metadata_t *oldBuffer = mBuffer;
-            mBuffer = allocate_camera_metadata(newEntryCount,
+            camera_metadata_t *newBuffer = allocate_camera_metadata(newEntryCount,
                     newDataCount);
-            if (mBuffer == NULL) {
+            if (newBuffer == NULL) {
                 ALOGE("%s: Can't allocate larger metadata buffer", __FUNCTION__);
                 return NO_MEMORY;
             }
-            append_camera_metadata(mBuffer, oldBuffer);
-            free_camera_metadata(oldBuffer);
+            append_camera_metadata(newBuffer, mBuffer);
+            // Other objects sharing the old buffer keep it
+            releaseBuffer();
+            mBuffer = newBuffer;
         }
     }
     return OK;
@@ -778,9 +959,16 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     camera_metadata* thisBuf = mBuffer;
     camera_metadata* otherBuf = other.mBuffer;
+    ShareCount* thisCount = mShareCount.load(std::memory_order_relaxed);
+    ShareCount* otherCount = other.mShareCount.load(std::memory_order_relaxed);
 
     other.mBuffer = thisBuf;
+    other.mShareCount.store(thisCount, std::memory_order_relaxed);
     mBuffer = otherBuf;
+    mShareCount.store(otherCount, std::memory_order_relaxed);
+    bool thisWritable = mWritable;
+    mWritable = other.mWritable;
+    other.mWritable = thisWritable;
 }
 
 status_t CameraMetadata::getTagFromName(const char *name,
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the metadata work that the camera service does for one capture result:
+// copy the HAL result, hand copies to the tag monitor and the result queue, and
+// patch the crop, region, face and zoom tags the way the result mappers do.
+//
+// Run with:
+//   camera_metadata_benchmark --benchmark_filter=BM_CaptureResult
+// The "clone" variants deep-copy every CameraMetadata copy, as was done before
+// copies became copy-on-write. "allocs" is the number of metadata buffers
+// allocated per result, and "cpu_pct" the share of one core used at the given
+// frame rate.
+
+#include <stdint.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <camera/CameraMetadata.h>
+#include <system/camera_metadata.h>
+
+using android::CameraMetadata;
+
+static constexpr size_t kFaceCount = 4;
+static constexpr size_t kPhysicalCameraCount = 2;
+static constexpr size_t kTonemapPoints = 64;
+static constexpr size_t kLensShadingMapSize = 4 * 17 * 13;
+// Room for frame count, request id and zoom ratio, as in the result path
+static constexpr size_t kExtraResultEntries = 4;
+
+// A HAL result with the usual 3A, lens, color and statistics tags
+static CameraMetadata makeHalResult(bool withStatistics) {
+    CameraMetadata result;
+    int64_t timestamp = 1000000000;
+    int64_t exposure = 10000000;
+    int64_t frameDuration = 33333333;
+    int32_t sensitivity = 100;
+    int32_t cropRegion[4] = {0, 0, 4000, 3000};
+    int32_t region[5] = {1000, 750, 3000, 2250, 1};
+    uint8_t state = 2;
+    float focusDistance = 0.5f;
+    float aperture = 1.8f;
+    float focalLength = 4.4f;
+    float gains[4] = {1.9f, 1.0f, 1.0f, 1.6f};
+    camera_metadata_rational_t transform[9];
+    for (auto &r : transform) {
+        r = {1, 1};
+    }
+
+    result.update(ANDROID_SENSOR_TIMESTAMP, &timestamp, 1);
+    result.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposure, 1);
+    result.update(ANDROID_SENSOR_FRAME_DURATION, &frameDuration, 1);
+    result.update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1);
+    result.update(ANDROID_SCALER_CROP_REGION, cropRegion, 4);
+    result.update(ANDROID_CONTROL_AE_REGIONS, region, 5);
+    result.update(ANDROID_CONTROL_AF_REGIONS, region, 5);
+    result.update(ANDROID_CONTROL_AWB_REGIONS, region, 5);
+    result.update(ANDROID_CONTROL_AE_STATE, &state, 1);
+    result.update(ANDROID_CONTROL_AF_STATE, &state, 1);
+    result.update(ANDROID_CONTROL_AWB_STATE, &state, 1);
+    result.update(ANDROID_LENS_FOCUS_DISTANCE, &focusDistance, 1);
+    result.update(ANDROID_LENS_APERTURE, &aperture, 1);
+    result.update(ANDROID_LENS_FOCAL_LENGTH, &focalLength, 1);
+    result.update(ANDROID_COLOR_CORRECTION_GAINS, gains, 4);
+    result.update(ANDROID_COLOR_CORRECTION_TRANSFORM, transform, 9);
+
+    if (withStatistics) {
+        std::vector<int32_t> rectangles(kFaceCount * 4);
+        std::vector<int32_t> landmarks(kFaceCount * 6);
+        std::vector<int32_t> ids(kFaceCount);
+        std::vector<uint8_t> scores(kFaceCount, 90);
+        for (size_t i = 0; i < kFaceCount; i++) {
+            rectangles[i * 4 + 0] = 500 + i * 800;
+            rectangles[i * 4 + 1] = 1000;
+            rectangles[i * 4 + 2] = 1100 + i * 800;
+            rectangles[i * 4 + 3] = 1600;
+            for (size_t j = 0; j < 6; j++) {
+                landmarks[i * 6 + j] = rectangles[i * 4 + j % 4];
+            }
+            ids[i] = i;
+        }
+        std::vector<float> curve(kTonemapPoints * 2);
+        for (size_t i = 0; i < kTonemapPoints; i++) {
+            curve[i * 2] = curve[i * 2 + 1] = i / (kTonemapPoints - 1.0f);
+        }
+        std::vector<float> shadingMap(kLensShadingMapSize, 1.0f);
+
+        result.update(ANDROID_STATISTICS_FACE_RECTANGLES, rectangles.data(), rectangles.size());
+        result.update(ANDROID_STATISTICS_FACE_LANDMARKS, landmarks.data(), landmarks.size());
+        result.update(ANDROID_STATISTICS_FACE_IDS, ids.data(), ids.size());
+        result.update(ANDROID_STATISTICS_FACE_SCORES, scores.data(), scores.size());
+        result.update(ANDROID_TONEMAP_CURVE_RED, curve.data(), curve.size());
+        result.update(ANDROID_TONEMAP_CURVE_GREEN, curve.data(), curve.size());
+        result.update(ANDROID_TONEMAP_CURVE_BLUE, curve.data(), curve.size());
+        result.update(ANDROID_STATISTICS_LENS_SHADING_MAP, shadingMap.data(), shadingMap.size());
+    }
+    return result;
+}
+
+static const camera_metadata_t* bufferOf(const CameraMetadata &metadata) {
+    const camera_metadata_t *buffer = metadata.getAndLock();
+    metadata.unlock(buffer);
+    return buffer;
+}
+
+// Counts metadata buffer allocations by watching the buffer of each object change.
+// A new buffer is always allocated before the old one is freed, so a step that
+// allocates always leaves a different pointer behind.
+class AllocationCounter {
+  public:
+    CameraMetadata copy(const CameraMetadata &source, bool share) {
+        CameraMetadata copy;
+        if (share) {
+            copy = source;
+        } else {
+            const camera_metadata_t *buffer = source.getAndLock();
+            copy = buffer;
+            source.unlock(buffer);
+        }
+        if (bufferOf(copy) != bufferOf(source)) mCount++;
+        return copy;
+    }
+
+    template <typename Step>
+    void patch(CameraMetadata *metadata, Step step) {
+        const camera_metadata_t *before = bufferOf(*metadata);
+        step(metadata);
+        if (bufferOf(*metadata) != before) mCount++;
+    }
+
+    int64_t count() const { return mCount; }
+
+  private:
+    int64_t mCount = 0;
+};
+
+// Same-size updates of the tags the distortion and zoom ratio mappers correct
+static void patchLikeMappers(CameraMetadata *result, int32_t frame) {
+    int32_t cropRegion[4] = {frame & 0xff, 0, 4000, 3000};
+    result->update(ANDROID_SCALER_CROP_REGION, cropRegion, 4);
+    for (uint32_t tag : {ANDROID_CONTROL_AE_REGIONS, ANDROID_CONTROL_AF_REGIONS,
+            ANDROID_CONTROL_AWB_REGIONS}) {
+        int32_t region[5] = {1000 + (frame & 0xff), 750, 3000, 2250, 1};
+        result->update(tag, region, 5);
+    }
+    camera_metadata_ro_entry faces =
+            static_cast<const CameraMetadata*>(result)->find(ANDROID_STATISTICS_FACE_RECTANGLES);
+    if (faces.count > 0) {
+        std::vector<int32_t> rectangles(faces.data.i32, faces.data.i32 + faces.count);
+        for (auto &value : rectangles) {
+            value += 1;
+        }
+        result->update(ANDROID_STATISTICS_FACE_RECTANGLES, rectangles.data(), rectangles.size());
+    }
+    float zoomRatio = 1.0f;
+    result->update(ANDROID_CONTROL_ZOOM_RATIO, &zoomRatio, 1);
+}
+
+static void BM_CaptureResult(benchmark::State& state, bool share, bool withStatistics) {
+    const double fps = state.range(0);
+    const CameraMetadata halResult = makeHalResult(withStatistics);
+    const CameraMetadata halPhysicalResult = makeHalResult(false);
+    const camera_metadata_t *halBuffer = bufferOf(halResult);
+    AllocationCounter allocations;
+    int32_t frame = 0;
+
+    for (auto _ : state) {
+        frame++;
+
+        // processCaptureResult: copy the HAL buffers, with room for the extra tags
+        CameraMetadata result;
+        allocations.patch(&result, [&](CameraMetadata *m) {
+            *m = CameraMetadata(get_camera_metadata_entry_count(halBuffer) + kExtraResultEntries,
+                    get_camera_metadata_data_count(halBuffer));
+            m->append(halResult);
+        });
+        std::vector<CameraMetadata> physicalResults;
+        physicalResults.reserve(kPhysicalCameraCount);
+        for (size_t i = 0; i < kPhysicalCameraCount; i++) {
+            CameraMetadata physical;
+            allocations.patch(&physical, [&](CameraMetadata *m) { m->append(halPhysicalResult); });
+            physicalResults.push_back(allocations.copy(physical, share));
+        }
+
+        // sendCaptureResult: the tag monitor keeps the uncorrected physical results
+        std::vector<CameraMetadata> monitored;
+        monitored.reserve(kPhysicalCameraCount);
+        for (const auto &physical : physicalResults) {
+            monitored.push_back(allocations.copy(physical, share));
+        }
+        allocations.patch(&result, [](CameraMetadata *m) { m->sort(); });
+        benchmark::DoNotOptimize(static_cast<const CameraMetadata&>(result).find(
+                ANDROID_SENSOR_TIMESTAMP).data.i64);
+        allocations.patch(&result, [frame](CameraMetadata *m) { patchLikeMappers(m, frame); });
+        for (auto &physical : physicalResults) {
+            allocations.patch(&physical, [frame](CameraMetadata *m) {
+                patchLikeMappers(m, frame);
+            });
+        }
+
+        // insertResultLocked
+        allocations.patch(&result, [frame](CameraMetadata *m) {
+            camera_metadata_t *meta = m->getAndLockForUpdate();
+            set_camera_metadata_vendor_id(meta, 1);
+            m->unlock(meta);
+            int32_t requestId = 1;
+            m->update(ANDROID_REQUEST_FRAME_COUNT, &frame, 1);
+            m->update(ANDROID_REQUEST_ID, &requestId, 1);
+        });
+        CameraMetadata queued = allocations.copy(result, share);
+        benchmark::DoNotOptimize(bufferOf(queued));
+    }
+
+    state.counters["allocs"] = benchmark::Counter(allocations.count(),
+            benchmark::Counter::kAvgIterations);
+    state.counters["cpu_pct"] = benchmark::Counter(state.iterations() / (fps * 100.0),
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void FrameRates(benchmark::internal::Benchmark *b) {
+    for (int fps : {60, 120}) {
+        b->Arg(fps);
+    }
+}
+
+BENCHMARK_CAPTURE(BM_CaptureResult, share, true, false)->Apply(FrameRates);
+BENCHMARK_CAPTURE(BM_CaptureResult, clone, false, false)->Apply(FrameRates);
+BENCHMARK_CAPTURE(BM_CaptureResult, share_statistics, true, true)->Apply(FrameRates);
+BENCHMARK_CAPTURE(BM_CaptureResult, clone_statistics, false, true)->Apply(FrameRates);
+
+BENCHMARK_MAIN();
@@ -19,6 +19,8 @@
 
 #include "system/camera_metadata.h"
 
+#include <atomic>
+
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <binder/Parcelable.h>
@@ -30,6 +32,11 @@ class VendorTagDescriptor;
 
 /**
  * A convenience wrapper around the C-based camera_metadata_t library.
+ *
+ * Copies are copy-on-write: a copied object shares the metadata buffer of the
+ * original until either of them is modified, at which point the modified one
+ * gets its own copy. Updating an existing entry with data of the same size is
+ * done in place, without reallocating the buffer.
  */
 class CameraMetadata: public Parcelable {
   public:
@@ -49,11 +56,12 @@ class CameraMetadata: public Parcelable {
 
     /** Takes ownership of passed-in buffer */
     CameraMetadata(camera_metadata_t *buffer);
-    /** Clones the metadata */
+    /** Shares the metadata buffer of other until one of them is modified */
     CameraMetadata(const CameraMetadata &other);
 
     /**
-     * Assignment clones metadata buffer.
+     * Assignment from another CameraMetadata shares its metadata buffer until
+     * one of them is modified; assignment from a raw buffer clones it.
      */
     CameraMetadata &operator=(const CameraMetadata &other);
     CameraMetadata &operator=(const camera_metadata_t *buffer);
@@ -72,6 +80,15 @@ class CameraMetadata: public Parcelable {
      */
     const camera_metadata_t* getAndLock() const;
 
+    /**
+     * Same as above, but for callers that modify the returned buffer in place
+     * (e.g. to set the vendor id). A shared buffer is copied first, so that
+     * the modification is not visible through other CameraMetadata objects.
+     * Readers must use getAndLock(): the copy would free the buffer that
+     * entries previously returned by this object point to.
+     */
+    camera_metadata_t* getAndLockForUpdate();
+
     /**
      * Unlock the CameraMetadata for use again. After this unlock, the pointer
      * given from getAndLock() may no longer be used. The pointer passed out
@@ -171,7 +188,10 @@ class CameraMetadata: public Parcelable {
     bool exists(uint32_t tag) const;
 
     /**
-     * Get metadata entry by tag id
+     * Get metadata entry by tag id. The entry data may be modified in place,
+     * so a shared buffer is copied first; use the const version for reading.
+     * Until the next modification of this object, copies of it get their own
+     * buffer, so that writes through the entry are never seen by them.
      */
     camera_metadata_entry find(uint32_t tag);
 
@@ -243,8 +263,33 @@ class CameraMetadata: public Parcelable {
             const VendorTagDescriptor* vTags, uint32_t *tag);
 
   private:
+    typedef std::atomic<int32_t> ShareCount;
+
     camera_metadata_t *mBuffer;
     mutable bool       mLocked;
+    // Number of CameraMetadata objects sharing mBuffer. Allocated when the
+    // buffer is first copied; nullptr while this object owns it exclusively.
+    mutable std::atomic<ShareCount*> mShareCount;
+    // Set when entries writable in place have been handed out by find() or
+    // getAndLockForUpdate(); the buffer is then cloned instead of shared.
+    bool               mWritable;
+
+    /**
+     * Start sharing the buffer of other. This object must not hold a buffer.
+     */
+    void shareFrom(const CameraMetadata &other);
+
+    /**
+     * Make sure that this object owns its buffer exclusively, copying it if
+     * it is shared with other objects.
+     */
+    status_t unshare();
+
+    /**
+     * Drop this object's reference to its buffer, freeing the buffer if no
+     * other object shares it.
+     */
+    void releaseBuffer();
 
     /**
      * Check if tag has a given type
@@ -623,11 +623,48 @@ TEST_F(CameraClientBinderTest, CheckBinderCameraDeviceUser) {
         sleep(/*second*/1); // allow some time for errors to show up, if any
         EXPECT_FALSE(callbacks->hadError());
 
+        // Can we do it with a compiled request and per-request deltas?
+        int32_t templateHandle = -1;
+        res = device->compileRequestTemplate(request3, /*out*/&templateHandle);
+        EXPECT_TRUE(res.isOk()) << res;
+        std::vector<CameraMetadata> deltas(2);
+        uint8_t aeLock = ANDROID_CONTROL_AE_LOCK_ON;
+        deltas[1].update(ANDROID_CONTROL_AE_LOCK, &aeLock, 1);
+        callbacks->clearStatus();
+        hardware::camera2::utils::SubmitInfo info4;
+        res = device->submitRequestTemplate(templateHandle, deltas, /*streaming*/false,
+                /*out*/&info4);
+        EXPECT_TRUE(res.isOk()) << res;
+        EXPECT_LT(info3.mRequestId, info4.mRequestId);
+        EXPECT_TRUE(callbacks->waitForStatus(TestCameraDeviceCallbacks::SENT_RESULT));
+        EXPECT_TRUE(callbacks->waitForIdle());
+        EXPECT_LT(info3.mLastFrameNumber, info4.mLastFrameNumber);
+        sleep(/*second*/1); // allow some time for errors to show up, if any
+        EXPECT_FALSE(callbacks->hadError());
+
+        // A delta may not retarget the request
+        int32_t outputStreams[] = {streamId};
+        deltas[0].update(ANDROID_REQUEST_OUTPUT_STREAMS, outputStreams, 1);
+        res = device->submitRequestTemplate(templateHandle, deltas, /*streaming*/false,
+                /*out*/&info4);
+        EXPECT_EQ(ICameraService::ERROR_ILLEGAL_ARGUMENT,
+                res.serviceSpecificErrorCode());
+
         // Can we unconfigure?
         res = device->beginConfigure();
         EXPECT_TRUE(res.isOk()) << res;
         res = device->deleteStream(streamId);
         EXPECT_TRUE(res.isOk()) << res;
+
+        // The template went with the stream configuration
+        deltas.resize(1);
+        deltas[0].clear();
+        res = device->submitRequestTemplate(templateHandle, deltas, /*streaming*/false,
+                /*out*/&info4);
+        EXPECT_EQ(ICameraService::ERROR_ILLEGAL_ARGUMENT,
+                res.serviceSpecificErrorCode());
+        res = device->releaseRequestTemplate(templateHandle);
+        EXPECT_TRUE(res.isOk()) << res;
         res = device->endConfigure(/*isConstrainedHighSpeed*/ false, sessionParams,
                 &offlineStreamIds);
         EXPECT_TRUE(res.isOk()) << res;
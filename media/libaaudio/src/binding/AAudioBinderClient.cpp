@@ -205,3 +205,9 @@ aaudio_result_t AAudioBinderClient::unregisterAudioThread(aaudio_handle_t stream
     return service->unregisterAudioThread(streamHandle,
                                           clientThreadId);
 }
+
+aaudio_result_t AAudioBinderClient::setStreamVolume(aaudio_handle_t streamHandle, float volume) {
+    const sp<IAAudioService> service = getAAudioService();
+    if (service.get() == nullptr) return AAUDIO_ERROR_NO_SERVICE;
+    return service->setStreamVolume(streamHandle, volume);
+}
@@ -97,6 +97,8 @@ public:
     aaudio_result_t unregisterAudioThread(aaudio_handle_t streamHandle,
                                                   pid_t clientThreadId) override;
 
+    aaudio_result_t setStreamVolume(aaudio_handle_t streamHandle, float volume) override;
+
     aaudio_result_t startClient(aaudio_handle_t streamHandle __unused,
                                 const android::AudioClient& client __unused,
                                 const audio_attributes_t *attr __unused,
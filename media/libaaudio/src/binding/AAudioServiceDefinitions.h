@@ -39,7 +39,8 @@ enum aaudio_service_commands_t {
     STOP_STREAM,
     FLUSH_STREAM,
     REGISTER_AUDIO_THREAD,
-    UNREGISTER_AUDIO_THREAD
+    UNREGISTER_AUDIO_THREAD,
+    SET_STREAM_VOLUME
 };
 
 enum aaudio_client_commands_t {
@@ -88,6 +88,11 @@ public:
     virtual aaudio_result_t unregisterAudioThread(aaudio_handle_t streamHandle,
                                                   pid_t clientThreadId) = 0;
 
+    /**
+     * Set the volume of a shared stream, applied by the mixer in the service.
+     */
+    virtual aaudio_result_t setStreamVolume(aaudio_handle_t streamHandle, float volume) = 0;
+
     virtual aaudio_result_t startClient(aaudio_handle_t streamHandle,
                                         const android::AudioClient& client,
                                         const audio_attributes_t *attr,
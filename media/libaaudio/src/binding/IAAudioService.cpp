@@ -227,6 +227,23 @@ public:
         return res;
     }
 
+    virtual aaudio_result_t setStreamVolume(aaudio_handle_t streamHandle, float volume)
+    override {
+        Parcel data, reply;
+        // send command
+        data.writeInterfaceToken(IAAudioService::getInterfaceDescriptor());
+        data.writeInt32(streamHandle);
+        data.writeFloat(volume);
+        status_t err = remote()->transact(SET_STREAM_VOLUME, data, &reply);
+        if (err != NO_ERROR) {
+            return AAudioConvert_androidToAAudioResult(err);
+        }
+        // parse reply
+        aaudio_result_t res;
+        reply.readInt32(&res);
+        return res;
+    }
+
 };
 
 // Implement an interface to the service.
@@ -242,6 +259,7 @@ status_t BnAAudioService::onTransact(uint32_t code, const Parcel& data,
     aaudio::AAudioStreamConfiguration configuration;
     pid_t tid = 0;
     int64_t nanoseconds = 0;
+    float volume = 0.0f;
     aaudio_result_t result = AAUDIO_OK;
     status_t status = NO_ERROR;
     ALOGV("BnAAudioService::onTransact(%i) %i", code, flags);
@@ -415,6 +433,25 @@ status_t BnAAudioService::onTransact(uint32_t code, const Parcel& data,
             return NO_ERROR;
         } break;
 
+        case SET_STREAM_VOLUME: {
+            CHECK_INTERFACE(IAAudioService, data, reply);
+            status = data.readInt32(&streamHandle);
+            if (status != NO_ERROR) {
+                ALOGE("BnAAudioService::%s(SET_STREAM_VOLUME) streamHandle failed!", __func__);
+                return status;
+            }
+            status = data.readFloat(&volume);
+            if (status != NO_ERROR) {
+                ALOGE("BnAAudioService::%s(SET_STREAM_VOLUME) volume failed!", __func__);
+                return status;
+            }
+            result = setStreamVolume(streamHandle, volume);
+            ALOGV("BnAAudioService::onTransact SET_STREAM_VOLUME 0x%08X, result = %d",
+                    streamHandle, result);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
+
         default:
             // ALOGW("BnAAudioService::onTransact not handled %u", code);
             return BBinder::onTransact(code, data, reply, flags);
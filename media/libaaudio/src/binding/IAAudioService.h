@@ -95,6 +95,13 @@ public:
 
     virtual aaudio_result_t unregisterAudioThread(aaudio::aaudio_handle_t streamHandle,
                                                 pid_t clientThreadId) = 0;
+
+    /**
+     * Set the volume of a shared stream. The mixer ramps to it over a few bursts.
+     * MMAP streams are not mixed so they are scaled in the client.
+     */
+    virtual aaudio_result_t setStreamVolume(aaudio::aaudio_handle_t streamHandle,
+                                            float volume) = 0;
 };
 
 class BnAAudioService : public BnInterface<IAAudioService> {
@@ -19,9 +19,11 @@
 
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <string.h>
 #include <utils/Trace.h>
 
 #include "client/AudioStreamInternalPlay.h"
+#include "utility/AAudioUtilities.h"
 #include "utility/AudioClock.h"
 
 // We do this after the #includes because if a header uses ALOG.
@@ -49,6 +51,12 @@ constexpr int kRampMSec = 10; // time to apply a change in volume
 aaudio_result_t AudioStreamInternalPlay::open(const AudioStreamBuilder &builder) {
     aaudio_result_t result = AudioStreamInternal::open(builder);
     if (result == AAUDIO_OK) {
+        if (isInService() && getSamplesPerFrame() == getDeviceChannelCount()) {
+            // The shared mixer converts its output to the device format, see
+            // AAudioMixer::convertOutput(), so the data is copied as is.
+            setFormat(getDeviceFormat());
+            mPassThrough = true;
+        }
         result = mFlowGraph.configure(getFormat(),
                              getSamplesPerFrame(),
                              getDeviceFormat(),
@@ -230,9 +238,13 @@ aaudio_result_t AudioStreamInternalPlay::writeNowWithConversion(const void *buff
 
             int32_t numBytes = getBytesPerFrame() * framesToWrite;
 
-            mFlowGraph.process((void *)byteBuffer,
-                               wrappingBuffer.data[partIndex],
-                               framesToWrite);
+            if (mPassThrough) {
+                memcpy(wrappingBuffer.data[partIndex], byteBuffer, numBytes);
+            } else {
+                mFlowGraph.process((void *)byteBuffer,
+                                   wrappingBuffer.data[partIndex],
+                                   framesToWrite);
+            }
 
             byteBuffer += numBytes;
             framesLeft -= framesToWrite;
@@ -309,6 +321,12 @@ status_t AudioStreamInternalPlay::doSetVolume() {
     float combinedVolume = mStreamVolume * getDuckAndMuteVolume();
     ALOGD("%s() mStreamVolume * duckAndMuteVolume = %f * %f = %f",
           __func__, mStreamVolume, getDuckAndMuteVolume(), combinedVolume);
+    if (getSharingMode() == AAUDIO_SHARING_MODE_SHARED) {
+        // The mixer in the service ramps to the new volume.
+        aaudio_result_t result = mServiceInterface.setStreamVolume(mServiceStreamHandle,
+                                                                   combinedVolume);
+        return AAudioConvert_aaudioToAndroidStatus(result);
+    }
     mFlowGraph.setTargetVolume(combinedVolume);
     return android::NO_ERROR;
 }
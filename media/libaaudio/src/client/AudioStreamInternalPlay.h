@@ -93,6 +93,8 @@ private:
                                            int32_t numFrames);
 
     AAudioFlowGraph          mFlowGraph;
+    // Data is already in the device format, written by the shared mixer in the service.
+    bool                     mPassThrough = false;
 
 };
 
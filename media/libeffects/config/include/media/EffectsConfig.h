@@ -57,6 +57,7 @@ struct EffectImpl {
 struct Effect : public EffectImpl {
     std::string name;
     bool isProxy;
+    bool worker; //< Chains holding the effect are processed on a dedicated worker thread
     EffectImpl libSw; //< Only valid if isProxy
     EffectImpl libHw; //< Only valid if isProxy
 };
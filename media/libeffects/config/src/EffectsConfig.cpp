@@ -204,6 +204,7 @@ bool parseEffect(const XMLElement& xmlEffect, Libraries& libraries, Effects* eff
     if (!parseImpl(xmlEffect, effect)) {
         return false;
     }
+    effect.worker = xmlEffect.BoolAttribute("worker", false);
 
     // Handle proxy effects
     effect.isProxy = false;
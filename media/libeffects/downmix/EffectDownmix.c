@@ -26,11 +26,6 @@
 
 #include "EffectDownmix.h"
 
-// Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
-//#define DOWNMIX_TEST_CHANNEL_INDEX 0
-// Do not submit with DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER defined, strictly for testing
-//#define DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER 0
-
 #ifdef BUILD_FLOAT
 #define MINUS_3_DB_IN_FLOAT 0.70710678f // -3dB = 0.70710678f
 const audio_format_t gTargetFormat = AUDIO_FORMAT_PCM_FLOAT;
@@ -39,14 +34,46 @@ const audio_format_t gTargetFormat = AUDIO_FORMAT_PCM_FLOAT;
 const audio_format_t gTargetFormat = AUDIO_FORMAT_PCM_16_BIT;
 #endif
 
-// subset of possible audio_channel_mask_t values, and AUDIO_CHANNEL_OUT_* renamed to CHANNEL_MASK_*
+// Gains of each channel position to the left and right outputs, indexed by the position of the
+// channel bit in the mask. Left channels go to the left output, right channels to the right
+// output, and center and low frequency channels to both at -3dB. The folded signal is then
+// attenuated by 6dB, as the downmix always did.
+// The last four positions are those of 22.2, with no AUDIO_CHANNEL_OUT_* name in this release.
 typedef enum {
-    CHANNEL_MASK_QUAD_BACK = AUDIO_CHANNEL_OUT_QUAD_BACK,
-    CHANNEL_MASK_QUAD_SIDE = AUDIO_CHANNEL_OUT_QUAD_SIDE,
-    CHANNEL_MASK_5POINT1_BACK = AUDIO_CHANNEL_OUT_5POINT1_BACK,
-    CHANNEL_MASK_5POINT1_SIDE = AUDIO_CHANNEL_OUT_5POINT1_SIDE,
-    CHANNEL_MASK_7POINT1 = AUDIO_CHANNEL_OUT_7POINT1,
-} downmix_input_channel_mask_t;
+    GAIN_LEFT,
+    GAIN_RIGHT,
+    GAIN_CENTER,
+} downmix_gain_t;
+
+static const downmix_gain_t kPositionGains[DOWNMIX_MAX_INPUT_CHANNELS] = {
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_FRONT_LEFT            = 0x1u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_FRONT_RIGHT           = 0x2u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_FRONT_CENTER          = 0x4u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_LOW_FREQUENCY         = 0x8u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_BACK_LEFT             = 0x10u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_BACK_RIGHT            = 0x20u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER  = 0x40u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER = 0x80u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_BACK_CENTER           = 0x100u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_SIDE_LEFT             = 0x200u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_SIDE_RIGHT            = 0x400u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_TOP_CENTER            = 0x800u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT        = 0x1000u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER      = 0x2000u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT       = 0x4000u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_TOP_BACK_LEFT         = 0x8000u
+    GAIN_CENTER, // AUDIO_CHANNEL_OUT_TOP_BACK_CENTER       = 0x10000u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT        = 0x20000u
+    GAIN_LEFT,   // AUDIO_CHANNEL_OUT_TOP_SIDE_LEFT         = 0x40000u
+    GAIN_RIGHT,  // AUDIO_CHANNEL_OUT_TOP_SIDE_RIGHT        = 0x80000u
+    GAIN_LEFT,   // bottom front left                       = 0x100000u
+    GAIN_CENTER, // bottom front center                     = 0x200000u
+    GAIN_RIGHT,  // bottom front right                      = 0x400000u
+    GAIN_CENTER, // low frequency 2                         = 0x800000u
+};
+
+// channel positions that can be downmixed
+const uint32_t kSupportedPositions = (1u << DOWNMIX_MAX_INPUT_CHANNELS) - 1;
 
 // effect_handle_t interface implementation for downmix effect
 const struct effect_interface_s gDownmixInterface = {
@@ -101,98 +128,6 @@ static LVM_FLOAT clamp_float(LVM_FLOAT a) {
     }
 }
 #endif
-/*----------------------------------------------------------------------------
- * Test code
- *--------------------------------------------------------------------------*/
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
-// strictly for testing, logs the indices of the channels for a given mask,
-// uses the same code as Downmix_foldGeneric()
-void Downmix_testIndexComputation(uint32_t mask) {
-    ALOGI("Testing index computation for 0x%" PRIx32 ":", mask);
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return;
-        }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return;
-        }
-        hasBacks = true;
-    }
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    ALOGI("  FL FR FC LFE BL BR BC SL SR");
-    ALOGI("   %d  %d  %d   %d  %d  %d  %d  %d  %d",
-            0, 1, indexFC, indexLFE, indexBL, indexBR, indexBC, indexSL, indexSR);
-}
-#endif
-
-static bool Downmix_validChannelMask(uint32_t mask)
-{
-    if (!mask) {
-        return false;
-    }
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return false;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return false;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return false;
-        }
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return false;
-        }
-    }
-    return true;
-}
-
 /*----------------------------------------------------------------------------
  * Effect API implementation
  *--------------------------------------------------------------------------*/
@@ -210,26 +145,6 @@ int32_t DownmixLib_Create(const effect_uuid_t *uuid,
 
     ALOGV("DownmixLib_Create()");
 
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
-    // should work (won't log an error)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                    AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_QUAD_SIDE | CHANNEL_MASK_QUAD_BACK);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_SIDE | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_BACK | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // shouldn't work (will log an error, won't display channel indices)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should NOT work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                        AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                            AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_SIDE_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                        AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                            AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT);
-#endif
-
     if (pHandle == NULL || uuid == NULL) {
         return -EINVAL;
     }
@@ -339,7 +254,6 @@ static int Downmix_Process(effect_handle_t self,
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
-    const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
 
     switch(pDownmixer->type) {
 
@@ -364,36 +278,7 @@ static int Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-              return -EINVAL;
-          }
-          break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
-        }
+        Downmix_foldMatrix(pDownmixer, pSrc, pDst, numFrames, accumulate);
         break;
 
       default:
@@ -438,7 +323,6 @@ static int Downmix_Process(effect_handle_t self,
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
-    const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
 
     switch(pDownmixer->type) {
 
@@ -463,38 +347,7 @@ static int Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported",
-                    downmixInputChannelMask);
-              return -EINVAL;
-          }
-          break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported",
-                      downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
-        }
+        Downmix_foldMatrix(pDownmixer, pSrc, pDst, numFrames, accumulate);
         break;
 
       default:
@@ -777,16 +630,13 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
     if (init) {
         pDownmixer->type = DOWNMIX_TYPE_FOLD;
         pDownmixer->apply_volume_correction = false;
-        pDownmixer->input_channel_count = 8; // matches default input of AUDIO_CHANNEL_OUT_7POINT1
-    } else {
-        // when configuring the effect, do not allow a blank or unsupported channel mask
-        if (!Downmix_validChannelMask(pConfig->inputCfg.channels)) {
-            ALOGE("Downmix_Configure error: input channel mask(0x%x) not supported",
-                                                        pConfig->inputCfg.channels);
-            return -EINVAL;
-        }
-        pDownmixer->input_channel_count =
-                audio_channel_count_from_out_mask(pConfig->inputCfg.channels);
+    }
+    // when configuring the effect, do not allow a blank or unsupported channel mask,
+    // this also sets the channel count to that of the default AUDIO_CHANNEL_OUT_7POINT1 on init
+    if (!Downmix_setMatrix(pDownmixer, pConfig->inputCfg.channels)) {
+        ALOGE("Downmix_Configure error: input channel mask(0x%x) not supported",
+                                                    pConfig->inputCfg.channels);
+        return -EINVAL;
     }
 
     Downmix_Reset(pDownmixer, init);
@@ -924,89 +774,95 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFromQuad()
+ * Downmix_setMatrix()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a quad signal to stereo
+ * Compute the gains of each input channel to the stereo output, for any channel mask made of
+ * channel positions up to those of 22.2, and choose the kernel folding the input.
+ * The mask need not contain the front left and right channels, nor have its side and back
+ * channels in pairs: each channel goes to the output of its side, or to both if centered.
  *
  * Inputs:
- *  pSrc       quad audio samples to downmix
- *  numFrames  the number of quad frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
+ *  pDownmixer  pointer to downmix context
+ *  mask        the channel mask of the input
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *
+ * Returns: false if the channel mask is blank or has unsupported channels, in which case the
+ *  context is not modified
+ *
+ * Side Effects:
+ *  updates:
+ *           pDownmixer->input_channel_count
+ *           pDownmixer->matrix
+ *           pDownmixer->fold
  *
  *----------------------------------------------------------------------------
  */
-#ifndef BUILD_FLOAT
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is RL
-    // sample at index 3 is RR
-    if (accumulate) {
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16(pDst[0] + ((pSrc[0] + pSrc[2]) >> 1));
-            // FR + RR
-            pDst[1] = clamp16(pDst[1] + ((pSrc[1] + pSrc[3]) >> 1));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16((pSrc[0] + pSrc[2]) >> 1);
-            // FR + RR
-            pDst[1] = clamp16((pSrc[1] + pSrc[3]) >> 1);
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
+bool Downmix_setMatrix(downmix_object_t *pDownmixer, uint32_t mask) {
+    if (mask == 0) {
+        return false;
     }
-}
+    if ((mask & ~kSupportedPositions) != 0) {
+        ALOGE("Unsupported channels in mask 0x%" PRIx32, mask);
+        return false;
+    }
+
+    // gains of the quad and 5.1 layouts, which have their own kernels
+    static const downmix_gain_t kQuadGains[] = {GAIN_LEFT, GAIN_RIGHT, GAIN_LEFT, GAIN_RIGHT};
+    static const downmix_gain_t k5Point1Gains[] = {
+            GAIN_LEFT, GAIN_RIGHT, GAIN_CENTER, GAIN_CENTER, GAIN_LEFT, GAIN_RIGHT};
+    bool isQuad = __builtin_popcount(mask) == 4;
+    bool is5Point1 = __builtin_popcount(mask) == 6;
+
+    int channel = 0;
+    for (uint32_t positions = mask; positions != 0; positions &= positions - 1, channel++) {
+        const int position = __builtin_ctz(positions);
+        isQuad = isQuad && kPositionGains[position] == kQuadGains[channel];
+        is5Point1 = is5Point1 && kPositionGains[position] == k5Point1Gains[channel];
+#ifdef BUILD_FLOAT
+        const LVM_FLOAT one = 1.0f;
+        const LVM_FLOAT minus3dB = MINUS_3_DB_IN_FLOAT;
 #else
-void Downmix_foldFromQuad(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is RL
-    // sample at index 3 is RR
-    if (accumulate) {
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp_float(pDst[0] + ((pSrc[0] + pSrc[2]) / 2.0f));
-            // FR + RR
-            pDst[1] = clamp_float(pDst[1] + ((pSrc[1] + pSrc[3]) / 2.0f));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp_float((pSrc[0] + pSrc[2]) / 2.0f);
-            // FR + RR
-            pDst[1] = clamp_float((pSrc[1] + pSrc[3]) / 2.0f);
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
+        const int32_t one = 1 << 12;
+        const int32_t minus3dB = MINUS_3_DB_IN_Q19_12;
+#endif
+        switch (kPositionGains[position]) {
+        case GAIN_LEFT:
+            pDownmixer->matrix[0][channel] = one;
+            pDownmixer->matrix[1][channel] = 0;
+            break;
+        case GAIN_RIGHT:
+            pDownmixer->matrix[0][channel] = 0;
+            pDownmixer->matrix[1][channel] = one;
+            break;
+        case GAIN_CENTER:
+            pDownmixer->matrix[0][channel] = minus3dB;
+            pDownmixer->matrix[1][channel] = minus3dB;
+            break;
         }
     }
+    pDownmixer->input_channel_count = channel;
+    pDownmixer->fold = isQuad ? DOWNMIX_FOLD_QUAD
+            : is5Point1 ? DOWNMIX_FOLD_5POINT1 : DOWNMIX_FOLD_MATRIX;
+    return true;
 }
-#endif
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom5Point1()
+ * Downmix_foldMatrix()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a 5.1 signal to stereo
+ * downmix to stereo a multichannel signal, with the gains computed by Downmix_setMatrix()
+ *
+ * Inputs with the gains of quad or 5.1 go to Downmix_foldFromQuad() and
+ * Downmix_foldFrom5Point1().
+ * The channel loop of Downmix_foldMatrixN() is unrolled for the common channel counts. In the
+ * float build, it folds two frames at once, with 4 channels in each vector register.
  *
  * Inputs:
- *  pSrc       5.1 audio samples to downmix
- *  numFrames  the number of 5.1 frames to downmix
+ *  pDownmixer pointer to downmix context
+ *  pSrc       multichannel audio buffer to downmix
+ *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
@@ -1016,417 +872,273 @@ void Downmix_foldFromQuad(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bo
  *----------------------------------------------------------------------------
  */
 #ifndef BUILD_FLOAT
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+static inline __attribute__((always_inline)) void Downmix_foldMatrixN(
+        const int32_t *gainsL, const int32_t *gainsR, const int16_t *pSrc, int16_t *pDst,
+        size_t numFrames, bool accumulate, const int numChan) {
+    // accumulate in 64 bits, as 24 channels at full scale overflow Q19.12
+    while (numFrames) {
+        int64_t lt = 0;
+        int64_t rt = 0;
+        for (int i = 0; i < numChan; i++) {
+            lt += pSrc[i] * gainsL[i];
+            rt += pSrc[i] * gainsR[i];
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+        if (accumulate) {
+            pDst[0] = clamp16(pDst[0] + (int32_t)(lt >> 13));
+            pDst[1] = clamp16(pDst[1] + (int32_t)(rt >> 13));
+        } else {
+            pDst[0] = clamp16(lt >> 13);
+            pDst[1] = clamp16(rt >> 13);
         }
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
     }
 }
-#else
-void Downmix_foldFrom5Point1(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
-    LVM_FLOAT lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_FLOAT)
-                    + (pSrc[3] * MINUS_3_DB_IN_FLOAT);
-            // FL + centerPlusLfeContrib + RL
-            lt = pSrc[0] + centerPlusLfeContrib + pSrc[4];
-            // FR + centerPlusLfeContrib + RR
-            rt = pSrc[1] + centerPlusLfeContrib + pSrc[5];
-            // accumulate in destination
-            pDst[0] = clamp_float(pDst[0] + (lt / 2.0f));
-            pDst[1] = clamp_float(pDst[1] + (rt / 2.0f));
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_FLOAT)
-                    + (pSrc[3] * MINUS_3_DB_IN_FLOAT);
-            // FL + centerPlusLfeContrib + RL
-            lt = pSrc[0] + centerPlusLfeContrib + pSrc[4];
-            // FR + centerPlusLfeContrib + RR
-            rt = pSrc[1] + centerPlusLfeContrib + pSrc[5];
-            // store in destination
-            pDst[0] = clamp_float(lt / 2.0f); // differs from when accumulate is true above
-            pDst[1] = clamp_float(rt / 2.0f); // differs from when accumulate is true above
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
-        }
+
+// Kernels for inputs with the gains of quad (FL, FR, BL, BR) and 5.1 (FL, FR, FC, LFE, BL, BR),
+// the most common inputs, for which Downmix_foldMatrixN() is slower. accumulate is a constant
+// where they are inlined, so that the loops are compiled without the test.
+static inline __attribute__((always_inline)) void Downmix_foldFromQuad(
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, const bool accumulate) {
+    // sample at index 0 is FL, 1 is FR, 2 is RL, 3 is RR
+    while (numFrames) {
+        // FL + RL
+        const int32_t lt = (pSrc[0] + pSrc[2]) >> 1;
+        // FR + RR
+        const int32_t rt = (pSrc[1] + pSrc[3]) >> 1;
+        pDst[0] = clamp16(accumulate ? pDst[0] + lt : lt);
+        pDst[1] = clamp16(accumulate ? pDst[1] + rt : rt);
+        pSrc += 4;
+        pDst += 2;
+        numFrames--;
     }
 }
-#endif
 
-/*----------------------------------------------------------------------------
- * Downmix_foldFrom7Point1()
- *----------------------------------------------------------------------------
- * Purpose:
- * downmix a 7.1 signal to stereo
- *
- * Inputs:
- *  pSrc       7.1 audio samples to downmix
- *  numFrames  the number of 7.1 frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- *----------------------------------------------------------------------------
- */
-#ifndef BUILD_FLOAT
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // sample at index 6 is SL
-    // sample at index 7 is SR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            //accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-    }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-        }
+static inline __attribute__((always_inline)) void Downmix_foldFrom5Point1(
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, const bool accumulate) {
+    // sample at index 0 is FL, 1 is FR, 2 is FC, 3 is LFE, 4 is RL, 5 is RR
+    while (numFrames) {
+        // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB), in Q19.12
+        const int32_t centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
+                + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
+        // FL + centerPlusLfeContrib + RL
+        const int32_t lt = ((pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12)) >> 13;
+        // FR + centerPlusLfeContrib + RR
+        const int32_t rt = ((pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12)) >> 13;
+        pDst[0] = clamp16(accumulate ? pDst[0] + lt : lt);
+        pDst[1] = clamp16(accumulate ? pDst[1] + rt : rt);
+        pSrc += 6;
+        pDst += 2;
+        numFrames--;
     }
 }
+void Downmix_foldMatrix(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate) {
+    const int32_t *gainsL = pDownmixer->matrix[0];
+    const int32_t *gainsR = pDownmixer->matrix[1];
 #else
-void Downmix_foldFrom7Point1(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
-    LVM_FLOAT lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // sample at index 6 is SL
-    // sample at index 7 is SR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_FLOAT)
-                    + (pSrc[3] * MINUS_3_DB_IN_FLOAT);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = pSrc[0] + centerPlusLfeContrib + pSrc[6] + pSrc[4];
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = pSrc[1] + centerPlusLfeContrib + pSrc[7] + pSrc[5];
-            //accumulate in destination
-            pDst[0] = clamp_float(pDst[0] + (lt / 2.0f));
-            pDst[1] = clamp_float(pDst[1] + (rt / 2.0f));
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
+// 4 lanes, mapped by the compiler to NEON or SSE registers
+typedef LVM_FLOAT downmix_vec_t __attribute__((vector_size(4 * sizeof(LVM_FLOAT))));
+
+// input frames and gains have no alignment
+static inline __attribute__((always_inline)) downmix_vec_t Downmix_loadVec(const LVM_FLOAT *p) {
+    downmix_vec_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// lanes of an int32_t vector are all ones where a comparison of downmix_vec_t lanes holds
+typedef int32_t downmix_mask_t __attribute__((vector_size(4 * sizeof(int32_t))));
+
+// same as clamp_float() on each lane, without branches
+static inline __attribute__((always_inline)) downmix_vec_t Downmix_clampVec(downmix_vec_t v) {
+    const downmix_vec_t one = {1.0f, 1.0f, 1.0f, 1.0f};
+    const downmix_vec_t minusOne = -one;
+    const downmix_mask_t above = v > one;
+    const downmix_mask_t below = v < minusOne;
+    return (downmix_vec_t)(((downmix_mask_t)v & ~(above | below))
+            | ((downmix_mask_t)one & above) | ((downmix_mask_t)minusOne & below));
+}
+
+// {a0 + a1, a2 + a3, b0 + b1, b2 + b3}
+static inline __attribute__((always_inline)) downmix_vec_t Downmix_pairwiseAdd(
+        downmix_vec_t a, downmix_vec_t b) {
+    return __builtin_shufflevector(a, b, 0, 2, 4, 6) + __builtin_shufflevector(a, b, 1, 3, 5, 7);
+}
+
+static inline __attribute__((always_inline)) void Downmix_foldMatrixN(
+        const LVM_FLOAT *gainsL, const LVM_FLOAT *gainsR, const LVM_FLOAT *pSrc, LVM_FLOAT *pDst,
+        size_t numFrames, bool accumulate, const int numChan) {
+    // groups of 4 channels in vector lanes, then the remaining channels. The gains are copied
+    // to locals, which stay in registers as the stores to pDst cannot modify them.
+    const int numVec = numChan / 4;
+    downmix_vec_t gainsVecL[DOWNMIX_MAX_INPUT_CHANNELS / 4];
+    downmix_vec_t gainsVecR[DOWNMIX_MAX_INPUT_CHANNELS / 4];
+    LVM_FLOAT gainsTailL[3];
+    LVM_FLOAT gainsTailR[3];
+    for (int v = 0; v < numVec; v++) {
+        gainsVecL[v] = Downmix_loadVec(gainsL + 4 * v);
+        gainsVecR[v] = Downmix_loadVec(gainsR + 4 * v);
+    }
+    for (int i = 4 * numVec; i < numChan; i++) {
+        gainsTailL[i - 4 * numVec] = gainsL[i];
+        gainsTailR[i - 4 * numVec] = gainsR[i];
+    }
+    // two frames at a time, so that the sums of the lanes give the 4 output samples at once.
+    // A last odd frame is folded twice, and its second result dropped.
+    while (numFrames) {
+        const LVM_FLOAT *pSrc1 = numFrames > 1 ? pSrc + numChan : pSrc;
+        downmix_vec_t lt0 = {0, 0, 0, 0};
+        downmix_vec_t rt0 = {0, 0, 0, 0};
+        downmix_vec_t lt1 = {0, 0, 0, 0};
+        downmix_vec_t rt1 = {0, 0, 0, 0};
+        for (int v = 0; v < numVec; v++) {
+            const downmix_vec_t src0 = Downmix_loadVec(pSrc + 4 * v);
+            const downmix_vec_t src1 = Downmix_loadVec(pSrc1 + 4 * v);
+            lt0 += src0 * gainsVecL[v];
+            rt0 += src0 * gainsVecR[v];
+            lt1 += src1 * gainsVecL[v];
+            rt1 += src1 * gainsVecR[v];
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_FLOAT)
-                    + (pSrc[3] * MINUS_3_DB_IN_FLOAT);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = pSrc[0] + centerPlusLfeContrib + pSrc[6] + pSrc[4];
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = pSrc[1] + centerPlusLfeContrib + pSrc[7] + pSrc[5];
-            // store in destination
-            pDst[0] = clamp_float(lt / 2.0f); // differs from when accumulate is true above
-            pDst[1] = clamp_float(rt / 2.0f); // differs from when accumulate is true above
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
+        // {lt0, rt0, lt1, rt1}
+        downmix_vec_t out = Downmix_pairwiseAdd(
+                Downmix_pairwiseAdd(lt0, rt0), Downmix_pairwiseAdd(lt1, rt1));
+        for (int i = 4 * numVec; i < numChan; i++) {
+            out[0] += pSrc[i] * gainsTailL[i - 4 * numVec];
+            out[1] += pSrc[i] * gainsTailR[i - 4 * numVec];
+            out[2] += pSrc1[i] * gainsTailL[i - 4 * numVec];
+            out[3] += pSrc1[i] * gainsTailR[i - 4 * numVec];
         }
+        out *= 0.5f;
+        if (numFrames == 1) {
+            pDst[0] = clamp_float(accumulate ? pDst[0] + out[0] : out[0]);
+            pDst[1] = clamp_float(accumulate ? pDst[1] + out[1] : out[1]);
+            break;
+        }
+        if (accumulate) {
+            out += Downmix_loadVec(pDst);
+        }
+        out = Downmix_clampVec(out);
+        memcpy(pDst, &out, sizeof(out));
+        pSrc += 2 * numChan;
+        pDst += 4;
+        numFrames -= 2;
     }
 }
-#endif
-/*----------------------------------------------------------------------------
- * Downmix_foldGeneric()
- *----------------------------------------------------------------------------
- * Purpose:
- * downmix to stereo a multichannel signal whose format is:
- *  - has FL/FR
- *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
- *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
- * Only handles channel masks not enumerated in downmix_input_channel_mask_t
- *
- * Inputs:
- *  mask       the channel mask of pSrc
- *  pSrc       multichannel audio buffer to downmix
- *  numFrames  the number of multichannel frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- * Returns: false if multichannel format is not supported
- *
- *----------------------------------------------------------------------------
- */
-#ifndef BUILD_FLOAT
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
 
-    if (!Downmix_validChannelMask(mask)) {
-        return false;
+// Kernels for inputs with the gains of quad (FL, FR, BL, BR) and 5.1 (FL, FR, FC, LFE, BL, BR),
+// the most common inputs, for which Downmix_foldMatrixN() is slower. They fold two frames at
+// once, with the lanes of the output vector being {L0, R0, L1, R1}, and give the same results
+// as the scalar folds of the int16 build. accumulate is a constant where they are inlined.
+static inline __attribute__((always_inline)) void Downmix_storeFrames(
+        downmix_vec_t out, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
+    if (numFrames == 1) {
+        pDst[0] = clamp_float(accumulate ? pDst[0] + out[0] : out[0]);
+        pDst[1] = clamp_float(accumulate ? pDst[1] + out[1] : out[1]);
+        return;
     }
-
-    const bool hasSides = (mask & kSides) != 0;
-    const bool hasBacks = (mask & kBacks) != 0;
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    int32_t lt, rt, centersLfeContrib; // samples in Q19.12 format
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
     if (accumulate) {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
-        }
-    } else {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
+        out += Downmix_loadVec(pDst);
+    }
+    out = Downmix_clampVec(out);
+    memcpy(pDst, &out, sizeof(out));
+}
+
+static inline __attribute__((always_inline)) void Downmix_foldFromQuad(
+        const LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, const bool accumulate) {
+    // {FL, FR, BL, BR} of each frame. A last odd frame is folded twice.
+    while (numFrames) {
+        const downmix_vec_t frame0 = Downmix_loadVec(pSrc);
+        const downmix_vec_t frame1 = Downmix_loadVec(numFrames > 1 ? pSrc + 4 : pSrc);
+        // FL + BL, FR + BR
+        const downmix_vec_t out = (__builtin_shufflevector(frame0, frame1, 0, 1, 4, 5)
+                + __builtin_shufflevector(frame0, frame1, 2, 3, 6, 7)) * 0.5f;
+        Downmix_storeFrames(out, pDst, numFrames, accumulate);
+        if (numFrames == 1) {
+            break;
         }
+        pSrc += 8;
+        pDst += 4;
+        numFrames -= 2;
     }
-    return true;
 }
-#else
-bool Downmix_foldGeneric(
-        uint32_t mask, LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
 
-    if (!Downmix_validChannelMask(mask)) {
-        return false;
+static inline __attribute__((always_inline)) void Downmix_foldFrom5Point1(
+        const LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, const bool accumulate) {
+    // {FL, FR, FC, LFE} and {FC, LFE, BL, BR} of each frame. A last odd frame is folded twice.
+    const downmix_vec_t minus3dB = {MINUS_3_DB_IN_FLOAT, MINUS_3_DB_IN_FLOAT,
+            MINUS_3_DB_IN_FLOAT, MINUS_3_DB_IN_FLOAT};
+    while (numFrames) {
+        const LVM_FLOAT *pSrc1 = numFrames > 1 ? pSrc + 6 : pSrc;
+        const downmix_vec_t front0 = Downmix_loadVec(pSrc);
+        const downmix_vec_t front1 = Downmix_loadVec(pSrc1);
+        const downmix_vec_t back0 = Downmix_loadVec(pSrc + 2);
+        const downmix_vec_t back1 = Downmix_loadVec(pSrc1 + 2);
+        // FC(-3dB) + LFE(-3dB)
+        const downmix_vec_t centerPlusLfeContrib =
+                __builtin_shufflevector(back0, back1, 0, 0, 4, 4) * minus3dB
+                + __builtin_shufflevector(back0, back1, 1, 1, 5, 5) * minus3dB;
+        // FL + centerPlusLfeContrib + BL, FR + centerPlusLfeContrib + BR
+        const downmix_vec_t out = (__builtin_shufflevector(front0, front1, 0, 1, 4, 5)
+                + centerPlusLfeContrib
+                + __builtin_shufflevector(back0, back1, 2, 3, 6, 7)) * 0.5f;
+        Downmix_storeFrames(out, pDst, numFrames, accumulate);
+        if (numFrames == 1) {
+            break;
+        }
+        pSrc += 12;
+        pDst += 4;
+        numFrames -= 2;
     }
+}
 
-    const bool hasSides = (mask & kSides) != 0;
-    const bool hasBacks = (mask & kBacks) != 0;
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    LVM_FLOAT lt, rt, centersLfeContrib;
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_FLOAT;
-            // always has FL/FR
-            lt = pSrc[0];
-            rt = pSrc[1];
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL];
-                rt += pSrc[indexSR];
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL];
-                rt += pSrc[indexBR];
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // accumulate in destination
-            pDst[0] = clamp_float(pDst[0] + (lt / 2.0f));
-            pDst[1] = clamp_float(pDst[1] + (rt / 2.0f));
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
+void Downmix_foldMatrix(const downmix_object_t *pDownmixer,
+        const LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate) {
+    const LVM_FLOAT *gainsL = pDownmixer->matrix[0];
+    const LVM_FLOAT *gainsR = pDownmixer->matrix[1];
+#endif
+    switch (pDownmixer->fold) {
+    case DOWNMIX_FOLD_QUAD:
+        if (accumulate) {
+            Downmix_foldFromQuad(pSrc, pDst, numFrames, true);
+        } else {
+            Downmix_foldFromQuad(pSrc, pDst, numFrames, false);
         }
-    } else {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_FLOAT;
-            // always has FL/FR
-            lt = pSrc[0];
-            rt = pSrc[1];
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL];
-                rt += pSrc[indexSR];
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL];
-                rt += pSrc[indexBR];
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // store in destination
-            pDst[0] = clamp_float(lt / 2.0f); // differs from when accumulate is true above
-            pDst[1] = clamp_float(rt / 2.0f); // differs from when accumulate is true above
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
+        return;
+    case DOWNMIX_FOLD_5POINT1:
+        if (accumulate) {
+            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, true);
+        } else {
+            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, false);
         }
+        return;
+    case DOWNMIX_FOLD_MATRIX:
+        break;
     }
-    return true;
+
+    // a constant channel count lets the compiler unroll and vectorize the channel loop
+#define DOWNMIX_FOLD_CASE(n) \
+    case n: \
+        Downmix_foldMatrixN(gainsL, gainsR, pSrc, pDst, numFrames, accumulate, n); \
+        break;
+
+    switch (pDownmixer->input_channel_count) {
+    DOWNMIX_FOLD_CASE(1)
+    DOWNMIX_FOLD_CASE(2)
+    DOWNMIX_FOLD_CASE(3)
+    DOWNMIX_FOLD_CASE(4)
+    DOWNMIX_FOLD_CASE(5)
+    DOWNMIX_FOLD_CASE(6)
+    DOWNMIX_FOLD_CASE(7)
+    DOWNMIX_FOLD_CASE(8)  // 7.1, 5.1.2
+    DOWNMIX_FOLD_CASE(10) // 5.1.4, 7.1.2
+    DOWNMIX_FOLD_CASE(12) // 7.1.4
+    DOWNMIX_FOLD_CASE(24) // 22.2
+    default:
+        Downmix_foldMatrixN(gainsL, gainsR, pSrc, pDst, numFrames, accumulate,
+                pDownmixer->input_channel_count);
+        break;
+    }
+#undef DOWNMIX_FOLD_CASE
 }
-#endif
@@ -36,12 +36,30 @@ typedef enum {
     DOWNMIX_STATE_ACTIVE,
 } downmix_state_t;
 
+// largest input channel count, for 22.2 which uses the 24 first channel positions
+#define DOWNMIX_MAX_INPUT_CHANNELS 24
+
+// kernel folding the input, chosen by Downmix_setMatrix() from the gains of the input channels
+typedef enum {
+    DOWNMIX_FOLD_MATRIX,   // any mask, with the gains of the matrix
+    DOWNMIX_FOLD_QUAD,     // gains of quad: left, right, left, right
+    DOWNMIX_FOLD_5POINT1,  // gains of 5.1: left, right, center, center, left, right
+} downmix_fold_t;
+
 /* parameters for each downmixer */
 typedef struct {
     downmix_state_t state;
     downmix_type_t type;
     bool apply_volume_correction;
     uint8_t input_channel_count;
+    downmix_fold_t fold;
+    // gains of each input channel to the left (row 0) and right (row 1) outputs, in the order of
+    // the channels in the input, computed from the input channel mask by Downmix_setMatrix()
+#ifdef BUILD_FLOAT
+    LVM_FLOAT matrix[2][DOWNMIX_MAX_INPUT_CHANNELS];
+#else
+    int32_t matrix[2][DOWNMIX_MAX_INPUT_CHANNELS]; // Q19.12
+#endif
 } downmix_object_t;
 
 
@@ -51,18 +69,6 @@ typedef struct downmix_module_s {
     downmix_object_t context;
 } downmix_module_t;
 
-const uint32_t kSides = AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT;
-const uint32_t kBacks = AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT;
-const uint32_t kUnsupported =
-        AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER | AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT |
-        AUDIO_CHANNEL_OUT_TOP_BACK_LEFT |
-        AUDIO_CHANNEL_OUT_TOP_BACK_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT;
-
 /*------------------------------------
  * Effect API
  *------------------------------------
@@ -97,18 +103,13 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
 int Downmix_Reset(downmix_object_t *pDownmixer, bool init);
 int Downmix_setParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t size, void *pValue);
 int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *pSize, void *pValue);
+bool Downmix_setMatrix(downmix_object_t *pDownmixer, uint32_t mask);
 #ifdef BUILD_FLOAT
-void Downmix_foldFromQuad(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom5Point1(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom7Point1(LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate);
-bool Downmix_foldGeneric(
-        uint32_t mask, LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate);
+void Downmix_foldMatrix(const downmix_object_t *pDownmixer,
+        const LVM_FLOAT *pSrc, LVM_FLOAT *pDst, size_t numFrames, bool accumulate);
 #else
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
+void Downmix_foldMatrix(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate);
 #endif
 
 #endif /*ANDROID_EFFECTDOWNMIX_H_*/
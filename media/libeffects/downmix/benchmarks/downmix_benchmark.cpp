@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the fold of the Downmix effect through its library interface, for 20 ms blocks
+// at 48 kHz.
+//
+// Run with:
+//   downmix_benchmark
+// The arguments are the input channel mask and whether the output is accumulated.
+
+#include <random>
+#include <vector>
+
+#include <audio_effects/effect_downmix.h>
+#include <benchmark/benchmark.h>
+#include <effect_benchmark/BlockTimes.h>
+#include <hardware/audio_effect.h>
+#include <system/audio.h>
+
+extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+static constexpr uint32_t kSampleRate = 48000;
+static constexpr size_t kFrameCount = 960;
+static constexpr effect_uuid_t kDownmixUuid =
+        {0x93f04452, 0xe4fe, 0x41cc, 0x91f9, {0xe4, 0x75, 0xb6, 0xd1, 0xd6, 0x9f}};
+
+// 22.2 uses the 24 first channel positions, not all named in system/audio.h
+static constexpr uint32_t kChannelMask22Point2 = (1u << 24) - 1;
+
+static constexpr uint32_t kChannelMasks[] = {
+    AUDIO_CHANNEL_OUT_QUAD,
+    AUDIO_CHANNEL_OUT_5POINT1,
+    AUDIO_CHANNEL_OUT_7POINT1,
+    AUDIO_CHANNEL_OUT_5POINT1POINT2,
+    AUDIO_CHANNEL_OUT_7POINT1POINT4,
+    kChannelMask22Point2,
+};
+
+static effect_handle_t createDownmix(uint32_t channelMask, bool accumulate) {
+    effect_handle_t effect;
+    if (AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(
+            &kDownmixUuid, 1 /* sessionId */, 1 /* ioId */, &effect) != 0) {
+        return nullptr;
+    }
+    effect_config_t config{};
+    config.inputCfg.samplingRate = config.outputCfg.samplingRate = kSampleRate;
+    config.inputCfg.channels = channelMask;
+    config.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    config.inputCfg.format = config.outputCfg.format = AUDIO_FORMAT_PCM_FLOAT;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.outputCfg.accessMode =
+            accumulate ? EFFECT_BUFFER_ACCESS_ACCUMULATE : EFFECT_BUFFER_ACCESS_WRITE;
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    if ((*effect)->command(effect, EFFECT_CMD_SET_CONFIG, sizeof(config), &config,
+            &replySize, &reply) != 0 || reply != 0 ||
+            (*effect)->command(effect, EFFECT_CMD_ENABLE, 0, nullptr, &replySize, &reply) != 0) {
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+        return nullptr;
+    }
+    return effect;
+}
+
+static void BM_DownmixFold(benchmark::State& state) {
+    const uint32_t channelMask = state.range(0);
+    const bool accumulate = state.range(1) != 0;
+    const size_t channelCount = audio_channel_count_from_out_mask(channelMask);
+
+    effect_handle_t effect = createDownmix(channelMask, accumulate);
+    if (effect == nullptr) {
+        state.SkipWithError("cannot create the downmix");
+        return;
+    }
+    std::vector<float> input(kFrameCount * channelCount);
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    for (auto& sample : input) {
+        sample = distribution(generator);
+    }
+    std::vector<float> output(kFrameCount * FCC_2);
+    audio_buffer_t inBuffer;
+    inBuffer.frameCount = kFrameCount;
+    inBuffer.f32 = input.data();
+    audio_buffer_t outBuffer;
+    outBuffer.frameCount = kFrameCount;
+    outBuffer.f32 = output.data();
+    android::effect_benchmark::BlockTimes blockTimes(kFrameCount * 1e6 / kSampleRate);
+
+    for (auto _ : state) {
+        blockTimes.time([&]() {
+            (*effect)->process(effect, &inBuffer, &outBuffer);
+            benchmark::DoNotOptimize(output.data());
+        });
+    }
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+
+    blockTimes.setCounters(state);
+    state.SetItemsProcessed(state.iterations() * kFrameCount);
+}
+
+static void DownmixArgs(benchmark::internal::Benchmark *b) {
+    for (uint32_t channelMask : kChannelMasks) {
+        for (int accumulate : {0, 1}) {
+            b->Args({channelMask, accumulate});
+        }
+    }
+}
+
+BENCHMARK(BM_DownmixFold)->Apply(DownmixArgs);
+
+BENCHMARK_MAIN();
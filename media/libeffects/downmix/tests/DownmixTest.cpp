@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <audio_effects/effect_downmix.h>
+#include <gtest/gtest.h>
+#include <hardware/audio_effect.h>
+#include <system/audio.h>
+
+extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+namespace {
+
+const effect_uuid_t kDownmixUuid =
+        { 0x93f04452, 0xe4fe, 0x41cc, 0x91f9, { 0xe4, 0x75, 0xb6, 0xd1, 0xd6, 0x9f } };
+
+// odd, to also fold the last frame of a pair alone
+constexpr size_t kFrameCount = 255;
+
+enum Gain { LEFT, RIGHT, CENTER };
+
+class Downmix {
+  public:
+    ~Downmix() {
+        if (mHandle != nullptr) {
+            AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(mHandle);
+        }
+    }
+
+    // Returns the status of EFFECT_CMD_SET_CONFIG with the given input mask.
+    int configure(audio_channel_mask_t inputMask, bool accumulate = false) {
+        if (mHandle == nullptr && AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(
+                &kDownmixUuid, 0 /* sessionId */, 0 /* ioId */, &mHandle) != 0) {
+            return -ENODEV;
+        }
+        effect_config_t config = {};
+        config.inputCfg.samplingRate = config.outputCfg.samplingRate = 48000;
+        config.inputCfg.channels = inputMask;
+        config.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+        config.inputCfg.format = config.outputCfg.format = AUDIO_FORMAT_PCM_FLOAT;
+        config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+        config.outputCfg.accessMode =
+                accumulate ? EFFECT_BUFFER_ACCESS_ACCUMULATE : EFFECT_BUFFER_ACCESS_WRITE;
+        config.inputCfg.mask = config.outputCfg.mask = EFFECT_CONFIG_ALL;
+        int reply = 0;
+        uint32_t replySize = sizeof(reply);
+        int status = (*mHandle)->command(mHandle, EFFECT_CMD_SET_CONFIG, sizeof(config),
+                                         &config, &replySize, &reply);
+        if (status != 0 || reply != 0) {
+            return status != 0 ? status : reply;
+        }
+        replySize = sizeof(reply);
+        return (*mHandle)->command(mHandle, EFFECT_CMD_ENABLE, 0, nullptr, &replySize, &reply);
+    }
+
+    int process(const std::vector<float>& in, std::vector<float>* out) {
+        audio_buffer_t inBuffer;
+        inBuffer.frameCount = kFrameCount;
+        inBuffer.f32 = const_cast<float *>(in.data());
+        audio_buffer_t outBuffer;
+        outBuffer.frameCount = kFrameCount;
+        outBuffer.f32 = out->data();
+        return (*mHandle)->process(mHandle, &inBuffer, &outBuffer);
+    }
+
+  private:
+    effect_handle_t mHandle = nullptr;
+};
+
+std::vector<float> makeInput(size_t channelCount) {
+    std::vector<float> input(kFrameCount * channelCount);
+    srand(1);
+    for (float& sample : input) {
+        sample = 1.5f * rand() / RAND_MAX - 0.75f;
+    }
+    return input;
+}
+
+// The fold computed sample by sample: each channel goes to the output of its side, or to both
+// at -3dB if centered, and the sum is attenuated by 6dB.
+std::vector<float> referenceFold(const std::vector<float>& in, const std::vector<Gain>& gains,
+                                 const std::vector<float>& out, bool accumulate) {
+    const float minus3dB = sqrtf(0.5f);
+    std::vector<float> expected(out);
+    for (size_t frame = 0; frame < kFrameCount; frame++) {
+        double lt = 0;
+        double rt = 0;
+        for (size_t channel = 0; channel < gains.size(); channel++) {
+            const double sample = in[frame * gains.size() + channel];
+            if (gains[channel] == CENTER) {
+                lt += sample * minus3dB;
+                rt += sample * minus3dB;
+            } else {
+                (gains[channel] == LEFT ? lt : rt) += sample;
+            }
+        }
+        for (int side = 0; side < 2; side++) {
+            const double sum = (side == 0 ? lt : rt) / 2 + (accumulate ? out[2 * frame + side] : 0);
+            expected[2 * frame + side] = fmin(fmax(sum, -1.), 1.);
+        }
+    }
+    return expected;
+}
+
+void checkFold(audio_channel_mask_t mask, const std::vector<Gain>& gains) {
+    for (bool accumulate : {false, true}) {
+        SCOPED_TRACE(testing::Message() << "mask " << std::hex << mask << " accumulate "
+                                        << accumulate);
+        Downmix downmix;
+        ASSERT_EQ(0, downmix.configure(mask, accumulate));
+        const std::vector<float> input = makeInput(gains.size());
+        std::vector<float> output(2 * kFrameCount);
+        for (size_t i = 0; i < output.size(); i++) {
+            output[i] = (i % 7) * 0.1f - 0.3f;
+        }
+        const std::vector<float> expected = referenceFold(input, gains, output, accumulate);
+        ASSERT_EQ(0, downmix.process(input, &output));
+        for (size_t i = 0; i < output.size(); i++) {
+            ASSERT_NEAR(expected[i], output[i], 1e-6) << "sample " << i;
+        }
+    }
+}
+
+// Quad and 5.1 have their own kernels, which must fold as the matrix does.
+TEST(DownmixTest, QuadAnd5Point1) {
+    checkFold(AUDIO_CHANNEL_OUT_QUAD, {LEFT, RIGHT, LEFT, RIGHT});
+    checkFold(AUDIO_CHANNEL_OUT_QUAD_SIDE, {LEFT, RIGHT, LEFT, RIGHT});
+    checkFold(AUDIO_CHANNEL_OUT_5POINT1, {LEFT, RIGHT, CENTER, CENTER, LEFT, RIGHT});
+    checkFold(AUDIO_CHANNEL_OUT_5POINT1_SIDE, {LEFT, RIGHT, CENTER, CENTER, LEFT, RIGHT});
+}
+
+TEST(DownmixTest, Matrix) {
+    checkFold(AUDIO_CHANNEL_OUT_7POINT1,
+              {LEFT, RIGHT, CENTER, CENTER, LEFT, RIGHT, LEFT, RIGHT});
+    // 4 and 6 channels without the gains of quad and 5.1
+    checkFold(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT
+                      | AUDIO_CHANNEL_OUT_FRONT_CENTER | AUDIO_CHANNEL_OUT_LOW_FREQUENCY,
+              {LEFT, RIGHT, CENTER, CENTER});
+    checkFold(AUDIO_CHANNEL_OUT_QUAD | AUDIO_CHANNEL_OUT_SIDE_LEFT
+                      | AUDIO_CHANNEL_OUT_SIDE_RIGHT,
+              {LEFT, RIGHT, LEFT, RIGHT, LEFT, RIGHT});
+}
+
+// Masks need not have the front left and right channels, nor their side and back channels in
+// pairs: each channel goes to the output of its side, or to both if centered.
+TEST(DownmixTest, MasksWithoutFrontPairOrUnpaired) {
+    checkFold(AUDIO_CHANNEL_OUT_FRONT_CENTER | AUDIO_CHANNEL_OUT_LOW_FREQUENCY,
+              {CENTER, CENTER});
+    checkFold(AUDIO_CHANNEL_OUT_FRONT_LEFT, {LEFT});
+    checkFold(AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT, {LEFT, RIGHT});
+    checkFold(AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_BACK_LEFT, {LEFT, RIGHT, LEFT});
+    checkFold(AUDIO_CHANNEL_OUT_STEREO | AUDIO_CHANNEL_OUT_SIDE_RIGHT, {LEFT, RIGHT, RIGHT});
+    checkFold(AUDIO_CHANNEL_OUT_5POINT1 | AUDIO_CHANNEL_OUT_SIDE_LEFT,
+              {LEFT, RIGHT, CENTER, CENTER, LEFT, RIGHT, LEFT});
+}
+
+TEST(DownmixTest, UnsupportedMasks) {
+    Downmix downmix;
+    EXPECT_NE(0, downmix.configure(AUDIO_CHANNEL_NONE));
+    // positions beyond those of 22.2
+    EXPECT_NE(0, downmix.configure((audio_channel_mask_t)(AUDIO_CHANNEL_OUT_STEREO | 1u << 24)));
+    EXPECT_NE(0, downmix.configure(audio_channel_mask_from_representation_and_bits(
+            AUDIO_CHANNEL_REPRESENTATION_INDEX, 0x3f)));
+}
+
+}  // namespace
@@ -24,6 +24,7 @@
 #include <time.h>
 #include <new>
 
+#include <cutils/properties.h>
 #include <log/log.h>
 #include <sys/param.h>
 
@@ -38,6 +39,10 @@
 #define ALOGVV(a...) do { } while (false)
 #endif
 
+// Number of threads processing the channels of an instance, 1 processes them on the
+// calling thread only.
+#define PROPERTY_DYNAMICS_PROCESSING_THREADS "vendor.audio.dynamics_processing.threads"
+
 // union to hold command values
 using value_t = union {
     int32_t i;
@@ -243,9 +248,12 @@ void DP_configureVariant(DynamicsProcessingContext *pContext, int newVariant) {
             //find next highest power of 2.
             currentBlock = 1 << (32 - __builtin_clz(desiredBlock));
         }
-        ((dp_fx::DPFrequency*)pContext->mPDynamics)->configure(currentBlock,
+        dp_fx::DPFrequency *pDpFrequency = (dp_fx::DPFrequency*)pContext->mPDynamics;
+        pDpFrequency->configure(currentBlock,
                 currentBlock/2,
                 pContext->mConfig.inputCfg.samplingRate);
+        pDpFrequency->setThreadCount(
+                property_get_int32(PROPERTY_DYNAMICS_PROCESSING_THREADS, 1));
         break;
     }
     default: {
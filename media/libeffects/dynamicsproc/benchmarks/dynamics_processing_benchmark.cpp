@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks DPFrequency with all its stages in use, as configured by the
+// DynamicsProcessing effect for a 20 ms frame duration at 48 kHz.
+//
+// Run with:
+//   dynamics_processing_benchmark
+// The arguments are the channel count, whether the multi band compressor is enabled, and
+// the number of threads processing the channels. Runs with several threads also check that
+// their output is identical to the single thread output.
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <effect_benchmark/BlockTimes.h>
+
+#include "dsp/DPFrequency.h"
+
+static constexpr size_t kSamplingRate = 48000;
+static constexpr size_t kBlockSize = 1024;          // 20 ms, rounded to a power of 2
+static constexpr size_t kFrameCount = 960;          // 20 ms mixer period
+static constexpr uint32_t kBandCount = 6;
+static constexpr float kCutoffFrequenciesHz[kBandCount] = {100, 400, 1500, 4000, 10000, 20000};
+
+static void configure(dp_fx::DPFrequency *dp, uint32_t channelCount, bool mbcEnabled,
+        size_t threadCount) {
+    dp->init(channelCount, true /* preEqInUse */, kBandCount, true /* mbcInUse */, kBandCount,
+            true /* postEqInUse */, kBandCount, true /* limiterInUse */);
+    for (uint32_t ch = 0; ch < channelCount; ch++) {
+        dp_fx::DPChannel *channel = dp->getChannel(ch);
+        channel->setInputGain(-2);
+        channel->setOutputGain(1.5);
+        channel->getPreEq()->setEnabled(true);
+        channel->getMbc()->setEnabled(mbcEnabled);
+        channel->getPostEq()->setEnabled(true);
+        for (uint32_t b = 0; b < kBandCount; b++) {
+            dp_fx::DPEqBand *preEqBand = channel->getPreEq()->getBand(b);
+            preEqBand->setEnabled(true);
+            preEqBand->setCutoffFrequency(kCutoffFrequenciesHz[b]);
+            preEqBand->setGain(b - 3.0f);
+            dp_fx::DPEqBand *postEqBand = channel->getPostEq()->getBand(b);
+            postEqBand->setEnabled(true);
+            postEqBand->setCutoffFrequency(kCutoffFrequenciesHz[b]);
+            postEqBand->setGain(2 - 0.7f * b);
+            dp_fx::DPMbcBand *mbcBand = channel->getMbc()->getBand(b);
+            mbcBand->setEnabled(true);
+            mbcBand->setCutoffFrequency(kCutoffFrequenciesHz[b]);
+            mbcBand->setAttackTime(3);
+            mbcBand->setReleaseTime(80);
+            mbcBand->setRatio(3);
+            mbcBand->setThreshold(-25.0f - b);
+            mbcBand->setKneeWidth(4);
+            mbcBand->setNoiseGateThreshold(-70);
+            mbcBand->setExpanderRatio(2);
+            mbcBand->setPreGain(1);
+            mbcBand->setPostGain(2);
+        }
+        dp_fx::DPLimiter *limiter = channel->getLimiter();
+        limiter->setEnabled(true);
+        limiter->setLinkGroup(ch % 2);
+        limiter->setAttackTime(1);
+        limiter->setReleaseTime(60);
+        limiter->setRatio(10);
+        limiter->setThreshold(-12);
+        limiter->setPostGain(0);
+    }
+    dp->configure(kBlockSize, kBlockSize / 2, kSamplingRate);
+    dp->setThreadCount(threadCount);
+}
+
+static void BM_DPFrequency(benchmark::State& state) {
+    const uint32_t channelCount = state.range(0);
+    const bool mbcEnabled = state.range(1) != 0;
+    const size_t threadCount = state.range(2);
+    const size_t sampleCount = kFrameCount * channelCount;
+
+    std::vector<float> input(sampleCount);
+    std::minstd_rand generator(42);
+    std::normal_distribution<float> distribution(0, 0.2f);
+    for (auto& sample : input) {
+        sample = distribution(generator);
+    }
+    std::vector<float> output(sampleCount);
+
+    android::effect_benchmark::BlockTimes callTimes(kFrameCount * 1e6 / kSamplingRate);
+
+    dp_fx::DPFrequency dp;
+    configure(&dp, channelCount, mbcEnabled, threadCount);
+    for (auto _ : state) {
+        callTimes.time([&]() {
+            dp.processSamples(input.data(), output.data(), sampleCount);
+            benchmark::DoNotOptimize(output.data());
+        });
+    }
+    callTimes.setCounters(state);
+
+    if (threadCount > 1) {
+        // Same input from the start on both instances
+        dp_fx::DPFrequency parallel;
+        dp_fx::DPFrequency serial;
+        configure(&parallel, channelCount, mbcEnabled, threadCount);
+        configure(&serial, channelCount, mbcEnabled, 1);
+        std::vector<float> serialOutput(sampleCount);
+        for (int i = 0; i < 50; i++) {
+            parallel.processSamples(input.data(), output.data(), sampleCount);
+            serial.processSamples(input.data(), serialOutput.data(), sampleCount);
+            if (output != serialOutput) {
+                state.SkipWithError("parallel output differs from serial output");
+                break;
+            }
+        }
+    }
+}
+
+static void DPFrequencyArgs(benchmark::internal::Benchmark* b) {
+    for (int channelCount : {2, 8}) {
+        for (int mbcEnabled : {0, 1}) {
+            for (int threadCount : {1, 2, 4}) {
+                b->Args({channelCount, mbcEnabled, threadCount});
+            }
+        }
+    }
+}
+
+BENCHMARK(BM_DPFrequency)->Apply(DPFrequencyArgs);
+
+BENCHMARK_MAIN();
@@ -20,7 +20,13 @@
 #include <log/log.h>
 #include "DPFrequency.h"
 #include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <sys/param.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 namespace dp_fx {
 
@@ -50,6 +56,22 @@ template <> bool compareEquality<float>(float a, float b) {
 #define IS_CHANGED(c, a, b) { c |= !compareEquality(a,b); \
     (a) = (b); }
 
+//bins [binStart, binStop) of a half spectrum, as interleaved real and imaginary parts
+static inline Eigen::Map<Eigen::ArrayXf> binsAsFloats(Eigen::VectorXcf &spectrum,
+        size_t binStart, size_t binStop) {
+    return Eigen::Map<Eigen::ArrayXf>(reinterpret_cast<float *>(spectrum.data() + binStart),
+            2 * (binStop - binStart));
+}
+
+//sets the factor of bins [binStart, binStop) in a vector of per bin factor pairs
+static inline void setBinFactors(FloatVec &factors, size_t binStart, size_t binStop,
+        float factor) {
+    for (size_t k = binStart; k < binStop; k++) {
+        factors[2 * k] = factor;
+        factors[2 * k + 1] = factor;
+    }
+}
+
 //ChannelBuffers helper
 void ChannelBuffer::initBuffers(unsigned int blockSize, unsigned int overlapSize,
         unsigned int halfFftSize, unsigned int samplingRate, DPBase &dpBase) {
@@ -66,10 +88,15 @@ void ChannelBuffer::initBuffers(unsigned int blockSize, unsigned int overlapSize
     input.resize(mBlockSize);
     output.resize(mBlockSize);
     outTail.resize(overlapSize);
+    windowed.resize(mBlockSize);
+
+    //unscaled fft, computing only the half spectrum of the real input
+    fft.init(mBlockSize);
+    complexTemp.resize(halfFftSize);
 
     //module vectors
-    mPreEqFactorVector.resize(halfFftSize, 1.0);
-    mPostEqFactorVector.resize(halfFftSize, 1.0);
+    mPreEqFactorVector.resize(2 * halfFftSize, 1.0);
+    mPostEqFactorVector.resize(2 * halfFftSize, 1.0);
 
     mPreEqBands.resize(dpBase.getPreEqBandCount());
     mMbcBands.resize(dpBase.getMbcBandCount());
@@ -122,6 +149,143 @@ void LinkedLimiters::remove(int index) {
     }
 }
 
+//== ChannelWorkers Helper
+static constexpr int kClaimGenerationShift = 32;
+static constexpr int kClaimCountShift = 16;
+static constexpr uint64_t kClaimIndexMask = (1 << kClaimCountShift) - 1;
+
+ChannelWorkers::~ChannelWorkers() {
+    stopThreads();
+}
+
+void ChannelWorkers::setThreadCount(size_t threadCount) {
+    if (threadCount == getThreadCount()) {
+        return;
+    }
+    stopThreads();
+    for (size_t i = 1; i < threadCount; i++) {
+        mThreads.emplace_back(&ChannelWorkers::threadLoop, this);
+    }
+    // the workers are matched to the scheduling of the calling thread once they all have an id
+    std::unique_lock<std::mutex> lock(mLock);
+    mDoneCondition.wait(lock, [this] { return mThreadIds.size() == mThreads.size(); });
+    mPolicy = -1;
+}
+
+void ChannelWorkers::stopThreads() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mStartCondition.notify_all();
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+    mThreadIds.clear();
+    mExit = false;
+}
+
+bool ChannelWorkers::matchCallerScheduling() {
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+        return false;
+    }
+    const int nice = getpriority(PRIO_PROCESS, 0);
+    if (policy == mPolicy && param.sched_priority == mPriority && nice == mNice) {
+        return mSchedulingMatched;
+    }
+    mPolicy = policy;
+    mPriority = param.sched_priority;
+    mNice = nice;
+    mSchedulingMatched = true;
+    // the ids are only modified by the thread calling setThreadCount(), which is not running
+    // concurrently with the audio thread
+    for (pid_t tid : mThreadIds) {
+        // the nice value only applies to the policies without a real time priority
+        if (sched_setscheduler(tid, policy, &param) != 0 ||
+                (param.sched_priority == 0 && setpriority(PRIO_PROCESS, tid, nice) != 0)) {
+            ALOGW("cannot give the scheduling policy %d priority %d nice %d to worker %d (%s), "
+                    "processing channels on the calling thread",
+                    policy, param.sched_priority, nice, tid, strerror(errno));
+            mSchedulingMatched = false;
+            break;
+        }
+    }
+    return mSchedulingMatched;
+}
+
+void ChannelWorkers::run(size_t count, Function function, void *cookie) {
+    if (mThreads.empty() || count < 2 || count > kClaimIndexMask || !matchCallerScheduling()) {
+        for (size_t i = 0; i < count; i++) {
+            function(cookie, i);
+        }
+        return;
+    }
+
+    mFunction = function;
+    mCookie = cookie;
+    mDoneCount.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mGeneration++;
+        mClaim.store((mGeneration << kClaimGenerationShift) | (count << kClaimCountShift),
+                std::memory_order_release);
+    }
+    mStartCondition.notify_all();
+    runIndices();
+
+    // only the indices a worker is processing remain
+    if (mDoneCount.load(std::memory_order_acquire) != count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mDoneCondition.wait(lock, [this, count] {
+            return mDoneCount.load(std::memory_order_acquire) == count;
+        });
+    }
+}
+
+void ChannelWorkers::threadLoop() {
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+    mThreadIds.push_back(gettid());
+    mDoneCondition.notify_all();
+    while (true) {
+        mStartCondition.wait(lock, [&] { return mExit || mGeneration != generation; });
+        if (mExit) {
+            return;
+        }
+        generation = mGeneration;
+        lock.unlock();
+        runIndices();
+        lock.lock();
+    }
+}
+
+void ChannelWorkers::runIndices() {
+    uint64_t claim = mClaim.load(std::memory_order_acquire);
+    while (true) {
+        const size_t index = claim & kClaimIndexMask;
+        const size_t count = (claim >> kClaimCountShift) & kClaimIndexMask;
+        if (index >= count) {
+            return;
+        }
+        // a successful claim of an index of a run means that run() is waiting for it, and
+        // has not modified the function and cookie
+        if (!mClaim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel,
+                std::memory_order_acquire)) {
+            continue;
+        }
+        mFunction(mCookie, index);
+        if (mDoneCount.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+            // the calling thread checks the count with the lock held before waiting
+            std::lock_guard<std::mutex> lock(mLock);
+            mDoneCondition.notify_all();
+        }
+        claim = mClaim.load(std::memory_order_acquire);
+    }
+}
+
 //== DPFrequency
 void DPFrequency::reset() {
 }
@@ -178,6 +342,18 @@ void DPFrequency::configure(size_t blockSize, size_t overlapSize,
 
     //Making sure window rms is not zero.
     mWindowRms = std::max(sqrt(mWindowRms / mVWindow.size()), MIN_ENVELOPE);
+
+    //the inverse fft is unscaled: fold its 1/N scaling into the synthesis window
+    mVSynthesisWindow.resize(mVWindow.size());
+    Eigen::Map<Eigen::VectorXf> eSynthesisWindow(&mVSynthesisWindow[0],
+            mVSynthesisWindow.size());
+    eSynthesisWindow = eWindow / mBlockSize;
+}
+
+void DPFrequency::setThreadCount(size_t threadCount) {
+    threadCount = std::min(threadCount, (size_t)getChannelCount());
+    ALOGV("setThreadCount %zu", threadCount);
+    mWorkers.setThreadCount(std::max(threadCount, (size_t)1));
 }
 
 void DPFrequency::updateParameters(ChannelBuffer &cb, int channelIndex) {
@@ -231,17 +407,14 @@ void DPFrequency::updateParameters(ChannelBuffer &cb, int channelIndex) {
                     if (!pEqBandParams->enabled) {
                         factor = inputGainFactor;
                     }
-                    for (size_t k = pEqBandParams->binStart;
-                            k <= pEqBandParams->binStop && k < mHalfFFTSize; k++) {
-                        cb.mPreEqFactorVector[k] = factor * inputGainFactor;
-                    }
+                    setBinFactors(cb.mPreEqFactorVector, pEqBandParams->binStart,
+                            std::min(pEqBandParams->binStop + 1, mHalfFFTSize),
+                            factor * inputGainFactor);
                 }
             } else {
                 ALOGV("only input gain changed, recomputing!");
                 //populate PreEq factor with input gain factor.
-                for (size_t k = 0; k < mHalfFFTSize; k++) {
-                    cb.mPreEqFactorVector[k] = inputGainFactor;
-                }
+                setBinFactors(cb.mPreEqFactorVector, 0, mHalfFFTSize, inputGainFactor);
             }
         }
     } //inputGain and preEq
@@ -282,10 +455,8 @@ void DPFrequency::updateParameters(ChannelBuffer &cb, int channelIndex) {
                     if (!pEqBandParams->enabled) {
                         factor = 1.0;
                     }
-                    for (size_t k = pEqBandParams->binStart;
-                            k <= pEqBandParams->binStop && k < mHalfFFTSize; k++) {
-                        cb.mPostEqFactorVector[k] = factor;
-                    }
+                    setBinFactors(cb.mPostEqFactorVector, pEqBandParams->binStart,
+                            std::min(pEqBandParams->binStop + 1, mHalfFFTSize), factor);
                 }
             }
         } //enabled
@@ -432,85 +603,116 @@ size_t DPFrequency::processChannelBuffers(CBufferVector &channelBuffers) {
         available = std::min(available, channelBuffers[ch].cBInput.availableToRead());
     }
 
+    //channels are independent apart from the linked limiters, computed between the passes
+    struct Pass {
+        DPFrequency *dp;
+        CBufferVector *channelBuffers;
+    } pass = { this, &channelBuffers };
+
     while (available >= processFrames) {
         //First pass
-        for (int ch = 0; ch < channelCount; ch++) {
-            ChannelBuffer * pCb = &channelBuffers[ch];
-            //move tail of previous
-            std::copy(pCb->input.begin() + processFrames,
-                    pCb->input.end(),
-                    pCb->input.begin());
-
-            //read new available data
-            for (unsigned int k = 0; k < processFrames; k++) {
-                pCb->input[mOverlapSize + k] = pCb->cBInput.read();
-            }
-            //first stages: fft, preEq, mbc, postEq and start of Limiter
-            processedSamples += processFirstStages(*pCb);
-        }
+        mWorkers.run(channelCount, [](void *cookie, size_t ch) {
+            Pass *pPass = (Pass *)cookie;
+            pPass->dp->processFirstPass((*pPass->channelBuffers)[ch]);
+        }, &pass);
+        processedSamples += channelCount * mBlockSize;
 
         //**compute linked limiters and update levels if needed
         processLinkedLimiters(channelBuffers);
 
         //final pass.
-        for (int ch = 0; ch < channelCount; ch++) {
-            ChannelBuffer * pCb = &channelBuffers[ch];
+        mWorkers.run(channelCount, [](void *cookie, size_t ch) {
+            Pass *pPass = (Pass *)cookie;
+            pPass->dp->processLastPass((*pPass->channelBuffers)[ch]);
+        }, &pass);
+        available -= processFrames;
+    }
+    return processedSamples;
+}
 
-            //linked limiter and ifft
-            processLastStages(*pCb);
+void DPFrequency::processFirstPass(ChannelBuffer &cb) {
+    size_t processFrames = mBlockSize - mOverlapSize;
 
-            //mix tail (and capture new tail
-            for (unsigned int k = 0; k < mOverlapSize; k++) {
-                pCb->output[k] += pCb->outTail[k];
-                pCb->outTail[k] = pCb->output[processFrames + k]; //new tail
-            }
+    //move tail of previous
+    std::copy(cb.input.begin() + processFrames,
+            cb.input.end(),
+            cb.input.begin());
 
-            //output data
-            for (unsigned int k = 0; k < processFrames; k++) {
-                pCb->cBOutput.write(pCb->output[k]);
-            }
-        }
-        available -= processFrames;
+    //read new available data
+    for (unsigned int k = 0; k < processFrames; k++) {
+        cb.input[mOverlapSize + k] = cb.cBInput.read();
     }
-    return processedSamples;
+    //first stages: fft, preEq, mbc, postEq and start of Limiter
+    processFirstStages(cb);
 }
+
+void DPFrequency::processLastPass(ChannelBuffer &cb) {
+    size_t processFrames = mBlockSize - mOverlapSize;
+
+    //linked limiter and ifft
+    processLastStages(cb);
+
+    //mix tail (and capture new tail
+    for (unsigned int k = 0; k < mOverlapSize; k++) {
+        cb.output[k] += cb.outTail[k];
+        cb.outTail[k] = cb.output[processFrames + k]; //new tail
+    }
+
+    //output data
+    for (unsigned int k = 0; k < processFrames; k++) {
+        cb.cBOutput.write(cb.output[k]);
+    }
+}
+
 size_t DPFrequency::processFirstStages(ChannelBuffer &cb) {
 
     //##apply window
-    Eigen::Map<Eigen::VectorXf> eWindow(&mVWindow[0], mVWindow.size());
-    Eigen::Map<Eigen::VectorXf> eInput(&cb.input[0], cb.input.size());
+    Eigen::Map<Eigen::ArrayXf> eWindow(&mVWindow[0], mVWindow.size());
+    Eigen::Map<Eigen::ArrayXf> eInput(&cb.input[0], cb.input.size());
+    Eigen::Map<Eigen::ArrayXf> eWin(&cb.windowed[0], cb.windowed.size());
 
-    Eigen::VectorXf eWin = eInput.cwiseProduct(eWindow); //apply window
+    eWin = eInput * eWindow; //apply window
 
     //##fft
-    //Note: we are using eigen with the default scaling, which ensures that
-    //  IFFT( FFT(x) ) = x.
-    // TODO: optimize by using the noscale option, and compensate with dB scale offsets
-    mFftServer.fwd(cb.complexTemp, eWin);
-
-    size_t cSize = cb.complexTemp.size();
-    size_t maxBin = std::min(cSize/2, mHalfFFTSize);
-
-    //== EqPre (always runs)
-    for (size_t k = 0; k < maxBin; k++) {
-        cb.complexTemp[k] *= cb.mPreEqFactorVector[k];
+    //Note: the fft is unscaled, and its 1/N scaling is applied with the synthesis window.
+    // Only the half spectrum, including the Nyquist bin, is computed.
+    cb.fft.fwd(cb.complexTemp.data(), &cb.windowed[0]);
+
+    //gains apply to all bins but the Nyquist bin. Per bin operations work on the spectrum
+    //as a float vector, which Eigen vectorizes.
+    const size_t maxBin = mHalfFFTSize - 1;
+    Eigen::Map<Eigen::ArrayXf> eBins = binsAsFloats(cb.complexTemp, 0, maxBin);
+    Eigen::Map<Eigen::ArrayXf> ePreEq(&cb.mPreEqFactorVector[0], 2 * maxBin);
+    Eigen::Map<Eigen::ArrayXf> ePostEq(&cb.mPostEqFactorVector[0], 2 * maxBin);
+    const bool mbcActive = cb.mMbcInUse && cb.mMbcEnabled;
+    const bool postEqActive = cb.mPostEqInUse && cb.mPostEqEnabled;
+
+    //== EqPre (always runs), and EqPost in the same pass if there is no MBC in between
+    if (postEqActive && !mbcActive) {
+        eBins *= ePreEq * ePostEq;
+    } else {
+        eBins *= ePreEq;
     }
 
     //== MBC
     if (cb.mMbcInUse && cb.mMbcEnabled) {
         for (size_t band = 0; band < cb.mMbcBands.size(); band++) {
             ChannelBuffer::MbcBandParams *pMbcBandParams = &cb.mMbcBands[band];
-            float fEnergySum = 0;
+            //band bins, within the half spectrum
+            const size_t binStart = std::min(pMbcBandParams->binStart, mHalfFFTSize);
+            const size_t binStop = std::max(binStart,
+                    std::min(pMbcBandParams->binStop + 1, mHalfFFTSize));
+            Eigen::Map<Eigen::ArrayXf> eBandBins =
+                    binsAsFloats(cb.complexTemp, binStart, binStop);
 
             //apply pre gain.
             float preGainFactor = dBtoLinear(pMbcBandParams->gainPreDb);
             float preGainSquared = preGainFactor * preGainFactor;
 
-            for (size_t k = pMbcBandParams->binStart; k <= pMbcBandParams->binStop; k++) {
-                fEnergySum += std::norm(cb.complexTemp[k]) * preGainSquared; //mag squared
-            }
+            //mag squared
+            float fEnergySum = eBandBins.matrix().squaredNorm() * preGainSquared;
 
-            //Eigen FFT is full spectrum, even if the source was real data.
+            //Only the half spectrum is computed, the other half being its mirror image.
             // Each half spectrum has half the energy. This is taken into account with the * 2
             // factor in the energy computations.
             // energy = sqrt(sum_components_squared) number_points
@@ -567,27 +769,20 @@ size_t DPFrequency::processFirstStages(ChannelBuffer &cb) {
             newFactor *= dBtoLinear(pMbcBandParams->gainPostDb);
 
             //apply to this band
-            for (size_t k = pMbcBandParams->binStart; k <= pMbcBandParams->binStop; k++) {
-                cb.complexTemp[k] *= newFactor;
-            }
+            eBandBins *= newFactor;
 
         } //end per band process
 
     } //end MBC
 
     //== EqPost
-    if (cb.mPostEqInUse && cb.mPostEqEnabled) {
-        for (size_t k = 0; k < maxBin; k++) {
-            cb.complexTemp[k] *= cb.mPostEqFactorVector[k];
-        }
+    if (postEqActive && mbcActive) {
+        eBins *= ePostEq;
     }
 
     //== Limiter. First Pass
     if (cb.mLimiterInUse && cb.mLimiterEnabled) {
-        float fEnergySum = 0;
-        for (size_t k = 0; k < maxBin; k++) {
-            fEnergySum += std::norm(cb.complexTemp[k]);
-        }
+        float fEnergySum = eBins.matrix().squaredNorm();
 
         //see explanation above for energy computation logic
         fEnergySum = sqrt(fEnergySum * 2) / (mBlockSize * mWindowRms);
@@ -654,22 +849,19 @@ size_t DPFrequency::processLastStages(ChannelBuffer &cb) {
         outputGainFactor *= factor;
     }
 
-    //apply to all if != 1.0
+    //apply to all bins but the Nyquist bin if != 1.0
+    const size_t maxBin = mHalfFFTSize - 1;
     if (!compareEquality(outputGainFactor, 1.0f)) {
-        size_t cSize = cb.complexTemp.size();
-        size_t maxBin = std::min(cSize/2, mHalfFFTSize);
-        for (size_t k = 0; k < maxBin; k++) {
-            cb.complexTemp[k] *= outputGainFactor;
-        }
+        binsAsFloats(cb.complexTemp, 0, maxBin) *= outputGainFactor;
     }
 
     //##ifft directly to output.
-    Eigen::Map<Eigen::VectorXf> eOutput(&cb.output[0], cb.output.size());
-    mFftServer.inv(eOutput, cb.complexTemp);
+    cb.fft.inv(&cb.output[0], cb.complexTemp.data());
 
-    //apply rest of window for resynthesis
-    Eigen::Map<Eigen::VectorXf> eWindow(&mVWindow[0], mVWindow.size());
-    eOutput = eOutput.cwiseProduct(eWindow);
+    //apply rest of window for resynthesis, with the 1/N scaling of the ifft
+    Eigen::Map<Eigen::ArrayXf> eOutput(&cb.output[0], cb.output.size());
+    Eigen::Map<Eigen::ArrayXf> eSynthesisWindow(&mVSynthesisWindow[0], mVSynthesisWindow.size());
+    eOutput *= eSynthesisWindow;
 
     return mBlockSize;
 }
@@ -18,10 +18,17 @@
 #ifndef DPFREQUENCY_H_
 #define DPFREQUENCY_H_
 
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <Eigen/Dense>
-#include <unsupported/Eigen/FFT>
 
 #include "RDsp.h"
+#include "RFft.h"
 #include "SHCircularBuffer.h"
 
 #include "DPBase.h"
@@ -38,8 +45,10 @@ public:
     FloatVec input;     // time domain temp vector for input
     FloatVec output;    // time domain temp vector for output
     FloatVec outTail;   // time domain temp vector for output tail (for overlap-add method)
+    FloatVec windowed;  // time domain temp vector for windowed input
 
-    Eigen::VectorXcf complexTemp; // complex temp vector for frequency domain operations
+    Eigen::VectorXcf complexTemp; // half spectrum temp vector for frequency domain operations
+    RFft fft;                     // per channel, as the FFT work buffers are not shared
 
     //Current parameters
     float inputGainDb;
@@ -96,8 +105,11 @@ public:
     bool mLimiterInUse;
     bool mLimiterEnabled;
     LimiterParams mLimiterParams;
-    FloatVec mPreEqFactorVector; // temp pre-computed vector to shape spectrum at preEQ stage
-    FloatVec mPostEqFactorVector; // temp pre-computed vector to shape spectrum at postEQ stage
+    // temp pre-computed vectors to shape spectrum at preEQ and postEQ stages. Each bin factor
+    // is repeated for the real and imaginary parts, so that the spectrum can be processed as
+    // a float vector.
+    FloatVec mPreEqFactorVector;
+    FloatVec mPostEqFactorVector;
 
     void initBuffers(unsigned int blockSize, unsigned int overlapSize, unsigned int halfFftSize,
             unsigned int samplingRate, DPBase &dpBase);
@@ -120,11 +132,64 @@ public:
     GroupsMap mGroupsMap;
 };
 
+// Runs a function for each channel, on the calling thread and on worker threads.
+// The calling thread is an audio thread: it never waits for a worker to wake up, as it takes the
+// channels no worker has started itself, and only waits for channels being processed. Workers
+// are given the scheduling policy and priority of the calling thread; if that is not permitted,
+// all channels are processed on the calling thread.
+class ChannelWorkers {
+public:
+    using Function = void (*)(void *cookie, size_t index);
+
+    ~ChannelWorkers();
+    // threadCount includes the calling thread; 1 runs all channels on the calling thread.
+    void setThreadCount(size_t threadCount);
+    size_t getThreadCount() const {
+        return mThreads.size() + 1;
+    }
+    // Calls function(cookie, index) for index in [0, count) and waits for all calls to return
+    void run(size_t count, Function function, void *cookie);
+
+private:
+    void stopThreads();
+    void threadLoop();
+    // Processes the indices not yet claimed
+    void runIndices();
+    // Gives the workers the scheduling of the calling thread when it changed, returns whether
+    // they have it
+    bool matchCallerScheduling();
+
+    std::vector<std::thread> mThreads;
+    std::vector<pid_t> mThreadIds;  // guarded by mLock
+    std::mutex mLock;
+    std::condition_variable mStartCondition;
+    std::condition_variable mDoneCondition;
+    uint64_t mGeneration = 0;   // incremented by each run(), guarded by mLock
+    bool mExit = false;
+
+    // scheduling of the calling thread last given to the workers
+    int mPolicy = -1;
+    int mPriority = 0;
+    int mNice = 0;
+    bool mSchedulingMatched = false;
+
+    // Written by run() before it publishes a claim word, and not modified until all the indices
+    // of that claim word are done.
+    Function mFunction = nullptr;
+    void *mCookie = nullptr;
+    // Generation of the run (32 bits), index count (16 bits) and next index to claim (16 bits).
+    // The generation prevents a stale claim word of a previous run from matching.
+    std::atomic<uint64_t> mClaim{0};
+    std::atomic<size_t> mDoneCount{0};
+};
+
 class DPFrequency : public DPBase {
 public:
     virtual size_t processSamples(const float *in, float *out, size_t samples);
     virtual void reset();
     void configure(size_t blockSize, size_t overlapSize, size_t samplingRate);
+    // Number of threads processing the channels in parallel, 1 by default
+    void setThreadCount(size_t threadCount);
     static size_t getMinBockSize();
     static size_t getMaxBockSize();
 
@@ -134,6 +199,8 @@ private:
     size_t processOneVector(FloatVec &output, FloatVec &input, ChannelBuffer &cb);
 
     size_t processChannelBuffers(CBufferVector &channelBuffers);
+    void processFirstPass(ChannelBuffer &cb);
+    void processLastPass(ChannelBuffer &cb);
     size_t processFirstStages(ChannelBuffer &cb);
     size_t processLastStages(ChannelBuffer &cb);
     void processLinkedLimiters(CBufferVector &channelBuffers);
@@ -149,10 +216,12 @@ private:
 
     LinkedLimiters mLinkedLimiters;
 
+    ChannelWorkers mWorkers;
+
     //dsp
     FloatVec mVWindow;  //window class.
+    FloatVec mVSynthesisWindow; //window with the 1/N scaling of the unscaled inverse FFT
     float mWindowRms;
-    Eigen::FFT<float> mFftServer;
 };
 
 } //namespace dp_fx
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RFft"
+//#define LOG_NDEBUG 0
+
+#include <log/log.h>
+#include <math.h>
+#include <utility>
+
+#include "RFft.h"
+
+namespace dp_fx {
+
+//first radix-2 stage, with sub-transforms at stride 1: y[2p] and y[2p + 1] from x[p] and
+//x[p + half]
+static void firstStage(size_t half, const float *twiddleRe, const float *twiddleIm,
+        const float *__restrict xr, const float *__restrict xi,
+        float *__restrict yr, float *__restrict yi) {
+    for (size_t p = 0; p < half; p++) {
+        const float ar = xr[p];
+        const float ai = xi[p];
+        const float br = xr[p + half];
+        const float bi = xi[p + half];
+        const float dr = ar - br;
+        const float di = ai - bi;
+        yr[2 * p] = ar + br;
+        yi[2 * p] = ai + bi;
+        yr[2 * p + 1] = dr * twiddleRe[p] - di * twiddleIm[p];
+        yi[2 * p + 1] = dr * twiddleIm[p] + di * twiddleRe[p];
+    }
+}
+
+//radix-2 stage with sub-transforms at stride s: the inner loop runs over s contiguous values
+static void stage(size_t half, size_t s, const float *twiddleRe, const float *twiddleIm,
+        const float *__restrict xr, const float *__restrict xi,
+        float *__restrict yr, float *__restrict yi) {
+    for (size_t p = 0; p < half; p++) {
+        const float wr = twiddleRe[p * s];
+        const float wi = twiddleIm[p * s];
+        const float *ar = xr + s * p;
+        const float *ai = xi + s * p;
+        const float *br = xr + s * (p + half);
+        const float *bi = xi + s * (p + half);
+        float *y0r = yr + 2 * s * p;
+        float *y0i = yi + 2 * s * p;
+        float *y1r = y0r + s;
+        float *y1i = y0i + s;
+        for (size_t q = 0; q < s; q++) {
+            const float dr = ar[q] - br[q];
+            const float di = ai[q] - bi[q];
+            y0r[q] = ar[q] + br[q];
+            y0i[q] = ai[q] + bi[q];
+            y1r[q] = dr * wr - di * wi;
+            y1i[q] = dr * wi + di * wr;
+        }
+    }
+}
+
+void RFft::init(size_t size) {
+    ALOGV("init size %zu", size);
+    mSize = size;
+    const size_t m = size / 2;
+
+    mTwiddleRe.resize(m / 2);
+    mTwiddleIm.resize(m / 2);
+    for (size_t k = 0; k < m / 2; k++) {
+        const double phase = -2 * M_PI * k / m;
+        mTwiddleRe[k] = cos(phase);
+        mTwiddleIm[k] = sin(phase);
+    }
+    mRealTwiddleRe.resize(m);
+    mRealTwiddleIm.resize(m);
+    for (size_t k = 0; k < m; k++) {
+        const double phase = -2 * M_PI * k / size;
+        mRealTwiddleRe[k] = cos(phase);
+        mRealTwiddleIm[k] = sin(phase);
+    }
+    for (int b = 0; b < 2; b++) {
+        mRe[b].resize(m);
+        mIm[b].resize(m);
+    }
+}
+
+int RFft::complexFft() {
+    const size_t m = mSize / 2;
+    int b = 0;
+    for (size_t n = m, s = 1; n > 1; n /= 2, s *= 2) {
+        if (s == 1) {
+            firstStage(n / 2, &mTwiddleRe[0], &mTwiddleIm[0], &mRe[b][0], &mIm[b][0],
+                    &mRe[1 - b][0], &mIm[1 - b][0]);
+        } else {
+            stage(n / 2, s, &mTwiddleRe[0], &mTwiddleIm[0], &mRe[b][0], &mIm[b][0],
+                    &mRe[1 - b][0], &mIm[1 - b][0]);
+        }
+        b = 1 - b;
+    }
+    return b;
+}
+
+void RFft::fwd(std::complex<float> *out, const float *in) {
+    const size_t m = mSize / 2;
+    float *o = reinterpret_cast<float *>(out);
+
+    //even samples as real parts, odd samples as imaginary parts
+    float *__restrict re = &mRe[0][0];
+    float *__restrict im = &mIm[0][0];
+    for (size_t k = 0; k < m; k++) {
+        re[k] = in[2 * k];
+        im[k] = in[2 * k + 1];
+    }
+
+    const int b = complexFft();
+    const float *zr = &mRe[b][0];
+    const float *zi = &mIm[b][0];
+
+    //split the spectra of the even and odd samples, and combine them
+    o[0] = zr[0] + zi[0];
+    o[1] = 0;
+    o[2 * m] = zr[0] - zi[0];
+    o[2 * m + 1] = 0;
+    for (size_t k = 1; k < m; k++) {
+        const float ar = zr[k];
+        const float ai = zi[k];
+        const float br = zr[m - k];
+        const float bi = -zi[m - k];
+        const float evenRe = 0.5f * (ar + br);
+        const float evenIm = 0.5f * (ai + bi);
+        const float oddRe = 0.5f * (ai - bi);
+        const float oddIm = -0.5f * (ar - br);
+        const float wr = mRealTwiddleRe[k];
+        const float wi = mRealTwiddleIm[k];
+        o[2 * k] = evenRe + wr * oddRe - wi * oddIm;
+        o[2 * k + 1] = evenIm + wr * oddIm + wi * oddRe;
+    }
+}
+
+void RFft::inv(float *out, const std::complex<float> *in) {
+    const size_t m = mSize / 2;
+    const float *x = reinterpret_cast<const float *>(in);
+
+    //spectra of the even samples plus i times the odd samples, with real and imaginary parts
+    //swapped so that the forward transform computes the inverse one
+    float *__restrict re = &mRe[0][0];
+    float *__restrict im = &mIm[0][0];
+    im[0] = x[0] + x[2 * m];
+    re[0] = x[0] - x[2 * m];
+    for (size_t k = 1; k < m; k++) {
+        const float ar = x[2 * k];
+        const float ai = x[2 * k + 1];
+        const float br = x[2 * (m - k)];
+        const float bi = -x[2 * (m - k) + 1];
+        const float wr = mRealTwiddleRe[k];
+        const float wi = mRealTwiddleIm[k];
+        const float dr = ar - br;
+        const float di = ai - bi;
+        const float oddRe = dr * wr + di * wi;
+        const float oddIm = di * wr - dr * wi;
+        im[k] = ar + br - oddIm;
+        re[k] = ai + bi + oddRe;
+    }
+
+    const int b = complexFft();
+    const float *zr = &mIm[b][0];
+    const float *zi = &mRe[b][0];
+    for (size_t k = 0; k < m; k++) {
+        out[2 * k] = zr[k];
+        out[2 * k + 1] = zi[k];
+    }
+}
+
+} //namespace dp_fx
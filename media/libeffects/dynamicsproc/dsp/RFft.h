@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RFFT_H
+#define RFFT_H
+
+#include <complex>
+#include <vector>
+
+namespace dp_fx {
+
+// Unscaled FFT of real blocks with a power of 2 size, producing the half spectrum (size / 2 + 1
+// bins, DC and Nyquist included) with the layout of Eigen::FFT with the HalfSpectrum and
+// Unscaled flags, so that inv(fwd(x)) = size * x.
+//
+// The real transform is computed with a complex transform of half the size, done in place
+// with the Stockham algorithm on separate real and imaginary parts: all the inner loops access
+// contiguous data, and are vectorized by the compiler.
+//
+// An instance holds its work buffers, and must not be used by several threads at once.
+class RFft {
+public:
+    // size is a power of 2, at least 8. Allocates the twiddles and buffers.
+    void init(size_t size);
+    size_t getSize() const {
+        return mSize;
+    }
+
+    // in has getSize() samples, out getSize() / 2 + 1 bins
+    void fwd(std::complex<float> *out, const float *in);
+    // in has getSize() / 2 + 1 bins, of which the imaginary parts of DC and Nyquist are
+    // ignored; out has getSize() samples
+    void inv(float *out, const std::complex<float> *in);
+
+private:
+    // Forward complex transform of mRe[0], mIm[0]; returns the index of the buffers holding
+    // the result.
+    int complexFft();
+
+    size_t mSize = 0;
+    std::vector<float> mTwiddleRe;      // exp(-2 pi i k / (size / 2)), k < size / 4
+    std::vector<float> mTwiddleIm;
+    std::vector<float> mRealTwiddleRe;  // exp(-2 pi i k / size), k < size / 2
+    std::vector<float> mRealTwiddleIm;
+    std::vector<float> mRe[2];          // ping-pong buffers of the complex transform
+    std::vector<float> mIm[2];
+};
+
+} //namespace dp_fx
+
+#endif //RFFT_H
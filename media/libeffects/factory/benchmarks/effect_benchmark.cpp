@@ -0,0 +1,717 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark and regression harness of audio effects, driven through the effect_handle_t
+// interface with synthetic multichannel signals.
+//
+// Usage:
+//     effect_benchmark [options]
+//
+// On device, the effects are enumerated and created through the EffectsFactory, as listed by
+// the audio effects configuration. With --library, and always on host, effect libraries are
+// loaded directly instead; the effects measured are those a library implements among the
+// effects bundled with the platform and the --uuid ones. The bundled effect libraries are
+// also built for host, for instance:
+//     effect_benchmark --library $ANDROID_HOST_OUT/lib64/soundfx/libldnhncr.so
+//
+// Each effect is measured with its default parameters, for every combination of format,
+// sample rate, channel count and block size it accepts. The report is JSON, one result per
+// line, with the mean processing time per frame, the 99th percentile and maximum block times
+// and a checksum of the output. Given the report of a previous run with --baseline, results
+// slower than the tolerance or with a different output are listed on stderr and the exit
+// status is 1.
+//
+// Options:
+//     --library <path>    load the effect library at path (repeatable)
+//     --uuid <uuid>       also look up this effect in the libraries (repeatable)
+//     --effect <name>     only measure effects whose name contains name (repeatable)
+//     --formats <list>    sample formats among float and int16, default float,int16
+//     --rates <list>      sample rates, default 44100,48000,96000
+//     --channels <list>   channel counts, default 1,2,6,8
+//     --frames <list>     frame counts per block, default 64,256,960
+//     --seconds <s>       duration of the signal processed per configuration, default 2
+//     --output <file>     write the report to file instead of stdout
+//     --baseline <file>   report of a previous run to compare with
+//     --tolerance <pct>   allowed increase of the time per frame over the baseline, default 10
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <hardware/audio_effect.h>
+#include <system/audio.h>
+#ifdef __ANDROID__
+#include <effect_benchmark/BlockTimes.h>
+#include <media/EffectsFactoryApi.h>
+#endif
+
+namespace {
+
+// Effects bundled with the platform, as listed in media/libeffects/data/audio_effects.xml
+const char * const kBundledEffectUuids[] = {
+    "aa8130e0-66fc-11e0-bad0-0002a5d5c51b",  // agc
+    "bb392ec0-8d4d-11e0-a896-0002a5d5c51b",  // aec
+    "c06c8400-8e06-11e0-9cb6-0002a5d5c51b",  // ns
+    "8631f300-72e2-11df-b57e-0002a5d5c51b",  // bassboost
+    "1d4033c0-8557-11df-9f2d-0002a5d5c51b",  // virtualizer
+    "ce772f20-847d-11df-bb17-0002a5d5c51b",  // equalizer
+    "119341a0-8469-11df-81f9-0002a5d5c51b",  // volume
+    "4a387fc0-8ab3-11df-8bad-0002a5d5c51b",  // reverb_env_aux
+    "c7a511a0-a3bb-11df-860e-0002a5d5c51b",  // reverb_env_ins
+    "f29a1400-a3bb-11df-8ddc-0002a5d5c51b",  // reverb_pre_aux
+    "172cdf00-a3bc-11df-a72f-0002a5d5c51b",  // reverb_pre_ins
+    "d069d9e0-8329-11df-9168-0002a5d5c51b",  // visualizer
+    "93f04452-e4fe-41cc-91f9-e475b6d1d69f",  // downmix
+    "fa415329-2034-4bea-b5dc-5b381c8d1e2c",  // loudness_enhancer
+    "e0e6539b-1781-7261-676f-6d7573696340",  // dynamics_processing
+};
+
+// Blocks processed before the block times are recorded, to leave out allocations and cache
+// misses of the first calls.
+constexpr size_t kWarmupBlocks = 8;
+
+struct Options {
+    std::vector<std::string> libraries;
+    std::vector<std::string> uuids;
+    std::vector<std::string> names;
+    std::vector<audio_format_t> formats = {AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT};
+    std::vector<uint32_t> sampleRates = {44100, 48000, 96000};
+    std::vector<uint32_t> channelCounts = {1, 2, 6, 8};
+    std::vector<uint32_t> frameCounts = {64, 256, 960};
+    double seconds = 2.;
+    const char *output = nullptr;
+    const char *baseline = nullptr;
+    double tolerancePct = 10.;
+};
+
+// An effect to measure and how to create it: from a library loaded by the harness, or from
+// the EffectsFactory when library is null.
+struct EffectEntry {
+    effect_descriptor_t descriptor;
+    std::string libraryPath;
+    const audio_effect_library_t *library;
+};
+
+struct Result {
+    std::string status;
+    uint32_t outChannelCount = 0;
+    size_t blocks = 0;
+    double nsPerFrame = 0.;
+    double p99Us = 0.;
+    double maxUs = 0.;
+    double cpuPct = 0.;
+    uint64_t checksum = 0;
+    double rmsDbfs = 0.;
+};
+
+bool parseUuid(const char *str, effect_uuid_t *uuid)
+{
+    int node[6];
+    unsigned timeMid, timeHiAndVersion, clockSeq;
+    if (sscanf(str, "%08x-%04x-%04x-%04x-%02x%02x%02x%02x%02x%02x", &uuid->timeLow, &timeMid,
+            &timeHiAndVersion, &clockSeq, &node[0], &node[1], &node[2], &node[3], &node[4],
+            &node[5]) != 10) {
+        return false;
+    }
+    uuid->timeMid = timeMid;
+    uuid->timeHiAndVersion = timeHiAndVersion;
+    uuid->clockSeq = clockSeq;
+    for (size_t i = 0; i < 6; i++) {
+        uuid->node[i] = node[i];
+    }
+    return true;
+}
+
+std::string uuidToString(const effect_uuid_t &uuid)
+{
+    char str[40];
+    snprintf(str, sizeof(str), "%08x-%04x-%04x-%04x-%02x%02x%02x%02x%02x%02x", uuid.timeLow,
+            uuid.timeMid, uuid.timeHiAndVersion, uuid.clockSeq, uuid.node[0], uuid.node[1],
+            uuid.node[2], uuid.node[3], uuid.node[4], uuid.node[5]);
+    return str;
+}
+
+const char *typeToString(uint32_t flags)
+{
+    switch (flags & EFFECT_FLAG_TYPE_MASK) {
+    case EFFECT_FLAG_TYPE_INSERT:
+        return "insert";
+    case EFFECT_FLAG_TYPE_AUXILIARY:
+        return "auxiliary";
+    case EFFECT_FLAG_TYPE_REPLACE:
+        return "replace";
+    case EFFECT_FLAG_TYPE_PRE_PROC:
+        return "pre_proc";
+    case EFFECT_FLAG_TYPE_POST_PROC:
+        return "post_proc";
+    default:
+        return "unknown";
+    }
+}
+
+// Same checks as the EffectsFactory when it loads a library from the configuration.
+const audio_effect_library_t *loadLibrary(const char *path)
+{
+    void *handle = dlopen(path, RTLD_NOW);
+    if (handle == nullptr) {
+        fprintf(stderr, "Could not dlopen library %s: %s\n", path, dlerror());
+        return nullptr;
+    }
+    auto *library = static_cast<const audio_effect_library_t *>(
+            dlsym(handle, AUDIO_EFFECT_LIBRARY_INFO_SYM_AS_STR));
+    if (library == nullptr || library->tag != AUDIO_EFFECT_LIBRARY_TAG ||
+            EFFECT_API_VERSION_MAJOR(library->version) !=
+                    EFFECT_API_VERSION_MAJOR(EFFECT_LIBRARY_API_VERSION_CURRENT)) {
+        fprintf(stderr, "Invalid effect library %s\n", path);
+        dlclose(handle);
+        return nullptr;
+    }
+    return library;
+}
+
+std::vector<EffectEntry> libraryEffects(const Options &options)
+{
+    std::vector<effect_uuid_t> uuids;
+    for (const char *str : kBundledEffectUuids) {
+        uuids.emplace_back();
+        parseUuid(str, &uuids.back());
+    }
+    for (const std::string &str : options.uuids) {
+        uuids.emplace_back();
+        if (!parseUuid(str.c_str(), &uuids.back())) {
+            fprintf(stderr, "Invalid uuid %s\n", str.c_str());
+            uuids.pop_back();
+        }
+    }
+
+    std::vector<EffectEntry> effects;
+    for (const std::string &path : options.libraries) {
+        const audio_effect_library_t *library = loadLibrary(path.c_str());
+        if (library == nullptr) {
+            continue;
+        }
+        for (const effect_uuid_t &uuid : uuids) {
+            EffectEntry entry{};
+            if (library->get_descriptor(&uuid, &entry.descriptor) == 0) {
+                entry.libraryPath = path;
+                entry.library = library;
+                effects.push_back(entry);
+            }
+        }
+    }
+    return effects;
+}
+
+#ifdef __ANDROID__
+std::vector<EffectEntry> factoryEffects()
+{
+    std::vector<EffectEntry> effects;
+    uint32_t numEffects = 0;
+    if (EffectQueryNumberEffects(&numEffects) != 0) {
+        fprintf(stderr, "Could not query the effects of the EffectsFactory\n");
+        return effects;
+    }
+    for (uint32_t i = 0; i < numEffects; i++) {
+        EffectEntry entry{};
+        if (EffectQueryEffect(i, &entry.descriptor) == 0) {
+            effects.push_back(entry);
+        }
+    }
+    return effects;
+}
+#endif
+
+int createEffect(const EffectEntry &entry, effect_handle_t *handle)
+{
+    if (entry.library != nullptr) {
+        return entry.library->create_effect(&entry.descriptor.uuid, 1 /* sessionId */,
+                1 /* ioId */, handle);
+    }
+#ifdef __ANDROID__
+    return EffectCreate(&entry.descriptor.uuid, 1 /* sessionId */, 1 /* ioId */, handle);
+#else
+    return -ENODEV;
+#endif
+}
+
+void releaseEffect(const EffectEntry &entry, effect_handle_t handle)
+{
+    if (entry.library != nullptr) {
+        entry.library->release_effect(handle);
+    }
+#ifdef __ANDROID__
+    else {
+        EffectRelease(handle);
+    }
+#endif
+}
+
+// Auxiliary effects receive the mono send of a track, pre processors capture channel masks.
+void setChannelMasks(uint32_t flags, uint32_t channelCount, effect_config_t *config)
+{
+    switch (flags & EFFECT_FLAG_TYPE_MASK) {
+    case EFFECT_FLAG_TYPE_AUXILIARY:
+        config->inputCfg.channels = AUDIO_CHANNEL_OUT_MONO;
+        config->outputCfg.channels = audio_channel_out_mask_from_count(channelCount);
+        break;
+    case EFFECT_FLAG_TYPE_PRE_PROC:
+        config->inputCfg.channels = config->outputCfg.channels =
+                audio_channel_in_mask_from_count(channelCount);
+        break;
+    default:
+        config->inputCfg.channels = config->outputCfg.channels =
+                audio_channel_out_mask_from_count(channelCount);
+        break;
+    }
+}
+
+bool setConfig(effect_handle_t effect, effect_config_t *config)
+{
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    return (*effect)->command(effect, EFFECT_CMD_SET_CONFIG, sizeof(*config), config,
+            &replySize, &reply) == 0 && reply == 0;
+}
+
+// A sine per channel at a different frequency, white noise and 50 ms bursts every 500 ms, so
+// that dynamics processors move between their states.
+std::vector<float> makeSignal(uint32_t sampleRate, uint32_t channelCount, size_t frameCount)
+{
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-0.1f, 0.1f);
+    std::vector<float> signal(frameCount * channelCount);
+    for (size_t i = 0; i < frameCount; i++) {
+        const bool burst = i % (sampleRate / 2) < sampleRate / 20;
+        for (uint32_t ch = 0; ch < channelCount; ch++) {
+            const double phase = 2. * M_PI * 110. * (ch + 1) * i / sampleRate;
+            signal[i * channelCount + ch] = (burst ? 0.8f : 0.2f) * (float)sin(phase)
+                    + distribution(generator);
+        }
+    }
+    return signal;
+}
+
+// FNV-1a hash of the output samples
+uint64_t checksum(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+Result measure(const EffectEntry &entry, audio_format_t format, uint32_t sampleRate,
+        uint32_t channelCount, uint32_t frameCount, double seconds)
+{
+    Result result;
+    effect_handle_t effect;
+    if (createEffect(entry, &effect) != 0) {
+        result.status = "create_failed";
+        return result;
+    }
+
+    effect_config_t config{};
+    config.inputCfg.samplingRate = config.outputCfg.samplingRate = sampleRate;
+    config.inputCfg.format = config.outputCfg.format = format;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    config.inputCfg.mask = config.outputCfg.mask = EFFECT_CONFIG_ALL;
+    setChannelMasks(entry.descriptor.flags, channelCount, &config);
+    bool configured = setConfig(effect, &config);
+    // channel reducing effects, such as the downmix, are configured with a stereo output
+    if (!configured && channelCount > FCC_2 &&
+            (entry.descriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_INSERT) {
+        config.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+        configured = setConfig(effect, &config);
+    }
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    if (!configured ||
+            (*effect)->command(effect, EFFECT_CMD_ENABLE, 0, nullptr, &replySize, &reply) != 0 ||
+            reply != 0) {
+        releaseEffect(entry, effect);
+        result.status = "unsupported";
+        return result;
+    }
+    const bool capture =
+            (entry.descriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_PRE_PROC;
+    const uint32_t inChannelCount = capture
+            ? audio_channel_count_from_in_mask(config.inputCfg.channels)
+            : audio_channel_count_from_out_mask(config.inputCfg.channels);
+    const uint32_t outChannelCount = capture
+            ? audio_channel_count_from_in_mask(config.outputCfg.channels)
+            : audio_channel_count_from_out_mask(config.outputCfg.channels);
+    result.outChannelCount = outChannelCount;
+
+    const size_t sampleSize = audio_bytes_per_sample(format);
+    const size_t blockCount = std::max((size_t)(seconds * sampleRate / frameCount),
+            kWarmupBlocks + 1);
+    const std::vector<float> signal =
+            makeSignal(sampleRate, inChannelCount, blockCount * frameCount);
+    std::vector<int16_t> signal16;
+    if (format == AUDIO_FORMAT_PCM_16_BIT) {
+        signal16.resize(signal.size());
+        for (size_t i = 0; i < signal.size(); i++) {
+            signal16[i] = (int16_t)(std::min(std::max(signal[i], -1.f), 1.f) * 32767.f);
+        }
+    }
+    const uint8_t *input = format == AUDIO_FORMAT_PCM_16_BIT
+            ? (const uint8_t *)signal16.data() : (const uint8_t *)signal.data();
+    const size_t inBlockSize = frameCount * inChannelCount * sampleSize;
+    const size_t outBlockSize = frameCount * outChannelCount * sampleSize;
+    // effects may process in place, the input is copied to a block buffer
+    std::vector<uint8_t> inBlock(inBlockSize);
+    std::vector<uint8_t> outBlock(outBlockSize);
+    android::effect_benchmark::BlockTimes blockTimes(frameCount * 1e6 / sampleRate);
+    double energy = 0.;
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t block = 0; block < blockCount; block++) {
+        memcpy(inBlock.data(), input + block * inBlockSize, inBlockSize);
+        audio_buffer_t inBuffer{};
+        inBuffer.frameCount = frameCount;
+        inBuffer.raw = inBlock.data();
+        audio_buffer_t outBuffer{};
+        outBuffer.frameCount = frameCount;
+        outBuffer.raw = outBlock.data();
+
+        const auto start = std::chrono::steady_clock::now();
+        const int status = (*effect)->process(effect, &inBuffer, &outBuffer);
+        const auto end = std::chrono::steady_clock::now();
+        if (status != 0) {
+            result.status = status == -ENODATA ? "idle" : "process_error";
+            break;
+        }
+        if (block >= kWarmupBlocks) {
+            blockTimes.add(std::chrono::duration<double, std::micro>(end - start)
+                    .count());
+        }
+        hash = checksum(hash, outBlock.data(), outBlockSize);
+        for (size_t i = 0; i < frameCount * outChannelCount; i++) {
+            const double sample = format == AUDIO_FORMAT_PCM_16_BIT
+                    ? ((const int16_t *)outBlock.data())[i] / 32768.
+                    : ((const float *)outBlock.data())[i];
+            energy += sample * sample;
+        }
+        result.blocks++;
+    }
+    releaseEffect(entry, effect);
+    if (!result.status.empty()) {
+        return result;
+    }
+
+    result.status = "ok";
+    result.nsPerFrame = blockTimes.meanUs() * 1e3 / frameCount;
+    result.p99Us = blockTimes.p99Us();
+    result.maxUs = blockTimes.maxUs();
+    result.cpuPct = blockTimes.cpuPct();
+    result.checksum = hash;
+    result.rmsDbfs = 10. * log10(std::max(energy / (result.blocks * frameCount * outChannelCount),
+            1e-20));
+    return result;
+}
+
+// Identifies a configuration of an effect across reports
+std::string resultKey(const std::string &uuid, const char *format, uint32_t sampleRate,
+        uint32_t channelCount, uint32_t frameCount)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "%s/%s/%u/%u/%u", uuid.c_str(), format, sampleRate,
+            channelCount, frameCount);
+    return key;
+}
+
+// The report is parsed line by line: each result is a flat JSON object on its own line.
+bool findField(const std::string &line, const char *name, std::string *value)
+{
+    const std::string pattern = std::string("\"") + name + "\": ";
+    const size_t pos = line.find(pattern);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    size_t begin = pos + pattern.size();
+    size_t end;
+    if (line[begin] == '"') {
+        end = line.find('"', ++begin);
+    } else {
+        end = line.find_first_of(",}", begin);
+    }
+    if (end == std::string::npos) {
+        return false;
+    }
+    *value = line.substr(begin, end - begin);
+    return true;
+}
+
+struct BaselineResult {
+    size_t blocks;
+    double nsPerFrame;
+    std::string checksum;
+};
+
+bool readBaseline(const char *path, std::map<std::string, BaselineResult> *baseline)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open baseline %s\n", path);
+        return false;
+    }
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), file) != nullptr) {
+        const std::string line = buffer;
+        std::string uuid, format, sampleRate, channels, frames, status, blocks, nsPerFrame,
+                hash;
+        if (!findField(line, "uuid", &uuid) || !findField(line, "format", &format) ||
+                !findField(line, "sample_rate", &sampleRate) ||
+                !findField(line, "channels", &channels) ||
+                !findField(line, "frame_count", &frames) ||
+                !findField(line, "status", &status) || status != "ok" ||
+                !findField(line, "blocks", &blocks) ||
+                !findField(line, "ns_per_frame", &nsPerFrame) ||
+                !findField(line, "checksum", &hash)) {
+            continue;
+        }
+        (*baseline)[resultKey(uuid, format.c_str(), atoi(sampleRate.c_str()),
+                atoi(channels.c_str()), atoi(frames.c_str()))] =
+                BaselineResult{(size_t)atol(blocks.c_str()), atof(nsPerFrame.c_str()), hash};
+    }
+    fclose(file);
+    return true;
+}
+
+std::vector<uint32_t> parseList(const char *str)
+{
+    std::vector<uint32_t> values;
+    for (const char *p = str; *p != '\0'; ) {
+        char *end;
+        values.push_back(strtoul(p, &end, 10));
+        p = *end == ',' ? end + 1 : end + strlen(end);
+    }
+    return values;
+}
+
+bool parseFormats(const char *str, std::vector<audio_format_t> *formats)
+{
+    formats->clear();
+    std::string list = str;
+    for (size_t begin = 0; begin <= list.size(); ) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        const std::string format = list.substr(begin, end - begin);
+        if (format == "float") {
+            formats->push_back(AUDIO_FORMAT_PCM_FLOAT);
+        } else if (format == "int16") {
+            formats->push_back(AUDIO_FORMAT_PCM_16_BIT);
+        } else {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return !formats->empty();
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [--library <path>]... [--uuid <uuid>]... [--effect <name>]...\n"
+            "       [--formats float,int16] [--rates <list>] [--channels <list>]\n"
+            "       [--frames <list>] [--seconds <s>] [--output <file>]\n"
+            "       [--baseline <file>] [--tolerance <pct>]\n",
+            name);
+}
+
+bool parseOptions(int argc, char **argv, Options *options)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        if (i + 1 == argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (option == "--library") {
+            options->libraries.push_back(value);
+        } else if (option == "--uuid") {
+            options->uuids.push_back(value);
+        } else if (option == "--effect") {
+            options->names.push_back(value);
+        } else if (option == "--formats") {
+            if (!parseFormats(value, &options->formats)) {
+                return false;
+            }
+        } else if (option == "--rates") {
+            options->sampleRates = parseList(value);
+        } else if (option == "--channels") {
+            options->channelCounts = parseList(value);
+        } else if (option == "--frames") {
+            options->frameCounts = parseList(value);
+        } else if (option == "--seconds") {
+            options->seconds = atof(value);
+        } else if (option == "--output") {
+            options->output = value;
+        } else if (option == "--baseline") {
+            options->baseline = value;
+        } else if (option == "--tolerance") {
+            options->tolerancePct = atof(value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool selected(const Options &options, const effect_descriptor_t &descriptor)
+{
+    if (options.names.empty()) {
+        return true;
+    }
+    for (const std::string &name : options.names) {
+        if (strstr(descriptor.name, name.c_str()) != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copies str into a JSON string, without the characters needing an escape sequence.
+std::string jsonString(const char *str)
+{
+    std::string json;
+    for (const char *p = str; *p != '\0'; p++) {
+        if (*p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) {
+            json += *p;
+        }
+    }
+    return json;
+}
+
+}   // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, BaselineResult> baseline;
+    if (options.baseline != nullptr && !readBaseline(options.baseline, &baseline)) {
+        return EXIT_FAILURE;
+    }
+
+#ifdef __ANDROID__
+    const std::vector<EffectEntry> effects =
+            options.libraries.empty() ? factoryEffects() : libraryEffects(options);
+#else
+    const std::vector<EffectEntry> effects = libraryEffects(options);
+#endif
+    if (effects.empty()) {
+        fprintf(stderr, "No effect to measure\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = options.output != nullptr ? fopen(options.output, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "Could not open %s\n", options.output);
+        return EXIT_FAILURE;
+    }
+    size_t regressions = 0;
+    bool first = true;
+    fprintf(out, "{\"results\": [\n");
+    for (const EffectEntry &entry : effects) {
+        if (!selected(options, entry.descriptor)) {
+            continue;
+        }
+        const std::string uuid = uuidToString(entry.descriptor.uuid);
+        for (audio_format_t format : options.formats) {
+            const char *formatName = format == AUDIO_FORMAT_PCM_FLOAT ? "float" : "int16";
+            for (uint32_t sampleRate : options.sampleRates) {
+                for (uint32_t channelCount : options.channelCounts) {
+                    for (uint32_t frameCount : options.frameCounts) {
+                        const Result result = measure(entry, format, sampleRate, channelCount,
+                                frameCount, options.seconds);
+                        fprintf(out, "%s{\"effect\": \"%s\", \"uuid\": \"%s\", "
+                                "\"implementor\": \"%s\", \"library\": \"%s\", "
+                                "\"type\": \"%s\", \"format\": \"%s\", \"sample_rate\": %u, "
+                                "\"channels\": %u, \"frame_count\": %u, \"status\": \"%s\"",
+                                first ? "" : ",\n",
+                                jsonString(entry.descriptor.name).c_str(), uuid.c_str(),
+                                jsonString(entry.descriptor.implementor).c_str(),
+                                jsonString(entry.libraryPath.c_str()).c_str(),
+                                typeToString(entry.descriptor.flags), formatName, sampleRate,
+                                channelCount, frameCount, result.status.c_str());
+                        first = false;
+                        if (result.status != "ok") {
+                            fprintf(out, "}");
+                            continue;
+                        }
+                        char hash[20];
+                        snprintf(hash, sizeof(hash), "%016" PRIx64, result.checksum);
+                        fprintf(out, ", \"out_channels\": %u, \"blocks\": %zu, "
+                                "\"ns_per_frame\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, "
+                                "\"cpu_pct\": %.4f, \"checksum\": \"%s\", \"rms_dbfs\": %.2f}",
+                                result.outChannelCount, result.blocks, result.nsPerFrame,
+                                result.p99Us, result.maxUs, result.cpuPct, hash, result.rmsDbfs);
+
+                        const auto it = baseline.find(resultKey(uuid, formatName, sampleRate,
+                                channelCount, frameCount));
+                        if (it == baseline.end()) {
+                            continue;
+                        }
+                        const std::string key = std::string(entry.descriptor.name) + " " +
+                                it->first;
+                        if (result.nsPerFrame >
+                                it->second.nsPerFrame * (1. + options.tolerancePct / 100.)) {
+                            fprintf(stderr, "%s: %.3f ns/frame, baseline %.3f ns/frame\n",
+                                    key.c_str(), result.nsPerFrame, it->second.nsPerFrame);
+                            regressions++;
+                        }
+                        // the output only matches for the same duration of the signal
+                        if (it->second.blocks == result.blocks &&
+                                it->second.checksum != hash) {
+                            fprintf(stderr, "%s: output checksum %s, baseline %s\n",
+                                    key.c_str(), hash, it->second.checksum.c_str());
+                            regressions++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    if (regressions > 0) {
+        fprintf(stderr, "%zu regressions over the baseline\n", regressions);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
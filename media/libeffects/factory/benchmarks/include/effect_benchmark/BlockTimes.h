@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECT_BENCHMARK_BLOCK_TIMES_H
+#define ANDROID_EFFECT_BENCHMARK_BLOCK_TIMES_H
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+namespace android {
+namespace effect_benchmark {
+
+// Processing times of the audio blocks of an effect benchmark, each block holding
+// blockDurationUs of audio. The effect benchmarks report them in the same counters:
+//   "cpu_pct"  mean block time over the block duration, the share of one core used in real time
+//   "p99_us"   99th percentile of the block times
+//   "max_us"   maximum block time
+class BlockTimes {
+public:
+    explicit BlockTimes(double blockDurationUs) : mBlockDurationUs(blockDurationUs) {}
+
+    // Runs and times the processing of one block.
+    template <typename F>
+    void time(F&& processBlock) {
+        const auto start = std::chrono::steady_clock::now();
+        processBlock();
+        add(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    void add(double us) {
+        mTimesUs.push_back(us);
+        mSorted = false;
+    }
+
+    bool empty() const { return mTimesUs.empty(); }
+
+    double meanUs() const {
+        return mTimesUs.empty() ? 0. :
+                std::accumulate(mTimesUs.begin(), mTimesUs.end(), 0.) / mTimesUs.size();
+    }
+
+    double p99Us() { return percentileUs(99); }
+
+    double maxUs() { return percentileUs(100); }
+
+    double cpuPct() const { return meanUs() / mBlockDurationUs * 100.; }
+
+    // Sets the counters above in a google-benchmark State.
+    template <typename State>
+    void setCounters(State& state) {
+        if (mTimesUs.empty()) {
+            return;
+        }
+        state.counters["cpu_pct"] = cpuPct();
+        state.counters["p99_us"] = p99Us();
+        state.counters["max_us"] = maxUs();
+    }
+
+private:
+    double percentileUs(size_t percentile) {
+        if (mTimesUs.empty()) {
+            return 0.;
+        }
+        if (!mSorted) {
+            std::sort(mTimesUs.begin(), mTimesUs.end());
+            mSorted = true;
+        }
+        return mTimesUs[std::min(mTimesUs.size() * percentile / 100, mTimesUs.size() - 1)];
+    }
+
+    const double mBlockDurationUs;
+    std::vector<double> mTimesUs;
+    bool mSorted = false;
+};
+
+}  // namespace effect_benchmark
+}  // namespace android
+
+#endif  // ANDROID_EFFECT_BENCHMARK_BLOCK_TIMES_H
@@ -27,7 +27,7 @@
 
 #include <log/log.h>
 
-#include <audio_effects/effect_loudnessenhancer.h>
+#include "EffectLoudnessEnhancer.h"
 #include "dsp/core/dynamic_range_compression.h"
 
 // BUILD_FLOAT targets building a float effect instead of the legacy int16_t effect.
@@ -78,6 +78,7 @@ struct LoudnessEnhancerContext {
     effect_config_t mConfig;
     uint8_t mState;
     int32_t mTargetGainmB;// target gain in mB
+    int32_t mLookaheadUs; // look-ahead of the limiter in us, 0 when disabled
     // in this implementation, there is no coupling between the compression on the left and right
     // channels
     le_fx::AdaptiveDynamicRangeCompression* mCompressor;
@@ -95,6 +96,8 @@ void LE_reset(LoudnessEnhancerContext *pContext)
         float targetAmp = pow(10, pContext->mTargetGainmB/2000.0f); // mB to linear amplification
         ALOGV("LE_reset(): Target gain=%dmB <=> factor=%.2fX", pContext->mTargetGainmB, targetAmp);
         pContext->mCompressor->Initialize(targetAmp, pContext->mConfig.inputCfg.samplingRate);
+        pContext->mCompressor->set_lookahead_frames((size_t)pContext->mLookaheadUs *
+                pContext->mConfig.inputCfg.samplingRate / 1000000);
     } else {
         ALOGE("LE_reset(%p): null compressors, can't apply target gain", pContext);
     }
@@ -188,6 +191,7 @@ int LE_init(LoudnessEnhancerContext *pContext)
     pContext->mConfig.outputCfg.mask = EFFECT_CONFIG_ALL;
 
     pContext->mTargetGainmB = LOUDNESS_ENHANCER_DEFAULT_TARGET_GAIN_MB;
+    pContext->mLookaheadUs = 0;
     float targetAmp = pow(10, pContext->mTargetGainmB/2000.0f); // mB to linear amplification
     ALOGV("LE_init(): Target gain=%dmB <=> factor=%.2fX", pContext->mTargetGainmB, targetAmp);
 
@@ -296,31 +300,35 @@ int LE_process(
     }
 
     //ALOGV("LE about to process %d samples", inBuffer->frameCount);
-    uint16_t inIdx;
+    // makeup gain is applied on the input of the compressor
 #ifdef BUILD_FLOAT
     constexpr float scale = 1 << 15; // power of 2 is lossless conversion to int16_t range
     constexpr float inverseScale = 1.f / scale;
     const float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f) * scale;
+    const size_t sampleCount = inBuffer->frameCount * 2;
+    for (size_t i = 0; i < sampleCount; i++) {
+        inBuffer->f32[i] *= inputAmp;
+    }
+    pContext->mCompressor->CompressBlock(inBuffer->f32, inBuffer->frameCount);
+    for (size_t i = 0; i < sampleCount; i++) {
+        inBuffer->f32[i] *= inverseScale;
+    }
 #else
-    float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f);
-#endif
-    float leftSample, rightSample;
-    for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
-        // makeup gain is applied on the input of the compressor
-#ifdef BUILD_FLOAT
-        leftSample  = inputAmp * inBuffer->f32[2*inIdx];
-        rightSample = inputAmp * inBuffer->f32[2*inIdx +1];
-        pContext->mCompressor->Compress(&leftSample, &rightSample);
-        inBuffer->f32[2*inIdx]    = leftSample * inverseScale;
-        inBuffer->f32[2*inIdx +1] = rightSample * inverseScale;
-#else
-        leftSample  = inputAmp * (float)inBuffer->s16[2*inIdx];
-        rightSample = inputAmp * (float)inBuffer->s16[2*inIdx +1];
-        pContext->mCompressor->Compress(&leftSample, &rightSample);
-        inBuffer->s16[2*inIdx]    = (int16_t) leftSample;
-        inBuffer->s16[2*inIdx +1] = (int16_t) rightSample;
-#endif // BUILD_FLOAT
+    const float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f);
+    constexpr size_t kBlockFrames = 256;
+    float block[kBlockFrames * 2];
+    for (size_t frame = 0; frame < inBuffer->frameCount; frame += kBlockFrames) {
+        const size_t frameCount = std::min(inBuffer->frameCount - frame, kBlockFrames);
+        int16_t *samples = inBuffer->s16 + frame * 2;
+        for (size_t i = 0; i < frameCount * 2; i++) {
+            block[i] = inputAmp * (float)samples[i];
+        }
+        pContext->mCompressor->CompressBlock(block, frameCount);
+        for (size_t i = 0; i < frameCount * 2; i++) {
+            samples[i] = (int16_t)block[i];
+        }
     }
+#endif // BUILD_FLOAT
 
     if (inBuffer->raw != outBuffer->raw) {
 #ifdef BUILD_FLOAT
@@ -426,6 +434,20 @@ int LE_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             p->vsize = sizeof(int32_t);
             *replySize += sizeof(int32_t);
             break;
+        case LOUDNESS_ENHANCER_PARAM_LOOKAHEAD_US:
+            ALOGV("get limiter look-ahead(us) = %d", pContext->mLookaheadUs);
+            *((int32_t *)p->data + 1) = pContext->mLookaheadUs;
+            p->vsize = sizeof(int32_t);
+            *replySize += sizeof(int32_t);
+            break;
+        case LOUDNESS_ENHANCER_PARAM_LATENCY_FRAMES: {
+            const int32_t latencyFrames = pContext->mCompressor != NULL ?
+                    (int32_t)pContext->mCompressor->latency_frames() : 0;
+            ALOGV("get latency(frames) = %d", latencyFrames);
+            *((int32_t *)p->data + 1) = latencyFrames;
+            p->vsize = sizeof(int32_t);
+            *replySize += sizeof(int32_t);
+            } break;
         default:
             p->status = -EINVAL;
         }
@@ -448,6 +470,16 @@ int LE_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             ALOGV("set target gain(mB) = %d", pContext->mTargetGainmB);
             LE_reset(pContext); // apply parameter update
             break;
+        case LOUDNESS_ENHANCER_PARAM_LOOKAHEAD_US: {
+            const int32_t lookaheadUs = *((int32_t *)p->data + 1);
+            if (lookaheadUs < 0 || lookaheadUs > LOUDNESS_ENHANCER_MAX_LOOKAHEAD_US) {
+                *(int32_t *)pReplyData = -EINVAL;
+                break;
+            }
+            pContext->mLookaheadUs = lookaheadUs;
+            ALOGV("set limiter look-ahead(us) = %d", pContext->mLookaheadUs);
+            LE_reset(pContext); // apply parameter update
+            } break;
         default:
             *(int32_t *)pReplyData = -EINVAL;
         }
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECTLOUDNESSENHANCER_H_
+#define ANDROID_EFFECTLOUDNESSENHANCER_H_
+
+#include <audio_effects/effect_loudnessenhancer.h>
+
+// Vendor parameter holding the look-ahead of the limiter following the compressor, as an
+// int32_t in microseconds between 0 and LOUDNESS_ENHANCER_MAX_LOOKAHEAD_US.
+// With a look-ahead, peaks exceeding full scale after compression are attenuated smoothly
+// instead of being clipped, and the output is delayed by the look-ahead minus one frame, as
+// reported by LOUDNESS_ENHANCER_PARAM_LATENCY_FRAMES. The default of 0 disables the limiter.
+#define LOUDNESS_ENHANCER_PARAM_LOOKAHEAD_US (LOUDNESS_ENHANCER_PARAM_TARGET_GAIN_MB + 0x100)
+
+// Read-only vendor parameter holding the delay of the output of the effect, as an int32_t in
+// frames at the configured sampling rate. It is 0 when the limiter is disabled.
+#define LOUDNESS_ENHANCER_PARAM_LATENCY_FRAMES (LOUDNESS_ENHANCER_PARAM_TARGET_GAIN_MB + 0x101)
+
+#define LOUDNESS_ENHANCER_MAX_LOOKAHEAD_US 20000
+
+#endif /*ANDROID_EFFECTLOUDNESSENHANCER_H_*/
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the loudness enhancer compressor on interleaved stereo at 48 kHz.
+//
+// Run with:
+//   loudness_benchmark
+// BM_Compress runs the per sample compressor, as the effect did before block processing; its
+// argument is the frame count per block. BM_CompressBlock arguments are the frame count per
+// block and the limiter look-ahead in frames, 0 disabling the limiter. "ns_per_frame" is the
+// mean processing time of a frame, next to the block time counters.
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <effect_benchmark/BlockTimes.h>
+
+#include "dsp/core/dynamic_range_compression.h"
+
+static constexpr float kSamplingRate = 48000.f;
+static constexpr float kTargetGain = 2.f;
+
+// Input in the fixed point range seen by the compressor, with peaks above the knee.
+static std::vector<float> makeInput(size_t frameCount) {
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    std::vector<float> input(frameCount * 2);
+    for (size_t i = 0; i < frameCount; i++) {
+        const float s = 32768.f * kTargetGain *
+                (0.6f * sinf(i * 0.05f) + 0.2f * distribution(generator));
+        input[2 * i] = s;
+        input[2 * i + 1] = 0.8f * s;
+    }
+    return input;
+}
+
+using android::effect_benchmark::BlockTimes;
+
+static BlockTimes makeBlockTimes(size_t frameCount) {
+    return BlockTimes(frameCount * 1e6 / kSamplingRate);
+}
+
+static void setCounters(benchmark::State& state, BlockTimes& blockTimes, size_t frameCount) {
+    blockTimes.setCounters(state);
+    state.counters["ns_per_frame"] = blockTimes.meanUs() * 1e3 / frameCount;
+    state.SetItemsProcessed(state.iterations() * frameCount);
+}
+
+static void BM_Compress(benchmark::State& state) {
+    const size_t frameCount = state.range(0);
+    const std::vector<float> input = makeInput(frameCount);
+    std::vector<float> buffer(input.size());
+    le_fx::AdaptiveDynamicRangeCompression compressor;
+    compressor.Initialize(kTargetGain, kSamplingRate);
+    BlockTimes blockTimes = makeBlockTimes(frameCount);
+
+    for (auto _ : state) {
+        std::copy(input.begin(), input.end(), buffer.begin());
+        blockTimes.time([&]() {
+            for (size_t i = 0; i < frameCount * 2; i += 2) {
+                compressor.Compress(&buffer[i], &buffer[i + 1]);
+            }
+            benchmark::DoNotOptimize(buffer.data());
+        });
+    }
+    setCounters(state, blockTimes, frameCount);
+}
+
+static void BM_CompressBlock(benchmark::State& state) {
+    const size_t frameCount = state.range(0);
+    const std::vector<float> input = makeInput(frameCount);
+    std::vector<float> buffer(input.size());
+    le_fx::AdaptiveDynamicRangeCompression compressor;
+    compressor.Initialize(kTargetGain, kSamplingRate);
+    compressor.set_lookahead_frames(state.range(1));
+    BlockTimes blockTimes = makeBlockTimes(frameCount);
+
+    for (auto _ : state) {
+        std::copy(input.begin(), input.end(), buffer.begin());
+        blockTimes.time([&]() {
+            compressor.CompressBlock(buffer.data(), frameCount);
+            benchmark::DoNotOptimize(buffer.data());
+        });
+    }
+    setCounters(state, blockTimes, frameCount);
+}
+
+static constexpr int64_t kFrameCounts[] = {64, 256, 960};
+
+static void CompressArgs(benchmark::internal::Benchmark *b) {
+    for (int64_t frameCount : kFrameCounts) {
+        b->Args({frameCount});
+    }
+}
+
+static void CompressBlockArgs(benchmark::internal::Benchmark *b) {
+    for (int64_t frameCount : kFrameCounts) {
+        for (int64_t lookahead : {0, 240}) {
+            b->Args({frameCount, lookahead});
+        }
+    }
+}
+
+BENCHMARK(BM_Compress)->Apply(CompressArgs);
+
+BENCHMARK(BM_CompressBlock)->Apply(CompressBlockArgs);
+
+BENCHMARK_MAIN();
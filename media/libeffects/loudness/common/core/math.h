@@ -18,6 +18,8 @@
 #define LE_FX_ENGINE_COMMON_CORE_MATH_H_
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include <algorithm>
 using ::std::min;
 using ::std::max;
@@ -51,6 +53,46 @@ inline float fast_log(float val) {
       0.693147180559945286226763982995180413126945495605468750f;
 }
 
+// A branch-free approximation to log2(.) for positive normal values, using a
+// 5-th order polynomial of the mantissa. The absolute error is below 6e-5.
+// Unlike fast_log2(), it has no pointer type-punning, so that loops calling it
+// can be vectorized by the compiler.
+inline float log2_approx(float val) {
+  uint32_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  const float exponent = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127);
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float mantissa;
+  memcpy(&mantissa, &bits, sizeof(mantissa));
+  float p = 0.0596515482674574969533f;
+  p = p * mantissa - 0.465725644288844778798f;
+  p = p * mantissa + 1.48116647521213171641f;
+  p = p * mantissa - 2.52074962577807006663f;
+  p = p * mantissa + 2.8882704548164776201f;
+  return p * (mantissa - 1.0f) + exponent;
+}
+
+// A branch-free approximation to exp2(.), using a 5-th order polynomial of the
+// fractional part. Arguments are clamped to [-126, 126]; in that range the
+// relative error is below 2e-7.
+inline float exp2_approx(float val) {
+  val = std::min(std::max(val, -126.0f), 126.0f);
+  // floor(.) without a library call: truncate, then correct negative values
+  const int32_t truncated = static_cast<int32_t>(val);
+  const int32_t integer = truncated - (static_cast<float>(truncated) > val);
+  const float fraction = val - static_cast<float>(integer);
+  float p = 1.8775767e-3f;
+  p = p * fraction + 8.9893397e-3f;
+  p = p * fraction + 5.5826318e-2f;
+  p = p * fraction + 2.4015361e-1f;
+  p = p * fraction + 6.9315308e-1f;
+  p = p * fraction + 9.9999994e-1f;
+  const uint32_t bits = static_cast<uint32_t>(integer + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
 // An approximation of the exp(.) function using a 5-th order Taylor expansion.
 // It's pretty accurate between +-0.1 and accurate to 10e-3 between +-1
 template <typename T>
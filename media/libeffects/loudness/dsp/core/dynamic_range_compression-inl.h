@@ -33,6 +33,15 @@ inline void AdaptiveDynamicRangeCompression::set_knee_threshold(float decibel) {
 }
 
 
+inline size_t AdaptiveDynamicRangeCompression::lookahead_frames() const {
+  return lookahead_;
+}
+
+inline size_t AdaptiveDynamicRangeCompression::latency_frames() const {
+  return lookahead_ > 0 ? lookahead_ - 1 : 0;
+}
+
+
 inline void AdaptiveDynamicRangeCompression::set_knee_threshold_via_target_gain(
     float target_gain) {
   const float decibel = target_gain_to_knee_threshold_.Interpolate(
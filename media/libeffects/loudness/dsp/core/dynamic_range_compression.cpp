@@ -40,8 +40,11 @@ const float AdaptiveDynamicRangeCompression::kDefaultKneeThresholdInDecibel =
 const float AdaptiveDynamicRangeCompression::kCompressionRatio = 7.0f;
 const float AdaptiveDynamicRangeCompression::kTauAttack = 0.001f;
 const float AdaptiveDynamicRangeCompression::kTauRelease = 0.015f;
+const float AdaptiveDynamicRangeCompression::kTauLimiterRelease = 0.05f;
+const size_t AdaptiveDynamicRangeCompression::kBlockSize;
 
-AdaptiveDynamicRangeCompression::AdaptiveDynamicRangeCompression() {
+AdaptiveDynamicRangeCompression::AdaptiveDynamicRangeCompression()
+    : lookahead_(0) {
   static const float kTargetGain[] = {
       1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
   static const float kKneeThreshold[] = {
@@ -71,9 +74,30 @@ bool AdaptiveDynamicRangeCompression::Initialize(
   }
   // Feed-forward topology
   slope_ = 1.0f / kCompressionRatio - 1.0f;
+  limiter_alpha_release_ = std::exp(-1.0f / (kTauLimiterRelease * sampling_rate_));
+  ResetLimiter();
   return true;
 }
 
+void AdaptiveDynamicRangeCompression::set_lookahead_frames(size_t frame_count) {
+  lookahead_ = frame_count > 1 ? frame_count : 0;
+  limiter_gains_.resize(lookahead_);
+  limiter_delay_.resize(2 * lookahead_);
+  limiter_min_gains_.resize(lookahead_);
+  limiter_min_frames_.resize(lookahead_);
+  ResetLimiter();
+}
+
+void AdaptiveDynamicRangeCompression::ResetLimiter() {
+  limiter_frames_ = 0;
+  limiter_gain_ = 1.0f;
+  limiter_gain_sum_ = lookahead_;
+  fill(limiter_gains_.begin(), limiter_gains_.end(), 1.0f);
+  fill(limiter_delay_.begin(), limiter_delay_.end(), 0.0f);
+  limiter_min_head_ = 0;
+  limiter_min_count_ = 0;
+}
+
 float AdaptiveDynamicRangeCompression::Compress(float x) {
   const float max_abs_x = std::max(std::fabs(x), kMinLogAbsValue);
   const float max_abs_x_dB = math::fast_log(max_abs_x);
@@ -136,5 +160,112 @@ void AdaptiveDynamicRangeCompression::Compress(float *x1, float *x2) {
   }
 }
 
-}  // namespace le_fx
+void AdaptiveDynamicRangeCompression::CompressBlock(float *x,
+                                                    size_t frame_count) {
+  static const float kLog2ToLog =
+      0.693147180559945286226763982995180413126945495605468750f;
+  static const float kLogToLog2 = 1.0f / kLog2ToLog;
+  float envelope[kBlockSize];
+  while (frame_count > 0) {
+    const size_t block_size = std::min(frame_count, kBlockSize);
+    // Control voltage for the peak of both channels, as in Compress(.). The
+    // peak and the logarithm are separate passes, which compilers vectorize
+    // more readily than the fused loop.
+    for (size_t i = 0; i < block_size; ++i) {
+      envelope[i] = std::max(std::max(std::fabs(x[2 * i]),
+                                      std::fabs(x[2 * i + 1])),
+                             kMinLogAbsValue);
+    }
+    for (size_t i = 0; i < block_size; ++i) {
+      const float overshoot =
+          math::log2_approx(envelope[i]) * kLog2ToLog - knee_threshold_;
+      envelope[i] = std::max(overshoot, 0.0f) * slope_;
+    }
+    // The envelope detector is recursive, it is the only sample by sample loop
+    float state = state_;
+    for (size_t i = 0; i < block_size; ++i) {
+      const float cv = envelope[i];
+      const float alpha = cv <= state ? alpha_attack_ : alpha_release_;
+      state = alpha * state + (1.0f - alpha) * cv;
+      envelope[i] = state;
+    }
+    state_ = state;
+    // Compress(.) accumulates the gain as the product of exp(.) of the state
+    // increments, which is exp(.) of the state.
+    if (lookahead_ > 0) {
+      for (size_t i = 0; i < block_size; ++i) {
+        const float gain = math::exp2_approx(envelope[i] * kLogToLog2);
+        x[2 * i] *= gain;
+        x[2 * i + 1] *= gain;
+      }
+      Limit(x, block_size);
+    } else {
+      for (size_t i = 0; i < block_size; ++i) {
+        const float gain = math::exp2_approx(envelope[i] * kLogToLog2);
+        x[2 * i] = std::min(std::max(x[2 * i] * gain, -kFixedPointLimit),
+                            kFixedPointLimit);
+        x[2 * i + 1] = std::min(std::max(x[2 * i + 1] * gain, -kFixedPointLimit),
+                                kFixedPointLimit);
+      }
+    }
+    compressor_gain_ = math::exp2_approx(state * kLogToLog2);
+    x += 2 * block_size;
+    frame_count -= block_size;
+  }
+}
 
+// The gain applied to a frame is the average of the smoothed gains of the
+// lookahead_ frames that follow it. Each of them is at most the minimum gain
+// required over the lookahead_ frames that precede it, which include the
+// delayed frame: the limited output never exceeds the fixed-point limit.
+void AdaptiveDynamicRangeCompression::Limit(float *x, size_t frame_count) {
+  // Ring buffer indices stay below 2 * lookahead_ before wrapping: wrap them
+  // with a subtraction rather than a division per frame.
+  const size_t lookahead = lookahead_;
+  auto wrap = [lookahead](size_t index) {
+    return index >= lookahead ? index - lookahead : index;
+  };
+  size_t slot = limiter_frames_ % lookahead;
+  for (size_t i = 0; i < frame_count; ++i, ++limiter_frames_) {
+    float *frame = x + 2 * i;
+    const float peak = std::max(std::fabs(frame[0]), std::fabs(frame[1]));
+    const float required =
+        peak > kFixedPointLimit ? kFixedPointLimit / peak : 1.0f;
+
+    // Sliding minimum of the required gains
+    if (limiter_min_count_ > 0 &&
+        limiter_min_frames_[limiter_min_head_] + lookahead_ <= limiter_frames_) {
+      limiter_min_head_ = wrap(limiter_min_head_ + 1);
+      --limiter_min_count_;
+    }
+    while (limiter_min_count_ > 0 &&
+           limiter_min_gains_[wrap(limiter_min_head_ + limiter_min_count_ -
+                                   1)] >= required) {
+      --limiter_min_count_;
+    }
+    const size_t tail = wrap(limiter_min_head_ + limiter_min_count_);
+    limiter_min_gains_[tail] = required;
+    limiter_min_frames_[tail] = limiter_frames_;
+    ++limiter_min_count_;
+    const float minimum = limiter_min_gains_[limiter_min_head_];
+
+    // Instantaneous attack and smooth release, then averaging over the window
+    limiter_gain_ = std::min(minimum, limiter_alpha_release_ * limiter_gain_ +
+                                          (1.0f - limiter_alpha_release_) * minimum);
+    limiter_gain_sum_ += limiter_gain_ - limiter_gains_[slot];
+    limiter_gains_[slot] = limiter_gain_;
+    const float gain = static_cast<float>(limiter_gain_sum_ / lookahead);
+
+    // Delay line: the frame limited is the oldest one of the window
+    const size_t delayed = wrap(slot + 1);
+    limiter_delay_[2 * slot] = frame[0];
+    limiter_delay_[2 * slot + 1] = frame[1];
+    frame[0] = std::min(std::max(limiter_delay_[2 * delayed] * gain,
+                                 -kFixedPointLimit), kFixedPointLimit);
+    frame[1] = std::min(std::max(limiter_delay_[2 * delayed + 1] * gain,
+                                 -kFixedPointLimit), kFixedPointLimit);
+    slot = delayed;
+  }
+}
+
+}  // namespace le_fx
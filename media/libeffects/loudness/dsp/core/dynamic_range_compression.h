@@ -23,6 +23,9 @@
 #include "dsp/core/basic.h"
 #include "dsp/core/interpolation.h"
 
+#include <stddef.h>
+#include <vector>
+
 #include <android/log.h>
 
 namespace le_fx {
@@ -58,6 +61,26 @@ class AdaptiveDynamicRangeCompression {
   // Stereo channel version of the compressor
   void Compress(float *x1, float *x2);
 
+  // Block version of the stereo compressor, processing `frame_count`
+  // interleaved stereo frames in place. The envelope follows the same
+  // recursion as Compress(float *, float *), but the detector input and the
+  // gains are computed a block at a time with log2_approx() and exp2_approx(),
+  // so that these loops are vectorized. When the look-ahead limiter is enabled,
+  // the output is delayed by latency_frames() frames.
+  void CompressBlock(float *x, size_t frame_count);
+
+  // Enables a look-ahead limiter after the compressor of CompressBlock(.) when
+  // `frame_count` is greater than 1. Instead of clipping at the fixed-point
+  // limit, the gain is reduced smoothly over `frame_count` frames ahead of the
+  // peaks exceeding it. A `frame_count` of 0 or 1 disables the limiter.
+  void set_lookahead_frames(size_t frame_count);
+
+  size_t lookahead_frames() const;
+
+  // Delay of the output of CompressBlock(.): lookahead_frames() - 1 frames when
+  // the limiter is enabled, 0 otherwise.
+  size_t latency_frames() const;
+
   // This version is slower than Compress(.) but faster than CompressSlow(.)
   float CompressNormalSpeed(float x);
 
@@ -91,6 +114,15 @@ class AdaptiveDynamicRangeCompression {
   static const float kTauAttack;
   // The release time of the envelope detector
   static const float kTauRelease;
+  // The release time of the look-ahead limiter
+  static const float kTauLimiterRelease;
+  // Number of frames processed at a time by CompressBlock(.)
+  static const size_t kBlockSize = 64;
+
+  // Limits the compressed interleaved stereo frames in `x` with the
+  // look-ahead limiter, delaying them by latency_frames() frames.
+  void Limit(float *x, size_t frame_count);
+  void ResetLimiter();
 
   float sampling_rate_;
   // the internal state of the envelope detector
@@ -105,6 +137,26 @@ class AdaptiveDynamicRangeCompression {
   // The knee threshold
   float knee_threshold_;
   float knee_threshold_in_decibel_;
+  // release constant of the look-ahead limiter
+  float limiter_alpha_release_;
+  // look-ahead limiter window, 0 when disabled
+  size_t lookahead_;
+  // number of frames limited since the limiter was reset
+  size_t limiter_frames_;
+  // last smoothed limiter gain
+  float limiter_gain_;
+  // sum of the smoothed limiter gains over the window
+  double limiter_gain_sum_;
+  // smoothed limiter gains over the window, circular
+  std::vector<float> limiter_gains_;
+  // compressed frames waiting to be output, circular
+  std::vector<float> limiter_delay_;
+  // ascending minima of the required limiter gains over the window, with the
+  // frame they were required for: a circular queue of at most lookahead_ items
+  std::vector<float> limiter_min_gains_;
+  std::vector<size_t> limiter_min_frames_;
+  size_t limiter_min_head_;
+  size_t limiter_min_count_;
   // This interpolator provides the function that relates target gain to knee
   // threshold.
   sigmod::InterpolatorLinear<float> target_gain_to_knee_threshold_;
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Accuracy harness of the loudness enhancer compressor: checks the error bounds of the
+// approximate log2/exp2 kernels, compares the per sample and block compressors to a double
+// precision reference of the same algorithm, and checks the look-ahead limiter.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "common/core/math.h"
+#include "dsp/core/dynamic_range_compression.h"
+
+namespace {
+
+constexpr float kSamplingRate = 48000.f;
+constexpr float kFixedPointLimit = 32767.f;
+
+// Double precision version of AdaptiveDynamicRangeCompression::Compress(float *, float *),
+// with the constants of dynamic_range_compression.cpp.
+class ReferenceCompressor {
+  public:
+    ReferenceCompressor(double targetGain) {
+        static const double kTargetGain[] = { 1., 2., 3., 4., 5. };
+        static const double kKneeThreshold[] = { -8., -8., -8.5, -9., -10. };
+        double decibel = kKneeThreshold[4];
+        for (int i = 0; i < 4; i++) {
+            if (targetGain <= kTargetGain[i + 1]) {
+                const double t = (targetGain - kTargetGain[i]) /
+                        (kTargetGain[i + 1] - kTargetGain[i]);
+                decibel = kKneeThreshold[i] + std::max(t, 0.) *
+                        (kKneeThreshold[i + 1] - kKneeThreshold[i]);
+                break;
+            }
+        }
+        mKneeThreshold = 0.1151292546497023 * decibel + 10.397177190355384;
+        mAlphaAttack = exp(-1. / (0.001 * kSamplingRate));
+        mAlphaRelease = exp(-1. / (0.015 * kSamplingRate));
+        mSlope = 1. / 7. - 1.;
+    }
+
+    void compress(double *x1, double *x2) {
+        const double maxAbs = std::max(std::max(fabs(*x1), fabs(*x2)), 0.032767);
+        const double cv = std::max(log(maxAbs) - mKneeThreshold, 0.) * mSlope;
+        const double alpha = cv <= mState ? mAlphaAttack : mAlphaRelease;
+        mState = alpha * mState + (1. - alpha) * cv;
+        const double gain = exp(mState);
+        *x1 = std::min(std::max(*x1 * gain, -(double)kFixedPointLimit), (double)kFixedPointLimit);
+        *x2 = std::min(std::max(*x2 * gain, -(double)kFixedPointLimit), (double)kFixedPointLimit);
+    }
+
+  private:
+    double mKneeThreshold;
+    double mAlphaAttack;
+    double mAlphaRelease;
+    double mSlope;
+    double mState = 0.;
+};
+
+// Interleaved stereo test signal in the fixed point range the compressor receives: a
+// sine sweep with 20 dB level steps and bursts of noise, amplified by the target gain.
+std::vector<float> makeSignal(size_t frameCount, float targetGain) {
+    std::vector<float> signal(frameCount * 2);
+    double phase = 0.;
+    for (size_t i = 0; i < frameCount; i++) {
+        const double t = i / (double)kSamplingRate;
+        phase += 2. * M_PI * (50. + 8000. * t / (frameCount / kSamplingRate)) / kSamplingRate;
+        const double level = pow(10., -(double)((i / 4800) % 4));
+        const double noise = (i / 2400) % 7 == 3 ? (rand() / (double)RAND_MAX - 0.5) : 0.;
+        const double s = 32768. * targetGain * level * (0.8 * sin(phase) + noise);
+        signal[2 * i] = (float)s;
+        signal[2 * i + 1] = (float)(0.7 * s);
+    }
+    return signal;
+}
+
+int checkKernels() {
+    int failures = 0;
+    double maxError = 0.;
+    for (float x = 0.032767f; x < 1048576.f; x = nextafterf(x + x * 1e-6f, INFINITY)) {
+        maxError = std::max(maxError, fabs(le_fx::math::log2_approx(x) - log2((double)x)));
+    }
+    printf("log2_approx: max absolute error %.3g (bound 6e-5)\n", maxError);
+    failures += maxError > 6e-5;
+
+    maxError = 0.;
+    for (float x = -126.f; x <= 126.f; x += 1e-5f) {
+        const double reference = exp2((double)x);
+        maxError = std::max(maxError,
+                fabs(le_fx::math::exp2_approx(x) - reference) / reference);
+    }
+    printf("exp2_approx: max relative error %.3g (bound 2e-7)\n", maxError);
+    failures += maxError > 2e-7;
+    return failures;
+}
+
+// Max deviation of the compressor outputs from the reference, in dB relative to full scale.
+int checkCompressor(float targetGain) {
+    constexpr size_t kFrameCount = 48000 * 4;
+    std::vector<float> signal = makeSignal(kFrameCount, targetGain);
+    std::vector<float> legacy = signal;
+    std::vector<float> block = signal;
+
+    ReferenceCompressor reference(targetGain);
+    le_fx::AdaptiveDynamicRangeCompression legacyCompressor;
+    le_fx::AdaptiveDynamicRangeCompression blockCompressor;
+    legacyCompressor.Initialize(targetGain, kSamplingRate);
+    blockCompressor.Initialize(targetGain, kSamplingRate);
+
+    double legacyError = 0.;
+    double blockError = 0.;
+    for (size_t i = 0; i < kFrameCount; i++) {
+        legacyCompressor.Compress(&legacy[2 * i], &legacy[2 * i + 1]);
+    }
+    // odd sized calls to exercise partial blocks
+    for (size_t i = 0; i < kFrameCount; ) {
+        const size_t frameCount = std::min(kFrameCount - i, (size_t)(1 + i % 997));
+        blockCompressor.CompressBlock(&block[2 * i], frameCount);
+        i += frameCount;
+    }
+    for (size_t i = 0; i < kFrameCount * 2; i += 2) {
+        double x1 = signal[i];
+        double x2 = signal[i + 1];
+        reference.compress(&x1, &x2);
+        legacyError = std::max(legacyError,
+                std::max(fabs(legacy[i] - x1), fabs(legacy[i + 1] - x2)));
+        blockError = std::max(blockError,
+                std::max(fabs(block[i] - x1), fabs(block[i + 1] - x2)));
+    }
+    legacyError = 20. * log10(std::max(legacyError, 1e-3) / kFixedPointLimit);
+    blockError = 20. * log10(std::max(blockError, 1e-3) / kFixedPointLimit);
+    printf("target gain %.1f: max error per sample %.1f dBFS, block %.1f dBFS (bound -80)\n",
+           targetGain, legacyError, blockError);
+    return blockError > -80.;
+}
+
+// Below the limit, the limiter only delays the compressor output. Above it, peaks are
+// attenuated down to the limit instead of being clipped: only samples of the peaks
+// themselves may reach it.
+int checkLimiter(float targetGain) {
+    constexpr size_t kFrameCount = 48000 * 4;
+    constexpr size_t kLookahead = 240;
+    int failures = 0;
+    for (float scale : { 0.1f, 4.f }) {
+        std::vector<float> signal = makeSignal(kFrameCount, targetGain * scale);
+        std::vector<float> limited = signal;
+        le_fx::AdaptiveDynamicRangeCompression compressor;
+        le_fx::AdaptiveDynamicRangeCompression limiter;
+        compressor.Initialize(targetGain, kSamplingRate);
+        limiter.Initialize(targetGain, kSamplingRate);
+        limiter.set_lookahead_frames(kLookahead);
+        compressor.CompressBlock(signal.data(), kFrameCount);
+        limiter.CompressBlock(limited.data(), kFrameCount);
+
+        size_t clipped = 0;
+        size_t limitedClipped = 0;
+        double delayError = 0.;
+        for (size_t i = 0; i < kFrameCount * 2; i++) {
+            clipped += fabsf(signal[i]) >= kFixedPointLimit;
+            limitedClipped += fabsf(limited[i]) >= kFixedPointLimit;
+        }
+        const size_t latency = limiter.latency_frames();
+        for (size_t i = 0; i < (kFrameCount - latency) * 2; i++) {
+            delayError = std::max(delayError,
+                    (double)fabsf(limited[i + latency * 2] - signal[i]));
+        }
+        printf("limiter, input %.1f x: %zu samples clipped by the compressor, %zu after the "
+               "limiter, max difference to delayed compressor output %.3g\n",
+               scale, clipped, limitedClipped, delayError);
+        failures += latency != kLookahead - 1;
+        if (clipped == 0) {
+            failures += delayError > 0.;
+        } else {
+            failures += limitedClipped > clipped / 100;
+        }
+    }
+    return failures;
+}
+
+}  // namespace
+
+int main() {
+    int failures = checkKernels();
+    for (float targetGain : { 1.f, 2.f, 3.5f, 5.f }) {
+        failures += checkCompressor(targetGain);
+    }
+    failures += checkLimiter(2.f);
+    printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
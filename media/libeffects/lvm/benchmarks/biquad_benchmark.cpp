@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the Bundle equaliser band filters run one band at a time with the
+// scalar peaking filter, as LVEQNB_Process used to, against the transposed
+// direct form II cascade that it runs now.
+//
+// Run with:
+//   lvm_biquad_benchmark --benchmark_filter=BM_Eq
+// The argument is the channel count. "snr_dB" is the signal to noise ratio of the
+// output for a 48 kHz sine sweep against the same filters run in double precision.
+// The cascade benchmark fails if it is more than kSnrToleranceDb below the scalar
+// filters, or below the 90.3 dB threshold that the lvmtest script uses.
+
+#include <math.h>
+#include <type_traits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "BIQUAD.h"
+#include "LVEQNB_Private.h"
+#include "VectorArithmetic.h"
+
+static constexpr int kFrameCount = 256;     // LVM_MAX_BLOCK_SIZE of the bundle wrapper
+static constexpr int kSweepFrameCount = 188 * kFrameCount;  // about one second
+static constexpr double kSnrThresholdDb = 90.308998;
+static constexpr double kSnrToleranceDb = 1.0;
+
+// The default bands of the bundle wrapper, with a gain on each
+static const LVEQNB_BandDef_t kBands[] = {
+    {6, 60, 96}, {-3, 230, 96}, {4, 910, 96}, {-5, 3600, 96}, {3, 14000, 96},
+};
+static constexpr int kBandCount = sizeof(kBands) / sizeof(kBands[0]);
+
+static std::vector<PK_FLOAT_Coefs_t> bandCoefs() {
+    std::vector<PK_FLOAT_Coefs_t> coefs(kBandCount);
+    for (int i = 0; i < kBandCount; i++) {
+        LVEQNB_BandDef_t band = kBands[i];
+        LVEQNB_SinglePrecCoefs(LVM_FS_48000, &band, &coefs[i]);
+    }
+    return coefs;
+}
+
+// Interleaved sine sweep from 20 Hz to 20 kHz, at -6 dBFS, with a phase offset per channel
+static std::vector<float> makeSweep(int channelCount, int frameCount) {
+    std::vector<float> sweep(channelCount * frameCount);
+    const double k = log(20000.0 / 20.0) / frameCount;
+    for (int i = 0; i < frameCount; i++) {
+        const double phase = 2 * M_PI * 20.0 * (exp(k * i) - 1) / k / 48000;
+        for (int c = 0; c < channelCount; c++) {
+            sweep[i * channelCount + c] = 0.5f * sin(phase + c);
+        }
+    }
+    return sweep;
+}
+
+class ScalarEq {
+  public:
+    explicit ScalarEq(const std::vector<PK_FLOAT_Coefs_t>& coefs)
+        : mInstances(coefs.size()), mTaps(coefs.size()) {
+        for (size_t i = 0; i < coefs.size(); i++) {
+            PK_FLOAT_Coefs_t c = coefs[i];
+            PK_2I_D32F32CssGss_TRC_WRA_01_Init(&mInstances[i], &mTaps[i], &c);
+            LoadConst_Float(0, (LVM_FLOAT *)&mTaps[i], sizeof(mTaps[i]) / sizeof(LVM_FLOAT));
+        }
+    }
+    void process(const float *in, float *out, int frameCount, int channelCount) {
+        for (auto& instance : mInstances) {
+            PK_Mc_D32F32C14G11_TRC_WRA_01(&instance, (LVM_FLOAT *)in, out, frameCount,
+                    channelCount);
+            in = out;
+        }
+    }
+  private:
+    std::vector<Biquad_FLOAT_Instance_t> mInstances;
+    std::vector<Biquad_2I_Order2_FLOAT_Taps_t> mTaps;
+};
+
+class CascadeEq {
+  public:
+    explicit CascadeEq(const std::vector<PK_FLOAT_Coefs_t>& coefs) : mStages(coefs.size()) {
+        for (size_t i = 0; i < coefs.size(); i++) {
+            PK_FLOAT_Coefs_t c = coefs[i];
+            PK_Cascade_Mc_D32F32_Init(&mStages[i], &c);
+            LoadConst_Float(0, (LVM_FLOAT *)mStages[i].State,
+                    sizeof(mStages[i].State) / sizeof(LVM_FLOAT));
+        }
+    }
+    void process(const float *in, float *out, int frameCount, int channelCount) {
+        BQ_Cascade_Mc_D32F32_TDF2(mStages.data(), mStages.size(), in, out, frameCount,
+                channelCount);
+    }
+  private:
+    std::vector<BQ_Cascade_FLOAT_Stage_t> mStages;
+};
+
+template <typename Eq>
+static std::vector<float> filterSweep(int channelCount) {
+    std::vector<float> buffer = makeSweep(channelCount, kSweepFrameCount);
+    Eq eq(bandCoefs());
+    for (int i = 0; i < kSweepFrameCount; i += kFrameCount) {
+        float *block = &buffer[i * channelCount];
+        eq.process(block, block, kFrameCount, channelCount);
+    }
+    return buffer;
+}
+
+// The peaking filters of PK_Mc_D32F32C14G11_TRC_WRA_01 in double precision:
+//   y(n) = x(n) + G * bp(n), with bp(n) = A0 * (x(n) - x(n-2)) + B1 * bp(n-1) + B2 * bp(n-2)
+static std::vector<double> referenceSweep(int channelCount) {
+    const std::vector<float> sweep = makeSweep(channelCount, kSweepFrameCount);
+    std::vector<double> buffer(sweep.begin(), sweep.end());
+    for (const PK_FLOAT_Coefs_t& c : bandCoefs()) {
+        for (int ch = 0; ch < channelCount; ch++) {
+            double x1 = 0, x2 = 0, bp1 = 0, bp2 = 0;
+            for (int i = 0; i < kSweepFrameCount; i++) {
+                double& x = buffer[i * channelCount + ch];
+                const double bp = c.A0 * (x - x2) + c.B1 * bp1 + c.B2 * bp2;
+                x2 = x1;
+                x1 = x;
+                bp2 = bp1;
+                bp1 = bp;
+                x += c.G * bp;
+            }
+        }
+    }
+    return buffer;
+}
+
+static double snrDb(const std::vector<double>& reference, const std::vector<float>& test) {
+    double signal = 0;
+    double noise = 0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        const double diff = test[i] - reference[i];
+        signal += reference[i] * reference[i];
+        noise += diff * diff;
+    }
+    return noise == 0 ? INFINITY : 10 * log10(signal / noise);
+}
+
+template <typename Eq>
+static void BM_Eq(benchmark::State& state) {
+    const int channelCount = state.range(0);
+    const std::vector<float> input = makeSweep(channelCount, kFrameCount);
+    std::vector<float> output(input.size());
+    Eq eq(bandCoefs());
+
+    for (auto _ : state) {
+        eq.process(input.data(), output.data(), kFrameCount, channelCount);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kFrameCount);
+
+    const std::vector<double> reference = referenceSweep(channelCount);
+    const double snr = snrDb(reference, filterSweep<Eq>(channelCount));
+    state.counters["snr_dB"] = snr;
+    if (std::is_same<Eq, CascadeEq>::value) {
+        const double scalarSnr = snrDb(reference, filterSweep<ScalarEq>(channelCount));
+        if (snr < kSnrThresholdDb || snr < scalarSnr - kSnrToleranceDb) {
+            state.SkipWithError("cascade output is less accurate than the scalar filters");
+        }
+    }
+}
+
+static void ChannelCounts(benchmark::internal::Benchmark *b) {
+    for (int channelCount : {2, 4, 6, 8}) {
+        b->Arg(channelCount);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_Eq, ScalarEq)->Apply(ChannelCounts);
+BENCHMARK_TEMPLATE(BM_Eq, CascadeEq)->Apply(ChannelCounts);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the LVREV feedback delay network with the partitioned convolution engine
+// of EffectReverb, for the presets of the preset reverb at 48 kHz, in blocks of the
+// size the wrapper uses.
+//
+// Run with:
+//   lvm_reverb_benchmark --benchmark_filter=BM_Reverb
+// The arguments are the preset, the input channel count (1 for auxiliary, 2 for
+// insert) and, for the convolution, the output channel count. Besides the block time
+// counters, "latency_frames" is the delay added by the engine and "level_dB" the output
+// level for white noise at unit reverb level.
+// BM_ConvolutionUpdate switches presets every kUpdatePeriod blocks, to show the cost
+// of the blocks that transform the new impulse response.
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <effect_benchmark/BlockTimes.h>
+
+#include "ConvolutionReverb.h"
+#include "LVREV.h"
+
+using android::ConvolutionReverb;
+
+static constexpr uint32_t kSampleRate = 48000;
+static constexpr size_t kFrameCount = 256;      // MAX_CALL_SIZE of the reverb wrapper
+static constexpr size_t kUpdatePeriod = 100;
+static constexpr int kMaxReverbLevel = 2000;
+
+struct Preset {
+    const char *name;
+    int16_t roomHfLevel;
+    uint32_t decayTime;
+    int16_t decayHfRatio;
+    int16_t diffusion;
+    int16_t density;
+};
+
+// sReverbPresets of EffectReverb
+static const Preset kPresets[] = {
+    {"SMALLROOM", -600, 1100, 830, 1000, 1000},
+    {"MEDIUMROOM", -600, 1300, 830, 1000, 1000},
+    {"LARGEROOM", -600, 1500, 830, 1000, 1000},
+    {"MEDIUMHALL", -600, 1800, 700, 1000, 1000},
+    {"LARGEHALL", -600, 1800, 700, 1000, 1000},
+    {"PLATE", -200, 1300, 900, 1000, 750},
+};
+static constexpr int kPresetCount = sizeof(kPresets) / sizeof(kPresets[0]);
+
+static ConvolutionReverb::Parameters convolutionParameters(const Preset& preset) {
+    ConvolutionReverb::Parameters parameters;
+    parameters.roomLevel = 0;
+    parameters.reverbLevel = kMaxReverbLevel;
+    parameters.roomHfLevel = preset.roomHfLevel;
+    parameters.decayTime = preset.decayTime;
+    parameters.decayHfRatio = preset.decayHfRatio;
+    parameters.diffusion = preset.diffusion;
+    parameters.density = preset.density;
+    return parameters;
+}
+
+// LVREV as set up by EffectReverb, at full level and without the room HF filter
+class Lvrev {
+  public:
+    Lvrev(uint32_t inChannelCount, const Preset& preset) {
+        LVREV_InstanceParams_st instanceParams;
+        instanceParams.MaxBlockSize = kFrameCount;
+        instanceParams.SourceFormat = LVM_STEREO;
+        instanceParams.NumDelays = LVREV_DELAYLINES_4;
+        LVREV_GetMemoryTable(LVM_NULL, &mMemoryTable, &instanceParams);
+        for (auto& region : mMemoryTable.Region) {
+            region.pBaseAddress = region.Size != 0 ? malloc(region.Size) : nullptr;
+        }
+        LVREV_GetInstanceHandle(&mHandle, &mMemoryTable, &instanceParams);
+
+        LVREV_ControlParams_st params;
+        params.OperatingMode = LVM_MODE_ON;
+        params.SampleRate = LVM_FS_48000;
+        params.SourceFormat = inChannelCount == 1 ? LVM_MONO : LVM_STEREO;
+        params.Level = 100;
+        params.LPF = 23999;
+        params.HPF = 50;
+        params.T60 = preset.decayTime;
+        params.Density = preset.diffusion / 10;
+        params.Damping = preset.decayHfRatio / 20;
+        params.RoomSize = preset.density * 99 / 1000 + 1;
+        LVREV_SetControlParameters(mHandle, &params);
+    }
+    ~Lvrev() {
+        for (auto& region : mMemoryTable.Region) {
+            free(region.pBaseAddress);
+        }
+    }
+    void process(const float *in, float *out, size_t frameCount) {
+        LVREV_Process(mHandle, in, out, frameCount);
+    }
+    size_t getLatency() const { return 0; }
+
+  private:
+    LVREV_MemoryTable_st mMemoryTable;
+    LVREV_Handle_t mHandle = LVM_NULL;
+};
+
+static std::vector<float> makeNoise(size_t sampleCount) {
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    std::vector<float> noise(sampleCount);
+    for (auto& sample : noise) {
+        sample = distribution(generator);
+    }
+    return noise;
+}
+
+// Output over input level, after the reverb has built up
+template <typename Engine>
+static double levelDb(Engine *engine, uint32_t inChannelCount, uint32_t outChannelCount) {
+    const size_t blockCount = 4 * kSampleRate / kFrameCount;
+    const std::vector<float> input = makeNoise(kFrameCount * inChannelCount);
+    std::vector<float> output(kFrameCount * outChannelCount);
+    double inputEnergy = 0;
+    double outputEnergy = 0;
+    for (size_t i = 0; i < blockCount; i++) {
+        engine->process(input.data(), output.data(), kFrameCount);
+        if (i < blockCount / 2) continue;
+        for (size_t j = 0; j < kFrameCount; j++) {
+            float mono = 0;
+            for (uint32_t c = 0; c < inChannelCount; c++) {
+                mono += input[j * inChannelCount + c] / inChannelCount;
+            }
+            inputEnergy += mono * mono;
+            outputEnergy += output[j * outChannelCount] * output[j * outChannelCount];
+        }
+    }
+    return 10 * log10(outputEnergy / inputEnergy);
+}
+
+template <typename Engine>
+static void runBlocks(benchmark::State& state, Engine *engine, uint32_t inChannelCount,
+        uint32_t outChannelCount, const std::function<void(size_t)>& beforeBlock) {
+    const std::vector<float> input = makeNoise(kFrameCount * inChannelCount);
+    std::vector<float> output(kFrameCount * outChannelCount);
+    android::effect_benchmark::BlockTimes blockTimes(kFrameCount * 1e6 / kSampleRate);
+    size_t block = 0;
+
+    for (auto _ : state) {
+        beforeBlock(block++);
+        blockTimes.time([&]() {
+            engine->process(input.data(), output.data(), kFrameCount);
+            benchmark::DoNotOptimize(output.data());
+        });
+    }
+
+    blockTimes.setCounters(state);
+    state.counters["latency_frames"] = engine->getLatency();
+}
+
+static void BM_ReverbLvrev(benchmark::State& state) {
+    const Preset& preset = kPresets[state.range(0)];
+    const uint32_t inChannelCount = state.range(1);
+    state.SetLabel(preset.name);
+
+    Lvrev engine(inChannelCount, preset);
+    runBlocks(state, &engine, inChannelCount, 2, [](size_t) {});
+    Lvrev levelEngine(inChannelCount, preset);
+    state.counters["level_dB"] = levelDb(&levelEngine, inChannelCount, 2);
+}
+
+static void BM_ReverbConvolution(benchmark::State& state) {
+    const Preset& preset = kPresets[state.range(0)];
+    const uint32_t inChannelCount = state.range(1);
+    const uint32_t outChannelCount = state.range(2);
+    state.SetLabel(preset.name);
+
+    ConvolutionReverb engine(kSampleRate, inChannelCount, outChannelCount);
+    engine.setParameters(convolutionParameters(preset));
+    // Let the impulse response update complete
+    std::vector<float> silence(kFrameCount * std::max(inChannelCount, outChannelCount));
+    while (engine.isUpdating()) {
+        engine.process(silence.data(), silence.data(), kFrameCount);
+    }
+    state.counters["partitions"] = engine.getPartitionCount();
+    runBlocks(state, &engine, inChannelCount, outChannelCount, [](size_t) {});
+
+    ConvolutionReverb levelEngine(kSampleRate, inChannelCount, outChannelCount);
+    levelEngine.setParameters(convolutionParameters(preset));
+    state.counters["level_dB"] = levelDb(&levelEngine, inChannelCount, outChannelCount);
+}
+
+static void BM_ConvolutionUpdate(benchmark::State& state) {
+    ConvolutionReverb engine(kSampleRate, 1, 2);
+    runBlocks(state, &engine, 1, 2, [&engine](size_t block) {
+        if (block % kUpdatePeriod == 0) {
+            engine.setParameters(convolutionParameters(
+                    kPresets[(block / kUpdatePeriod) % kPresetCount]));
+        }
+    });
+}
+
+static void Presets(benchmark::internal::Benchmark *b) {
+    for (int preset = 0; preset < kPresetCount; preset++) {
+        for (int inChannelCount : {1, 2}) {
+            b->Args({preset, inChannelCount});
+        }
+    }
+}
+
+static void PresetsAndOutputs(benchmark::internal::Benchmark *b) {
+    for (int preset = 0; preset < kPresetCount; preset++) {
+        for (int inChannelCount : {1, 2}) {
+            b->Args({preset, inChannelCount, 2});
+        }
+    }
+    // Multichannel output costs one multiply-accumulate and inverse FFT per channel
+    b->Args({kPresetCount - 1, 2, 6});
+    b->Args({kPresetCount - 1, 2, 8});
+}
+
+BENCHMARK(BM_ReverbLvrev)->Apply(Presets);
+BENCHMARK(BM_ReverbConvolution)->Apply(PresetsAndOutputs);
+BENCHMARK(BM_ConvolutionUpdate);
+
+BENCHMARK_MAIN();
@@ -115,11 +115,10 @@ void    LVDBE_SetFilters(LVDBE_Instance_t     *pInstance,
      * Setup the high pass filter
      */
     LoadConst_Float(0,                                          /* Clear the history, value 0 */
-                   (LVM_FLOAT *)&pInstance->pData->HPFTaps,     /* Destination */
-                    sizeof(pInstance->pData->HPFTaps) / sizeof(LVM_FLOAT)); /* Number of words */
-    BQ_2I_D32F32Cll_TRC_WRA_01_Init(&pInstance->pCoef->HPFInstance,    /* Initialise the filter */
-                                    &pInstance->pData->HPFTaps,
-                                    (BQ_FLOAT_Coefs_t *)&LVDBE_HPF_Table[Offset]);
+                   (LVM_FLOAT *)pInstance->pData->HPFStage.State, /* Destination */
+                    sizeof(pInstance->pData->HPFStage.State) / sizeof(LVM_FLOAT)); /* Number of words */
+    BQ_Cascade_Mc_D32F32_Init(&pInstance->pData->HPFStage,      /* Initialise the filter */
+                              (BQ_FLOAT_Coefs_t *)&LVDBE_HPF_Table[Offset]);
 
     /*
      * Setup the band pass filter
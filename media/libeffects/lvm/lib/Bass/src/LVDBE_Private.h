@@ -82,7 +82,7 @@ typedef struct
     AGC_MIX_VOL_2St1Mon_FLOAT_t   AGCInstance;        /* AGC instance parameters */
 
     /* Process variables */
-    Biquad_2I_Order2_FLOAT_Taps_t     HPFTaps;            /* High pass filter taps */
+    BQ_Cascade_FLOAT_Stage_t          HPFStage;           /* High pass filter coefs and taps */
     Biquad_1I_Order2_FLOAT_Taps_t     BPFTaps;            /* Band pass filter taps */
     LVMixer3_1St_FLOAT_st             BypassVolume;       /* Bypass volume scaler */
     LVMixer3_2St_FLOAT_st             BypassMixer;        /* Bypass Mixer for Click Removal */
@@ -93,7 +93,6 @@ typedef struct
 typedef struct
 {
     /* Process variables */
-    Biquad_FLOAT_Instance_t           HPFInstance;        /* High pass filter instance */
     Biquad_FLOAT_Instance_t           BPFInstance;        /* Band pass filter instance */
 } LVDBE_Coef_FLOAT_t;
 /* Instance structure */
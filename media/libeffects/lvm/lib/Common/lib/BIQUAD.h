@@ -117,6 +117,21 @@ typedef struct
     LVM_FLOAT Storage[ (2 * 4) ];  /* Two channels, four taps of size LVM_FLOAT */
 #endif
 } Biquad_2I_Order2_FLOAT_Taps_t;
+
+/*** Types used for biquad cascades ***********************************************/
+/*
+ * One stage of a biquad cascade in transposed direct form II. The coefficients follow
+ * the BQ_FLOAT_Coefs_t convention, plus a direct path gain added to the output so that
+ * peaking filters keep their x + G * bandpass(x) form. The stage keeps its two state
+ * values for every channel, so that the channels of a frame are filtered side by side.
+ */
+typedef struct
+{
+    BQ_FLOAT_Coefs_t Coefs;                         /* Stage coefficients */
+    LVM_FLOAT Direct;                               /* Direct path gain */
+    LVM_FLOAT State[2][LVM_MAX_CHANNELS];           /* s1 and s2 for each channel */
+    LVM_INT16 Bypass;                               /* LVM_TRUE to skip the stage */
+} BQ_Cascade_FLOAT_Stage_t;
 /* The names of the functions are changed to satisfy QAC rules: Name should be Unique withing 16 characters*/
 #define BQ_2I_D32F32Cll_TRC_WRA_01_Init  Init_BQ_2I_D32F32Cll_TRC_WRA_01
 #define BP_1I_D32F32C30_TRC_WRA_02       TWO_BP_1I_D32F32C30_TRC_WRA_02
@@ -274,6 +289,25 @@ void PK_Mc_D32F32C14G11_TRC_WRA_01(Biquad_FLOAT_Instance_t       *pInstance,
                                    LVM_INT16               NrChannels);
 #endif
 
+/**********************************************************************************
+   FUNCTION PROTOTYPES: BIQUAD CASCADES
+***********************************************************************************/
+
+/*** 32 bit data path MULTICHANNEL ************************************************/
+/* The Init functions set the stage coefficients and clear Bypass; the state is kept */
+void BQ_Cascade_Mc_D32F32_Init(     BQ_Cascade_FLOAT_Stage_t      *pStage,
+                                    BQ_FLOAT_Coefs_t              *pCoef);
+void PK_Cascade_Mc_D32F32_Init(     BQ_Cascade_FLOAT_Stage_t      *pStage,
+                                    PK_FLOAT_Coefs_t              *pCoef);
+void FO_Cascade_Mc_D32F32_Init(     BQ_Cascade_FLOAT_Stage_t      *pStage,
+                                    FO_FLOAT_Coefs_t              *pCoef);
+void BQ_Cascade_Mc_D32F32_TDF2(     BQ_Cascade_FLOAT_Stage_t      *pStages,
+                                    LVM_INT16                     NrStages,
+                                    const LVM_FLOAT               *pDataIn,
+                                    LVM_FLOAT                     *pDataOut,
+                                    LVM_INT16                     NrFrames,
+                                    LVM_INT16                     NrChannels);
+
 /**********************************************************************************
    FUNCTION PROTOTYPES: DC REMOVAL FILTERS
 ***********************************************************************************/
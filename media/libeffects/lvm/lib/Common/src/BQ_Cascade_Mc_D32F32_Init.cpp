@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BIQUAD.h"
+
+/**************************************************************************
+ ASSUMPTIONS:
+ COEFS-
+ pStage->Coefs.A0 to A2 are the feed forward coefficients,
+ pStage->Coefs.B1 and B2 are the feed back coefficients with inverted sign,
+ as in BQ_FLOAT_Coefs_t, and pStage->Direct is the gain of x(n) added
+ to the output:
+   yb(n) = A0 * x(n) + A1 * x(n-1) + A2 * x(n-2) + B1 * yb(n-1) + B2 * yb(n-2)
+   y(n)  = Direct * x(n) + yb(n)
+***************************************************************************/
+void BQ_Cascade_Mc_D32F32_Init(BQ_Cascade_FLOAT_Stage_t      *pStage,
+                               BQ_FLOAT_Coefs_t              *pCoef)
+{
+    pStage->Coefs  = *pCoef;
+    pStage->Direct = 0;
+    pStage->Bypass = LVM_FALSE;
+}
+
+/**************************************************************************
+ The peaking filter of PK_2I_D32F32C14G11_TRC_WRA_01 adds a gain times band
+ pass to its input:
+   y(n) = x(n) + G * (A0 * (x(n) - x(n-2)) + B1 * yb(n-1) + B2 * yb(n-2))
+ The gain is folded into the band pass numerator. Folding the direct path
+ in as well would give a numerator close to the denominator, which loses
+ precision at low centre frequencies.
+***************************************************************************/
+void PK_Cascade_Mc_D32F32_Init(BQ_Cascade_FLOAT_Stage_t      *pStage,
+                               PK_FLOAT_Coefs_t              *pCoef)
+{
+    pStage->Coefs.A0 = pCoef->G * pCoef->A0;
+    pStage->Coefs.A1 = 0;
+    pStage->Coefs.A2 = -pCoef->G * pCoef->A0;
+    pStage->Coefs.B1 = pCoef->B1;
+    pStage->Coefs.B2 = pCoef->B2;
+    pStage->Direct   = 1.0f;
+    pStage->Bypass   = LVM_FALSE;
+}
+
+/**************************************************************************
+ First order filter as a biquad with A2 = B2 = 0
+***************************************************************************/
+void FO_Cascade_Mc_D32F32_Init(BQ_Cascade_FLOAT_Stage_t      *pStage,
+                               FO_FLOAT_Coefs_t              *pCoef)
+{
+    pStage->Coefs.A0 = pCoef->A0;
+    pStage->Coefs.A1 = pCoef->A1;
+    pStage->Coefs.A2 = 0;
+    pStage->Coefs.B1 = pCoef->B1;
+    pStage->Coefs.B2 = 0;
+    pStage->Direct   = 0;
+    pStage->Bypass   = LVM_FALSE;
+}
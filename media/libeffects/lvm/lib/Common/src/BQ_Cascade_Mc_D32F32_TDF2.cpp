@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BIQUAD.h"
+#include "VectorArithmetic.h"
+
+/**************************************************************************
+ NrFused consecutive stages in transposed direct form II, for every channel
+ of a frame:
+   yb(n) = A0 * x(n) + s1(n-1)
+   s1(n) = A1 * x(n) + B1 * yb(n) + s2(n-1)
+   s2(n) = A2 * x(n) + B2 * yb(n)
+   y(n)  = Direct * x(n) + yb(n)
+ with the output of each stage the input of the next one.
+
+ The channel count is a compile time constant, so the loop over the
+ channels of a frame becomes a fixed width SIMD operation. The state of the
+ stages stays in registers for the whole buffer, and running several stages
+ per frame lets their recursions overlap instead of waiting on each other.
+***************************************************************************/
+template <int NrChannels, int NrFused>
+static void BQ_Cascade_Stages(BQ_Cascade_FLOAT_Stage_t      **ppStages,
+                              const LVM_FLOAT               *pDataIn,
+                              LVM_FLOAT                     *pDataOut,
+                              LVM_INT16                     NrFrames)
+{
+    LVM_FLOAT A0[NrFused], A1[NrFused], A2[NrFused], B1[NrFused], B2[NrFused];
+    LVM_FLOAT Direct[NrFused];
+    LVM_FLOAT s1[NrFused][NrChannels];
+    LVM_FLOAT s2[NrFused][NrChannels];
+
+    for (int kk = 0; kk < NrFused; kk++)
+    {
+        A0[kk] = ppStages[kk]->Coefs.A0;
+        A1[kk] = ppStages[kk]->Coefs.A1;
+        A2[kk] = ppStages[kk]->Coefs.A2;
+        B1[kk] = ppStages[kk]->Coefs.B1;
+        B2[kk] = ppStages[kk]->Coefs.B2;
+        Direct[kk] = ppStages[kk]->Direct;
+        for (int jj = 0; jj < NrChannels; jj++)
+        {
+            s1[kk][jj] = ppStages[kk]->State[0][jj];
+            s2[kk][jj] = ppStages[kk]->State[1][jj];
+        }
+    }
+
+    for (LVM_INT16 ii = NrFrames; ii != 0; ii--)
+    {
+        for (int jj = 0; jj < NrChannels; jj++)
+        {
+            LVM_FLOAT xn = pDataIn[jj];
+            for (int kk = 0; kk < NrFused; kk++)
+            {
+                const LVM_FLOAT ybn = A0[kk] * xn + s1[kk][jj];
+                s1[kk][jj] = A1[kk] * xn + B1[kk] * ybn + s2[kk][jj];
+                s2[kk][jj] = A2[kk] * xn + B2[kk] * ybn;
+                xn = Direct[kk] * xn + ybn;
+            }
+            pDataOut[jj] = xn;
+        }
+        pDataIn += NrChannels;
+        pDataOut += NrChannels;
+    }
+
+    for (int kk = 0; kk < NrFused; kk++)
+    {
+        for (int jj = 0; jj < NrChannels; jj++)
+        {
+            ppStages[kk]->State[0][jj] = s1[kk][jj];
+            ppStages[kk]->State[1][jj] = s2[kk][jj];
+        }
+    }
+}
+
+/* Stages run together in one pass over the buffer */
+#define BQ_CASCADE_MAX_FUSED    2
+/* Above this channel count the state of fused stages no longer fits in registers */
+#define BQ_CASCADE_MAX_FUSED_CHANNELS   4
+
+template <int NrChannels>
+static void BQ_Cascade_Pass(BQ_Cascade_FLOAT_Stage_t      **ppStages,
+                            LVM_INT16                     NrFused,
+                            const LVM_FLOAT               *pDataIn,
+                            LVM_FLOAT                     *pDataOut,
+                            LVM_INT16                     NrFrames)
+{
+    if (NrFused == 2 && NrChannels <= BQ_CASCADE_MAX_FUSED_CHANNELS)
+    {
+        BQ_Cascade_Stages<NrChannels, 2>(ppStages, pDataIn, pDataOut, NrFrames);
+        return;
+    }
+    for (LVM_INT16 kk = 0; kk < NrFused; kk++)
+    {
+        BQ_Cascade_Stages<NrChannels, 1>(&ppStages[kk], pDataIn, pDataOut, NrFrames);
+        pDataIn = pDataOut;
+    }
+}
+
+/**************************************************************************
+ Runs the stages that are not bypassed in order, the first pass from pDataIn
+ to pDataOut and the others in place. pDataIn and pDataOut may be the same
+ buffer. Each channel is computed the same way whatever the channel count,
+ so the first channels of a multichannel stream match the stereo result.
+***************************************************************************/
+void BQ_Cascade_Mc_D32F32_TDF2(BQ_Cascade_FLOAT_Stage_t      *pStages,
+                               LVM_INT16                     NrStages,
+                               const LVM_FLOAT               *pDataIn,
+                               LVM_FLOAT                     *pDataOut,
+                               LVM_INT16                     NrFrames,
+                               LVM_INT16                     NrChannels)
+{
+    const LVM_FLOAT *pSrc = pDataIn;
+    LVM_INT16 ii = 0;
+
+    while (ii < NrStages)
+    {
+        BQ_Cascade_FLOAT_Stage_t *pPass[BQ_CASCADE_MAX_FUSED];
+        LVM_INT16 NrFused = 0;
+        for (; ii < NrStages && NrFused < BQ_CASCADE_MAX_FUSED; ii++)
+        {
+            if (pStages[ii].Bypass == LVM_FALSE)
+            {
+                pPass[NrFused++] = &pStages[ii];
+            }
+        }
+        if (NrFused == 0)
+        {
+            break;
+        }
+        switch (NrChannels)
+        {
+            case 1: BQ_Cascade_Pass<1>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 2: BQ_Cascade_Pass<2>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+#ifdef SUPPORT_MC
+            case 3: BQ_Cascade_Pass<3>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 4: BQ_Cascade_Pass<4>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 5: BQ_Cascade_Pass<5>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 6: BQ_Cascade_Pass<6>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 7: BQ_Cascade_Pass<7>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+            case 8: BQ_Cascade_Pass<8>(pPass, NrFused, pSrc, pDataOut, NrFrames); break;
+#endif
+            default: return;
+        }
+        pSrc = pDataOut;
+    }
+
+    if (pSrc != pDataOut)
+    {
+        /* All stages bypassed */
+        Copy_Float(pSrc, pDataOut, (LVM_INT16)(NrFrames * NrChannels));
+    }
+}
@@ -178,7 +178,7 @@ void    LVEQNB_SetFilters(LVEQNB_Instance_t     *pInstance,
 /*                                                                                  */
 /* DESCRIPTION:                                                                     */
 /*  Sets the filter coefficients. This uses the type to select single or double     */
-/*  precision coefficients.                                                         */
+/*  precision coefficients. Bands with 0dB gain or out of range are bypassed.       */
 /*                                                                                  */
 /* PARAMETERS:                                                                      */
 /*  pInstance           Pointer to the instance                                     */
@@ -202,6 +202,20 @@ void    LVEQNB_SetCoefficients(LVEQNB_Instance_t     *pInstance)
          * Check band type for correct initialisation method and recalculate the coefficients
          */
         BiquadType = pInstance->pBiquadType[i];
+        if (pInstance->pBandDefinitions[i].Gain == 0)
+        {
+            pInstance->pEQNB_Stages[i].Bypass = LVM_TRUE;
+            continue;
+        }
+        if (pInstance->pEQNB_Stages[i].Bypass == LVM_TRUE)
+        {
+            /* The history of a bypassed band is stale, restart it from silence */
+            LoadConst_Float(0,
+                            (LVM_FLOAT *)pInstance->pEQNB_Stages[i].State,
+                            (LVM_INT16)(sizeof(pInstance->pEQNB_Stages[i].State) /
+                                        sizeof(LVM_FLOAT)));
+        }
+        pInstance->pEQNB_Stages[i].Bypass = LVM_TRUE;
         switch  (BiquadType)
         {
             case    LVEQNB_SinglePrecision_Float:
@@ -214,11 +228,10 @@ void    LVEQNB_SetCoefficients(LVEQNB_Instance_t     *pInstance)
                                        &pInstance->pBandDefinitions[i],
                                        &Coefficients);
                 /*
-                 * Set the coefficients
+                 * Set the coefficients, as a single biquad stage of the band cascade
                  */
-                PK_2I_D32F32CssGss_TRC_WRA_01_Init(&pInstance->pEQNB_FilterState_Float[i],
-                                                   &pInstance->pEQNB_Taps_Float[i],
-                                                   &Coefficients);
+                PK_Cascade_Mc_D32F32_Init(&pInstance->pEQNB_Stages[i],
+                                          &Coefficients);
                 break;
             }
             default:
@@ -241,18 +254,14 @@ void    LVEQNB_SetCoefficients(LVEQNB_Instance_t     *pInstance)
 /************************************************************************************/
 void    LVEQNB_ClearFilterHistory(LVEQNB_Instance_t     *pInstance)
 {
-    LVM_FLOAT       *pTapAddress;
-    LVM_INT16       NumTaps;
-
-    pTapAddress = (LVM_FLOAT *)pInstance->pEQNB_Taps_Float;
-    NumTaps     = (LVM_INT16)((pInstance->Capabilities.MaxBands * \
-                                    sizeof(Biquad_2I_Order2_FLOAT_Taps_t)) / sizeof(LVM_FLOAT));
+    LVM_UINT16      i;                                  /* Filter band index */
 
-    if (NumTaps != 0)
+    for (i = 0; i < pInstance->Capabilities.MaxBands; i++)
     {
         LoadConst_Float(0,                                 /* Clear the history, value 0 */
-                        pTapAddress,                       /* Destination */
-                        NumTaps);                          /* Number of words */
+                        (LVM_FLOAT *)pInstance->pEQNB_Stages[i].State, /* Destination */
+                        (LVM_INT16)(sizeof(pInstance->pEQNB_Stages[i].State) /
+                                    sizeof(LVM_FLOAT)));   /* Number of words */
     }
 }
 /****************************************************************************************/
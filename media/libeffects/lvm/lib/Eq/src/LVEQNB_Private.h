@@ -84,8 +84,7 @@ typedef struct
     /* Aligned memory pointers */
     LVM_FLOAT                      *pFastTemporary;        /* Fast temporary data base address */
 
-    Biquad_2I_Order2_FLOAT_Taps_t   *pEQNB_Taps_Float;        /* Equaliser Taps */
-    Biquad_FLOAT_Instance_t         *pEQNB_FilterState_Float; /* State for each filter band */
+    BQ_Cascade_FLOAT_Stage_t        *pEQNB_Stages;      /* Cascade stage for each filter band */
 
     /* Filter definitions and call back */
     LVM_UINT16                      NBands;             /* Number of bands */
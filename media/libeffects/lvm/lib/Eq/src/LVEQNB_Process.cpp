@@ -106,49 +106,14 @@ LVEQNB_ReturnStatus_en LVEQNB_Process(LVEQNB_Handle_t       hInstance,
                    (LVM_INT16)NrSamples);
 
         /*
-         * For each section execte the filter unless the gain is 0dB
+         * Run the band filters as one cascade, bands with 0dB gain are bypassed
          */
-        if (pInstance->NBands != 0)
-        {
-            for (LVM_UINT16 i = 0; i < pInstance->NBands; i++)
-            {
-                /*
-                 * Check if band is non-zero dB gain
-                 */
-                if (pInstance->pBandDefinitions[i].Gain != 0)
-                {
-                    /*
-                     * Get the address of the biquad instance
-                     */
-                    Biquad_FLOAT_Instance_t *pBiquad = &pInstance->pEQNB_FilterState_Float[i];
-
-                    /*
-                     * Select single or double precision as required
-                     */
-                    switch (pInstance->pBiquadType[i])
-                    {
-                        case LVEQNB_SinglePrecision_Float:
-                        {
-#ifdef SUPPORT_MC
-                            PK_Mc_D32F32C14G11_TRC_WRA_01(pBiquad,
-                                                          pScratch,
-                                                          pScratch,
-                                                          (LVM_INT16)NrFrames,
-                                                          (LVM_INT16)NrChannels);
-#else
-                            PK_2I_D32F32C14G11_TRC_WRA_01(pBiquad,
-                                                          pScratch,
-                                                          pScratch,
-                                                          (LVM_INT16)NrFrames);
-#endif
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-                }
-            }
-        }
+        BQ_Cascade_Mc_D32F32_TDF2(pInstance->pEQNB_Stages,
+                                  (LVM_INT16)pInstance->NBands,
+                                  pScratch,
+                                  pScratch,
+                                  (LVM_INT16)NrFrames,
+                                  (LVM_INT16)NrChannels);
 
         if(pInstance->bInOperatingModeTransition == LVM_TRUE){
 #ifdef SUPPORT_MC
@@ -80,11 +80,10 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings (LVREV_Instance_st     *pPrivate)
 
         Omega = LVM_GetOmega(pPrivate->NewParams.HPF, pPrivate->NewParams.SampleRate);
         LVM_FO_HPF(Omega, &Coeffs);
-        FO_1I_D32F32Cll_TRC_WRA_01_Init( &pPrivate->pFastCoef->HPCoefs,
-                                         &pPrivate->pFastData->HPTaps, &Coeffs);
+        FO_Cascade_Mc_D32F32_Init(&pPrivate->pFastData->InputFilters[LVREV_HPF_STAGE], &Coeffs);
         LoadConst_Float(0,
-                (LVM_FLOAT *)&pPrivate->pFastData->HPTaps,
-                        sizeof(Biquad_1I_Order1_FLOAT_Taps_t) / sizeof(LVM_FLOAT));
+                (LVM_FLOAT *)pPrivate->pFastData->InputFilters[LVREV_HPF_STAGE].State,
+                        sizeof(pPrivate->pFastData->InputFilters[0].State) / sizeof(LVM_FLOAT));
     }
 
     /*
@@ -112,11 +111,15 @@ LVREV_ReturnStatus_en LVREV_ApplyNewSettings (LVREV_Instance_st     *pPrivate)
                 LVM_FO_LPF(Omega, &Coeffs);
             }
         }
-        FO_1I_D32F32Cll_TRC_WRA_01_Init( &pPrivate->pFastCoef->LPCoefs,
-                                         &pPrivate->pFastData->LPTaps, &Coeffs);
+        FO_Cascade_Mc_D32F32_Init(&pPrivate->pFastData->InputFilters[LVREV_LPF_STAGE], &Coeffs);
+        if ((Coeffs.A0 == 1) && (Coeffs.A1 == 0) && (Coeffs.B1 == 0))
+        {
+            /* Filter not applied */
+            pPrivate->pFastData->InputFilters[LVREV_LPF_STAGE].Bypass = LVM_TRUE;
+        }
         LoadConst_Float(0,
-                (LVM_FLOAT *)&pPrivate->pFastData->LPTaps,
-                        sizeof(Biquad_1I_Order1_FLOAT_Taps_t) / sizeof(LVM_FLOAT));
+                (LVM_FLOAT *)pPrivate->pFastData->InputFilters[LVREV_LPF_STAGE].State,
+                        sizeof(pPrivate->pFastData->InputFilters[0].State) / sizeof(LVM_FLOAT));
     }
 
     /*
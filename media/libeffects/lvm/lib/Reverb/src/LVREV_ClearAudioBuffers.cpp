@@ -60,11 +60,11 @@ LVREV_ReturnStatus_en LVREV_ClearAudioBuffers(LVREV_Handle_t  hInstance)
      */
 
     LoadConst_Float(0,
-        (LVM_FLOAT *)&pLVREV_Private->pFastData->HPTaps,
-        2);
+        (LVM_FLOAT *)pLVREV_Private->pFastData->InputFilters[LVREV_HPF_STAGE].State,
+        sizeof(pLVREV_Private->pFastData->InputFilters[0].State) / sizeof(LVM_FLOAT));
     LoadConst_Float(0,
-        (LVM_FLOAT *)&pLVREV_Private->pFastData->LPTaps,
-        2);
+        (LVM_FLOAT *)pLVREV_Private->pFastData->InputFilters[LVREV_LPF_STAGE].State,
+        sizeof(pLVREV_Private->pFastData->InputFilters[0].State) / sizeof(LVM_FLOAT));
     if((LVM_UINT16)pLVREV_Private->InstanceParams.NumDelays == LVREV_DELAYLINES_4)
     {
         LoadConst_Float(0, (LVM_FLOAT *)&pLVREV_Private->pFastData->RevLPTaps[3], 2);
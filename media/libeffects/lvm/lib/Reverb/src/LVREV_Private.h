@@ -94,6 +94,8 @@
 #define LVREV_MAX_DENSITY                 100           /* Maximum density, 100% */
 #define LVREV_MAX_DAMPING                 100           /* Maximum damping, 100% */
 #define LVREV_MAX_ROOMSIZE                100           /* Maximum room size, 100% */
+#define LVREV_HPF_STAGE                   0             /* Input high pass filter stage */
+#define LVREV_LPF_STAGE                   1             /* Input low pass filter stage */
 
 /****************************************************************************************/
 /*                                                                                      */
@@ -104,8 +106,7 @@
 /* Fast data structure */
 typedef struct
 {
-    Biquad_1I_Order1_FLOAT_Taps_t HPTaps;                     /* High pass filter taps */
-    Biquad_1I_Order1_FLOAT_Taps_t LPTaps;                     /* Low pass filter taps */
+    BQ_Cascade_FLOAT_Stage_t      InputFilters[2];            /* High and low pass filters */
     Biquad_1I_Order1_FLOAT_Taps_t RevLPTaps[4];               /* Reverb low pass filters taps */
 
 } LVREV_FastData_st;
@@ -114,8 +115,6 @@ typedef struct
 typedef struct
 {
 
-    Biquad_FLOAT_Instance_t       HPCoefs;              /* High pass filter coefficients */
-    Biquad_FLOAT_Instance_t       LPCoefs;              /* Low pass filter coefficients */
     Biquad_FLOAT_Instance_t       RevLPCoefs[4];        /* Reverb low pass filters coefficients */
 
 } LVREV_FastCoef_st;
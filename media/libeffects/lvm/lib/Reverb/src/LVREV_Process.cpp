@@ -231,19 +231,14 @@ void ReverbBlock(LVM_FLOAT *pInput, LVM_FLOAT *pOutput,
                  (LVM_INT16)NumSamples);
 
     /*
-     *  High pass filter
+     *  High pass and low pass filters
      */
-    FO_1I_D32F32C31_TRC_WRA_01(&pPrivate->pFastCoef->HPCoefs,
-                               pTemp,
-                               pTemp,
-                               (LVM_INT16)NumSamples);
-    /*
-     *  Low pass filter
-     */
-    FO_1I_D32F32C31_TRC_WRA_01(&pPrivate->pFastCoef->LPCoefs,
-                               pTemp,
-                               pTemp,
-                               (LVM_INT16)NumSamples);
+    BQ_Cascade_Mc_D32F32_TDF2(pPrivate->pFastData->InputFilters,
+                              2,
+                              pTemp,
+                              pTemp,
+                              (LVM_INT16)NumSamples,
+                              1);
 
     /*
      *  Process all delay lines
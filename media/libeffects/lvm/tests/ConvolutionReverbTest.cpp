@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ConvolutionReverb.h"
+
+using android::ConvolutionReverb;
+
+namespace {
+
+constexpr uint32_t kSampleRate = 48000;
+
+ConvolutionReverb::Parameters shortRoom() {
+    ConvolutionReverb::Parameters parameters;
+    parameters.roomLevel = 0;
+    parameters.roomHfLevel = -1000;
+    parameters.decayTime = 100;
+    parameters.decayHfRatio = 500;
+    parameters.reverbLevel = 0;
+    parameters.diffusion = 700;
+    parameters.density = 500;
+    return parameters;
+}
+
+void completeUpdate(ConvolutionReverb *engine, uint32_t inChannelCount,
+                    uint32_t outChannelCount) {
+    std::vector<float> in(ConvolutionReverb::kDefaultBlockSize * inChannelCount);
+    std::vector<float> out(ConvolutionReverb::kDefaultBlockSize * outChannelCount);
+    while (engine->isUpdating()) {
+        engine->process(in.data(), out.data(), ConvolutionReverb::kDefaultBlockSize);
+    }
+    engine->reset();
+}
+
+// Creating the engine or changing its properties leaves the synthesis of the impulse
+// response to process(), a few partitions per block.
+TEST(ConvolutionReverbTest, ResponseSynthesizedInProcess) {
+    ConvolutionReverb engine(kSampleRate, 1, 2);
+    engine.setParameters(shortRoom());
+    EXPECT_TRUE(engine.isUpdating());
+    EXPECT_EQ(0u, engine.getPartitionCount());
+
+    std::vector<float> in(ConvolutionReverb::kDefaultBlockSize);
+    std::vector<float> out(2 * ConvolutionReverb::kDefaultBlockSize);
+    engine.process(in.data(), out.data(), in.size());
+    // The first response is used as its partitions are ready
+    const size_t partitionCount = engine.getPartitionCount();
+    EXPECT_GT(partitionCount, 0u);
+    EXPECT_TRUE(engine.isUpdating());
+
+    completeUpdate(&engine, 1, 2);
+    EXPECT_GT(engine.getPartitionCount(), partitionCount);
+    EXPECT_EQ(engine.getPartitionCount() * ConvolutionReverb::kDefaultBlockSize,
+              engine.getImpulseResponse(0).size());
+}
+
+// The partitioned convolution must give the direct convolution of the mono send with the
+// impulse response of each output channel, delayed by the latency, whatever the number of
+// frames per call.
+TEST(ConvolutionReverbTest, MatchesDirectConvolution) {
+    constexpr uint32_t kInChannelCount = 2;
+    constexpr uint32_t kOutChannelCount = 2;
+    ConvolutionReverb engine(kSampleRate, kInChannelCount, kOutChannelCount);
+    engine.setParameters(shortRoom());
+    completeUpdate(&engine, kInChannelCount, kOutChannelCount);
+
+    const size_t frameCount = 3 * kSampleRate / 10;
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    std::vector<float> in(frameCount * kInChannelCount);
+    for (float& sample : in) {
+        sample = distribution(generator);
+    }
+    std::vector<float> out(frameCount * kOutChannelCount);
+    const size_t callFrames[] = {1, 100, 256, 300, 17};
+    for (size_t done = 0, call = 0; done < frameCount; call++) {
+        const size_t frames = std::min(callFrames[call % 5], frameCount - done);
+        engine.process(&in[done * kInChannelCount], &out[done * kOutChannelCount], frames);
+        done += frames;
+    }
+
+    std::vector<double> send(frameCount);
+    for (size_t i = 0; i < frameCount; i++) {
+        send[i] = ((double)in[2 * i] + in[2 * i + 1]) / 2;
+    }
+    const size_t latency = engine.getLatency();
+    for (uint32_t c = 0; c < kOutChannelCount; c++) {
+        const std::vector<float> response = engine.getImpulseResponse(c);
+        ASSERT_FALSE(response.empty());
+        double peak = 0;
+        double maxError = 0;
+        for (size_t i = 0; i < frameCount; i++) {
+            double expected = 0;
+            for (size_t k = 0; k < response.size() && k + latency <= i; k++) {
+                expected += response[k] * send[i - latency - k];
+            }
+            peak = std::max(peak, fabs(expected));
+            maxError = std::max(maxError, fabs(expected - out[i * kOutChannelCount + c]));
+        }
+        EXPECT_GT(peak, 0.01) << "channel " << c;
+        EXPECT_LT(maxError, 1e-4 * peak) << "channel " << c;
+    }
+
+    // The output channels are decorrelated
+    EXPECT_NE(engine.getImpulseResponse(0), engine.getImpulseResponse(1));
+}
+
+}  // namespace
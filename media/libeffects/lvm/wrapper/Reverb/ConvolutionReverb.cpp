@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ConvolutionReverb"
+//#define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#include "ConvolutionReverb.h"
+
+namespace android {
+
+namespace {
+
+// Partitions transformed per block while the impulse response is updated
+constexpr size_t kSynthesisPartitionsPerBlock = 8;
+// Reference frequency of roomHfLevel and decayHfRatio
+constexpr float kHfReferenceHz = 5000.0f;
+// Sparse noise pulses per second for each permille of density
+constexpr float kPulsesPerSecondPerDensity = 4.0f;
+// Reverb level giving unity gain, as in the LVREV wrapper
+constexpr int32_t kMaxReverbLevel = 2000;
+// Combined level below which the reverb is muted, as in the LVREV wrapper
+constexpr int32_t kMinCombinedLevel = -12000;
+// Output level of LVREV for a unit combined level, relative to a unit energy response
+constexpr float kLevelCalibration = 0.5f;
+
+float levelToGain(int32_t roomLevel, int32_t reverbLevel) {
+    const int32_t level = std::min(roomLevel + reverbLevel - kMaxReverbLevel, 0);
+    if (level <= kMinCombinedLevel) {
+        return 0;
+    }
+    // LVREV scales its output by the linear level, then by the gain compensation
+    // (1 / (1 + level / 2))^2 of its feedback network; follow the same law so that
+    // the presets sound as loud with both engines.
+    const float linear = powf(10.0f, level / 2000.0f);
+    const float compensation = 2.0f / (1.0f + linear);
+    return kLevelCalibration * linear * compensation * compensation;
+}
+
+// Coefficient a of the one pole low pass y(n) = a * y(n-1) + (1 - a) * x(n)
+float onePoleCoef(float cutoffHz, uint32_t sampleRate) {
+    return expf(-2.0f * (float)M_PI * cutoffHz / sampleRate);
+}
+
+// sum of r^n for n in [0, length)
+double geometricSum(double r, size_t length) {
+    return r >= 1.0 ? length : (1.0 - pow(r, length)) / (1.0 - r);
+}
+
+} // namespace
+
+ConvolutionReverb::ConvolutionReverb(uint32_t sampleRate, uint32_t inChannelCount,
+        uint32_t outChannelCount, size_t blockSize) :
+        mSampleRate(sampleRate),
+        mInChannelCount(std::max(inChannelCount, 1u)),
+        mOutChannelCount(std::min(std::max(outChannelCount, 1u), (uint32_t)kMaxChannelCount)),
+        mBlockSize(blockSize),
+        mBinCount(blockSize + 1),
+        mTimeInput(2 * blockSize, 0),
+        mTimeOutput(2 * blockSize, 0),
+        mOutput(blockSize * mOutChannelCount, 0),
+        mFilters(mOutChannelCount),
+        mAccumulators(mOutChannelCount, Eigen::VectorXcf::Zero(mBinCount)),
+        mTimePartition(2 * blockSize, 0) {
+    mFft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+    // The 1 / (2 * blockSize) of the inverse FFT is folded into the impulse response
+    mFft.SetFlag(Eigen::FFT<float>::Unscaled);
+    // Let the FFT allocate its plan and scratch buffers here rather than in process()
+    mFft.fwd(mAccumulators[0].data(), mTimeInput.data(), 2 * mBlockSize);
+    mFft.inv(mTimeOutput.data(), mAccumulators[0].data(), 2 * mBlockSize);
+    mAccumulators[0].setZero();
+
+    mParameters.decayTime = 0;  // force the synthesis of the default response
+    setParameters(Parameters());
+    mGain = mTargetGain;
+}
+
+void ConvolutionReverb::setParameters(const Parameters& parameters) {
+    mTargetGain = levelToGain(parameters.roomLevel, parameters.reverbLevel);
+    const bool shapeChanged = parameters.decayTime != mParameters.decayTime
+            || parameters.decayHfRatio != mParameters.decayHfRatio
+            || parameters.roomHfLevel != mParameters.roomHfLevel
+            || parameters.diffusion != mParameters.diffusion
+            || parameters.density != mParameters.density;
+    mParameters = parameters;
+    if (!shapeChanged) {
+        return;
+    }
+
+    const float decayMs = std::min(std::max(parameters.decayTime, 1u), kMaxDecayTimeMs);
+    const float hfDecayMs = decayMs * std::max((int)parameters.decayHfRatio, 1) / 1000.0f;
+    const float lengthMs = std::min(std::max(decayMs, hfDecayMs), (float)kMaxDecayTimeMs);
+    const size_t frameCount = (size_t)ceilf(lengthMs * mSampleRate / 1000.0f);
+    const size_t partitionCount = std::max((frameCount + mBlockSize - 1) / mBlockSize,
+            (size_t)1);
+
+    // -60 dB over the decay time
+    mLowDecay = expf(logf(0.001f) / (decayMs * mSampleRate / 1000.0f));
+    mHighDecay = expf(logf(0.001f) / (hfDecayMs * mSampleRate / 1000.0f));
+    mCrossoverCoef = onePoleCoef(kHfReferenceHz, mSampleRate);
+
+    // A one pole low pass attenuating the reference frequency by roomHfLevel
+    const float roomHfGain = powf(10.0f, std::min((int)parameters.roomHfLevel, 0) / 2000.0f);
+    mRoomLowPassCoef = 0;
+    if (roomHfGain < 0.999f) {
+        const float cutoffHz = kHfReferenceHz / sqrtf(1.0f / (roomHfGain * roomHfGain) - 1.0f);
+        if (cutoffHz < mSampleRate / 2) {
+            mRoomLowPassCoef = onePoleCoef(cutoffHz, mSampleRate);
+        }
+    }
+
+    // Unit variance noise: dense uniform noise mixed with sparse pulses
+    const float pulsesPerSecond =
+            std::max((int)parameters.density, 1) * kPulsesPerSecondPerDensity;
+    mPulseProbability = std::min(pulsesPerSecond / mSampleRate, 1.0f);
+    mPulseAmplitude = 1.0f / sqrtf(mPulseProbability);
+    const float dense = std::min(std::max((int)parameters.diffusion, 0), 1000) / 1000.0f;
+    mDenseWeight = sqrtf(dense);
+    mSparseWeight = sqrtf(1.0f - dense);
+
+    // Energy of the response before the room HF level filter, which attenuates on purpose
+    const double a = mCrossoverCoef;
+    const double lowVariance = (1.0 - a) / (1.0 + a);
+    const double covariance = (1.0 - a) - lowVariance;
+    const double highVariance = 1.0 - 2.0 * (1.0 - a) + lowVariance;
+    const size_t length = partitionCount * mBlockSize;
+    const double energy = lowVariance * geometricSum((double)mLowDecay * mLowDecay, length)
+            + highVariance * geometricSum((double)mHighDecay * mHighDecay, length)
+            + 2.0 * covariance * geometricSum((double)mLowDecay * mHighDecay, length);
+    mNormalization = (float)(1.0 / (sqrt(energy) * 2 * mBlockSize));
+
+    ALOGV("setParameters decay %.0f ms, HF decay %.0f ms, %zu partitions",
+            decayMs, hfDecayMs, partitionCount);
+    startSynthesis(partitionCount);
+}
+
+void ConvolutionReverb::reset() {
+    std::fill(mTimeInput.begin(), mTimeInput.end(), 0);
+    std::fill(mOutput.begin(), mOutput.end(), 0);
+    for (auto& spectrum : mFdl) {
+        spectrum.setZero();
+    }
+    mFill = 0;
+    mGain = mTargetGain;
+}
+
+std::vector<float> ConvolutionReverb::getImpulseResponse(uint32_t channel) {
+    if (channel >= mOutChannelCount) {
+        return {};
+    }
+    std::vector<float> response(mActivePartitions * mBlockSize);
+    for (size_t p = 0; p < mActivePartitions; p++) {
+        mFft.inv(mTimeOutput.data(), mFilters[channel][p].data(), 2 * mBlockSize);
+        for (size_t i = 0; i < mBlockSize; i++) {
+            response[p * mBlockSize + i] = mTimeOutput[i] * mTargetGain;
+        }
+    }
+    return response;
+}
+
+void ConvolutionReverb::process(const float *in, float *out, size_t frameCount) {
+    const float sendScale = 1.0f / mInChannelCount;
+    while (frameCount > 0) {
+        const size_t frames = std::min(frameCount, mBlockSize - mFill);
+        float *send = &mTimeInput[mBlockSize + mFill];
+        for (size_t i = 0; i < frames; i++) {
+            float sum = 0;
+            for (uint32_t c = 0; c < mInChannelCount; c++) {
+                sum += in[c];
+            }
+            send[i] = sum * sendScale;
+            in += mInChannelCount;
+        }
+        memcpy(out, &mOutput[mFill * mOutChannelCount],
+                frames * mOutChannelCount * sizeof(float));
+        out += frames * mOutChannelCount;
+        mFill += frames;
+        frameCount -= frames;
+
+        if (mFill == mBlockSize) {
+            processBlock();
+            mFill = 0;
+        }
+    }
+}
+
+void ConvolutionReverb::processBlock() {
+    const size_t fdlSize = mFdl.size();
+    mFdlHead = (mFdlHead + fdlSize - 1) % fdlSize;
+    mFft.fwd(mFdl[mFdlHead].data(), mTimeInput.data(), 2 * mBlockSize);
+
+    for (auto& accumulator : mAccumulators) {
+        accumulator.setZero();
+    }
+    // Each input spectrum is loaded once for all the output channels
+    for (size_t p = 0; p < mActivePartitions; p++) {
+        const Eigen::VectorXcf& input = mFdl[(mFdlHead + p) % fdlSize];
+        for (uint32_t c = 0; c < mOutChannelCount; c++) {
+            mAccumulators[c] += input.cwiseProduct(mFilters[c][p]);
+        }
+    }
+
+    const float gainStep = (mTargetGain - mGain) / mBlockSize;
+    for (uint32_t c = 0; c < mOutChannelCount; c++) {
+        mFft.inv(mTimeOutput.data(), mAccumulators[c].data(), 2 * mBlockSize);
+        // Overlap-save: the second half holds the linear convolution of the current block
+        const float *convolved = &mTimeOutput[mBlockSize];
+        float gain = mGain;
+        for (size_t i = 0; i < mBlockSize; i++) {
+            gain += gainStep;
+            mOutput[i * mOutChannelCount + c] = convolved[i] * gain;
+        }
+    }
+    mGain = mTargetGain;
+
+    std::copy(mTimeInput.begin() + mBlockSize, mTimeInput.end(), mTimeInput.begin());
+
+    if (isUpdating()) {
+        synthesizePartitions(kSynthesisPartitionsPerBlock);
+    }
+}
+
+void ConvolutionReverb::resizePartitions(size_t partitionCount) {
+    const size_t fdlSize = mFdl.size();
+    if (partitionCount <= fdlSize) {
+        return;
+    }
+    // Keep the input history in order, newest first
+    std::vector<Eigen::VectorXcf> fdl(partitionCount, Eigen::VectorXcf::Zero(mBinCount));
+    for (size_t i = 0; i < fdlSize; i++) {
+        fdl[i].swap(mFdl[(mFdlHead + i) % fdlSize]);
+    }
+    mFdl.swap(fdl);
+    mFdlHead = 0;
+    for (auto& filter : mFilters) {
+        filter.resize(partitionCount, Eigen::VectorXcf::Zero(mBinCount));
+    }
+}
+
+void ConvolutionReverb::startSynthesis(size_t partitionCount) {
+    resizePartitions(partitionCount);
+    for (uint32_t c = 0; c < mOutChannelCount; c++) {
+        // A different seed per output channel decorrelates the channels
+        mGenerators[c] = {0x2545f491u * (c + 1), 0, 0, 1.0f, 1.0f};
+    }
+    mTargetPartitions = partitionCount;
+    mSynthesizedPartitions = 0;
+}
+
+float ConvolutionReverb::nextNoise(Generator *generator) const {
+    generator->seed = generator->seed * 1664525u + 1013904223u;
+    // Uniform in [-1, 1), of variance 1/3
+    const float dense = (int32_t)generator->seed * (1.0f / 2147483648.0f) * sqrtf(3.0f);
+    generator->seed = generator->seed * 1664525u + 1013904223u;
+    const float draw = (generator->seed >> 8) * (1.0f / 16777216.0f);
+    float sparse = 0;
+    if (draw < mPulseProbability) {
+        sparse = (generator->seed & 1) ? mPulseAmplitude : -mPulseAmplitude;
+    }
+    return mDenseWeight * dense + mSparseWeight * sparse;
+}
+
+void ConvolutionReverb::synthesizePartitions(size_t count) {
+    const float a = mCrossoverCoef;
+    const float b = mRoomLowPassCoef;
+    for (; count > 0 && mSynthesizedPartitions < mTargetPartitions; count--) {
+        const size_t p = mSynthesizedPartitions++;
+        for (uint32_t c = 0; c < mOutChannelCount; c++) {
+            Generator *generator = &mGenerators[c];
+            for (size_t i = 0; i < mBlockSize; i++) {
+                const float x = nextNoise(generator);
+                generator->lowPassState = a * generator->lowPassState + (1.0f - a) * x;
+                const float low = generator->lowPassState;
+                const float sample = low * generator->lowEnvelope
+                        + (x - low) * generator->highEnvelope;
+                generator->lowEnvelope *= mLowDecay;
+                generator->highEnvelope *= mHighDecay;
+                generator->roomLowPassState = b * generator->roomLowPassState
+                        + (1.0f - b) * sample;
+                mTimePartition[i] = generator->roomLowPassState * mNormalization;
+            }
+            // The second half stays zero, for the overlap-save convolution
+            mFft.fwd(mFilters[c][p].data(), mTimePartition.data(), 2 * mBlockSize);
+        }
+    }
+    if (mSynthesizedPartitions == mTargetPartitions) {
+        mActivePartitions = mTargetPartitions;
+    } else {
+        // Partitions beyond those of the current response only hold the new one
+        mActivePartitions = std::max(mActivePartitions, mSynthesizedPartitions);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CONVOLUTIONREVERB_H_
+#define ANDROID_CONVOLUTIONREVERB_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+
+namespace android {
+
+/**
+ * Reverb engine convolving the input with a synthesized impulse response, as an
+ * alternative to the feedback delay network of LVREV.
+ *
+ * The impulse response is exponentially decaying noise shaped by the environmental
+ * reverb properties, with one decorrelated response per output channel. It is split in
+ * partitions of one block, and the convolution runs in the frequency domain with
+ * uniformly partitioned overlap-save: each block takes one forward FFT of the mono send,
+ * one complex multiply-accumulate per partition and output channel, and one inverse FFT
+ * per output channel, whatever the block contents. The output is delayed by one block.
+ *
+ * The impulse response is synthesized and transformed a few partitions per block in
+ * process(), and never all at once, so that the cost of a block stays bounded and creating
+ * the engine or changing its properties is cheap. The first response is used as its
+ * partitions are ready; a new one takes over when complete.
+ *
+ * setParameters(), reset(), process() and getImpulseResponse() must not run concurrently.
+ */
+class ConvolutionReverb {
+  public:
+    // Properties of the synthesized impulse response, in the units of t_reverb_settings
+    struct Parameters {
+        int16_t roomLevel = -6000;      // millibel
+        int16_t roomHfLevel = 0;        // millibel at 5 kHz, relative to low frequencies
+        uint32_t decayTime = 1490;      // milliseconds, to -60 dB at low frequencies
+        int16_t decayHfRatio = 1000;    // permille, decay time at 5 kHz over decayTime
+        int16_t reverbLevel = 0;        // millibel, relative to roomLevel
+        int16_t diffusion = 1000;       // permille, share of dense noise in the response
+        int16_t density = 1000;         // permille, rate of the sparse noise pulses
+    };
+
+    static constexpr size_t kDefaultBlockSize = 256;
+    static constexpr uint32_t kMaxDecayTimeMs = 7000;
+    static constexpr size_t kMaxChannelCount = 8;
+
+    ConvolutionReverb(uint32_t sampleRate, uint32_t inChannelCount, uint32_t outChannelCount,
+            size_t blockSize = kDefaultBlockSize);
+
+    void setParameters(const Parameters& parameters);
+    const Parameters& getParameters() const { return mParameters; }
+
+    // Clears the input history and the pending output
+    void reset();
+
+    // in has inChannelCount interleaved channels, out outChannelCount
+    void process(const float *in, float *out, size_t frameCount);
+
+    // Frames between an input frame and its first contribution to the output
+    size_t getLatency() const { return mBlockSize; }
+    size_t getPartitionCount() const { return mActivePartitions; }
+    bool isUpdating() const { return mSynthesizedPartitions < mTargetPartitions; }
+
+    // Response of output channel to the mono send, output gain included, as convolved
+    // in process()
+    std::vector<float> getImpulseResponse(uint32_t channel);
+
+  private:
+    // Sequential generator of the impulse response of one output channel
+    struct Generator {
+        uint32_t seed;
+        float lowPassState;         // crossover between the two decay rates
+        float roomLowPassState;     // room HF level filter
+        float lowEnvelope;
+        float highEnvelope;
+    };
+
+    void processBlock();
+    void resizePartitions(size_t partitionCount);
+    void startSynthesis(size_t partitionCount);
+    void synthesizePartitions(size_t count);
+    float nextNoise(Generator *generator) const;
+
+    const uint32_t mSampleRate;
+    const uint32_t mInChannelCount;
+    const uint32_t mOutChannelCount;
+    const size_t mBlockSize;
+    const size_t mBinCount;
+
+    Parameters mParameters;
+    float mGain = 0;                // applied to the output, ramped over one block
+    float mTargetGain = 0;
+
+    Eigen::FFT<float> mFft;
+    std::vector<float> mTimeInput;      // previous and current block of the mono send
+    std::vector<float> mTimeOutput;     // one inverse FFT
+    std::vector<float> mOutput;         // interleaved output block being played
+    size_t mFill = 0;                   // frames of the current block
+
+    // Spectra of the last input blocks, mFdl[mFdlHead] being the newest
+    std::vector<Eigen::VectorXcf> mFdl;
+    size_t mFdlHead = 0;
+    // Impulse response partition spectra, per output channel
+    std::vector<std::vector<Eigen::VectorXcf>> mFilters;
+    size_t mActivePartitions = 0;
+    std::vector<Eigen::VectorXcf> mAccumulators;    // output spectrum per output channel
+
+    // Impulse response synthesis, partition by partition
+    Generator mGenerators[kMaxChannelCount];
+    size_t mTargetPartitions = 0;
+    size_t mSynthesizedPartitions = 0;
+    std::vector<float> mTimePartition;
+    float mNormalization = 0;
+    float mLowDecay = 0;                // per sample envelope factors
+    float mHighDecay = 0;
+    float mCrossoverCoef = 0;
+    float mRoomLowPassCoef = 0;
+    float mPulseProbability = 0;
+    float mPulseAmplitude = 0;
+    float mDenseWeight = 0;
+    float mSparseWeight = 0;
+};
+
+} // namespace android
+
+#endif // ANDROID_CONVOLUTIONREVERB_H_
@@ -21,6 +21,7 @@ typedef float LVM_FLOAT;
 #define ARRAY_SIZE(array) (sizeof (array) / sizeof (array)[0])
 //#define LOG_NDEBUG 0
 
+#include <algorithm>
 #include <assert.h>
 #include <inttypes.h>
 #include <new>
@@ -30,6 +31,7 @@ typedef float LVM_FLOAT;
 #include <audio_utils/primitives.h>
 #include <log/log.h>
 
+#include "ConvolutionReverb.h"
 #include "EffectReverb.h"
 // from Reverb/lib
 #include "LVREV.h"
@@ -164,6 +166,8 @@ struct ReverbContext{
     LVM_INT16                       prevLeftVolume;
     LVM_INT16                       prevRightVolume;
     int                             volumeMode;
+    reverb_engine_t                 engine;
+    ConvolutionReverb               *pConvolution;      // used instead of LVREV if not NULL
 };
 
 enum {
@@ -188,6 +192,8 @@ int  Reverb_getParameter    (ReverbContext *pContext,
                              uint32_t      *pValueSize,
                              void          *pValue);
 int Reverb_LoadPreset       (ReverbContext   *pContext);
+int Reverb_setEngine        (ReverbContext *pContext, int32_t engine);
+void ReverbUpdateConvolution(ReverbContext *pContext);
 int Reverb_paramValueSize   (int32_t param);
 
 /* Effect Library Interface Implementation */
@@ -225,6 +231,8 @@ extern "C" int EffectCreate(const effect_uuid_t *uuid,
 
     pContext->itfe      = &gReverbInterface;
     pContext->hInstance = NULL;
+    pContext->engine    = REVERB_ENGINE_LVREV;
+    pContext->pConvolution = NULL;
 
     pContext->auxiliary = false;
     if ((desc->flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY){
@@ -283,6 +291,7 @@ extern "C" int EffectRelease(effect_handle_t handle){
     free(pContext->OutFrames);
     pContext->bufferSizeIn = 0;
     pContext->bufferSizeOut = 0;
+    delete pContext->pConvolution;
     Reverb_free(pContext);
     delete pContext;
     return 0;
@@ -398,11 +407,15 @@ int process( effect_buffer_t   *pIn,
             ALOGV("\tZeroing %d samples per frame at the end of call", channels);
         }
 
-        /* Process the samples, producing a stereo output */
-        LvmStatus = LVREV_Process(pContext->hInstance,      /* Instance handle */
-                                  pContext->InFrames,     /* Input buffer */
-                                  pContext->OutFrames,    /* Output buffer */
-                                  frameCount);              /* Number of samples to read */
+        if (pContext->pConvolution != NULL) {
+            pContext->pConvolution->process(pContext->InFrames, pContext->OutFrames, frameCount);
+        } else {
+            /* Process the samples, producing a stereo output */
+            LvmStatus = LVREV_Process(pContext->hInstance,      /* Instance handle */
+                                      pContext->InFrames,     /* Input buffer */
+                                      pContext->OutFrames,    /* Output buffer */
+                                      frameCount);              /* Number of samples to read */
+        }
     }
 
     LVM_ERROR_CHECK(LvmStatus, "LVREV_Process", "process")
@@ -592,6 +605,16 @@ int Reverb_setConfig(ReverbContext *pContext, effect_config_t *pConfig){
         if(LvmStatus != LVREV_SUCCESS) return -EINVAL;
         //ALOGV("\tReverb_setConfig Succesfully called LVREV_SetControlParameters\n");
         pContext->SampleRate = SampleRate;
+
+        if (pContext->engine == REVERB_ENGINE_CONVOLUTION) {
+            // the impulse response is synthesized for the sampling rate
+            delete pContext->pConvolution;
+            pContext->pConvolution = NULL;
+            if (Reverb_setEngine(pContext, REVERB_ENGINE_CONVOLUTION) != 0) {
+                // keep processing, with LVREV rather than no engine
+                Reverb_setEngine(pContext, REVERB_ENGINE_LVREV);
+            }
+        }
     }else{
         //ALOGV("\tReverb_setConfig keep sampling rate at %d", SampleRate);
     }
@@ -1428,11 +1451,85 @@ int Reverb_LoadPreset(ReverbContext   *pContext)
         // reverbDelay
         ReverbSetDiffusion(pContext, preset->diffusion);
         ReverbSetDensity(pContext, preset->density);
+        ReverbUpdateConvolution(pContext);
     }
 
     return 0;
 }
 
+//----------------------------------------------------------------------------
+// ReverbUpdateConvolution()
+//----------------------------------------------------------------------------
+// Purpose:
+// Apply the saved reverb properties to the convolution engine, if selected. The new
+// impulse response takes over progressively, in process().
+//
+// Inputs:
+//  pContext         - handle to instance data
+//
+//----------------------------------------------------------------------------
+void ReverbUpdateConvolution(ReverbContext *pContext)
+{
+    if (pContext->pConvolution == NULL) {
+        return;
+    }
+
+    ConvolutionReverb::Parameters parameters;
+    parameters.roomLevel = pContext->SavedRoomLevel;
+    parameters.roomHfLevel = pContext->SavedHfLevel;
+    parameters.decayTime = std::min<uint32_t>((uint16_t)pContext->SavedDecayTime, LVREV_MAX_T60);
+    parameters.decayHfRatio = pContext->SavedDecayHfRatio;
+    parameters.reverbLevel = pContext->SavedReverbLevel;
+    parameters.diffusion = pContext->SavedDiffusion;
+    parameters.density = pContext->SavedDensity;
+    pContext->pConvolution->setParameters(parameters);
+}
+
+//----------------------------------------------------------------------------
+// Reverb_setEngine()
+//----------------------------------------------------------------------------
+// Purpose:
+// Select the engine processing the reverb
+//
+// Inputs:
+//  pContext         - handle to instance data
+//  engine           - REVERB_ENGINE_LVREV or REVERB_ENGINE_CONVOLUTION
+//
+//----------------------------------------------------------------------------
+int Reverb_setEngine(ReverbContext *pContext, int32_t engine)
+{
+    switch (engine) {
+    case REVERB_ENGINE_LVREV:
+        if (pContext->engine == REVERB_ENGINE_CONVOLUTION) {
+            delete pContext->pConvolution;
+            pContext->pConvolution = NULL;
+            // LVREV did not run while the convolution engine was selected
+            LVREV_ReturnStatus_en LvmStatus = LVREV_ClearAudioBuffers(pContext->hInstance);
+            LVM_ERROR_CHECK(LvmStatus, "LVREV_ClearAudioBuffers", "Reverb_setEngine")
+        }
+        break;
+    case REVERB_ENGINE_CONVOLUTION:
+        if (pContext->pConvolution == NULL) {
+            pContext->pConvolution = new (std::nothrow) ConvolutionReverb(
+                    pContext->config.inputCfg.samplingRate,
+                    audio_channel_count_from_out_mask(pContext->config.inputCfg.channels),
+                    FCC_2);
+            if (pContext->pConvolution == NULL) {
+                ALOGE("\tLVREV_ERROR : Reverb_setEngine failed to allocate convolution engine");
+                return -ENOMEM;
+            }
+            ReverbUpdateConvolution(pContext);
+        }
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    pContext->engine = (reverb_engine_t)engine;
+    ALOGV("\tReverb_setEngine engine %d", engine);
+    return 0;
+}
+
 //----------------------------------------------------------------------------
 // Reverb_getParameter()
 //----------------------------------------------------------------------------
@@ -1464,6 +1561,15 @@ int Reverb_getParameter(ReverbContext *pContext,
     t_reverb_settings *pProperties;
 
     //ALOGV("\tReverb_getParameter start");
+    if (param == REVERB_PARAM_ENGINE) {
+        if (*pValueSize < sizeof(int32_t)) {
+            return -EINVAL;
+        }
+        *(int32_t *)pValue = pContext->engine;
+        *pValueSize = sizeof(int32_t);
+        return 0;
+    }
+
     if (pContext->preset) {
         if (param != REVERB_PARAM_PRESET || *pValueSize < sizeof(uint16_t)) {
             return -EINVAL;
@@ -1680,6 +1786,13 @@ int Reverb_setParameter (ReverbContext *pContext, void *pParam, void *pValue, in
     int32_t param = *pParamTemp++;
 
     //ALOGV("\tReverb_setParameter start");
+    if (param == REVERB_PARAM_ENGINE) {
+        if (vsize < (int)sizeof(int32_t)) {
+            return -EINVAL;
+        }
+        return Reverb_setEngine(pContext, *(int32_t *)pValue);
+    }
+
     if (pContext->preset) {
         if (param != REVERB_PARAM_PRESET) {
             return -EINVAL;
@@ -1773,6 +1886,7 @@ int Reverb_setParameter (ReverbContext *pContext, void *pParam, void *pValue, in
             ALOGV("\tLVM_ERROR : Reverb_setParameter() invalid param %d", param);
             break;
     }
+    ReverbUpdateConvolution(pContext);
 
     //ALOGV("\tReverb_setParameter end");
     return status;
@@ -2001,6 +2115,9 @@ int Reverb_command(effect_handle_t  self,
             LVM_ERROR_CHECK(LvmStatus, "LVREV_GetControlParameters", "EFFECT_CMD_ENABLE")
             pContext->SamplesToExitCount =
                     (ActiveParams.T60 * pContext->config.inputCfg.samplingRate)/1000;
+            if (pContext->pConvolution != NULL) {
+                pContext->SamplesToExitCount += pContext->pConvolution->getLatency();
+            }
             // force no volume ramp for first buffer processed after enabling the effect
             pContext->volumeMode = android::REVERB_VOLUME_FLAT;
             //ALOGV("\tEFFECT_CMD_ENABLE SamplesToExitCount = %d", pContext->SamplesToExitCount);
@@ -28,6 +28,16 @@
 #define LVREV_CUP_LOAD_ARM9E    470    // Expressed in 0.1 MIPS
 #define LVREV_MEM_USAGE         (71+(LVREV_MAX_FRAME_SIZE>>7))     // Expressed in kB
 
+// Vendor parameter selecting the reverb engine, accepted by the environmental and preset
+// reverbs. The value is an int32_t from reverb_engine_t.
+#define REVERB_PARAM_ENGINE     0x100
+
+typedef enum
+{
+    REVERB_ENGINE_LVREV,            // feedback delay network, default
+    REVERB_ENGINE_CONVOLUTION,      // partitioned convolution, one block of latency
+} reverb_engine_t;
+
 typedef struct _LPFPair_t
 {
     int16_t Room_HF;
@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <stdlib.h>
 #include <string.h>
 #define LOG_TAG "PreProcessing"
 //#define LOG_NDEBUG 0
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Timers.h>
 #include <hardware/audio_effect.h>
@@ -28,6 +30,8 @@
 #include <audio_processing.h>
 #include "speex/speex_resampler.h"
 
+#include "PreProcessing.h"
+
 // undefine to perform multi channels API functional tests
 //#define DUAL_MIC_TEST
 
@@ -67,6 +71,7 @@ typedef void* preproc_fx_handle_t;
 typedef struct preproc_session_s preproc_session_t;
 typedef struct preproc_effect_s preproc_effect_t;
 typedef struct preproc_ops_s preproc_ops_t;
+typedef struct preproc_settings_s preproc_settings_t;
 
 // Effect operation table. Functions for all pre processors are declared in sPreProcOps[] table.
 // Function pointer can be null if no action required.
@@ -96,6 +101,26 @@ struct preproc_effect_s {
 #endif
 };
 
+// Everything that determines the output of a session's APM for a given input, as compared
+// between sessions in shared analysis mode. Members not in use are 0.
+struct preproc_settings_s {
+    audio_format_t format;
+    uint32_t apmSamplingRate;
+    uint32_t inChannelCount;
+    uint32_t outChannelCount;
+    uint32_t revChannelCount;
+    uint32_t enabledMsk;
+    int agcMode;
+    int agcTargetLevel;
+    int agcCompGain;
+    int agcLimiterEnabled;
+    int aecRoutingMode;
+    int aecComfortNoiseEnabled;
+    int aecStreamDelayMs;
+    int nsLevel;
+    uint32_t nsType;
+};
+
 // Session context
 struct preproc_session_s {
     struct preproc_effect_s effects[PREPROC_NUM_EFFECTS]; // effects in this session
@@ -114,11 +139,11 @@ struct preproc_session_s {
     uint32_t processedMsk;              // bit field containing IDs of pre processors already
                                         // processed in current round
     webrtc::AudioFrame *procFrame;      // audio frame passed to webRTC AMP ProcessStream()
-    int16_t *inBuf;                     // input buffer used when resampling
+    void *inBuf;                        // input buffer used when resampling
     size_t inBufSize;                   // input buffer size in frames
     size_t framesIn;                    // number of frames in input buffer
     SpeexResamplerState *inResampler;   // handle on input speex resampler
-    int16_t *outBuf;                    // output buffer used when resampling
+    void *outBuf;                       // output buffer used when resampling
     size_t outBufSize;                  // output buffer size in frames
     size_t framesOut;                   // number of frames in output buffer
     SpeexResamplerState *outResampler;  // handle on output speex resampler
@@ -128,12 +153,41 @@ struct preproc_session_s {
     uint32_t revProcessedMsk;           // bit field containing IDs of pre processors with reverse
                                         // channel already processed in current round
     webrtc::AudioFrame *revFrame;       // audio frame passed to webRTC AMP AnalyzeReverseStream()
-    int16_t *revBuf;                    // reverse channel input buffer
+    void *revBuf;                       // reverse channel input buffer
     size_t revBufSize;                  // reverse channel input buffer size
     size_t framesRev;                   // number of frames in reverse channel input buffer
     SpeexResamplerState *revResampler;  // handle on reverse channel input speex resampler
+    audio_format_t format;              // sample format at effect process interface
+    float *procBuf;                     // APM input and output in float format, interleaved
+    float *procPlanes;                  // APM input and output in float format, one plane
+                                        // per channel
+    float *revProcBuf;                  // APM reverse input in float format, interleaved
+    float *revProcPlanes;               // APM reverse input in float format, one plane
+                                        // per channel
+    preproc_settings_t settings;        // settings of the APM, valid when settingsValid is set
+    bool settingsValid;                 // cleared by any command, refreshed before use
+    // Members read by other sessions in shared analysis mode, guarded by sSharedLock
+    void *sharedIn;                     // last APM input processed, in shared analysis mode
+    void *sharedOut;                    // APM output for sharedIn
+    preproc_settings_t sharedSettings;  // settings of the APM that produced sharedOut
+    bool sharedValid;                   // sharedIn and sharedOut hold a block this session
+                                        // processed
+    uint32_t sharedSeq;                 // number of blocks processed in shared analysis mode
+    uint32_t sharedConsumed[PREPROC_NUM_SESSIONS]; // sharedSeq of each session when its
+                                        // output was last used by this session
+    preproc_process_stats_t stats;      // processing time and block counts
 };
 
+#ifndef PREPROC_SHARED_ANALYSIS_DEFAULT
+#define PREPROC_SHARED_ANALYSIS_DEFAULT false
+#endif
+
+// true when PREPROC_SHARED_ANALYSIS_PROPERTY was set at library initialization
+static bool sSharedAnalysis = false;
+// Guards the shared members of all sessions. Sessions of an input are processed by the same
+// thread, but commands and releases come from others.
+static pthread_mutex_t sSharedLock = PTHREAD_MUTEX_INITIALIZER;
+
 #ifdef DUAL_MIC_TEST
 enum {
     PREPROC_CMD_DUAL_MIC_ENABLE = EFFECT_CMD_FIRST_PROPRIETARY, // enable dual mic mode
@@ -813,6 +867,12 @@ int Session_Init(preproc_session_t *session)
     session->io = 0;
     session->createdMsk = 0;
     session->apm = NULL;
+    session->procBuf = NULL;
+    session->procPlanes = NULL;
+    session->revProcBuf = NULL;
+    session->revProcPlanes = NULL;
+    session->sharedIn = NULL;
+    session->sharedOut = NULL;
     for (i = 0; i < PREPROC_NUM_EFFECTS && status == 0; i++) {
         status = Effect_Init(&session->effects[i], i);
     }
@@ -820,6 +880,37 @@ int Session_Init(preproc_session_t *session)
 }
 
 
+void Session_FreeApmBuffers(preproc_session_t *session)
+{
+    delete[] session->procBuf;
+    session->procBuf = NULL;
+    delete[] session->procPlanes;
+    session->procPlanes = NULL;
+    delete[] session->revProcBuf;
+    session->revProcBuf = NULL;
+    delete[] session->revProcPlanes;
+    session->revProcPlanes = NULL;
+    pthread_mutex_lock(&sSharedLock);
+    session->sharedValid = false;
+    free(session->sharedIn);
+    session->sharedIn = NULL;
+    free(session->sharedOut);
+    session->sharedOut = NULL;
+    pthread_mutex_unlock(&sSharedLock);
+}
+
+// Stops other sessions from using the output of this one until it processes again with
+// refreshed settings.
+void Session_InvalidateShared(preproc_session_t *session)
+{
+    session->settingsValid = false;
+    if (sSharedAnalysis) {
+        pthread_mutex_lock(&sSharedLock);
+        session->sharedValid = false;
+        pthread_mutex_unlock(&sSharedLock);
+    }
+}
+
 extern "C" int Session_CreateEffect(preproc_session_t *session,
                                     int32_t procId,
                                     effect_handle_t  *interface)
@@ -874,6 +965,26 @@ extern "C" int Session_CreateEffect(preproc_session_t *session,
         session->revResampler = NULL;
         session->revBuf = NULL;
         session->revBufSize = 0;
+        session->format = AUDIO_FORMAT_PCM_16_BIT;
+        session->procBuf = new float[webrtc::AudioFrame::kMaxDataSizeSamples];
+        session->procPlanes = new float[webrtc::AudioFrame::kMaxDataSizeSamples];
+        session->revProcBuf = new float[webrtc::AudioFrame::kMaxDataSizeSamples];
+        session->revProcPlanes = new float[webrtc::AudioFrame::kMaxDataSizeSamples];
+        session->settingsValid = false;
+        session->sharedIn = NULL;
+        session->sharedOut = NULL;
+        if (sSharedAnalysis) {
+            session->sharedIn = malloc(webrtc::AudioFrame::kMaxDataSizeSamples * sizeof(float));
+            session->sharedOut = malloc(webrtc::AudioFrame::kMaxDataSizeSamples * sizeof(float));
+            if (session->sharedIn == NULL || session->sharedOut == NULL) {
+                ALOGW("Session_CreateEffect could not allocate shared analysis buffers");
+                goto error;
+            }
+        }
+        session->sharedValid = false;
+        session->sharedSeq = 0;
+        memset(session->sharedConsumed, 0, sizeof(session->sharedConsumed));
+        memset(&session->stats, 0, sizeof(session->stats));
     }
     status = Effect_Create(&session->effects[procId], session, interface);
     if (status < 0) {
@@ -885,6 +996,7 @@ extern "C" int Session_CreateEffect(preproc_session_t *session,
 
 error:
     if (session->createdMsk == 0) {
+        Session_FreeApmBuffers(session);
         delete session->revFrame;
         session->revFrame = NULL;
         delete session->procFrame;
@@ -898,6 +1010,7 @@ error:
 int Session_ReleaseEffect(preproc_session_t *session,
                           preproc_effect_t *fx)
 {
+    Session_InvalidateShared(session);
     ALOGW_IF(Effect_Release(fx) != 0, " Effect_Release() failed for proc ID %d", fx->procId);
     session->createdMsk &= ~(1<<fx->procId);
     if (session->createdMsk == 0) {
@@ -919,13 +1032,19 @@ int Session_ReleaseEffect(preproc_session_t *session,
             speex_resampler_destroy(session->revResampler);
             session->revResampler = NULL;
         }
-        delete session->inBuf;
+        free(session->inBuf);
         session->inBuf = NULL;
-        delete session->outBuf;
+        free(session->outBuf);
         session->outBuf = NULL;
-        delete session->revBuf;
+        free(session->revBuf);
         session->revBuf = NULL;
+        Session_FreeApmBuffers(session);
 
+        ALOGV("Session_ReleaseEffect session %d: %u blocks processed in %lld us, %u shared, "
+              "%u reverse blocks analyzed in %lld us", session->id,
+              session->stats.processedBlocks, (long long)(session->stats.processTimeNs / 1000),
+              session->stats.sharedBlocks, session->stats.reverseBlocks,
+              (long long)(session->stats.reverseTimeNs / 1000));
         session->id = 0;
     }
 
@@ -940,7 +1059,8 @@ int Session_SetConfig(preproc_session_t *session, effect_config_t *config)
 
     if (config->inputCfg.samplingRate != config->outputCfg.samplingRate ||
         config->inputCfg.format != config->outputCfg.format ||
-        config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        (config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+         config->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT)) {
         return -EINVAL;
     }
 
@@ -963,11 +1083,16 @@ int Session_SetConfig(preproc_session_t *session, effect_config_t *config)
        {static_cast<int>(session->apmSamplingRate), outCnl},
        {static_cast<int>(session->apmSamplingRate), inCnl},
        {static_cast<int>(session->apmSamplingRate), inCnl}}};
+    if ((session->apmSamplingRate / 100) * std::max(inCnl, outCnl) >
+            webrtc::AudioFrame::kMaxDataSizeSamples) {
+        return -EINVAL;
+    }
     status = session->apm->Initialize(processing_config);
     if (status < 0) {
         return -EINVAL;
     }
 
+    session->format = config->inputCfg.format;
     session->samplingRate = config->inputCfg.samplingRate;
     session->apmFrameCount = session->apmSamplingRate / 100;
     if (session->samplingRate == session->apmSamplingRate) {
@@ -988,8 +1113,11 @@ int Session_SetConfig(preproc_session_t *session, effect_config_t *config)
     // force process buffer reallocation
     session->inBufSize = 0;
     session->outBufSize = 0;
+    session->revBufSize = 0;
     session->framesIn = 0;
     session->framesOut = 0;
+    session->framesRev = 0;
+    Session_InvalidateShared(session);
 
 
     if (session->inResampler != NULL) {
@@ -1052,7 +1180,7 @@ void Session_GetConfig(preproc_session_t *session, effect_config_t *config)
 {
     memset(config, 0, sizeof(effect_config_t));
     config->inputCfg.samplingRate = config->outputCfg.samplingRate = session->samplingRate;
-    config->inputCfg.format = config->outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    config->inputCfg.format = config->outputCfg.format = session->format;
     config->inputCfg.channels = audio_channel_in_mask_from_count(session->inChannelCount);
     // "out" doesn't mean output device, so this is the correct API to convert channel count to mask
     config->outputCfg.channels = audio_channel_in_mask_from_count(session->outChannelCount);
@@ -1064,7 +1192,8 @@ int Session_SetReverseConfig(preproc_session_t *session, effect_config_t *config
 {
     if (config->inputCfg.samplingRate != config->outputCfg.samplingRate ||
             config->inputCfg.format != config->outputCfg.format ||
-            config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+            (config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+             config->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT)) {
         return -EINVAL;
     }
 
@@ -1075,10 +1204,13 @@ int Session_SetReverseConfig(preproc_session_t *session, effect_config_t *config
         return -ENOSYS;
     }
     if (config->inputCfg.samplingRate != session->samplingRate ||
-            config->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+            config->inputCfg.format != session->format) {
         return -EINVAL;
     }
     uint32_t inCnl = audio_channel_count_from_out_mask(config->inputCfg.channels);
+    if (session->apmFrameCount * inCnl > webrtc::AudioFrame::kMaxDataSizeSamples) {
+        return -EINVAL;
+    }
     const webrtc::ProcessingConfig processing_config = {
        {{static_cast<int>(session->apmSamplingRate), session->inChannelCount},
         {static_cast<int>(session->apmSamplingRate), session->outChannelCount},
@@ -1102,7 +1234,7 @@ void Session_GetReverseConfig(preproc_session_t *session, effect_config_t *confi
 {
     memset(config, 0, sizeof(effect_config_t));
     config->inputCfg.samplingRate = config->outputCfg.samplingRate = session->samplingRate;
-    config->inputCfg.format = config->outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    config->inputCfg.format = config->outputCfg.format = session->format;
     config->inputCfg.channels = config->outputCfg.channels =
             audio_channel_in_mask_from_count(session->revChannelCount);
     config->inputCfg.mask = config->outputCfg.mask =
@@ -1144,6 +1276,43 @@ void Session_SetProcEnabled(preproc_session_t *session, uint32_t procId, bool en
     }
 }
 
+void Session_UpdateSettings(preproc_session_t *session)
+{
+    if (session->settingsValid) {
+        return;
+    }
+    preproc_settings_t *settings = &session->settings;
+    memset(settings, 0, sizeof(preproc_settings_t));
+    settings->format = session->format;
+    settings->apmSamplingRate = session->apmSamplingRate;
+    settings->inChannelCount = session->inChannelCount;
+    settings->outChannelCount = session->outChannelCount;
+    settings->revChannelCount = session->revChannelCount;
+    settings->enabledMsk = session->enabledMsk;
+    if (session->enabledMsk & (1 << PREPROC_AGC)) {
+        webrtc::GainControl *agc =
+                static_cast<webrtc::GainControl *>(session->effects[PREPROC_AGC].engine);
+        settings->agcMode = agc->mode();
+        settings->agcTargetLevel = agc->target_level_dbfs();
+        settings->agcCompGain = agc->compression_gain_db();
+        settings->agcLimiterEnabled = agc->is_limiter_enabled();
+    }
+    if (session->enabledMsk & (1 << PREPROC_AEC)) {
+        webrtc::EchoControlMobile *aec =
+                static_cast<webrtc::EchoControlMobile *>(session->effects[PREPROC_AEC].engine);
+        settings->aecRoutingMode = aec->routing_mode();
+        settings->aecComfortNoiseEnabled = aec->is_comfort_noise_enabled();
+        settings->aecStreamDelayMs = session->apm->stream_delay_ms();
+    }
+    if (session->enabledMsk & (1 << PREPROC_NS)) {
+        webrtc::NoiseSuppression *ns =
+                static_cast<webrtc::NoiseSuppression *>(session->effects[PREPROC_NS].engine);
+        settings->nsLevel = ns->level();
+        settings->nsType = session->effects[PREPROC_NS].type;
+    }
+    session->settingsValid = true;
+}
+
 //------------------------------------------------------------------------------
 // Bundle functions
 //------------------------------------------------------------------------------
@@ -1183,6 +1352,9 @@ int PreProc_Init() {
     for (i = 0; i < PREPROC_NUM_SESSIONS && status == 0; i++) {
         status = Session_Init(&sSessions[i]);
     }
+    sSharedAnalysis = property_get_bool(PREPROC_SHARED_ANALYSIS_PROPERTY,
+                                        PREPROC_SHARED_ANALYSIS_DEFAULT);
+    ALOGV_IF(sSharedAnalysis, "PreProc_Init shared analysis enabled");
     sInitStatus = status;
     return sInitStatus;
 }
@@ -1199,195 +1371,435 @@ const effect_descriptor_t *PreProc_GetDescriptor(const effect_uuid_t *uuid)
 }
 
 
-extern "C" {
-
 //------------------------------------------------------------------------------
-// Effect Control Interface Implementation
+// Processing functions
 //------------------------------------------------------------------------------
 
-int PreProcessingFx_Process(effect_handle_t     self,
-                            audio_buffer_t    *inBuffer,
-                            audio_buffer_t    *outBuffer)
+// Returns the buffer holding the APM input and output in the session format.
+template <typename T> T *Session_ProcBuffer(preproc_session_t *session);
+template <> int16_t *Session_ProcBuffer<int16_t>(preproc_session_t *session)
 {
-    preproc_effect_t * effect = (preproc_effect_t *)self;
+    return session->procFrame->data_;
+}
+template <> float *Session_ProcBuffer<float>(preproc_session_t *session)
+{
+    return session->procBuf;
+}
 
-    if (effect == NULL){
-        ALOGV("PreProcessingFx_Process() ERROR effect == NULL");
-        return -EINVAL;
+// Returns the buffer holding the APM reverse input in the session format.
+template <typename T> T *Session_RevBuffer(preproc_session_t *session);
+template <> int16_t *Session_RevBuffer<int16_t>(preproc_session_t *session)
+{
+    return session->revFrame->data_;
+}
+template <> float *Session_RevBuffer<float>(preproc_session_t *session)
+{
+    return session->revProcBuf;
+}
+
+void PreProc_Resample(SpeexResamplerState *resampler, uint32_t channelCount,
+                      const int16_t *in, spx_uint32_t *inFrames,
+                      int16_t *out, spx_uint32_t *outFrames)
+{
+    if (channelCount == 1) {
+        speex_resampler_process_int(resampler, 0, in, inFrames, out, outFrames);
+    } else {
+        speex_resampler_process_interleaved_int(resampler, in, inFrames, out, outFrames);
     }
-    preproc_session_t * session = (preproc_session_t *)effect->session;
+}
 
-    if (inBuffer == NULL  || inBuffer->raw == NULL  ||
-            outBuffer == NULL || outBuffer->raw == NULL){
-        ALOGW("PreProcessingFx_Process() ERROR bad pointer");
-        return -EINVAL;
+void PreProc_Resample(SpeexResamplerState *resampler, uint32_t channelCount,
+                      const float *in, spx_uint32_t *inFrames,
+                      float *out, spx_uint32_t *outFrames)
+{
+    if (channelCount == 1) {
+        speex_resampler_process_float(resampler, 0, in, inFrames, out, outFrames);
+    } else {
+        speex_resampler_process_interleaved_float(resampler, in, inFrames, out, outFrames);
     }
+}
 
-    session->processedMsk |= (1<<effect->procId);
+// Copies interleaved samples to one plane of frameCount samples per channel in planar, and
+// points planes[] to them as expected by the APM float interface.
+void PreProc_Deinterleave(const float *in, float *planar, float **planes,
+                          uint32_t channelCount, size_t frameCount)
+{
+    for (uint32_t ch = 0; ch < channelCount; ch++) {
+        planes[ch] = planar + ch * frameCount;
+        for (size_t i = 0; i < frameCount; i++) {
+            planes[ch][i] = in[i * channelCount + ch];
+        }
+    }
+}
 
-//    ALOGV("PreProcessingFx_Process In %d frames enabledMsk %08x processedMsk %08x",
-//         inBuffer->frameCount, session->enabledMsk, session->processedMsk);
+void PreProc_Interleave(const float * const *planes, float *out,
+                        uint32_t channelCount, size_t frameCount)
+{
+    for (uint32_t ch = 0; ch < channelCount; ch++) {
+        for (size_t i = 0; i < frameCount; i++) {
+            out[i * channelCount + ch] = planes[ch][i];
+        }
+    }
+}
 
-    if ((session->processedMsk & session->enabledMsk) == session->enabledMsk) {
-        effect->session->processedMsk = 0;
-        size_t framesRq = outBuffer->frameCount;
-        size_t framesWr = 0;
-        if (session->framesOut) {
-            size_t fr = session->framesOut;
-            if (outBuffer->frameCount < fr) {
-                fr = outBuffer->frameCount;
-            }
-            memcpy(outBuffer->s16,
-                  session->outBuf,
-                  fr * session->outChannelCount * sizeof(int16_t));
-            memcpy(session->outBuf,
-                  session->outBuf + fr * session->outChannelCount,
-                  (session->framesOut - fr) * session->outChannelCount * sizeof(int16_t));
-            session->framesOut -= fr;
-            framesWr += fr;
+void Session_RunApm(preproc_session_t *session, int16_t *buf __unused)
+{
+    session->procFrame->samples_per_channel_ = session->apmFrameCount;
+    session->apm->ProcessStream(session->procFrame);
+}
+
+void Session_RunApm(preproc_session_t *session, float *buf)
+{
+    float *planes[AUDIO_CHANNEL_COUNT_MAX];
+    const int rate = static_cast<int>(session->apmSamplingRate);
+
+    // output planes beyond the input channel count are written by the APM
+    PreProc_Deinterleave(buf, session->procPlanes, planes,
+                         std::max(session->inChannelCount, session->outChannelCount),
+                         session->apmFrameCount);
+    session->apm->ProcessStream(planes,
+                                webrtc::StreamConfig(rate, session->inChannelCount),
+                                webrtc::StreamConfig(rate, session->outChannelCount),
+                                planes);
+    PreProc_Interleave(planes, buf, session->outChannelCount, session->apmFrameCount);
+}
+
+void Session_RunReverseApm(preproc_session_t *session, int16_t *buf __unused)
+{
+    session->revFrame->samples_per_channel_ = session->apmFrameCount;
+    session->apm->AnalyzeReverseStream(session->revFrame);
+}
+
+void Session_RunReverseApm(preproc_session_t *session, float *buf)
+{
+    float *planes[AUDIO_CHANNEL_COUNT_MAX];
+    const webrtc::StreamConfig config(static_cast<int>(session->apmSamplingRate),
+                                      session->revChannelCount);
+
+    PreProc_Deinterleave(buf, session->revProcPlanes, planes, session->revChannelCount,
+                         session->apmFrameCount);
+    session->apm->ProcessReverseStream(planes, config, config, planes);
+}
+
+// Looks for a session on the same input and with the same settings that processed the block
+// in buf, and whose output for it was not used by this session yet. If there is one, copies
+// its output to buf and returns true. Shared analysis mode only, called with sSharedLock held.
+bool PreProc_UseSharedOutput_l(preproc_session_t *session, void *buf, size_t inSize,
+                               size_t outSize)
+{
+    for (size_t i = 0; i < PREPROC_NUM_SESSIONS; i++) {
+        preproc_session_t *source = &sSessions[i];
+        if (source == session || !source->sharedValid || source->io != session->io ||
+                source->sharedSeq == session->sharedConsumed[i]) {
+            continue;
         }
-        outBuffer->frameCount = framesWr;
-        if (framesWr == framesRq) {
-            inBuffer->frameCount = 0;
-            return 0;
+        if (memcmp(&source->sharedSettings, &session->settings,
+                   sizeof(preproc_settings_t)) != 0 ||
+                memcmp(source->sharedIn, buf, inSize) != 0) {
+            continue;
         }
+        session->sharedConsumed[i] = source->sharedSeq;
+        memcpy(buf, source->sharedOut, outSize);
+        return true;
+    }
+    return false;
+}
 
-        if (session->inResampler != NULL) {
-            size_t fr = session->frameCount - session->framesIn;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            if (session->inBufSize < session->framesIn + fr) {
-                int16_t *buf;
-                session->inBufSize = session->framesIn + fr;
-                buf = (int16_t *)realloc(session->inBuf,
-                                 session->inBufSize * session->inChannelCount * sizeof(int16_t));
-                if (buf == NULL) {
-                    session->framesIn = 0;
-                    free(session->inBuf);
-                    session->inBuf = NULL;
-                    return -ENOMEM;
-                }
-                session->inBuf = buf;
+// Processes one 10 ms block in place. In shared analysis mode, the output of another session
+// for the same block is used instead when available.
+template <typename T>
+void Session_ProcessStream(preproc_session_t *session, T *buf)
+{
+    size_t inSize = session->apmFrameCount * session->inChannelCount * sizeof(T);
+    size_t outSize = session->apmFrameCount * session->outChannelCount * sizeof(T);
+
+    if (sSharedAnalysis) {
+        Session_UpdateSettings(session);
+        pthread_mutex_lock(&sSharedLock);
+        session->sharedValid = false;
+        bool shared = PreProc_UseSharedOutput_l(session, buf, inSize, outSize);
+        if (!shared) {
+            memcpy(session->sharedIn, buf, inSize);
+        }
+        pthread_mutex_unlock(&sSharedLock);
+        if (shared) {
+            session->stats.sharedBlocks++;
+            return;
+        }
+    }
+
+    nsecs_t start = systemTime();
+    Session_RunApm(session, buf);
+    session->stats.processTimeNs += systemTime() - start;
+    session->stats.processedBlocks++;
+
+    if (sSharedAnalysis) {
+        pthread_mutex_lock(&sSharedLock);
+        memcpy(session->sharedOut, buf, outSize);
+        session->sharedSettings = session->settings;
+        session->sharedValid = session->settingsValid;
+        session->sharedSeq++;
+        pthread_mutex_unlock(&sSharedLock);
+    }
+}
+
+// Analyzes one 10 ms block of reverse stream. Also done while the session uses the output of
+// another session, so that its echo canceller is current when it processes again.
+template <typename T>
+void Session_AnalyzeReverseStream(preproc_session_t *session, T *buf)
+{
+    nsecs_t start = systemTime();
+    Session_RunReverseApm(session, buf);
+    session->stats.reverseTimeNs += systemTime() - start;
+    session->stats.reverseBlocks++;
+}
+
+template <typename T>
+int Session_Process(preproc_session_t *session,
+                    audio_buffer_t *inBuffer,
+                    audio_buffer_t *outBuffer)
+{
+    T *procBuf = Session_ProcBuffer<T>(session);
+
+    size_t framesRq = outBuffer->frameCount;
+    size_t framesWr = 0;
+    if (session->framesOut) {
+        size_t fr = session->framesOut;
+        if (outBuffer->frameCount < fr) {
+            fr = outBuffer->frameCount;
+        }
+        memcpy((T *)outBuffer->raw,
+              session->outBuf,
+              fr * session->outChannelCount * sizeof(T));
+        memcpy(session->outBuf,
+              (T *)session->outBuf + fr * session->outChannelCount,
+              (session->framesOut - fr) * session->outChannelCount * sizeof(T));
+        session->framesOut -= fr;
+        framesWr += fr;
+    }
+    outBuffer->frameCount = framesWr;
+    if (framesWr == framesRq) {
+        inBuffer->frameCount = 0;
+        return 0;
+    }
+
+    if (session->inResampler != NULL) {
+        size_t fr = session->frameCount - session->framesIn;
+        if (inBuffer->frameCount < fr) {
+            fr = inBuffer->frameCount;
+        }
+        if (session->inBufSize < session->framesIn + fr) {
+            void *buf;
+            session->inBufSize = session->framesIn + fr;
+            buf = realloc(session->inBuf,
+                             session->inBufSize * session->inChannelCount * sizeof(T));
+            if (buf == NULL) {
+                session->framesIn = 0;
+                free(session->inBuf);
+                session->inBuf = NULL;
+                return -ENOMEM;
             }
-            memcpy(session->inBuf + session->framesIn * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
+            session->inBuf = buf;
+        }
+        memcpy((T *)session->inBuf + session->framesIn * session->inChannelCount,
+               (T *)inBuffer->raw,
+               fr * session->inChannelCount * sizeof(T));
 #ifdef DUAL_MIC_TEST
-            pthread_mutex_lock(&gPcmDumpLock);
-            if (gPcmDumpFh != NULL) {
-                fwrite(inBuffer->raw,
-                       fr * session->inChannelCount * sizeof(int16_t), 1, gPcmDumpFh);
-            }
-            pthread_mutex_unlock(&gPcmDumpLock);
+        pthread_mutex_lock(&gPcmDumpLock);
+        if (gPcmDumpFh != NULL) {
+            fwrite(inBuffer->raw,
+                   fr * session->inChannelCount * sizeof(T), 1, gPcmDumpFh);
+        }
+        pthread_mutex_unlock(&gPcmDumpLock);
 #endif
 
-            session->framesIn += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesIn < session->frameCount) {
-                return 0;
-            }
-            spx_uint32_t frIn = session->framesIn;
-            spx_uint32_t frOut = session->apmFrameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->inResampler,
-                                            0,
-                                            session->inBuf,
-                                            &frIn,
-                                            session->procFrame->data_,
-                                            &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->inResampler,
-                                                        session->inBuf,
-                                                        &frIn,
-                                                        session->procFrame->data_,
-                                                        &frOut);
-            }
-            memcpy(session->inBuf,
-                   session->inBuf + frIn * session->inChannelCount,
-                   (session->framesIn - frIn) * session->inChannelCount * sizeof(int16_t));
-            session->framesIn -= frIn;
-        } else {
-            size_t fr = session->frameCount - session->framesIn;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            memcpy(session->procFrame->data_ + session->framesIn * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
+        session->framesIn += fr;
+        inBuffer->frameCount = fr;
+        if (session->framesIn < session->frameCount) {
+            return 0;
+        }
+        spx_uint32_t frIn = session->framesIn;
+        spx_uint32_t frOut = session->apmFrameCount;
+        PreProc_Resample(session->inResampler, session->inChannelCount,
+                         (T *)session->inBuf, &frIn, procBuf, &frOut);
+        memcpy(session->inBuf,
+               (T *)session->inBuf + frIn * session->inChannelCount,
+               (session->framesIn - frIn) * session->inChannelCount * sizeof(T));
+        session->framesIn -= frIn;
+    } else {
+        size_t fr = session->frameCount - session->framesIn;
+        if (inBuffer->frameCount < fr) {
+            fr = inBuffer->frameCount;
+        }
+        memcpy(procBuf + session->framesIn * session->inChannelCount,
+               (T *)inBuffer->raw,
+               fr * session->inChannelCount * sizeof(T));
 
 #ifdef DUAL_MIC_TEST
-            pthread_mutex_lock(&gPcmDumpLock);
-            if (gPcmDumpFh != NULL) {
-                fwrite(inBuffer->raw,
-                       fr * session->inChannelCount * sizeof(int16_t), 1, gPcmDumpFh);
-            }
-            pthread_mutex_unlock(&gPcmDumpLock);
+        pthread_mutex_lock(&gPcmDumpLock);
+        if (gPcmDumpFh != NULL) {
+            fwrite(inBuffer->raw,
+                   fr * session->inChannelCount * sizeof(T), 1, gPcmDumpFh);
+        }
+        pthread_mutex_unlock(&gPcmDumpLock);
 #endif
 
-            session->framesIn += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesIn < session->frameCount) {
-                return 0;
-            }
-            session->framesIn = 0;
+        session->framesIn += fr;
+        inBuffer->frameCount = fr;
+        if (session->framesIn < session->frameCount) {
+            return 0;
         }
-        session->procFrame->samples_per_channel_ = session->apmFrameCount;
+        session->framesIn = 0;
+    }
+    Session_ProcessStream(session, procBuf);
+
+    if (session->outBufSize < session->framesOut + session->frameCount) {
+        void *buf;
+        session->outBufSize = session->framesOut + session->frameCount;
+        buf = realloc(session->outBuf,
+                         session->outBufSize * session->outChannelCount * sizeof(T));
+        if (buf == NULL) {
+            session->framesOut = 0;
+            free(session->outBuf);
+            session->outBuf = NULL;
+            return -ENOMEM;
+        }
+        session->outBuf = buf;
+    }
+
+    if (session->outResampler != NULL) {
+        spx_uint32_t frIn = session->apmFrameCount;
+        spx_uint32_t frOut = session->frameCount;
+        PreProc_Resample(session->outResampler, session->inChannelCount,
+                         procBuf, &frIn,
+                         (T *)session->outBuf + session->framesOut * session->outChannelCount,
+                         &frOut);
+        session->framesOut += frOut;
+    } else {
+        memcpy((T *)session->outBuf + session->framesOut * session->outChannelCount,
+               procBuf,
+               session->frameCount * session->outChannelCount * sizeof(T));
+        session->framesOut += session->frameCount;
+    }
+    size_t fr = session->framesOut;
+    if (framesRq - framesWr < fr) {
+        fr = framesRq - framesWr;
+    }
+    memcpy((T *)outBuffer->raw + framesWr * session->outChannelCount,
+          session->outBuf,
+          fr * session->outChannelCount * sizeof(T));
+    memcpy(session->outBuf,
+          (T *)session->outBuf + fr * session->outChannelCount,
+          (session->framesOut - fr) * session->outChannelCount * sizeof(T));
+    session->framesOut -= fr;
+    outBuffer->frameCount += fr;
 
-        effect->session->apm->ProcessStream(session->procFrame);
+    return 0;
+}
 
-        if (session->outBufSize < session->framesOut + session->frameCount) {
-            int16_t *buf;
-            session->outBufSize = session->framesOut + session->frameCount;
-            buf = (int16_t *)realloc(session->outBuf,
-                             session->outBufSize * session->outChannelCount * sizeof(int16_t));
+template <typename T>
+int Session_ProcessReverse(preproc_session_t *session, audio_buffer_t *inBuffer)
+{
+    T *revApmBuf = Session_RevBuffer<T>(session);
+
+    if (session->revResampler != NULL) {
+        size_t fr = session->frameCount - session->framesRev;
+        if (inBuffer->frameCount < fr) {
+            fr = inBuffer->frameCount;
+        }
+        if (session->revBufSize < session->framesRev + fr) {
+            void *buf;
+            session->revBufSize = session->framesRev + fr;
+            buf = realloc(session->revBuf,
+                             session->revBufSize * session->inChannelCount * sizeof(T));
             if (buf == NULL) {
-                session->framesOut = 0;
-                free(session->outBuf);
-                session->outBuf = NULL;
+                session->framesRev = 0;
+                free(session->revBuf);
+                session->revBuf = NULL;
                 return -ENOMEM;
             }
-            session->outBuf = buf;
+            session->revBuf = buf;
         }
+        memcpy((T *)session->revBuf + session->framesRev * session->inChannelCount,
+               (T *)inBuffer->raw,
+               fr * session->inChannelCount * sizeof(T));
 
-        if (session->outResampler != NULL) {
-            spx_uint32_t frIn = session->apmFrameCount;
-            spx_uint32_t frOut = session->frameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->outResampler,
-                                    0,
-                                    session->procFrame->data_,
-                                    &frIn,
-                                    session->outBuf + session->framesOut * session->outChannelCount,
-                                    &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->outResampler,
-                                    session->procFrame->data_,
-                                    &frIn,
-                                    session->outBuf + session->framesOut * session->outChannelCount,
-                                    &frOut);
-            }
-            session->framesOut += frOut;
-        } else {
-            memcpy(session->outBuf + session->framesOut * session->outChannelCount,
-                   session->procFrame->data_,
-                   session->frameCount * session->outChannelCount * sizeof(int16_t));
-            session->framesOut += session->frameCount;
+        session->framesRev += fr;
+        inBuffer->frameCount = fr;
+        if (session->framesRev < session->frameCount) {
+            return 0;
         }
-        size_t fr = session->framesOut;
-        if (framesRq - framesWr < fr) {
-            fr = framesRq - framesWr;
+        spx_uint32_t frIn = session->framesRev;
+        spx_uint32_t frOut = session->apmFrameCount;
+        PreProc_Resample(session->revResampler, session->inChannelCount,
+                         (T *)session->revBuf, &frIn, revApmBuf, &frOut);
+        memcpy(session->revBuf,
+               (T *)session->revBuf + frIn * session->inChannelCount,
+               (session->framesRev - frIn) * session->inChannelCount * sizeof(T));
+        session->framesRev -= frIn;
+    } else {
+        size_t fr = session->frameCount - session->framesRev;
+        if (inBuffer->frameCount < fr) {
+            fr = inBuffer->frameCount;
         }
-        memcpy(outBuffer->s16 + framesWr * session->outChannelCount,
-              session->outBuf,
-              fr * session->outChannelCount * sizeof(int16_t));
-        memcpy(session->outBuf,
-              session->outBuf + fr * session->outChannelCount,
-              (session->framesOut - fr) * session->outChannelCount * sizeof(int16_t));
-        session->framesOut -= fr;
-        outBuffer->frameCount += fr;
+        memcpy(revApmBuf + session->framesRev * session->inChannelCount,
+               (T *)inBuffer->raw,
+               fr * session->inChannelCount * sizeof(T));
+        session->framesRev += fr;
+        inBuffer->frameCount = fr;
+        if (session->framesRev < session->frameCount) {
+            return 0;
+        }
+        session->framesRev = 0;
+    }
+    Session_AnalyzeReverseStream(session, revApmBuf);
+    return 0;
+}
 
-        return 0;
+int Session_ProcessReverse(preproc_session_t *session, audio_buffer_t *inBuffer)
+{
+    if (session->format == AUDIO_FORMAT_PCM_FLOAT) {
+        return Session_ProcessReverse<float>(session, inBuffer);
+    }
+    return Session_ProcessReverse<int16_t>(session, inBuffer);
+}
+
+
+extern "C" {
+
+//------------------------------------------------------------------------------
+// Effect Control Interface Implementation
+//------------------------------------------------------------------------------
+
+int PreProcessingFx_Process(effect_handle_t     self,
+                            audio_buffer_t    *inBuffer,
+                            audio_buffer_t    *outBuffer)
+{
+    preproc_effect_t * effect = (preproc_effect_t *)self;
+
+    if (effect == NULL){
+        ALOGV("PreProcessingFx_Process() ERROR effect == NULL");
+        return -EINVAL;
+    }
+    preproc_session_t * session = (preproc_session_t *)effect->session;
+
+    if (inBuffer == NULL  || inBuffer->raw == NULL  ||
+            outBuffer == NULL || outBuffer->raw == NULL){
+        ALOGW("PreProcessingFx_Process() ERROR bad pointer");
+        return -EINVAL;
+    }
+
+    session->processedMsk |= (1<<effect->procId);
+
+//    ALOGV("PreProcessingFx_Process In %d frames enabledMsk %08x processedMsk %08x",
+//         inBuffer->frameCount, session->enabledMsk, session->processedMsk);
+
+    if ((session->processedMsk & session->enabledMsk) == session->enabledMsk) {
+        effect->session->processedMsk = 0;
+        if (session->format == AUDIO_FORMAT_PCM_FLOAT) {
+            return Session_Process<float>(session, inBuffer, outBuffer);
+        }
+        return Session_Process<int16_t>(session, inBuffer, outBuffer);
     } else {
         return -ENODATA;
     }
@@ -1408,6 +1820,9 @@ int PreProcessingFx_Command(effect_handle_t  self,
 
     //ALOGV("PreProcessingFx_Command: command %d cmdSize %d",cmdCode, cmdSize);
 
+    // settings compared in shared analysis mode are refreshed at next process call
+    Session_InvalidateShared(effect->session);
+
     switch (cmdCode){
         case EFFECT_CMD_INIT:
             if (pReplyData == NULL || *replySize != sizeof(int)){
@@ -1575,6 +1990,16 @@ int PreProcessingFx_Command(effect_handle_t  self,
         case EFFECT_CMD_SET_AUDIO_MODE:
             break;
 
+        case PREPROC_CMD_GET_PROCESS_STATS:
+            if (pReplyData == NULL || replySize == NULL ||
+                    *replySize != sizeof(preproc_process_stats_t)) {
+                ALOGV("PreProcessingFx_Command cmdCode Case: "
+                        "PREPROC_CMD_GET_PROCESS_STATS: ERROR");
+                return -EINVAL;
+            }
+            memcpy(pReplyData, &effect->session->stats, sizeof(preproc_process_stats_t));
+            break;
+
 #ifdef DUAL_MIC_TEST
         ///// test commands start
         case PREPROC_CMD_DUAL_MIC_ENABLE: {
@@ -1794,71 +2219,7 @@ int PreProcessingFx_ProcessReverse(effect_handle_t     self,
 
     if ((session->revProcessedMsk & session->revEnabledMsk) == session->revEnabledMsk) {
         effect->session->revProcessedMsk = 0;
-        if (session->revResampler != NULL) {
-            size_t fr = session->frameCount - session->framesRev;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            if (session->revBufSize < session->framesRev + fr) {
-                int16_t *buf;
-                session->revBufSize = session->framesRev + fr;
-                buf = (int16_t *)realloc(session->revBuf,
-                                 session->revBufSize * session->inChannelCount * sizeof(int16_t));
-                if (buf == NULL) {
-                    session->framesRev = 0;
-                    free(session->revBuf);
-                    session->revBuf = NULL;
-                    return -ENOMEM;
-                }
-                session->revBuf = buf;
-            }
-            memcpy(session->revBuf + session->framesRev * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-
-            session->framesRev += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesRev < session->frameCount) {
-                return 0;
-            }
-            spx_uint32_t frIn = session->framesRev;
-            spx_uint32_t frOut = session->apmFrameCount;
-            if (session->inChannelCount == 1) {
-                speex_resampler_process_int(session->revResampler,
-                                            0,
-                                            session->revBuf,
-                                            &frIn,
-                                            session->revFrame->data_,
-                                            &frOut);
-            } else {
-                speex_resampler_process_interleaved_int(session->revResampler,
-                                                        session->revBuf,
-                                                        &frIn,
-                                                        session->revFrame->data_,
-                                                        &frOut);
-            }
-            memcpy(session->revBuf,
-                   session->revBuf + frIn * session->inChannelCount,
-                   (session->framesRev - frIn) * session->inChannelCount * sizeof(int16_t));
-            session->framesRev -= frIn;
-        } else {
-            size_t fr = session->frameCount - session->framesRev;
-            if (inBuffer->frameCount < fr) {
-                fr = inBuffer->frameCount;
-            }
-            memcpy(session->revFrame->data_ + session->framesRev * session->inChannelCount,
-                   inBuffer->s16,
-                   fr * session->inChannelCount * sizeof(int16_t));
-            session->framesRev += fr;
-            inBuffer->frameCount = fr;
-            if (session->framesRev < session->frameCount) {
-                return 0;
-            }
-            session->framesRev = 0;
-        }
-        session->revFrame->samples_per_channel_ = session->apmFrameCount;
-        effect->session->apm->AnalyzeReverseStream(session->revFrame);
-        return 0;
+        return Session_ProcessReverse(session, inBuffer);
     } else {
         return -ENODATA;
     }
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PREPROCESSING_H_
+#define ANDROID_PREPROCESSING_H_
+
+#include <stdint.h>
+#include <hardware/audio_effect.h>
+
+// Vendor command returning the processing statistics of the session the effect belongs to,
+// in a preproc_process_stats_t. All pre processors of a session share one webRTC APM, so
+// their statistics are the same. The command has no argument.
+#define PREPROC_CMD_GET_PROCESS_STATS  (EFFECT_CMD_FIRST_PROPRIETARY + 0x100)
+
+// When this property is true, sessions attached to the same input stream with the same
+// configuration and settings run the APM once per 10 ms block: a session receiving the same
+// input as a block just processed by another session reuses its output.
+#define PREPROC_SHARED_ANALYSIS_PROPERTY "vendor.audio.preproc.shared_analysis"
+
+typedef struct preproc_process_stats_s {
+    int64_t processTimeNs;      // time spent in the APM processing the capture stream
+    int64_t reverseTimeNs;      // time spent in the APM analyzing the reverse stream
+    uint32_t processedBlocks;   // 10 ms blocks of capture stream processed by the APM
+    uint32_t sharedBlocks;      // 10 ms blocks of capture stream reusing another session's output
+    uint32_t reverseBlocks;     // 10 ms blocks of reverse stream analyzed by the APM
+} preproc_process_stats_t;
+
+#endif /*ANDROID_PREPROCESSING_H_*/
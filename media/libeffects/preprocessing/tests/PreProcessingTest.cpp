@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include <audio_utils/primitives.h>
+#include <gtest/gtest.h>
+#include <hardware/audio_effect.h>
+
+#include "PreProcessing.h"
+
+extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+namespace {
+
+const effect_uuid_t kAecUuid =
+        { 0xbb392ec0, 0x8d4d, 0x11e0, 0xa896, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } };
+const effect_uuid_t kNsUuid =
+        { 0xc06c8400, 0x8e06, 0x11e0, 0x9cb6, { 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b } };
+
+constexpr uint32_t kSampleRate = 16000;
+constexpr size_t kBlockFrames = kSampleRate / 100;  // one APM block, so no resampling
+constexpr size_t kNumBlocks = 200;
+
+// Tone in noise, the same for every run.
+std::vector<float> makeInput(size_t frames) {
+    std::vector<float> input(frames);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1664525 + 1013904223;
+        const float noise = (int32_t)seed / 2147483648.f;
+        input[i] = 0.25f * sinf(2 * M_PI * 440 * i / kSampleRate) + 0.05f * noise;
+    }
+    return input;
+}
+
+int sendCommand(effect_handle_t handle, uint32_t cmdCode, uint32_t cmdSize = 0,
+                void *cmdData = nullptr) {
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    int status = (*handle)->command(handle, cmdCode, cmdSize, cmdData, &replySize, &reply);
+    return status != 0 ? status : reply;
+}
+
+// Creates and enables a pre processor on a mono input at kSampleRate.
+effect_handle_t createEffect(const effect_uuid_t &uuid, int32_t sessionId, int32_t ioId,
+                             audio_format_t format) {
+    effect_handle_t handle = nullptr;
+    if (AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(&uuid, sessionId, ioId, &handle) != 0) {
+        return nullptr;
+    }
+    effect_config_t config = {};
+    config.inputCfg.samplingRate = config.outputCfg.samplingRate = kSampleRate;
+    config.inputCfg.channels = config.outputCfg.channels = AUDIO_CHANNEL_IN_MONO;
+    config.inputCfg.format = config.outputCfg.format = format;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    config.inputCfg.mask = config.outputCfg.mask = EFFECT_CONFIG_ALL;
+    if (sendCommand(handle, EFFECT_CMD_INIT) != 0 ||
+            sendCommand(handle, EFFECT_CMD_SET_CONFIG, sizeof(config), &config) != 0 ||
+            sendCommand(handle, EFFECT_CMD_ENABLE) != 0) {
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(handle);
+        return nullptr;
+    }
+    return handle;
+}
+
+preproc_process_stats_t getStats(effect_handle_t handle) {
+    preproc_process_stats_t stats = {};
+    uint32_t replySize = sizeof(stats);
+    EXPECT_EQ(0, (*handle)->command(handle, PREPROC_CMD_GET_PROCESS_STATS, 0, nullptr,
+                                    &replySize, &stats));
+    return stats;
+}
+
+template <typename T>
+int processBlock(effect_handle_t handle, const T *in, T *out) {
+    audio_buffer_t inBuffer;
+    inBuffer.frameCount = kBlockFrames;
+    inBuffer.raw = (void *)in;
+    audio_buffer_t outBuffer;
+    outBuffer.frameCount = kBlockFrames;
+    outBuffer.raw = out;
+    int status = (*handle)->process(handle, &inBuffer, &outBuffer);
+    return status != 0 ? status : (outBuffer.frameCount == kBlockFrames ? 0 : -ENODATA);
+}
+
+template <typename T>
+int processReverseBlock(effect_handle_t handle, const T *in) {
+    audio_buffer_t inBuffer;
+    inBuffer.frameCount = kBlockFrames;
+    inBuffer.raw = (void *)in;
+    audio_buffer_t outBuffer = inBuffer;
+    return (*handle)->process_reverse(handle, &inBuffer, &outBuffer);
+}
+
+// The float path must give the int16 result up to the quantization of input and output.
+TEST(PreProcessingTest, FloatMatchesInt16) {
+    const std::vector<float> input = makeInput(kBlockFrames * kNumBlocks);
+    std::vector<int16_t> input16(input.size());
+    memcpy_to_i16_from_float(input16.data(), input.data(), input.size());
+
+    effect_handle_t ns16 = createEffect(kNsUuid, 1 /* sessionId */, 1 /* ioId */,
+                                        AUDIO_FORMAT_PCM_16_BIT);
+    effect_handle_t nsFloat = createEffect(kNsUuid, 2 /* sessionId */, 2 /* ioId */,
+                                           AUDIO_FORMAT_PCM_FLOAT);
+    ASSERT_NE(nullptr, ns16);
+    ASSERT_NE(nullptr, nsFloat);
+
+    std::vector<int16_t> output16(input.size());
+    std::vector<float> outputFloat(input.size());
+    for (size_t i = 0; i < input.size(); i += kBlockFrames) {
+        ASSERT_EQ(0, processBlock(ns16, &input16[i], &output16[i]));
+        ASSERT_EQ(0, processBlock(nsFloat, &input[i], &outputFloat[i]));
+    }
+    std::vector<float> output16AsFloat(input.size());
+    memcpy_to_float_from_i16(output16AsFloat.data(), output16.data(), input.size());
+
+    double signal = 0;
+    double error = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+        signal += output16AsFloat[i] * output16AsFloat[i];
+        error += (outputFloat[i] - output16AsFloat[i]) * (outputFloat[i] - output16AsFloat[i]);
+    }
+    ASSERT_GT(signal, 0.);
+    EXPECT_GT(10 * log10(signal / (error + 1e-20)), 30.)
+            << "float output differs from int16 output";
+
+    EXPECT_EQ(kNumBlocks, getStats(nsFloat).processedBlocks);
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(ns16);
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(nsFloat);
+}
+
+// Two sessions on the same input with the same settings: the second one uses the output of
+// the first for every block, and keeps analyzing the reverse stream.
+TEST(PreProcessingTest, SameInputSessionsShareBlocks) {
+    const std::vector<float> input = makeInput(kBlockFrames * kNumBlocks);
+    std::vector<int16_t> input16(input.size());
+    memcpy_to_i16_from_float(input16.data(), input.data(), input.size());
+    const std::vector<int16_t> reverse(kBlockFrames, 0);
+
+    effect_handle_t effects[2][2];
+    for (int s = 0; s < 2; s++) {
+        effects[s][0] = createEffect(kNsUuid, 10 + s /* sessionId */, 10 /* ioId */,
+                                     AUDIO_FORMAT_PCM_16_BIT);
+        effects[s][1] = createEffect(kAecUuid, 10 + s /* sessionId */, 10 /* ioId */,
+                                     AUDIO_FORMAT_PCM_16_BIT);
+        ASSERT_NE(nullptr, effects[s][0]);
+        ASSERT_NE(nullptr, effects[s][1]);
+    }
+
+    std::vector<int16_t> output[2];
+    for (int s = 0; s < 2; s++) {
+        output[s].resize(input.size());
+    }
+    for (size_t i = 0; i < input.size(); i += kBlockFrames) {
+        for (int s = 0; s < 2; s++) {
+            // only the echo canceller has a reverse stream
+            ASSERT_EQ(0, processReverseBlock(effects[s][1], reverse.data()));
+            // the session processes the block when all of its enabled effects were called
+            ASSERT_EQ(-ENODATA, processBlock(effects[s][0], &input16[i], &output[s][i]));
+            ASSERT_EQ(0, processBlock(effects[s][1], &input16[i], &output[s][i]));
+        }
+    }
+    EXPECT_EQ(0, memcmp(output[0].data(), output[1].data(), input.size() * sizeof(int16_t)));
+
+    const preproc_process_stats_t source = getStats(effects[0][0]);
+    const preproc_process_stats_t follower = getStats(effects[1][0]);
+    EXPECT_EQ(kNumBlocks, source.processedBlocks);
+    EXPECT_EQ(0u, source.sharedBlocks);
+    EXPECT_EQ(0u, follower.processedBlocks);
+    EXPECT_EQ(kNumBlocks, follower.sharedBlocks);
+    EXPECT_EQ(kNumBlocks, source.reverseBlocks);
+    EXPECT_EQ(kNumBlocks, follower.reverseBlocks);
+
+    for (int s = 0; s < 2; s++) {
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effects[s][0]);
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effects[s][1]);
+    }
+}
+
+}  // namespace
@@ -25,13 +25,16 @@
 #include <time.h>
 
 #include <algorithm> // max
+#include <complex>
 #include <new>
+#include <vector>
 
 #include <log/log.h>
 
-#include <audio_effects/effect_visualizer.h>
 #include <audio_utils/primitives.h>
 
+#include "EffectVisualizer.h"
+
 #ifdef BUILD_FLOAT
 
 static constexpr audio_format_t kProcessFormat = AUDIO_FORMAT_PCM_FLOAT;
@@ -78,6 +81,14 @@ enum visualizer_state_e {
 // maximum number of buffers for which we keep track of the measurements
 #define MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS 25 // note: buffer index is stored in uint8_t
 
+#ifdef BUILD_FLOAT
+// frames downmixed at a time by Visualizer_process(), in a buffer on the stack
+static constexpr size_t kChunkFrames = 256;
+
+// independent accumulators of the measurement kernels, so that they are vectorized
+static constexpr size_t kLanes = 8;
+#endif // BUILD_FLOAT
+
 
 struct BufferStats {
     bool mIsValid;
@@ -102,6 +113,13 @@ struct VisualizerContext {
     uint8_t mMeasurementWindowSizeInBuffers;
     uint8_t mMeasurementBufferIdx;
     BufferStats mPastMeasurements[MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS];
+    // for VISUALIZER_CMD_MEASURE_FFT, only accessed by the command thread
+    std::vector<float> mFftWindow; // Hann window of the current FFT size
+    std::vector<std::complex<float>> mFftTwiddles; // exp(-2 pi i k / size), k < size / 2
+    std::vector<uint32_t> mFftBitReversal;
+    std::vector<std::complex<float>> mFftBuf;
+    std::vector<uint8_t> mFftCapture; // waveform of the last magnitudes computed
+    std::vector<int16_t> mFftMagnitudes;
 };
 
 //
@@ -166,6 +184,7 @@ int Visualizer_setConfig(VisualizerContext *pContext, effect_config_t *pConfig)
     if (pConfig->inputCfg.format != kProcessFormat) return -EINVAL;
 
     pContext->mConfig = *pConfig;
+    pContext->mChannelCount = channelCount;
 
     Visualizer_reset(pContext);
 
@@ -245,6 +264,178 @@ int Visualizer_init(VisualizerContext *pContext)
     return 0;
 }
 
+//----------------------------------------------------------------------------
+// Visualizer_capture()
+//----------------------------------------------------------------------------
+// Purpose: Get the captureSize last samples of the capture buffer, as played considering the
+//  latency, or silence if the effect is not active or playback has stopped.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  captureSize: number of samples to return
+//
+// Outputs:
+//  pCapture:   8 bit unsigned samples
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_capture(VisualizerContext *pContext, uint8_t *pCapture, uint32_t captureSize)
+{
+    if (pContext->mState == VISUALIZER_STATE_ACTIVE) {
+        const uint32_t deltaMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
+
+        // if audio framework has stopped playing audio although the effect is still
+        // active we must clear the capture buffer to return silence
+        if ((pContext->mLastCaptureIdx == pContext->mCaptureIdx) &&
+                (pContext->mBufferUpdateTime.tv_sec != 0) &&
+                (deltaMs > MAX_STALL_TIME_MS)) {
+                ALOGV("capture going to idle");
+                pContext->mBufferUpdateTime.tv_sec = 0;
+                memset(pCapture, 0x80, captureSize);
+        } else {
+            int32_t latencyMs = pContext->mLatency;
+            latencyMs -= deltaMs;
+            if (latencyMs < 0) {
+                latencyMs = 0;
+            }
+            uint32_t deltaSmpl = captureSize
+                    + pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
+
+            // large sample rate, latency, or capture size, could cause overflow.
+            // do not offset more than the size of buffer.
+            if (deltaSmpl > CAPTURE_BUF_SIZE) {
+                android_errorWriteLog(0x534e4554, "31781965");
+                deltaSmpl = CAPTURE_BUF_SIZE;
+            }
+
+            int32_t capturePoint;
+            //capturePoint = (int32_t)pContext->mCaptureIdx - deltaSmpl;
+            __builtin_sub_overflow((int32_t)pContext->mCaptureIdx, deltaSmpl, &capturePoint);
+            // a negative capturePoint means we wrap the buffer.
+            if (capturePoint < 0) {
+                uint32_t size = -capturePoint;
+                if (size > captureSize) {
+                    size = captureSize;
+                }
+                memcpy(pCapture,
+                       pContext->mCaptureBuf + CAPTURE_BUF_SIZE + capturePoint,
+                       size);
+                pCapture += size;
+                captureSize -= size;
+                capturePoint = 0;
+            }
+            memcpy(pCapture,
+                   pContext->mCaptureBuf + capturePoint,
+                   captureSize);
+        }
+
+        pContext->mLastCaptureIdx = pContext->mCaptureIdx;
+    } else {
+        memset(pCapture, 0x80, captureSize);
+    }
+}
+
+// Allocates the window and tables of the FFT when its size changes.
+static void Visualizer_setFftSize(VisualizerContext *pContext, uint32_t size)
+{
+    if (pContext->mFftWindow.size() == size) {
+        return;
+    }
+    ALOGV("Visualizer_setFftSize %" PRIu32, size);
+    pContext->mFftWindow.resize(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        pContext->mFftWindow[i] = 0.5 - 0.5 * cos(2 * M_PI * i / size);
+    }
+    pContext->mFftTwiddles.resize(size / 2);
+    for (uint32_t k = 0; k < size / 2; ++k) {
+        pContext->mFftTwiddles[k] = std::polar(1.0, -2 * M_PI * k / size);
+    }
+    pContext->mFftBitReversal.resize(size);
+    for (uint32_t i = 0, j = 0; i < size; ++i) {
+        pContext->mFftBitReversal[i] = j;
+        // increment j from its most significant bit
+        uint32_t bit = size / 2;
+        for (; bit != 0 && (j & bit) != 0; bit /= 2) {
+            j ^= bit;
+        }
+        j |= bit;
+    }
+    pContext->mFftBuf.resize(size);
+    pContext->mFftCapture.clear(); // force the computation of the magnitudes
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_measureFft()
+//----------------------------------------------------------------------------
+// Purpose: Compute the magnitude spectrum of the waveform returned by Visualizer_capture().
+//  The magnitudes are kept with the waveform, so that requests made before new audio is
+//  captured, by the same or other clients, do not transform it again.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  captureSize: size of the waveform, a power of 2
+//
+// Outputs:
+//  pMagnitudes: VISUALIZER_FFT_BIN_COUNT(captureSize) magnitudes in mB re full scale sine
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_measureFft(VisualizerContext *pContext, int16_t *pMagnitudes,
+        uint32_t captureSize)
+{
+    uint8_t capture[VISUALIZER_CAPTURE_SIZE_MAX];
+    Visualizer_capture(pContext, capture, captureSize);
+
+    const uint32_t binCount = VISUALIZER_FFT_BIN_COUNT(captureSize);
+    Visualizer_setFftSize(pContext, captureSize);
+    if (pContext->mFftCapture.size() == captureSize &&
+            memcmp(pContext->mFftCapture.data(), capture, captureSize) == 0) {
+        memcpy(pMagnitudes, pContext->mFftMagnitudes.data(), binCount * sizeof(int16_t));
+        return;
+    }
+
+    // windowed samples in bit reversed order, for an in place radix 2 decimation in time
+    std::complex<float> *__restrict x = pContext->mFftBuf.data();
+    const float *window = pContext->mFftWindow.data();
+    const uint32_t *bitReversal = pContext->mFftBitReversal.data();
+    const std::complex<float> *twiddles = pContext->mFftTwiddles.data();
+    for (uint32_t i = 0; i < captureSize; ++i) {
+        x[bitReversal[i]] = window[i] * ((capture[i] - 128) / 128.f);
+    }
+    for (uint32_t half = 1; half < captureSize; half *= 2) {
+        const uint32_t stride = captureSize / (2 * half);
+        for (uint32_t start = 0; start < captureSize; start += 2 * half) {
+            std::complex<float> *a = x + start;
+            std::complex<float> *b = x + start + half;
+            for (uint32_t k = 0; k < half; ++k) {
+                // written out, as the complex operator would handle infinities and NaNs
+                const std::complex<float> w = twiddles[k * stride];
+                const std::complex<float> t(w.real() * b[k].real() - w.imag() * b[k].imag(),
+                        w.real() * b[k].imag() + w.imag() * b[k].real());
+                b[k] = a[k] - t;
+                a[k] += t;
+            }
+        }
+    }
+
+    // a full scale sine at the center of a bin has a magnitude of captureSize / 4 with the
+    // Hann window
+    const float fullScale = captureSize / 4.f;
+    const float invFullScaleSquared = 1.f / (fullScale * fullScale);
+    pContext->mFftMagnitudes.resize(binCount);
+    for (uint32_t k = 0; k < binCount; ++k) {
+        const float power = std::norm(x[k]) * invFullScaleSquared;
+        int32_t mB = -9600; // -96dB
+        if (power > 2.5e-10f) {
+            mB = (int32_t) (1000 * log10(power));
+            mB = std::min(std::max(mB, -9600), (int32_t) INT16_MAX);
+        }
+        pContext->mFftMagnitudes[k] = mB;
+    }
+    pContext->mFftCapture.assign(capture, capture + captureSize);
+    memcpy(pMagnitudes, pContext->mFftMagnitudes.data(), binCount * sizeof(int16_t));
+}
+
 //
 //--- Effect Library Interface Implementation
 //
@@ -314,6 +505,99 @@ int VisualizerLib_GetDescriptor(const effect_uuid_t *uuid,
     return  -EINVAL;
 } /* end VisualizerLib_GetDescriptor */
 
+#ifdef BUILD_FLOAT
+//
+//--- Capture and measurement kernels
+//
+// The loops below have no dependency between iterations, or one per lane, so that the compiler
+// vectorizes them. std::max() rather than fmax() keeps them free of library calls; both ignore
+// NaN samples.
+
+// Sums the channels of each frame, in channel order as the capture always did.
+static void Visualizer_downmix(float *__restrict mono, const float *__restrict in,
+        size_t frameCount, uint32_t channelCount) {
+    switch (channelCount) {
+    case 1:
+        memcpy(mono, in, frameCount * sizeof(float));
+        break;
+    case 2:
+        for (size_t i = 0; i < frameCount; ++i) {
+            mono[i] = in[2 * i] + in[2 * i + 1];
+        }
+        break;
+    default:
+        for (size_t i = 0; i < frameCount; ++i) {
+            float smp = 0.f;
+            for (uint32_t c = 0; c < channelCount; ++c) {
+                smp += in[i * channelCount + c];
+            }
+            mono[i] = smp;
+        }
+        break;
+    }
+}
+
+static float Visualizer_maxAbs(const float *in, size_t sampleCount) {
+    float peaks[kLanes] = {};
+    size_t i = 0;
+    for (; i + kLanes <= sampleCount; i += kLanes) {
+        for (size_t j = 0; j < kLanes; ++j) {
+            peaks[j] = std::max(peaks[j], fabsf(in[i + j]));
+        }
+    }
+    for (; i < sampleCount; ++i) {
+        peaks[0] = std::max(peaks[0], fabsf(in[i]));
+    }
+    float peak = 0.f;
+    for (size_t j = 0; j < kLanes; ++j) {
+        peak = std::max(peak, peaks[j]);
+    }
+    return peak;
+}
+
+// Peak absolute value and sum of the squares of the samples.
+static void Visualizer_measurePeakRms(const float *in, size_t sampleCount,
+        float *peak, float *sumSquares) {
+    float peaks[kLanes] = {};
+    float sums[kLanes] = {};
+    size_t i = 0;
+    for (; i + kLanes <= sampleCount; i += kLanes) {
+        for (size_t j = 0; j < kLanes; ++j) {
+            peaks[j] = std::max(peaks[j], fabsf(in[i + j]));
+            sums[j] += in[i + j] * in[i + j];
+        }
+    }
+    for (; i < sampleCount; ++i) {
+        peaks[0] = std::max(peaks[0], fabsf(in[i]));
+        sums[0] += in[i] * in[i];
+    }
+    *peak = 0.f;
+    *sumSquares = 0.f;
+    for (size_t j = 0; j < kLanes; ++j) {
+        *peak = std::max(*peak, peaks[j]);
+        *sumSquares += sums[j];
+    }
+}
+
+// Writes the scaled 8 bit capture of frameCount mono samples at captIdx, in at most two
+// contiguous runs of the capture buffer, and returns the index following the last one written.
+static uint32_t Visualizer_captureMono(uint8_t *buf, uint32_t captIdx,
+        const float *mono, size_t frameCount, float scale) {
+    while (frameCount > 0) {
+        if (captIdx >= CAPTURE_BUF_SIZE) captIdx = 0; // wrap
+        const size_t count = std::min(frameCount, size_t(CAPTURE_BUF_SIZE - captIdx));
+        uint8_t *__restrict out = buf + captIdx;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = clamp8_from_float(mono[i] * scale);
+        }
+        mono += count;
+        frameCount -= count;
+        captIdx += count;
+    }
+    return captIdx;
+}
+#endif // BUILD_FLOAT
+
 //
 //--- Effect Control Interface Implementation
 //
@@ -343,10 +627,7 @@ int Visualizer_process(
 
 #ifdef BUILD_FLOAT
         float maxSample = 0.f;
-        for (size_t inIdx = 0; inIdx < sampleLen; ++inIdx) {
-            maxSample = fmax(maxSample, fabs(inBuffer->f32[inIdx]));
-            rmsSqAcc += inBuffer->f32[inIdx] * inBuffer->f32[inIdx];
-        }
+        Visualizer_measurePeakRms(inBuffer->f32, sampleLen, &maxSample, &rmsSqAcc);
         maxSample *= 1 << 15; // scale to int16_t, with exactly 1 << 15 representing positive num.
         rmsSqAcc *= 1 << 30; // scale to int16_t * 2
 #else
@@ -368,6 +649,11 @@ int Visualizer_process(
 
 #ifdef BUILD_FLOAT
     float fscale; // multiplicative scale
+    // the channels summed together, a chunk at a time
+    float mono[kChunkFrames];
+    const size_t frameCount = inBuffer->frameCount;
+    const uint32_t channelCount = pContext->mChannelCount;
+    bool monoIsCurrent = false; // whether mono holds the only chunk of the buffer
 #else
     int32_t shift;
 #endif // BUILD_FLOAT
@@ -378,15 +664,15 @@ int Visualizer_process(
 
 #ifdef BUILD_FLOAT
         float maxSample = 0.f;
-        for (size_t inIdx = 0; inIdx < sampleLen; ) {
+        for (size_t frame = 0; frame < frameCount; frame += kChunkFrames) {
+            const size_t chunkFrames = std::min(frameCount - frame, kChunkFrames);
             // we reconstruct the actual summed value to ensure proper normalization
             // for multichannel outputs (channels > 2 may often be 0).
-            float smp = 0.f;
-            for (int i = 0; i < pContext->mChannelCount; ++i) {
-                smp += inBuffer->f32[inIdx++];
-            }
-            maxSample = fmax(maxSample, fabs(smp));
+            Visualizer_downmix(mono, inBuffer->f32 + frame * channelCount, chunkFrames,
+                    channelCount);
+            maxSample = std::max(maxSample, Visualizer_maxAbs(mono, chunkFrames));
         }
+        monoIsCurrent = frameCount <= kChunkFrames;
         if (maxSample > 0.f) {
             fscale = 0.99f / maxSample;
             int exp; // unused
@@ -427,26 +713,26 @@ int Visualizer_process(
 #endif // BUILD_FLOAT
     }
 
-    uint32_t captIdx;
-    uint32_t inIdx;
+    uint32_t captIdx = pContext->mCaptureIdx;
     uint8_t *buf = pContext->mCaptureBuf;
-    for (inIdx = 0, captIdx = pContext->mCaptureIdx;
-         inIdx < sampleLen;
-         captIdx++) {
-        if (captIdx >= CAPTURE_BUF_SIZE) captIdx = 0; // wrap
-
 #ifdef BUILD_FLOAT
-        float smp = 0.f;
-        for (uint32_t i = 0; i < pContext->mChannelCount; ++i) {
-            smp += inBuffer->f32[inIdx++];
+    for (size_t frame = 0; frame < frameCount; frame += kChunkFrames) {
+        const size_t chunkFrames = std::min(frameCount - frame, kChunkFrames);
+        if (!monoIsCurrent) {
+            Visualizer_downmix(mono, inBuffer->f32 + frame * channelCount, chunkFrames,
+                    channelCount);
         }
-        buf[captIdx] = clamp8_from_float(smp * fscale);
+        captIdx = Visualizer_captureMono(buf, captIdx, mono, chunkFrames, fscale);
+    }
 #else
+    for (uint32_t inIdx = 0; inIdx < sampleLen; captIdx++) {
+        if (captIdx >= CAPTURE_BUF_SIZE) captIdx = 0; // wrap
+
         const int32_t smp = (inBuffer->s16[inIdx] + inBuffer->s16[inIdx + 1]) >> shift;
         inIdx += FCC_2;  // integer supports stereo only.
         buf[captIdx] = ((uint8_t)smp)^0x80;
-#endif // BUILD_FLOAT
     }
+#endif // BUILD_FLOAT
 
     // XXX the following two should really be atomic, though it probably doesn't
     // matter much for visualization purposes
@@ -634,59 +920,23 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
                     *replySize, captureSize);
             return -EINVAL;
         }
-        if (pContext->mState == VISUALIZER_STATE_ACTIVE) {
-            const uint32_t deltaMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
-
-            // if audio framework has stopped playing audio although the effect is still
-            // active we must clear the capture buffer to return silence
-            if ((pContext->mLastCaptureIdx == pContext->mCaptureIdx) &&
-                    (pContext->mBufferUpdateTime.tv_sec != 0) &&
-                    (deltaMs > MAX_STALL_TIME_MS)) {
-                    ALOGV("capture going to idle");
-                    pContext->mBufferUpdateTime.tv_sec = 0;
-                    memset(pReplyData, 0x80, captureSize);
-            } else {
-                int32_t latencyMs = pContext->mLatency;
-                latencyMs -= deltaMs;
-                if (latencyMs < 0) {
-                    latencyMs = 0;
-                }
-                uint32_t deltaSmpl = captureSize
-                        + pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
-
-                // large sample rate, latency, or capture size, could cause overflow.
-                // do not offset more than the size of buffer.
-                if (deltaSmpl > CAPTURE_BUF_SIZE) {
-                    android_errorWriteLog(0x534e4554, "31781965");
-                    deltaSmpl = CAPTURE_BUF_SIZE;
-                }
-
-                int32_t capturePoint;
-                //capturePoint = (int32_t)pContext->mCaptureIdx - deltaSmpl;
-                __builtin_sub_overflow((int32_t)pContext->mCaptureIdx, deltaSmpl, &capturePoint);
-                // a negative capturePoint means we wrap the buffer.
-                if (capturePoint < 0) {
-                    uint32_t size = -capturePoint;
-                    if (size > captureSize) {
-                        size = captureSize;
-                    }
-                    memcpy(pReplyData,
-                           pContext->mCaptureBuf + CAPTURE_BUF_SIZE + capturePoint,
-                           size);
-                    pReplyData = (char *)pReplyData + size;
-                    captureSize -= size;
-                    capturePoint = 0;
-                }
-                memcpy(pReplyData,
-                       pContext->mCaptureBuf + capturePoint,
-                       captureSize);
-            }
+        Visualizer_capture(pContext, (uint8_t *)pReplyData, captureSize);
+        } break;
 
-            pContext->mLastCaptureIdx = pContext->mCaptureIdx;
-        } else {
-            memset(pReplyData, 0x80, captureSize);
+    case VISUALIZER_CMD_MEASURE_FFT: {
+        const uint32_t captureSize = pContext->mCaptureSize;
+        if (pReplyData == NULL || replySize == NULL ||
+                *replySize != VISUALIZER_FFT_BIN_COUNT(captureSize) * sizeof(int16_t)) {
+            ALOGV("VISUALIZER_CMD_MEASURE_FFT() error replySize for captureSize %" PRIu32,
+                    captureSize);
+            return -EINVAL;
         }
-
+        // the FFT is radix 2
+        if (captureSize < 2 || (captureSize & (captureSize - 1)) != 0) {
+            ALOGV("VISUALIZER_CMD_MEASURE_FFT() error captureSize %" PRIu32, captureSize);
+            return -EINVAL;
+        }
+        Visualizer_measureFft(pContext, (int16_t *)pReplyData, captureSize);
         } break;
 
     case VISUALIZER_CMD_MEASURE: {
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECTVISUALIZER_H_
+#define ANDROID_EFFECTVISUALIZER_H_
+
+#include <audio_effects/effect_visualizer.h>
+
+// Vendor command returning the magnitude spectrum of the waveform that VISUALIZER_CMD_CAPTURE
+// would return, so that clients do not need to capture and transform it themselves.
+// The spectrum is computed on the calling thread, with a Hann window over the current capture
+// size, and shared by the clients requesting it before new audio is captured.
+// The reply holds VISUALIZER_FFT_BIN_COUNT(captureSize) int16_t magnitudes in millibels relative
+// to a full scale sine, from DC to half the sampling rate. Silent bins are -9600 (-96 dB).
+#define VISUALIZER_CMD_MEASURE_FFT  (VISUALIZER_CMD_MEASURE + 0x100)
+
+#define VISUALIZER_FFT_BIN_COUNT(captureSize) ((captureSize) / 2 + 1)
+
+#endif /*ANDROID_EFFECTVISUALIZER_H_*/
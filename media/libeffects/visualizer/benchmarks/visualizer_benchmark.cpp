@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the Visualizer effect through its library interface, at 48 kHz.
+//
+// Run with:
+//   visualizer_benchmark
+// BM_VisualizerProcess arguments are the channel count, the frame count per block, the scaling
+// mode and whether the peak and RMS measurement is enabled.
+// BM_VisualizerMeasureFft arguments are the capture size and whether audio is processed
+// between requests; without it, requests after the first return the magnitudes already
+// computed.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <effect_benchmark/BlockTimes.h>
+#include <hardware/audio_effect.h>
+
+#include "EffectVisualizer.h"
+
+extern audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+static constexpr uint32_t kSampleRate = 48000;
+static constexpr effect_uuid_t kVisualizerUuid =
+        {0xd069d9e0, 0x8329, 0x11df, 0x9168, {0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b}};
+
+static audio_channel_mask_t channelMask(uint32_t channelCount) {
+    switch (channelCount) {
+    case 1:
+        return AUDIO_CHANNEL_OUT_MONO;
+    case 2:
+        return AUDIO_CHANNEL_OUT_STEREO;
+    case 6:
+        return AUDIO_CHANNEL_OUT_5POINT1;
+    default:
+        return AUDIO_CHANNEL_OUT_7POINT1;
+    }
+}
+
+static int setParameter(effect_handle_t effect, uint32_t parameter, uint32_t value) {
+    uint32_t cmd[sizeof(effect_param_t) / sizeof(uint32_t) + 2];
+    effect_param_t *param = (effect_param_t *)cmd;
+    param->psize = sizeof(uint32_t);
+    param->vsize = sizeof(uint32_t);
+    *(uint32_t *)param->data = parameter;
+    *((uint32_t *)param->data + 1) = value;
+    int32_t reply = 0;
+    uint32_t replySize = sizeof(reply);
+    const int status = (*effect)->command(effect, EFFECT_CMD_SET_PARAM, sizeof(cmd), cmd,
+            &replySize, &reply);
+    return status != 0 ? status : reply;
+}
+
+// Visualizer enabled as an insert effect processing in place
+static effect_handle_t createVisualizer(uint32_t channelCount, uint32_t scalingMode,
+        bool measure) {
+    effect_handle_t effect;
+    if (AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(
+            &kVisualizerUuid, 1 /* sessionId */, 1 /* ioId */, &effect) != 0) {
+        return nullptr;
+    }
+    effect_config_t config{};
+    config.inputCfg.samplingRate = config.outputCfg.samplingRate = kSampleRate;
+    config.inputCfg.channels = config.outputCfg.channels = channelMask(channelCount);
+    config.inputCfg.format = config.outputCfg.format = AUDIO_FORMAT_PCM_FLOAT;
+    config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+    int reply = 0;
+    uint32_t replySize = sizeof(reply);
+    if ((*effect)->command(effect, EFFECT_CMD_SET_CONFIG, sizeof(config), &config,
+            &replySize, &reply) != 0 || reply != 0 ||
+            (*effect)->command(effect, EFFECT_CMD_ENABLE, 0, nullptr, &replySize, &reply) != 0 ||
+            setParameter(effect, VISUALIZER_PARAM_SCALING_MODE, scalingMode) != 0 ||
+            setParameter(effect, VISUALIZER_PARAM_MEASUREMENT_MODE,
+                    measure ? MEASUREMENT_MODE_PEAK_RMS : MEASUREMENT_MODE_NONE) != 0) {
+        AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+        return nullptr;
+    }
+    return effect;
+}
+
+static std::vector<float> makeInput(size_t sampleCount) {
+    std::minstd_rand generator(42);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    std::vector<float> input(sampleCount);
+    for (auto& sample : input) {
+        sample = distribution(generator);
+    }
+    return input;
+}
+
+static void BM_VisualizerProcess(benchmark::State& state) {
+    const uint32_t channelCount = state.range(0);
+    const size_t frameCount = state.range(1);
+    const uint32_t scalingMode = state.range(2);
+    const bool measure = state.range(3) != 0;
+
+    effect_handle_t effect = createVisualizer(channelCount, scalingMode, measure);
+    if (effect == nullptr) {
+        state.SkipWithError("cannot create the visualizer");
+        return;
+    }
+    std::vector<float> buffer = makeInput(frameCount * channelCount);
+    audio_buffer_t audioBuffer;
+    audioBuffer.frameCount = frameCount;
+    audioBuffer.f32 = buffer.data();
+    android::effect_benchmark::BlockTimes blockTimes(frameCount * 1e6 / kSampleRate);
+
+    for (auto _ : state) {
+        blockTimes.time([&]() {
+            (*effect)->process(effect, &audioBuffer, &audioBuffer);
+            benchmark::ClobberMemory();
+        });
+    }
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+
+    blockTimes.setCounters(state);
+    state.SetItemsProcessed(state.iterations() * frameCount);
+}
+
+static void BM_VisualizerMeasureFft(benchmark::State& state) {
+    const uint32_t captureSize = state.range(0);
+    const bool newAudio = state.range(1) != 0;
+    constexpr uint32_t kChannelCount = 2;
+    constexpr size_t kFrameCount = 256;
+
+    effect_handle_t effect = createVisualizer(kChannelCount,
+            VISUALIZER_SCALING_MODE_NORMALIZED, false /* measure */);
+    if (effect == nullptr ||
+            setParameter(effect, VISUALIZER_PARAM_CAPTURE_SIZE, captureSize) != 0) {
+        state.SkipWithError("cannot create the visualizer");
+        return;
+    }
+    // distinct blocks, so that each one changes the capture
+    constexpr size_t kBlockCount = 16;
+    std::vector<float> input = makeInput(kBlockCount * kFrameCount * kChannelCount);
+    std::vector<float> buffer(kFrameCount * kChannelCount);
+    audio_buffer_t audioBuffer;
+    audioBuffer.frameCount = kFrameCount;
+    audioBuffer.f32 = buffer.data();
+    size_t block = 0;
+    auto processBlock = [&]() {
+        std::copy_n(&input[block * buffer.size()], buffer.size(), buffer.begin());
+        (*effect)->process(effect, &audioBuffer, &audioBuffer);
+        block = (block + 1) % kBlockCount;
+    };
+    for (size_t i = 0; i < captureSize / kFrameCount + 1; i++) {
+        processBlock();
+    }
+    std::vector<int16_t> magnitudes(VISUALIZER_FFT_BIN_COUNT(captureSize));
+
+    for (auto _ : state) {
+        if (newAudio) {
+            state.PauseTiming();
+            processBlock();
+            state.ResumeTiming();
+        }
+        uint32_t replySize = magnitudes.size() * sizeof(int16_t);
+        if ((*effect)->command(effect, VISUALIZER_CMD_MEASURE_FFT, 0, nullptr, &replySize,
+                magnitudes.data()) != 0) {
+            state.SkipWithError("VISUALIZER_CMD_MEASURE_FFT failed");
+            break;
+        }
+        benchmark::DoNotOptimize(magnitudes.data());
+    }
+    AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(effect);
+}
+
+static void ProcessArgs(benchmark::internal::Benchmark *b) {
+    for (int channelCount : {2, 8}) {
+        for (int frameCount : {256, 960}) {
+            for (int scalingMode : {VISUALIZER_SCALING_MODE_NORMALIZED,
+                    VISUALIZER_SCALING_MODE_AS_PLAYED}) {
+                for (int measure : {0, 1}) {
+                    b->Args({channelCount, frameCount, scalingMode, measure});
+                }
+            }
+        }
+    }
+}
+
+static void MeasureFftArgs(benchmark::internal::Benchmark *b) {
+    for (int captureSize : {VISUALIZER_CAPTURE_SIZE_MIN, VISUALIZER_CAPTURE_SIZE_MAX}) {
+        for (int newAudio : {1, 0}) {
+            b->Args({captureSize, newAudio});
+        }
+    }
+}
+
+BENCHMARK(BM_VisualizerProcess)->Apply(ProcessArgs);
+BENCHMARK(BM_VisualizerMeasureFft)->Apply(MeasureFftArgs);
+
+BENCHMARK_MAIN();
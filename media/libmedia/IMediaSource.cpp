@@ -40,8 +40,15 @@ enum {
     READMULTIPLE,
     RELEASE_BUFFER,
     SUPPORT_NONBLOCKING_READ,
+    SETUP_SAMPLE_RING,
+    SEEK_SAMPLE_RING,
 };
 
+// How long a client waits on the sample ring before checking that the source is alive.
+static const int kSampleRingWaitMs = 1000;
+// How long the fill thread waits for free space before checking for a stop request.
+static const int kSampleRingFillWaitMs = 100;
+
 enum {
     NULL_BUFFER,
     SHARED_BUFFER,
@@ -68,7 +75,7 @@ protected:
 class BpMediaSource : public BpInterface<IMediaSource> {
 public:
     explicit BpMediaSource(const sp<IBinder>& impl)
-        : BpInterface<IMediaSource>(impl), mBuffersSinceStop(0)
+        : BpInterface<IMediaSource>(impl), mBuffersSinceStop(0), mRingSetupPending(false)
     {
     }
 
@@ -80,6 +87,11 @@ public:
             params->writeToParcel(data);
         }
         status_t ret = remote()->transact(START, data, &reply);
+        if (ret == NO_ERROR) {
+            // the ring is set up by the first read, so a source that is never read costs nothing
+            AutoMutex _l(mRingLock);
+            mRingSetupPending = true;
+        }
         if (ret == NO_ERROR && params) {
             ALOGW("ignoring potentially modified MetaData from start");
             ALOGW("input:");
@@ -93,6 +105,14 @@ public:
 
     virtual status_t stop() {
         ALOGV("stop");
+        {
+            // Wake a reader blocked on the ring. The mapping is kept for the next start().
+            AutoMutex _l(mRingLock);
+            mRingSetupPending = false;
+            if (mRing != nullptr) {
+                mRing->close(NO_INIT);
+            }
+        }
         Parcel data, reply;
         data.writeInterfaceToken(BpMediaSource::getInterfaceDescriptor());
         status_t status = remote()->transact(STOP, data, &reply);
@@ -131,6 +151,32 @@ public:
         if (buffers == NULL || !buffers->isEmpty()) {
             return BAD_VALUE;
         }
+        MediaSource::ReadOptions fallbackOptions;
+        sp<MediaSampleRing> ring = getSampleRing();
+        if (ring != nullptr) {
+            status_t ret;
+            {
+                AutoMutex _l(mRingReadLock);
+                ret = readMultipleFromRing(ring, buffers, maxNumBuffers, options);
+            }
+            if (ret != ERROR_BUFFER_TOO_SMALL) {
+                return ret;
+            }
+            // The next sample is larger than the ring; the source holds on to it
+            // and hands it out through readMultiple from now on.
+            ALOGW("sample too large for ring, falling back to binder reads");
+            {
+                AutoMutex _l(mRingLock);
+                if (mRing == ring) {
+                    mRing.clear();
+                }
+            }
+            if (options != nullptr) {
+                fallbackOptions = *options;
+                fallbackOptions.clearNonPersistent(); // seek was applied by the ring
+                options = &fallbackOptions;
+            }
+        }
         Parcel data, reply;
         data.writeInterfaceToken(BpMediaSource::getInterfaceDescriptor());
         data.writeUint32(maxNumBuffers);
@@ -218,8 +264,82 @@ public:
 
 private:
 
+    // Sets up the ring at the first read after start(). The source reuses the ring the client
+    // still maps from a previous start() if it can.
+    sp<MediaSampleRing> getSampleRing() {
+        AutoMutex _l(mRingLock);
+        if (!mRingSetupPending) {
+            return mRing;
+        }
+        mRingSetupPending = false;
+        Parcel data, reply;
+        data.writeInterfaceToken(BpMediaSource::getInterfaceDescriptor());
+        data.writeInt32(mRing != nullptr);
+        status_t ret = remote()->transact(SETUP_SAMPLE_RING, data, &reply);
+        if (ret != NO_ERROR || reply.readInt32() != OK) {
+            ALOGV("sample ring not supported by source");
+            mRing.clear();
+        } else if (reply.readInt32() != 0) {
+            mRing = MediaSampleRing::CreateFromParcel(reply);
+            ALOGW_IF(mRing == nullptr, "failed to map sample ring");
+        }
+        return mRing;
+    }
+
+    status_t readMultipleFromRing(const sp<MediaSampleRing> &ring,
+            Vector<MediaBufferBase *> *buffers, uint32_t maxNumBuffers,
+            const MediaSource::ReadOptions *options) {
+        status_t closedStatus = ring->closedStatus();
+        if (closedStatus != OK) {
+            return closedStatus; // stopped, until the next start()
+        }
+        int64_t seekTimeUs;
+        MediaSource::ReadOptions::SeekMode seekMode;
+        if (options != nullptr && options->getSeekTo(&seekTimeUs, &seekMode)) {
+            // The source flushes the ring and restarts filling at the new position.
+            Parcel data, reply;
+            data.writeInterfaceToken(BpMediaSource::getInterfaceDescriptor());
+            data.writeByteArray(sizeof(*options), (uint8_t*) options);
+            status_t ret = remote()->transact(SEEK_SAMPLE_RING, data, &reply);
+            if (ret != NO_ERROR) {
+                return ret;
+            }
+            ret = reply.readInt32();
+            if (ret != OK) {
+                return ret;
+            }
+        }
+        if (maxNumBuffers > kMaxNumReadMultiple) {
+            maxNumBuffers = kMaxNumReadMultiple;
+        }
+        const bool nonBlocking = options != nullptr && options->getNonBlocking();
+        status_t ret;
+        while ((ret = ring->readMultiple(buffers, maxNumBuffers,
+                nonBlocking ? 0 : kSampleRingWaitMs)) == TIMED_OUT) {
+            if (nonBlocking) {
+                return WOULD_BLOCK;
+            }
+            if (!remote()->isBinderAlive()) {
+                return DEAD_OBJECT;
+            }
+        }
+        mBuffersSinceStop += buffers->size();
+        ALOGV("readMultipleFromRing status %d, bufferCount %zu, sinceStop %u",
+                ret, buffers->size(), mBuffersSinceStop);
+        return ret;
+    }
+
     uint32_t mBuffersSinceStop; // Buffer tracking variable
 
+    // Shared-memory sample transport, if the source supports it. Kept across stop() and
+    // start() for the source to reuse.
+    sp<MediaSampleRing> mRing;
+    bool mRingSetupPending;
+    // guards mRing and mRingSetupPending; never held while waiting for samples
+    Mutex mRingLock;
+    // serializes ring reads; the ring has a single consumer
+    Mutex mRingReadLock;
+
     // NuPlayer passes pointers-to-metadata around, so we use this to keep the metadata alive
     // XXX: could we use this for caching, or does metadata change on the fly?
     sp<MetaData> mMetaData;
@@ -273,10 +393,116 @@ IMPLEMENT_META_INTERFACE(MediaSource, "android.media.IMediaSource");
 
 BnMediaSource::BnMediaSource()
     : mBuffersSinceStop(0)
-    , mGroup(new MediaBufferGroup(kBinderMediaBuffers /* growthLimit */)) {
+    , mGroup(new MediaBufferGroup(kBinderMediaBuffers /* growthLimit */))
+    , mStopFilling(false)
+    , mPendingBuffer(nullptr)
+    , mFillRequested(false)
+    , mFilling(false)
+    , mFillExit(false) {
 }
 
 BnMediaSource::~BnMediaSource() {
+    stopSampleRing();
+}
+
+void BnMediaSource::stopSampleRing() {
+    AutoMutex _l(mBnLock);
+    releaseSampleRingLocked();
+    if (mFillThread.joinable()) {
+        {
+            AutoMutex _f(mFillLock);
+            mFillExit = true;
+            mFillCondition.broadcast();
+        }
+        mFillThread.join();
+    }
+}
+
+void BnMediaSource::startFillingLocked(const MediaSource::ReadOptions &options) {
+    if (!mFillThread.joinable()) {
+        mFillThread = std::thread(&BnMediaSource::fillThreadLoop, this);
+    }
+    AutoMutex _f(mFillLock);
+    mStopFilling = false;
+    mFillOptions = options;
+    mFillRequested = true;
+    mFillCondition.broadcast();
+}
+
+void BnMediaSource::stopFillingLocked() {
+    AutoMutex _f(mFillLock);
+    mFillRequested = false;
+    if (!mFilling) {
+        return;
+    }
+    mStopFilling = true;
+    mRing->wakeProducer();
+    while (mFilling) {
+        mFillCondition.wait(mFillLock);
+    }
+}
+
+void BnMediaSource::releaseSampleRingLocked() {
+    if (mRing != nullptr) {
+        stopFillingLocked();
+        mRing.clear();
+    }
+    if (mPendingBuffer != nullptr) {
+        mPendingBuffer->release();
+        mPendingBuffer = nullptr;
+    }
+}
+
+// The thread is created with the first ring and parks between fill sessions, which run from
+// SETUP_SAMPLE_RING or SEEK_SAMPLE_RING to a terminal status, STOP or the next seek.
+void BnMediaSource::fillThreadLoop() {
+    AutoMutex _f(mFillLock);
+    for (;;) {
+        while (!mFillRequested && !mFillExit) {
+            mFillCondition.wait(mFillLock);
+        }
+        if (mFillExit) {
+            return;
+        }
+        mFillRequested = false;
+        mFilling = true;
+        MediaSource::ReadOptions options = mFillOptions;
+        mFillLock.unlock();
+        fillSampleRing(options);
+        mFillLock.lock();
+        mFilling = false;
+        mFillCondition.broadcast();
+    }
+}
+
+void BnMediaSource::fillSampleRing(MediaSource::ReadOptions options) {
+    while (!mStopFilling && mRing->closedStatus() == OK) {
+        MediaBufferBase *buf = nullptr;
+        status_t err = read(&buf, &options);
+        options.clearNonPersistent();
+        if (err == OK && buf == nullptr) {
+            err = ERROR_MALFORMED;
+        }
+
+        status_t ret = err == OK ? mRing->writeSample(buf) : mRing->writeStatus(err);
+        if (ret == ERROR_BUFFER_TOO_SMALL) {
+            // Keep the sample for readMultiple and tell the client to fall back.
+            mPendingBuffer = buf;
+            buf = nullptr;
+            err = ERROR_BUFFER_TOO_SMALL;
+            ret = mRing->writeStatus(err);
+        }
+        while (ret == WOULD_BLOCK && !mStopFilling && mRing->closedStatus() == OK) {
+            mRing->waitForSpace(kSampleRingFillWaitMs);
+            ret = err == OK ? mRing->writeSample(buf) : mRing->writeStatus(err);
+        }
+        if (buf != nullptr) {
+            buf->release();
+        }
+        if (err != OK && err != INFO_FORMAT_CHANGED) {
+            break; // the status is terminal, nothing more to read.
+        }
+    }
 }
 
 status_t BnMediaSource::onTransact(
@@ -300,6 +526,19 @@ status_t BnMediaSource::onTransact(
             ALOGV("stop");
             CHECK_INTERFACE(IMediaSource, data, reply);
             mGroup->signalBufferReturned(nullptr);
+            {
+                // The client may be blocked on the ring: the status must be written before
+                // waiting for the fill thread. The ring is kept for the next start().
+                AutoMutex _l(mBnLock);
+                if (mRing != nullptr) {
+                    mRing->close(NO_INIT);
+                    stopFillingLocked();
+                }
+                if (mPendingBuffer != nullptr) {
+                    mPendingBuffer->release();
+                    mPendingBuffer = nullptr;
+                }
+            }
             status_t status = stop();
             AutoMutex _l(mBnLock);
             mIndexCache.reset();
@@ -342,6 +581,18 @@ status_t BnMediaSource::onTransact(
                     && data.read((void *)&opts, len) == NO_ERROR;
 
             AutoMutex _l(mBnLock);
+            // A client reading through binder has given up on the sample ring.
+            if (mRing != nullptr) {
+                stopFillingLocked();
+                mRing.clear();
+            }
+            int64_t seekTimeUs;
+            MediaSource::ReadOptions::SeekMode seekMode;
+            if (mPendingBuffer != nullptr
+                    && useOptions && opts.getSeekTo(&seekTimeUs, &seekMode)) {
+                mPendingBuffer->release();
+                mPendingBuffer = nullptr;
+            }
             mGroup->signalBufferReturned(nullptr);
             mIndexCache.gc();
             size_t inlineTransferSize = 0;
@@ -349,7 +600,13 @@ status_t BnMediaSource::onTransact(
             uint32_t bufferCount = 0;
             for (; bufferCount < maxNumBuffers; ++bufferCount, ++mBuffersSinceStop) {
                 MediaBuffer *buf = nullptr;
-                ret = read((MediaBufferBase **)&buf, useOptions ? &opts : nullptr);
+                if (mPendingBuffer != nullptr) {
+                    buf = (MediaBuffer *)mPendingBuffer;
+                    mPendingBuffer = nullptr;
+                    ret = OK;
+                } else {
+                    ret = read((MediaBufferBase **)&buf, useOptions ? &opts : nullptr);
+                }
                 opts.clearNonPersistent(); // Remove options that only apply to first buffer.
                 if (ret != NO_ERROR || buf == nullptr) {
                     break;
@@ -443,6 +700,72 @@ status_t BnMediaSource::onTransact(
                     ret, bufferCount, mBuffersSinceStop);
             return NO_ERROR;
         }
+        case SETUP_SAMPLE_RING: {
+            ALOGV("setupSampleRing");
+            CHECK_INTERFACE(IMediaSource, data, reply);
+            const bool clientHasRing = data.readInt32() != 0;
+            if (!supportSampleRing()) {
+                reply->writeInt32(ERROR_UNSUPPORTED);
+                return NO_ERROR;
+            }
+            size_t capacity = kSampleRingMinCapacity;
+            sp<MetaData> format = getFormat();
+            int32_t maxInputSize;
+            if (format != nullptr && format->findInt32(kKeyMaxInputSize, &maxInputSize)
+                    && maxInputSize > 0
+                    && (size_t)maxInputSize * kSampleRingMinSamples > capacity) {
+                capacity = (size_t)maxInputSize * kSampleRingMinSamples;
+            }
+            AutoMutex _l(mBnLock);
+            if (clientHasRing && mRing != nullptr && mRing->capacity() >= capacity) {
+                // the ring of the previous start(), which the client still maps
+                stopFillingLocked();
+                if (mPendingBuffer != nullptr) {
+                    mPendingBuffer->release();
+                    mPendingBuffer = nullptr;
+                }
+                mRing->reset();
+                reply->writeInt32(OK);
+                reply->writeInt32(0 /* new ring */);
+            } else {
+                releaseSampleRingLocked();
+                mRing = MediaSampleRing::Create(capacity);
+                if (mRing == nullptr) {
+                    reply->writeInt32(NO_MEMORY);
+                    return NO_ERROR;
+                }
+                reply->writeInt32(OK);
+                reply->writeInt32(1 /* new ring */);
+                mRing->writeToParcel(reply);
+            }
+            startFillingLocked(MediaSource::ReadOptions());
+            return NO_ERROR;
+        }
+        case SEEK_SAMPLE_RING: {
+            ALOGV("seekSampleRing");
+            CHECK_INTERFACE(IMediaSource, data, reply);
+            MediaSource::ReadOptions opts;
+            uint32_t len;
+            if (data.readUint32(&len) != NO_ERROR
+                    || len != sizeof(opts)
+                    || data.read((void *)&opts, len) != NO_ERROR) {
+                return BAD_VALUE;
+            }
+            AutoMutex _l(mBnLock);
+            if (mRing == nullptr) {
+                reply->writeInt32(INVALID_OPERATION);
+                return NO_ERROR;
+            }
+            stopFillingLocked();
+            if (mPendingBuffer != nullptr) {
+                mPendingBuffer->release();
+                mPendingBuffer = nullptr;
+            }
+            mRing->reset();
+            startFillingLocked(opts);
+            reply->writeInt32(OK);
+            return NO_ERROR;
+        }
         case SUPPORT_NONBLOCKING_READ: {
             ALOGV("supportNonblockingRead");
             CHECK_INTERFACE(IMediaSource, data, reply);
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MediaSampleRing"
+#include <utils/Log.h>
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <media/MediaSampleRing.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaDataBase.h>
+
+namespace android {
+
+// Control block at the start of the shared mapping. Positions are free-running byte
+// counts; the offset into the data area is the position modulo the capacity.
+struct MediaSampleRing::Header {
+    std::atomic<uint32_t> mWritePos;        // owned by the producer
+    uint8_t mPad0[60];
+    std::atomic<uint32_t> mReadPos;         // owned by the consumer
+    uint8_t mPad1[60];
+    std::atomic<uint32_t> mConsumerWaiting; // set by a consumer about to sleep
+    std::atomic<uint32_t> mProducerWaiting; // set by a producer about to sleep
+    uint32_t mCapacity;
+    std::atomic<int32_t> mClosedStatus;     // set by close(), OK while open
+};
+
+struct MediaSampleRing::Record {
+    uint32_t mType;       // RecordType
+    uint32_t mDataSize;
+    uint32_t mMetaSize;
+    int32_t mStatus;
+};
+
+static const size_t kHeaderSize = 256;
+static const size_t kRecordAlignment = 16;
+static const size_t kMinCapacity = 64 * 1024;
+static const size_t kMaxCapacity = 64 * 1024 * 1024;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomics must be lock free");
+static_assert(kRecordAlignment >= 16, "a padding record must always fit in the tail");
+
+static inline size_t alignRecord(size_t size) {
+    return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+MediaSampleRing::MediaSampleRing()
+    : mBase(nullptr),
+      mMapSize(0),
+      mLocal(false),
+      mHeader(nullptr),
+      mData(nullptr),
+      mCapacity(0),
+      mBlockedReadPos(0) {
+}
+
+MediaSampleRing::~MediaSampleRing() {
+    if (mBase != nullptr) {
+        if (mLocal) {
+            free(mBase);
+        } else {
+            munmap(mBase, mMapSize);
+        }
+    }
+}
+
+// static
+sp<MediaSampleRing> MediaSampleRing::Create(size_t capacity) {
+    sp<MediaSampleRing> ring = new MediaSampleRing();
+    if (ring->init(capacity, false /* local */) != OK) {
+        return nullptr;
+    }
+    return ring;
+}
+
+// static
+sp<MediaSampleRing> MediaSampleRing::CreateLocal(size_t capacity) {
+    sp<MediaSampleRing> ring = new MediaSampleRing();
+    if (ring->init(capacity, true /* local */) != OK) {
+        return nullptr;
+    }
+    return ring;
+}
+
+status_t MediaSampleRing::init(size_t capacity, bool local) {
+    if (capacity < kMinCapacity) {
+        capacity = kMinCapacity;
+    } else if (capacity > kMaxCapacity) {
+        capacity = kMaxCapacity;
+    }
+    // round up to a power of two so positions can wrap freely.
+    size_t pow2 = kMinCapacity;
+    while (pow2 < capacity) {
+        pow2 <<= 1;
+    }
+    mCapacity = pow2;
+    mMapSize = kHeaderSize + mCapacity;
+    mLocal = local;
+
+    mDataEventFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    mSpaceEventFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (mDataEventFd < 0 || mSpaceEventFd < 0) {
+        ALOGE("failed to create eventfd: %s", strerror(errno));
+        return NO_INIT;
+    }
+
+    if (local) {
+        mBase = (uint8_t *)calloc(1, mMapSize);
+        if (mBase == nullptr) {
+            return NO_MEMORY;
+        }
+    } else {
+        mMemFd.reset(ashmem_create_region("MediaSampleRing", mMapSize));
+        if (mMemFd < 0) {
+            ALOGE("failed to create ashmem region of %zu bytes", mMapSize);
+            return NO_MEMORY;
+        }
+        void *base = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, mMemFd, 0);
+        if (base == MAP_FAILED) {
+            ALOGE("failed to map ring: %s", strerror(errno));
+            return NO_MEMORY;
+        }
+        mBase = (uint8_t *)base;
+    }
+
+    mHeader = new (mBase) Header();
+    mHeader->mWritePos.store(0);
+    mHeader->mReadPos.store(0);
+    mHeader->mConsumerWaiting.store(0);
+    mHeader->mProducerWaiting.store(0);
+    mHeader->mCapacity = mCapacity;
+    mHeader->mClosedStatus.store(OK);
+    mData = mBase + kHeaderSize;
+    return OK;
+}
+
+// static
+sp<MediaSampleRing> MediaSampleRing::CreateFromParcel(const Parcel &parcel) {
+    sp<MediaSampleRing> ring = new MediaSampleRing();
+    ring->mMemFd.reset(fcntl(parcel.readFileDescriptor(), F_DUPFD_CLOEXEC, 0));
+    ring->mDataEventFd.reset(fcntl(parcel.readFileDescriptor(), F_DUPFD_CLOEXEC, 0));
+    ring->mSpaceEventFd.reset(fcntl(parcel.readFileDescriptor(), F_DUPFD_CLOEXEC, 0));
+    uint64_t mapSize = parcel.readUint64();
+    if (ring->mMemFd < 0 || ring->mDataEventFd < 0 || ring->mSpaceEventFd < 0) {
+        ALOGE("invalid ring file descriptors");
+        return nullptr;
+    }
+    if (mapSize < kHeaderSize + kMinCapacity || mapSize > kHeaderSize + kMaxCapacity) {
+        ALOGE("invalid ring size %llu", (unsigned long long)mapSize);
+        return nullptr;
+    }
+
+    void *base = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->mMemFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("failed to map ring: %s", strerror(errno));
+        return nullptr;
+    }
+    ring->mBase = (uint8_t *)base;
+    ring->mMapSize = mapSize;
+    ring->mHeader = reinterpret_cast<Header *>(ring->mBase);
+    ring->mData = ring->mBase + kHeaderSize;
+
+    // The peer is not trusted; only use the capacity if it agrees with the mapping.
+    uint32_t capacity = ring->mHeader->mCapacity;
+    if (capacity + kHeaderSize != mapSize || (capacity & (capacity - 1)) != 0) {
+        ALOGE("ring capacity %u does not match size %llu",
+                capacity, (unsigned long long)mapSize);
+        return nullptr;
+    }
+    ring->mCapacity = capacity;
+    return ring;
+}
+
+status_t MediaSampleRing::writeToParcel(Parcel *parcel) const {
+    if (mLocal) {
+        return INVALID_OPERATION;
+    }
+    parcel->writeDupFileDescriptor(mMemFd);
+    parcel->writeDupFileDescriptor(mDataEventFd);
+    parcel->writeDupFileDescriptor(mSpaceEventFd);
+    return parcel->writeUint64(mMapSize);
+}
+
+status_t MediaSampleRing::writeSample(MediaBufferBase *buffer) {
+    Parcel meta;
+    buffer->meta_data().writeToParcel(meta);
+    return writeRecord(kRecordSample, OK,
+            (const uint8_t *)buffer->data() + buffer->range_offset(),
+            buffer->range_length(), &meta);
+}
+
+status_t MediaSampleRing::writeStatus(status_t status) {
+    return writeRecord(kRecordStatus, status, nullptr, 0, nullptr);
+}
+
+status_t MediaSampleRing::writeRecord(RecordType type, int32_t status,
+        const uint8_t *data, size_t dataSize, const Parcel *meta) {
+    const size_t metaSize = meta != nullptr ? meta->dataSize() : 0;
+    if (dataSize > mCapacity || metaSize > mCapacity) {
+        return ERROR_BUFFER_TOO_SMALL;
+    }
+    const size_t total = alignRecord(sizeof(Record) + dataSize + metaSize);
+    if (total > mCapacity) {
+        return ERROR_BUFFER_TOO_SMALL;
+    }
+
+    uint32_t writePos = mHeader->mWritePos.load(std::memory_order_relaxed);
+    const uint32_t readPos = mHeader->mReadPos.load(std::memory_order_acquire);
+    const uint32_t offset = writePos & (mCapacity - 1);
+    const uint32_t tail = mCapacity - offset;
+    const size_t needed = total + (tail < total ? tail : 0);
+    if (mCapacity - (writePos - readPos) < needed) {
+        mBlockedReadPos = readPos;
+        return WOULD_BLOCK;
+    }
+
+    if (tail < total) {
+        Record *padding = reinterpret_cast<Record *>(mData + offset);
+        padding->mType = kRecordPadding;
+        padding->mDataSize = tail - sizeof(Record);
+        padding->mMetaSize = 0;
+        padding->mStatus = OK;
+        writePos += tail;
+    }
+
+    uint8_t *dst = mData + (writePos & (mCapacity - 1));
+    Record *record = reinterpret_cast<Record *>(dst);
+    record->mType = type;
+    record->mDataSize = dataSize;
+    record->mMetaSize = metaSize;
+    record->mStatus = status;
+    if (dataSize > 0) {
+        memcpy(dst + sizeof(Record), data, dataSize);
+    }
+    if (metaSize > 0) {
+        memcpy(dst + sizeof(Record) + dataSize, meta->data(), metaSize);
+    }
+    mHeader->mWritePos.store(writePos + total, std::memory_order_release);
+
+    if (mHeader->mConsumerWaiting.exchange(0) != 0) {
+        signal(mDataEventFd);
+    }
+    return OK;
+}
+
+status_t MediaSampleRing::waitForSpace(int timeoutMs) {
+    mHeader->mProducerWaiting.store(1);
+    // the consumer may have freed space between the failed write and the flag above.
+    if (mHeader->mReadPos.load() != mBlockedReadPos || mHeader->mClosedStatus.load() != OK) {
+        mHeader->mProducerWaiting.store(0);
+        return OK;
+    }
+    return wait(mSpaceEventFd, timeoutMs);
+}
+
+void MediaSampleRing::wakeProducer() {
+    signal(mSpaceEventFd);
+}
+
+void MediaSampleRing::close(status_t status) {
+    mHeader->mClosedStatus.store(status != OK ? status : UNKNOWN_ERROR);
+    signal(mDataEventFd);
+    signal(mSpaceEventFd);
+}
+
+status_t MediaSampleRing::closedStatus() const {
+    return mHeader->mClosedStatus.load(std::memory_order_acquire);
+}
+
+status_t MediaSampleRing::readMultiple(
+        Vector<MediaBufferBase *> *buffers, uint32_t maxNumBuffers, int timeoutMs) {
+    uint32_t readPos = mHeader->mReadPos.load(std::memory_order_relaxed);
+    while (buffers->size() < maxNumBuffers) {
+        const status_t closedStatus = mHeader->mClosedStatus.load(std::memory_order_acquire);
+        if (closedStatus != OK) {
+            return buffers->isEmpty() ? closedStatus : OK;
+        }
+        const uint32_t writePos = mHeader->mWritePos.load(std::memory_order_acquire);
+        if (writePos == readPos) {
+            if (!buffers->isEmpty()) {
+                break;
+            }
+            mHeader->mConsumerWaiting.store(1);
+            if (mHeader->mWritePos.load() != readPos) {
+                mHeader->mConsumerWaiting.store(0);
+                continue;
+            }
+            status_t err = wait(mDataEventFd, timeoutMs);
+            if (err != OK) {
+                return err;
+            }
+            continue;
+        }
+
+        const uint32_t available = writePos - readPos;
+        const uint32_t offset = readPos & (mCapacity - 1);
+        if (available > mCapacity || available < sizeof(Record)
+                || mCapacity - offset < sizeof(Record)) {
+            ALOGE("corrupt ring positions: read %u write %u", readPos, writePos);
+            return ERROR_MALFORMED;
+        }
+
+        // Copy the record header out of shared memory before validating it.
+        Record record;
+        memcpy(&record, mData + offset, sizeof(record));
+
+        if (record.mType == kRecordPadding) {
+            if (record.mDataSize != mCapacity - offset - sizeof(Record)) {
+                ALOGE("corrupt padding record of %u bytes at %u", record.mDataSize, offset);
+                return ERROR_MALFORMED;
+            }
+            readPos += mCapacity - offset;
+            mHeader->mReadPos.store(readPos, std::memory_order_release);
+            continue;
+        }
+
+        if (record.mType == kRecordStatus) {
+            if (!buffers->isEmpty()) {
+                break; // deliver the samples first, the status on the next read.
+            }
+            if (record.mStatus == INFO_FORMAT_CHANGED) {
+                readPos += alignRecord(sizeof(Record));
+                mHeader->mReadPos.store(readPos, std::memory_order_release);
+                if (mHeader->mProducerWaiting.exchange(0) != 0) {
+                    signal(mSpaceEventFd);
+                }
+            }
+            // any other status is terminal and stays at the head of the ring.
+            return record.mStatus;
+        }
+
+        if (record.mType != kRecordSample
+                || record.mDataSize > mCapacity || record.mMetaSize > mCapacity) {
+            ALOGE("corrupt record type %u", record.mType);
+            return ERROR_MALFORMED;
+        }
+        const size_t total = alignRecord(
+                sizeof(Record) + (size_t)record.mDataSize + record.mMetaSize);
+        if (total > mCapacity - offset || total > available) {
+            ALOGE("corrupt sample record of %zu bytes at %u", total, offset);
+            return ERROR_MALFORMED;
+        }
+
+        const uint8_t *src = mData + offset + sizeof(Record);
+        MediaBuffer *buf = new MediaBuffer(record.mDataSize);
+        memcpy(buf->data(), src, record.mDataSize);
+        Parcel meta;
+        meta.setData(src + record.mDataSize, record.mMetaSize);
+        if (buf->meta_data().updateFromParcel(meta) != OK) {
+            buf->release();
+            return ERROR_MALFORMED;
+        }
+        buffers->push_back(buf);
+
+        readPos += total;
+        mHeader->mReadPos.store(readPos, std::memory_order_release);
+        if (mHeader->mProducerWaiting.exchange(0) != 0) {
+            signal(mSpaceEventFd);
+        }
+    }
+    return OK;
+}
+
+void MediaSampleRing::reset() {
+    mHeader->mWritePos.store(0);
+    mHeader->mReadPos.store(0);
+    mHeader->mConsumerWaiting.store(0);
+    mHeader->mProducerWaiting.store(0);
+    mHeader->mClosedStatus.store(OK);
+    mBlockedReadPos = 0;
+    drain(mDataEventFd);
+    drain(mSpaceEventFd);
+}
+
+// static
+status_t MediaSampleRing::wait(int fd, int timeoutMs) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+    int ret = poll(&pfd, 1, timeoutMs);
+    if (ret == 0) {
+        return TIMED_OUT;
+    }
+    if (ret > 0) {
+        drain(fd);
+    }
+    // EINTR is treated as a spurious wakeup; callers re-check the ring.
+    return OK;
+}
+
+// static
+void MediaSampleRing::signal(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+        ALOGW("failed to signal ring: %s", strerror(errno));
+    }
+}
+
+// static
+void MediaSampleRing::drain(int fd) {
+    uint64_t count;
+    (void)read(fd, &count, sizeof(count)); // non-blocking; clears the counter
+}
+
+}  // namespace android
@@ -18,13 +18,17 @@
 
 #define IMEDIA_SOURCE_BASE_H_
 
+#include <atomic>
 #include <map>
+#include <thread>
 
 #include <binder/IInterface.h>
 #include <binder/IMemory.h>
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaErrors.h>
+#include <media/MediaSampleRing.h>
+#include <utils/Condition.h>
 
 namespace android {
 
@@ -124,21 +128,55 @@ public:
         return false;
     }
 
+    // Override in source to let clients read samples from a shared-memory
+    // MediaSampleRing, filled by a dedicated thread, instead of through a binder
+    // transaction per readMultiple().
+    virtual bool supportSampleRing() {
+        return false;
+    }
+
     // align buffer count with video request size in NuMediaExtractor::selectTrack()
     static const size_t kBinderMediaBuffers = 8; // buffers managed by BnMediaSource
     static const size_t kTransferSharedAsSharedThreshold = 4 * 1024;  // if >= shared, else inline
     static const size_t kTransferInlineAsSharedThreshold = 8 * 1024; // if >= shared, else inline
     static const size_t kInlineMaxTransfer = 64 * 1024; // Binder size limited to BINDER_VM_SIZE.
+    static const size_t kSampleRingMinCapacity = 1024 * 1024;
+    static const size_t kSampleRingMinSamples = 4; // ring holds at least this many max size samples
 
 protected:
     virtual ~BnMediaSource();
 
+    // Releases the sample ring and stops its fill thread. Sources supporting the sample
+    // ring must call this before tearing down whatever read() depends on.
+    void stopSampleRing();
+
 private:
     uint32_t mBuffersSinceStop; // Buffer tracking variable
     Mutex mBnLock; // to guard readMultiple against concurrent access to the buffer cache
 
     std::unique_ptr<MediaBufferGroup> mGroup;
 
+    // Sample ring state, guarded by mBnLock except where noted.
+    sp<MediaSampleRing> mRing;
+    std::thread mFillThread;
+    std::atomic<bool> mStopFilling;
+    // Sample that did not fit in mRing; written by mFillThread before its session ends.
+    MediaBufferBase *mPendingBuffer;
+
+    // Fill session state, guarded by mFillLock.
+    Mutex mFillLock;
+    Condition mFillCondition;
+    bool mFillRequested;
+    bool mFilling;
+    bool mFillExit;
+    MediaSource::ReadOptions mFillOptions;
+
+    void startFillingLocked(const MediaSource::ReadOptions &options);
+    void stopFillingLocked();
+    void releaseSampleRingLocked();
+    void fillThreadLoop();
+    void fillSampleRing(MediaSource::ReadOptions options);
+
     // To prevent marshalling IMemory with each read transaction, we cache the IMemory pointer
     // into a map.
     //
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEDIA_SAMPLE_RING_H_
+
+#define MEDIA_SAMPLE_RING_H_
+
+#include <android-base/unique_fd.h>
+#include <binder/Parcel.h>
+#include <media/stagefright/MediaBufferBase.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Single-producer, single-consumer ring of media samples in shared memory.
+//
+// The producer (BnMediaSource in the extractor process) copies each sample and its
+// metadata into the ring; the consumer (BpMediaSource) copies them back out into
+// MediaBuffers. No binder transaction is needed per sample. Each side only signals
+// the other's eventfd when the other side has announced that it is about to sleep,
+// so a steady stream of samples costs no syscalls.
+//
+// Status records (end of stream, errors, format changes) travel in order with the
+// samples. A terminal status stays at the head of the ring so that it is returned
+// on every subsequent read. close() ends the stream out of band, when the ring may be full.
+class MediaSampleRing : public RefBase {
+public:
+    // Creates a ring backed by ashmem, for sharing with another process.
+    static sp<MediaSampleRing> Create(size_t capacity);
+
+    // Creates a ring backed by process-private memory; it cannot be written to a
+    // Parcel. Used as a stand-in transport for local testing.
+    static sp<MediaSampleRing> CreateLocal(size_t capacity);
+
+    // Returns the peer's view of a ring written with writeToParcel().
+    static sp<MediaSampleRing> CreateFromParcel(const Parcel &parcel);
+
+    status_t writeToParcel(Parcel *parcel) const;
+
+    // Producer side.
+
+    // Appends a copy of |buffer| and its metadata. Returns WOULD_BLOCK if there is
+    // currently not enough free space and ERROR_BUFFER_TOO_SMALL if the sample can
+    // never fit.
+    status_t writeSample(MediaBufferBase *buffer);
+
+    // Appends a status record. Returns WOULD_BLOCK if there is no free space.
+    status_t writeStatus(status_t status);
+
+    // Waits up to |timeoutMs| (-1 for ever) for the consumer to free space, or for
+    // wakeProducer(). Returns OK or TIMED_OUT.
+    status_t waitForSpace(int timeoutMs);
+
+    // Wakes a producer blocked in waitForSpace().
+    void wakeProducer();
+
+    // Either side. Makes every following read return |status|, discarding the records left,
+    // wakes both sides and stops waitForSpace() from waiting. Unlike a status record, it
+    // needs no free space. reset() reopens the ring.
+    void close(status_t status);
+
+    // Returns the status passed to close(), or OK if the ring is open.
+    status_t closedStatus() const;
+
+    // Consumer side.
+
+    // Waits up to |timeoutMs| (-1 for ever) for the first record, then returns
+    // whatever else is immediately available, up to |maxNumBuffers| samples.
+    // Returns OK if at least one sample was read, the next status record if it is
+    // at the head of the ring, or TIMED_OUT.
+    status_t readMultiple(
+            Vector<MediaBufferBase *> *buffers, uint32_t maxNumBuffers, int timeoutMs);
+
+    // Discards all records. Only safe while neither side is accessing the ring.
+    void reset();
+
+    size_t capacity() const { return mCapacity; }
+
+protected:
+    virtual ~MediaSampleRing();
+
+private:
+    struct Header;
+    struct Record;
+
+    enum RecordType : uint32_t {
+        kRecordSample = 1,
+        kRecordStatus,
+        kRecordPadding,   // fills the tail of the ring up to the wrap point
+    };
+
+    uint8_t *mBase;       // start of the mapping, including the header
+    size_t mMapSize;
+    bool mLocal;
+    Header *mHeader;
+    uint8_t *mData;
+    uint32_t mCapacity;   // bytes available for records, a power of two
+    uint32_t mBlockedReadPos; // read position seen by the last write that would block
+
+    base::unique_fd mMemFd;
+    base::unique_fd mDataEventFd;   // signalled by the producer
+    base::unique_fd mSpaceEventFd;  // signalled by the consumer
+
+    MediaSampleRing();
+    status_t init(size_t capacity, bool local);
+
+    status_t writeRecord(RecordType type, int32_t status,
+            const uint8_t *data, size_t dataSize, const Parcel *meta);
+    static status_t wait(int fd, int timeoutMs);
+    static void signal(int fd);
+    static void drain(int fd);
+
+    DISALLOW_EVIL_CONSTRUCTORS(MediaSampleRing);
+};
+
+}  // namespace android
+
+#endif  // MEDIA_SAMPLE_RING_H_
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MultiPipe"
+//#define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_utils/roundup.h>
+#include <cutils/compiler.h>
+#include <media/nbaio/MultiPipe.h>
+#include <utils/Log.h>
+
+namespace android {
+
+static const size_t kCacheLineSize = 64;
+static const size_t kDefaultBlocks = 16;
+
+MultiPipe::MultiPipe(size_t maxFrames, const NBAIO_Format& format, Mode mode,
+        size_t numReaders, size_t blockFrames) :
+        mMode(mode),
+        mNumReaders(mode == MODE_BROADCAST ? std::min(std::max(numReaders, (size_t) 1),
+                (size_t) kMaxReaders) : 1),
+        mFrameSize(Format_frameSize(format)),
+        mBlockFrames(blockFrames != 0 ? blockFrames :
+                std::max(maxFrames / kDefaultBlocks, (size_t) 1)),
+        mNumBlocks(roundup(std::max((maxFrames + mBlockFrames - 1) / mBlockFrames,
+                (size_t) 2))),
+        mBlockStride((sizeof(Block) + mBlockFrames * mFrameSize + kCacheLineSize - 1)
+                & ~(kCacheLineSize - 1)),
+        mBuffer((uint8_t *) aligned_alloc(kCacheLineSize, mNumBlocks * mBlockStride)),
+        mFormat(format),
+        mWriterMask(0),
+        mReadersCreated(0)
+{
+    ALOGW_IF(mode != MODE_BROADCAST && numReaders != 1,
+            "numReaders %zu ignored unless MODE_BROADCAST", numReaders);
+    LOG_ALWAYS_FATAL_IF(mBuffer == NULL, "cannot allocate %zu blocks", mNumBlocks);
+    for (size_t i = 0; i < mNumBlocks; ++i) {
+        Block *b = new (mBuffer + i * mBlockStride) Block();
+        // a block is published when its sequence becomes position + 1
+        b->mSequence.store(i, std::memory_order_relaxed);
+        b->mPendingReaders.store(0, std::memory_order_relaxed);
+    }
+    // The timestamp queues outlive the writers, so that the master reader can push to a
+    // slot while its writer is being replaced.
+    for (WriterState &state : mWriters) {
+        // the observer initializes the shared state
+        state.mTimestampObserver =
+                new (state.mObserverStorage) TimestampQueue::Observer(&state.mTimestampShared);
+        state.mTimestampMutator =
+                new (state.mMutatorStorage) TimestampQueue::Mutator(&state.mTimestampShared);
+    }
+}
+
+MultiPipe::~MultiPipe()
+{
+    ALOG_ASSERT(mWriterMask == 0);
+    free(mBuffer);
+}
+
+sp<MultiPipeWriter> MultiPipe::createWriter()
+{
+    Mutex::Autolock _l(mLock);
+    const size_t maxWriters = mMode == MODE_BROADCAST ? 1 : kMaxWriters;
+    for (size_t i = 0; i < maxWriters; ++i) {
+        if (mWriterMask & (1 << i)) {
+            continue;
+        }
+        WriterState &state = mWriters[i];
+        uint16_t generation = state.mGeneration.load(std::memory_order_relaxed) + 1;
+        if (generation == 0) {
+            generation = 1;     // 0 means no writer has used the slot
+        }
+        state.mFramesConsumed.store(0, std::memory_order_relaxed);
+        // the master reader picks up the new generation from the first block written
+        state.mGeneration.store(generation, std::memory_order_release);
+        mWriterMask |= 1 << i;
+        return new MultiPipeWriter(this, i, generation);
+    }
+    return nullptr;
+}
+
+sp<MultiPipeReader> MultiPipe::createReader()
+{
+    Mutex::Autolock _l(mLock);
+    if (mReadersCreated >= mNumReaders) {
+        return nullptr;
+    }
+    const bool isMaster = mReadersCreated++ == 0;
+    return new MultiPipeReader(this, isMaster);
+}
+
+void MultiPipe::removeWriter(size_t writer)
+{
+    Mutex::Autolock _l(mLock);
+    mWriterMask &= ~(1 << writer);
+}
+
+ssize_t MultiPipe::write(size_t writer, uint16_t generation, const void *buffer, size_t count)
+{
+    const size_t wanted = (count + mBlockFrames - 1) / mBlockFrames;
+    // Claim up to 'wanted' consecutive blocks. Blocks are released in order, so everything
+    // between the release position and the enqueue position is in use.
+    uint32_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+    size_t claimed;
+    for (;;) {
+        const uint32_t inUse = position - mReleasePosition.load(std::memory_order_acquire);
+        claimed = std::min(wanted, mNumBlocks - std::min((size_t) inUse, mNumBlocks));
+        if (claimed == 0) {
+            break;
+        }
+        if (mEnqueuePosition.compare_exchange_weak(position, position + claimed,
+                std::memory_order_acquire, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    const uint8_t *src = (const uint8_t *) buffer;
+    size_t remaining = count;
+    for (size_t i = 0; i < claimed; ++i) {
+        Block *b = block(position + i);
+        const size_t frames = std::min(remaining, mBlockFrames);
+        memcpy(blockData(b), src, frames * mFrameSize);
+        b->mFrames = frames;
+        b->mWriter = writer;
+        b->mGeneration = generation;
+        b->mPendingReaders.store(mNumReaders, std::memory_order_relaxed);
+        b->mSequence.store(position + i + 1, std::memory_order_release);
+        src += frames * mFrameSize;
+        remaining -= frames;
+    }
+    if (remaining > 0) {
+        mFramesOverrun.fetch_add(remaining, std::memory_order_relaxed);
+        mOverruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    return count - remaining;
+}
+
+void MultiPipe::releaseBlock(uint32_t position)
+{
+    if (mMode == MODE_BROADCAST) {
+        Block *b = block(position);
+        if (b->mPendingReaders.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+    }
+    // Each block is released by the last reader to read it; readers read in order,
+    // so releases are ordered too.
+    mReleasePosition.store(position + 1, std::memory_order_release);
+}
+
+// ----------------------------------------------------------------------------
+
+MultiPipeWriter::MultiPipeWriter(const sp<MultiPipe>& pipe, size_t id, uint16_t generation) :
+        NBAIO_Sink(pipe->mFormat),
+        mPipe(pipe),
+        mId(id),
+        mGeneration(generation),
+        mFramesOverrun(0),
+        mOverruns(0)
+{
+}
+
+MultiPipeWriter::~MultiPipeWriter()
+{
+    mPipe->removeWriter(mId);
+}
+
+ssize_t MultiPipeWriter::availableToWrite()
+{
+    if (CC_UNLIKELY(!mNegotiated)) {
+        return NEGOTIATE;
+    }
+    const uint32_t inUse = mPipe->mEnqueuePosition.load(std::memory_order_relaxed)
+            - mPipe->mReleasePosition.load(std::memory_order_relaxed);
+    return (mPipe->mNumBlocks - std::min((size_t) inUse, mPipe->mNumBlocks))
+            * mPipe->mBlockFrames;
+}
+
+ssize_t MultiPipeWriter::write(const void *buffer, size_t count)
+{
+    if (CC_UNLIKELY(!mNegotiated)) {
+        return NEGOTIATE;
+    }
+    const ssize_t actual = mPipe->write(mId, mGeneration, buffer, count);
+    if ((size_t) actual < count) {
+        mFramesOverrun += count - actual;
+        ++mOverruns;
+    }
+    mFramesWritten += actual;
+    return actual;
+}
+
+status_t MultiPipeWriter::getTimestamp(ExtendedTimestamp &timestamp)
+{
+    ExtendedTimestamp ets;
+    if (mPipe->mWriters[mId].mTimestampObserver->poll(ets)) {
+        timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL] =
+                ets.mPosition[ExtendedTimestamp::LOCATION_KERNEL];
+        timestamp.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL] =
+                ets.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL];
+        return OK;
+    }
+    return INVALID_OPERATION;
+}
+
+int64_t MultiPipeWriter::framesConsumed() const
+{
+    return mPipe->mWriters[mId].mFramesConsumed.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------------------------
+
+MultiPipeReader::MultiPipeReader(const sp<MultiPipe>& pipe, bool isMaster) :
+        NBAIO_Source(pipe->mFormat),
+        mPipe(pipe),
+        mIsMaster(isMaster),
+        mPosition(0),
+        mOffset(0),
+        mFramesUnderrun(0),
+        mUnderruns(0),
+        mUnderrunning(false),
+        mNumSegments(0)
+{
+    memset(mConsumed, 0, sizeof(mConsumed));
+    memset(mGenerations, 0, sizeof(mGenerations));
+}
+
+MultiPipeReader::~MultiPipeReader()
+{
+}
+
+ssize_t MultiPipeReader::availableToRead()
+{
+    if (CC_UNLIKELY(!mNegotiated)) {
+        return NEGOTIATE;
+    }
+    size_t available = 0;
+    size_t offset = mOffset;
+    for (uint32_t position = mPosition; position - mPosition < mPipe->mNumBlocks; ++position) {
+        MultiPipe::Block *b = mPipe->block(position);
+        if (b->mSequence.load(std::memory_order_acquire) != position + 1) {
+            break;
+        }
+        available += b->mFrames - offset;
+        offset = 0;
+    }
+    return available;
+}
+
+size_t MultiPipeReader::consume(void *buffer, size_t count)
+{
+    uint8_t *dst = (uint8_t *) buffer;
+    const size_t frameSize = mPipe->mFrameSize;
+    size_t done = 0;
+    while (done < count) {
+        MultiPipe::Block *b = mPipe->block(mPosition);
+        if (b->mSequence.load(std::memory_order_acquire) != mPosition + 1) {
+            break;
+        }
+        const size_t frames = std::min(count - done, (size_t) b->mFrames - mOffset);
+        if (dst != NULL) {
+            memcpy(dst, (const uint8_t *) MultiPipe::blockData(b) + mOffset * frameSize,
+                    frames * frameSize);
+            dst += frames * frameSize;
+        }
+        if (mIsMaster) {
+            account(b->mWriter, b->mGeneration, frames);
+        }
+        mFramesRead += frames;
+        done += frames;
+        mOffset += frames;
+        if (mOffset == b->mFrames) {
+            mPipe->releaseBlock(mPosition);
+            ++mPosition;
+            mOffset = 0;
+        }
+    }
+    return done;
+}
+
+void MultiPipeReader::account(uint16_t writer, uint16_t generation, size_t frames)
+{
+    if (generation != mGenerations[writer]) {
+        // the writer slot has been reused since its previous block
+        mGenerations[writer] = generation;
+        mConsumed[writer] = 0;
+    }
+    mConsumed[writer] += frames;
+    MultiPipe::WriterState &state = mPipe->mWriters[writer];
+    if (state.mGeneration.load(std::memory_order_relaxed) == generation) {
+        state.mFramesConsumed.store(mConsumed[writer], std::memory_order_relaxed);
+    }
+
+    // extend the most recent segment if it is from the same writer
+    if (mNumSegments > 0) {
+        Segment &last = mSegments[(mNumSegments - 1) & (kMaxSegments - 1)];
+        if (last.mWriter == writer && last.mGeneration == generation
+                && last.mReaderEnd == mFramesRead) {
+            last.mReaderEnd += frames;
+            last.mWriterEnd += frames;
+            last.mFrames += frames;
+            return;
+        }
+    }
+    Segment &segment = mSegments[mNumSegments++ & (kMaxSegments - 1)];
+    segment.mReaderEnd = mFramesRead + frames;
+    segment.mWriterEnd = mConsumed[writer];
+    segment.mFrames = frames;
+    segment.mWriter = writer;
+    segment.mGeneration = generation;
+}
+
+ssize_t MultiPipeReader::read(void *buffer, size_t count)
+{
+    if (CC_UNLIKELY(!mNegotiated)) {
+        return NEGOTIATE;
+    }
+    const size_t actual = consume(buffer, count);
+    if (actual < count) {
+        mFramesUnderrun += count - actual;
+        if (!mUnderrunning) {
+            ++mUnderruns;
+            mUnderrunning = true;
+        }
+    } else {
+        mUnderrunning = false;
+    }
+    return actual;
+}
+
+ssize_t MultiPipeReader::flush()
+{
+    if (CC_UNLIKELY(!mNegotiated)) {
+        return NEGOTIATE;
+    }
+    // we consider flushed frames as read
+    return consume(NULL, SIZE_MAX);
+}
+
+void MultiPipeReader::onTimestamp(const ExtendedTimestamp &timestamp)
+{
+    const int64_t timeNs = timestamp.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL];
+    if (!mIsMaster || timeNs <= 0) {
+        return;
+    }
+    // Our position presented at timeNs; find the matching position of each writer by
+    // walking the segments back from the most recent one. A writer whose last segment ends
+    // at or before the presented position has had all of its consumed frames presented.
+    const int64_t presented = timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL];
+    int64_t positions[MultiPipe::kMaxWriters];
+    bool found[MultiPipe::kMaxWriters] = {};
+    memcpy(positions, mConsumed, sizeof(positions));
+    const size_t numSegments = std::min(mNumSegments, (size_t) kMaxSegments);
+    for (size_t i = 1; i <= numSegments; ++i) {
+        const Segment &segment = mSegments[(mNumSegments - i) & (kMaxSegments - 1)];
+        const uint16_t w = segment.mWriter;
+        if (found[w] || segment.mGeneration != mGenerations[w]) {
+            continue;
+        }
+        const int64_t readerStart = segment.mReaderEnd - segment.mFrames;
+        const int64_t writerStart = segment.mWriterEnd - segment.mFrames;
+        if (presented <= readerStart) {
+            positions[w] = writerStart;
+        } else {
+            positions[w] = writerStart
+                    + std::min(presented - readerStart, (int64_t) segment.mFrames);
+            found[w] = true;
+        }
+    }
+
+    for (size_t w = 0; w < MultiPipe::kMaxWriters; ++w) {
+        MultiPipe::WriterState &state = mPipe->mWriters[w];
+        if (mGenerations[w] == 0
+                || state.mGeneration.load(std::memory_order_acquire) != mGenerations[w]) {
+            continue;   // no frames read from the current writer in this slot yet
+        }
+        ExtendedTimestamp writerTimestamp;
+        writerTimestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL] = positions[w];
+        writerTimestamp.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL] = timeNs;
+        state.mTimestampMutator->push(writerTimestamp);
+    }
+}
+
+}   // namespace android
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MULTI_PIPE_H
+#define ANDROID_AUDIO_MULTI_PIPE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include <media/nbaio/NBAIO.h>
+#include <media/nbaio/SingleStateQueue.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+class MultiPipeReader;
+class MultiPipeWriter;
+
+// MultiPipe is a lock-free pipe with more than one endpoint on one side:
+//  - MODE_MULTI_WRITER: up to kMaxWriters writers and a single reader. Each write() is
+//    queued atomically with respect to other writers, in whole blocks, and the reader
+//    sees the frames of all writers in the order they were queued.
+//  - MODE_BROADCAST: a single writer and up to kMaxReaders readers, each of which reads
+//    every frame. The slowest reader paces the writer.
+//
+// Unlike Pipe, write() never overwrites unread data: when the pipe is full it returns a
+// short transfer count, and the frames it could not accept are counted as an overrun of
+// that writer. A read() that returns fewer frames than requested is counted as an underrun.
+//
+// The pipe is a ring of fixed size blocks. Writers claim blocks with a single compare and
+// swap and publish each block with a release store, so a writer is never blocked by another
+// writer or by a reader. A writer that is preempted between claiming and publishing a block
+// holds up the reader at that block until it resumes.
+//
+// The first reader is the master reader: timestamps it receives through onTimestamp() are
+// translated to each writer's own frame position and returned by that writer's
+// getTimestamp().
+//
+// Endpoints are created and destroyed with createWriter() and createReader(), which take a
+// mutex and must not be called from a SCHED_FIFO thread. In MODE_BROADCAST all readers must
+// be created before, and destroyed after, the writer starts writing.
+class MultiPipe : public RefBase {
+
+    friend class MultiPipeReader;
+    friend class MultiPipeWriter;
+
+public:
+    enum Mode {
+        MODE_MULTI_WRITER,
+        MODE_BROADCAST,
+    };
+
+    static const size_t kMaxWriters = 8;
+    static const size_t kMaxReaders = 8;
+
+    // maxFrames is the total capacity, which is rounded up to a whole number of blocks.
+    // blockFrames is the granularity of interleaving between writers, 0 for a default of
+    // maxFrames / 16. A write() of n frames uses at least ceil(n / blockFrames) blocks.
+    // numReaders is the number of readers in MODE_BROADCAST and must be 1 otherwise.
+    MultiPipe(size_t maxFrames, const NBAIO_Format& format, Mode mode = MODE_MULTI_WRITER,
+            size_t numReaders = 1, size_t blockFrames = 0);
+    virtual ~MultiPipe();
+
+    // Returns nullptr if the maximum number of writers for the mode are attached.
+    sp<MultiPipeWriter> createWriter();
+
+    // Returns nullptr if the maximum number of readers for the mode have been created.
+    sp<MultiPipeReader> createReader();
+
+    Mode    mode() const { return mMode; }
+    size_t  maxFrames() const { return mNumBlocks * mBlockFrames; }
+    size_t  blockFrames() const { return mBlockFrames; }
+
+    // Frames that writers could not queue because the pipe was full, and the number of
+    // write() calls that were affected, over all writers since construction.
+    int64_t framesOverrun() const { return mFramesOverrun.load(std::memory_order_relaxed); }
+    int64_t overruns() const { return mOverruns.load(std::memory_order_relaxed); }
+
+private:
+    typedef SingleStateQueue<ExtendedTimestamp> TimestampQueue;
+
+    struct Block {
+        std::atomic<uint32_t> mSequence;        // position + 1 once published
+        std::atomic<uint32_t> mPendingReaders;  // MODE_BROADCAST readers yet to read it
+        uint32_t    mFrames;
+        uint16_t    mWriter;
+        uint16_t    mGeneration;
+        // followed by mBlockFrames frames of audio
+    };
+
+    // Per writer state, kept here rather than in MultiPipeWriter so that the reader never
+    // touches a writer that has been destroyed.
+    struct WriterState {
+        std::atomic<uint16_t> mGeneration{0};   // changes every time the slot is reused
+        std::atomic<int64_t>  mFramesConsumed{0}; // frames of this writer read by the master
+        TimestampQueue::Shared mTimestampShared;
+        // constructed by the MultiPipe constructor
+        TimestampQueue::Mutator  *mTimestampMutator = nullptr;  // used by the master reader
+        TimestampQueue::Observer *mTimestampObserver = nullptr; // used by the writer
+        alignas(TimestampQueue::Mutator) uint8_t mMutatorStorage[sizeof(TimestampQueue::Mutator)];
+        alignas(TimestampQueue::Observer)
+                uint8_t mObserverStorage[sizeof(TimestampQueue::Observer)];
+    };
+
+    Block *block(uint32_t position) const {
+        return (Block *)(mBuffer + (size_t)(position & (mNumBlocks - 1)) * mBlockStride);
+    }
+    static void *blockData(Block *block) { return block + 1; }
+
+    ssize_t write(size_t writer, uint16_t generation, const void *buffer, size_t count);
+    void    releaseBlock(uint32_t position);
+    void    removeWriter(size_t writer);
+
+    const Mode      mMode;
+    const size_t    mNumReaders;
+    const size_t    mFrameSize;
+    const size_t    mBlockFrames;
+    const size_t    mNumBlocks;         // always a power of 2
+    const size_t    mBlockStride;       // bytes, a multiple of the cache line size
+    uint8_t * const mBuffer;
+    const NBAIO_Format mFormat;
+
+    // Producer and consumer positions are counted in blocks and wrap around.
+    alignas(64) std::atomic<uint32_t> mEnqueuePosition{0};  // next block to claim
+    alignas(64) std::atomic<uint32_t> mReleasePosition{0};  // blocks before this are free
+
+    alignas(64) std::atomic<int64_t> mFramesOverrun{0};
+    std::atomic<int64_t> mOverruns{0};
+
+    WriterState     mWriters[kMaxWriters];
+
+    Mutex           mLock;              // protects endpoint creation and removal
+    uint32_t        mWriterMask;        // writers currently attached, protected by mLock
+    size_t          mReadersCreated;    // protected by mLock
+};
+
+// Writer endpoint of a MultiPipe. Safe for a single thread; each writer thread should use
+// its own MultiPipeWriter.
+class MultiPipeWriter : public NBAIO_Sink {
+
+    friend class MultiPipe;
+
+public:
+    virtual ~MultiPipeWriter();
+
+    // NBAIO_Sink interface
+
+    //virtual int64_t framesWritten() const;
+    //virtual int64_t framesUnderrun() const;
+    //virtual int64_t underruns() const;
+
+    virtual ssize_t availableToWrite();
+
+    // Queues up to count frames. Returns a short transfer count, and counts an overrun, if
+    // there is not enough space.
+    virtual ssize_t write(const void *buffer, size_t count);
+
+    // Returns the most recent timestamp of the master reader, translated to the position in
+    // the frames written by this writer.
+    virtual status_t getTimestamp(ExtendedTimestamp &timestamp);
+
+    // NBAIO_Sink end
+
+    // Frames of this writer that the pipe could not accept, and the number of write() calls
+    // affected.
+    int64_t framesOverrun() const { return mFramesOverrun; }
+    int64_t overruns() const { return mOverruns; }
+
+    // Frames of this writer that have been read by the master reader.
+    int64_t framesConsumed() const;
+
+    size_t  id() const { return mId; }
+
+private:
+    MultiPipeWriter(const sp<MultiPipe>& pipe, size_t id, uint16_t generation);
+
+    const sp<MultiPipe> mPipe;
+    const size_t    mId;
+    const uint16_t  mGeneration;
+    int64_t         mFramesOverrun;
+    int64_t         mOverruns;
+};
+
+// Reader endpoint of a MultiPipe. Safe for a single thread.
+class MultiPipeReader : public NBAIO_Source {
+
+    friend class MultiPipe;
+
+public:
+    virtual ~MultiPipeReader();
+
+    // NBAIO_Source interface
+
+    //virtual int64_t framesRead() const;
+
+    // Frames that writers dropped because the pipe was full.
+    virtual int64_t framesOverrun() { return mPipe->framesOverrun(); }
+    virtual int64_t overruns() { return mPipe->overruns(); }
+
+    virtual ssize_t availableToRead();
+
+    // Reads up to count frames. A short transfer count is counted as an underrun.
+    virtual ssize_t read(void *buffer, size_t count);
+
+    virtual ssize_t flush();
+
+    // On the master reader, forwards the timestamp to every writer.
+    virtual void    onTimestamp(const ExtendedTimestamp &timestamp);
+
+    // NBAIO_Source end
+
+    // Frames requested by read() but not available, and the number of underrun events,
+    // where consecutive short reads count as one event.
+    int64_t framesUnderrun() const { return mFramesUnderrun; }
+    int64_t underruns() const { return mUnderruns; }
+
+    bool    isMaster() const { return mIsMaster; }
+
+private:
+    MultiPipeReader(const sp<MultiPipe>& pipe, bool isMaster);
+
+    // Consumes up to count frames, copying them to buffer if it is not NULL.
+    size_t  consume(void *buffer, size_t count);
+
+    // Records that frames of the given writer were read, for timestamp translation.
+    void    account(uint16_t writer, uint16_t generation, size_t frames);
+
+    const sp<MultiPipe> mPipe;
+    const bool      mIsMaster;
+    uint32_t        mPosition;          // block being read
+    size_t          mOffset;            // frames of that block already read
+    int64_t         mFramesUnderrun;
+    int64_t         mUnderruns;
+    bool            mUnderrunning;      // the previous read() was short
+
+    // Master reader only: consecutive runs of frames from one writer, most recent last,
+    // used to find the frame of each writer that corresponds to a timestamped position.
+    struct Segment {
+        int64_t     mReaderEnd;         // mFramesRead after the segment
+        int64_t     mWriterEnd;         // writer's consumed frames after the segment
+        uint32_t    mFrames;
+        uint16_t    mWriter;
+        uint16_t    mGeneration;
+    };
+    static const size_t kMaxSegments = 64;  // must be a power of 2
+    Segment         mSegments[kMaxSegments];
+    size_t          mNumSegments;       // total appended, wraps in the array
+    int64_t         mConsumed[MultiPipe::kMaxWriters];
+    uint16_t        mGenerations[MultiPipe::kMaxWriters];
+};
+
+}   // namespace android
+
+#endif  // ANDROID_AUDIO_MULTI_PIPE_H
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MultiPipe_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/nbaio/MultiPipe.h>
+
+#include <atomic>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+// Each frame carries the writer index and a per-writer sequence number.
+struct TestFrame {
+    int32_t writer;
+    int32_t sequence;
+};
+
+static const NBAIO_Format kFormat = Format_from_SR_C(48000, 2, AUDIO_FORMAT_PCM_32_BIT);
+
+template <typename T>
+static void negotiate(const sp<T>& port)
+{
+    size_t numCounterOffers = 0;
+    ASSERT_EQ(0, port->negotiate(&kFormat, 1, NULL, numCounterOffers));
+}
+
+// Writes count frames, retrying short writes, in chunks of 1 to maxChunk frames.
+static void writeAll(const sp<MultiPipeWriter>& writer, int32_t index, int32_t count,
+        size_t maxChunk)
+{
+    std::vector<TestFrame> chunk(maxChunk);
+    unsigned seed = index + 1;
+    int32_t sequence = 0;
+    while (sequence < count) {
+        const size_t frames = std::min((size_t) (count - sequence), 1 + rand_r(&seed) % maxChunk);
+        for (size_t i = 0; i < frames; ++i) {
+            chunk[i] = {index, sequence + (int32_t) i};
+        }
+        size_t done = 0;
+        while (done < frames) {
+            const ssize_t actual = writer->write(&chunk[done], frames - done);
+            ASSERT_GE(actual, 0);
+            done += actual;
+            if (done < frames) {
+                sched_yield();
+            }
+        }
+        sequence += frames;
+    }
+}
+
+TEST(MultiPipeTest, MultipleWritersStress)
+{
+    const int32_t kWriters = 4;
+    const int32_t kFramesPerWriter = 200000;
+    sp<MultiPipe> pipe = new MultiPipe(4096, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, 64 /*blockFrames*/);
+    sp<MultiPipeReader> reader = pipe->createReader();
+    ASSERT_NE(nullptr, reader.get());
+    ASSERT_EQ(nullptr, pipe->createReader().get());
+    negotiate(reader);
+
+    std::vector<sp<MultiPipeWriter>> writers;
+    for (int32_t i = 0; i < kWriters; ++i) {
+        writers.push_back(pipe->createWriter());
+        ASSERT_NE(nullptr, writers.back().get());
+        negotiate(writers.back());
+    }
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < kWriters; ++i) {
+        threads.emplace_back(writeAll, writers[i], writers[i]->id(), kFramesPerWriter,
+                300 /*maxChunk*/);
+    }
+
+    std::vector<int32_t> next(MultiPipe::kMaxWriters, 0);
+    int64_t total = 0;
+    TestFrame frames[256];
+    while (total < (int64_t) kWriters * kFramesPerWriter) {
+        const ssize_t actual = reader->read(frames, 256);
+        ASSERT_GE(actual, 0);
+        for (ssize_t i = 0; i < actual; ++i) {
+            ASSERT_LT(frames[i].writer, (int32_t) MultiPipe::kMaxWriters);
+            // frames of each writer arrive in order and without gaps
+            ASSERT_EQ(next[frames[i].writer]++, frames[i].sequence);
+        }
+        total += actual;
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(0, reader->availableToRead());
+    EXPECT_EQ(total, reader->framesRead());
+    int64_t framesOverrun = 0;
+    for (const sp<MultiPipeWriter> &writer : writers) {
+        EXPECT_EQ(kFramesPerWriter, next[writer->id()]);
+        EXPECT_EQ(kFramesPerWriter, writer->framesWritten());
+        EXPECT_EQ(kFramesPerWriter, writer->framesConsumed());
+        framesOverrun += writer->framesOverrun();
+    }
+    EXPECT_EQ(framesOverrun, pipe->framesOverrun());
+    ALOGD("writer overruns %lld frames in %lld events, reader underruns %lld in %lld events",
+            (long long) pipe->framesOverrun(), (long long) pipe->overruns(),
+            (long long) reader->framesUnderrun(), (long long) reader->underruns());
+}
+
+TEST(MultiPipeTest, BroadcastStress)
+{
+    const int32_t kReaders = 3;
+    const int32_t kFrames = 200000;
+    sp<MultiPipe> pipe = new MultiPipe(2048, kFormat, MultiPipe::MODE_BROADCAST, kReaders);
+    std::vector<sp<MultiPipeReader>> readers;
+    for (int32_t i = 0; i < kReaders; ++i) {
+        readers.push_back(pipe->createReader());
+        ASSERT_NE(nullptr, readers.back().get());
+        negotiate(readers.back());
+    }
+    EXPECT_TRUE(readers[0]->isMaster());
+    EXPECT_FALSE(readers[1]->isMaster());
+    sp<MultiPipeWriter> writer = pipe->createWriter();
+    ASSERT_NE(nullptr, writer.get());
+    ASSERT_EQ(nullptr, pipe->createWriter().get());
+    negotiate(writer);
+
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (int32_t r = 0; r < kReaders; ++r) {
+        threads.emplace_back([&, r] {
+            int32_t next = 0;
+            TestFrame frames[100];
+            while (next < kFrames) {
+                const ssize_t actual = readers[r]->read(frames, 100);
+                for (ssize_t i = 0; i < actual; ++i) {
+                    if (frames[i].sequence != next++) {
+                        failures++;
+                    }
+                }
+                if (actual == 0) {
+                    sched_yield();
+                }
+            }
+        });
+    }
+    writeAll(writer, 0, kFrames, 500 /*maxChunk*/);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(0, failures.load());
+    for (const sp<MultiPipeReader> &reader : readers) {
+        EXPECT_EQ(kFrames, reader->framesRead());
+    }
+    EXPECT_EQ(kFrames, writer->framesConsumed());
+}
+
+TEST(MultiPipeTest, OverrunAndUnderrunCounters)
+{
+    sp<MultiPipe> pipe = new MultiPipe(256, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, 64 /*blockFrames*/);
+    sp<MultiPipeReader> reader = pipe->createReader();
+    sp<MultiPipeWriter> writer = pipe->createWriter();
+    negotiate(reader);
+    negotiate(writer);
+    ASSERT_EQ(256u, pipe->maxFrames());
+
+    TestFrame frames[400] = {};
+    EXPECT_EQ(256, writer->availableToWrite());
+    EXPECT_EQ(256, writer->write(frames, 400));
+    EXPECT_EQ(144, writer->framesOverrun());
+    EXPECT_EQ(1, writer->overruns());
+    EXPECT_EQ(0, writer->write(frames, 10));
+    EXPECT_EQ(154, pipe->framesOverrun());
+    EXPECT_EQ(2, reader->overruns());
+
+    EXPECT_EQ(256, reader->availableToRead());
+    EXPECT_EQ(100, reader->read(frames, 100));
+    EXPECT_EQ(0, reader->underruns());
+    // a partially read block is only freed once it has been read completely
+    EXPECT_EQ(64, writer->availableToWrite());
+    EXPECT_EQ(156, reader->read(frames, 200));
+    EXPECT_EQ(0, reader->read(frames, 10));
+    EXPECT_EQ(54, reader->framesUnderrun());
+    EXPECT_EQ(1, reader->underruns());      // consecutive short reads are one event
+    EXPECT_EQ(256, writer->availableToWrite());
+
+    EXPECT_EQ(10, writer->write(frames, 10));
+    EXPECT_EQ(10, reader->read(frames, 10));
+    EXPECT_EQ(0, reader->read(frames, 1));
+    EXPECT_EQ(2, reader->underruns());
+}
+
+TEST(MultiPipeTest, TimestampTranslatedPerWriter)
+{
+    sp<MultiPipe> pipe = new MultiPipe(1024, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, 100 /*blockFrames*/);
+    sp<MultiPipeReader> reader = pipe->createReader();
+    sp<MultiPipeWriter> a = pipe->createWriter();
+    sp<MultiPipeWriter> b = pipe->createWriter();
+    negotiate(reader);
+    negotiate(a);
+    negotiate(b);
+
+    // reader order: a[0, 100) b[0, 100) a[100, 200) b[100, 150)
+    TestFrame frames[200] = {};
+    ASSERT_EQ(100, a->write(frames, 100));
+    ASSERT_EQ(100, b->write(frames, 100));
+    ASSERT_EQ(100, a->write(frames, 100));
+    ASSERT_EQ(50, b->write(frames, 50));
+    ASSERT_EQ(350, reader->read(frames, 200) + reader->read(frames, 200));
+
+    ExtendedTimestamp timestamp;
+    EXPECT_EQ(INVALID_OPERATION, a->getTimestamp(timestamp));
+
+    // reader frame 250 is a's frame 150 and follows b's frame 100
+    ExtendedTimestamp presented;
+    presented.mPosition[ExtendedTimestamp::LOCATION_KERNEL] = 250;
+    presented.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL] = 123456789;
+    reader->onTimestamp(presented);
+
+    ASSERT_EQ(OK, a->getTimestamp(timestamp));
+    EXPECT_EQ(150, timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL]);
+    EXPECT_EQ(123456789, timestamp.mTimeNs[ExtendedTimestamp::LOCATION_KERNEL]);
+    ASSERT_EQ(OK, b->getTimestamp(timestamp));
+    EXPECT_EQ(100, timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL]);
+
+    // once everything has been presented, each writer is at its total
+    presented.mPosition[ExtendedTimestamp::LOCATION_KERNEL] = 350;
+    reader->onTimestamp(presented);
+    ASSERT_EQ(OK, a->getTimestamp(timestamp));
+    EXPECT_EQ(200, timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL]);
+    ASSERT_EQ(OK, b->getTimestamp(timestamp));
+    EXPECT_EQ(150, timestamp.mPosition[ExtendedTimestamp::LOCATION_KERNEL]);
+}
+
+TEST(MultiPipeTest, WriterSlotReuse)
+{
+    sp<MultiPipe> pipe = new MultiPipe(1024, kFormat);
+    sp<MultiPipeReader> reader = pipe->createReader();
+    negotiate(reader);
+    std::vector<sp<MultiPipeWriter>> writers;
+    for (size_t i = 0; i < MultiPipe::kMaxWriters; ++i) {
+        writers.push_back(pipe->createWriter());
+        ASSERT_NE(nullptr, writers.back().get());
+    }
+    EXPECT_EQ(nullptr, pipe->createWriter().get());
+
+    const size_t id = writers[3]->id();
+    negotiate(writers[3]);
+    TestFrame frames[10] = {};
+    ASSERT_EQ(10, writers[3]->write(frames, 10));
+    ASSERT_EQ(10, reader->read(frames, 10));
+    EXPECT_EQ(10, writers[3]->framesConsumed());
+
+    writers[3].clear();
+    sp<MultiPipeWriter> replacement = pipe->createWriter();
+    ASSERT_NE(nullptr, replacement.get());
+    EXPECT_EQ(id, replacement->id());
+    EXPECT_EQ(0, replacement->framesConsumed());
+    negotiate(replacement);
+    ASSERT_EQ(5, replacement->write(frames, 5));
+    ASSERT_EQ(5, reader->read(frames, 10));
+    EXPECT_EQ(5, replacement->framesConsumed());
+}
+
+}  // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <sched.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <media/nbaio/MultiPipe.h>
+
+using namespace android;
+
+static const NBAIO_Format kFormat = Format_from_SR_C(48000, 2, AUDIO_FORMAT_PCM_FLOAT);
+static constexpr size_t kFrameSize = 2 * sizeof(float);
+
+template <typename T>
+static void negotiate(const sp<T>& port)
+{
+    size_t numCounterOffers = 0;
+    port->negotiate(&kFormat, 1, NULL, numCounterOffers);
+}
+
+static int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Cost of one write() and the matching read() on a single thread, by burst size.
+static void BM_MultiPipe_WriteRead(benchmark::State& state)
+{
+    const size_t frames = state.range(0);
+    sp<MultiPipe> pipe = new MultiPipe(4096, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, 256 /*blockFrames*/);
+    sp<MultiPipeWriter> writer = pipe->createWriter();
+    sp<MultiPipeReader> reader = pipe->createReader();
+    negotiate(writer);
+    negotiate(reader);
+    std::vector<uint8_t> buffer(frames * kFrameSize);
+
+    while (state.KeepRunning()) {
+        writer->write(buffer.data(), frames);
+        reader->read(buffer.data(), frames);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * frames * kFrameSize);
+}
+
+BENCHMARK(BM_MultiPipe_WriteRead)->Arg(64)->Arg(256)->Arg(1024);
+
+// Throughput with range(0) writer threads feeding one reader.
+static void BM_MultiPipe_Writers(benchmark::State& state)
+{
+    const size_t numWriters = state.range(0);
+    const size_t frames = 192;
+    sp<MultiPipe> pipe = new MultiPipe(8192, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, frames);
+    sp<MultiPipeReader> reader = pipe->createReader();
+    negotiate(reader);
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numWriters; ++i) {
+        sp<MultiPipeWriter> writer = pipe->createWriter();
+        negotiate(writer);
+        threads.emplace_back([writer, frames, &done] {
+            std::vector<uint8_t> buffer(frames * kFrameSize);
+            while (!done.load(std::memory_order_relaxed)) {
+                if (writer->write(buffer.data(), frames) == 0) {
+                    sched_yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint8_t> buffer(frames * kFrameSize);
+    int64_t framesRead = 0;
+    while (state.KeepRunning()) {
+        framesRead += reader->read(buffer.data(), frames);
+    }
+    done = true;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    state.SetBytesProcessed(framesRead * kFrameSize);
+    state.counters["overruns"] = pipe->overruns();
+}
+
+BENCHMARK(BM_MultiPipe_Writers)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+// Time from write() on one thread until read() on another returns the frames.
+static void BM_MultiPipe_Latency(benchmark::State& state)
+{
+    sp<MultiPipe> pipe = new MultiPipe(1024, kFormat, MultiPipe::MODE_MULTI_WRITER,
+            1 /*numReaders*/, 64 /*blockFrames*/);
+    sp<MultiPipeWriter> writer = pipe->createWriter();
+    sp<MultiPipeReader> reader = pipe->createReader();
+    negotiate(writer);
+    negotiate(reader);
+
+    std::atomic<bool> done{false};
+    std::atomic<int64_t> latencyNs{0};
+    std::atomic<int64_t> samples{0};
+    std::thread readerThread([&] {
+        float frame[2];
+        while (!done.load(std::memory_order_relaxed)) {
+            int64_t sent;
+            if (reader->read(frame, 1) == 1) {
+                memcpy(&sent, frame, sizeof(sent));
+                latencyNs += nowNs() - sent;
+                ++samples;
+            }
+        }
+    });
+
+    float frame[2];
+    while (state.KeepRunning()) {
+        const int64_t sent = nowNs();
+        memcpy(frame, &sent, sizeof(sent));
+        while (writer->write(frame, 1) == 0) {
+            sched_yield();
+        }
+        // wait for the reader so that each sample measures an empty pipe
+        while (writer->availableToWrite() < (ssize_t) pipe->maxFrames()) {
+            sched_yield();
+        }
+    }
+    done = true;
+    readerThread.join();
+    state.counters["latency_ns"] = samples > 0 ? (double) latencyNs / samples : 0.;
+}
+
+BENCHMARK(BM_MultiPipe_Latency)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NBLog"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <media/nblog/BinaryDump.h>
+#include <media/nblog/Events.h>
+#include <utils/Log.h>
+
+namespace android {
+namespace NBLog {
+
+// Every entry is [type][length][data ...][length], see Entry.h.
+static constexpr size_t kEntryOverhead = 3;
+
+#define FORMAT(event, payloadType, payloadSize) \
+        { event, payloadType, payloadSize, #event }
+
+// Update when adding an Event to Events.h.
+static const binary_dump_format_t kFormats[] = {
+    FORMAT(EVENT_STRING,             PAYLOAD_STRING, 0),
+    FORMAT(EVENT_TIMESTAMP,          PAYLOAD_INT64,  sizeof(int64_t)),
+    FORMAT(EVENT_FMT_START,          PAYLOAD_STRING, 0),
+    FORMAT(EVENT_FMT_AUTHOR,         PAYLOAD_INT32,  sizeof(int)),
+    FORMAT(EVENT_FMT_FLOAT,          PAYLOAD_FLOAT,  sizeof(float)),
+    FORMAT(EVENT_FMT_HASH,           PAYLOAD_INT64,  sizeof(log_hash_t)),
+    FORMAT(EVENT_FMT_INTEGER,        PAYLOAD_INT32,  sizeof(int)),
+    FORMAT(EVENT_FMT_PID,            PAYLOAD_BYTES,  0),
+    FORMAT(EVENT_FMT_STRING,         PAYLOAD_STRING, 0),
+    FORMAT(EVENT_FMT_TIMESTAMP,      PAYLOAD_INT64,  sizeof(int64_t)),
+    FORMAT(EVENT_FMT_END,            PAYLOAD_NONE,   0),
+    FORMAT(EVENT_AUDIO_STATE,        PAYLOAD_BYTES,  0),
+    FORMAT(EVENT_HISTOGRAM_ENTRY_TS, PAYLOAD_BYTES,  0),
+    FORMAT(EVENT_LATENCY,            PAYLOAD_DOUBLE, sizeof(double)),
+    FORMAT(EVENT_OVERRUN,            PAYLOAD_INT64,  sizeof(int64_t)),
+    FORMAT(EVENT_THREAD_INFO,        PAYLOAD_STRUCT, sizeof(thread_info_t)),
+    FORMAT(EVENT_UNDERRUN,           PAYLOAD_INT64,  sizeof(int64_t)),
+    FORMAT(EVENT_WARMUP_TIME,        PAYLOAD_DOUBLE, sizeof(double)),
+    FORMAT(EVENT_WORK_TIME,          PAYLOAD_INT64,  sizeof(int64_t)),
+    FORMAT(EVENT_THREAD_PARAMS,      PAYLOAD_STRUCT, sizeof(thread_params_t)),
+    FORMAT(EVENT_LOG_LINEAR_HIST,    PAYLOAD_STRUCT, sizeof(log_linear_hist_t)),
+};
+
+#undef FORMAT
+
+static_assert(sizeof(kFormats) / sizeof(kFormats[0]) == EVENT_UPPER_BOUND - 1,
+        "kFormats must describe every Event");
+
+const binary_dump_format_t *getBinaryDumpFormat(Event event)
+{
+    for (const binary_dump_format_t &format : kFormats) {
+        if (format.event == event) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
+
+static constexpr uint64_t alignUp(uint64_t value)
+{
+    return (value + 7) & ~(uint64_t)7;
+}
+
+static int64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+
+void BinaryDumpWriter::addSection(const std::string &name, const uint8_t *data, size_t size,
+        size_t lost)
+{
+    mSections.push_back({name, data, data != nullptr ? size : 0, lost});
+}
+
+static int writeFully(int fd, const void *data, size_t size)
+{
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        const ssize_t written = ::write(fd, ptr, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        ptr += written;
+        size -= written;
+    }
+    return 0;
+}
+
+int BinaryDumpWriter::write(int fd) const
+{
+    const size_t numFormats = sizeof(kFormats) / sizeof(kFormats[0]);
+
+    binary_dump_header_t header = {};
+    memcpy(header.magic, kBinaryDumpMagic, sizeof(header.magic));
+    header.version = kBinaryDumpVersion;
+    header.headerSize = sizeof(header);
+    header.numFormats = numFormats;
+    header.formatsOffset = alignUp(sizeof(header));
+    header.numSections = mSections.size();
+    header.sectionsOffset = alignUp(header.formatsOffset + sizeof(kFormats));
+    header.monotonicNs = clockNs(CLOCK_MONOTONIC);
+    header.realtimeNs = clockNs(CLOCK_REALTIME);
+
+    std::vector<binary_dump_section_t> sections(mSections.size());
+    uint64_t offset = alignUp(header.sectionsOffset
+            + mSections.size() * sizeof(binary_dump_section_t));
+    for (size_t i = 0; i < mSections.size(); ++i) {
+        binary_dump_section_t &section = sections[i];
+        memset(&section, 0, sizeof(section));
+        // snprintf() rather than strlcpy(), which the host C library may lack
+        snprintf(section.name, sizeof(section.name), "%s", mSections[i].name.c_str());
+        section.dataOffset = offset;
+        section.dataSize = mSections[i].size;
+        section.lost = mSections[i].lost;
+        offset = alignUp(offset + section.dataSize);
+    }
+
+    // All offsets are already aligned, so only the padding after each part is needed.
+    static const uint8_t kPadding[8] = {};
+    uint64_t position = 0;
+    auto append = [&](const void *data, size_t size) -> int {
+        int err = writeFully(fd, data, size);
+        if (err == 0) {
+            position += size;
+            err = writeFully(fd, kPadding, alignUp(position) - position);
+            position = alignUp(position);
+        }
+        return err;
+    };
+    int err = append(&header, sizeof(header));
+    if (err == 0) {
+        err = append(kFormats, sizeof(kFormats));
+    }
+    if (err == 0 && !sections.empty()) {
+        err = append(sections.data(), sections.size() * sizeof(binary_dump_section_t));
+    }
+    for (size_t i = 0; err == 0 && i < mSections.size(); ++i) {
+        err = append(mSections[i].data, mSections[i].size);
+    }
+    ALOGW_IF(err != 0, "failed to write binary dump: %s", strerror(-err));
+    return err;
+}
+
+// ---------------------------------------------------------------------------
+
+bool BinaryDumpReader::SectionIterator::next(EntryView *entry)
+{
+    if (mPtr >= mEnd) {
+        return false;
+    }
+    // the section has been validated, so this entry is complete
+    entry->type = (Event)mPtr[0];
+    entry->length = mPtr[1];
+    entry->data = mPtr + 2;
+    mPtr += entry->length + kEntryOverhead;
+    return true;
+}
+
+BinaryDumpReader::~BinaryDumpReader()
+{
+    if (mMapped) {
+        munmap(const_cast<uint8_t *>(mData), mSize);
+    }
+}
+
+// static
+std::unique_ptr<BinaryDumpReader> BinaryDumpReader::open(const std::string &path,
+        std::string *error)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = path + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        *error = path + ": empty or unreadable file";
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 /* offset */);
+    close(fd);
+    if (data == MAP_FAILED) {
+        *error = path + ": mmap failed: " + strerror(errno);
+        return nullptr;
+    }
+    std::unique_ptr<BinaryDumpReader> reader(new BinaryDumpReader());
+    reader->mData = (const uint8_t *)data;
+    reader->mSize = st.st_size;
+    reader->mMapped = true;
+    if (!reader->validate(error)) {
+        *error = path + ": " + *error;
+        return nullptr;
+    }
+    return reader;
+}
+
+// static
+std::unique_ptr<BinaryDumpReader> BinaryDumpReader::fromMemory(const void *data, size_t size,
+        std::string *error)
+{
+    std::unique_ptr<BinaryDumpReader> reader(new BinaryDumpReader());
+    reader->mData = (const uint8_t *)data;
+    reader->mSize = size;
+    if (data == nullptr || !reader->validate(error)) {
+        return nullptr;
+    }
+    return reader;
+}
+
+// Checks that [offset, offset + count * elementSize) lies within the dump.
+static bool inRange(uint64_t offset, uint64_t count, uint64_t elementSize, size_t size)
+{
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+bool BinaryDumpReader::validate(std::string *error)
+{
+    if (mSize < sizeof(binary_dump_header_t)) {
+        *error = "truncated header";
+        return false;
+    }
+    // mmap() and the writer both guarantee 8 byte alignment of the start of the dump.
+    if (((uintptr_t)mData & 7) != 0) {
+        *error = "misaligned dump";
+        return false;
+    }
+    mHeader = (const binary_dump_header_t *)mData;
+    if (memcmp(mHeader->magic, kBinaryDumpMagic, sizeof(kBinaryDumpMagic)) != 0) {
+        *error = "not an NBLog binary dump";
+        return false;
+    }
+    if (mHeader->version != kBinaryDumpVersion
+            || mHeader->headerSize < sizeof(binary_dump_header_t)) {
+        *error = "unsupported version " + std::to_string(mHeader->version);
+        return false;
+    }
+    if ((mHeader->formatsOffset & 7) != 0 || (mHeader->sectionsOffset & 7) != 0
+            || !inRange(mHeader->formatsOffset, mHeader->numFormats,
+                    sizeof(binary_dump_format_t), mSize)
+            || !inRange(mHeader->sectionsOffset, mHeader->numSections,
+                    sizeof(binary_dump_section_t), mSize)) {
+        *error = "corrupt table offsets";
+        return false;
+    }
+    // The writer lays out the header, the two tables and the section data in that order,
+    // so that nothing overlaps. The ranges are known to be within the dump by now.
+    const uint64_t formatsEnd = mHeader->formatsOffset
+            + (uint64_t)mHeader->numFormats * sizeof(binary_dump_format_t);
+    const uint64_t sectionsEnd = mHeader->sectionsOffset
+            + (uint64_t)mHeader->numSections * sizeof(binary_dump_section_t);
+    if (mHeader->formatsOffset < mHeader->headerSize || mHeader->sectionsOffset < formatsEnd) {
+        *error = "overlapping tables";
+        return false;
+    }
+    mFormats = (const binary_dump_format_t *)(mData + mHeader->formatsOffset);
+    mSections = (const binary_dump_section_t *)(mData + mHeader->sectionsOffset);
+
+    for (size_t i = 0; i < mHeader->numFormats; ++i) {
+        const binary_dump_format_t &format = mFormats[i];
+        if (memchr(format.name, '\0', sizeof(format.name)) == nullptr) {
+            *error = "unterminated event name";
+            return false;
+        }
+        if (mFormatByEvent[format.event] == nullptr) {
+            mFormatByEvent[format.event] = &format;
+        }
+    }
+
+    // Walk every entry once so that SectionIterator can trust the lengths.
+    uint64_t dataEnd = sectionsEnd;
+    for (size_t i = 0; i < mHeader->numSections; ++i) {
+        const binary_dump_section_t &section = mSections[i];
+        if (memchr(section.name, '\0', sizeof(section.name)) == nullptr
+                || !inRange(section.dataOffset, section.dataSize, 1, mSize)) {
+            *error = "corrupt section " + std::to_string(i);
+            return false;
+        }
+        if (section.dataOffset < dataEnd) {
+            *error = "section " + std::to_string(i) + " overlaps the previous one";
+            return false;
+        }
+        dataEnd = section.dataOffset + section.dataSize;
+        const uint8_t *ptr = mData + section.dataOffset;
+        const uint8_t *end = ptr + section.dataSize;
+        while (ptr < end) {
+            const size_t remaining = end - ptr;
+            if (remaining < kEntryOverhead
+                    || remaining < (size_t)ptr[1] + kEntryOverhead
+                    || ptr[ptr[1] + 2] != ptr[1]
+                    || ptr[0] == EVENT_RESERVED) {
+                *error = "corrupt entry at offset "
+                        + std::to_string(ptr - mData) + " in section " + section.name;
+                return false;
+            }
+            ptr += ptr[1] + kEntryOverhead;
+        }
+    }
+    return true;
+}
+
+BinaryDumpReader::SectionIterator BinaryDumpReader::entries(size_t index) const
+{
+    const binary_dump_section_t &section = mSections[index];
+    const uint8_t *begin = mData + section.dataOffset;
+    return SectionIterator(begin, begin + section.dataSize);
+}
+
+const binary_dump_format_t *BinaryDumpReader::format(Event event) const
+{
+    return mFormatByEvent[event];
+}
+
+const char *BinaryDumpReader::eventName(Event event) const
+{
+    const binary_dump_format_t *format = mFormatByEvent[event];
+    return format != nullptr ? format->name : "EVENT_UNKNOWN";
+}
+
+bool BinaryDumpReader::isCompatible(Event event) const
+{
+    const binary_dump_format_t *theirs = mFormatByEvent[event];
+    const binary_dump_format_t *ours = getBinaryDumpFormat(event);
+    return theirs != nullptr && ours != nullptr
+            && theirs->payloadType == ours->payloadType
+            && theirs->payloadSize == ours->payloadSize;
+}
+
+}   // namespace NBLog
+}   // namespace android
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LogLinearHistogram"
+//#define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+
+#include <media/nblog/LogLinearHistogram.h>
+#include <utils/Log.h>
+
+namespace android {
+namespace ReportPerformance {
+
+// The NBLog entry payload length is stored in a uint8_t.
+static_assert(sizeof(NBLog::log_linear_hist_t) <= 255,
+        "log_linear_hist_t must fit in a single NBLog entry");
+static_assert(LogLinearHistogram::kNumBuckets <= UINT8_MAX,
+        "bucket indices must fit in log_linear_hist_t::first");
+
+// static
+uint32_t LogLinearHistogram::bucketLowerBound(size_t index) {
+    const size_t group = index / kSubBuckets;
+    const size_t sub = index % kSubBuckets;
+    if (group == 0) {
+        return index;
+    }
+    return (uint32_t)(kSubBuckets + sub) << (group - 1);
+}
+
+// static
+uint32_t LogLinearHistogram::bucketUpperBound(size_t index) {
+    const size_t group = index / kSubBuckets;
+    if (group == 0) {
+        return index;
+    }
+    // computed in 64 bits since the last bucket ends at UINT32_MAX.
+    return (uint32_t)(((uint64_t)bucketLowerBound(index) + (1ULL << (group - 1))) - 1);
+}
+
+void LogLinearHistogram::add(const LogLinearHistogram &other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        mCounts[i] += other.mCounts[i];
+    }
+}
+
+void LogLinearHistogram::clear() {
+    memset(mCounts, 0, sizeof(mCounts));
+}
+
+uint64_t LogLinearHistogram::totalCount() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        total += mCounts[i];
+    }
+    return total;
+}
+
+uint32_t LogLinearHistogram::percentile(double percentile) const {
+    const uint64_t total = totalCount();
+    if (total == 0) {
+        return 0;
+    }
+    percentile = std::min(std::max(percentile, 0.), 100.);
+    // rank of the requested value, 1-based
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percentile / 100. * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        seen += mCounts[i];
+        if (seen >= rank) {
+            return bucketUpperBound(i);
+        }
+    }
+    return max();
+}
+
+uint32_t LogLinearHistogram::max() const {
+    for (size_t i = kNumBuckets; i > 0; --i) {
+        if (mCounts[i - 1] != 0) {
+            return bucketUpperBound(i - 1);
+        }
+    }
+    return 0;
+}
+
+std::string LogLinearHistogram::toString() const {
+    std::stringstream ss;
+    ss << "loglinear," << kSubBucketBits << ",{";
+    bool first = true;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        if (mCounts[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            ss << ",";
+        }
+        ss << i << "|" << mCounts[i];
+        first = false;
+    }
+    ss << "}";
+    return ss.str();
+}
+
+std::string LogLinearHistogram::summaryString(double divisor, const char *units) const {
+    const uint64_t total = totalCount();
+    if (total == 0) {
+        return "no data";
+    }
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+            "count=%llu p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f max=%.3f %s",
+            (unsigned long long)total,
+            percentile(50.) / divisor, percentile(90.) / divisor,
+            percentile(99.) / divisor, percentile(99.9) / divisor,
+            max() / divisor, units);
+    return buffer;
+}
+
+static void writeVarint(std::vector<uint8_t> *out, uint32_t value) {
+    while (value >= 0x80) {
+        out->push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back((uint8_t)value);
+}
+
+// Returns the number of bytes read, or 0 if the varint is truncated or too long.
+static size_t readVarint(const uint8_t *data, size_t size, uint32_t *value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < size && i < 5; ++i) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void LogLinearHistogram::serialize(std::vector<uint8_t> *out) const {
+    out->push_back(kVersion);
+    out->push_back(kSubBucketBits);
+    size_t previous = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        if (mCounts[i] == 0) {
+            continue;
+        }
+        writeVarint(out, i - previous);
+        writeVarint(out, mCounts[i]);
+        previous = i;
+    }
+    writeVarint(out, 0);    // index delta
+    writeVarint(out, 0);    // a zero count terminates the list
+}
+
+size_t LogLinearHistogram::deserializeAndAdd(const uint8_t *data, size_t size) {
+    if (size < 2 || data[0] != kVersion || data[1] != kSubBucketBits) {
+        return 0;
+    }
+    size_t offset = 2;
+    size_t index = 0;
+    uint32_t decoded[kNumBuckets] = {};
+    for (;;) {
+        uint32_t delta, count;
+        size_t n = readVarint(data + offset, size - offset, &delta);
+        if (n == 0) {
+            return 0;
+        }
+        offset += n;
+        n = readVarint(data + offset, size - offset, &count);
+        if (n == 0) {
+            return 0;
+        }
+        offset += n;
+        if (count == 0) {
+            break;
+        }
+        index += delta;
+        if (index >= kNumBuckets) {
+            return 0;
+        }
+        decoded[index] += count;
+    }
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        mCounts[i] += decoded[i];
+    }
+    return offset;
+}
+
+size_t LogLinearHistogram::deltaChunks(const LogLinearHistogram &logged,
+        NBLog::HistogramKind kind, uint8_t track,
+        NBLog::log_linear_hist_t *chunks, size_t maxChunks) const {
+    size_t numChunks = 0;
+    size_t i = 0;
+    while (i < kNumBuckets && numChunks < maxChunks) {
+        // skip buckets without new counts
+        if (mCounts[i] == logged.mCounts[i]) {
+            ++i;
+            continue;
+        }
+        NBLog::log_linear_hist_t &chunk = chunks[numChunks++];
+        chunk.kind = kind;
+        chunk.track = track;
+        chunk.first = i;
+        const size_t n = std::min(NBLog::kLogLinearHistChunkBuckets, kNumBuckets - i);
+        size_t last = 0;
+        for (size_t j = 0; j < n; ++j) {
+            chunk.counts[j] = mCounts[i + j] - logged.mCounts[i + j];
+            if (chunk.counts[j] != 0) {
+                last = j;
+            }
+        }
+        chunk.numBuckets = last + 1;
+        i += n;
+    }
+    return numChunks;
+}
+
+void LogLinearHistogram::addChunk(const NBLog::log_linear_hist_t &chunk) {
+    const size_t first = chunk.first;
+    const size_t n = std::min<size_t>(chunk.numBuckets, NBLog::kLogLinearHistChunkBuckets);
+    if (first >= kNumBuckets || n > kNumBuckets - first) {
+        ALOGW("ignoring malformed histogram chunk first=%zu numBuckets=%zu", first, n);
+        return;
+    }
+    for (size_t j = 0; j < n; ++j) {
+        mCounts[first + j] += chunk.counts[j];
+    }
+}
+
+}   // namespace ReportPerformance
+}   // namespace android
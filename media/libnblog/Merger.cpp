@@ -167,6 +167,10 @@ void MergeReader::processSnapshot(Snapshot &snapshot, int author)
             const double timeMs = it.payload<double>();
             data.warmupHist.add(timeMs);
         } break;
+        case EVENT_LOG_LINEAR_HIST: {
+            const log_linear_hist_t chunk = it.payload<log_linear_hist_t>();
+            data.addLogLinearHistChunk(chunk);
+        } break;
         case EVENT_UNDERRUN: {
             const int64_t ts = it.payload<int64_t>();
             data.underruns++;
@@ -230,6 +234,7 @@ void MergeReader::dump(int fd, const Vector<String16>& args)
     // TODO: add a mutex around media.log dump
     // Options for dumpsys
     bool pa = false, json = false, plots = false, retro = false;
+    bool hist = false, histBinary = false;
     for (const auto &arg : args) {
         if (arg == String16("--pa")) {
             pa = true;
@@ -239,6 +244,10 @@ void MergeReader::dump(int fd, const Vector<String16>& args)
             plots = true;
         } else if (arg == String16("--retro")) {
             retro = true;
+        } else if (arg == String16("--hist")) {
+            hist = true;
+        } else if (arg == String16("--hist-binary")) {
+            histBinary = true;
         }
     }
     if (pa) {
@@ -253,6 +262,12 @@ void MergeReader::dump(int fd, const Vector<String16>& args)
     if (retro) {
         ReportPerformance::dumpRetro(fd, mThreadPerformanceData);
     }
+    if (hist) {
+        ReportPerformance::dumpLogLinearHistograms(fd, mThreadPerformanceData);
+    }
+    if (histBinary) {
+        ReportPerformance::dumpLogLinearHistogramsBinary(fd, mThreadPerformanceData);
+    }
 }
 
 void MergeReader::handleAuthor(const AbstractEntry &entry, String8 *body)
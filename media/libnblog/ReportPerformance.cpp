@@ -51,6 +51,9 @@ static std::unique_ptr<Json::Value> dumpToJson(const PerformanceData& data)
     root["workMsHist"] = data.workHist.toString();
     root["latencyMsHist"] = data.latencyHist.toString();
     root["warmupMsHist"] = data.warmupHist.toString();
+    root["cycleNsHist"] = data.cycleHist.toString();
+    root["mixNsHist"] = data.mixHist.toString();
+    root["trackHookNsHist"] = data.allTrackHookHist().toString();
     root["underruns"] = (Json::Value::Int64)data.underruns;
     root["overruns"] = (Json::Value::Int64)data.overruns;
     root["activeMs"] = (Json::Value::Int64)ns2ms(data.active);
@@ -97,6 +100,103 @@ void dumpJson(int fd, const std::map<int, PerformanceData>& threadDataMap)
     write(fd, rootStr.c_str(), rootStr.size());
 }
 
+void dumpLogLinearHistograms(int fd, const std::map<int, PerformanceData>& threadDataMap)
+{
+    if (fd < 0) {
+        return;
+    }
+
+    std::map<NBLog::ThreadType, PerformanceData> merged;
+    std::stringstream ss;
+    for (const auto &item : threadDataMap) {
+        const PerformanceData& data = item.second;
+        if (data.cycleHist.totalCount() == 0 && data.mixHist.totalCount() == 0
+                && data.trackHookHists.empty()) {
+            continue;
+        }
+        ss << "Thread " << item.first << " type=" << NBLog::threadTypeToString(data.threadInfo.type)
+                << " handle=" << data.threadInfo.id << "\n";
+        ss << "  cycle: " << data.cycleHist.summaryString(1e6, "ms") << "\n";
+        ss << "  mix: " << data.mixHist.summaryString(1e6, "ms") << "\n";
+        for (const auto &track : data.trackHookHists) {
+            ss << "  track " << (int)track.first << " hook: "
+                    << track.second.summaryString(1e3, "us") << "\n";
+        }
+        PerformanceData& all = merged[data.threadInfo.type];
+        all.cycleHist.add(data.cycleHist);
+        all.mixHist.add(data.mixHist);
+        for (const auto &track : data.trackHookHists) {
+            all.trackHookHists[track.first].add(track.second);
+        }
+    }
+    for (const auto &item : merged) {
+        ss << "All " << NBLog::threadTypeToString(item.first) << " threads\n";
+        ss << "  cycle: " << item.second.cycleHist.summaryString(1e6, "ms") << "\n";
+        ss << "  mix: " << item.second.mixHist.summaryString(1e6, "ms") << "\n";
+        ss << "  track hook: " << item.second.allTrackHookHist().summaryString(1e3, "us") << "\n";
+    }
+    const std::string str = ss.str();
+    write(fd, str.c_str(), str.size());
+}
+
+static void appendInt32(std::vector<uint8_t> *out, int32_t value)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    out->insert(out->end(), bytes, bytes + sizeof(value));
+}
+
+static void appendHistogram(std::vector<uint8_t> *out, int threadNum,
+        const NBLog::thread_info_t &info, NBLog::HistogramKind kind, uint8_t track,
+        const LogLinearHistogram &hist)
+{
+    if (hist.totalCount() == 0) {
+        return;
+    }
+    appendInt32(out, threadNum);
+    out->push_back((uint8_t)info.type);
+    appendInt32(out, info.id);
+    out->push_back(kind);
+    out->push_back(track);
+    hist.serialize(out);
+}
+
+static void appendHistograms(std::vector<uint8_t> *out, int threadNum,
+        const PerformanceData &data)
+{
+    appendHistogram(out, threadNum, data.threadInfo, NBLog::HIST_CYCLE_TIME, 0, data.cycleHist);
+    appendHistogram(out, threadNum, data.threadInfo, NBLog::HIST_MIX_TIME, 0, data.mixHist);
+    for (const auto &track : data.trackHookHists) {
+        appendHistogram(out, threadNum, data.threadInfo, NBLog::HIST_TRACK_HOOK_TIME,
+                track.first, track.second);
+    }
+}
+
+void dumpLogLinearHistogramsBinary(int fd, const std::map<int, PerformanceData>& threadDataMap)
+{
+    if (fd < 0) {
+        return;
+    }
+
+    static constexpr uint8_t kBinaryVersion = 1;
+    std::vector<uint8_t> out = {'N', 'B', 'L', 'H', kBinaryVersion};
+    std::map<NBLog::ThreadType, PerformanceData> merged;
+    for (const auto &item : threadDataMap) {
+        const PerformanceData& data = item.second;
+        appendHistograms(&out, item.first, data);
+        PerformanceData& all = merged[data.threadInfo.type];
+        all.threadInfo.type = data.threadInfo.type;
+        all.cycleHist.add(data.cycleHist);
+        all.mixHist.add(data.mixHist);
+        for (const auto &track : data.trackHookHists) {
+            all.trackHookHists[track.first].add(track.second);
+        }
+    }
+    for (const auto &item : merged) {
+        appendHistograms(&out, -1 /*threadNum*/, item.second);
+    }
+    write(fd, out.data(), out.size());
+}
+
 void dumpPlots(int fd, const std::map<int, PerformanceData>& threadDataMap)
 {
     if (fd < 0) {
@@ -158,6 +258,9 @@ bool sendToMediaMetrics(const PerformanceData& data)
     static constexpr char kThreadWorkHist[] = "android.media.audiothread.workMs.hist";
     static constexpr char kThreadLatencyHist[] = "android.media.audiothread.latencyMs.hist";
     static constexpr char kThreadWarmupHist[] = "android.media.audiothread.warmupMs.hist";
+    static constexpr char kThreadCycleHist[] = "android.media.audiothread.cycleNs.hist";
+    static constexpr char kThreadMixHist[] = "android.media.audiothread.mixNs.hist";
+    static constexpr char kThreadTrackHookHist[] = "android.media.audiothread.trackHookNs.hist";
     static constexpr char kThreadUnderruns[] = "android.media.audiothread.underruns";
     static constexpr char kThreadOverruns[] = "android.media.audiothread.overruns";
     static constexpr char kThreadActive[] = "android.media.audiothread.activeMs";
@@ -185,6 +288,19 @@ bool sendToMediaMetrics(const PerformanceData& data)
         item->setCString(kThreadWarmupHist, warmupHist.toString().c_str());
     }
 
+    if (data.cycleHist.totalCount() > 0) {
+        item->setCString(kThreadCycleHist, data.cycleHist.toString().c_str());
+    }
+
+    if (data.mixHist.totalCount() > 0) {
+        item->setCString(kThreadMixHist, data.mixHist.toString().c_str());
+    }
+
+    const LogLinearHistogram trackHookHist = data.allTrackHookHist();
+    if (trackHookHist.totalCount() > 0) {
+        item->setCString(kThreadTrackHookHist, trackHookHist.toString().c_str());
+    }
+
     if (data.underruns > 0) {
         item->setInt64(kThreadUnderruns, data.underruns);
     }
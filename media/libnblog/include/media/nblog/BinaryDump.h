@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MEDIA_NBLOG_BINARY_DUMP_H
+#define ANDROID_MEDIA_NBLOG_BINARY_DUMP_H
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <media/nblog/Events.h>
+
+namespace android {
+namespace NBLog {
+
+// Binary dump of NBLog buffers.
+//
+// Instead of formatting entries as text inside the audioserver, the raw entries of each
+// reader's snapshot are written out unchanged, together with a table describing every
+// Event type known to the writer. The file can be mmap()ed and iterated in place by an
+// offline tool (see tools/nblog_analyze.cpp). The layout and the entry lengths are
+// validated on open, so that iterating never reads past the end of a section.
+//
+// Layout, all integers in host (little endian) byte order, all offsets 8 byte aligned,
+// each part starting after the end of the previous one:
+//    binary_dump_header_t
+//    binary_dump_format_t[numFormats]
+//    binary_dump_section_t[numSections]
+//    entry data of each section, referenced by binary_dump_section_t::dataOffset
+
+constexpr char kBinaryDumpMagic[4] = {'N', 'B', 'L', 'B'};
+constexpr uint32_t kBinaryDumpVersion = 1;
+
+// How to interpret the payload of an Event, recorded in the format table so that a
+// tool built against an older Events.h can still skip or decode newer entries.
+enum PayloadType : uint8_t {
+    PAYLOAD_NONE,               // no payload
+    PAYLOAD_BYTES,              // opaque, variable length
+    PAYLOAD_STRING,             // ASCII string, not NUL-terminated
+    PAYLOAD_INT32,
+    PAYLOAD_INT64,
+    PAYLOAD_FLOAT,
+    PAYLOAD_DOUBLE,
+    PAYLOAD_STRUCT,             // fixed size struct declared in Events.h
+};
+
+struct binary_dump_header_t {
+    char     magic[4];              // kBinaryDumpMagic
+    uint32_t version;               // kBinaryDumpVersion
+    uint32_t headerSize;            // sizeof(binary_dump_header_t)
+    uint32_t numFormats;
+    uint64_t formatsOffset;
+    uint32_t numSections;
+    uint32_t reserved;
+    uint64_t sectionsOffset;
+    int64_t  monotonicNs;           // CLOCK_MONOTONIC when the dump was taken
+    int64_t  realtimeNs;            // CLOCK_REALTIME when the dump was taken
+};
+
+struct binary_dump_format_t {
+    uint8_t  event;                 // Event
+    uint8_t  payloadType;           // PayloadType
+    uint16_t payloadSize;           // for fixed size payloads, otherwise 0
+    char     name[28];              // NUL-terminated
+};
+
+struct binary_dump_section_t {
+    char     name[48];              // reader name, NUL-terminated and possibly truncated
+    uint64_t dataOffset;
+    uint64_t dataSize;              // bytes of complete entries
+    uint64_t lost;                  // bytes lost by the reader before the snapshot
+};
+
+static_assert(sizeof(binary_dump_header_t) == 56, "binary_dump_header_t layout changed");
+static_assert(sizeof(binary_dump_format_t) == 32, "binary_dump_format_t layout changed");
+static_assert(sizeof(binary_dump_section_t) == 72, "binary_dump_section_t layout changed");
+
+// Format table entry for |event| as known to this build, or nullptr for an unknown event.
+const binary_dump_format_t *getBinaryDumpFormat(Event event);
+
+// Collects snapshots and writes them as a binary dump.
+class BinaryDumpWriter {
+public:
+    // |data| must contain complete entries, e.g. [Snapshot::begin(), Snapshot::end()).
+    // The data is referenced, not copied, until write() returns.
+    void addSection(const std::string &name, const uint8_t *data, size_t size, size_t lost);
+
+    // Writes the dump to |fd|. Returns 0 on success or a negative errno.
+    int write(int fd) const;
+
+private:
+    struct Section {
+        std::string name;
+        const uint8_t *data;
+        size_t size;
+        size_t lost;
+    };
+    std::vector<Section> mSections;
+};
+
+// Read only view of a binary dump, either mmap()ed from a file or in caller memory.
+class BinaryDumpReader {
+public:
+    // A decoded entry; data points into the dump.
+    struct EntryView {
+        Event type;
+        uint8_t length;
+        const uint8_t *data;
+    };
+
+    // Iterates over the entries of one section without copying.
+    class SectionIterator {
+    public:
+        // Returns false at the end of the section.
+        bool next(EntryView *entry);
+    private:
+        friend class BinaryDumpReader;
+        SectionIterator(const uint8_t *begin, const uint8_t *end) : mPtr(begin), mEnd(end) {}
+        const uint8_t *mPtr;
+        const uint8_t *mEnd;
+    };
+
+    ~BinaryDumpReader();
+
+    // Maps the file at |path|. On failure returns nullptr and sets |error|.
+    static std::unique_ptr<BinaryDumpReader> open(const std::string &path, std::string *error);
+
+    // Validates a dump held in caller memory, which must outlive the reader.
+    static std::unique_ptr<BinaryDumpReader> fromMemory(const void *data, size_t size,
+            std::string *error);
+
+    const binary_dump_header_t &header() const { return *mHeader; }
+
+    size_t numSections() const { return mHeader->numSections; }
+    const binary_dump_section_t &section(size_t index) const { return mSections[index]; }
+    SectionIterator entries(size_t index) const;
+
+    // Format of |event| as recorded by the writer of the dump, or nullptr if the writer
+    // did not know the event.
+    const binary_dump_format_t *format(Event event) const;
+
+    // Name of |event| from the dump's format table.
+    const char *eventName(Event event) const;
+
+    // True if |event| has the payload layout this build expects, so that it is safe to
+    // decode with the struct declared in Events.h.
+    bool isCompatible(Event event) const;
+
+private:
+    BinaryDumpReader() = default;
+    bool validate(std::string *error);
+
+    const uint8_t *mData = nullptr;
+    size_t mSize = 0;
+    bool mMapped = false;
+    const binary_dump_header_t *mHeader = nullptr;
+    const binary_dump_format_t *mFormats = nullptr;
+    const binary_dump_section_t *mSections = nullptr;
+    // index by Event, nullptr if absent
+    const binary_dump_format_t *mFormatByEvent[UINT8_MAX + 1] = {};
+};
+
+}   // namespace NBLog
+}   // namespace android
+
+#endif  // ANDROID_MEDIA_NBLOG_BINARY_DUMP_H
@@ -68,6 +68,7 @@ enum Event : uint8_t {
     EVENT_WARMUP_TIME,          // thread warmup time
     EVENT_WORK_TIME,            // the time a thread takes to do work, e.g. read, write, etc.
     EVENT_THREAD_PARAMS,        // see thread_params_t below
+    EVENT_LOG_LINEAR_HIST,      // see log_linear_hist_t below
 
     EVENT_UPPER_BOUND,          // to check for invalid events
 };
@@ -132,6 +133,42 @@ struct thread_params_t {
     unsigned sampleRate = 0;        // in frames per second
 };
 
+// Which measurement a log_linear_hist_t belongs to.
+enum HistogramKind : uint8_t {
+    HIST_CYCLE_TIME,            // wall clock time of a fast thread cycle
+    HIST_MIX_TIME,              // time spent in AudioMixer::process() per cycle
+    HIST_TRACK_HOOK_TIME,       // time spent in a fast track's provider hooks per cycle
+    HIST_KIND_COUNT,
+};
+
+inline const char *histogramKindToString(HistogramKind kind) {
+    switch (kind) {
+    case HIST_CYCLE_TIME:
+        return "cycle";
+    case HIST_MIX_TIME:
+        return "mix";
+    case HIST_TRACK_HOOK_TIME:
+        return "trackHook";
+    default:
+        return "unknown";
+    }
+}
+
+// Number of buckets carried by one log_linear_hist_t, chosen so the entry fits in
+// the maximum NBLog entry payload.
+constexpr size_t kLogLinearHistChunkBuckets = 60;
+
+// mapped from EVENT_LOG_LINEAR_HIST
+// Counts added to a range of ReportPerformance::LogLinearHistogram buckets since the
+// previous chunk for the same kind and track. A histogram is logged as one or more chunks.
+struct log_linear_hist_t {
+    HistogramKind kind = HIST_CYCLE_TIME;
+    uint8_t track = 0;              // fast track index for HIST_TRACK_HOOK_TIME, otherwise 0
+    uint8_t first = 0;              // index of the bucket in counts[0]
+    uint8_t numBuckets = 0;         // number of valid entries in counts
+    uint32_t counts[kLogLinearHistChunkBuckets];
+};
+
 template <Event E> struct get_mapped;
 #define MAP_EVENT_TO_TYPE(E, T) \
 template<> struct get_mapped<E> { \
@@ -149,6 +186,7 @@ MAP_EVENT_TO_TYPE(EVENT_UNDERRUN, int64_t);
 MAP_EVENT_TO_TYPE(EVENT_WARMUP_TIME, double);
 MAP_EVENT_TO_TYPE(EVENT_WORK_TIME, int64_t);
 MAP_EVENT_TO_TYPE(EVENT_THREAD_PARAMS, thread_params_t);
+MAP_EVENT_TO_TYPE(EVENT_LOG_LINEAR_HIST, log_linear_hist_t);
 
 }   // namespace NBLog
 }   // namespace android
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MEDIA_NBLOG_LOG_LINEAR_HISTOGRAM_H
+#define ANDROID_MEDIA_NBLOG_LOG_LINEAR_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <media/nblog/Events.h>
+
+namespace android {
+namespace ReportPerformance {
+
+/*
+ * LogLinearHistogram counts 32-bit values (typically nanoseconds) in buckets whose width
+ * grows with the magnitude of the value, in the style of an HDR histogram. Values below
+ * 2 * kSubBuckets are counted exactly; above that each power of two is split into
+ * kSubBuckets linear buckets, so the relative error of any recorded value is at most
+ * 1 / kSubBuckets.
+ *
+ * The layout is a fixed-size array of counters, so the histogram can live in shared
+ * dump state. add() is a single increment and is safe to call from a real-time thread.
+ * Like the other dump state, there is a single writer and no synchronization; readers
+ * must tolerate counters that are updated while they are being read.
+ */
+class LogLinearHistogram {
+public:
+    static constexpr uint32_t kSubBucketBits = 3;
+    static constexpr uint32_t kSubBuckets = 1 << kSubBucketBits;
+    // One group of exact values, then one group per power of two from 2^kSubBucketBits
+    // up to 2^31.
+    static constexpr size_t kNumBuckets = (33 - kSubBucketBits) * kSubBuckets;
+
+    static inline size_t bucketIndex(uint32_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        const uint32_t msb = 31 - __builtin_clz(value);
+        const uint32_t sub = (value >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+        return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+
+    // Smallest value counted in bucket |index|.
+    static uint32_t bucketLowerBound(size_t index);
+    // Largest value counted in bucket |index|.
+    static uint32_t bucketUpperBound(size_t index);
+
+    inline void add(uint32_t value) {
+        mCounts[bucketIndex(value)]++;
+    }
+
+    // Adds the counts of |other| to this histogram.
+    void add(const LogLinearHistogram &other);
+
+    void clear();
+
+    uint64_t totalCount() const;
+
+    uint32_t count(size_t index) const { return mCounts[index]; }
+
+    // Returns the upper bound of the bucket containing the |percentile|th value,
+    // 0 <= percentile <= 100, or 0 if the histogram is empty.
+    uint32_t percentile(double percentile) const;
+
+    // Upper bound of the highest non-empty bucket, or 0 if the histogram is empty.
+    uint32_t max() const;
+
+    // Serializes the histogram as a string for Media Metrics, listing only non-empty
+    // buckets:
+    //   loglinear,subBucketBits,{index|count,...}
+    std::string toString() const;
+
+    // One line summary of count and percentiles, with values divided by |divisor|.
+    std::string summaryString(double divisor, const char *units) const;
+
+    // Appends a compact binary encoding to |out|: a version byte, kSubBucketBits, then
+    // (index delta, count) varint pairs for non-empty buckets, terminated by a zero count.
+    void serialize(std::vector<uint8_t> *out) const;
+
+    // Decodes one histogram written by serialize() and adds it to this histogram.
+    // Returns the number of bytes consumed, or 0 if the data is malformed.
+    size_t deserializeAndAdd(const uint8_t *data, size_t size);
+
+    // Fills |chunks| with the bucket counts added since |logged|, for logging through NBLog.
+    // Ranges of buckets with no new counts are skipped. Returns the number of chunks used.
+    size_t deltaChunks(const LogLinearHistogram &logged,
+            NBLog::HistogramKind kind, uint8_t track,
+            NBLog::log_linear_hist_t *chunks, size_t maxChunks) const;
+
+    // Adds the counts of a chunk produced by deltaChunks().
+    void addChunk(const NBLog::log_linear_hist_t &chunk);
+
+    static constexpr size_t kMaxChunks =
+            (kNumBuckets + NBLog::kLogLinearHistChunkBuckets - 1)
+            / NBLog::kLogLinearHistChunkBuckets;
+
+private:
+    static constexpr uint8_t kVersion = 1;
+
+    uint32_t mCounts[kNumBuckets] = {};
+};
+
+}   // namespace ReportPerformance
+}   // namespace android
+
+#endif  // ANDROID_MEDIA_NBLOG_LOG_LINEAR_HISTOGRAM_H
@@ -24,6 +24,7 @@
 #include <vector>
 
 #include <media/nblog/Events.h>
+#include <media/nblog/LogLinearHistogram.h>
 #include <media/nblog/ReportPerformance.h>
 #include <utils/Timers.h>
 
@@ -159,6 +160,10 @@ struct PerformanceData {
     Histogram workHist{kWorkConfig};
     Histogram latencyHist{kLatencyConfig};
     Histogram warmupHist{kWarmupConfig};
+    // Always-on nanosecond histograms logged by the fast threads.
+    LogLinearHistogram cycleHist;
+    LogLinearHistogram mixHist;
+    std::map<uint8_t /*track*/, LogLinearHistogram> trackHookHists;
     int64_t underruns = 0;
     static constexpr size_t kMaxSnapshotsToStore = 256;
     std::deque<std::pair<NBLog::Event, int64_t /*timestamp*/>> snapshots;
@@ -173,6 +178,9 @@ struct PerformanceData {
         workHist.clear();
         latencyHist.clear();
         warmupHist.clear();
+        cycleHist.clear();
+        mixHist.clear();
+        trackHookHists.clear();
         underruns = 0;
         overruns = 0;
         active = 0;
@@ -182,8 +190,35 @@ struct PerformanceData {
     // Return true if performance data has not been recorded yet, false otherwise.
     bool empty() const {
         return workHist.totalCount() == 0 && latencyHist.totalCount() == 0
-                && warmupHist.totalCount() == 0 && underruns == 0 && overruns == 0
-                && active == 0;
+                && warmupHist.totalCount() == 0 && cycleHist.totalCount() == 0
+                && mixHist.totalCount() == 0 && trackHookHists.empty()
+                && underruns == 0 && overruns == 0 && active == 0;
+    }
+
+    // Adds a chunk of an EVENT_LOG_LINEAR_HIST entry to the matching histogram.
+    void addLogLinearHistChunk(const NBLog::log_linear_hist_t &chunk) {
+        switch (chunk.kind) {
+        case NBLog::HIST_CYCLE_TIME:
+            cycleHist.addChunk(chunk);
+            break;
+        case NBLog::HIST_MIX_TIME:
+            mixHist.addChunk(chunk);
+            break;
+        case NBLog::HIST_TRACK_HOOK_TIME:
+            trackHookHists[chunk.track].addChunk(chunk);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Returns the hook time histogram of all tracks combined.
+    LogLinearHistogram allTrackHookHist() const {
+        LogLinearHistogram all;
+        for (const auto &item : trackHookHists) {
+            all.add(item.second);
+        }
+        return all;
     }
 };
 
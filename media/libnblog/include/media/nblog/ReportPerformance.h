@@ -35,6 +35,16 @@ void dumpPlots(int fd, const std::map<int, PerformanceData>& threadDataMap);
 // Dumps snapshots at important events in the past.
 void dumpRetro(int fd, const std::map<int, PerformanceData>& threadDataMap);
 
+// Dumps percentile summaries of the log-linear cycle, mix and track hook histograms,
+// per thread and merged across all threads of the same type.
+void dumpLogLinearHistograms(int fd, const std::map<int, PerformanceData>& threadDataMap);
+
+// Dumps the log-linear histograms in binary, for offline analysis. The format is the
+// magic "NBLH", a version byte, then one record per histogram:
+//   int32 threadNum (-1 for the merge of all threads of a type), uint8 thread type,
+//   int32 I/O handle, uint8 HistogramKind, uint8 track, LogLinearHistogram::serialize().
+void dumpLogLinearHistogramsBinary(int fd, const std::map<int, PerformanceData>& threadDataMap);
+
 // Send one thread's data to media metrics, if the performance data is nontrivial (i.e. not
 // all zero values). Return true if data was sent, false if there is nothing to write
 // or an error occurred while writing.
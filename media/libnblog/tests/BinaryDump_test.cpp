@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <media/nblog/BinaryDump.h>
+
+namespace android {
+namespace NBLog {
+
+namespace {
+
+struct Entry {
+    Event type;
+    std::vector<uint8_t> payload;
+
+    bool operator==(const Entry &other) const {
+        return type == other.type && payload == other.payload;
+    }
+};
+
+// [type][length][payload ...][length], as written by the Writer
+void appendEntry(std::vector<uint8_t> *data, const Entry &entry) {
+    data->push_back(entry.type);
+    data->push_back(entry.payload.size());
+    data->insert(data->end(), entry.payload.begin(), entry.payload.end());
+    data->push_back(entry.payload.size());
+}
+
+std::vector<uint8_t> bytesOf(const void *data, size_t size) {
+    return std::vector<uint8_t>((const uint8_t *)data, (const uint8_t *)data + size);
+}
+
+std::vector<Entry> readEntries(const BinaryDumpReader &reader, size_t section) {
+    std::vector<Entry> entries;
+    BinaryDumpReader::SectionIterator it = reader.entries(section);
+    BinaryDumpReader::EntryView view;
+    while (it.next(&view)) {
+        entries.push_back({view.type, bytesOf(view.data, view.length)});
+    }
+    return entries;
+}
+
+class BinaryDumpTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const int64_t timestamp = 123456789;
+        const int32_t integer = -42;
+        mFirstEntries = {
+            {EVENT_TIMESTAMP, bytesOf(&timestamp, sizeof(timestamp))},
+            {EVENT_STRING, bytesOf("hello", 5)},
+            {EVENT_FMT_END, {}},
+        };
+        mLastEntries = {
+            {EVENT_FMT_INTEGER, bytesOf(&integer, sizeof(integer))},
+            {EVENT_STRING, std::vector<uint8_t>(255, 'a')},  // the longest entry
+        };
+        for (const Entry &entry : mFirstEntries) {
+            appendEntry(&mFirstData, entry);
+        }
+        for (const Entry &entry : mLastEntries) {
+            appendEntry(&mLastData, entry);
+        }
+
+        BinaryDumpWriter writer;
+        writer.addSection("first", mFirstData.data(), mFirstData.size(), 0 /* lost */);
+        writer.addSection("empty", nullptr, 0, 0 /* lost */);
+        writer.addSection(std::string(60, 'x'), mLastData.data(), mLastData.size(), 17);
+        ASSERT_EQ(0, writer.write(mFile.fd));
+
+        std::string contents;
+        ASSERT_TRUE(android::base::ReadFileToString(mFile.path, &contents));
+        mDump.assign(contents.begin(), contents.end());
+    }
+
+    // Validates the first |size| bytes of |dump| in a buffer of exactly that size, so that
+    // the address sanitizer catches any read past the end, then walks all the entries.
+    bool accepts(const std::vector<uint8_t> &dump, size_t size, std::string *error) {
+        std::unique_ptr<uint8_t[]> copy(new uint8_t[size]);
+        memcpy(copy.get(), dump.data(), size);
+        std::unique_ptr<BinaryDumpReader> reader =
+                BinaryDumpReader::fromMemory(copy.get(), size, error);
+        if (reader == nullptr) {
+            return false;
+        }
+        for (size_t i = 0; i < reader->numSections(); ++i) {
+            readEntries(*reader, i);
+        }
+        return true;
+    }
+
+    // Checks that |corrupt| applied to a copy of the dump makes it invalid, for a reason
+    // containing |reason| if not nullptr.
+    void expectRejected(const std::function<void(std::vector<uint8_t> *)> &corrupt,
+            const char *what, const char *reason = nullptr) {
+        std::vector<uint8_t> dump = mDump;
+        corrupt(&dump);
+        std::string error;
+        EXPECT_FALSE(accepts(dump, dump.size(), &error)) << what;
+        EXPECT_FALSE(error.empty()) << what;
+        if (reason != nullptr) {
+            EXPECT_NE(std::string::npos, error.find(reason)) << what << ": " << error;
+        }
+    }
+
+    static binary_dump_header_t *headerOf(std::vector<uint8_t> *dump) {
+        return reinterpret_cast<binary_dump_header_t *>(dump->data());
+    }
+
+    static binary_dump_section_t *sectionOf(std::vector<uint8_t> *dump, size_t index) {
+        return reinterpret_cast<binary_dump_section_t *>(
+                dump->data() + headerOf(dump)->sectionsOffset) + index;
+    }
+
+    TemporaryFile mFile;
+    std::vector<Entry> mFirstEntries;
+    std::vector<Entry> mLastEntries;
+    std::vector<uint8_t> mFirstData;
+    std::vector<uint8_t> mLastData;
+    std::vector<uint8_t> mDump;
+};
+
+}   // namespace
+
+TEST_F(BinaryDumpTest, WriteThenOpen) {
+    std::string error;
+    std::unique_ptr<BinaryDumpReader> reader = BinaryDumpReader::open(mFile.path, &error);
+    ASSERT_NE(nullptr, reader) << error;
+
+    const binary_dump_header_t &header = reader->header();
+    EXPECT_EQ(0, memcmp(kBinaryDumpMagic, header.magic, sizeof(header.magic)));
+    EXPECT_EQ(kBinaryDumpVersion, header.version);
+    EXPECT_EQ(sizeof(binary_dump_header_t), header.headerSize);
+    EXPECT_GT(header.monotonicNs, 0);
+    EXPECT_GT(header.realtimeNs, 0);
+
+    ASSERT_EQ(3u, reader->numSections());
+    EXPECT_STREQ("first", reader->section(0).name);
+    EXPECT_EQ(0u, reader->section(0).lost);
+    EXPECT_EQ(mFirstEntries, readEntries(*reader, 0));
+
+    EXPECT_STREQ("empty", reader->section(1).name);
+    EXPECT_EQ(0u, reader->section(1).dataSize);
+    EXPECT_TRUE(readEntries(*reader, 1).empty());
+
+    // the name is truncated to fit
+    EXPECT_EQ(std::string(sizeof(binary_dump_section_t::name) - 1, 'x'),
+            reader->section(2).name);
+    EXPECT_EQ(17u, reader->section(2).lost);
+    EXPECT_EQ(mLastEntries, readEntries(*reader, 2));
+
+    for (size_t i = 0; i < reader->numSections(); ++i) {
+        EXPECT_EQ(0u, reader->section(i).dataOffset % 8);
+    }
+}
+
+TEST_F(BinaryDumpTest, FormatTable) {
+    std::string error;
+    std::unique_ptr<BinaryDumpReader> reader =
+            BinaryDumpReader::fromMemory(mDump.data(), mDump.size(), &error);
+    ASSERT_NE(nullptr, reader) << error;
+
+    for (int event = EVENT_RESERVED + 1; event < EVENT_UPPER_BOUND; ++event) {
+        SCOPED_TRACE(testing::Message() << "event " << event);
+        const binary_dump_format_t *format = reader->format((Event)event);
+        ASSERT_NE(nullptr, format);
+        EXPECT_EQ(event, format->event);
+        EXPECT_STREQ(getBinaryDumpFormat((Event)event)->name, format->name);
+        EXPECT_TRUE(reader->isCompatible((Event)event));
+    }
+    EXPECT_STREQ("EVENT_TIMESTAMP", reader->eventName(EVENT_TIMESTAMP));
+    EXPECT_EQ(PAYLOAD_INT64, reader->format(EVENT_TIMESTAMP)->payloadType);
+
+    EXPECT_EQ(nullptr, reader->format(EVENT_RESERVED));
+    EXPECT_STREQ("EVENT_UNKNOWN", reader->eventName(EVENT_RESERVED));
+    EXPECT_FALSE(reader->isCompatible(EVENT_UPPER_BOUND));
+}
+
+// A format recorded with another payload layout is not decoded with ours.
+TEST_F(BinaryDumpTest, IncompatibleFormat) {
+    std::vector<uint8_t> dump = mDump;
+    binary_dump_format_t *formats = reinterpret_cast<binary_dump_format_t *>(
+            dump.data() + headerOf(&dump)->formatsOffset);
+    for (uint32_t i = 0; i < headerOf(&dump)->numFormats; ++i) {
+        if (formats[i].event == EVENT_THREAD_INFO) {
+            formats[i].payloadSize++;
+        }
+    }
+    std::string error;
+    std::unique_ptr<BinaryDumpReader> reader =
+            BinaryDumpReader::fromMemory(dump.data(), dump.size(), &error);
+    ASSERT_NE(nullptr, reader) << error;
+    EXPECT_FALSE(reader->isCompatible(EVENT_THREAD_INFO));
+    EXPECT_TRUE(reader->isCompatible(EVENT_TIMESTAMP));
+}
+
+// Only the padding after the last section may be cut off.
+TEST_F(BinaryDumpTest, RejectsTruncatedDumps) {
+    std::vector<uint8_t> dump = mDump;
+    const binary_dump_section_t &last = *sectionOf(&dump, 2);
+    const size_t end = last.dataOffset + last.dataSize;
+    ASSERT_LE(end, mDump.size());
+
+    for (size_t size = 0; size < end; ++size) {
+        std::string error;
+        EXPECT_FALSE(accepts(mDump, size, &error)) << size << " bytes";
+        EXPECT_FALSE(error.empty()) << size << " bytes";
+    }
+    for (size_t size = end; size <= mDump.size(); ++size) {
+        std::string error;
+        EXPECT_TRUE(accepts(mDump, size, &error)) << size << " bytes: " << error;
+    }
+}
+
+TEST_F(BinaryDumpTest, RejectsBadHeader) {
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->magic[3] = 'X';
+    }, "magic");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->version = kBinaryDumpVersion + 1;
+    }, "newer version");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->version = 0;
+    }, "older version");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->headerSize = sizeof(binary_dump_header_t) - 8;
+    }, "short header size");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->headerSize = UINT32_MAX;
+    }, "header size past the end");
+}
+
+TEST_F(BinaryDumpTest, RejectsMisalignedDump) {
+    std::vector<uint8_t> buffer(mDump.size() + 1);
+    memcpy(buffer.data() + 1, mDump.data(), mDump.size());
+    std::string error;
+    EXPECT_EQ(nullptr, BinaryDumpReader::fromMemory(buffer.data() + 1, mDump.size(), &error));
+    EXPECT_FALSE(error.empty());
+}
+
+TEST_F(BinaryDumpTest, RejectsTablesOutOfRange) {
+    const uint64_t size = mDump.size();
+    expectRejected([size](std::vector<uint8_t> *dump) {
+        headerOf(dump)->formatsOffset = size + 8;
+    }, "formats offset past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->formatsOffset = UINT64_MAX & ~7ull;
+    }, "huge formats offset");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->numFormats = UINT32_MAX;
+    }, "format count past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->formatsOffset += 4;
+    }, "misaligned formats offset");
+    expectRejected([size](std::vector<uint8_t> *dump) {
+        headerOf(dump)->sectionsOffset = size + 8;
+    }, "sections offset past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->sectionsOffset = UINT64_MAX & ~7ull;
+    }, "huge sections offset");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->numSections = UINT32_MAX;
+    }, "section count past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->sectionsOffset += 4;
+    }, "misaligned sections offset");
+}
+
+TEST_F(BinaryDumpTest, RejectsSectionsOutOfRange) {
+    const uint64_t size = mDump.size();
+    expectRejected([size](std::vector<uint8_t> *dump) {
+        sectionOf(dump, 2)->dataOffset = size + 8;
+    }, "data offset past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        sectionOf(dump, 2)->dataOffset = UINT64_MAX & ~7ull;
+    }, "huge data offset");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        sectionOf(dump, 2)->dataSize = UINT64_MAX;
+    }, "huge data size");
+    expectRejected([size](std::vector<uint8_t> *dump) {
+        binary_dump_section_t *section = sectionOf(dump, 2);
+        section->dataSize = size - section->dataOffset + 1;
+    }, "data one byte past the end");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        memset(sectionOf(dump, 0)->name, 'n', sizeof(binary_dump_section_t::name));
+    }, "unterminated section name");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        binary_dump_format_t *formats = reinterpret_cast<binary_dump_format_t *>(
+                dump->data() + headerOf(dump)->formatsOffset);
+        memset(formats[0].name, 'n', sizeof(binary_dump_format_t::name));
+    }, "unterminated event name");
+}
+
+TEST_F(BinaryDumpTest, RejectsOverlaps) {
+    // each of these would be valid on its own
+    expectRejected([](std::vector<uint8_t> *dump) {
+        binary_dump_section_t *first = sectionOf(dump, 0);
+        binary_dump_section_t *last = sectionOf(dump, 2);
+        last->dataOffset = first->dataOffset;
+        last->dataSize = first->dataSize;
+    }, "two sections sharing their data", "overlaps");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        binary_dump_section_t *first = sectionOf(dump, 0);
+        binary_dump_section_t *last = sectionOf(dump, 2);
+        last->dataOffset = first->dataOffset + 8;
+        last->dataSize = 0;
+    }, "section starting inside another one", "overlaps");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        sectionOf(dump, 0)->dataOffset = headerOf(dump)->sectionsOffset;
+        sectionOf(dump, 0)->dataSize = 0;
+    }, "section data over the section table", "overlaps");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->sectionsOffset = headerOf(dump)->formatsOffset;
+        headerOf(dump)->numSections = 0;
+    }, "section table over the format table", "overlapping tables");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        headerOf(dump)->formatsOffset = 0;
+        headerOf(dump)->numFormats = 1;
+    }, "format table over the header", "overlapping tables");
+}
+
+TEST_F(BinaryDumpTest, RejectsCorruptEntries) {
+    expectRejected([](std::vector<uint8_t> *dump) {
+        uint8_t *entry = dump->data() + sectionOf(dump, 0)->dataOffset;
+        entry[entry[1] + 2]++;
+    }, "mismatched trailing length");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        // the last entry is the 255 byte string
+        sectionOf(dump, 2)->dataSize--;
+    }, "entry running past the end of its section");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        dump->data()[sectionOf(dump, 0)->dataOffset] = EVENT_RESERVED;
+    }, "reserved event");
+    expectRejected([](std::vector<uint8_t> *dump) {
+        sectionOf(dump, 0)->dataSize = 2;
+    }, "entry shorter than its overhead");
+}
+
+}   // namespace NBLog
+}   // namespace android
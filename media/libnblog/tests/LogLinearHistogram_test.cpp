@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <media/nblog/LogLinearHistogram.h>
+
+namespace android {
+namespace ReportPerformance {
+
+namespace {
+
+using Histogram = LogLinearHistogram;
+
+void expectSameCounts(const Histogram &expected, const Histogram &actual) {
+    for (size_t i = 0; i < Histogram::kNumBuckets; ++i) {
+        EXPECT_EQ(expected.count(i), actual.count(i)) << "bucket " << i;
+    }
+}
+
+// Values spread over all the magnitudes, with counts that need multi-byte varints.
+Histogram makeHistogram() {
+    Histogram histogram;
+    histogram.add(0);
+    histogram.add(UINT32_MAX);
+    for (uint32_t value = 1; value < 100000; value = value * 3 + 1) {
+        for (uint32_t i = 0; i < value % 300; ++i) {
+            histogram.add(value);
+        }
+    }
+    for (int i = 0; i < 200000; ++i) {
+        histogram.add(1234567);
+    }
+    return histogram;
+}
+
+}   // namespace
+
+TEST(LogLinearHistogramTest, ExactSmallValues) {
+    for (uint32_t value = 0; value < 2 * Histogram::kSubBuckets; ++value) {
+        EXPECT_EQ(value, Histogram::bucketIndex(value));
+        EXPECT_EQ(value, Histogram::bucketLowerBound(value));
+        EXPECT_EQ(value, Histogram::bucketUpperBound(value));
+    }
+    // the first bucket wider than one value
+    const size_t index = 2 * Histogram::kSubBuckets;
+    EXPECT_EQ(index, Histogram::bucketIndex(2 * Histogram::kSubBuckets));
+    EXPECT_EQ(index, Histogram::bucketIndex(2 * Histogram::kSubBuckets + 1));
+    EXPECT_EQ(index + 1, Histogram::bucketIndex(2 * Histogram::kSubBuckets + 2));
+}
+
+// The buckets cover all 32-bit values without gaps, and every value maps to the bucket
+// whose bounds contain it.
+TEST(LogLinearHistogramTest, BucketBounds) {
+    EXPECT_EQ(0u, Histogram::bucketIndex(0));
+    EXPECT_EQ(0u, Histogram::bucketLowerBound(0));
+    EXPECT_EQ(Histogram::kNumBuckets - 1, Histogram::bucketIndex(UINT32_MAX));
+    EXPECT_EQ(UINT32_MAX, Histogram::bucketUpperBound(Histogram::kNumBuckets - 1));
+
+    for (size_t i = 0; i < Histogram::kNumBuckets; ++i) {
+        SCOPED_TRACE(testing::Message() << "bucket " << i);
+        const uint32_t lower = Histogram::bucketLowerBound(i);
+        const uint32_t upper = Histogram::bucketUpperBound(i);
+        ASSERT_LE(lower, upper);
+        if (i > 0) {
+            EXPECT_EQ(Histogram::bucketUpperBound(i - 1) + 1, lower);
+        }
+        // both sides of each sub-bucket edge
+        EXPECT_EQ(i, Histogram::bucketIndex(lower));
+        EXPECT_EQ(i, Histogram::bucketIndex(upper));
+        if (lower > 0) {
+            EXPECT_EQ(i - 1, Histogram::bucketIndex(lower - 1));
+        }
+        if (upper < UINT32_MAX) {
+            EXPECT_EQ(i + 1, Histogram::bucketIndex(upper + 1));
+        }
+        // relative error bound
+        EXPECT_LE((uint64_t)(upper - lower) * Histogram::kSubBuckets, lower);
+    }
+}
+
+TEST(LogLinearHistogramTest, Percentile) {
+    Histogram histogram;
+    EXPECT_EQ(0u, histogram.percentile(50.));
+    EXPECT_EQ(0u, histogram.max());
+
+    // exactly counted values
+    for (int i = 0; i < 90; ++i) {
+        histogram.add(3);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.add(12);
+    }
+    EXPECT_EQ(100u, histogram.totalCount());
+    EXPECT_EQ(3u, histogram.percentile(0.));
+    EXPECT_EQ(3u, histogram.percentile(50.));
+    EXPECT_EQ(3u, histogram.percentile(90.));
+    EXPECT_EQ(12u, histogram.percentile(91.));
+    EXPECT_EQ(12u, histogram.percentile(100.));
+    EXPECT_EQ(12u, histogram.percentile(1000.));    // clamped
+    EXPECT_EQ(12u, histogram.max());
+
+    // uniform over 1..10000: the percentiles are the upper bounds of the buckets of the
+    // exact percentiles
+    histogram.clear();
+    EXPECT_EQ(0u, histogram.totalCount());
+    for (uint32_t value = 1; value <= 10000; ++value) {
+        histogram.add(value);
+    }
+    for (double p : {1., 10., 50., 90., 99., 99.9, 100.}) {
+        SCOPED_TRACE(testing::Message() << "p" << p);
+        const uint32_t exact = (uint32_t)(p / 100. * 10000 + 0.5);
+        const uint32_t expected = Histogram::bucketUpperBound(Histogram::bucketIndex(exact));
+        EXPECT_EQ(expected, histogram.percentile(p));
+        EXPECT_LE(expected - exact, exact / Histogram::kSubBuckets);
+    }
+    EXPECT_EQ(Histogram::bucketUpperBound(Histogram::bucketIndex(10000)), histogram.max());
+}
+
+TEST(LogLinearHistogramTest, AddHistogram) {
+    const Histogram histogram = makeHistogram();
+    Histogram sum = histogram;
+    sum.add(histogram);
+    EXPECT_EQ(2 * histogram.totalCount(), sum.totalCount());
+    for (size_t i = 0; i < Histogram::kNumBuckets; ++i) {
+        EXPECT_EQ(2 * histogram.count(i), sum.count(i)) << "bucket " << i;
+    }
+}
+
+TEST(LogLinearHistogramTest, SerializeRoundTrip) {
+    const Histogram histogram = makeHistogram();
+    std::vector<uint8_t> data;
+    histogram.serialize(&data);
+
+    Histogram decoded;
+    EXPECT_EQ(data.size(), decoded.deserializeAndAdd(data.data(), data.size()));
+    expectSameCounts(histogram, decoded);
+
+    // adds to the existing counts
+    EXPECT_EQ(data.size(), decoded.deserializeAndAdd(data.data(), data.size()));
+    EXPECT_EQ(2 * histogram.totalCount(), decoded.totalCount());
+
+    // an empty histogram
+    std::vector<uint8_t> empty;
+    Histogram().serialize(&empty);
+    Histogram emptyDecoded;
+    EXPECT_EQ(empty.size(), emptyDecoded.deserializeAndAdd(empty.data(), empty.size()));
+    EXPECT_EQ(0u, emptyDecoded.totalCount());
+}
+
+// Each histogram reports its length, so that several can be read back to back.
+TEST(LogLinearHistogramTest, DeserializeConsecutive) {
+    const Histogram first = makeHistogram();
+    Histogram second;
+    second.add(42);
+    std::vector<uint8_t> data;
+    first.serialize(&data);
+    const size_t firstSize = data.size();
+    second.serialize(&data);
+
+    Histogram decoded;
+    ASSERT_EQ(firstSize, decoded.deserializeAndAdd(data.data(), data.size()));
+    expectSameCounts(first, decoded);
+    decoded.clear();
+    ASSERT_EQ(data.size() - firstSize,
+            decoded.deserializeAndAdd(data.data() + firstSize, data.size() - firstSize));
+    expectSameCounts(second, decoded);
+}
+
+// Malformed data is rejected without changing the histogram.
+TEST(LogLinearHistogramTest, DeserializeMalformed) {
+    std::vector<uint8_t> data;
+    makeHistogram().serialize(&data);
+    Histogram decoded;
+    decoded.add(7);
+    const Histogram original = decoded;
+
+    for (size_t size = 0; size < data.size(); ++size) {
+        std::vector<uint8_t> truncated(data.begin(), data.begin() + size);
+        EXPECT_EQ(0u, decoded.deserializeAndAdd(truncated.data(), truncated.size()))
+                << size << " bytes";
+    }
+
+    std::vector<uint8_t> badVersion = data;
+    badVersion[0]++;
+    EXPECT_EQ(0u, decoded.deserializeAndAdd(badVersion.data(), badVersion.size()));
+
+    std::vector<uint8_t> badSubBuckets = data;
+    badSubBuckets[1]++;
+    EXPECT_EQ(0u, decoded.deserializeAndAdd(badSubBuckets.data(), badSubBuckets.size()));
+
+    // a bucket index past the end
+    std::vector<uint8_t> badIndex = {data[0], data[1], 0xf0, 0x01 /* 240 */, 1, 0, 0};
+    EXPECT_EQ(0u, decoded.deserializeAndAdd(badIndex.data(), badIndex.size()));
+
+    // a varint longer than 32 bits
+    std::vector<uint8_t> longVarint = {data[0], data[1], 0x80, 0x80, 0x80, 0x80, 0x80, 0, 0};
+    EXPECT_EQ(0u, decoded.deserializeAndAdd(longVarint.data(), longVarint.size()));
+
+    expectSameCounts(original, decoded);
+}
+
+// Chunks logged between two snapshots, added to the first one, reproduce the second one.
+TEST(LogLinearHistogramTest, DeltaChunks) {
+    const Histogram before = makeHistogram();
+    Histogram after = before;
+    // new counts in the first bucket, in buckets further apart than a chunk, and in the
+    // last bucket
+    after.add(0);
+    after.add(100);
+    after.add(100);
+    after.add(1000000);
+    after.add(UINT32_MAX);
+
+    NBLog::log_linear_hist_t chunks[Histogram::kMaxChunks];
+    const size_t numChunks = after.deltaChunks(before, NBLog::HIST_TRACK_HOOK_TIME,
+            5 /* track */, chunks, Histogram::kMaxChunks);
+    ASSERT_GT(numChunks, 0u);
+    ASSERT_LE(numChunks, Histogram::kMaxChunks);
+
+    Histogram delta;
+    Histogram rebuilt = before;
+    for (size_t i = 0; i < numChunks; ++i) {
+        EXPECT_EQ(NBLog::HIST_TRACK_HOOK_TIME, chunks[i].kind);
+        EXPECT_EQ(5, chunks[i].track);
+        EXPECT_GT(chunks[i].numBuckets, 0);
+        EXPECT_LE(chunks[i].numBuckets, NBLog::kLogLinearHistChunkBuckets);
+        delta.addChunk(chunks[i]);
+        rebuilt.addChunk(chunks[i]);
+    }
+    expectSameCounts(after, rebuilt);
+    EXPECT_EQ(5u, delta.totalCount());
+    EXPECT_EQ(1u, delta.count(0));
+    EXPECT_EQ(2u, delta.count(Histogram::bucketIndex(100)));
+    EXPECT_EQ(1u, delta.count(Histogram::kNumBuckets - 1));
+
+    // nothing new
+    EXPECT_EQ(0u, after.deltaChunks(after, NBLog::HIST_CYCLE_TIME, 0 /* track */,
+            chunks, Histogram::kMaxChunks));
+}
+
+TEST(LogLinearHistogramTest, DeltaChunksFromEmpty) {
+    const Histogram histogram = makeHistogram();
+    NBLog::log_linear_hist_t chunks[Histogram::kMaxChunks];
+    const size_t numChunks = histogram.deltaChunks(Histogram(), NBLog::HIST_CYCLE_TIME,
+            0 /* track */, chunks, Histogram::kMaxChunks);
+    Histogram rebuilt;
+    for (size_t i = 0; i < numChunks; ++i) {
+        rebuilt.addChunk(chunks[i]);
+    }
+    expectSameCounts(histogram, rebuilt);
+
+    // limited to the room given
+    EXPECT_EQ(1u, histogram.deltaChunks(Histogram(), NBLog::HIST_CYCLE_TIME, 0 /* track */,
+            chunks, 1));
+}
+
+TEST(LogLinearHistogramTest, AddChunkIgnoresMalformed) {
+    Histogram histogram;
+    NBLog::log_linear_hist_t chunk;
+    for (size_t j = 0; j < NBLog::kLogLinearHistChunkBuckets; ++j) {
+        chunk.counts[j] = 1;
+    }
+    chunk.first = Histogram::kNumBuckets;
+    chunk.numBuckets = 1;
+    histogram.addChunk(chunk);
+    chunk.first = Histogram::kNumBuckets - 1;
+    chunk.numBuckets = 2;
+    histogram.addChunk(chunk);
+    EXPECT_EQ(0u, histogram.totalCount());
+
+    chunk.numBuckets = 1;
+    histogram.addChunk(chunk);
+    EXPECT_EQ(1u, histogram.count(Histogram::kNumBuckets - 1));
+}
+
+}   // namespace ReportPerformance
+}   // namespace android
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Offline analysis of NBLog binary dumps, as written by
+//     adb exec-out dumpsys media.log --binary > capture.nblog
+//
+// Usage:
+//     nblog_analyze info <dump>
+//     nblog_analyze timeline <dump> [section]
+//     nblog_analyze stats <dump> [section]
+//     nblog_analyze diff <before> <after>
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <media/nblog/BinaryDump.h>
+#include <media/nblog/Events.h>
+#include <media/nblog/LogLinearHistogram.h>
+
+using namespace android;
+using namespace android::NBLog;
+using android::ReportPerformance::LogLinearHistogram;
+
+namespace {
+
+template <typename T>
+T payload(const BinaryDumpReader::EntryView &entry)
+{
+    T value;
+    memcpy(&value, entry.data, sizeof(value));
+    return value;
+}
+
+// Statistics for one section (one NBLog writer) of a dump.
+struct SectionStats {
+    std::string name;
+    thread_info_t info;
+    thread_params_t params;
+    uint64_t entries = 0;
+    uint64_t formatEntries = 0;
+    uint64_t skippedEntries = 0;        // unknown or incompatible layout
+    uint64_t underruns = 0;
+    uint64_t overruns = 0;
+    uint64_t lostBytes = 0;
+    LogLinearHistogram workNs;          // EVENT_WORK_TIME
+    LogLinearHistogram jitterNs;        // |work time - nominal period|
+    double jitterSumSq = 0;             // for the RMS jitter
+    LogLinearHistogram latencyUs;       // EVENT_LATENCY
+    LogLinearHistogram warmupUs;        // EVENT_WARMUP_TIME
+    LogLinearHistogram logged[HIST_KIND_COUNT]; // EVENT_LOG_LINEAR_HIST, all tracks merged
+
+    int64_t nominalPeriodNs() const {
+        return params.sampleRate != 0
+                ? (int64_t)params.frameCount * 1000000000 / params.sampleRate : 0;
+    }
+    double rmsJitterNs() const {
+        const uint64_t n = jitterNs.totalCount();
+        return n != 0 ? sqrt(jitterSumSq / n) : 0.;
+    }
+};
+
+SectionStats computeStats(const BinaryDumpReader &dump, size_t index)
+{
+    SectionStats stats;
+    stats.name = dump.section(index).name;
+    stats.lostBytes = dump.section(index).lost;
+    BinaryDumpReader::SectionIterator it = dump.entries(index);
+    BinaryDumpReader::EntryView entry;
+    while (it.next(&entry)) {
+        ++stats.entries;
+        if (entry.type == EVENT_FMT_START) {
+            ++stats.formatEntries;
+            continue;
+        }
+        if (getBinaryDumpFormat(entry.type) == nullptr || !dump.isCompatible(entry.type)
+                || entry.length < dump.format(entry.type)->payloadSize) {
+            ++stats.skippedEntries;
+            continue;
+        }
+        switch (entry.type) {
+        case EVENT_THREAD_INFO:
+            stats.info = payload<thread_info_t>(entry);
+            break;
+        case EVENT_THREAD_PARAMS:
+            stats.params = payload<thread_params_t>(entry);
+            break;
+        case EVENT_WORK_TIME: {
+            const int64_t ns = payload<int64_t>(entry);
+            stats.workNs.add((uint32_t)std::min<int64_t>(std::max<int64_t>(ns, 0), UINT32_MAX));
+            const int64_t periodNs = stats.nominalPeriodNs();
+            if (periodNs > 0) {
+                const int64_t jitter = llabs(ns - periodNs);
+                stats.jitterNs.add((uint32_t)std::min<int64_t>(jitter, UINT32_MAX));
+                stats.jitterSumSq += (double)jitter * jitter;
+            }
+        } break;
+        case EVENT_LATENCY:
+            stats.latencyUs.add((uint32_t)std::max(0., payload<double>(entry) * 1e3));
+            break;
+        case EVENT_WARMUP_TIME:
+            stats.warmupUs.add((uint32_t)std::max(0., payload<double>(entry) * 1e3));
+            break;
+        case EVENT_UNDERRUN:
+            ++stats.underruns;
+            break;
+        case EVENT_OVERRUN:
+            ++stats.overruns;
+            break;
+        case EVENT_LOG_LINEAR_HIST: {
+            const log_linear_hist_t chunk = payload<log_linear_hist_t>(entry);
+            if (chunk.kind < HIST_KIND_COUNT) {
+                stats.logged[chunk.kind].addChunk(chunk);
+            }
+        } break;
+        default:
+            break;
+        }
+    }
+    return stats;
+}
+
+void printSummary(const char *label, const LogLinearHistogram &hist, double divisor,
+        const char *units)
+{
+    if (hist.totalCount() != 0) {
+        printf("  %-16s %s\n", label, hist.summaryString(divisor, units).c_str());
+    }
+}
+
+void printStats(const SectionStats &stats)
+{
+    printf("%s: type=%s id=%d frameCount=%zu sampleRate=%u\n", stats.name.c_str(),
+            threadTypeToString(stats.info.type), (int)stats.info.id,
+            stats.params.frameCount, stats.params.sampleRate);
+    printf("  entries=%" PRIu64 " formatted=%" PRIu64 " skipped=%" PRIu64
+            " lostBytes=%" PRIu64 " underruns=%" PRIu64 " overruns=%" PRIu64 "\n",
+            stats.entries, stats.formatEntries, stats.skippedEntries, stats.lostBytes,
+            stats.underruns, stats.overruns);
+    printSummary("work time", stats.workNs, 1e6, "ms");
+    if (stats.jitterNs.totalCount() != 0) {
+        printf("  %-16s %s rms=%.3f ms (nominal period %.3f ms)\n", "jitter",
+                stats.jitterNs.summaryString(1e6, "ms").c_str(), stats.rmsJitterNs() / 1e6,
+                stats.nominalPeriodNs() / 1e6);
+    }
+    printSummary("latency", stats.latencyUs, 1e3, "ms");
+    printSummary("warmup", stats.warmupUs, 1e3, "ms");
+    for (size_t kind = 0; kind < HIST_KIND_COUNT; ++kind) {
+        const std::string label =
+                std::string("logged ") + histogramKindToString((HistogramKind)kind);
+        printSummary(label.c_str(), stats.logged[kind], 1e6, "ms");
+    }
+}
+
+// Prints a formatted entry starting at the EVENT_FMT_START |start|, consuming its arguments.
+void printFormatEntry(const BinaryDumpReader::EntryView &start,
+        BinaryDumpReader::SectionIterator *it)
+{
+    std::vector<BinaryDumpReader::EntryView> args;
+    int64_t timestampNs = 0;
+    BinaryDumpReader::EntryView entry;
+    while (it->next(&entry) && entry.type != EVENT_FMT_END) {
+        if (entry.type == EVENT_TIMESTAMP && entry.length == sizeof(int64_t)) {
+            timestampNs = payload<int64_t>(entry);
+        } else if (entry.type != EVENT_FMT_HASH && entry.type != EVENT_FMT_AUTHOR) {
+            args.push_back(entry);
+        }
+    }
+    printf("%" PRId64 ",FMT,", timestampNs);
+    size_t arg = 0;
+    for (size_t i = 0; i < start.length; ++i) {
+        const char c = (char)start.data[i];
+        if (c != '%' || i + 1 == start.length) {
+            putchar(c);
+            continue;
+        }
+        const char spec = (char)start.data[++i];
+        if (spec == '%') {
+            putchar('%');
+            continue;
+        }
+        if (arg >= args.size()) {
+            break;
+        }
+        const BinaryDumpReader::EntryView &value = args[arg++];
+        switch (value.type) {
+        case EVENT_FMT_INTEGER:
+            printf("%d", value.length >= sizeof(int) ? payload<int>(value) : 0);
+            break;
+        case EVENT_FMT_FLOAT:
+            printf("%f", value.length >= sizeof(float) ? payload<float>(value) : 0.f);
+            break;
+        case EVENT_FMT_TIMESTAMP:
+            printf("%" PRId64, value.length >= sizeof(int64_t) ? payload<int64_t>(value) : 0);
+            break;
+        case EVENT_FMT_PID:
+            if (value.length >= sizeof(pid_t)) {
+                printf("%d:%.*s", payload<pid_t>(value), (int)(value.length - sizeof(pid_t)),
+                        (const char *)value.data + sizeof(pid_t));
+            }
+            break;
+        default:
+            printf("%.*s", (int)value.length, (const char *)value.data);
+            break;
+        }
+    }
+    putchar('\n');
+}
+
+void printTimeline(const BinaryDumpReader &dump, size_t index)
+{
+    printf("# %s\n", dump.section(index).name);
+    BinaryDumpReader::SectionIterator it = dump.entries(index);
+    BinaryDumpReader::EntryView entry;
+    while (it.next(&entry)) {
+        if (entry.type == EVENT_FMT_START) {
+            printFormatEntry(entry, &it);
+            continue;
+        }
+        const char *name = dump.eventName(entry.type);
+        if (!dump.isCompatible(entry.type)
+                || entry.length < dump.format(entry.type)->payloadSize) {
+            printf(",%s,<%u bytes>\n", name, entry.length);
+            continue;
+        }
+        // Only underruns and overruns carry a timestamp; other events print an empty one.
+        switch (entry.type) {
+        case EVENT_UNDERRUN:
+        case EVENT_OVERRUN:
+            printf("%" PRId64 ",%s\n", payload<int64_t>(entry), name);
+            break;
+        case EVENT_WORK_TIME:
+            printf(",%s,%" PRId64 "\n", name, payload<int64_t>(entry));
+            break;
+        case EVENT_LATENCY:
+        case EVENT_WARMUP_TIME:
+            printf(",%s,%.3f\n", name, payload<double>(entry));
+            break;
+        case EVENT_THREAD_INFO: {
+            const thread_info_t info = payload<thread_info_t>(entry);
+            printf(",%s,%d,%s\n", name, (int)info.id, threadTypeToString(info.type));
+        } break;
+        case EVENT_THREAD_PARAMS: {
+            const thread_params_t params = payload<thread_params_t>(entry);
+            printf(",%s,%zu,%u\n", name, params.frameCount, params.sampleRate);
+        } break;
+        case EVENT_LOG_LINEAR_HIST: {
+            const log_linear_hist_t chunk = payload<log_linear_hist_t>(entry);
+            printf(",%s,%s,%u,%u,%u\n", name, histogramKindToString(chunk.kind),
+                    chunk.track, chunk.first, chunk.numBuckets);
+        } break;
+        default:
+            printf(",%s,<%u bytes>\n", name, entry.length);
+            break;
+        }
+    }
+}
+
+std::unique_ptr<BinaryDumpReader> openDump(const char *path)
+{
+    std::string error;
+    std::unique_ptr<BinaryDumpReader> dump = BinaryDumpReader::open(path, &error);
+    if (dump == nullptr) {
+        fprintf(stderr, "%s\n", error.c_str());
+    }
+    return dump;
+}
+
+bool sectionSelected(const BinaryDumpReader &dump, size_t index, const char *section)
+{
+    return section == nullptr || strcmp(dump.section(index).name, section) == 0;
+}
+
+void printDelta(const char *label, const LogLinearHistogram &before,
+        const LogLinearHistogram &after, double divisor, const char *units)
+{
+    if (before.totalCount() == 0 && after.totalCount() == 0) {
+        return;
+    }
+    printf("  %-12s", label);
+    static const double kPercentiles[] = {50., 90., 99., 99.9};
+    for (double p : kPercentiles) {
+        const double b = before.percentile(p) / divisor;
+        const double a = after.percentile(p) / divisor;
+        printf(" p%g %.3f->%.3f (%+.3f)", p, b, a, a - b);
+    }
+    printf(" max %.3f->%.3f %s\n", before.max() / divisor, after.max() / divisor, units);
+}
+
+int diff(const BinaryDumpReader &before, const BinaryDumpReader &after)
+{
+    std::map<std::string, SectionStats> beforeStats;
+    for (size_t i = 0; i < before.numSections(); ++i) {
+        SectionStats stats = computeStats(before, i);
+        beforeStats[stats.name] = std::move(stats);
+    }
+    for (size_t i = 0; i < after.numSections(); ++i) {
+        const SectionStats a = computeStats(after, i);
+        auto it = beforeStats.find(a.name);
+        if (it == beforeStats.end()) {
+            printf("%s: only in second dump\n", a.name.c_str());
+            continue;
+        }
+        const SectionStats &b = it->second;
+        printf("%s:\n", a.name.c_str());
+        printf("  underruns %" PRIu64 "->%" PRIu64 " overruns %" PRIu64 "->%" PRIu64 "\n",
+                b.underruns, a.underruns, b.overruns, a.overruns);
+        printDelta("work time", b.workNs, a.workNs, 1e6, "ms");
+        printDelta("jitter", b.jitterNs, a.jitterNs, 1e6, "ms");
+        printDelta("latency", b.latencyUs, a.latencyUs, 1e3, "ms");
+        for (size_t kind = 0; kind < HIST_KIND_COUNT; ++kind) {
+            printDelta(histogramKindToString((HistogramKind)kind), b.logged[kind],
+                    a.logged[kind], 1e6, "ms");
+        }
+        beforeStats.erase(it);
+    }
+    for (const auto &entry : beforeStats) {
+        printf("%s: only in first dump\n", entry.first.c_str());
+    }
+    return EXIT_SUCCESS;
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s info <dump>\n"
+            "       %s timeline <dump> [section]\n"
+            "       %s stats <dump> [section]\n"
+            "       %s diff <before> <after>\n",
+            name, name, name, name);
+}
+
+}   // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string command = argv[1];
+    std::unique_ptr<BinaryDumpReader> dump = openDump(argv[2]);
+    if (dump == nullptr) {
+        return EXIT_FAILURE;
+    }
+    const char *section = argc > 3 ? argv[3] : nullptr;
+
+    if (command == "info") {
+        const binary_dump_header_t &header = dump->header();
+        printf("version=%u formats=%u sections=%u monotonicNs=%" PRId64
+                " realtimeNs=%" PRId64 "\n", header.version, header.numFormats,
+                header.numSections, header.monotonicNs, header.realtimeNs);
+        for (size_t i = 0; i < dump->numSections(); ++i) {
+            const binary_dump_section_t &s = dump->section(i);
+            printf("  %-48s bytes=%" PRIu64 " lost=%" PRIu64 "\n", s.name, s.dataSize, s.lost);
+        }
+    } else if (command == "timeline") {
+        for (size_t i = 0; i < dump->numSections(); ++i) {
+            if (sectionSelected(*dump, i, section)) {
+                printTimeline(*dump, i);
+            }
+        }
+    } else if (command == "stats") {
+        for (size_t i = 0; i < dump->numSections(); ++i) {
+            if (sectionSelected(*dump, i, section)) {
+                printStats(computeStats(*dump, i));
+            }
+        }
+    } else if (command == "diff" && argc == 4) {
+        std::unique_ptr<BinaryDumpReader> after = openDump(argv[3]);
+        if (after == nullptr) {
+            return EXIT_FAILURE;
+        }
+        return diff(*dump, *after);
+    } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
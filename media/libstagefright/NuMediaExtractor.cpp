@@ -620,14 +620,14 @@ status_t NuMediaExtractor::advance() {
 }
 
 status_t NuMediaExtractor::appendVorbisNumPageSamples(
-        MediaBufferBase *mbuf, const sp<ABuffer> &buffer) {
+        MediaBufferBase *mbuf, const sp<ABuffer> &buffer, size_t offset) {
     int32_t numPageSamples;
     if (!mbuf->meta_data().findInt32(
             kKeyValidSamples, &numPageSamples)) {
         numPageSamples = -1;
     }
 
-    memcpy((uint8_t *)buffer->data() + mbuf->range_length(),
+    memcpy((uint8_t *)buffer->data() + offset + mbuf->range_length(),
            &numPageSamples,
            sizeof(numPageSamples));
 
@@ -715,6 +715,90 @@ status_t NuMediaExtractor::readSampleData(const sp<ABuffer> &buffer) {
     return err;
 }
 
+status_t NuMediaExtractor::readSampleDataBatch(
+        const sp<ABuffer> &buffer, size_t maxSamples, Vector<SampleInfo> *infos) {
+    Mutex::Autolock autoLock(mLock);
+
+    infos->clear();
+
+    size_t offset = 0;
+    status_t err = OK;
+    while (infos->size() < maxSamples) {
+        ssize_t minIndex = fetchAllTrackSamples();
+
+        if (minIndex < 0) {
+            err = minIndex;
+            break;
+        }
+
+        TrackInfo *info = &mSelectedTracks.editItemAt(minIndex);
+
+        auto it = info->mSamples.begin();
+        size_t sampleSize = it->mBuffer->range_length();
+
+        if (info->mTrackFlags & kIsVorbis) {
+            sampleSize += sizeof(int32_t);
+        }
+
+        if (buffer->capacity() - offset < sampleSize) {
+            err = -ENOMEM;
+            break;
+        }
+
+        const uint8_t *src =
+            (const uint8_t *)it->mBuffer->data()
+                + it->mBuffer->range_offset();
+
+        memcpy((uint8_t *)buffer->data() + offset, src, it->mBuffer->range_length());
+
+        if (info->mTrackFlags & kIsVorbis) {
+            err = appendVorbisNumPageSamples(it->mBuffer, buffer, offset);
+            if (err != OK) {
+                break;
+            }
+        }
+
+        SampleInfo sampleInfo;
+        sampleInfo.mOffset = offset;
+        sampleInfo.mSize = sampleSize;
+        sampleInfo.mTimeUs = it->mSampleTimeUs;
+        sampleInfo.mFlags = getSampleFlags(it->mBuffer);
+        sampleInfo.mTrackIndex = info->mTrackIndex;
+        infos->push_back(sampleInfo);
+        offset += sampleSize;
+
+        // Equivalent of advance(), without dropping the lock in between.
+        if (it->mBuffer != NULL) {
+            it->mBuffer->release();
+        }
+        info->mSamples.erase(it);
+    }
+
+    buffer->setRange(0, offset);
+
+    if (!infos->empty()) {
+        return OK;
+    }
+    return err;
+}
+
+// static
+uint32_t NuMediaExtractor::getSampleFlags(MediaBufferBase *mbuf) {
+    uint32_t sampleFlags = 0;
+    int32_t val;
+    if (mbuf->meta_data().findInt32(kKeyIsSyncFrame, &val) && val != 0) {
+        sampleFlags |= SAMPLE_FLAG_SYNC;
+    }
+
+    uint32_t type;
+    const void *data;
+    size_t size;
+    if (mbuf->meta_data().findData(kKeyEncryptedSizes, &type, &data, &size)) {
+        sampleFlags |= SAMPLE_FLAG_ENCRYPTED;
+    }
+    return sampleFlags;
+}
+
 status_t NuMediaExtractor::getSampleSize(size_t *sampleSize) {
     Mutex::Autolock autoLock(mLock);
 
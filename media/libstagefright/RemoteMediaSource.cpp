@@ -29,6 +29,8 @@ RemoteMediaSource::RemoteMediaSource(
       mExtractorPlugin(plugin) {}
 
 RemoteMediaSource::~RemoteMediaSource() {
+    // the ring fill thread reads from mTrack.
+    stopSampleRing();
     delete mTrack;
     mExtractorPlugin = nullptr;
 }
@@ -62,6 +64,10 @@ bool RemoteMediaSource::supportNonblockingRead() {
     return mTrack->supportNonblockingRead();
 }
 
+bool RemoteMediaSource::supportSampleRing() {
+    return true;
+}
+
 status_t RemoteMediaSource::pause() {
     return ERROR_UNSUPPORTED;
 }
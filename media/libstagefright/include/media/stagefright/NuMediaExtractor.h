@@ -47,6 +47,15 @@ struct NuMediaExtractor : public RefBase {
         SAMPLE_FLAG_ENCRYPTED   = 2,
     };
 
+    // Per-sample metadata returned by readSampleDataBatch().
+    struct SampleInfo {
+        size_t mOffset;       // byte offset of the sample within the batch buffer
+        size_t mSize;         // sample size in bytes, including any vorbis suffix
+        int64_t mTimeUs;
+        uint32_t mFlags;      // bitmask of "SampleFlags"
+        size_t mTrackIndex;
+    };
+
     typedef IMediaExtractor::EntryPoint EntryPoint;
 
     // identical to IMediaExtractor::GetTrackMetaDataFlags
@@ -89,6 +98,13 @@ struct NuMediaExtractor : public RefBase {
     status_t advance();
     // readSampleData() reads the sample with the lowest timestamp.
     status_t readSampleData(const sp<ABuffer> &buffer);
+    // readSampleDataBatch() reads up to |maxSamples| samples in timestamp order,
+    // packing them back to back into |buffer| and advancing past each one.
+    // Stops early when the next sample does not fit in the remaining capacity.
+    // Returns OK if at least one sample was read, ERROR_END_OF_STREAM if none
+    // are left and -ENOMEM if the first sample does not fit.
+    status_t readSampleDataBatch(
+            const sp<ABuffer> &buffer, size_t maxSamples, Vector<SampleInfo> *infos);
 
     status_t getSampleSize(size_t *sampleSize);
     status_t getSampleTrackIndex(size_t *trackIndex);
@@ -160,7 +176,11 @@ private:
 
     bool getTotalBitrate(int64_t *bitRate) const;
     status_t updateDurationAndBitrate();
-    status_t appendVorbisNumPageSamples(MediaBufferBase *mbuf, const sp<ABuffer> &buffer);
+    status_t appendVorbisNumPageSamples(
+            MediaBufferBase *mbuf, const sp<ABuffer> &buffer, size_t offset = 0);
+    static uint32_t getSampleFlags(MediaBufferBase *mbuf);
+
+    friend class MediaTestHelper;
 
     DISALLOW_EVIL_CONSTRUCTORS(NuMediaExtractor);
 };
@@ -38,6 +38,7 @@ public:
             MediaBufferBase **buffer,
             const MediaSource::ReadOptions *options = NULL);
     virtual bool supportNonblockingRead();
+    virtual bool supportSampleRing();
     virtual status_t pause();
     virtual status_t setStopTimeUs(int64_t stopTimeUs);
 
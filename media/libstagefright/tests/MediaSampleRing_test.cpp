@@ -0,0 +1,286 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MediaSampleRing_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <binder/Binder.h>
+#include <media/IMediaSource.h>
+#include <media/MediaSampleRing.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/MetaDataBase.h>
+#include <utils/Timers.h>
+
+#include <future>
+#include <thread>
+#include <unistd.h>
+
+namespace android {
+
+static const size_t kRingCapacity = 64 * 1024;
+
+static MediaBuffer *makeSample(size_t size, int64_t timeUs) {
+    MediaBuffer *buf = new MediaBuffer(size);
+    uint8_t *data = (uint8_t *)buf->data();
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = (uint8_t)(timeUs + i);
+    }
+    buf->meta_data().setInt64(kKeyTime, timeUs);
+    return buf;
+}
+
+static void checkSample(MediaBufferBase *buf, size_t size, int64_t timeUs) {
+    ASSERT_EQ(size, buf->range_length());
+    int64_t sampleTimeUs;
+    ASSERT_TRUE(buf->meta_data().findInt64(kKeyTime, &sampleTimeUs));
+    EXPECT_EQ(timeUs, sampleTimeUs);
+    const uint8_t *data = (const uint8_t *)buf->data() + buf->range_offset();
+    for (size_t i = 0; i < size; ++i) {
+        ASSERT_EQ((uint8_t)(timeUs + i), data[i]) << "at byte " << i;
+    }
+}
+
+// Sample sizes cycle through small audio-like frames and larger ones so the ring
+// wraps at many different offsets.
+static size_t sampleSize(int64_t index) {
+    return 1 + (index * 37) % 3000;
+}
+
+static void produce(const sp<MediaSampleRing> &ring, int64_t count) {
+    for (int64_t i = 0; i < count; ++i) {
+        MediaBuffer *buf = makeSample(sampleSize(i), i);
+        status_t err;
+        while ((err = ring->writeSample(buf)) == WOULD_BLOCK) {
+            ring->waitForSpace(-1);
+        }
+        ASSERT_EQ(OK, err);
+        buf->release();
+    }
+    while (ring->writeStatus(ERROR_END_OF_STREAM) == WOULD_BLOCK) {
+        ring->waitForSpace(-1);
+    }
+}
+
+TEST(MediaSampleRingTest, DeliversSamplesInOrder) {
+    sp<MediaSampleRing> ring = MediaSampleRing::CreateLocal(kRingCapacity);
+    ASSERT_NE(nullptr, ring.get());
+
+    const int64_t kNumSamples = 20000;
+    std::thread producer(produce, ring, kNumSamples);
+
+    int64_t next = 0;
+    status_t err = OK;
+    while (err == OK) {
+        Vector<MediaBufferBase *> buffers;
+        err = ring->readMultiple(&buffers, 16 /* maxNumBuffers */, 5000 /* timeoutMs */);
+        ASSERT_NE(TIMED_OUT, err);
+        ASSERT_LE(buffers.size(), 16u);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            checkSample(buffers[i], sampleSize(next), next);
+            buffers[i]->release();
+            ++next;
+        }
+    }
+    producer.join();
+    EXPECT_EQ(ERROR_END_OF_STREAM, err);
+    EXPECT_EQ(kNumSamples, next);
+
+    // end of stream is sticky.
+    Vector<MediaBufferBase *> buffers;
+    EXPECT_EQ(ERROR_END_OF_STREAM, ring->readMultiple(&buffers, 1, 0 /* timeoutMs */));
+    EXPECT_TRUE(buffers.isEmpty());
+}
+
+TEST(MediaSampleRingTest, FormatChangeIsNotSticky) {
+    sp<MediaSampleRing> ring = MediaSampleRing::CreateLocal(kRingCapacity);
+    ASSERT_NE(nullptr, ring.get());
+
+    MediaBuffer *buf = makeSample(100, 1);
+    ASSERT_EQ(OK, ring->writeSample(buf));
+    ASSERT_EQ(OK, ring->writeStatus(INFO_FORMAT_CHANGED));
+    ASSERT_EQ(OK, ring->writeSample(buf));
+    buf->release();
+
+    Vector<MediaBufferBase *> buffers;
+    ASSERT_EQ(OK, ring->readMultiple(&buffers, 8, 0 /* timeoutMs */));
+    ASSERT_EQ(1u, buffers.size()); // stops in front of the status
+    buffers[0]->release();
+    buffers.clear();
+
+    EXPECT_EQ(INFO_FORMAT_CHANGED, ring->readMultiple(&buffers, 8, 0 /* timeoutMs */));
+    EXPECT_TRUE(buffers.isEmpty());
+
+    ASSERT_EQ(OK, ring->readMultiple(&buffers, 8, 0 /* timeoutMs */));
+    ASSERT_EQ(1u, buffers.size());
+    checkSample(buffers[0], 100, 1);
+    buffers[0]->release();
+    buffers.clear();
+
+    EXPECT_EQ(TIMED_OUT, ring->readMultiple(&buffers, 8, 0 /* timeoutMs */));
+}
+
+TEST(MediaSampleRingTest, RejectsOversizedSample) {
+    sp<MediaSampleRing> ring = MediaSampleRing::CreateLocal(kRingCapacity);
+    ASSERT_NE(nullptr, ring.get());
+
+    MediaBuffer *buf = makeSample(ring->capacity() + 1, 0);
+    EXPECT_EQ(ERROR_BUFFER_TOO_SMALL, ring->writeSample(buf));
+    buf->release();
+}
+
+TEST(MediaSampleRingTest, ResetDiscardsRecords) {
+    sp<MediaSampleRing> ring = MediaSampleRing::CreateLocal(kRingCapacity);
+    ASSERT_NE(nullptr, ring.get());
+
+    MediaBuffer *buf = makeSample(1000, 7);
+    while (ring->writeSample(buf) == OK) {
+    }
+    ASSERT_EQ(WOULD_BLOCK, ring->writeSample(buf));
+    ring->reset();
+    ASSERT_EQ(OK, ring->writeSample(buf));
+    buf->release();
+
+    Vector<MediaBufferBase *> buffers;
+    ASSERT_EQ(OK, ring->readMultiple(&buffers, 128, 0 /* timeoutMs */));
+    ASSERT_EQ(1u, buffers.size());
+    checkSample(buffers[0], 1000, 7);
+    buffers[0]->release();
+}
+
+TEST(MediaSampleRingTest, Throughput) {
+    sp<MediaSampleRing> ring = MediaSampleRing::CreateLocal(kRingCapacity);
+    ASSERT_NE(nullptr, ring.get());
+
+    const int64_t kNumSamples = 200000;
+    const nsecs_t start = systemTime();
+    std::thread producer(produce, ring, kNumSamples);
+    int64_t count = 0;
+    status_t err = OK;
+    while (err == OK) {
+        Vector<MediaBufferBase *> buffers;
+        err = ring->readMultiple(&buffers, 64 /* maxNumBuffers */, 5000 /* timeoutMs */);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            buffers[i]->release();
+        }
+        count += buffers.size();
+    }
+    producer.join();
+    const nsecs_t elapsed = systemTime() - start;
+    EXPECT_EQ(kNumSamples, count);
+    ALOGI("%lld samples in %lld us, %.1f ns/sample",
+            (long long)count, (long long)ns2us(elapsed), (double)elapsed / count);
+}
+
+// Source producing one sample per |intervalUs|, so that its clients drain the ring and
+// wait on it.
+class SlowSource : public BnMediaSource {
+public:
+    explicit SlowSource(useconds_t intervalUs) : mIntervalUs(intervalUs), mNextTimeUs(0) {}
+
+    status_t start(MetaData * /* params */) override { return OK; }
+    status_t stop() override { return OK; }
+    sp<MetaData> getFormat() override { return new MetaData; }
+    status_t read(MediaBufferBase **buffer,
+            const MediaSource::ReadOptions * /* options */) override {
+        usleep(mIntervalUs);
+        *buffer = makeSample(100, mNextTimeUs++);
+        return OK;
+    }
+    bool supportSampleRing() override { return true; }
+
+protected:
+    ~SlowSource() override { stopSampleRing(); }
+
+private:
+    const useconds_t mIntervalUs;
+    int64_t mNextTimeUs;
+};
+
+// Forwards transactions to a local binder without exposing its interface, so that
+// IMediaSource::asInterface() returns the proxy, as in a client process.
+class ForwardingBinder : public BBinder {
+public:
+    explicit ForwardingBinder(const sp<IBinder> &target) : mTarget(target) {}
+
+protected:
+    status_t onTransact(uint32_t code, const Parcel &data, Parcel *reply,
+            uint32_t flags) override {
+        return mTarget->transact(code, data, reply, flags);
+    }
+
+private:
+    const sp<IBinder> mTarget;
+};
+
+static sp<IMediaSource> makeProxy(const sp<BnMediaSource> &source) {
+    return IMediaSource::asInterface(new ForwardingBinder(IInterface::asBinder(source)));
+}
+
+static status_t readOne(const sp<IMediaSource> &source,
+        const MediaSource::ReadOptions *options = nullptr) {
+    Vector<MediaBufferBase *> buffers;
+    status_t err = source->readMultiple(&buffers, 1 /* maxNumBuffers */, options);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        buffers[i]->release();
+    }
+    return err;
+}
+
+TEST(MediaSampleRingTest, StopWakesBlockedRead) {
+    sp<IMediaSource> proxy = makeProxy(new SlowSource(50000 /* intervalUs */));
+
+    for (int session = 0; session < 2; ++session) {
+        ASSERT_EQ(OK, proxy->start());
+        ASSERT_EQ(OK, readOne(proxy));
+
+        std::promise<status_t> readStatus;
+        std::future<status_t> readResult = readStatus.get_future();
+        std::thread reader([&proxy, &readStatus]() {
+            status_t err;
+            while ((err = readOne(proxy)) == OK) {
+            }
+            readStatus.set_value(err);
+        });
+        usleep(120000); // the reader waits on the ring between samples
+
+        std::future<status_t> stopStatus =
+                std::async(std::launch::async, [&proxy]() { return proxy->stop(); });
+        ASSERT_EQ(std::future_status::ready, stopStatus.wait_for(std::chrono::seconds(5)))
+                << "stop() blocked by a read, session " << session;
+        EXPECT_EQ(OK, stopStatus.get());
+        ASSERT_EQ(std::future_status::ready, readResult.wait_for(std::chrono::seconds(5)));
+        EXPECT_EQ(NO_INIT, readResult.get());
+        reader.join();
+    }
+}
+
+TEST(MediaSampleRingTest, NonBlockingReadOfEmptyRing) {
+    sp<IMediaSource> proxy = makeProxy(new SlowSource(500000 /* intervalUs */));
+    ASSERT_EQ(OK, proxy->start());
+
+    MediaSource::ReadOptions options;
+    options.setNonBlocking();
+    EXPECT_EQ(WOULD_BLOCK, readOne(proxy, &options));
+    EXPECT_EQ(OK, readOne(proxy)); // blocks until the first sample
+    EXPECT_EQ(OK, proxy->stop());
+}
+
+}  // namespace android
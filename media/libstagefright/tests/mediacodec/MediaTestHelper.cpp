@@ -16,6 +16,7 @@
 
 #include <media/stagefright/MediaCodec.h>
 #include <media/stagefright/MediaCodecListWriter.h>
+#include <media/stagefright/NuMediaExtractor.h>
 
 #include "MediaTestHelper.h"
 
@@ -52,4 +53,15 @@ void MediaTestHelper::WriteCodecInfos(
     writer->writeCodecInfos(codecInfos);
 }
 
+// static
+status_t MediaTestHelper::SetExtractorImpl(
+        const sp<NuMediaExtractor> &extractor, const sp<IMediaExtractor> &impl) {
+    Mutex::Autolock autoLock(extractor->mLock);
+    if (extractor->mImpl != NULL) {
+        return -EINVAL;
+    }
+    extractor->mImpl = impl;
+    return OK;
+}
+
 }  // namespace android
@@ -25,9 +25,11 @@ namespace android {
 
 struct ALooper;
 struct CodecBase;
+class IMediaExtractor;
 struct MediaCodec;
 struct MediaCodecInfo;
 struct MediaCodecListWriter;
+struct NuMediaExtractor;
 
 class MediaTestHelper {
 public:
@@ -44,6 +46,10 @@ public:
     static void WriteCodecInfos(
             const std::shared_ptr<MediaCodecListWriter> &writer,
             std::vector<sp<MediaCodecInfo>> *codecInfos);
+
+    // NuMediaExtractor
+    static status_t SetExtractorImpl(
+            const sp<NuMediaExtractor> &extractor, const sp<IMediaExtractor> &impl);
 };
 
 }  // namespace android
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <android/IMediaExtractor.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/NuMediaExtractor.h>
+#include <media/stagefright/foundation/ABuffer.h>
+
+#include "MediaTestHelper.h"
+
+namespace android {
+
+namespace {
+
+struct FakeSample {
+    size_t size;
+    int64_t timeUs;
+    bool sync;
+    int32_t validSamples;  // kKeyValidSamples of the sample, not set if negative
+};
+
+std::vector<uint8_t> payloadOf(const FakeSample &sample) {
+    std::vector<uint8_t> payload(sample.size);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = (uint8_t)(sample.timeUs / 1000 + i);
+    }
+    return payload;
+}
+
+// Track returning the given samples one per read().
+class FakeSource : public BnMediaSource {
+public:
+    FakeSource(const char *mime, const std::vector<FakeSample> &samples)
+        : mFormat(new MetaData),
+          mSamples(samples),
+          mNext(0) {
+        mFormat->setCString(kKeyMIMEType, mime);
+    }
+
+    status_t start(MetaData * /* params */) override {
+        mNext = 0;
+        return OK;
+    }
+
+    status_t stop() override {
+        return OK;
+    }
+
+    sp<MetaData> getFormat() override {
+        return mFormat;
+    }
+
+    status_t read(MediaBufferBase **buffer,
+            const MediaSource::ReadOptions * /* options */) override {
+        if (mNext == mSamples.size()) {
+            return ERROR_END_OF_STREAM;
+        }
+        const FakeSample &sample = mSamples[mNext++];
+        const std::vector<uint8_t> payload = payloadOf(sample);
+        MediaBuffer *mbuf = new MediaBuffer(payload.size());
+        memcpy(mbuf->data(), payload.data(), payload.size());
+        mbuf->meta_data().setInt64(kKeyTime, sample.timeUs);
+        mbuf->meta_data().setInt32(kKeyIsSyncFrame, sample.sync);
+        if (sample.validSamples >= 0) {
+            mbuf->meta_data().setInt32(kKeyValidSamples, sample.validSamples);
+        }
+        *buffer = mbuf;
+        return OK;
+    }
+
+private:
+    sp<MetaData> mFormat;
+    std::vector<FakeSample> mSamples;
+    size_t mNext;
+};
+
+class FakeExtractor : public BnMediaExtractor {
+public:
+    explicit FakeExtractor(const std::vector<sp<FakeSource>> &tracks) : mTracks(tracks) {}
+
+    size_t countTracks() override {
+        return mTracks.size();
+    }
+
+    sp<IMediaSource> getTrack(size_t index) override {
+        return mTracks[index];
+    }
+
+    sp<MetaData> getTrackMetaData(size_t index, uint32_t /* flags */) override {
+        return mTracks[index]->getFormat();
+    }
+
+    sp<MetaData> getMetaData() override {
+        return new MetaData;
+    }
+
+    status_t getMetrics(Parcel * /* reply */) override {
+        return OK;
+    }
+
+    uint32_t flags() const override {
+        return 0;
+    }
+
+    status_t setMediaCas(const HInterfaceToken & /* casToken */) override {
+        return ERROR_UNSUPPORTED;
+    }
+
+    String8 name() override {
+        return String8("FakeExtractor");
+    }
+
+    status_t setEntryPoint(EntryPoint /* entryPoint */) override {
+        return OK;
+    }
+
+private:
+    std::vector<sp<FakeSource>> mTracks;
+};
+
+// Extractor with all the given tracks selected.
+sp<NuMediaExtractor> createExtractor(
+        const char *mime, const std::vector<std::vector<FakeSample>> &tracks) {
+    std::vector<sp<FakeSource>> sources;
+    for (const std::vector<FakeSample> &samples : tracks) {
+        sources.push_back(new FakeSource(mime, samples));
+    }
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor(NuMediaExtractor::EntryPoint::OTHER);
+    if (MediaTestHelper::SetExtractorImpl(extractor, new FakeExtractor(sources)) != OK) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        if (extractor->selectTrack(i) != OK) {
+            return nullptr;
+        }
+    }
+    return extractor;
+}
+
+}  // namespace
+
+// A batch larger than what is left of the stream returns the remaining samples of all
+// tracks in time order, and the next batch reports the end of stream.
+TEST(NuMediaExtractorTest, PartialBatchEndsAtEndOfStream) {
+    const std::vector<std::vector<FakeSample>> tracks = {
+        {{100, 0, true, -1}, {60, 20000, false, -1}, {80, 40000, true, -1}},
+        {{50, 10000, true, -1}, {70, 30000, false, -1}},
+    };
+    const std::vector<std::pair<size_t, FakeSample>> expected = {
+        {0, tracks[0][0]}, {1, tracks[1][0]}, {0, tracks[0][1]}, {1, tracks[1][1]},
+        {0, tracks[0][2]},
+    };
+    sp<NuMediaExtractor> extractor = createExtractor(MEDIA_MIMETYPE_AUDIO_RAW, tracks);
+    ASSERT_NE(nullptr, extractor);
+
+    sp<ABuffer> buffer = new ABuffer(4096);
+    Vector<NuMediaExtractor::SampleInfo> infos;
+    ASSERT_EQ(OK, extractor->readSampleDataBatch(buffer, 8, &infos));
+    ASSERT_EQ(expected.size(), infos.size());
+
+    size_t offset = 0;
+    for (size_t i = 0; i < infos.size(); ++i) {
+        SCOPED_TRACE(testing::Message() << "sample " << i);
+        const FakeSample &sample = expected[i].second;
+        EXPECT_EQ(offset, infos[i].mOffset);
+        EXPECT_EQ(sample.size, infos[i].mSize);
+        EXPECT_EQ(sample.timeUs, infos[i].mTimeUs);
+        const uint32_t flags = sample.sync ? NuMediaExtractor::SAMPLE_FLAG_SYNC : 0;
+        EXPECT_EQ(flags, infos[i].mFlags);
+        EXPECT_EQ(expected[i].first, infos[i].mTrackIndex);
+        const std::vector<uint8_t> payload = payloadOf(sample);
+        EXPECT_EQ(0, memcmp(payload.data(), buffer->data() + offset, payload.size()));
+        offset += sample.size;
+    }
+    EXPECT_EQ(offset, buffer->size());
+
+    EXPECT_EQ(ERROR_END_OF_STREAM, extractor->readSampleDataBatch(buffer, 8, &infos));
+    EXPECT_TRUE(infos.empty());
+    EXPECT_EQ(0u, buffer->size());
+    int64_t timeUs;
+    EXPECT_NE(OK, extractor->getSampleTime(&timeUs));
+}
+
+// The batch stops at the first sample that doesn't fit in the rest of the buffer, and that
+// sample stays the current one.
+TEST(NuMediaExtractorTest, SampleThatDoesNotFitStaysCurrent) {
+    const std::vector<FakeSample> samples = {
+        {100, 0, true, -1}, {200, 20000, false, -1}, {300, 40000, false, -1},
+    };
+    sp<NuMediaExtractor> extractor = createExtractor(MEDIA_MIMETYPE_AUDIO_RAW, {samples});
+    ASSERT_NE(nullptr, extractor);
+
+    sp<ABuffer> buffer = new ABuffer(samples[0].size + samples[1].size + samples[2].size - 1);
+    Vector<NuMediaExtractor::SampleInfo> infos;
+    ASSERT_EQ(OK, extractor->readSampleDataBatch(buffer, 8, &infos));
+    ASSERT_EQ(2u, infos.size());
+    EXPECT_EQ(samples[0].size + samples[1].size, buffer->size());
+
+    int64_t timeUs;
+    ASSERT_EQ(OK, extractor->getSampleTime(&timeUs));
+    EXPECT_EQ(samples[2].timeUs, timeUs);
+
+    // alone, it doesn't fit either
+    buffer = new ABuffer(samples[2].size - 1);
+    EXPECT_EQ(-ENOMEM, extractor->readSampleDataBatch(buffer, 8, &infos));
+    EXPECT_TRUE(infos.empty());
+    ASSERT_EQ(OK, extractor->getSampleTime(&timeUs));
+    EXPECT_EQ(samples[2].timeUs, timeUs);
+
+    buffer = new ABuffer(samples[2].size);
+    ASSERT_EQ(OK, extractor->readSampleData(buffer));
+    const std::vector<uint8_t> payload = payloadOf(samples[2]);
+    ASSERT_EQ(payload.size(), buffer->size());
+    EXPECT_EQ(0, memcmp(payload.data(), buffer->data(), payload.size()));
+}
+
+// Vorbis samples are followed by their number of page samples, -1 if unknown, as with
+// readSampleData(). The suffix counts in the size of the sample for the buffer to fit.
+TEST(NuMediaExtractorTest, VorbisAppendsNumPageSamples) {
+    const std::vector<FakeSample> samples = {
+        {40, 0, true, 128}, {30, 20000, true, -1}, {50, 40000, true, 256},
+    };
+    const size_t kSuffix = sizeof(int32_t);
+
+    // what readSampleData() returns sample by sample
+    sp<NuMediaExtractor> reference = createExtractor(MEDIA_MIMETYPE_AUDIO_VORBIS, {samples});
+    ASSERT_NE(nullptr, reference);
+    std::vector<uint8_t> expected;
+    for (const FakeSample &sample : samples) {
+        sp<ABuffer> buffer = new ABuffer(sample.size + kSuffix);
+        ASSERT_EQ(OK, reference->readSampleData(buffer));
+        ASSERT_EQ(sample.size + kSuffix, buffer->size());
+        int32_t numPageSamples;
+        memcpy(&numPageSamples, buffer->data() + sample.size, kSuffix);
+        EXPECT_EQ(sample.validSamples, numPageSamples);
+        expected.insert(expected.end(), buffer->data(), buffer->data() + buffer->size());
+        reference->advance();
+    }
+
+    sp<NuMediaExtractor> extractor = createExtractor(MEDIA_MIMETYPE_AUDIO_VORBIS, {samples});
+    ASSERT_NE(nullptr, extractor);
+    Vector<NuMediaExtractor::SampleInfo> infos;
+
+    // room for the first sample and all of the second one but its suffix
+    sp<ABuffer> buffer = new ABuffer(samples[0].size + kSuffix + samples[1].size);
+    ASSERT_EQ(OK, extractor->readSampleDataBatch(buffer, 8, &infos));
+    ASSERT_EQ(1u, infos.size());
+    EXPECT_EQ(samples[0].size + kSuffix, infos[0].mSize);
+
+    buffer = new ABuffer(expected.size());
+    ASSERT_EQ(OK, extractor->readSampleDataBatch(buffer, 8, &infos));
+    ASSERT_EQ(2u, infos.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < infos.size(); ++i) {
+        EXPECT_EQ(offset, infos[i].mOffset);
+        EXPECT_EQ(samples[i + 1].size + kSuffix, infos[i].mSize);
+        offset += infos[i].mSize;
+    }
+    const size_t firstSize = samples[0].size + kSuffix;
+    ASSERT_EQ(expected.size() - firstSize, buffer->size());
+    EXPECT_EQ(0, memcmp(expected.data() + firstSize, buffer->data(), buffer->size()));
+}
+
+}  // namespace android
@@ -189,6 +189,29 @@ ssize_t AMediaExtractor_readSampleData(AMediaExtractor *mData, uint8_t *buffer,
     return -1;
 }
 
+EXPORT
+ssize_t AMediaExtractor_readSampleDataBatch(AMediaExtractor *mData,
+        uint8_t *buffer, size_t capacity,
+        AMediaExtractorSampleInfo *infos, size_t maxSamples) {
+    if (buffer == NULL || infos == NULL || maxSamples == 0) {
+        return -1;
+    }
+    sp<ABuffer> tmp = new ABuffer(buffer, capacity);
+    Vector<NuMediaExtractor::SampleInfo> sampleInfos;
+    if (mData->mImpl->readSampleDataBatch(tmp, maxSamples, &sampleInfos) != OK) {
+        return -1;
+    }
+    for (size_t i = 0; i < sampleInfos.size(); ++i) {
+        const NuMediaExtractor::SampleInfo &info = sampleInfos[i];
+        infos[i].offset = info.mOffset;
+        infos[i].size = info.mSize;
+        infos[i].presentationTimeUs = info.mTimeUs;
+        infos[i].flags = info.mFlags;
+        infos[i].trackIndex = info.mTrackIndex;
+    }
+    return sampleInfos.size();
+}
+
 EXPORT
 ssize_t AMediaExtractor_getSampleSize(AMediaExtractor *mData) {
     size_t sampleSize;
@@ -267,6 +267,46 @@ media_status_t AMediaExtractor_getSampleFormat(AMediaExtractor *ex,
 
 #endif /* __ANDROID_API__ >= 28 */
 
+#if __ANDROID_API__ >= 31
+
+/**
+ * Location and metadata of one sample returned by AMediaExtractor_readSampleDataBatch.
+ */
+typedef struct AMediaExtractorSampleInfo {
+    /** Byte offset of the sample within the caller's buffer. */
+    size_t offset;
+    /** Size of the sample in bytes. */
+    size_t size;
+    /** Presentation time of the sample in microseconds. */
+    int64_t presentationTimeUs;
+    /** Bitmask of AMEDIAEXTRACTOR_SAMPLE_FLAG_* values. */
+    uint32_t flags;
+    /** Index of the track the sample belongs to. */
+    int32_t trackIndex;
+} AMediaExtractorSampleInfo;
+
+/**
+ * Read up to |maxSamples| consecutive samples into |buffer| and advance past them,
+ * as if AMediaExtractor_readSampleData, AMediaExtractor_getSampleTime,
+ * AMediaExtractor_getSampleFlags, AMediaExtractor_getSampleTrackIndex and
+ * AMediaExtractor_advance had been called for each sample in turn.
+ *
+ * Samples are packed back to back starting at the beginning of |buffer|, and their
+ * location and metadata are written to the first entries of |infos|. Reading stops
+ * early at end of stream or when the next sample does not fit in the remaining
+ * capacity; that sample is left as the current sample.
+ *
+ * Returns the number of samples read, or -1 if no sample could be read (end of
+ * stream, or the current sample is larger than |capacity|).
+ *
+ * Available since API level 31.
+ */
+ssize_t AMediaExtractor_readSampleDataBatch(AMediaExtractor*,
+        uint8_t *buffer, size_t capacity,
+        AMediaExtractorSampleInfo *infos, size_t maxSamples) __INTRODUCED_IN(31);
+
+#endif /* __ANDROID_API__ >= 31 */
+
 #endif /* __ANDROID_API__ >= 21 */
 
 __END_DECLS
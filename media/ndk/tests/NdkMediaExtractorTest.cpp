@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <media/NdkMediaDataSource.h>
+#include <media/NdkMediaExtractor.h>
+
+namespace {
+
+constexpr uint32_t kSampleRate = 48000;
+constexpr uint16_t kChannelCount = 2;
+// several WAV extractor reads, the last one partial
+constexpr size_t kDataSize = 4 * 32768 + 1000;
+
+void appendLE(std::vector<uint8_t> *out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out->push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+// 16 bit PCM WAV file
+std::vector<uint8_t> makeWav() {
+    std::vector<uint8_t> wav;
+    auto appendTag = [&wav](const char *tag) { wav.insert(wav.end(), tag, tag + 4); };
+    appendTag("RIFF");
+    appendLE(&wav, 36 + kDataSize, 4);
+    appendTag("WAVE");
+    appendTag("fmt ");
+    appendLE(&wav, 16, 4);
+    appendLE(&wav, 1 /* PCM */, 2);
+    appendLE(&wav, kChannelCount, 2);
+    appendLE(&wav, kSampleRate, 4);
+    appendLE(&wav, kSampleRate * kChannelCount * 2, 4);
+    appendLE(&wav, kChannelCount * 2, 2);
+    appendLE(&wav, 16, 2);
+    appendTag("data");
+    appendLE(&wav, kDataSize, 4);
+    for (size_t i = 0; i < kDataSize; ++i) {
+        wav.push_back((uint8_t)(i * 7));
+    }
+    return wav;
+}
+
+struct Sample {
+    std::vector<uint8_t> data;
+    int64_t timeUs;
+    uint32_t flags;
+    int trackIndex;
+};
+
+class NdkMediaExtractorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mWav = makeWav();
+    }
+
+    void TearDown() override {
+        for (AMediaExtractor *extractor : mExtractors) {
+            AMediaExtractor_delete(extractor);
+        }
+        for (AMediaDataSource *source : mSources) {
+            AMediaDataSource_delete(source);
+        }
+    }
+
+    // Extractor of the WAV file, with its track selected.
+    AMediaExtractor *createExtractor() {
+        AMediaDataSource *source = AMediaDataSource_new();
+        mSources.push_back(source);
+        AMediaDataSource_setUserdata(source, &mWav);
+        AMediaDataSource_setReadAt(source, [](void *userdata, off64_t offset, void *buffer,
+                                              size_t size) -> ssize_t {
+            const std::vector<uint8_t> *wav = static_cast<std::vector<uint8_t> *>(userdata);
+            if (offset < 0 || (size_t)offset >= wav->size()) {
+                return 0;
+            }
+            size = std::min(size, wav->size() - (size_t)offset);
+            memcpy(buffer, wav->data() + offset, size);
+            return size;
+        });
+        AMediaDataSource_setGetSize(source, [](void *userdata) -> ssize_t {
+            return static_cast<std::vector<uint8_t> *>(userdata)->size();
+        });
+
+        AMediaExtractor *extractor = AMediaExtractor_new();
+        mExtractors.push_back(extractor);
+        if (AMediaExtractor_setDataSourceCustom(extractor, source) != AMEDIA_OK ||
+                AMediaExtractor_getTrackCount(extractor) != 1 ||
+                AMediaExtractor_selectTrack(extractor, 0) != AMEDIA_OK) {
+            return nullptr;
+        }
+        return extractor;
+    }
+
+    // The samples as read one by one with AMediaExtractor_readSampleData.
+    std::vector<Sample> readSamples(AMediaExtractor *extractor) {
+        std::vector<Sample> samples;
+        ssize_t size;
+        while ((size = AMediaExtractor_getSampleSize(extractor)) >= 0) {
+            Sample sample;
+            sample.data.resize(size);
+            if (AMediaExtractor_readSampleData(extractor, sample.data.data(), size) != size) {
+                break;
+            }
+            sample.timeUs = AMediaExtractor_getSampleTime(extractor);
+            sample.flags = AMediaExtractor_getSampleFlags(extractor);
+            sample.trackIndex = AMediaExtractor_getSampleTrackIndex(extractor);
+            samples.push_back(sample);
+            if (!AMediaExtractor_advance(extractor)) {
+                break;
+            }
+        }
+        return samples;
+    }
+
+    std::vector<uint8_t> mWav;
+    std::vector<AMediaDataSource *> mSources;
+    std::vector<AMediaExtractor *> mExtractors;
+};
+
+void expectSample(const Sample &sample, const uint8_t *buffer,
+                  const AMediaExtractorSampleInfo &info) {
+    EXPECT_EQ(sample.data.size(), info.size);
+    EXPECT_EQ(sample.timeUs, info.presentationTimeUs);
+    EXPECT_EQ(sample.flags, info.flags);
+    EXPECT_EQ(sample.trackIndex, info.trackIndex);
+    EXPECT_EQ(0, memcmp(sample.data.data(), buffer + info.offset, sample.data.size()));
+}
+
+}  // namespace
+
+// A batch larger than what is left of the stream returns the samples that
+// AMediaExtractor_readSampleData() would, packed back to back, and the next batch fails.
+TEST_F(NdkMediaExtractorTest, PartialBatchEndsAtEndOfStream) {
+    AMediaExtractor *reference = createExtractor();
+    ASSERT_NE(nullptr, reference);
+    const std::vector<Sample> samples = readSamples(reference);
+    ASSERT_GE(samples.size(), 3u);
+    size_t totalSize = 0;
+    for (const Sample &sample : samples) {
+        totalSize += sample.data.size();
+    }
+
+    AMediaExtractor *extractor = createExtractor();
+    ASSERT_NE(nullptr, extractor);
+    std::vector<uint8_t> buffer(totalSize);
+    std::vector<AMediaExtractorSampleInfo> infos(samples.size() + 4);
+    ASSERT_EQ((ssize_t)samples.size(), AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), buffer.size(), infos.data(), infos.size()));
+    size_t offset = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        SCOPED_TRACE(testing::Message() << "sample " << i);
+        EXPECT_EQ(offset, infos[i].offset);
+        expectSample(samples[i], buffer.data(), infos[i]);
+        offset += samples[i].data.size();
+    }
+
+    EXPECT_EQ(-1, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), buffer.size(), infos.data(), infos.size()));
+    EXPECT_LT(AMediaExtractor_getSampleTime(extractor), 0);
+}
+
+// The batch stops at the first sample that doesn't fit in the rest of the buffer, and that
+// sample stays the current one.
+TEST_F(NdkMediaExtractorTest, SampleThatDoesNotFitStaysCurrent) {
+    AMediaExtractor *reference = createExtractor();
+    ASSERT_NE(nullptr, reference);
+    const std::vector<Sample> samples = readSamples(reference);
+    ASSERT_GE(samples.size(), 3u);
+
+    AMediaExtractor *extractor = createExtractor();
+    ASSERT_NE(nullptr, extractor);
+    std::vector<uint8_t> buffer(
+            samples[0].data.size() + samples[1].data.size() + samples[2].data.size() - 1);
+    std::vector<AMediaExtractorSampleInfo> infos(samples.size());
+    ASSERT_EQ(2, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), buffer.size(), infos.data(), infos.size()));
+    expectSample(samples[0], buffer.data(), infos[0]);
+    expectSample(samples[1], buffer.data(), infos[1]);
+    EXPECT_EQ(samples[2].timeUs, AMediaExtractor_getSampleTime(extractor));
+
+    // alone, it doesn't fit either
+    EXPECT_EQ(-1, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), samples[2].data.size() - 1, infos.data(), infos.size()));
+    EXPECT_EQ(samples[2].timeUs, AMediaExtractor_getSampleTime(extractor));
+
+    ASSERT_EQ(1, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), samples[2].data.size(), infos.data(), 1));
+    expectSample(samples[2], buffer.data(), infos[0]);
+}
+
+TEST_F(NdkMediaExtractorTest, InvalidArguments) {
+    AMediaExtractor *extractor = createExtractor();
+    ASSERT_NE(nullptr, extractor);
+    std::vector<uint8_t> buffer(kDataSize);
+    AMediaExtractorSampleInfo info;
+    EXPECT_EQ(-1, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), buffer.size(), &info, 0));
+    EXPECT_EQ(-1, AMediaExtractor_readSampleDataBatch(
+            extractor, nullptr, buffer.size(), &info, 1));
+    EXPECT_EQ(-1, AMediaExtractor_readSampleDataBatch(
+            extractor, buffer.data(), buffer.size(), nullptr, 1));
+    // nothing was consumed
+    EXPECT_EQ(0, AMediaExtractor_getSampleTime(extractor));
+}
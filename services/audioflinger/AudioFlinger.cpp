@@ -208,6 +208,8 @@ AudioFlinger::AudioFlinger()
 
     mDevicesFactoryHal = DevicesFactoryHalInterface::create();
     mEffectsFactoryHal = EffectsFactoryHalInterface::create();
+    // parse the effect configuration now rather than with a thread lock held
+    (void) EffectChain::workerEffectUuids();
 
     mMediaLogNotifier->run("MediaLogNotifier");
     std::vector<pid_t> halPids;
@@ -29,6 +29,7 @@
 #include <set>
 #include <string>
 #include <vector>
+#include <semaphore.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <limits.h>
@@ -126,6 +127,7 @@ class AudioFlinger :
     public BnAudioFlinger
 {
     friend class BinderService<AudioFlinger>;   // for AudioFlinger()
+    friend class EffectChainTest;               // for the effect classes
 
 public:
     static const char* getServiceName() ANDROID_API { return "media.audio_flinger"; }
@@ -33,6 +33,7 @@
 #include <media/AudioContainers.h>
 #include <media/AudioEffect.h>
 #include <media/AudioDeviceTypeAddr.h>
+#include <media/EffectsConfig.h>
 #include <media/audiohal/EffectHalInterface.h>
 #include <media/audiohal/EffectsFactoryHalInterface.h>
 #include <mediautils/ServiceUtilities.h>
@@ -579,8 +580,15 @@ ssize_t AudioFlinger::EffectModule::removeHandle_l(EffectHandle *handle)
     return status;
 }
 
-bool AudioFlinger::EffectModule::updateState() {
-    Mutex::Autolock _l(mLock);
+bool AudioFlinger::EffectModule::updateState(bool tryLock) {
+    if (tryLock) {
+        if (mLock.tryLock() != NO_ERROR) {
+            return false;
+        }
+    } else {
+        mLock.lock();
+    }
+    std::lock_guard<Mutex> _l(mLock, std::adopt_lock);
 
     bool started = false;
     switch (mState) {
@@ -627,13 +635,15 @@ bool AudioFlinger::EffectModule::updateState() {
     return started;
 }
 
-void AudioFlinger::EffectModule::process()
+bool AudioFlinger::EffectModule::process(bool int16Pending)
 {
     Mutex::Autolock _l(mLock);
 
     if (mState == DESTROYED || mEffectInterface == 0 || mInBuffer == 0 || mOutBuffer == 0) {
-        return;
+        return int16Pending;
     }
+    ALOG_ASSERT(!int16Pending || mUsesSharedInt16Buffer,
+            "%s: shared int16_t buffer not flushed before effect", __func__);
 
     const uint32_t inChannelCount =
             audio_channel_count_from_out_mask(mConfig.inputCfg.channels);
@@ -680,6 +690,7 @@ void AudioFlinger::EffectModule::process()
     };
 
     if (isProcessEnabled()) {
+        const nsecs_t startNs = systemTime();
         int ret;
         if (isProcessImplemented()) {
             if (auxType) {
@@ -736,7 +747,17 @@ void AudioFlinger::EffectModule::process()
                         * mOutChannelCountRequested * mConfig.outputCfg.buffer.frameCount);
                 outBuffer = mOutConversionBuffer;
             }
-            if (!mSupportsFloat) { // convert input to int16_t as effect doesn't support float.
+            if (mUsesSharedInt16Buffer) {
+                // process in place in the shared buffer, converting only if the previous
+                // effect did not leave its output there
+                if (!int16Pending) {
+                    memcpy_to_i16_from_float(
+                            mSharedInt16Buffer->audioBuffer()->s16,
+                            inBuffer->audioBuffer()->f32,
+                            inChannelCount * mConfig.inputCfg.buffer.frameCount);
+                }
+            } else if (!mSupportsFloat) {
+                // convert input to int16_t as effect doesn't support float.
                 if (!auxType) {
                     if (mInConversionBuffer == nullptr) {
                         ALOGW("%s: mInConversionBuffer is null, bypassing", __func__);
@@ -763,7 +784,10 @@ void AudioFlinger::EffectModule::process()
 #endif
             ret = mEffectInterface->process();
 #ifdef FLOAT_EFFECT_CHAIN
-            if (!mSupportsFloat) { // convert output int16_t back to float.
+            if (mUsesSharedInt16Buffer) {
+                // converted back by the chain when needed, see EffectChain::process_l()
+                int16Pending = true;
+            } else if (!mSupportsFloat) { // convert output int16_t back to float.
                 sp<EffectBufferHalInterface> target =
                         mOutChannelCountRequested != outChannelCount
                         ? mOutConversionBuffer : mOutBuffer;
@@ -811,6 +835,11 @@ void AudioFlinger::EffectModule::process()
 #endif
             memset(mConfig.inputCfg.buffer.raw, 0, size);
         }
+
+        const nsecs_t processNs = systemTime() - startNs;
+        mProcessCount++;
+        mProcessTotalNs += processNs;
+        mProcessMaxNs = std::max(mProcessMaxNs, processNs);
     } else if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_INSERT &&
                 // mInBuffer->audioBuffer()->raw != mOutBuffer->audioBuffer()->raw
                 mConfig.inputCfg.buffer.raw != mConfig.outputCfg.buffer.raw) {
@@ -825,6 +854,22 @@ void AudioFlinger::EffectModule::process()
             }
         }
     }
+    return int16Pending;
+}
+
+void AudioFlinger::EffectModule::flushSharedInt16Buffer()
+{
+#ifdef FLOAT_EFFECT_CHAIN
+    Mutex::Autolock _l(mLock);
+    if (mSharedInt16Buffer == nullptr || mOutBuffer == nullptr) {
+        return;
+    }
+    memcpy_to_float_from_i16(
+            mOutBuffer->audioBuffer()->f32,
+            mSharedInt16Buffer->audioBuffer()->s16,
+            audio_channel_count_from_out_mask(mConfig.outputCfg.channels)
+                    * mConfig.outputCfg.buffer.frameCount);
+#endif
 }
 
 void AudioFlinger::EffectModule::reset_l()
@@ -1313,6 +1358,7 @@ void AudioFlinger::EffectModule::setInBuffer(const sp<EffectBufferHalInterface>&
             ALOGE("%s cannot create mInConversionBuffer", __func__);
         }
     }
+    updateSharedInt16Buffer_l();
 #endif
 }
 
@@ -1357,6 +1403,56 @@ void AudioFlinger::EffectModule::setOutBuffer(const sp<EffectBufferHalInterface>
             ALOGE("%s cannot create mOutConversionBuffer", __func__);
         }
     }
+    updateSharedInt16Buffer_l();
+#endif
+}
+
+void AudioFlinger::EffectModule::setSharedInt16Buffer(const sp<EffectBufferHalInterface>& buffer)
+{
+#ifdef FLOAT_EFFECT_CHAIN
+    mSharedInt16Buffer = buffer;
+    updateSharedInt16Buffer_l();
+#else
+    (void)buffer;
+#endif
+}
+
+// Selects the shared int16_t buffer as HAL buffers when possible: the effect processes int16_t,
+// in place, and without channel adjustment. Called when any of these conditions may change.
+void AudioFlinger::EffectModule::updateSharedInt16Buffer_l()
+{
+#ifdef FLOAT_EFFECT_CHAIN
+    if (mEffectInterface == nullptr) {  // released
+        mUsesSharedInt16Buffer = false;
+        return;
+    }
+    const bool auxType = (mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY;
+    const uint32_t inChannelCount =
+            audio_channel_count_from_out_mask(mConfig.inputCfg.channels);
+    const uint32_t outChannelCount =
+            audio_channel_count_from_out_mask(mConfig.outputCfg.channels);
+    const size_t frameCount = mConfig.inputCfg.buffer.frameCount;
+    const bool useSharedBuffer = mSharedInt16Buffer != nullptr
+            && !mSupportsFloat && !auxType
+            && mInBuffer != nullptr && mOutBuffer != nullptr
+            && mConfig.inputCfg.buffer.raw == mConfig.outputCfg.buffer.raw
+            && mInChannelCountRequested == inChannelCount
+            && mOutChannelCountRequested == outChannelCount
+            && frameCount > 0
+            && inChannelCount * frameCount * sizeof(int16_t) <= mSharedInt16Buffer->getSize();
+
+    if (useSharedBuffer) {
+        ALOGV("%s: using shared int16_t buffer %p", __func__, mSharedInt16Buffer.get());
+        mUsesSharedInt16Buffer = true;
+        mSharedInt16Buffer->setFrameCount(frameCount);
+        mEffectInterface->setInBuffer(mSharedInt16Buffer);
+        mEffectInterface->setOutBuffer(mSharedInt16Buffer);
+    } else if (mUsesSharedInt16Buffer) {
+        // restore the HAL buffers selected by setInBuffer() and setOutBuffer()
+        mUsesSharedInt16Buffer = false;
+        setInBuffer(mInBuffer);
+        setOutBuffer(mOutBuffer);
+    }
 #endif
 }
 
@@ -1548,7 +1644,20 @@ void AudioFlinger::EffectModule::dump(int fd, const Vector<String16>& args)
     result.appendFormat("\t\t%03d    %p\n",
             mStatus, mEffectInterface.get());
 
-    result.appendFormat("\t\t- data: %s\n", mSupportsFloat ? "float" : "int16");
+    result.appendFormat("\t\t- data: %s%s\n", mSupportsFloat ? "float" : "int16",
+            mUsesSharedInt16Buffer ? " (shared buffer)" : "");
+
+    if (mProcessCount > 0) {
+        const double bufferDurationUs = mConfig.inputCfg.samplingRate != 0
+                ? mConfig.inputCfg.buffer.frameCount * 1e6 / mConfig.inputCfg.samplingRate : 0;
+        const double meanUs = mProcessTotalNs * 1e-3 / mProcessCount;
+        result.appendFormat("\t\t- process: %llu calls, mean %.1f us, max %.1f us",
+                (unsigned long long)mProcessCount, meanUs, mProcessMaxNs * 1e-3);
+        if (bufferDurationUs > 0) {
+            result.appendFormat(", %.2f%% of buffer duration", meanUs * 100 / bufferDurationUs);
+        }
+        result.append("\n");
+    }
 
     result.append("\t\t- Input configuration:\n");
     result.append("\t\t\tBuffer     Frames  Smp rate Channels Format\n");
@@ -1959,6 +2068,7 @@ AudioFlinger::EffectChain::EffectChain(const wp<ThreadBase>& thread,
 
 AudioFlinger::EffectChain::~EffectChain()
 {
+    stopWorker_l();
 }
 
 // getEffectFromDesc_l() must be called with ThreadBase::mLock held
@@ -2032,6 +2142,262 @@ void AudioFlinger::EffectChain::clearInputBuffer_l()
     mInBuffer->commit();
 }
 
+// Must be called with EffectChain::mLock locked
+void AudioFlinger::EffectChain::planBuffers_l()
+{
+#ifdef FLOAT_EFFECT_CHAIN
+    // Insert effects that only support int16_t process in place in one buffer shared by the
+    // chain. A run of such adjacent effects then converts from float before its first effect
+    // and back after its last one, instead of around each of them.
+    // Use FCC_2 in case the chain is mono and the effects are stereo.
+    const size_t size = std::max((uint32_t)FCC_2, mEffectCallback->channelCount())
+            * mEffectCallback->frameCount() * sizeof(int16_t);
+    if (size > 0 && (mSharedInt16Buffer == nullptr || size > mSharedInt16Buffer->getSize())) {
+        mSharedInt16Buffer.clear();
+        ALOGV("%s: allocating mSharedInt16Buffer %zu", __func__, size);
+        if (mEffectCallback->allocateHalBuffer(size, &mSharedInt16Buffer) != OK) {
+            ALOGE("%s cannot create mSharedInt16Buffer", __func__);
+        }
+    }
+    for (size_t i = 0; i < mEffects.size(); i++) {
+        if ((mEffects[i]->desc().flags & EFFECT_FLAG_TYPE_MASK) != EFFECT_FLAG_TYPE_AUXILIARY) {
+            mEffects[i]->setSharedInt16Buffer(mSharedInt16Buffer);
+        }
+    }
+#endif
+}
+
+// static
+const std::vector<effect_uuid_t>& AudioFlinger::EffectChain::workerEffectUuids()
+{
+    static const std::vector<effect_uuid_t> uuids = [] {
+        std::vector<effect_uuid_t> uuids;
+        const auto result = effectsConfig::parse();
+        if (result.parsedConfig == nullptr) {
+            ALOGW("%s: could not parse %s", __func__, result.configPath.c_str());
+            return uuids;
+        }
+        for (const auto& effect : result.parsedConfig->effects) {
+            if (effect.worker) {
+                ALOGV("%s: effect %s runs on a worker", __func__, effect.name.c_str());
+                uuids.push_back(effect.uuid);
+            }
+        }
+        return uuids;
+    }();
+    return uuids;
+}
+
+// Must be called with ThreadBase::mLock and EffectChain::mLock held
+void AudioFlinger::EffectChain::updateWorker_l()
+{
+    stopWorker_l();
+#ifdef FLOAT_EFFECT_CHAIN
+    std::vector<sp<EffectModule>> insertEffects;
+    bool useWorker = false;
+    for (size_t i = 0; i < mEffects.size(); i++) {
+        const effect_descriptor_t& desc = mEffects[i]->desc();
+        if ((desc.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+            continue;
+        }
+        insertEffects.push_back(mEffects[i]);
+        for (const auto& uuid : workerEffectUuids()) {
+            useWorker = useWorker || memcmp(&uuid, &desc.uuid, sizeof(uuid)) == 0;
+        }
+    }
+    sp<ThreadBase> thread = mEffectCallback->thread().promote();
+    if (useWorker && thread != nullptr && !mEffectCallback->isOffloadOrMmap()
+            && mInBuffer != nullptr && mOutBuffer != nullptr) {
+        const size_t sampleCount = mEffectCallback->channelCount() * mEffectCallback->frameCount();
+        sp<EffectBufferHalInterface> buffer;
+        if (mEffectCallback->allocateHalBuffer(sampleCount * sizeof(float), &buffer) == OK) {
+            mWorker = new Worker(insertEffects, buffer, sampleCount);
+        } else {
+            ALOGE("%s cannot create worker buffer", __func__);
+        }
+    }
+    setInsertEffectBuffers_l();
+    if (mWorker != 0) {
+        status_t status = mWorker->run("AudioEffectWorker", ANDROID_PRIORITY_URGENT_AUDIO);
+        if (status != NO_ERROR) {
+            ALOGE("%s cannot start worker: %d", __func__, status);
+            mWorker.clear();
+            setInsertEffectBuffers_l();
+        } else {
+            // same real time priority as the application audio callback threads,
+            // below the fast mixer and fast capture threads
+            thread->sendPrioConfigEvent_l(getpid(), mWorker->getTid(), 2 /* prio */,
+                    false /*forApp*/);
+            ALOGV("%s: chain %p started worker %d for %zu effects", __func__, this,
+                    mWorker->getTid(), insertEffects.size());
+        }
+    }
+#endif
+}
+
+// Must be called with EffectChain::mLock held
+void AudioFlinger::EffectChain::stopWorker_l()
+{
+    if (mWorker == 0) {
+        return;
+    }
+    mWorker->stop();
+    mWorkerBlocks += mWorker->blocks();
+    mWorkerUnderruns += mWorker->underruns();
+    mWorker.clear();
+}
+
+// Insert effects process the worker buffer in place if the chain has a worker. Otherwise they
+// read and write the chain input buffer, and the last one writes the chain output buffer.
+// Must be called with EffectChain::mLock held
+void AudioFlinger::EffectChain::setInsertEffectBuffers_l()
+{
+    const size_t size = mEffects.size();
+    for (size_t i = 0; i < size; i++) {
+        const sp<EffectModule>& effect = mEffects[i];
+        if ((effect->desc().flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+            continue;
+        }
+        const sp<EffectBufferHalInterface>& inBuffer =
+                mWorker != 0 ? mWorker->buffer() : mInBuffer;
+        const sp<EffectBufferHalInterface>& outBuffer =
+                mWorker != 0 ? mWorker->buffer() : (i == size - 1 ? mOutBuffer : mInBuffer);
+        if (inBuffer == nullptr || outBuffer == nullptr) {
+            continue;
+        }
+        if (effect->inBuffer() != inBuffer->ptr() || effect->outBuffer() != outBuffer->ptr()) {
+            effect->setInBuffer(inBuffer);
+            effect->setOutBuffer(outBuffer);
+            effect->configure();
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+//  EffectChain::Worker implementation
+// ----------------------------------------------------------------------------
+
+AudioFlinger::EffectChain::Worker::Worker(const std::vector<sp<EffectModule>>& effects,
+                                          const sp<EffectBufferHalInterface>& buffer,
+                                          size_t sampleCount)
+    : Thread(false /*canCallJava*/),
+      mEffects(effects), mBuffer(buffer), mSampleCount(sampleCount), mDry(sampleCount)
+{
+    sem_init(&mSemaphore, 0 /*pshared*/, 0 /*value*/);
+    // the output of the block before the first one is silence
+    memset(mBuffer->audioBuffer()->raw, 0, mSampleCount * sizeof(float));
+}
+
+AudioFlinger::EffectChain::Worker::~Worker()
+{
+    sem_destroy(&mSemaphore);
+}
+
+void AudioFlinger::EffectChain::Worker::stop()
+{
+    requestExit();
+    sem_post(&mSemaphore);
+    // Only waits for the block being processed, if any: the thread is not joined and exits
+    // without processing another block.
+    Mutex::Autolock _l(mProcessLock);
+    mEffects.clear();
+}
+
+void AudioFlinger::EffectChain::Worker::exchange(float *in, float *out, bool accumulate)
+{
+    const uint64_t submitted = mSubmitted.load(std::memory_order_relaxed);
+    const bool late = mProcessed.load(std::memory_order_acquire) != submitted;
+    float *work = mBuffer->audioBuffer()->f32;
+    float *dry = mDry.data();
+    mBlocks++;
+    if (late || mDropPending) {
+        // The worker is late, or has just completed a late block: the block due is output
+        // unprocessed, as bypassed insert effects would, and the late output is dropped.
+        // Blocks are never reordered and the latency stays one buffer.
+        if (accumulate) {
+            accumulate_float(out, dry, mSampleCount);
+            memcpy(dry, in, mSampleCount * sizeof(float));
+        } else {
+            std::swap_ranges(in, in + mSampleCount, dry);
+        }
+        if (late) {
+            mUnderruns++;
+            mDropPending = true;
+            return;
+        }
+        mDropPending = false;
+        memcpy(work, dry, mSampleCount * sizeof(float));
+    } else {
+        // The worker is idle: output the block it processed, and hand over the next one
+        memcpy(dry, in, mSampleCount * sizeof(float));
+        if (accumulate) {
+            accumulate_float(out, work, mSampleCount);
+            memcpy(work, in, mSampleCount * sizeof(float));
+        } else {
+            std::swap_ranges(in, in + mSampleCount, work);
+        }
+    }
+    mSubmitted.store(submitted + 1, std::memory_order_release);
+    sem_post(&mSemaphore);
+}
+
+bool AudioFlinger::EffectChain::Worker::threadLoop()
+{
+    while (sem_wait(&mSemaphore) != 0) {
+        if (errno != EINTR) {
+            ALOGE("%s: sem_wait failed: %s", __func__, strerror(errno));
+            return false;
+        }
+    }
+    Mutex::Autolock _l(mProcessLock);
+    if (exitPending()) {
+        return false;
+    }
+    const uint64_t submitted = mSubmitted.load(std::memory_order_acquire);
+    if (submitted == mProcessed.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    const nsecs_t startNs = systemTime();
+    processEffects(mEffects, true /* insert */);
+    const nsecs_t processNs = systemTime() - startNs;
+    if (processNs > mMaxProcessNs.load(std::memory_order_relaxed)) {
+        mMaxProcessNs.store(processNs, std::memory_order_relaxed);
+    }
+
+    mProcessed.store(submitted, std::memory_order_release);
+    return true;
+}
+
+// Effects using the shared int16_t buffer leave their output there: it is converted
+// back to float only before an effect not using it, and at the end of the chain.
+template <typename Effects>
+void AudioFlinger::EffectChain::processEffects(const Effects& effects, bool insert)
+{
+    EffectModule *int16Owner = nullptr;
+    for (size_t i = 0; i < effects.size(); i++) {
+        const sp<EffectModule>& effect = effects[i];
+        if (!insert && (effect->desc().flags & EFFECT_FLAG_TYPE_MASK)
+                != EFFECT_FLAG_TYPE_AUXILIARY) {
+            continue;
+        }
+        if (int16Owner != nullptr && !effect->usesSharedInt16Buffer()) {
+            int16Owner->flushSharedInt16Buffer();
+            int16Owner = nullptr;
+        }
+        if (effect->process(int16Owner != nullptr)) {
+            int16Owner = effect.get();
+        }
+    }
+    if (int16Owner != nullptr) {
+        int16Owner->flushSharedInt16Buffer();
+    }
+}
+
+// for the chain effects, also called by EffectChainTest
+template void AudioFlinger::EffectChain::processEffects(
+        const Vector<sp<EffectModule>>& effects, bool insert);
+
 // Must be called with EffectChain::mLock locked
 void AudioFlinger::EffectChain::process_l()
 {
@@ -2067,8 +2433,16 @@ void AudioFlinger::EffectChain::process_l()
         if (mInBuffer->audioBuffer()->raw != mOutBuffer->audioBuffer()->raw) {
             mOutBuffer->update();
         }
-        for (size_t i = 0; i < size; i++) {
-            mEffects[i]->process();
+        if (mWorker != 0) {
+            // auxiliary effects accumulate in the chain input buffer on this thread,
+            // insert effects are processed by the worker
+            processEffects(mEffects, false /* insert */);
+#ifdef FLOAT_EFFECT_CHAIN
+            mWorker->exchange(mInBuffer->audioBuffer()->f32, mOutBuffer->audioBuffer()->f32,
+                    mInBuffer->audioBuffer()->raw != mOutBuffer->audioBuffer()->raw);
+#endif
+        } else {
+            processEffects(mEffects, true /* insert */);
         }
         mInBuffer->commit();
         if (mInBuffer->audioBuffer()->raw != mOutBuffer->audioBuffer()->raw) {
@@ -2077,7 +2451,11 @@ void AudioFlinger::EffectChain::process_l()
     }
     bool doResetVolume = false;
     for (size_t i = 0; i < size; i++) {
-        doResetVolume = mEffects[i]->updateState() || doResetVolume;
+        // the worker holds the lock of the insert effects while processing them: do not wait
+        // for it, the state of a busy effect is updated at the next call
+        const bool tryLock = mWorker != 0 && (mEffects[i]->desc().flags & EFFECT_FLAG_TYPE_MASK)
+                != EFFECT_FLAG_TYPE_AUXILIARY;
+        doResetVolume = mEffects[i]->updateState(tryLock) || doResetVolume;
     }
     if (doResetVolume) {
         resetVolume_l();
@@ -2136,6 +2514,7 @@ status_t AudioFlinger::EffectChain::addEffect_ll(const sp<EffectModule>& effect)
                 numSamples * sizeof(int32_t), &halBuffer);
 #endif
         if (result != OK) return result;
+        stopWorker_l();
         effect->setInBuffer(halBuffer);
         // auxiliary effects output samples to chain input buffer for further processing
         // by insert effects
@@ -2203,6 +2582,8 @@ status_t AudioFlinger::EffectChain::addEffect_ll(const sp<EffectModule>& effect)
             }
         }
 
+        stopWorker_l();
+
         // always read samples from chain input buffer
         effect->setInBuffer(mInBuffer);
 
@@ -2223,6 +2604,8 @@ status_t AudioFlinger::EffectChain::addEffect_ll(const sp<EffectModule>& effect)
                 idx_insert);
     }
     effect->configure();
+    planBuffers_l();
+    updateWorker_l();
 
     return NO_ERROR;
 }
@@ -2235,6 +2618,9 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect,
     size_t size = mEffects.size();
     uint32_t type = effect->desc().flags & EFFECT_FLAG_TYPE_MASK;
 
+    // the worker must not process the effects while they are changed
+    stopWorker_l();
+
     for (size_t i = 0; i < size; i++) {
         if (effect == mEffects[i]) {
             // calling stop here will remove pre-processing effect from the audio HAL.
@@ -2255,12 +2641,14 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect,
                 }
             }
             mEffects.removeAt(i);
+            effect->setSharedInt16Buffer(nullptr);
             ALOGV("removeEffect_l() effect %p, removed from chain %p at rank %zu", effect.get(),
                     this, i);
 
             break;
         }
     }
+    updateWorker_l();
 
     return mEffects.size();
 }
@@ -2417,6 +2805,20 @@ void AudioFlinger::EffectChain::dump(int fd, const Vector<String16>& args)
                 (int)outBufferStr.size(), "Out buffer      ");
         result.appendFormat("\t%s   %s   %d\n",
                 inBufferStr.c_str(), outBufferStr.c_str(), mActiveTrackCnt);
+        if (mWorker != 0 || mWorkerBlocks != 0) {
+            const uint64_t blocks = mWorkerBlocks + (mWorker != 0 ? mWorker->blocks() : 0);
+            const uint64_t underruns =
+                    mWorkerUnderruns + (mWorker != 0 ? mWorker->underruns() : 0);
+            result.appendFormat("\tWorker: %s, blocks %llu, underruns %llu",
+                    mWorker != 0 ? "running" : "stopped",
+                    (unsigned long long)blocks, (unsigned long long)underruns);
+            if (mWorker != 0) {
+                result.appendFormat(", tid %d, max process %.1f us, latency %zu frames",
+                        mWorker->getTid(), mWorker->maxProcessNs() * 1e-3,
+                        mEffectCallback->frameCount());
+            }
+            result.append("\n");
+        }
         write(fd, result.string(), result.size());
 
         for (size_t i = 0; i < numEffects; ++i) {
@@ -211,8 +211,13 @@ public:
                     audio_port_handle_t deviceId);
     virtual ~EffectModule();
 
-    void process();
-    bool updateState();
+    // Processes one buffer. int16Pending is true when the chain buffer content is held in the
+    // shared int16_t buffer, left there by the previous effect (see setSharedInt16Buffer()).
+    // Returns true when the content is held in the shared int16_t buffer on return.
+    bool process(bool int16Pending = false);
+    // Returns true if the effect was started. If tryLock is true, the state is left unchanged
+    // when the effect lock is held, and updated at a later call.
+    bool updateState(bool tryLock = false);
     status_t command(uint32_t cmdCode,
                      uint32_t cmdSize,
                      void *pCmdData,
@@ -240,6 +245,14 @@ public:
         return mOutBuffer != 0 ? reinterpret_cast<int16_t*>(mOutBuffer->ptr()) : NULL;
     }
 
+    // Offers an int16_t HAL buffer shared by the insert effects of the chain. It is used by
+    // effects processing int16_t in place with the chain channel count, so that adjacent such
+    // effects do not convert from and to float around each process call.
+    void        setSharedInt16Buffer(const sp<EffectBufferHalInterface>& buffer);
+    bool        usesSharedInt16Buffer() const { return mUsesSharedInt16Buffer; }
+    // Converts the shared int16_t buffer back to the float output buffer.
+    void        flushSharedInt16Buffer();
+
     ssize_t removeHandle_l(EffectHandle *handle) override;
 
     status_t         setDevices(const AudioDeviceTypeAddrVector &devices);
@@ -271,6 +284,7 @@ private:
     status_t stop_l();
     status_t removeEffectFromHal_l();
     status_t sendSetAudioDevicesCommand(const AudioDeviceTypeAddrVector &devices, uint32_t cmdCode);
+    void updateSharedInt16Buffer_l();
 
     effect_config_t     mConfig;    // input and output audio configuration
     sp<EffectHalInterface> mEffectInterface; // Effect module HAL
@@ -289,7 +303,14 @@ private:
     sp<EffectBufferHalInterface> mOutConversionBuffer;
     uint32_t mInChannelCountRequested;
     uint32_t mOutChannelCountRequested;
+    sp<EffectBufferHalInterface> mSharedInt16Buffer;   // offered by the chain
 #endif
+    bool     mUsesSharedInt16Buffer = false;   // HAL buffers are mSharedInt16Buffer
+
+    // Time spent in process() while processing is enabled, reported by dump()
+    uint64_t mProcessCount = 0;
+    int64_t  mProcessTotalNs = 0;
+    int64_t  mProcessMaxNs = 0;
 
     class AutoLockReentrant {
     public:
@@ -462,11 +483,22 @@ public:
     void decTrackCnt() { android_atomic_dec(&mTrackCnt); }
     int32_t trackCnt() const { return android_atomic_acquire_load(&mTrackCnt); }
 
+    // the worker outputs the last processed buffer one buffer after the last input
     void incActiveTrackCnt() { android_atomic_inc(&mActiveTrackCnt);
-                               mTailBufferCount = mMaxTailBuffers; }
+                               mTailBufferCount = mMaxTailBuffers + (mWorker != 0 ? 1 : 0); }
     void decActiveTrackCnt() { android_atomic_dec(&mActiveTrackCnt); }
     int32_t activeTrackCnt() const { return android_atomic_acquire_load(&mActiveTrackCnt); }
 
+    // Implementation UUIDs of the effects configured with worker="true" in audio_effects.xml,
+    // parsed at the first call
+    static const std::vector<effect_uuid_t>& workerEffectUuids();
+
+    // Latency added by the worker: one buffer if the insert effects run on a worker.
+    // Must be called with ThreadBase::mLock held
+    size_t workerLatencyFrames_l() const {
+        return mWorker != 0 ? mEffectCallback->frameCount() : 0;
+    }
+
     uint32_t strategy() const { return mStrategy; }
     void setStrategy(uint32_t strategy)
             { mStrategy = strategy; }
@@ -567,7 +599,51 @@ private:
         wp<AudioFlinger> mAudioFlinger;
     };
 
+    // Processes the insert effects of the chain on a dedicated thread, one buffer behind the
+    // thread calling process_l(). Each buffer is exchanged with the worker buffer while the
+    // worker is idle, and handed over with atomic block counters and a semaphore: process_l()
+    // never waits for the worker. If the worker has not completed the previous buffer, that
+    // buffer is output unprocessed from a copy, the late output is dropped and an underrun is
+    // counted.
+    // The worker is stopped while the effects of the chain are added, removed or configured.
+    class Worker : public Thread {
+    public:
+        Worker(const std::vector<sp<EffectModule>>& effects,
+               const sp<EffectBufferHalInterface>& buffer,
+               size_t sampleCount);
+        ~Worker() override;
+
+        // Called by process_l(). accumulate is true if the chain output buffer is distinct
+        // from the input buffer.
+        void exchange(float *in, float *out, bool accumulate);
+        // Waits for the block being processed, if any. The effects are not processed after
+        // return, and the thread exits on its own. The worker cannot be run again.
+        void stop();
+
+        const sp<EffectBufferHalInterface>& buffer() const { return mBuffer; }
+        uint64_t blocks() const { return mBlocks; }
+        uint64_t underruns() const { return mUnderruns; }
+        int64_t maxProcessNs() const { return mMaxProcessNs.load(std::memory_order_relaxed); }
+
+    private:
+        bool threadLoop() override;
+
+        Mutex mProcessLock;                          // held by the worker while processing
+        std::vector<sp<EffectModule>> mEffects;      // cleared by stop()
+        const sp<EffectBufferHalInterface> mBuffer;  // buffer the effects process in place
+        const size_t mSampleCount;
+        sem_t mSemaphore;                            // posted for each submitted block
+        std::atomic<uint64_t> mSubmitted{0};         // written by process_l()
+        std::atomic<uint64_t> mProcessed{0};         // written by the worker
+        uint64_t mBlocks = 0;                        // exchanges by process_l()
+        uint64_t mUnderruns = 0;                     // exchanges with the worker late
+        std::vector<float> mDry;                     // unprocessed copy of the block due next
+        bool mDropPending = false;                   // the output of the worker is late
+        std::atomic<int64_t> mMaxProcessNs{0};
+    };
+
     friend class AudioFlinger;  // for mThread, mEffects
+    friend class EffectChainTest;  // for processEffects()
     DISALLOW_COPY_AND_ASSIGN(EffectChain);
 
     class SuspendedEffectDesc : public RefBase {
@@ -594,6 +670,20 @@ private:
 
     void clearInputBuffer_l();
 
+    // Offers the shared int16_t buffer to the insert effects, see
+    // EffectModule::setSharedInt16Buffer()
+    void planBuffers_l();
+
+    // Processes the auxiliary effects, and the insert effects if insert is true
+    template <typename Effects>
+    static void processEffects(const Effects& effects, bool insert);
+
+    // Starts a worker if an insert effect is configured to run on one, and connects the insert
+    // effects to the worker buffer or to the chain buffers.
+    void updateWorker_l();
+    void stopWorker_l();
+    void setInsertEffectBuffers_l();
+
     void setThread(const sp<ThreadBase>& thread);
 
     // true if any effect module within the chain has volume control
@@ -606,6 +696,10 @@ private:
              audio_session_t mSessionId; // audio session ID
              sp<EffectBufferHalInterface> mInBuffer;  // chain input buffer
              sp<EffectBufferHalInterface> mOutBuffer; // chain output buffer
+             sp<EffectBufferHalInterface> mSharedInt16Buffer; // see planBuffers_l()
+             sp<Worker> mWorker;         // processes the insert effects if not null
+             uint64_t mWorkerBlocks = 0;     // blocks and underruns of the previous workers
+             uint64_t mWorkerUnderruns = 0;
 
     // 'volatile' here means these are accessed with atomic operations instead of mutex
     volatile int32_t mActiveTrackCnt;    // number of active tracks connected
@@ -122,6 +122,25 @@ void FastMixer::onExit()
     free(mSinkBuffer);
 }
 
+void FastMixer::onLogHistograms()
+{
+#ifdef FAST_THREAD_STATISTICS
+    const FastMixerState * const current = (const FastMixerState *) mCurrent;
+    FastMixerDumpState * const dumpState = (FastMixerDumpState *) mDumpState;
+    logHistogramDelta(NBLog::HIST_MIX_TIME, 0 /* track */, dumpState->mMixHist, &mLoggedMixHist);
+    unsigned currentTrackMask = current->mTrackMask;
+    while (currentTrackMask != 0) {
+        int i = __builtin_ctz(currentTrackMask);
+        currentTrackMask &= ~(1 << i);
+        FastTrackHookHist * const hookHist = dumpState->mTracks[i].mHookHist.get();
+        if (hookHist != nullptr) {
+            logHistogramDelta(NBLog::HIST_TRACK_HOOK_TIME, i, hookHist->mHist,
+                    &hookHist->mLogged);
+        }
+    }
+#endif
+}
+
 bool FastMixer::isSubClassCommand(FastThreadState::Command command)
 {
     switch ((FastMixerState::Command) command) {
@@ -371,6 +390,10 @@ void FastMixer::onWork()
 
         // for each track, update volume and check for underrun
         unsigned currentTrackMask = current->mTrackMask;
+#ifdef FAST_THREAD_STATISTICS
+        // the end of one track's hooks is the start of the next track's
+        nsecs_t hookStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+#endif
         while (currentTrackMask != 0) {
             int i = __builtin_ctz(currentTrackMask);
             currentTrackMask &= ~(1 << i);
@@ -417,6 +440,13 @@ void FastMixer::onWork()
                 ATRACE_INT(traceName, framesReady);
             }
             FastTrackDump *ftDump = &dumpState->mTracks[i];
+#ifdef FAST_THREAD_STATISTICS
+            const nsecs_t hookEndNs = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (ftDump->mHookHist != nullptr) {
+                ftDump->mHookHist->mHist.add(hookEndNs - hookStartNs);
+            }
+            hookStartNs = hookEndNs;
+#endif
             FastTrackUnderruns underruns = ftDump->mUnderruns;
             if (framesReady < frameCount) {
                 if (framesReady == 0) {
@@ -443,7 +473,13 @@ void FastMixer::onWork()
 
         if (anyEnabledTracks) {
             // process() is CPU-bound
+#ifdef FAST_THREAD_STATISTICS
+            const nsecs_t mixStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
             mMixer->process();
+            dumpState->mMixHist.add(systemTime(SYSTEM_TIME_MONOTONIC) - mixStartNs);
+#else
+            mMixer->process();
+#endif
             mMixerBufferState = MIXED;
         } else if (mMixerBufferState != ZEROED) {
             mMixerBufferState = UNDEFINED;
@@ -58,6 +58,7 @@ private:
     virtual bool isSubClassCommand(FastThreadState::Command command);
     virtual void onStateChange();
     virtual void onWork();
+    virtual void onLogHistograms();
 
     enum Reason {
         REASON_REMOVE,
@@ -102,6 +103,12 @@ private:
 
     audio_utils::Balance mBalance;
 
+#ifdef FAST_THREAD_STATISTICS
+    // mixer histogram in dump state as last logged to NBLog; the per-track ones are
+    // in FastTrackHookHist
+    ReportPerformance::LogLinearHistogram mLoggedMixHist;
+#endif
+
     // accessed without lock between multiple threads.
     std::atomic_bool mMasterMono;
     std::atomic<float> mMasterBalance{};
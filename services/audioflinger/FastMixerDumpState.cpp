@@ -30,6 +30,27 @@
 
 namespace android {
 
+FastTrackDump::FastTrackDump(const FastTrackDump& copyFrom) :
+    mUnderruns(copyFrom.mUnderruns), mFramesReady(copyFrom.mFramesReady),
+    mFramesWritten(copyFrom.mFramesWritten)
+{
+    if (copyFrom.mHookHist != nullptr) {
+        mHookHist = std::make_unique<FastTrackHookHist>(*copyFrom.mHookHist);
+    }
+}
+
+FastTrackDump& FastTrackDump::operator=(const FastTrackDump& rhs)
+{
+    if (this != &rhs) {
+        mUnderruns = rhs.mUnderruns;
+        mFramesReady = rhs.mFramesReady;
+        mFramesWritten = rhs.mFramesWritten;
+        mHookHist = rhs.mHookHist != nullptr
+                ? std::make_unique<FastTrackHookHist>(*rhs.mHookHist) : nullptr;
+    }
+    return *this;
+}
+
 FastMixerDumpState::FastMixerDumpState() : FastThreadDumpState(),
     mWriteSequence(0), mFramesWritten(0),
     mNumTracks(0), mWriteErrors(0),
@@ -165,6 +186,10 @@ void FastMixerDumpState::dump(int fd) const
                     right.getStdDev()*1e-6);
         delete[] tail;
     }
+    dprintf(fd, "  Histogram of all mix cycle times: %s\n",
+            mCycleHist.summaryString(1e6, "ms").c_str());
+    dprintf(fd, "  Histogram of AudioMixer::process() times: %s\n",
+            mMixHist.summaryString(1e6, "ms").c_str());
 #endif
     // The active track mask and track states are updated non-atomically.
     // So if we relied on isActive to decide whether to display,
@@ -202,6 +227,18 @@ void FastMixerDumpState::dump(int fd) const
                 mostRecent, ftDump->mFramesReady,
                 (long long)ftDump->mFramesWritten);
     }
+#ifdef FAST_THREAD_STATISTICS
+    dprintf(fd, "  Fast track provider hook times per mix cycle:\n");
+    trackMask = mTrackMask;
+    while (trackMask != 0) {
+        const uint32_t i = __builtin_ctz(trackMask);
+        trackMask &= ~(1 << i);
+        if (mTracks[i].mHookHist != nullptr) {
+            dprintf(fd, "  %5u %s\n", i,
+                    mTracks[i].mHookHist->mHist.summaryString(1e3, "us").c_str());
+        }
+    }
+#endif
 }
 
 }   // android
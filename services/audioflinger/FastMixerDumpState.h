@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FAST_MIXER_DUMP_STATE_H
 #define ANDROID_AUDIO_FAST_MIXER_DUMP_STATE_H
 
+#include <memory>
 #include <stdint.h>
 #include <audio_utils/TimestampVerifier.h>
 #include "Configuration.h"
@@ -52,13 +53,26 @@ private:
     uint32_t mAtomic;
 };
 
+// Per-cycle nanoseconds spent in a fast track's provider hooks (timestamp, volume and
+// framesReady()), and the counts of it already logged to NBLog by the fast mixer.
+struct FastTrackHookHist {
+    ReportPerformance::LogLinearHistogram mHist;
+    ReportPerformance::LogLinearHistogram mLogged;
+};
+
 // Represents the dump state of a fast track
 struct FastTrackDump {
     FastTrackDump() : mFramesReady(0) { }
+    FastTrackDump(const FastTrackDump& copyFrom);   // copies the histograms too
+    FastTrackDump& operator=(const FastTrackDump& rhs);
     /*virtual*/ ~FastTrackDump() { }
     FastTrackUnderruns  mUnderruns;
     size_t              mFramesReady;        // most recent value only; no long-term statistics kept
     int64_t             mFramesWritten;      // last value from track
+    // About 2 KB, so allocated by the normal mixer thread when the slot first becomes active
+    // rather than for all kMaxFastTracks slots, and nullptr until then. Kept for the life of
+    // the dump state and, like the underrun counters, not reset when the slot is reused.
+    std::unique_ptr<FastTrackHookHist> mHookHist;
 };
 
 struct FastMixerDumpState : FastThreadDumpState {
@@ -76,6 +90,7 @@ struct FastMixerDumpState : FastThreadDumpState {
     size_t   mFrameCount;
     uint32_t mTrackMask;        // mask of active tracks
     FastTrackDump   mTracks[FastMixerState::kMaxFastTracks];
+    ReportPerformance::LogLinearHistogram mMixHist;  // nanoseconds in AudioMixer::process()
 
     // For timestamp statistics.
     TimestampVerifier<int64_t /* frame count */, int64_t /* time ns */> mTimestampVerifier;
@@ -59,6 +59,8 @@ FastThread::FastThread(const char *cycleMs, const char *loadUs) : Thread(false /
     mOldLoadValid(false),
     mBounds(0),
     mFull(false),
+    // mLoggedCycleHist
+    mLastHistogramLogNs(0),
     // mTcu
 #endif
     mColdGen(0),
@@ -88,6 +90,29 @@ FastThread::~FastThread()
 {
 }
 
+void FastThread::onLogHistograms()
+{
+}
+
+// static
+void FastThread::logHistogramDelta(NBLog::HistogramKind kind, uint8_t track,
+        const ReportPerformance::LogLinearHistogram &current,
+        ReportPerformance::LogLinearHistogram *logged)
+{
+    // The histogram went backwards, e.g. because a new dump state area was installed;
+    // log its entire contents.
+    if (current.totalCount() < logged->totalCount()) {
+        logged->clear();
+    }
+    NBLog::log_linear_hist_t chunks[ReportPerformance::LogLinearHistogram::kMaxChunks];
+    const size_t numChunks = current.deltaChunks(*logged, kind, track, chunks,
+            ReportPerformance::LogLinearHistogram::kMaxChunks);
+    for (size_t i = 0; i < numChunks; ++i) {
+        LOG_LOG_LINEAR_HIST(chunks[i]);
+    }
+    *logged = current;
+}
+
 bool FastThread::threadLoop()
 {
     // LOGT now works even if tlNBLogWriter is nullptr, but we're considering changing that,
@@ -344,6 +369,7 @@ bool FastThread::threadLoop()
                     // or with respect to store #4 below
                     mDumpState->mMonotonicNs[i] = monotonicNs;
                     LOG_WORK_TIME(monotonicNs);
+                    mDumpState->mCycleHist.add(monotonicNs);
                     mDumpState->mLoadNs[i] = loadNs;
 #ifdef CPU_FREQUENCY_STATISTICS
                     mDumpState->mCpukHz[i] = kHz;
@@ -353,6 +379,15 @@ bool FastThread::threadLoop()
                     mDumpState->mBounds = mBounds;
                     ATRACE_INT(mCycleMs, monotonicNs / 1000000);
                     ATRACE_INT(mLoadUs, loadNs / 1000);
+
+                    // periodically export the histograms, as deltas to keep entries small
+                    const int64_t nowNs = audio_utils_ns_from_timespec(&newTs);
+                    if (nowNs - mLastHistogramLogNs >= kHistogramLogPeriodNs) {
+                        mLastHistogramLogNs = nowNs;
+                        logHistogramDelta(NBLog::HIST_CYCLE_TIME, 0 /* track */,
+                                mDumpState->mCycleHist, &mLoggedCycleHist);
+                        onLogHistograms();
+                    }
                 }
 #endif
             } else {
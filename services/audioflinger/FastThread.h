@@ -21,6 +21,7 @@
 #ifdef CPU_FREQUENCY_STATISTICS
 #include <cpustats/ThreadCpuUsage.h>
 #endif
+#include <media/nblog/LogLinearHistogram.h>
 #include <utils/Thread.h>
 #include "FastThreadState.h"
 
@@ -47,6 +48,17 @@ protected:
     virtual bool isSubClassCommand(FastThreadState::Command command) = 0;
     virtual void onStateChange() = 0;
     virtual void onWork() = 0;
+    // Called about once per kHistogramLogPeriodNs while warm, to log histogram counts
+    // added since the previous call through NBLog.
+    virtual void onLogHistograms();
+
+    // Logs the counts added to |current| since |logged| as EVENT_LOG_LINEAR_HIST entries,
+    // then updates |logged|.
+    static void logHistogramDelta(NBLog::HistogramKind kind, uint8_t track,
+            const ReportPerformance::LogLinearHistogram &current,
+            ReportPerformance::LogLinearHistogram *logged);
+
+    static const int64_t kHistogramLogPeriodNs = 1000000000; // 1 second
 
     // FIXME these former local variables need comments
     const FastThreadState*  mPrevious;
@@ -71,6 +83,8 @@ protected:
     bool            mOldLoadValid;  // whether oldLoad is valid
     uint32_t        mBounds;
     bool            mFull;          // whether we have collected at least mSamplingN samples
+    ReportPerformance::LogLinearHistogram mLoggedCycleHist; // mCycleHist as last logged
+    int64_t         mLastHistogramLogNs;
 #ifdef CPU_FREQUENCY_STATISTICS
     ThreadCpuUsage  mTcu;           // for reading the current CPU clock frequency in kHz
 #endif
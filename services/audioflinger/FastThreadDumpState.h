@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FAST_THREAD_DUMP_STATE_H
 #define ANDROID_AUDIO_FAST_THREAD_DUMP_STATE_H
 
+#include <media/nblog/LogLinearHistogram.h>
 #include "Configuration.h"
 #include "FastThreadState.h"
 
@@ -60,6 +61,9 @@ struct FastThreadDumpState {
 #ifdef CPU_FREQUENCY_STATISTICS
     uint32_t mCpukHz[kSamplingN];       // absolute CPU clock frequency in kHz, bits 0-3 are CPU#
 #endif
+    // All cycle times since construction, in nanoseconds; unlike the arrays above this
+    // keeps the full distribution and is also exported through NBLog.
+    ReportPerformance::LogLinearHistogram mCycleHist;
 
     // Increase sampling window after construction, must be a power of 2 <= kSamplingN
     void    increaseSamplingN(uint32_t samplingN);
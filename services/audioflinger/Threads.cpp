@@ -2419,7 +2419,19 @@ uint32_t AudioFlinger::PlaybackThread::latency_l() const
 {
     uint32_t latency;
     if (initCheck() == NO_ERROR && mOutput->stream->getLatency(&latency) == OK) {
-        return correctLatency_l(latency);
+        // session chains are processed before the output mix chain
+        size_t sessionFrames = 0;
+        size_t outputFrames = 0;
+        for (size_t i = 0; i < mEffectChains.size(); i++) {
+            const size_t frames = mEffectChains[i]->workerLatencyFrames_l();
+            if (audio_is_global_session(mEffectChains[i]->sessionId())) {
+                outputFrames += frames;
+            } else {
+                sessionFrames = std::max(sessionFrames, frames);
+            }
+        }
+        return correctLatency_l(latency)
+                + (uint32_t)(((sessionFrames + outputFrames) * 1000) / mSampleRate);
     }
     return 0;
 }
@@ -4997,6 +5009,12 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                     fastTrack->mHapticPlaybackEnabled = track->getHapticPlaybackEnabled();
                     fastTrack->mHapticIntensity = track->getHapticIntensity();
                     fastTrack->mGeneration++;
+#ifdef FAST_THREAD_STATISTICS
+                    // visible to the fast mixer once the state below is pushed
+                    if (ftDump->mHookHist == nullptr) {
+                        ftDump->mHookHist = std::make_unique<FastTrackHookHist>();
+                    }
+#endif
                     state->mTrackMask |= 1 << j;
                     didModify = true;
                     // no acknowledgement required for newly active tracks
@@ -102,6 +102,11 @@ constexpr uint64_t hash(const char (&file)[n], uint32_t line) {
 #define LOG_LATENCY(ms) do { NBLog::Writer *x = tlNBLogWriter; if (x != nullptr) \
         x->log<NBLog::EVENT_LATENCY>(ms); } while (0)
 
+// Record a chunk of log-linear histogram bucket counts.
+// Parameter chunk is of type log_linear_hist_t as defined in Events.h.
+#define LOG_LOG_LINEAR_HIST(chunk) do { NBLog::Writer *x = tlNBLogWriter; if (x != nullptr) \
+        x->log<NBLog::EVENT_LOG_LINEAR_HIST>(chunk); } while (0)
+
 // Record thread overrun event nanosecond timestamp. Parameter ns is an int64_t.
 #define LOG_OVERRUN(ns) do { NBLog::Writer *x = tlNBLogWriter; if (x != nullptr) \
         x->log<NBLog::EVENT_OVERRUN>(ns); } while (0)
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectChainTest"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "AudioFlinger.h"
+
+namespace android {
+
+// Runs insert effects processing float and int16_t through EffectChain::processEffects(),
+// once with the int16_t effects sharing the chain int16_t buffer as planBuffers_l() sets up,
+// and once with each of them converting from and to float around its own process call, and
+// checks that both give the same output. Converting int16_t to float and back is lossless,
+// so the outputs must be identical.
+class EffectChainTest : public ::testing::Test {
+protected:
+    using EffectModule = AudioFlinger::EffectModule;
+    using EffectChain = AudioFlinger::EffectChain;
+
+    static constexpr size_t kFrameCount = 240;
+    static constexpr uint32_t kChannelCount = FCC_2;
+    static constexpr size_t kSampleCount = kFrameCount * kChannelCount;
+    static constexpr size_t kBlocks = 16;
+
+    // A buffer allocated by the chain, as from the effects factory.
+    class Buffer : public EffectBufferHalInterface {
+    public:
+        explicit Buffer(size_t size) : mData(size) {
+            mAudioBuffer.frameCount = 0;
+            mAudioBuffer.raw = mData.data();
+        }
+
+        audio_buffer_t* audioBuffer() override { return &mAudioBuffer; }
+        void* externalData() const override { return nullptr; }
+        size_t getSize() const override { return mData.size(); }
+        void setExternalData(void* external __unused) override {}
+        void setFrameCount(size_t frameCount) override { mAudioBuffer.frameCount = frameCount; }
+        bool checkFrameCountChange() override { return false; }
+        void update() override {}
+        void commit() override {}
+        void update(size_t size __unused) override {}
+        void commit(size_t size __unused) override {}
+
+    private:
+        std::vector<uint8_t> mData;
+        audio_buffer_t mAudioBuffer;
+    };
+
+    // An effect engine supporting either float or int16_t only. Each instance applies a
+    // different gain and offset, saturating, so that a skipped, repeated or reordered effect
+    // changes the output. Like the effects of the framework, a disabled engine passes its
+    // input through to its output if they differ and returns -ENODATA.
+    class FakeEffect : public EffectHalInterface {
+    public:
+        FakeEffect(int index, bool int16Only) : mIndex(index), mInt16Only(int16Only) {}
+
+        status_t setInBuffer(const sp<EffectBufferHalInterface>& buffer) override {
+            mInBuffer = buffer;
+            return OK;
+        }
+        status_t setOutBuffer(const sp<EffectBufferHalInterface>& buffer) override {
+            mOutBuffer = buffer;
+            return OK;
+        }
+
+        status_t process() override {
+            const size_t samples = mConfig.inputCfg.buffer.frameCount
+                    * audio_channel_count_from_out_mask(mConfig.inputCfg.channels);
+            const bool accumulate =
+                    mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE;
+            audio_buffer_t* in = mInBuffer->audioBuffer();
+            audio_buffer_t* out = mOutBuffer->audioBuffer();
+            if (!mEnabled && in->raw == out->raw) {
+                return -ENODATA;
+            }
+            for (size_t i = 0; i < samples; i++) {
+                if (mInt16Only) {
+                    int32_t value = mEnabled
+                            ? in->s16[i] * (mIndex + 2) / 3 - 700 * mIndex : in->s16[i];
+                    if (accumulate) {
+                        value += out->s16[i];
+                    }
+                    out->s16[i] = std::min(std::max(value, (int32_t)INT16_MIN),
+                            (int32_t)INT16_MAX);
+                } else {
+                    float value = mEnabled
+                            ? in->f32[i] * (0.6f + 0.1f * mIndex) + 0.03f * mIndex : in->f32[i];
+                    out->f32[i] = accumulate ? out->f32[i] + value : value;
+                }
+            }
+            return mEnabled ? OK : -ENODATA;
+        }
+
+        status_t processReverse() override { return INVALID_OPERATION; }
+
+        status_t command(uint32_t cmdCode, uint32_t cmdSize, void *pCmdData,
+                uint32_t *replySize, void *pReplyData) override {
+            int32_t status = 0;
+            switch (cmdCode) {
+            case EFFECT_CMD_SET_CONFIG: {
+                const audio_format_t format =
+                        mInt16Only ? AUDIO_FORMAT_PCM_16_BIT : AUDIO_FORMAT_PCM_FLOAT;
+                const effect_config_t *config = (const effect_config_t *)pCmdData;
+                if (cmdSize != sizeof(effect_config_t)
+                        || config->inputCfg.format != format
+                        || config->outputCfg.format != format) {
+                    status = -EINVAL;
+                } else {
+                    mConfig = *config;
+                }
+                break;
+            }
+            case EFFECT_CMD_ENABLE:
+                mEnabled = true;
+                break;
+            case EFFECT_CMD_DISABLE:
+                mEnabled = false;
+                break;
+            default:
+                break;
+            }
+            if (pReplyData != nullptr && replySize != nullptr
+                    && *replySize >= sizeof(int32_t)) {
+                *(int32_t *)pReplyData = status;
+                *replySize = sizeof(int32_t);
+            }
+            return OK;
+        }
+
+        status_t getDescriptor(effect_descriptor_t *pDescriptor __unused) override {
+            return INVALID_OPERATION;
+        }
+        status_t close() override { return OK; }
+        bool isLocal() const override { return true; }
+        status_t dump(int fd __unused) override { return OK; }
+
+    private:
+        const int mIndex;
+        const bool mInt16Only;
+        bool mEnabled = false;
+        effect_config_t mConfig = {};
+        sp<EffectBufferHalInterface> mInBuffer;
+        sp<EffectBufferHalInterface> mOutBuffer;
+    };
+
+    // A playback thread of kFrameCount stereo frames with no other effect management. The
+    // uuid of the effect tells which engine to create: timeLow is its index, and timeMid is
+    // 1 for an int16_t only engine.
+    class Callback : public AudioFlinger::EffectCallbackInterface {
+    public:
+        audio_io_handle_t io() const override { return AUDIO_IO_HANDLE_NONE; }
+        bool isOutput() const override { return true; }
+        bool isOffload() const override { return false; }
+        bool isOffloadOrDirect() const override { return false; }
+        bool isOffloadOrMmap() const override { return false; }
+        uint32_t sampleRate() const override { return 48000; }
+        audio_channel_mask_t channelMask() const override { return AUDIO_CHANNEL_OUT_STEREO; }
+        uint32_t channelCount() const override { return kChannelCount; }
+        size_t frameCount() const override { return kFrameCount; }
+
+        status_t addEffectToHal(sp<EffectHalInterface> effect __unused) override {
+            return OK;
+        }
+        status_t removeEffectFromHal(sp<EffectHalInterface> effect __unused) override {
+            return OK;
+        }
+        void setVolumeForOutput(float left __unused, float right __unused) const override {}
+        bool disconnectEffectHandle(AudioFlinger::EffectHandle *handle __unused,
+                bool unpinIfLast __unused) override {
+            return false;
+        }
+        void checkSuspendOnEffectEnabled(const sp<AudioFlinger::EffectBase>& effect __unused,
+                bool enabled __unused, bool threadLocked __unused) override {}
+        void onEffectEnable(const sp<AudioFlinger::EffectBase>& effect __unused) override {}
+        void onEffectDisable(const sp<AudioFlinger::EffectBase>& effect __unused) override {}
+
+        status_t createEffectHal(const effect_uuid_t *pEffectUuid,
+                int32_t sessionId __unused, int32_t deviceId __unused,
+                sp<EffectHalInterface> *effect) override {
+            *effect = new FakeEffect(pEffectUuid->timeLow, pEffectUuid->timeMid != 0);
+            return OK;
+        }
+        status_t allocateHalBuffer(size_t size, sp<EffectBufferHalInterface>* buffer) override {
+            *buffer = new Buffer(size);
+            return OK;
+        }
+        bool updateOrphanEffectChains(const sp<AudioFlinger::EffectBase>& effect __unused)
+                override {
+            return false;
+        }
+
+        uint32_t strategy() const override { return 0; }
+        int32_t activeTrackCnt() const override { return 1; }
+        void resetVolume() override {}
+
+        wp<AudioFlinger::EffectChain> chain() const override { return {}; }
+    };
+
+    struct Chain {
+        Vector<sp<EffectModule>> effects;
+        sp<EffectBufferHalInterface> inBuffer;
+        sp<EffectBufferHalInterface> outBuffer;
+    };
+
+    void TearDown() override {
+        for (Chain *chain : {&mShared, &mReference}) {
+            for (const sp<EffectModule>& effect : chain->effects) {
+                effect->release_l();
+            }
+        }
+    }
+
+    // Adds enabled insert effects to the shared and the reference chains, int16_t only for
+    // the true entries of int16Only, in place as in a global session. With accumulate, the
+    // last effect accumulates into a separate output buffer, as in a track session.
+    void makeChains(const std::vector<bool>& int16Only, bool accumulate = false) {
+        makeChain(&mShared, int16Only, accumulate, true /* shared */);
+        makeChain(&mReference, int16Only, accumulate, false /* shared */);
+    }
+
+    void makeChain(Chain *chain, const std::vector<bool>& int16Only, bool accumulate,
+            bool shared) {
+        const size_t bufferSize = kSampleCount * sizeof(float);
+        chain->inBuffer = new Buffer(bufferSize);
+        chain->outBuffer = accumulate ? new Buffer(bufferSize) : chain->inBuffer;
+        sp<EffectBufferHalInterface> int16Buffer;
+        if (shared) {
+            // as EffectChain::planBuffers_l()
+            ASSERT_EQ(OK, mCallback->allocateHalBuffer(
+                    kSampleCount * sizeof(int16_t), &int16Buffer));
+        }
+        for (size_t i = 0; i < int16Only.size(); i++) {
+            effect_descriptor_t desc = {};
+            desc.uuid.timeLow = i;
+            desc.uuid.timeMid = int16Only[i];
+            desc.flags = EFFECT_FLAG_TYPE_INSERT;
+            sp<EffectModule> effect = new EffectModule(mCallback, &desc, i + 1 /* id */,
+                    AUDIO_SESSION_OUTPUT_MIX, false /* pinned */, AUDIO_PORT_HANDLE_NONE);
+            ASSERT_EQ(OK, (status_t)effect->status());
+            effect->setInBuffer(chain->inBuffer);
+            effect->setOutBuffer(i + 1 == int16Only.size() ? chain->outBuffer : chain->inBuffer);
+            ASSERT_EQ(OK, effect->configure());
+            effect->setSharedInt16Buffer(int16Buffer);
+            chain->effects.add(effect);
+            effect->setEnabled(true, false /* fromHandle */);
+            effect->updateState();
+        }
+    }
+
+    // Toggles effect index in both chains.
+    void setEnabled(size_t index, bool enabled) {
+        mShared.effects[index]->setEnabled(enabled, false /* fromHandle */);
+        mReference.effects[index]->setEnabled(enabled, false /* fromHandle */);
+    }
+
+    // One cycle of EffectChain::process_l() for both chains, on the same input.
+    void processBlock(size_t block) {
+        // full scale and beyond, so that the conversions to int16_t clamp
+        std::vector<float> input(kSampleCount);
+        for (size_t i = 0; i < kSampleCount; i++) {
+            input[i] = 1.25f * sinf((block * kSampleCount + i) * 0.0137f * (1 + i % 3));
+        }
+        std::vector<float> outputs[2];
+        int n = 0;
+        for (Chain *chain : {&mShared, &mReference}) {
+            std::copy(input.begin(), input.end(), chain->inBuffer->audioBuffer()->f32);
+            if (chain->outBuffer != chain->inBuffer) {
+                // the mix of the other sessions
+                std::fill_n(chain->outBuffer->audioBuffer()->f32, kSampleCount, 0.125f);
+            }
+            EffectChain::processEffects(chain->effects, true /* insert */);
+            for (const sp<EffectModule>& effect : chain->effects) {
+                effect->updateState();
+            }
+            const float *output = chain->outBuffer->audioBuffer()->f32;
+            outputs[n++].assign(output, output + kSampleCount);
+        }
+        ASSERT_EQ(outputs[1], outputs[0]) << "block " << block;
+        mProcessed |= outputs[0] != input;
+    }
+
+    void processBlocks() {
+        for (size_t block = 0; block < kBlocks; block++) {
+            ASSERT_NO_FATAL_FAILURE(processBlock(block));
+        }
+        EXPECT_TRUE(mProcessed);
+    }
+
+    const sp<Callback> mCallback = new Callback();
+    Chain mShared;
+    Chain mReference;
+    bool mProcessed = false;    // any output differed from its input
+};
+
+// Runs of int16_t effects around float ones, at both ends of the chain.
+TEST_F(EffectChainTest, MixedChain) {
+    const std::vector<bool> int16Only = {true, true, false, true, true, true, false, true};
+    ASSERT_NO_FATAL_FAILURE(makeChains(int16Only));
+    for (size_t i = 0; i < int16Only.size(); i++) {
+        EXPECT_EQ(int16Only[i], mShared.effects[i]->usesSharedInt16Buffer()) << "effect " << i;
+        EXPECT_FALSE(mReference.effects[i]->usesSharedInt16Buffer()) << "effect " << i;
+    }
+    processBlocks();
+}
+
+// Effects disabled and enabled between blocks go through the STOPPING, STOPPED, IDLE and
+// STARTING states, splitting and joining the runs of int16_t effects.
+TEST_F(EffectChainTest, EnableDisableMidStream) {
+    ASSERT_NO_FATAL_FAILURE(makeChains({true, true, false, true, true, true, false, true}));
+    const struct {
+        size_t block;
+        size_t effect;
+        bool enabled;
+    } changes[] = {
+        {2, 1, false},      // inside a run
+        {3, 0, false},      // at the head of the chain
+        {5, 2, false},      // the float effect between two runs
+        {6, 1, true},
+        {7, 5, false},      // at the end of a run
+        {8, 7, false},      // at the end of the chain
+        {9, 0, true},
+        {10, 2, true},
+        {11, 3, false},
+        {11, 4, false},
+        {12, 7, true},
+        {13, 3, true},
+        {13, 5, true},
+    };
+    size_t next = 0;
+    for (size_t block = 0; block < kBlocks; block++) {
+        for (; next < std::size(changes) && changes[next].block == block; next++) {
+            setEnabled(changes[next].effect, changes[next].enabled);
+        }
+        ASSERT_NO_FATAL_FAILURE(processBlock(block));
+    }
+    EXPECT_TRUE(mProcessed);
+}
+
+TEST_F(EffectChainTest, SingleInt16Effect) {
+    ASSERT_NO_FATAL_FAILURE(makeChains({true}));
+    EXPECT_TRUE(mShared.effects[0]->usesSharedInt16Buffer());
+    processBlocks();
+}
+
+TEST_F(EffectChainTest, SingleFloatEffect) {
+    ASSERT_NO_FATAL_FAILURE(makeChains({false}));
+    EXPECT_FALSE(mShared.effects[0]->usesSharedInt16Buffer());
+    processBlocks();
+}
+
+TEST_F(EffectChainTest, SingleInt16EffectDisabledMidStream) {
+    ASSERT_NO_FATAL_FAILURE(makeChains({true}));
+    for (size_t block = 0; block < kBlocks; block++) {
+        if (block == 4 || block == 10) {
+            setEnabled(0, block == 10);
+        }
+        ASSERT_NO_FATAL_FAILURE(processBlock(block));
+    }
+    EXPECT_TRUE(mProcessed);
+}
+
+// The last effect of a track session accumulates into the chain output: it cannot process in
+// place, so it converts on its own after the run before it is flushed.
+TEST_F(EffectChainTest, LastEffectAccumulates) {
+    ASSERT_NO_FATAL_FAILURE(makeChains({true, true, true}, true /* accumulate */));
+    EXPECT_TRUE(mShared.effects[0]->usesSharedInt16Buffer());
+    EXPECT_TRUE(mShared.effects[1]->usesSharedInt16Buffer());
+    EXPECT_FALSE(mShared.effects[2]->usesSharedInt16Buffer());
+    processBlocks();
+}
+
+}  // namespace android
@@ -42,86 +42,6 @@ typedef android::RingBufferConsumer::PinnedBufferItem PinnedBufferItem;
 namespace android {
 namespace camera2 {
 
-namespace {
-struct TimestampFinder : public RingBufferConsumer::RingBufferComparator {
-    typedef RingBufferConsumer::BufferInfo BufferInfo;
-
-    enum {
-        SELECT_I1 = -1,
-        SELECT_I2 = 1,
-        SELECT_NEITHER = 0,
-    };
-
-    explicit TimestampFinder(nsecs_t timestamp) : mTimestamp(timestamp) {}
-    ~TimestampFinder() {}
-
-    template <typename T>
-    static void swap(T& a, T& b) {
-        T tmp = a;
-        a = b;
-        b = tmp;
-    }
-
-    /**
-     * Try to find the best candidate for a ZSL buffer.
-     * Match priority from best to worst:
-     *  1) Timestamps match.
-     *  2) Timestamp is closest to the needle (and lower).
-     *  3) Timestamp is closest to the needle (and higher).
-     *
-     */
-    virtual int compare(const BufferInfo *i1,
-                        const BufferInfo *i2) const {
-        // Try to select non-null object first.
-        if (i1 == NULL) {
-            return SELECT_I2;
-        } else if (i2 == NULL) {
-            return SELECT_I1;
-        }
-
-        // Best result: timestamp is identical
-        if (i1->mTimestamp == mTimestamp) {
-            return SELECT_I1;
-        } else if (i2->mTimestamp == mTimestamp) {
-            return SELECT_I2;
-        }
-
-        const BufferInfo* infoPtrs[2] = {
-            i1,
-            i2
-        };
-        int infoSelectors[2] = {
-            SELECT_I1,
-            SELECT_I2
-        };
-
-        // Order i1,i2 so that always i1.timestamp < i2.timestamp
-        if (i1->mTimestamp > i2->mTimestamp) {
-            swap(infoPtrs[0], infoPtrs[1]);
-            swap(infoSelectors[0], infoSelectors[1]);
-        }
-
-        // Second best: closest (lower) timestamp
-        if (infoPtrs[1]->mTimestamp < mTimestamp) {
-            return infoSelectors[1];
-        } else if (infoPtrs[0]->mTimestamp < mTimestamp) {
-            return infoSelectors[0];
-        }
-
-        // Worst: closest (higher) timestamp
-        return infoSelectors[0];
-
-        /**
-         * The above cases should cover all the possibilities,
-         * and we get an 'empty' result only if the ring buffer
-         * was empty itself
-         */
-    }
-
-    const nsecs_t mTimestamp;
-}; // struct TimestampFinder
-} // namespace anonymous
-
 ZslProcessor::ZslProcessor(
     sp<Camera2Client> client,
     wp<CaptureSequencer> sequencer):
@@ -434,8 +354,10 @@ status_t ZslProcessor::pushToReprocess(int32_t requestId) {
         dumpZslQueue(-1);
     }
 
+    nsecs_t selectionStart = systemTime();
     size_t metadataIdx;
     nsecs_t candidateTimestamp = getCandidateTimestampLocked(&metadataIdx);
+    nsecs_t selectionTime = systemTime() - selectionStart;
 
     if (candidateTimestamp == -1) {
         ALOGV("%s: Could not find good candidate for ZSL reprocessing",
@@ -467,8 +389,13 @@ status_t ZslProcessor::pushToReprocess(int32_t requestId) {
         }
     }
 
+    // The one-time input producer setup above is left out of the selection latency
+    selectionStart = systemTime();
     res = enqueueInputBufferByTimestamp(candidateTimestamp,
         /*actualTimestamp*/NULL);
+    if (res == OK) {
+        mSelectionLatency.add(selectionTime + systemTime() - selectionStart);
+    }
     if (res == NO_BUFFER_AVAILABLE) {
         ALOGV("%s: No ZSL buffers yet", __FUNCTION__);
         return NOT_ENOUGH_DATA;
@@ -591,9 +518,7 @@ status_t ZslProcessor::enqueueInputBufferByTimestamp(
         nsecs_t timestamp,
         nsecs_t* actualTimestamp) {
 
-    TimestampFinder timestampFinder = TimestampFinder(timestamp);
-
-    mInputBuffer = mProducer->pinSelectedBuffer(timestampFinder,
+    mInputBuffer = mProducer->pinBufferByTimestamp(timestamp,
         /*waitForFence*/false);
 
     if (nullptr == mInputBuffer.get()) {
@@ -684,6 +609,11 @@ void ZslProcessor::dump(int fd, const Vector<String16>& /*args*/) const {
         String8 result("    Latest ZSL capture request: none yet\n");
         write(fd, result.string(), result.size());
     }
+    String8 latency = String8::format("    ZSL buffer selection latency: count %" PRIu64
+            ", mean %" PRId64 " us, p99 %" PRId64 " us, max %" PRId64 " us\n",
+            mSelectionLatency.count(), mSelectionLatency.meanUs(),
+            mSelectionLatency.percentileUs(99), mSelectionLatency.maxUs());
+    write(fd, latency.string(), latency.size());
     dumpZslQueue(fd);
 }
 
@@ -29,6 +29,7 @@
 #include <camera/CameraMetadata.h>
 
 #include "api1/client2/FrameProcessor.h"
+#include "utils/PipelineLatency.h"
 
 namespace android {
 
@@ -139,6 +140,9 @@ class ZslProcessor :
     // Input buffer queued into HAL
     sp<RingBufferConsumer::PinnedBufferItem> mInputBuffer;
     sp<RingBufferConsumer>                   mProducer;
+    // Time to pick the ZSL metadata candidate, pin its buffer and queue it
+    // to the input stream
+    CameraStageHistogram                     mSelectionLatency;
     sp<IGraphicBufferProducer>               mInputProducer;
     int                                      mInputProducerSlot;
 
@@ -91,7 +91,9 @@ CameraDeviceClient::CameraDeviceClient(const sp<CameraService>& cameraService,
                 cameraFacing, clientPid, clientUid, servicePid),
     mInputStream(),
     mStreamingRequestId(REQUEST_ID_NONE),
-    mRequestIdCounter(0) {
+    mRequestIdCounter(0),
+    mStreamConfigGeneration(0),
+    mRequestTemplateHandleCounter(0) {
 
     ATRACE_CALL();
     ALOGI("CameraDeviceClient %s: Opened", cameraId.string());
@@ -216,165 +218,18 @@ binder::Status CameraDeviceClient::submitRequestList(
     uint32_t loopCounter = 0;
 
     for (auto&& request: requests) {
-        if (request.mIsReprocess) {
-            if (!mInputStream.configured) {
-                ALOGE("%s: Camera %s: no input stream is configured.", __FUNCTION__,
-                        mCameraIdStr.string());
-                return STATUS_ERROR_FMT(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                        "No input configured for camera %s but request is for reprocessing",
-                        mCameraIdStr.string());
-            } else if (streaming) {
-                ALOGE("%s: Camera %s: streaming reprocess requests not supported.", __FUNCTION__,
-                        mCameraIdStr.string());
-                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                        "Repeating reprocess requests not supported");
-            } else if (request.mPhysicalCameraSettings.size() > 1) {
-                ALOGE("%s: Camera %s: reprocess requests not supported for "
-                        "multiple physical cameras.", __FUNCTION__,
-                        mCameraIdStr.string());
-                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                        "Reprocess requests not supported for multiple cameras");
-            }
-        }
-
-        if (request.mPhysicalCameraSettings.empty()) {
-            ALOGE("%s: Camera %s: request doesn't contain any settings.", __FUNCTION__,
+        if (request.mIsReprocess && streaming) {
+            ALOGE("%s: Camera %s: streaming reprocess requests not supported.", __FUNCTION__,
                     mCameraIdStr.string());
             return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                    "Request doesn't contain any settings");
-        }
-
-        //The first capture settings should always match the logical camera id
-        String8 logicalId(request.mPhysicalCameraSettings.begin()->id.c_str());
-        if (mDevice->getId() != logicalId) {
-            ALOGE("%s: Camera %s: Invalid camera request settings.", __FUNCTION__,
-                    mCameraIdStr.string());
-            return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                    "Invalid camera request settings");
-        }
-
-        if (request.mSurfaceList.isEmpty() && request.mStreamIdxList.size() == 0) {
-            ALOGE("%s: Camera %s: Requests must have at least one surface target. "
-                    "Rejecting request.", __FUNCTION__, mCameraIdStr.string());
-            return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                    "Request has no output targets");
-        }
-
-        /**
-         * Write in the output stream IDs and map from stream ID to surface ID
-         * which we calculate from the capture request's list of surface target
-         */
-        SurfaceMap surfaceMap;
-        Vector<int32_t> outputStreamIds;
-        std::vector<std::string> requestedPhysicalIds;
-        if (request.mSurfaceList.size() > 0) {
-            for (const sp<Surface>& surface : request.mSurfaceList) {
-                if (surface == 0) continue;
-
-                int32_t streamId;
-                sp<IGraphicBufferProducer> gbp = surface->getIGraphicBufferProducer();
-                res = insertGbpLocked(gbp, &surfaceMap, &outputStreamIds, &streamId);
-                if (!res.isOk()) {
-                    return res;
-                }
-
-                ssize_t index = mConfiguredOutputs.indexOfKey(streamId);
-                if (index >= 0) {
-                    String8 requestedPhysicalId(
-                            mConfiguredOutputs.valueAt(index).getPhysicalCameraId());
-                    requestedPhysicalIds.push_back(requestedPhysicalId.string());
-                } else {
-                    ALOGW("%s: Output stream Id not found among configured outputs!", __FUNCTION__);
-                }
-            }
-        } else {
-            for (size_t i = 0; i < request.mStreamIdxList.size(); i++) {
-                int streamId = request.mStreamIdxList.itemAt(i);
-                int surfaceIdx = request.mSurfaceIdxList.itemAt(i);
-
-                ssize_t index = mConfiguredOutputs.indexOfKey(streamId);
-                if (index < 0) {
-                    ALOGE("%s: Camera %s: Tried to submit a request with a surface that"
-                            " we have not called createStream on: stream %d",
-                            __FUNCTION__, mCameraIdStr.string(), streamId);
-                    return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                            "Request targets Surface that is not part of current capture session");
-                }
-
-                const auto& gbps = mConfiguredOutputs.valueAt(index).getGraphicBufferProducers();
-                if ((size_t)surfaceIdx >= gbps.size()) {
-                    ALOGE("%s: Camera %s: Tried to submit a request with a surface that"
-                            " we have not called createStream on: stream %d, surfaceIdx %d",
-                            __FUNCTION__, mCameraIdStr.string(), streamId, surfaceIdx);
-                    return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                            "Request targets Surface has invalid surface index");
-                }
-
-                res = insertGbpLocked(gbps[surfaceIdx], &surfaceMap, &outputStreamIds, nullptr);
-                if (!res.isOk()) {
-                    return res;
-                }
-
-                String8 requestedPhysicalId(
-                        mConfiguredOutputs.valueAt(index).getPhysicalCameraId());
-                requestedPhysicalIds.push_back(requestedPhysicalId.string());
-            }
+                    "Repeating reprocess requests not supported");
         }
 
+        std::shared_ptr<const CaptureRequestTargets> targets;
         CameraDeviceBase::PhysicalCameraSettingsList physicalSettingsList;
-        for (const auto& it : request.mPhysicalCameraSettings) {
-            if (it.settings.isEmpty()) {
-                ALOGE("%s: Camera %s: Sent empty metadata packet. Rejecting request.",
-                        __FUNCTION__, mCameraIdStr.string());
-                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                        "Request settings are empty");
-            }
-
-            String8 physicalId(it.id.c_str());
-            if (physicalId != mDevice->getId()) {
-                auto found = std::find(requestedPhysicalIds.begin(), requestedPhysicalIds.end(),
-                        it.id);
-                if (found == requestedPhysicalIds.end()) {
-                    ALOGE("%s: Camera %s: Physical camera id: %s not part of attached outputs.",
-                            __FUNCTION__, mCameraIdStr.string(), physicalId.string());
-                    return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
-                            "Invalid physical camera id");
-                }
-
-                if (!mSupportedPhysicalRequestKeys.empty()) {
-                    // Filter out any unsupported physical request keys.
-                    CameraMetadata filteredParams(mSupportedPhysicalRequestKeys.size());
-                    camera_metadata_t *meta = const_cast<camera_metadata_t *>(
-                            filteredParams.getAndLock());
-                    set_camera_metadata_vendor_id(meta, mDevice->getVendorTagId());
-                    filteredParams.unlock(meta);
-
-                    for (const auto& keyIt : mSupportedPhysicalRequestKeys) {
-                        camera_metadata_ro_entry entry = it.settings.find(keyIt);
-                        if (entry.count > 0) {
-                            filteredParams.update(entry);
-                        }
-                    }
-
-                    physicalSettingsList.push_back({it.id, filteredParams});
-                }
-            } else {
-                physicalSettingsList.push_back({it.id, it.settings});
-            }
-        }
-
-        if (!enforceRequestPermissions(physicalSettingsList.begin()->metadata)) {
-            // Callee logs
-            return STATUS_ERROR(CameraService::ERROR_PERMISSION_DENIED,
-                    "Caller does not have permission to change restricted controls");
-        }
-
-        physicalSettingsList.begin()->metadata.update(ANDROID_REQUEST_OUTPUT_STREAMS,
-                &outputStreamIds[0], outputStreamIds.size());
-
-        if (request.mIsReprocess) {
-            physicalSettingsList.begin()->metadata.update(ANDROID_REQUEST_INPUT_STREAMS,
-                    &mInputStream.id, 1);
+        res = compileRequestLocked(request, &targets, &physicalSettingsList);
+        if (!res.isOk()) {
+            return res;
         }
 
         physicalSettingsList.begin()->metadata.update(ANDROID_REQUEST_ID,
@@ -385,7 +240,7 @@ binder::Status CameraDeviceClient::submitRequestList(
                 loopCounter, requests.size());
 
         metadataRequestList.push_back(physicalSettingsList);
-        surfaceMapList.push_back(surfaceMap);
+        surfaceMapList.push_back(targets->surfaceMap);
     }
     mRequestIdCounter++;
 
@@ -421,6 +276,361 @@ binder::Status CameraDeviceClient::submitRequestList(
     return res;
 }
 
+binder::Status CameraDeviceClient::compileRequestLocked(
+        const hardware::camera2::CaptureRequest& request,
+        /*out*/
+        std::shared_ptr<const CaptureRequestTargets>* targets,
+        /*out*/
+        CameraDeviceBase::PhysicalCameraSettingsList* physicalSettingsList) {
+    if (request.mIsReprocess) {
+        if (!mInputStream.configured) {
+            ALOGE("%s: Camera %s: no input stream is configured.", __FUNCTION__,
+                    mCameraIdStr.string());
+            return STATUS_ERROR_FMT(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                    "No input configured for camera %s but request is for reprocessing",
+                    mCameraIdStr.string());
+        } else if (request.mPhysicalCameraSettings.size() > 1) {
+            ALOGE("%s: Camera %s: reprocess requests not supported for "
+                    "multiple physical cameras.", __FUNCTION__,
+                    mCameraIdStr.string());
+            return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                    "Reprocess requests not supported for multiple cameras");
+        }
+    }
+
+    if (request.mPhysicalCameraSettings.empty()) {
+        ALOGE("%s: Camera %s: request doesn't contain any settings.", __FUNCTION__,
+                mCameraIdStr.string());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Request doesn't contain any settings");
+    }
+
+    //The first capture settings should always match the logical camera id
+    String8 logicalId(request.mPhysicalCameraSettings.begin()->id.c_str());
+    if (mDevice->getId() != logicalId) {
+        ALOGE("%s: Camera %s: Invalid camera request settings.", __FUNCTION__,
+                mCameraIdStr.string());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Invalid camera request settings");
+    }
+
+    if (request.mSurfaceList.isEmpty() && request.mStreamIdxList.size() == 0) {
+        ALOGE("%s: Camera %s: Requests must have at least one surface target. "
+                "Rejecting request.", __FUNCTION__, mCameraIdStr.string());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Request has no output targets");
+    }
+
+    binder::Status res = resolveRequestTargetsLocked(request, targets);
+    if (!res.isOk()) {
+        return res;
+    }
+    const std::vector<std::string>& requestedPhysicalIds = (*targets)->physicalCameraIds;
+
+    for (const auto& it : request.mPhysicalCameraSettings) {
+        if (it.settings.isEmpty()) {
+            ALOGE("%s: Camera %s: Sent empty metadata packet. Rejecting request.",
+                    __FUNCTION__, mCameraIdStr.string());
+            return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                    "Request settings are empty");
+        }
+
+        String8 physicalId(it.id.c_str());
+        if (physicalId != mDevice->getId()) {
+            auto found = std::find(requestedPhysicalIds.begin(), requestedPhysicalIds.end(),
+                    it.id);
+            if (found == requestedPhysicalIds.end()) {
+                ALOGE("%s: Camera %s: Physical camera id: %s not part of attached outputs.",
+                        __FUNCTION__, mCameraIdStr.string(), physicalId.string());
+                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                        "Invalid physical camera id");
+            }
+
+            if (!mSupportedPhysicalRequestKeys.empty()) {
+                // Filter out any unsupported physical request keys.
+                CameraMetadata filteredParams(mSupportedPhysicalRequestKeys.size());
+                camera_metadata_t *meta = filteredParams.getAndLockForUpdate();
+                set_camera_metadata_vendor_id(meta, mDevice->getVendorTagId());
+                filteredParams.unlock(meta);
+
+                for (const auto& keyIt : mSupportedPhysicalRequestKeys) {
+                    camera_metadata_ro_entry entry = it.settings.find(keyIt);
+                    if (entry.count > 0) {
+                        filteredParams.update(entry);
+                    }
+                }
+
+                physicalSettingsList->push_back({it.id, filteredParams});
+            }
+        } else {
+            physicalSettingsList->push_back({it.id, it.settings});
+        }
+    }
+
+    if (!enforceRequestPermissions(physicalSettingsList->begin()->metadata)) {
+        // Callee logs
+        return STATUS_ERROR(CameraService::ERROR_PERMISSION_DENIED,
+                "Caller does not have permission to change restricted controls");
+    }
+
+    const Vector<int32_t>& outputStreamIds = (*targets)->outputStreamIds;
+    physicalSettingsList->begin()->metadata.update(ANDROID_REQUEST_OUTPUT_STREAMS,
+            &outputStreamIds[0], outputStreamIds.size());
+
+    if (request.mIsReprocess) {
+        physicalSettingsList->begin()->metadata.update(ANDROID_REQUEST_INPUT_STREAMS,
+                &mInputStream.id, 1);
+    }
+
+    return binder::Status::ok();
+}
+
+binder::Status CameraDeviceClient::resolveRequestTargetsLocked(
+        const hardware::camera2::CaptureRequest& request,
+        /*out*/
+        std::shared_ptr<const CaptureRequestTargets>* targets) {
+    // Requests name their targets either by surface or by stream/surface index. The
+    // binders are kept alive by mStreamMap, and the cache is dropped whenever that
+    // changes, so a binder address identifies the same surface for as long as it is
+    // cached.
+    std::vector<uintptr_t> key;
+    if (request.mSurfaceList.size() > 0) {
+        key.reserve(request.mSurfaceList.size() + 1);
+        key.push_back(0);
+        for (const sp<Surface>& surface : request.mSurfaceList) {
+            if (surface == 0) continue;
+            key.push_back(reinterpret_cast<uintptr_t>(
+                    IInterface::asBinder(surface->getIGraphicBufferProducer()).get()));
+        }
+    } else {
+        key.reserve(request.mStreamIdxList.size() * 2 + 1);
+        key.push_back(1);
+        for (size_t i = 0; i < request.mStreamIdxList.size(); i++) {
+            key.push_back(static_cast<uint32_t>(request.mStreamIdxList.itemAt(i)));
+            key.push_back(static_cast<uint32_t>(request.mSurfaceIdxList.itemAt(i)));
+        }
+    }
+
+    auto cached = mRequestTargetCache.find(key);
+    if (cached != mRequestTargetCache.end()) {
+        *targets = cached->second;
+        return binder::Status::ok();
+    }
+
+    /**
+     * Write in the output stream IDs and map from stream ID to surface ID
+     * which we calculate from the capture request's list of surface target
+     */
+    auto resolved = std::make_shared<CaptureRequestTargets>();
+    binder::Status res;
+    if (request.mSurfaceList.size() > 0) {
+        for (const sp<Surface>& surface : request.mSurfaceList) {
+            if (surface == 0) continue;
+
+            int32_t streamId;
+            sp<IGraphicBufferProducer> gbp = surface->getIGraphicBufferProducer();
+            res = insertGbpLocked(gbp, &resolved->surfaceMap, &resolved->outputStreamIds,
+                    &streamId);
+            if (!res.isOk()) {
+                return res;
+            }
+
+            ssize_t index = mConfiguredOutputs.indexOfKey(streamId);
+            if (index >= 0) {
+                String8 requestedPhysicalId(
+                        mConfiguredOutputs.valueAt(index).getPhysicalCameraId());
+                resolved->physicalCameraIds.push_back(requestedPhysicalId.string());
+            } else {
+                ALOGW("%s: Output stream Id not found among configured outputs!", __FUNCTION__);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < request.mStreamIdxList.size(); i++) {
+            int streamId = request.mStreamIdxList.itemAt(i);
+            int surfaceIdx = request.mSurfaceIdxList.itemAt(i);
+
+            ssize_t index = mConfiguredOutputs.indexOfKey(streamId);
+            if (index < 0) {
+                ALOGE("%s: Camera %s: Tried to submit a request with a surface that"
+                        " we have not called createStream on: stream %d",
+                        __FUNCTION__, mCameraIdStr.string(), streamId);
+                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                        "Request targets Surface that is not part of current capture session");
+            }
+
+            const auto& gbps = mConfiguredOutputs.valueAt(index).getGraphicBufferProducers();
+            if ((size_t)surfaceIdx >= gbps.size()) {
+                ALOGE("%s: Camera %s: Tried to submit a request with a surface that"
+                        " we have not called createStream on: stream %d, surfaceIdx %d",
+                        __FUNCTION__, mCameraIdStr.string(), streamId, surfaceIdx);
+                return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                        "Request targets Surface has invalid surface index");
+            }
+
+            res = insertGbpLocked(gbps[surfaceIdx], &resolved->surfaceMap,
+                    &resolved->outputStreamIds, nullptr);
+            if (!res.isOk()) {
+                return res;
+            }
+
+            String8 requestedPhysicalId(
+                    mConfiguredOutputs.valueAt(index).getPhysicalCameraId());
+            resolved->physicalCameraIds.push_back(requestedPhysicalId.string());
+        }
+    }
+
+    if (mRequestTargetCache.size() >= kMaxCachedRequestTargets) {
+        mRequestTargetCache.clear();
+    }
+    mRequestTargetCache.emplace(std::move(key), resolved);
+    *targets = std::move(resolved);
+    return binder::Status::ok();
+}
+
+void CameraDeviceClient::invalidateRequestTemplatesLocked() {
+    mRequestTargetCache.clear();
+    mRequestTemplates.clear();
+    mStreamConfigGeneration++;
+}
+
+binder::Status CameraDeviceClient::compileRequestTemplate(
+        const hardware::camera2::CaptureRequest& request,
+        /*out*/
+        int32_t* templateHandle) {
+    ATRACE_CALL();
+
+    binder::Status res;
+    if (!(res = checkPidStatus(__FUNCTION__)).isOk()) return res;
+
+    if (templateHandle == nullptr) {
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT, "Invalid template handle");
+    }
+
+    Mutex::Autolock icl(mBinderSerializationLock);
+
+    if (!mDevice.get()) {
+        return STATUS_ERROR(CameraService::ERROR_DISCONNECTED, "Camera device no longer alive");
+    }
+
+    if (mRequestTemplates.size() >= kMaxRequestTemplates) {
+        ALOGE("%s: Camera %s: Already holding %zu request templates", __FUNCTION__,
+                mCameraIdStr.string(), mRequestTemplates.size());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Too many request templates");
+    }
+
+    std::shared_ptr<const CaptureRequestTargets> targets;
+    CameraDeviceBase::PhysicalCameraSettingsList physicalSettingsList;
+    res = compileRequestLocked(request, &targets, &physicalSettingsList);
+    if (!res.isOk()) {
+        return res;
+    }
+
+    *templateHandle = mRequestTemplateHandleCounter++;
+    mRequestTemplates[*templateHandle] = new CaptureRequestTemplate(std::move(targets),
+            physicalSettingsList, request.mIsReprocess, mStreamConfigGeneration);
+    return res;
+}
+
+binder::Status CameraDeviceClient::submitRequestTemplate(
+        int32_t templateHandle,
+        const std::vector<hardware::camera2::impl::CameraMetadataNative>& deltas,
+        bool streaming,
+        /*out*/
+        hardware::camera2::utils::SubmitInfo *submitInfo) {
+    ATRACE_CALL();
+
+    binder::Status res;
+    if (!(res = checkPidStatus(__FUNCTION__)).isOk()) return res;
+
+    if (submitInfo == nullptr) {
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT, "Invalid submit info");
+    }
+
+    Mutex::Autolock icl(mBinderSerializationLock);
+
+    if (!mDevice.get()) {
+        return STATUS_ERROR(CameraService::ERROR_DISCONNECTED, "Camera device no longer alive");
+    }
+
+    auto templateIt = mRequestTemplates.find(templateHandle);
+    if (templateIt == mRequestTemplates.end()) {
+        ALOGE("%s: Camera %s: Unknown request template %d, released or dropped by a stream "
+                "configuration change", __FUNCTION__, mCameraIdStr.string(), templateHandle);
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Unknown or out of date request template");
+    }
+    const sp<CaptureRequestTemplate>& requestTemplate = templateIt->second;
+    if (requestTemplate->getConfigGeneration() != mStreamConfigGeneration) {
+        ALOGE("%s: Camera %s: Request template predates the current stream configuration",
+                __FUNCTION__, mCameraIdStr.string());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Request template is out of date");
+    }
+
+    if (deltas.empty()) {
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT, "Empty request list");
+    }
+
+    if (streaming && requestTemplate->isReprocess()) {
+        ALOGE("%s: Camera %s: streaming reprocess requests not supported.", __FUNCTION__,
+                mCameraIdStr.string());
+        return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                "Repeating reprocess requests not supported");
+    }
+
+    for (const auto& delta : deltas) {
+        if (!CaptureRequestTemplate::isValidDelta(delta)) {
+            ALOGE("%s: Camera %s: Request delta changes the request targets or id",
+                    __FUNCTION__, mCameraIdStr.string());
+            return STATUS_ERROR(CameraService::ERROR_ILLEGAL_ARGUMENT,
+                    "Invalid request delta");
+        }
+        // The template settings passed the permission check when compiled, so only a
+        // delta that touches the restricted transmit LED control needs another one.
+        if (delta.exists(ANDROID_LED_TRANSMIT)) {
+            CameraMetadata checked(delta);
+            if (!enforceRequestPermissions(checked)) {
+                // Callee logs
+                return STATUS_ERROR(CameraService::ERROR_PERMISSION_DENIED,
+                        "Caller does not have permission to change restricted controls");
+            }
+        }
+    }
+
+    submitInfo->mRequestId = mRequestIdCounter;
+    mRequestIdCounter++;
+
+    status_t err = requestTemplate->submit(mDevice.get(), deltas, submitInfo->mRequestId,
+            streaming, &(submitInfo->mLastFrameNumber));
+    if (err != OK) {
+        String8 msg = String8::format(
+            "Camera %s: Got error %s (%d) after trying to submit request template",
+            mCameraIdStr.string(), strerror(-err), err);
+        ALOGE("%s: %s", __FUNCTION__, msg.string());
+        return STATUS_ERROR(CameraService::ERROR_INVALID_OPERATION, msg.string());
+    }
+
+    if (streaming) {
+        Mutex::Autolock idLock(mStreamingRequestIdLock);
+        mStreamingRequestId = submitInfo->mRequestId;
+    }
+    return res;
+}
+
+binder::Status CameraDeviceClient::releaseRequestTemplate(int32_t templateHandle) {
+    ATRACE_CALL();
+
+    binder::Status res;
+    if (!(res = checkPidStatus(__FUNCTION__)).isOk()) return res;
+
+    Mutex::Autolock icl(mBinderSerializationLock);
+
+    // Templates dropped by a stream configuration change are released already
+    mRequestTemplates.erase(templateHandle);
+    return res;
+}
+
 binder::Status CameraDeviceClient::cancelRequest(
         int requestId,
         /*out*/
@@ -497,6 +707,9 @@ binder::Status CameraDeviceClient::endConfigure(int operatingMode,
         return res;
     }
 
+    // Composite streams get new internal stream ids below
+    invalidateRequestTemplatesLocked();
+
     status_t err = mDevice->configureStreams(sessionParams, operatingMode);
     if (err == BAD_VALUE) {
         String8 msg = String8::format("Camera %s: Unsupported set of inputs/outputs provided",
@@ -920,6 +1133,7 @@ binder::Status CameraDeviceClient::deleteStream(int streamId) {
         ALOGE("%s: %s", __FUNCTION__, msg.string());
         res = STATUS_ERROR(CameraService::ERROR_INVALID_OPERATION, msg.string());
     } else {
+        invalidateRequestTemplatesLocked();
         if (isInput) {
             mInputStream.configured = false;
         } else {
@@ -1067,6 +1281,7 @@ binder::Status CameraDeviceClient::createStream(
         }
 
         mConfiguredOutputs.add(streamId, outputConfiguration);
+        invalidateRequestTemplatesLocked();
         mStreamInfoMap[streamId] = streamInfo;
 
         ALOGV("%s: Camera %s: Successfully created a new stream ID %d for output surface"
@@ -1356,6 +1571,7 @@ binder::Status CameraDeviceClient::updateOutputConfiguration(int streamId,
         }
 
         mConfiguredOutputs.replaceValueFor(streamId, outputConfiguration);
+        invalidateRequestTemplatesLocked();
 
         ALOGV("%s: Camera %s: Successful stream ID %d update",
                   __FUNCTION__, mCameraIdStr.string(), streamId);
@@ -1929,6 +2145,7 @@ binder::Status CameraDeviceClient::finalizeOutputConfigurations(int32_t streamId
         }
         mStreamInfoMap[streamId].finalized = true;
         mConfiguredOutputs.replaceValueFor(streamId, outputConfiguration);
+        invalidateRequestTemplatesLocked();
     } else if (err == NO_INIT) {
         res = STATUS_ERROR_FMT(CameraService::ERROR_ILLEGAL_ARGUMENT,
                 "Camera %s: Deferred surface is invalid: %s (%d)",
@@ -2074,6 +2291,7 @@ binder::Status CameraDeviceClient::switchToOffline(
         mDeferredStreams.clear();
         mStreamInfoMap.clear();
         mCompositeStreamMap.clear();
+        invalidateRequestTemplatesLocked();
         mInputStream = {false, 0, 0, 0, 0};
     } else {
         switch(ret) {
@@ -2237,6 +2455,7 @@ void CameraDeviceClient::detachDevice() {
         }
     }
     mCompositeStreamMap.clear();
+    invalidateRequestTemplatesLocked();
 
     Camera2ClientBase::detachDevice();
 }
@@ -17,6 +17,8 @@
 #ifndef ANDROID_SERVERS_CAMERA_PHOTOGRAPHY_CAMERADEVICECLIENT_H
 #define ANDROID_SERVERS_CAMERA_PHOTOGRAPHY_CAMERADEVICECLIENT_H
 
+#include <map>
+
 #include <android/hardware/camera2/BnCameraDeviceUser.h>
 #include <android/hardware/camera2/ICameraDeviceCallbacks.h>
 #include <camera/camera2/OutputConfiguration.h>
@@ -25,6 +27,7 @@
 
 #include "CameraOfflineSessionClient.h"
 #include "CameraService.h"
+#include "CaptureRequestTemplate.h"
 #include "common/FrameProcessorBase.h"
 #include "common/Camera2ClientBase.h"
 #include "CompositeStream.h"
@@ -91,6 +94,23 @@ public:
             /*out*/
             int64_t* lastFrameNumber = NULL) override;
 
+    // Validate and convert a request once. The template stays valid until the stream
+    // configuration changes.
+    virtual binder::Status compileRequestTemplate(
+            const hardware::camera2::CaptureRequest& request,
+            /*out*/
+            int32_t* templateHandle) override;
+
+    // Submit one request per delta under a single request id, each made of the template
+    // settings with the delta tags updated.
+    virtual binder::Status submitRequestTemplate(int32_t templateHandle,
+            const std::vector<hardware::camera2::impl::CameraMetadataNative>& deltas,
+            bool streaming,
+            /*out*/
+            hardware::camera2::utils::SubmitInfo *submitInfo) override;
+
+    virtual binder::Status releaseRequestTemplate(int32_t templateHandle) override;
+
     virtual binder::Status beginConfigure() override;
 
     virtual binder::Status endConfigure(int operatingMode,
@@ -310,6 +330,21 @@ private:
             /*out*/SurfaceMap* surfaceMap, /*out*/Vector<int32_t>* streamIds,
             /*out*/int32_t*  currentStreamId);
 
+    // Validate a request, resolve its targets and build its settings, all but the
+    // request id.
+    binder::Status compileRequestLocked(const hardware::camera2::CaptureRequest& request,
+            /*out*/std::shared_ptr<const CaptureRequestTargets>* targets,
+            /*out*/CameraDeviceBase::PhysicalCameraSettingsList* settings);
+
+    // Resolve the output targets of a request, reusing the result for requests with the
+    // same surfaces or stream/surface indices.
+    binder::Status resolveRequestTargetsLocked(const hardware::camera2::CaptureRequest& request,
+            /*out*/std::shared_ptr<const CaptureRequestTargets>* targets);
+
+    // Drop the resolved targets and the compiled templates. Called whenever the stream
+    // configuration changes.
+    void invalidateRequestTemplatesLocked();
+
     // Check that the physicalCameraId passed in is spported by the camera
     // device.
     static binder::Status checkPhysicalCameraId(const std::vector<std::string> &physicalCameraIds,
@@ -346,6 +381,18 @@ private:
 
     KeyedVector<sp<IBinder>, sp<CompositeStream>> mCompositeStreamMap;
 
+    // Request target key (surface binders or stream/surface indices) -> resolved targets
+    std::map<std::vector<uintptr_t>, std::shared_ptr<const CaptureRequestTargets>>
+            mRequestTargetCache;
+    static const size_t kMaxCachedRequestTargets = 32;
+    // Bumped on every stream configuration change
+    uint32_t mStreamConfigGeneration;
+
+    // Template handle -> template compiled against the current stream configuration
+    std::map<int32_t, sp<CaptureRequestTemplate>> mRequestTemplates;
+    int32_t mRequestTemplateHandleCounter;
+    static const size_t kMaxRequestTemplates = 32;
+
     static const int32_t MAX_SURFACES_PER_STREAM = 4;
     sp<CameraProviderManager> mProviderManager;
 };
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraDeviceClient-RequestTemplate"
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+//#define LOG_NDEBUG 0
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include "CaptureRequestTemplate.h"
+
+namespace android {
+
+CaptureRequestTemplate::CaptureRequestTemplate(
+        std::shared_ptr<const CaptureRequestTargets> targets,
+        const CameraDeviceBase::PhysicalCameraSettingsList& settings, bool isReprocess,
+        uint32_t configGeneration) :
+        mTargets(std::move(targets)),
+        mSettings(settings),
+        mIsReprocess(isReprocess),
+        mConfigGeneration(configGeneration) {
+    // Reserve the request id entry so that setting it per request is an in-place update
+    if (!mSettings.empty() && !mSettings.begin()->metadata.exists(ANDROID_REQUEST_ID)) {
+        int32_t requestId = 0;
+        mSettings.begin()->metadata.update(ANDROID_REQUEST_ID, &requestId, 1);
+    }
+}
+
+bool CaptureRequestTemplate::isValidDelta(const CameraMetadata& delta) {
+    return !delta.exists(ANDROID_REQUEST_ID) &&
+            !delta.exists(ANDROID_REQUEST_OUTPUT_STREAMS) &&
+            !delta.exists(ANDROID_REQUEST_INPUT_STREAMS);
+}
+
+status_t CaptureRequestTemplate::appendRequest(const CameraMetadata& delta, int32_t requestId,
+        List<const CameraDeviceBase::PhysicalCameraSettingsList>* requests,
+        std::list<const SurfaceMap>* surfaceMaps) const {
+    if (requests == nullptr || surfaceMaps == nullptr || mSettings.empty()) {
+        return BAD_VALUE;
+    }
+
+    // The copies share the template buffers until the logical settings are updated below.
+    CameraDeviceBase::PhysicalCameraSettingsList settings(mSettings);
+    CameraMetadata& logical = settings.begin()->metadata;
+
+    status_t res = OK;
+    if (!delta.isEmpty()) {
+        const camera_metadata_t* buffer = delta.getAndLock();
+        size_t entryCount = get_camera_metadata_entry_count(buffer);
+        for (size_t i = 0; i < entryCount && res == OK; i++) {
+            camera_metadata_ro_entry_t entry;
+            res = get_camera_metadata_ro_entry(buffer, i, &entry);
+            if (res == OK) {
+                res = logical.update(entry);
+            }
+        }
+        delta.unlock(buffer);
+        if (res != OK) {
+            ALOGE("%s: Failed to apply request delta: %s (%d)", __FUNCTION__,
+                    strerror(-res), res);
+            return res;
+        }
+    }
+
+    res = logical.update(ANDROID_REQUEST_ID, &requestId, 1);
+    if (res != OK) {
+        return res;
+    }
+
+    requests->push_back(settings);
+    surfaceMaps->push_back(mTargets->surfaceMap);
+    return OK;
+}
+
+status_t CaptureRequestTemplate::submit(CameraDeviceBase* device,
+        const std::vector<CameraMetadata>& deltas, int32_t requestId, bool streaming,
+        int64_t* lastFrameNumber) const {
+    ATRACE_CALL();
+    if (device == nullptr || deltas.empty()) {
+        return BAD_VALUE;
+    }
+
+    List<const CameraDeviceBase::PhysicalCameraSettingsList> requests;
+    std::list<const SurfaceMap> surfaceMaps;
+    for (const auto& delta : deltas) {
+        status_t res = appendRequest(delta, requestId, &requests, &surfaceMaps);
+        if (res != OK) {
+            return res;
+        }
+    }
+
+    return streaming ?
+            device->setStreamingRequestList(requests, surfaceMaps, lastFrameNumber) :
+            device->captureList(requests, surfaceMaps, lastFrameNumber);
+}
+
+}; // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_PHOTOGRAPHY_CAPTUREREQUESTTEMPLATE_H
+#define ANDROID_SERVERS_CAMERA_PHOTOGRAPHY_CAPTUREREQUESTTEMPLATE_H
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <camera/CameraMetadata.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "common/CameraDeviceBase.h"
+
+namespace android {
+
+/**
+ * Output targets of a capture request, resolved from its surfaces or stream/surface
+ * indices against the current stream configuration.
+ */
+struct CaptureRequestTargets {
+    SurfaceMap surfaceMap;
+    Vector<int32_t> outputStreamIds;
+    // Physical camera id of each targeted output, empty for logical camera outputs
+    std::vector<std::string> physicalCameraIds;
+};
+
+/**
+ * A capture request that has been validated and converted once, for repeated
+ * submission with a small set of per-request metadata deltas.
+ *
+ * The settings already carry the output and input stream tags and a request id
+ * placeholder, so building a request only takes a copy-on-write copy of each settings
+ * buffer and in-place updates of the request id and the delta tags. A template is only
+ * valid for the stream configuration it was compiled against; the owner compares the
+ * configuration generation before submitting it.
+ */
+class CaptureRequestTemplate : public LightRefBase<CaptureRequestTemplate> {
+  public:
+    CaptureRequestTemplate(std::shared_ptr<const CaptureRequestTargets> targets,
+            const CameraDeviceBase::PhysicalCameraSettingsList& settings, bool isReprocess,
+            uint32_t configGeneration);
+
+    // Append one request to the lists passed to CameraDeviceBase::captureList or
+    // setStreamingRequestList: the template settings with the delta tags updated in the
+    // logical camera settings, and the given request id.
+    status_t appendRequest(const CameraMetadata& delta, int32_t requestId,
+            /*out*/List<const CameraDeviceBase::PhysicalCameraSettingsList>* requests,
+            /*out*/std::list<const SurfaceMap>* surfaceMaps) const;
+
+    // Submit one request per delta, as a burst capture or as a repeating burst.
+    status_t submit(CameraDeviceBase* device, const std::vector<CameraMetadata>& deltas,
+            int32_t requestId, bool streaming, /*out*/int64_t* lastFrameNumber) const;
+
+    // A delta may not retarget the request or change its id
+    static bool isValidDelta(const CameraMetadata& delta);
+
+    const CameraDeviceBase::PhysicalCameraSettingsList& getSettings() const { return mSettings; }
+    const CaptureRequestTargets& getTargets() const { return *mTargets; }
+    bool isReprocess() const { return mIsReprocess; }
+    uint32_t getConfigGeneration() const { return mConfigGeneration; }
+
+  private:
+    const std::shared_ptr<const CaptureRequestTargets> mTargets;
+    CameraDeviceBase::PhysicalCameraSettingsList mSettings;
+    const bool mIsReprocess;
+    const uint32_t mConfigGeneration;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SERVERS_CAMERA_PHOTOGRAPHY_CAPTUREREQUESTTEMPLATE_H
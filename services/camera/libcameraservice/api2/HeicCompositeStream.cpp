@@ -68,6 +68,10 @@ HeicCompositeStream::HeicCompositeStream(sp<CameraDeviceBase> device,
         mCodecOutputCounter(0),
         mQuality(-1),
         mGridTimestampUs(0),
+        mTileCopyExit(false),
+        mTileCopyFrame(nullptr),
+        mNextTileCopy(0),
+        mTileCopiesInFlight(0),
         mStatusId(StatusTracker::NO_STATUS_ID) {
 }
 
@@ -1037,48 +1041,142 @@ status_t HeicCompositeStream::processAppSegment(int64_t frameNumber, InputFrame
 }
 
 status_t HeicCompositeStream::processCodecInputFrame(InputFrame &inputFrame) {
-    for (auto& inputBuffer : inputFrame.codecInputBuffers) {
-        sp<MediaCodecBuffer> buffer;
-        auto res = mCodec->getInputBuffer(inputBuffer.index, &buffer);
+    ATRACE_CALL();
+    auto& inputBuffers = inputFrame.codecInputBuffers;
+    std::vector<TileCopy> tileCopies(inputBuffers.size());
+    for (size_t i = 0; i < inputBuffers.size(); i++) {
+        auto res = mCodec->getInputBuffer(inputBuffers[i].index, &tileCopies[i].codecBuffer);
         if (res != OK) {
             ALOGE("%s: Error getting codec input buffer: %s (%d)", __FUNCTION__,
                     strerror(-res), res);
             return res;
         }
+    }
 
-        // Copy one tile from source to destination.
-        size_t tileX = inputBuffer.tileIndex % mGridCols;
-        size_t tileY = inputBuffer.tileIndex / mGridCols;
-        size_t top = mGridHeight * tileY;
-        size_t left = mGridWidth * tileX;
-        size_t width = (tileX == static_cast<size_t>(mGridCols) - 1) ?
-                mOutputWidth - tileX * mGridWidth : mGridWidth;
-        size_t height = (tileY == static_cast<size_t>(mGridRows) - 1) ?
-                mOutputHeight - tileY * mGridHeight : mGridHeight;
-        ALOGV("%s: inputBuffer tileIndex [%zu, %zu], top %zu, left %zu, width %zu, height %zu,"
-                " timeUs %" PRId64, __FUNCTION__, tileX, tileY, top, left, width, height,
-                inputBuffer.timeUs);
-
-        res = copyOneYuvTile(buffer, inputFrame.yuvBuffer, top, left, width, height);
-        if (res != OK) {
-            ALOGE("%s: Failed to copy YUV tile %s (%d)", __FUNCTION__,
-                    strerror(-res), res);
-            return res;
-        }
+    // The tile copy threads and this thread copy the tiles in order. Each tile is queued to
+    // the codec as soon as it and all tiles before it are copied, so that the encoder can start
+    // on the first tiles while the rest are still being copied.
+    Mutex::Autolock l(mTileCopyLock);
+    mTileCopyFrame = &inputFrame;
+    mTileCopies = std::move(tileCopies);
+    mNextTileCopy = 0;
+    mTileCopySignal.broadcast();
 
-        res = mCodec->queueInputBuffer(inputBuffer.index, 0, buffer->capacity(),
-                inputBuffer.timeUs, 0, nullptr /*errorDetailMsg*/);
-        if (res != OK) {
-            ALOGE("%s: Failed to queueInputBuffer to Codec: %s (%d)",
-                    __FUNCTION__, strerror(-res), res);
-            return res;
+    status_t res = OK;
+    size_t queued = 0;
+    while (res == OK && queued < mTileCopies.size()) {
+        if (mTileCopies[queued].done) {
+            res = mTileCopies[queued].result;
+            if (res != OK) {
+                ALOGE("%s: Failed to copy YUV tile %s (%d)", __FUNCTION__, strerror(-res), res);
+                break;
+            }
+            size_t bufferSize = mTileCopies[queued].codecBuffer->capacity();
+            mTileCopyLock.unlock();
+            res = mCodec->queueInputBuffer(inputBuffers[queued].index, 0, bufferSize,
+                    inputBuffers[queued].timeUs, 0, nullptr /*errorDetailMsg*/);
+            mTileCopyLock.lock();
+            if (res != OK) {
+                ALOGE("%s: Failed to queueInputBuffer to Codec: %s (%d)",
+                        __FUNCTION__, strerror(-res), res);
+            }
+            queued++;
+        } else if (mNextTileCopy < mTileCopies.size()) {
+            copyNextTileLocked();
+        } else {
+            mTileCopySignal.wait(mTileCopyLock);
         }
     }
 
+    // Leave no copy of this frame behind on failure
+    mNextTileCopy = mTileCopies.size();
+    while (mTileCopiesInFlight > 0) {
+        mTileCopySignal.wait(mTileCopyLock);
+    }
+    mTileCopyFrame = nullptr;
+    mTileCopies.clear();
+    if (res != OK) {
+        return res;
+    }
+
     inputFrame.codecInputBuffers.clear();
     return OK;
 }
 
+void HeicCompositeStream::copyNextTileLocked() {
+    size_t i = mNextTileCopy++;
+    mTileCopiesInFlight++;
+    TileCopy& tileCopy = mTileCopies[i];
+    const InputFrame& inputFrame = *mTileCopyFrame;
+    mTileCopyLock.unlock();
+    status_t res = copyOneTile(tileCopy.codecBuffer, inputFrame.yuvBuffer,
+            inputFrame.codecInputBuffers[i]);
+    mTileCopyLock.lock();
+    tileCopy.done = true;
+    tileCopy.result = res;
+    mTileCopiesInFlight--;
+    mTileCopySignal.broadcast();
+}
+
+bool HeicCompositeStream::processNextTileCopy() {
+    Mutex::Autolock l(mTileCopyLock);
+    while (!mTileCopyExit && mNextTileCopy >= mTileCopies.size()) {
+        mTileCopySignal.wait(mTileCopyLock);
+    }
+    if (mTileCopyExit) {
+        return false;
+    }
+    copyNextTileLocked();
+    return true;
+}
+
+void HeicCompositeStream::startTileCopyThreads() {
+    {
+        Mutex::Autolock l(mTileCopyLock);
+        mTileCopyExit = false;
+    }
+    for (size_t i = 1; i < kMaxParallelTileCopies; i++) {
+        sp<TileCopyThread> thread = new TileCopyThread(this);
+        status_t res = thread->run(String8::format("C3HeicTileCopy%zu", i).string());
+        if (res != OK) {
+            // The tiles the missing threads would copy are copied by the others
+            ALOGW("%s: Failed to start tile copy thread: %s (%d)", __FUNCTION__,
+                    strerror(-res), res);
+            break;
+        }
+        mTileCopyThreads.push_back(thread);
+    }
+}
+
+void HeicCompositeStream::stopTileCopyThreads() {
+    {
+        Mutex::Autolock l(mTileCopyLock);
+        mTileCopyExit = true;
+        mTileCopySignal.broadcast();
+    }
+    for (auto& thread : mTileCopyThreads) {
+        thread->requestExitAndWait();
+    }
+    mTileCopyThreads.clear();
+}
+
+status_t HeicCompositeStream::copyOneTile(sp<MediaCodecBuffer>& codecBuffer,
+        const CpuConsumer::LockedBuffer& yuvBuffer, const CodecInputBufferInfo& inputBuffer) {
+    size_t tileX = inputBuffer.tileIndex % mGridCols;
+    size_t tileY = inputBuffer.tileIndex / mGridCols;
+    size_t top = mGridHeight * tileY;
+    size_t left = mGridWidth * tileX;
+    size_t width = (tileX == static_cast<size_t>(mGridCols) - 1) ?
+            mOutputWidth - tileX * mGridWidth : mGridWidth;
+    size_t height = (tileY == static_cast<size_t>(mGridRows) - 1) ?
+            mOutputHeight - tileY * mGridHeight : mGridHeight;
+    ALOGV("%s: inputBuffer tileIndex [%zu, %zu], top %zu, left %zu, width %zu, height %zu,"
+            " timeUs %" PRId64, __FUNCTION__, tileX, tileY, top, left, width, height,
+            inputBuffer.timeUs);
+
+    return copyOneYuvTile(codecBuffer, yuvBuffer, top, left, width, height);
+}
+
 status_t HeicCompositeStream::processOneCodecOutputFrame(int64_t frameNumber,
         InputFrame &inputFrame) {
     auto it = inputFrame.codecOutputBuffers.begin();
@@ -1378,12 +1476,17 @@ status_t HeicCompositeStream::initializeCodec(uint32_t width, uint32_t height,
     mOutputHeight = height;
     mAppSegmentMaxSize = calcAppSegmentMaxSize(cameraDevice->info());
     mMaxHeicBufferSize = mOutputWidth * mOutputHeight * 3 / 2 + mAppSegmentMaxSize;
+    if (mUseGrid) {
+        startTileCopyThreads();
+    }
 
     return OK;
 }
 
 void HeicCompositeStream::deinitCodec() {
     ALOGV("%s", __FUNCTION__);
+    stopTileCopyThreads();
+
     if (mCodec != nullptr) {
         mCodec->stop();
         mCodec->release();
@@ -132,6 +132,9 @@ private:
     static const int64_t kNoFrameDropMaxPtsGap = -1000000;
     static const int32_t kNoGridOpRate = 30;
     static const int32_t kGridOpRate = 120;
+    // Max number of grid tiles copied to codec input buffers concurrently: the processing
+    // thread and the tile copy threads
+    static const size_t kMaxParallelTileCopies = 4;
 
     void onHeicOutputFrameAvailable(const CodecOutputBufferInfo& bufferInfo);
     void onHeicInputFrameAvailable(int32_t index);  // Only called for YUV input mode.
@@ -197,6 +200,34 @@ private:
 
     size_t findAppSegmentsSize(const uint8_t* appSegmentBuffer, size_t maxSize,
             size_t* app1SegmentSize);
+    status_t copyOneTile(sp<MediaCodecBuffer>& codecBuffer,
+            const CpuConsumer::LockedBuffer& yuvBuffer, const CodecInputBufferInfo& inputBuffer);
+
+    //
+    // Tile copy threads, started with the codec in grid mode. They copy the tiles of the
+    // frame being queued to the codec along with the processing thread.
+    //
+    class TileCopyThread : public Thread {
+      public:
+        explicit TileCopyThread(HeicCompositeStream* parent) : mParent(parent) {}
+      private:
+        bool threadLoop() override { return mParent->processNextTileCopy(); }
+        HeicCompositeStream* mParent;
+    };
+
+    struct TileCopy {
+        sp<MediaCodecBuffer> codecBuffer;
+        bool done = false;
+        status_t result = OK;
+    };
+
+    void startTileCopyThreads();
+    void stopTileCopyThreads();
+    // Copies the next tile of the current frame; returns false once the threads are stopped.
+    bool processNextTileCopy();
+    // Claims and copies the next tile, with mTileCopyLock released during the copy.
+    void copyNextTileLocked();
+
     status_t copyOneYuvTile(sp<MediaCodecBuffer>& codecBuffer,
             const CpuConsumer::LockedBuffer& yuvBuffer,
             size_t top, size_t left, size_t width, size_t height);
@@ -271,6 +302,17 @@ private:
     // Indexed by frame number. In most common use case, entries are accessed in order.
     std::map<int64_t, InputFrame> mPendingInputFrames;
 
+    std::vector<sp<TileCopyThread>> mTileCopyThreads;
+    Mutex             mTileCopyLock;
+    Condition         mTileCopySignal;
+    bool              mTileCopyExit;
+    // Tiles of the frame being queued to the codec, the next one to copy, and how many are
+    // being copied.
+    InputFrame*       mTileCopyFrame;
+    std::vector<TileCopy> mTileCopies;
+    size_t            mNextTileCopy;
+    size_t            mTileCopiesInFlight;
+
     // Function pointer of libyuv row copy.
     void (*mFnCopyRow)(const uint8_t* src, uint8_t* dst, int width);
 
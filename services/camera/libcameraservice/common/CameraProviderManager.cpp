@@ -99,10 +99,38 @@ status_t CameraProviderManager::initialize(wp<CameraProviderManager::StatusListe
     }
 
 
+    // Connect to the known providers one at a time, then initialize them in parallel,
+    // since each one enumerates its devices and fetches their characteristics over HIDL.
+    nsecs_t startTime = systemTime();
+    std::vector<sp<ProviderInfo>> providers;
+    std::vector<sp<provider::V2_4::ICameraProvider>> interfaces;
     for (const auto& instance : mServiceProxy->listServices()) {
-        this->addProviderLocked(instance);
+        sp<provider::V2_4::ICameraProvider> interface;
+        if (connectProviderLocked(instance, &interface) != OK) {
+            continue;
+        }
+        providers.push_back(new ProviderInfo(instance, this));
+        interfaces.push_back(interface);
     }
 
+    std::vector<std::future<status_t>> results;
+    results.reserve(providers.size());
+    for (size_t i = 0; i < providers.size(); i++) {
+        results.push_back(std::async(std::launch::async, [this, &providers, &interfaces, i]() {
+            return providers[i]->initialize(interfaces[i], mDeviceState);
+        }));
+    }
+    // Register in listing order, so that device ID conflicts resolve as before
+    for (size_t i = 0; i < providers.size(); i++) {
+        if (results[i].get() != OK) {
+            continue;
+        }
+        providers[i]->removeDuplicateDevices();
+        mProviders.push_back(providers[i]);
+    }
+    ALOGI("%s: %zu camera providers ready in %" PRId64 " ms", __FUNCTION__,
+            mProviders.size(), ns2ms(systemTime() - startTime));
+
     IPCThreadState::self()->flushCommands();
 
     return OK;
@@ -218,10 +246,9 @@ bool CameraProviderManager::isValidDevice(const std::string &id, uint16_t majorV
 
 bool CameraProviderManager::isValidDeviceLocked(const std::string &id, uint16_t majorVersion) const {
     for (auto& provider : mProviders) {
-        for (auto& deviceInfo : provider->mDevices) {
-            if (deviceInfo->mId == id && deviceInfo->mVersion.get_major() == majorVersion) {
-                return true;
-            }
+        if (provider->findDeviceInfo(id, hardware::hidl_version{majorVersion, 0},
+                hardware::hidl_version{majorVersion, UINT16_MAX}) != nullptr) {
+            return true;
         }
     }
     return false;
@@ -546,11 +573,9 @@ CameraProviderManager::ProviderInfo::DeviceInfo* CameraProviderManager::findDevi
         const std::string& id,
         hardware::hidl_version minVersion, hardware::hidl_version maxVersion) const {
     for (auto& provider : mProviders) {
-        for (auto& deviceInfo : provider->mDevices) {
-            if (deviceInfo->mId == id &&
-                    minVersion <= deviceInfo->mVersion && maxVersion >= deviceInfo->mVersion) {
-                return deviceInfo.get();
-            }
+        auto deviceInfo = provider->findDeviceInfo(id, minVersion, maxVersion);
+        if (deviceInfo != nullptr) {
+            return deviceInfo;
         }
     }
     return nullptr;
@@ -563,12 +588,8 @@ metadata_vendor_id_t CameraProviderManager::getProviderTagIdLocked(
 
     std::lock_guard<std::mutex> lock(mInterfaceMutex);
     for (auto& provider : mProviders) {
-        for (auto& deviceInfo : provider->mDevices) {
-            if (deviceInfo->mId == id &&
-                    minVersion <= deviceInfo->mVersion &&
-                    maxVersion >= deviceInfo->mVersion) {
-                return provider->mProviderTagid;
-            }
+        if (provider->findDeviceInfo(id, minVersion, maxVersion) != nullptr) {
+            return provider->mProviderTagid;
         }
     }
 
@@ -727,10 +748,10 @@ void CameraProviderManager::ProviderInfo::DeviceInfo3::getSupportedDynamicDepthS
     }
 }
 
-status_t CameraProviderManager::ProviderInfo::DeviceInfo3::addDynamicDepthTags() {
+status_t CameraProviderManager::ProviderInfo::DeviceInfo3::addDynamicDepthTags(
+        CameraMetadata& c) {
     uint32_t depthExclTag = ANDROID_DEPTH_DEPTH_IS_EXCLUSIVE;
     uint32_t depthSizesTag = ANDROID_DEPTH_AVAILABLE_DEPTH_STREAM_CONFIGURATIONS;
-    auto& c = mCameraCharacteristics;
     std::vector<std::tuple<size_t, size_t>> supportedBlobSizes, supportedDepthSizes,
             supportedDynamicDepthSizes, internalDepthSizes;
     auto chTags = c.find(ANDROID_REQUEST_AVAILABLE_CHARACTERISTICS_KEYS);
@@ -1087,9 +1108,7 @@ status_t CameraProviderManager::ProviderInfo::DeviceInfo3::fillHeicStreamCombina
     return OK;
 }
 
-status_t CameraProviderManager::ProviderInfo::DeviceInfo3::deriveHeicTags() {
-    auto& c = mCameraCharacteristics;
-
+status_t CameraProviderManager::ProviderInfo::DeviceInfo3::deriveHeicTags(CameraMetadata& c) {
     camera_metadata_entry halHeicSupport = c.find(ANDROID_HEIC_INFO_SUPPORTED);
     if (halHeicSupport.count > 1) {
         ALOGE("%s: Invalid entry count %zu for ANDROID_HEIC_INFO_SUPPORTED",
@@ -1189,27 +1208,16 @@ bool CameraProviderManager::isHiddenPhysicalCamera(const std::string& cameraId)
 std::pair<bool, CameraProviderManager::ProviderInfo::DeviceInfo *>
 CameraProviderManager::isHiddenPhysicalCameraInternal(const std::string& cameraId) const {
     auto falseRet = std::make_pair(false, nullptr);
-    for (auto& provider : mProviders) {
-        for (auto& deviceInfo : provider->mDevices) {
-            if (deviceInfo->mId == cameraId) {
-                // cameraId is found in public camera IDs advertised by the
-                // provider.
-                return falseRet;
-            }
-        }
+    if (findDeviceInfoLocked(cameraId) != nullptr) {
+        // cameraId is found in public camera IDs advertised by the
+        // provider.
+        return falseRet;
     }
 
+    // The physical IDs are known without the characteristics, so this doesn't force the
+    // deferred tags of every device to be derived.
     for (auto& provider : mProviders) {
         for (auto& deviceInfo : provider->mDevices) {
-            CameraMetadata info;
-            status_t res = deviceInfo->getCameraCharacteristics(&info);
-            if (res != OK) {
-                ALOGE("%s: Failed to getCameraCharacteristics for id %s", __FUNCTION__,
-                        deviceInfo->mId.c_str());
-                return falseRet;
-            }
-
-            std::vector<std::string> physicalIds;
             if (deviceInfo->mIsLogicalCamera) {
                 if (std::find(deviceInfo->mPhysicalIds.begin(), deviceInfo->mPhysicalIds.end(),
                         cameraId) != deviceInfo->mPhysicalIds.end()) {
@@ -1230,7 +1238,8 @@ CameraProviderManager::isHiddenPhysicalCameraInternal(const std::string& cameraI
     return falseRet;
 }
 
-status_t CameraProviderManager::addProviderLocked(const std::string& newProvider) {
+status_t CameraProviderManager::connectProviderLocked(const std::string& newProvider,
+        sp<provider::V2_4::ICameraProvider>* interface) const {
     for (const auto& providerInfo : mProviders) {
         if (providerInfo->mProviderName == newProvider) {
             ALOGW("%s: Camera provider HAL with name '%s' already registered", __FUNCTION__,
@@ -1239,17 +1248,25 @@ status_t CameraProviderManager::addProviderLocked(const std::string& newProvider
         }
     }
 
-    sp<provider::V2_4::ICameraProvider> interface;
-    interface = mServiceProxy->tryGetService(newProvider);
+    *interface = mServiceProxy->tryGetService(newProvider);
 
-    if (interface == nullptr) {
+    if (*interface == nullptr) {
         ALOGE("%s: Camera provider HAL '%s' is not actually available", __FUNCTION__,
                 newProvider.c_str());
         return BAD_VALUE;
     }
+    return OK;
+}
+
+status_t CameraProviderManager::addProviderLocked(const std::string& newProvider) {
+    sp<provider::V2_4::ICameraProvider> interface;
+    status_t res = connectProviderLocked(newProvider, &interface);
+    if (res != OK) {
+        return res;
+    }
 
     sp<ProviderInfo> providerInfo = new ProviderInfo(newProvider, this);
-    status_t res = providerInfo->initialize(interface, mDeviceState);
+    res = providerInfo->initialize(interface, mDeviceState);
     if (res != OK) {
         return res;
     }
@@ -1583,6 +1600,7 @@ status_t CameraProviderManager::ProviderInfo::addDevice(const std::string& name,
     deviceInfo->mStatus = initialStatus;
     bool isAPI1Compatible = deviceInfo->isAPI1Compatible();
 
+    mDeviceIndex[id].push_back(deviceInfo.get());
     mDevices.push_back(std::move(deviceInfo));
 
     mUniqueCameraIds.insert(id);
@@ -1604,18 +1622,61 @@ status_t CameraProviderManager::ProviderInfo::addDevice(const std::string& name,
 void CameraProviderManager::ProviderInfo::removeDevice(std::string id) {
     for (auto it = mDevices.begin(); it != mDevices.end(); it++) {
         if ((*it)->mId == id) {
-            mUniqueCameraIds.erase(id);
-            if ((*it)->isAPI1Compatible()) {
-                mUniqueAPI1CompatibleCameraIds.erase(std::remove(
-                        mUniqueAPI1CompatibleCameraIds.begin(),
-                        mUniqueAPI1CompatibleCameraIds.end(), id));
-            }
-            mDevices.erase(it);
+            eraseDevice(it);
             break;
         }
     }
 }
 
+std::vector<std::unique_ptr<CameraProviderManager::ProviderInfo::DeviceInfo>>::iterator
+CameraProviderManager::ProviderInfo::eraseDevice(
+        std::vector<std::unique_ptr<DeviceInfo>>::iterator it) {
+    const std::string id = (*it)->mId;
+    auto indexIt = mDeviceIndex.find(id);
+    if (indexIt != mDeviceIndex.end()) {
+        auto& versions = indexIt->second;
+        versions.erase(std::remove(versions.begin(), versions.end(), it->get()), versions.end());
+        if (versions.empty()) {
+            mDeviceIndex.erase(indexIt);
+        }
+    }
+    mUniqueCameraIds.erase(id);
+    if ((*it)->isAPI1Compatible()) {
+        mUniqueAPI1CompatibleCameraIds.erase(std::remove(
+                mUniqueAPI1CompatibleCameraIds.begin(),
+                mUniqueAPI1CompatibleCameraIds.end(), id));
+    }
+    return mDevices.erase(it);
+}
+
+CameraProviderManager::ProviderInfo::DeviceInfo* CameraProviderManager::ProviderInfo::findDeviceInfo(
+        const std::string& id, hardware::hidl_version minVersion,
+        hardware::hidl_version maxVersion) const {
+    auto indexIt = mDeviceIndex.find(id);
+    if (indexIt == mDeviceIndex.end()) {
+        return nullptr;
+    }
+    for (auto deviceInfo : indexIt->second) {
+        if (minVersion <= deviceInfo->mVersion && maxVersion >= deviceInfo->mVersion) {
+            return deviceInfo;
+        }
+    }
+    return nullptr;
+}
+
+void CameraProviderManager::ProviderInfo::removeDuplicateDevices() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto it = mDevices.begin(); it != mDevices.end();) {
+        if (mManager->isValidDeviceLocked((*it)->mId, (*it)->mVersion.get_major())) {
+            ALOGE("%s: Device %s: Already registered by another provider, ignoring",
+                    __FUNCTION__, (*it)->mName.c_str());
+            it = eraseDevice(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 status_t CameraProviderManager::ProviderInfo::dump(int fd, const Vector<String16>&) const {
     dprintf(fd, "== Camera Provider HAL %s (v2.%d, %s) static info: %zu devices: ==\n",
             mProviderName.c_str(),
@@ -2363,16 +2424,6 @@ CameraProviderManager::ProviderInfo::DeviceInfo3::DeviceInfo3(const std::string&
                 __FUNCTION__, strerror(-res), res);
         return;
     }
-    auto stat = addDynamicDepthTags();
-    if (OK != stat) {
-        ALOGE("%s: Failed appending dynamic depth tags: %s (%d)", __FUNCTION__, strerror(-stat),
-                stat);
-    }
-    res = deriveHeicTags();
-    if (OK != res) {
-        ALOGE("%s: Unable to derive HEIC tags based on camera and media capabilities: %s (%d)",
-                __FUNCTION__, strerror(-res), res);
-    }
     res = addRotateCropTags();
     if (OK != res) {
         ALOGE("%s: Unable to add default SCALER_ROTATE_AND_CROP tags: %s (%d)", __FUNCTION__,
@@ -2542,11 +2593,27 @@ status_t CameraProviderManager::ProviderInfo::DeviceInfo3::dumpState(int fd) {
     return OK;
 }
 
+void CameraProviderManager::ProviderInfo::DeviceInfo3::addDeferredTags() {
+    ATRACE_CALL();
+    mFullCharacteristics = mCameraCharacteristics;
+    status_t res = addDynamicDepthTags(mFullCharacteristics);
+    if (OK != res) {
+        ALOGE("%s: Failed appending dynamic depth tags: %s (%d)", __FUNCTION__, strerror(-res),
+                res);
+    }
+    res = deriveHeicTags(mFullCharacteristics);
+    if (OK != res) {
+        ALOGE("%s: Unable to derive HEIC tags based on camera and media capabilities: %s (%d)",
+                __FUNCTION__, strerror(-res), res);
+    }
+}
+
 status_t CameraProviderManager::ProviderInfo::DeviceInfo3::getCameraCharacteristics(
-        CameraMetadata *characteristics) const {
+        CameraMetadata *characteristics) {
     if (characteristics == nullptr) return BAD_VALUE;
 
-    *characteristics = mCameraCharacteristics;
+    std::call_once(mDeferredTagsFlag, [this]() { addDeferredTags(); });
+    *characteristics = mFullCharacteristics;
     return OK;
 }
 
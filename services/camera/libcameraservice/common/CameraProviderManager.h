@@ -392,6 +392,10 @@ private:
 
         status_t dump(int fd, const Vector<String16>& args) const;
 
+        // Drop the devices whose ID and major version another registered provider already
+        // has. Providers initialized in parallel can't check each other in addDevice.
+        void removeDuplicateDevices();
+
         // ICameraProviderCallbacks interface - these lock the parent mInterfaceMutex
         hardware::Return<void> cameraDeviceStatusChange(
                 const hardware::hidl_string& cameraDeviceName,
@@ -463,7 +467,8 @@ private:
             virtual status_t getCameraInfo(hardware::CameraInfo *info) const = 0;
             virtual bool isAPI1Compatible() const = 0;
             virtual status_t dumpState(int fd) = 0;
-            virtual status_t getCameraCharacteristics(CameraMetadata *characteristics) const {
+            // Not const, since tags that are expensive to derive may be added on first call
+            virtual status_t getCameraCharacteristics(CameraMetadata *characteristics) {
                 (void) characteristics;
                 return INVALID_OPERATION;
             }
@@ -511,6 +516,13 @@ private:
             }
         };
         std::vector<std::unique_ptr<DeviceInfo>> mDevices;
+        // Device ID -> the devices in mDevices with that ID, one per major version. Kept in
+        // step with mDevices by addDevice and removeDevice.
+        std::unordered_map<std::string, std::vector<DeviceInfo*>> mDeviceIndex;
+        // Finds the first device of the given ID within the version range, see
+        // findDeviceInfoLocked
+        DeviceInfo* findDeviceInfo(const std::string& id, hardware::hidl_version minVersion,
+                hardware::hidl_version maxVersion) const;
         std::unordered_set<std::string> mUniqueCameraIds;
         int mUniqueDeviceCount;
         std::vector<std::string> mUniqueAPI1CompatibleCameraIds;
@@ -551,7 +563,7 @@ private:
             virtual bool isAPI1Compatible() const override;
             virtual status_t dumpState(int fd) override;
             virtual status_t getCameraCharacteristics(
-                    CameraMetadata *characteristics) const override;
+                    CameraMetadata *characteristics) override;
             virtual status_t getPhysicalCameraCharacteristics(const std::string& physicalCameraId,
                     CameraMetadata *characteristics) const override;
             virtual status_t isSessionConfigurationSupported(
@@ -566,13 +578,23 @@ private:
                     const std::vector<std::string>& publicCameraIds, sp<InterfaceT> interface);
             virtual ~DeviceInfo3();
         private:
+            // Not modified after construction, so that the const accessors, such as
+            // isAPI1Compatible, can read it while the deferred tags are derived.
             CameraMetadata mCameraCharacteristics;
             std::unordered_map<std::string, CameraMetadata> mPhysicalCameraCharacteristics;
+            // The dynamic depth and HEIC tags take stream configuration math and a media
+            // codec query per device, so they are derived on the first
+            // getCameraCharacteristics call rather than at provider startup. They are added to
+            // mFullCharacteristics, a copy of mCameraCharacteristics only read after
+            // mDeferredTagsFlag.
+            std::once_flag mDeferredTagsFlag;
+            CameraMetadata mFullCharacteristics;
+            void addDeferredTags();
             void queryPhysicalCameraIds();
             SystemCameraKind getSystemCameraKind();
             status_t fixupMonochromeTags();
-            status_t addDynamicDepthTags();
-            status_t deriveHeicTags();
+            status_t addDynamicDepthTags(CameraMetadata& c);
+            status_t deriveHeicTags(CameraMetadata& c);
             status_t addRotateCropTags();
             status_t addPreCorrectionActiveArraySize();
 
@@ -655,6 +677,8 @@ private:
         static metadata_vendor_id_t generateVendorTagId(const std::string &name);
 
         void removeDevice(std::string id);
+        std::vector<std::unique_ptr<DeviceInfo>>::iterator eraseDevice(
+                std::vector<std::unique_ptr<DeviceInfo>>::iterator it);
 
         // Expects to have mLock locked
         status_t reCacheConcurrentStreamingCameraIdsLocked();
@@ -674,6 +698,10 @@ private:
 
     status_t addProviderLocked(const std::string& newProvider);
 
+    // Get the interface of a provider HAL that isn't registered yet
+    status_t connectProviderLocked(const std::string& newProvider,
+            /*out*/sp<hardware::camera::provider::V2_4::ICameraProvider>* interface) const;
+
     bool isLogicalCameraLocked(const std::string& id, std::vector<std::string>* physicalCameraIds);
 
     status_t removeProvider(const std::string& provider);
@@ -21,6 +21,9 @@
 
 #include "DepthPhotoProcessor.h"
 
+#include <algorithm>
+#include <future>
+
 #include <dynamic_depth/camera.h>
 #include <dynamic_depth/cameras.h>
 #include <dynamic_depth/container.h>
@@ -36,6 +39,7 @@
 #include <libexif/exif-system.h>
 #include <math.h>
 #include <sstream>
+#include <string.h>
 #include <utils/Errors.h>
 #include <utils/ExifUtils.h>
 #include <utils/Log.h>
@@ -235,100 +239,132 @@ status_t encodeGrayscaleJpeg(size_t width, size_t height, uint8_t *in, void *out
     return ret;
 }
 
-inline void unpackDepth16(uint16_t value, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    // Android densely packed depth map. The units for the range are in
-    // millimeters and need to be scaled to meters.
-    // The confidence value is encoded in the 3 most significant bits.
-    // The confidence data needs to be additionally normalized with
-    // values 1.0f, 0.0f representing maximum and minimum confidence
-    // respectively.
-    auto point = static_cast<float>(value & 0x1FFF) / 1000.f;
-    points->push_back(point);
-
-    auto conf = (value >> 13) & 0x7;
-    float normConfidence = (conf == 0) ? 1.f : (static_cast<float>(conf) - 1) / 7.f;
-    confidence->push_back(normConfidence);
-    if (normConfidence < CONFIDENCE_THRESHOLD) {
-        return;
-    }
+// Android densely packed depth map. The units for the range are in
+// millimeters and need to be scaled to meters.
+// The confidence value is encoded in the 3 most significant bits.
+// The confidence data needs to be additionally normalized with
+// values 1.0f, 0.0f representing maximum and minimum confidence
+// respectively.
+static const uint16_t kDepthRangeMask = 0x1FFF;
+static const int kDepthConfidenceShift = 13;
+static const size_t kDepthConfidenceLevels = 8;
+
+static inline float normalizeConfidence(uint16_t level) {
+    return (level == 0) ? 1.f : (static_cast<float>(level) - 1) / 7.f;
+}
 
-    if (*near > point) {
-        *near = point;
-    }
-    if (*far < point) {
-        *far = point;
+// Copy the depth samples densely packed in output order, applying the depth photo orientation.
+// Returns true if the width and height of the output are switched.
+static bool rotateDepthMap(const DepthPhotoInputFrame& inputFrame,
+        DepthPhotoOrientation orientation, uint16_t *out /*out*/) {
+    const uint16_t *in = inputFrame.mDepthMapBuffer;
+    size_t width = inputFrame.mDepthMapWidth;
+    size_t height = inputFrame.mDepthMapHeight;
+    size_t stride = inputFrame.mDepthMapStride;
+    switch (orientation) {
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES:
+            break;
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES:
+            // 90 degrees CW rotation can be applied by starting to read from bottom, left corner
+            // transposing rows and columns.
+            for (size_t i = 0; i < width; i++) {
+                for (size_t j = 0; j < height; j++) {
+                    *out++ = in[(height - 1 - j) * stride + i];
+                }
+            }
+            return true;
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES:
+            // 180 CW degrees rotation can be applied by starting to read backwards from bottom,
+            // right corner.
+            for (size_t i = 0; i < height; i++) {
+                const uint16_t *row = in + (height - 1 - i) * stride;
+                for (size_t j = 0; j < width; j++) {
+                    *out++ = row[width - 1 - j];
+                }
+            }
+            return false;
+        case DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES:
+            // 270 degrees CW rotation can be applied by starting to read from top, right corner
+            // transposing rows and columns.
+            for (size_t i = 0; i < width; i++) {
+                for (size_t j = 0; j < height; j++) {
+                    *out++ = in[j * stride + width - 1 - i];
+                }
+            }
+            return true;
+        default:
+            ALOGE("%s: Unsupported depth photo rotation: %d, default to 0", __FUNCTION__,
+                    orientation);
     }
-}
 
-// Trivial case, read forward from top,left corner.
-void rotate0AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (size_t i = 0; i < inputFrame.mDepthMapHeight; i++) {
-        for (size_t j = 0; j < inputFrame.mDepthMapWidth; j++) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[i*inputFrame.mDepthMapStride + j], points,
-                    confidence, near, far);
-        }
+    // Trivial case, read forward from top,left corner.
+    for (size_t i = 0; i < height; i++) {
+        memcpy(out + i * width, in + i * stride, width * sizeof(uint16_t));
     }
+    return false;
 }
 
-// 90 degrees CW rotation can be applied by starting to read from bottom, left corner
-// transposing rows and columns.
-void rotate90AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (size_t i = 0; i < inputFrame.mDepthMapWidth; i++) {
-        for (ssize_t j = inputFrame.mDepthMapHeight-1; j >= 0; j--) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[j*inputFrame.mDepthMapStride + i], points,
-                    confidence, near, far);
-        }
+int quantizeDepthMap(DepthPhotoInputFrame inputFrame, bool applyOrientation,
+        uint8_t *depthOut, uint8_t *confidenceOut, float *near, float *far,
+        bool *switchDimensions) {
+    if ((inputFrame.mDepthMapBuffer == nullptr) || (depthOut == nullptr) ||
+            (confidenceOut == nullptr) || (near == nullptr) || (far == nullptr) ||
+            (switchDimensions == nullptr)) {
+        return BAD_VALUE;
     }
-}
 
-// 180 CW degrees rotation can be applied by starting to read backwards from bottom, right corner.
-void rotate180AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (ssize_t i = inputFrame.mDepthMapHeight-1; i >= 0; i--) {
-        for (ssize_t j = inputFrame.mDepthMapWidth-1; j >= 0; j--) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[i*inputFrame.mDepthMapStride + j], points,
-                    confidence, near, far);
+    size_t pointCount = inputFrame.mDepthMapWidth * inputFrame.mDepthMapHeight;
+    std::vector<uint16_t> samples(pointCount);
+    *switchDimensions = rotateDepthMap(inputFrame, applyOrientation ? inputFrame.mOrientation :
+            DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES, samples.data());
+
+    // There are only 8 confidence levels, so their quantized values and whether they pass the
+    // threshold are looked up.
+    uint8_t quantizedConfidence[kDepthConfidenceLevels];
+    uint32_t validLevels = 0;
+    for (uint16_t level = 0; level < kDepthConfidenceLevels; level++) {
+        float normConfidence = normalizeConfidence(level);
+        quantizedConfidence[level] = static_cast<uint8_t>(floorf(normConfidence * 255.0f));
+        if (normConfidence >= CONFIDENCE_THRESHOLD) {
+            validLevels |= 1 << level;
         }
     }
-}
 
-// 270 degrees CW rotation can be applied by starting to read from top, right corner
-// transposing rows and columns.
-void rotate270AndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    for (ssize_t i = inputFrame.mDepthMapWidth-1; i >= 0; i--) {
-        for (size_t j = 0; j < inputFrame.mDepthMapHeight; j++) {
-            unpackDepth16(inputFrame.mDepthMapBuffer[j*inputFrame.mDepthMapStride + i], points,
-                    confidence, near, far);
-        }
+    // Depth samples with low confidence don't contribute to the near/far values. The conversion
+    // to meters is monotonic, so the range is found on the raw samples, which keeps this loop
+    // free of float compares and lets it vectorize.
+    uint16_t nearRaw = UINT16_MAX;
+    uint16_t farRaw = 0;
+    for (size_t i = 0; i < pointCount; i++) {
+        uint16_t range = samples[i] & kDepthRangeMask;
+        bool valid = (validLevels >> (samples[i] >> kDepthConfidenceShift)) & 1;
+        nearRaw = std::min<uint16_t>(nearRaw, valid ? range : UINT16_MAX);
+        farRaw = std::max<uint16_t>(farRaw, valid ? range : 0);
+    }
+    *near = (nearRaw == UINT16_MAX) ? UINT16_MAX : static_cast<float>(nearRaw) / 1000.f;
+    *far = static_cast<float>(farRaw) / 1000.f;
+    if (*near == *far) {
+        ALOGE("%s: Near and far range values must not match!", __FUNCTION__);
+        return BAD_VALUE;
     }
-}
 
-bool rotateAndUnpack(DepthPhotoInputFrame inputFrame, std::vector<float> *points /*out*/,
-        std::vector<float> *confidence /*out*/, float *near /*out*/, float *far /*out*/) {
-    switch (inputFrame.mOrientation) {
-        case DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES:
-            rotate0AndUnpack(inputFrame, points, confidence, near, far);
-            return false;
-        case DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES:
-            rotate90AndUnpack(inputFrame, points, confidence, near, far);
-            return true;
-        case DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES:
-            rotate180AndUnpack(inputFrame, points, confidence, near, far);
-            return false;
-        case DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES:
-            rotate270AndUnpack(inputFrame, points, confidence, near, far);
-            return true;
-        default:
-            ALOGE("%s: Unsupported depth photo rotation: %d, default to 0", __FUNCTION__,
-                    inputFrame.mOrientation);
-            rotate0AndUnpack(inputFrame, points, confidence, near, far);
+    // Samples with enough confidence are within [near, far] already, so clamping all of them
+    // only affects the low confidence ones.
+    const float nearValue = *near;
+    const float farValue = *far;
+    for (size_t i = 0; i < pointCount; i++) {
+        float point = static_cast<float>(samples[i] & kDepthRangeMask) / 1000.f;
+        point = std::min(std::max(point, nearValue), farValue);
+        float rangeInverse = floorf(((farValue * (point - nearValue)) /
+                (point * (farValue - nearValue))) * 255.0f);
+        // A zero range sample is undefined (0/0), store it as 0.
+        depthOut[i] = static_cast<uint8_t>(std::min(255.f, std::max(0.f, rangeInverse)));
+    }
+    for (size_t i = 0; i < pointCount; i++) {
+        confidenceOut[i] = quantizedConfidence[samples[i] >> kDepthConfidenceShift];
     }
 
-    return false;
+    return OK;
 }
 
 std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFrame inputFrame,
@@ -338,21 +374,17 @@ std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFra
         return nullptr;
     }
 
-    std::vector<float> points, confidence;
-
     size_t pointCount = inputFrame.mDepthMapWidth * inputFrame.mDepthMapHeight;
-    points.reserve(pointCount);
-    confidence.reserve(pointCount);
-    float near = UINT16_MAX;
-    float far = .0f;
-    *switchDimensions = false;
+    std::vector<uint8_t> pointsQuantized(pointCount), confidenceQuantized(pointCount);
+    float near, far;
     // Physical rotation of depth and confidence maps may be needed in case
     // the EXIF orientation is set to 0 degrees and the depth photo orientation
     // (source color image) has some different value.
-    if (exifOrientation == ExifOrientation::ORIENTATION_0_DEGREES) {
-        *switchDimensions = rotateAndUnpack(inputFrame, &points, &confidence, &near, &far);
-    } else {
-        rotate0AndUnpack(inputFrame, &points, &confidence, &near, &far);
+    auto ret = quantizeDepthMap(inputFrame,
+            exifOrientation == ExifOrientation::ORIENTATION_0_DEGREES, pointsQuantized.data(),
+            confidenceQuantized.data(), &near, &far, switchDimensions);
+    if (ret != OK) {
+        return nullptr;
     }
 
     size_t width = inputFrame.mDepthMapWidth;
@@ -362,50 +394,36 @@ std::unique_ptr<dynamic_depth::DepthMap> processDepthMapFrame(DepthPhotoInputFra
         height = inputFrame.mDepthMapWidth;
     }
 
-    if (near == far) {
-        ALOGE("%s: Near and far range values must not match!", __FUNCTION__);
-        return nullptr;
-    }
-
-    std::vector<uint8_t> pointsQuantized, confidenceQuantized;
-    pointsQuantized.reserve(pointCount); confidenceQuantized.reserve(pointCount);
-    auto pointIt = points.begin();
-    auto confidenceIt = confidence.begin();
-    while ((pointIt != points.end()) && (confidenceIt != confidence.end())) {
-        auto point = *pointIt;
-        if ((*confidenceIt) < CONFIDENCE_THRESHOLD) {
-            point = std::clamp(point, near, far);
-        }
-        pointsQuantized.push_back(floorf(((far * (point - near)) /
-                (point * (far - near))) * 255.0f));
-        confidenceQuantized.push_back(floorf(*confidenceIt * 255.0f));
-        confidenceIt++; pointIt++;
-    }
-
     DepthMapParams depthParams(DepthFormat::kRangeInverse, near, far, DepthUnits::kMeters,
             "android/depthmap");
     depthParams.confidence_uri = "android/confidencemap";
     depthParams.mime = "image/jpeg";
     depthParams.depth_image_data.resize(inputFrame.mMaxJpegSize);
     depthParams.confidence_data.resize(inputFrame.mMaxJpegSize);
+
+    // The two maps are independent, so the confidence map is compressed in parallel.
+    size_t actualConfidenceJpegSize = 0;
+    auto confidenceRet = std::async(std::launch::async, [&]() {
+        return encodeGrayscaleJpeg(width, height, confidenceQuantized.data(),
+                depthParams.confidence_data.data(), inputFrame.mMaxJpegSize,
+                inputFrame.mJpegQuality, exifOrientation, actualConfidenceJpegSize);
+    });
     size_t actualJpegSize;
-    auto ret = encodeGrayscaleJpeg(width, height, pointsQuantized.data(),
+    ret = encodeGrayscaleJpeg(width, height, pointsQuantized.data(),
             depthParams.depth_image_data.data(), inputFrame.mMaxJpegSize,
             inputFrame.mJpegQuality, exifOrientation, actualJpegSize);
+    auto confidenceEncodeRet = confidenceRet.get();
     if (ret != NO_ERROR) {
         ALOGE("%s: Depth map compression failed!", __FUNCTION__);
         return nullptr;
     }
     depthParams.depth_image_data.resize(actualJpegSize);
 
-    ret = encodeGrayscaleJpeg(width, height, confidenceQuantized.data(),
-            depthParams.confidence_data.data(), inputFrame.mMaxJpegSize,
-            inputFrame.mJpegQuality, exifOrientation, actualJpegSize);
-    if (ret != NO_ERROR) {
+    if (confidenceEncodeRet != NO_ERROR) {
         ALOGE("%s: Confidence map compression failed!", __FUNCTION__);
         return nullptr;
     }
-    depthParams.confidence_data.resize(actualJpegSize);
+    depthParams.confidence_data.resize(actualConfidenceJpegSize);
 
     return DepthMap::FromData(depthParams, items);
 }
@@ -68,6 +68,13 @@ int processDepthPhotoFrame(DepthPhotoInputFrame /*inputFrame*/,
         size_t /*depthPhotoBufferSize*/, void* /*depthPhotoBuffer out*/,
         size_t* /*depthPhotoActualSize out*/);
 
+// Convert the DEPTH16 map of the input frame to the 8-bit range inverse depth and confidence
+// maps stored in the depth photo. Both outputs hold mDepthMapWidth * mDepthMapHeight samples,
+// rotated according to mOrientation if applyOrientation is set.
+int quantizeDepthMap(DepthPhotoInputFrame /*inputFrame*/, bool /*applyOrientation*/,
+        uint8_t* /*depthMap out*/, uint8_t* /*confidenceMap out*/, float* /*near out*/,
+        float* /*far out*/, bool* /*switchDimensions out*/);
+
 }; // namespace camera3
 }; // namespace android
 
@@ -18,6 +18,8 @@
 #define LOG_TAG "Camera3-BufferManager"
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 
+#include <inttypes.h>
+
 #include <gui/ISurfaceComposer.h>
 #include <private/gui/ComposerService.h>
 #include <utils/Log.h>
@@ -33,6 +35,16 @@ Camera3BufferManager::Camera3BufferManager() {
 }
 
 Camera3BufferManager::~Camera3BufferManager() {
+    sp<PrefetchThread> prefetchThread;
+    {
+        Mutex::Autolock l(mLock);
+        mPrefetchExit = true;
+        mPrefetchSignal.signal();
+        prefetchThread = mPrefetchThread;
+    }
+    if (prefetchThread != nullptr) {
+        prefetchThread->join();
+    }
 }
 
 status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
@@ -89,6 +101,7 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
                 __FUNCTION__, streamSetId);
         // Create stream info map, then add to mStreamsetMap.
         StreamSet newStreamSet;
+        newStreamSet.generation = mNextGeneration++;
         setIdx = mStreamSetMap.add(streamSetId, newStreamSet);
     }
     // Update stream set map and water mark.
@@ -102,6 +115,8 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
     currentStreamSet.streamInfoMap.add(streamId, streamInfo);
     currentStreamSet.handoutBufferCountMap.add(streamId, 0);
     currentStreamSet.attachedBufferCountMap.add(streamId, 0);
+    currentStreamSet.demandMap.add(streamId, StreamDemand());
+    currentStreamSet.registrationMap.add(streamId, mNextRegistration++);
     mStreamMap.add(streamId, stream);
 
     // The max allowed buffer count should be the max of buffer count of each stream inside a stream
@@ -116,6 +131,8 @@ status_t Camera3BufferManager::registerStream(wp<Camera3OutputStream>& stream,
 status_t Camera3BufferManager::unregisterStream(int streamId, int streamSetId) {
     ATRACE_CALL();
 
+    // Spare buffers of the set are dropped after mLock is released.
+    std::list<sp<GraphicBuffer>> freedBuffers;
     Mutex::Autolock l(mLock);
     ALOGV("%s: unregister stream %d with stream set %d", __FUNCTION__,
             streamId, streamSetId);
@@ -133,6 +150,14 @@ status_t Camera3BufferManager::unregisterStream(int streamId, int streamSetId) {
     InfoMap& infoMap = currentSet.streamInfoMap;
     handOutBufferCounts.removeItem(streamId);
     attachedBufferCounts.removeItem(streamId);
+    currentSet.demandMap.removeItem(streamId);
+    currentSet.registrationMap.removeItem(streamId);
+
+    // The spare buffers may not fit the remaining streams; drop them along with any prefetch
+    // still in progress.
+    freedBuffers.splice(freedBuffers.end(), currentSet.spareBuffers);
+    currentSet.pendingPrefetchCount = 0;
+    currentSet.generation = mNextGeneration++;
 
     // Remove the stream info from info map and recalculate the buffer count water mark.
     infoMap.removeItem(streamId);
@@ -164,82 +189,231 @@ void Camera3BufferManager::notifyBufferRemoved(int streamId, int streamSetId) {
     attachedBufferCount--;
 }
 
+size_t Camera3BufferManager::getTotalAllocatedBufferCountLocked(const StreamSet& streamSet) {
+    size_t totalAllocatedBufferCount = streamSet.spareBuffers.size();
+    for (size_t i = 0; i < streamSet.attachedBufferCountMap.size(); i++) {
+        totalAllocatedBufferCount += streamSet.attachedBufferCountMap[i];
+    }
+    return totalAllocatedBufferCount;
+}
+
+bool Camera3BufferManager::isCompatible(uint32_t width, uint32_t height, uint32_t format,
+        uint64_t usage, const StreamInfo& info) {
+    return width == info.width && height == info.height && format == info.format &&
+            (usage & info.combinedUsage) == info.combinedUsage;
+}
+
+status_t Camera3BufferManager::detachBufferFromOtherStreamLocked(int streamId, int streamSetId,
+        const StreamInfo* compatibleInfo, GraphicBufferEntry* buffer) {
+    StreamId otherStreamId = CAMERA3_STREAM_ID_INVALID;
+    const StreamSet &streamSet = mStreamSetMap.valueFor(streamSetId);
+    for (size_t i = 0; i < streamSet.streamInfoMap.size(); i++) {
+        const StreamInfo& otherInfo = streamSet.streamInfoMap[i];
+        if (otherInfo.streamId == streamId) {
+            continue;
+        }
+        if (compatibleInfo != nullptr && !isCompatible(otherInfo.width, otherInfo.height,
+                otherInfo.format, otherInfo.combinedUsage, *compatibleInfo)) {
+            continue;
+        }
+        size_t otherBufferCount = streamSet.handoutBufferCountMap.valueFor(otherInfo.streamId);
+        size_t otherAttachedBufferCount =
+                streamSet.attachedBufferCountMap.valueFor(otherInfo.streamId);
+        if (otherAttachedBufferCount > otherBufferCount) {
+            otherStreamId = otherInfo.streamId;
+            break;
+        }
+    }
+    if (otherStreamId == CAMERA3_STREAM_ID_INVALID) {
+        ALOGV("StreamSet %d has no buffer available to detach", streamSetId);
+        return OK;
+    }
+
+    ALOGV("Stream %d: Detach buffer for stream %d", otherStreamId, streamId);
+    sp<Camera3OutputStream> stream = mStreamMap.valueFor(otherStreamId).promote();
+    if (stream == nullptr) {
+        ALOGE("%s: unable to promote stream %d to detach buffer", __FUNCTION__, otherStreamId);
+        return INVALID_OPERATION;
+    }
+
+    // Need to unlock because the stream may also be calling
+    // into the buffer manager in parallel to signal buffer
+    // release, or acquire a new buffer.
+    mLock.unlock();
+    stream->detachBuffer(&buffer->graphicBuffer,
+            compatibleInfo != nullptr ? &buffer->fenceFd : nullptr);
+    stream.clear();
+    mLock.lock();
+
+    if (buffer->graphicBuffer != nullptr &&
+            checkIfStreamRegisteredLocked(otherStreamId, streamSetId)) {
+        size_t& otherAttachedBufferCount = mStreamSetMap.editValueFor(streamSetId)
+                .attachedBufferCountMap.editValueFor(otherStreamId);
+        if (otherAttachedBufferCount > 0) {
+            otherAttachedBufferCount--;
+        }
+    }
+    return OK;
+}
+
 status_t Camera3BufferManager::checkAndFreeBufferOnOtherStreamsLocked(
-        int streamId, int streamSetId) {
-    StreamId firstOtherStreamId = CAMERA3_STREAM_ID_INVALID;
+        int streamId, int streamSetId, std::vector<sp<GraphicBuffer>>* freedBuffers) {
     StreamSet &streamSet = mStreamSetMap.editValueFor(streamSetId);
+    if (getTotalAllocatedBufferCountLocked(streamSet) <= streamSet.allocatedBufferWaterMark) {
+        return OK;
+    }
+
+    // A spare buffer isn't attached to any stream, so it can be dropped right away.
+    if (!streamSet.spareBuffers.empty()) {
+        ALOGV("StreamSet %d: Freeing spare buffer", streamSetId);
+        freedBuffers->push_back(streamSet.spareBuffers.front());
+        streamSet.spareBuffers.pop_front();
+        return OK;
+    }
     if (streamSet.streamInfoMap.size() == 1) {
         ALOGV("StreamSet %d has no other stream available to free", streamSetId);
         return OK;
     }
 
-    bool freeBufferIsAttached = false;
-    for (size_t i = 0; i < streamSet.streamInfoMap.size(); i++) {
-        firstOtherStreamId = streamSet.streamInfoMap[i].streamId;
-        if (firstOtherStreamId != streamId) {
-
-            size_t otherBufferCount  =
-                    streamSet.handoutBufferCountMap.valueFor(firstOtherStreamId);
-            size_t otherAttachedBufferCount =
-                    streamSet.attachedBufferCountMap.valueFor(firstOtherStreamId);
-            if (otherAttachedBufferCount > otherBufferCount) {
-                freeBufferIsAttached = true;
-                break;
-            }
+    // This will drop the reference to one free buffer, which will effectively free one
+    // buffer (from the free buffer list) for the inactive streams.
+    GraphicBufferEntry buffer;
+    status_t res = detachBufferFromOtherStreamLocked(streamId, streamSetId,
+            /*compatibleInfo*/nullptr, &buffer);
+    if (buffer.graphicBuffer != nullptr) {
+        freedBuffers->push_back(buffer.graphicBuffer);
+    }
+    return res;
+}
+
+bool Camera3BufferManager::takeSpareBufferLocked(StreamSet& streamSet, const StreamInfo& info,
+        sp<GraphicBuffer>* buffer) {
+    for (auto it = streamSet.spareBuffers.begin(); it != streamSet.spareBuffers.end(); it++) {
+        const sp<GraphicBuffer>& gb = *it;
+        if (isCompatible(gb->getWidth(), gb->getHeight(), gb->getPixelFormat(), gb->getUsage(),
+                info)) {
+            *buffer = gb;
+            streamSet.spareBuffers.erase(it);
+            return true;
         }
-        firstOtherStreamId = CAMERA3_STREAM_ID_INVALID;
     }
-    if (firstOtherStreamId == CAMERA3_STREAM_ID_INVALID || !freeBufferIsAttached) {
-        ALOGV("StreamSet %d has no buffer available to free", streamSetId);
-        return OK;
+    return false;
+}
+
+bool Camera3BufferManager::updateDemandLocked(StreamSet& streamSet, int streamId,
+        bool needsBuffer, nsecs_t now) {
+    StreamDemand& demand = streamSet.demandMap.editValueFor(streamId);
+    if (demand.lastRequestTime != 0) {
+        nsecs_t interval = now - demand.lastRequestTime;
+        demand.requestInterval = (demand.requestInterval == 0) ? interval :
+                (demand.requestInterval * 7 + interval) / 8;
+    }
+    demand.lastRequestTime = now;
+    if (!needsBuffer) {
+        return false;
     }
 
+    // Running out of buffers twice within a few requests means the stream pipeline is still
+    // getting deeper at the current request rate, so the next request is likely to need a new
+    // buffer as well.
+    bool shouldPrefetch = demand.lastMissTime != 0 && demand.requestInterval > 0 &&
+            now - demand.lastMissTime <= PREFETCH_MISS_WINDOW * demand.requestInterval;
+    demand.lastMissTime = now;
+    return shouldPrefetch;
+}
 
-    // This will drop the reference to one free buffer, which will effectively free one
-    // buffer (from the free buffer list) for the inactive streams.
-    size_t totalAllocatedBufferCount = 0;
-    for (size_t i = 0; i < streamSet.attachedBufferCountMap.size(); i++) {
-        totalAllocatedBufferCount += streamSet.attachedBufferCountMap[i];
+status_t Camera3BufferManager::allocateBuffer(const StreamInfo& info,
+        sp<GraphicBuffer>* buffer) {
+    ATRACE_CALL();
+    *buffer = new GraphicBuffer(
+            info.width, info.height, PixelFormat(info.format), info.combinedUsage,
+            std::string("Camera3BufferManager pid [") +
+                    std::to_string(getpid()) + "]");
+    status_t res = (*buffer)->initCheck();
+
+    ALOGV("%s: allocating a new graphic buffer (%dx%d, format 0x%x) %p with handle %p",
+            __FUNCTION__, info.width, info.height, info.format,
+            buffer->get(), (*buffer)->handle);
+    if (res < 0) {
+        ALOGE("%s: graphic buffer allocation failed: (error %d %s) ",
+                __FUNCTION__, res, strerror(-res));
+        buffer->clear();
+        return res;
     }
-    if (totalAllocatedBufferCount > streamSet.allocatedBufferWaterMark) {
-        ALOGV("Stream %d: Freeing buffer: detach", firstOtherStreamId);
-        sp<Camera3OutputStream> stream =
-                mStreamMap.valueFor(firstOtherStreamId).promote();
-        if (stream == nullptr) {
-            ALOGE("%s: unable to promote stream %d to detach buffer", __FUNCTION__,
-                    firstOtherStreamId);
-            return INVALID_OPERATION;
+    ALOGV("%s: allocation done", __FUNCTION__);
+    return OK;
+}
+
+void Camera3BufferManager::queuePrefetchLocked(StreamSet& streamSet, int streamSetId,
+        const StreamInfo& info) {
+    size_t spareBufferCount = streamSet.spareBuffers.size() + streamSet.pendingPrefetchCount;
+    size_t bufferCount = streamSet.handoutBufferCountMap.valueFor(info.streamId);
+    if (spareBufferCount >= kMaxSpareBufferCount || bufferCount >= info.totalBufferCount ||
+            getTotalAllocatedBufferCountLocked(streamSet) + streamSet.pendingPrefetchCount >=
+                    streamSet.maxAllowedBufferCount) {
+        return;
+    }
+
+    if (mPrefetchThread == nullptr) {
+        mPrefetchThread = new PrefetchThread(this);
+        status_t res = mPrefetchThread->run("C3BufMgrPrefetch");
+        if (res != OK) {
+            ALOGE("%s: Unable to start prefetch thread: %s (%d)", __FUNCTION__,
+                    strerror(-res), res);
+            mPrefetchThread.clear();
+            return;
         }
+    }
 
-        // Detach and then drop the buffer.
-        //
-        // Need to unlock because the stream may also be calling
-        // into the buffer manager in parallel to signal buffer
-        // release, or acquire a new buffer.
-        bool bufferFreed = false;
-        {
-            mLock.unlock();
-            sp<GraphicBuffer> buffer;
-            stream->detachBuffer(&buffer, /*fenceFd*/ nullptr);
-            mLock.lock();
-            if (buffer.get() != nullptr) {
-                bufferFreed = true;
-            }
+    ALOGV("Stream %d set %d: Prefetch buffer", info.streamId, streamSetId);
+    streamSet.pendingPrefetchCount++;
+    mPrefetchQueue.push_back({streamSetId, streamSet.generation, info});
+    mPrefetchSignal.signal();
+}
+
+bool Camera3BufferManager::processNextPrefetch() {
+    PrefetchRequest request;
+    {
+        Mutex::Autolock l(mLock);
+        while (mPrefetchQueue.empty() && !mPrefetchExit) {
+            mPrefetchSignal.wait(mLock);
         }
-        if (bufferFreed) {
-            size_t& otherAttachedBufferCount =
-                    streamSet.attachedBufferCountMap.editValueFor(firstOtherStreamId);
-            otherAttachedBufferCount--;
+        if (mPrefetchExit) {
+            return false;
         }
+        request = mPrefetchQueue.front();
+        mPrefetchQueue.pop_front();
     }
 
-    return OK;
+    sp<GraphicBuffer> buffer;
+    nsecs_t allocationStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    status_t res = allocateBuffer(request.info, &buffer);
+    mPrefetchLatency.add(systemTime(SYSTEM_TIME_MONOTONIC) - allocationStart);
+
+    Mutex::Autolock l(mLock);
+    ssize_t setIdx = mStreamSetMap.indexOfKey(request.streamSetId);
+    if (setIdx == NAME_NOT_FOUND ||
+            mStreamSetMap.valueAt(setIdx).generation != request.generation) {
+        // The streams changed in the meantime; the buffer is dropped once mLock is released.
+        ALOGV("%s: dropping prefetched buffer for stream set %d", __FUNCTION__,
+                request.streamSetId);
+        return true;
+    }
+    StreamSet& streamSet = mStreamSetMap.editValueAt(setIdx);
+    streamSet.pendingPrefetchCount--;
+    if (res == OK) {
+        streamSet.spareBuffers.push_back(buffer);
+    }
+    return true;
 }
 
 status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
         sp<GraphicBuffer>* gb, int* fenceFd, bool noFreeBufferAtConsumer) {
     ATRACE_CALL();
 
+    // Buffers released by this call are only dropped after mLock is released.
+    std::vector<sp<GraphicBuffer>> freedBuffers;
+    GraphicBufferEntry buffer;
     Mutex::Autolock l(mLock);
     ALOGV("%s: get buffer for stream %d with stream set %d", __FUNCTION__,
             streamId, streamSetId);
@@ -266,7 +440,10 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
         return INVALID_OPERATION;
     }
 
-    if (attachedBufferCount > bufferCount) {
+    bool needsBuffer = (attachedBufferCount <= bufferCount);
+    bool shouldPrefetch = updateDemandLocked(streamSet, streamId, needsBuffer,
+            systemTime(SYSTEM_TIME_MONOTONIC));
+    if (!needsBuffer) {
         // We've already attached more buffers to this stream than we currently have
         // outstanding, so have the stream just use an already-attached buffer
         bufferCount++;
@@ -275,51 +452,114 @@ status_t Camera3BufferManager::getBufferForStream(int streamId, int streamSetId,
     ALOGV("Stream %d set %d: Get buffer for stream: Allocate new", streamId, streamSetId);
 
     if (mGrallocVersion < HARDWARE_DEVICE_API_VERSION(1,0)) {
-        const StreamInfo& info = streamSet.streamInfoMap.valueFor(streamId);
-        GraphicBufferEntry buffer;
-        buffer.fenceFd = -1;
-        buffer.graphicBuffer = new GraphicBuffer(
-                info.width, info.height, PixelFormat(info.format), info.combinedUsage,
-                std::string("Camera3BufferManager pid [") +
-                        std::to_string(getpid()) + "]");
-        status_t res = buffer.graphicBuffer->initCheck();
-
-        ALOGV("%s: allocating a new graphic buffer (%dx%d, format 0x%x) %p with handle %p",
-                __FUNCTION__, info.width, info.height, info.format,
-                buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
-        if (res < 0) {
-            ALOGE("%s: graphic buffer allocation failed: (error %d %s) ",
-                    __FUNCTION__, res, strerror(-res));
-            return res;
+        // Copy the stream info, since the stream set may change whenever mLock is released below.
+        const StreamInfo info = streamSet.streamInfoMap.valueFor(streamId);
+        const uint32_t registration = streamSet.registrationMap.valueFor(streamId);
+        bool allocated = false;
+        bool recycled = false;
+
+        if (takeSpareBufferLocked(streamSet, info, &buffer.graphicBuffer)) {
+            ALOGV("%s: using spare buffer", __FUNCTION__);
+            streamSet.spareHandoutCount++;
+        } else if (getTotalAllocatedBufferCountLocked(streamSet) >=
+                streamSet.allocatedBufferWaterMark) {
+            // A new buffer would exceed the water mark and get a free buffer of another stream
+            // freed right after. Take over a compatible one directly instead.
+            status_t res = detachBufferFromOtherStreamLocked(streamId, streamSetId, &info,
+                    &buffer);
+            if (res != OK) {
+                // Not fatal for this stream, fall back to allocating a new buffer.
+                ALOGW("%s: Unable to recycle a buffer for stream %d: %s (%d)", __FUNCTION__,
+                        streamId, strerror(-res), res);
+            }
+            recycled = (buffer.graphicBuffer != nullptr);
         }
-        ALOGV("%s: allocation done", __FUNCTION__);
 
-        // Increase the hand-out and attached buffer counts for tracking purposes.
-        bufferCount++;
-        attachedBufferCount++;
+        if (buffer.graphicBuffer == nullptr) {
+            // Reserve the buffer in the counts so that concurrent calls for other streams see
+            // it, then allocate it without holding mLock.
+            mStreamSetMap.editValueFor(streamSetId).handoutBufferCountMap
+                    .editValueFor(streamId)++;
+            mStreamSetMap.editValueFor(streamSetId).attachedBufferCountMap
+                    .editValueFor(streamId)++;
+
+            mLock.unlock();
+            nsecs_t allocationStart = systemTime(SYSTEM_TIME_MONOTONIC);
+            status_t res = allocateBuffer(info, &buffer.graphicBuffer);
+            mAllocationLatency.add(systemTime(SYSTEM_TIME_MONOTONIC) - allocationStart);
+            mLock.lock();
+
+            // The reservation went away with the registration it was made for; a stream
+            // registered again in the meantime starts from fresh counts.
+            if (!checkIfStreamRegisteredLocked(streamId, streamSetId) ||
+                    mStreamSetMap.valueFor(streamSetId).registrationMap.valueFor(streamId) !=
+                            registration) {
+                ALOGE("%s: stream %d was unregistered while allocating a buffer",
+                        __FUNCTION__, streamId);
+                return BAD_VALUE;
+            }
+            StreamSet &currentSet = mStreamSetMap.editValueFor(streamSetId);
+            if (res != OK) {
+                currentSet.handoutBufferCountMap.editValueFor(streamId)--;
+                currentSet.attachedBufferCountMap.editValueFor(streamId)--;
+                return res;
+            }
+            currentSet.allocatedHandoutCount++;
+            allocated = true;
+        } else {
+            if (!checkIfStreamRegisteredLocked(streamId, streamSetId)) {
+                ALOGE("%s: stream %d was unregistered while detaching a buffer",
+                        __FUNCTION__, streamId);
+                if (buffer.fenceFd >= 0) {
+                    close(buffer.fenceFd);
+                }
+                return BAD_VALUE;
+            }
+            StreamSet &currentSet = mStreamSetMap.editValueFor(streamSetId);
+            currentSet.handoutBufferCountMap.editValueFor(streamId)++;
+            currentSet.attachedBufferCountMap.editValueFor(streamId)++;
+            if (recycled) {
+                ALOGV("%s: recycled buffer of another stream", __FUNCTION__);
+                currentSet.recycledHandoutCount++;
+            }
+        }
+
+        // Look everything up again, the maps may have changed while mLock was released.
+        StreamSet &currentSet = mStreamSetMap.editValueFor(streamSetId);
+        size_t currentBufferCount = currentSet.handoutBufferCountMap.valueFor(streamId);
         // Update the water mark to be the max hand-out buffer count + 1. An additional buffer is
         // added to reduce the chance of buffer allocation during stream steady state, especially
         // for cases where one stream is active, the other stream may request some buffers randomly.
-        if (bufferCount + 1 > streamSet.allocatedBufferWaterMark) {
-            streamSet.allocatedBufferWaterMark = bufferCount + 1;
+        if (currentBufferCount + 1 > currentSet.allocatedBufferWaterMark) {
+            currentSet.allocatedBufferWaterMark = currentBufferCount + 1;
         }
         *gb = buffer.graphicBuffer;
         *fenceFd = buffer.fenceFd;
         ALOGV("%s: get buffer (%p) with handle (%p).",
                 __FUNCTION__, buffer.graphicBuffer.get(), buffer.graphicBuffer->handle);
 
+        if (shouldPrefetch) {
+            queuePrefetchLocked(currentSet, streamSetId, info);
+        }
+
+        // A spare or recycled buffer doesn't change the total buffer count of the set.
+        if (!allocated) {
+            return OK;
+        }
+
         // Proactively free buffers for other streams if the current number of allocated buffers
         // exceeds the water mark. This only for Gralloc V1, for V2, this logic can also be handled
         // in returnBufferForStream() if we want to free buffer more quickly.
         // TODO: probably should find out all the inactive stream IDs, and free the firstly found
         // buffers for them.
-        res = checkAndFreeBufferOnOtherStreamsLocked(streamId, streamSetId);
+        status_t res = checkAndFreeBufferOnOtherStreamsLocked(streamId, streamSetId,
+                &freedBuffers);
         if (res != OK) {
             return res;
         }
         // Since we just allocated one new buffer above, try free one more buffer from other streams
         // to prevent total buffer count from growing
-        res = checkAndFreeBufferOnOtherStreamsLocked(streamId, streamSetId);
+        res = checkAndFreeBufferOnOtherStreamsLocked(streamId, streamSetId, &freedBuffers);
         if (res != OK) {
             return res;
         }
@@ -340,6 +580,8 @@ status_t Camera3BufferManager::onBufferReleased(
         return BAD_VALUE;
     }
 
+    // A spare buffer released by this call is only dropped after mLock is released.
+    sp<GraphicBuffer> freedSpareBuffer;
     Mutex::Autolock l(mLock);
     ALOGV("Stream %d set %d: Buffer released", streamId, streamSetId);
     *shouldFreeBuffer = false;
@@ -358,10 +600,9 @@ status_t Camera3BufferManager::onBufferReleased(
         ALOGV("%s: Stream %d set %d: Buffer count now %zu", __FUNCTION__, streamId, streamSetId,
                 bufferCount);
 
-        size_t totalAllocatedBufferCount = 0;
+        size_t totalAllocatedBufferCount = getTotalAllocatedBufferCountLocked(streamSet);
         size_t totalHandOutBufferCount = 0;
-        for (size_t i = 0; i < streamSet.attachedBufferCountMap.size(); i++) {
-            totalAllocatedBufferCount += streamSet.attachedBufferCountMap[i];
+        for (size_t i = 0; i < streamSet.handoutBufferCountMap.size(); i++) {
             totalHandOutBufferCount += streamSet.handoutBufferCountMap[i];
         }
 
@@ -375,6 +616,16 @@ status_t Camera3BufferManager::onBufferReleased(
                     __FUNCTION__, streamId, streamSetId, streamSet.allocatedBufferWaterMark);
         }
 
+        // Spare buffers are the cheapest to give up, as they aren't attached to any stream.
+        if (totalAllocatedBufferCount > streamSet.allocatedBufferWaterMark &&
+                !streamSet.spareBuffers.empty()) {
+            ALOGV("%s: Stream %d set %d: free a spare buffer", __FUNCTION__, streamId,
+                    streamSetId);
+            freedSpareBuffer = streamSet.spareBuffers.front();
+            streamSet.spareBuffers.pop_front();
+            totalAllocatedBufferCount--;
+        }
+
         size_t attachedBufferCount = streamSet.attachedBufferCountMap.valueFor(streamId);
         if (attachedBufferCount <= bufferCount) {
             ALOGV("%s: stream %d has no buffer available to free.", __FUNCTION__, streamId);
@@ -459,6 +710,11 @@ void Camera3BufferManager::dump(int fd, const Vector<String16>& args) const {
             lines.appendFormat("            stream id: %d, buffer count: %zu.\n",
                     streamId, bufferCount);
         }
+        lines.appendFormat("          Spare buffer count: %zu (%zu being prefetched)\n",
+                mStreamSetMap[i].spareBuffers.size(), mStreamSetMap[i].pendingPrefetchCount);
+        lines.appendFormat("          Buffers handed out from spares: %zu, recycled from other"
+                " streams: %zu, newly allocated: %zu\n", mStreamSetMap[i].spareHandoutCount,
+                mStreamSetMap[i].recycledHandoutCount, mStreamSetMap[i].allocatedHandoutCount);
         lines.appendFormat("          Attached buffer counts:\n");
         for (size_t m = 0; m < mStreamSetMap[i].attachedBufferCountMap.size(); m++) {
             int streamId = mStreamSetMap[i].attachedBufferCountMap.keyAt(m);
@@ -467,6 +723,18 @@ void Camera3BufferManager::dump(int fd, const Vector<String16>& args) const {
                     streamId, bufferCount);
         }
     }
+    auto appendLatency = [&lines](const char* name, const CameraStageHistogram& histogram) {
+        lines.appendFormat("      %s: %" PRIu64 " buffers", name, histogram.count());
+        if (histogram.count() > 0) {
+            lines.appendFormat(", mean %" PRId64 " us, p50 %" PRId64 " us, p90 %" PRId64
+                    " us, p99 %" PRId64 " us, max %" PRId64 " us", histogram.meanUs(),
+                    histogram.percentileUs(50), histogram.percentileUs(90),
+                    histogram.percentileUs(99), histogram.maxUs());
+        }
+        lines.append("\n");
+    };
+    appendLatency("Buffer allocation latency", mAllocationLatency);
+    appendLatency("Buffer prefetch latency", mPrefetchLatency);
     write(fd, lines.string(), lines.size());
 }
 
@@ -18,11 +18,16 @@
 #define ANDROID_SERVERS_CAMERA3_BUFFER_MANAGER_H
 
 #include <list>
+#include <deque>
+#include <vector>
 #include <algorithm>
 #include <ui/GraphicBuffer.h>
+#include <utils/Condition.h>
 #include <utils/RefBase.h>
 #include <utils/KeyedVector.h>
+#include <utils/Thread.h>
 #include "Camera3OutputStream.h"
+#include "utils/PipelineLatency.h"
 
 namespace android {
 
@@ -41,6 +46,12 @@ class Camera3OutputStream;
  * In doing so, it reduces the memory footprint unless it is already minimal without impacting
  * performance.
  *
+ * Gralloc allocation and freeing happen with the manager lock released, so that one stream
+ * allocating a buffer doesn't stall the other streams. Before allocating, the manager first
+ * hands out a spare buffer it owns, or recycles an idle buffer attached to another compatible
+ * stream of the same stream set. When a stream keeps running out of buffers faster than its
+ * observed request rate, a spare buffer is allocated ahead of time on a background thread.
+ *
  */
 class Camera3BufferManager: public virtual RefBase {
 public:
@@ -125,6 +136,9 @@ public:
      *             combination doesn't match what was registered, or this stream wasn't registered
      *             to this buffer manager before.
      *  NO_MEMORY: Unable to allocate a buffer for this stream at this time.
+     *
+     * The returned fenceFd must be waited on before the buffer is written when the buffer was
+     * recycled from another stream of the same stream set, and is -1 otherwise.
      */
     status_t getBufferForStream(
             int streamId, int streamSetId, sp<GraphicBuffer>* gb, int* fenceFd,
@@ -197,6 +211,14 @@ private:
     // (BUFFER_FREE_THRESHOLD + steady state handout buffer count) buffers.
     static const int BUFFER_FREE_THRESHOLD = 3;
 
+    // A stream that runs out of attached buffers again within this many of its own buffer
+    // requests is considered to still be growing its pipeline, and gets a buffer prefetched.
+    static const int PREFETCH_MISS_WINDOW = 4;
+
+    // The max number of spare (prefetched, not yet attached) buffers for each stream set,
+    // including those still being allocated.
+    static const size_t kMaxSpareBufferCount = 2;
+
     /**
      * Lock to synchronize the access to the methods of this class.
      */
@@ -236,6 +258,19 @@ private:
      */
     typedef KeyedVector<StreamId, size_t> BufferCountMap;
 
+    /**
+     * Buffer request history of a stream, used to predict when it will run out of buffers.
+     */
+    struct StreamDemand {
+        // Time of the last getBufferForStream() call
+        nsecs_t lastRequestTime = 0;
+        // Moving average of the time between getBufferForStream() calls
+        nsecs_t requestInterval = 0;
+        // Time of the last getBufferForStream() call that found no free attached buffer
+        nsecs_t lastMissTime = 0;
+    };
+    typedef KeyedVector<StreamId, StreamDemand> DemandMap;
+
     /**
      * StreamSet keeps track of the stream info, free buffer list and hand-out buffer counts for
      * each stream set.
@@ -282,10 +317,46 @@ private:
          * An attached buffer may be free or handed out
          */
         BufferCountMap attachedBufferCountMap;
+        /**
+         * The buffer request history of the streams of this set.
+         */
+        DemandMap demandMap;
+        /**
+         * A serial number for each registration of the streams of this set, to tell whether a
+         * stream was unregistered and registered again while mLock was released.
+         */
+        KeyedVector<StreamId, uint32_t> registrationMap;
+        /**
+         * Buffers owned by this manager that aren't attached to any stream yet. They count
+         * towards the allocated buffer count of the set, and are handed out to any stream of
+         * the set with a compatible format before a new buffer is allocated.
+         */
+        std::list<sp<GraphicBuffer>> spareBuffers;
+        /**
+         * The count of spare buffers queued to, or being allocated by, the prefetch thread.
+         */
+        size_t pendingPrefetchCount;
+        /**
+         * Prefetches issued for an older generation are dropped when they complete. A new
+         * generation starts whenever the streams of the set change.
+         */
+        uint32_t generation;
+
+        /**
+         * Buffer hand-out statistics of this set, by where the buffer came from.
+         */
+        size_t spareHandoutCount;
+        size_t recycledHandoutCount;
+        size_t allocatedHandoutCount;
 
         StreamSet() {
             allocatedBufferWaterMark = 0;
             maxAllowedBufferCount = 0;
+            pendingPrefetchCount = 0;
+            generation = 0;
+            spareHandoutCount = 0;
+            recycledHandoutCount = 0;
+            allocatedHandoutCount = 0;
         }
     };
 
@@ -306,11 +377,81 @@ private:
      */
     bool checkIfStreamRegisteredLocked(int streamId, int streamSetId) const;
 
+    /**
+     * Sum of the attached and spare buffer counts of a stream set. This method needs to be
+     * called with mLock held.
+     */
+    static size_t getTotalAllocatedBufferCountLocked(const StreamSet& streamSet);
+
     /**
      * Check if other streams in the stream set has extra buffer available to be freed, and
-     * free one if so.
+     * detach one if so. The detached buffer is appended to freedBuffers, to be dropped by the
+     * caller once mLock is released.
+     */
+    status_t checkAndFreeBufferOnOtherStreamsLocked(int streamId, int streamSetId,
+            std::vector<sp<GraphicBuffer>>* freedBuffers);
+
+    /**
+     * Detach a free buffer from another stream of the stream set. If compatibleInfo is not null,
+     * only streams whose buffers can be used for that stream are considered. mLock is released
+     * while the buffer is detached; the caller must check that its streams are still registered
+     * afterwards.
+     */
+    status_t detachBufferFromOtherStreamLocked(int streamId, int streamSetId,
+            const StreamInfo* compatibleInfo, GraphicBufferEntry* buffer);
+
+    /**
+     * Take a spare buffer that can be used for the given stream out of the stream set.
+     */
+    static bool takeSpareBufferLocked(StreamSet& streamSet, const StreamInfo& info,
+            sp<GraphicBuffer>* buffer);
+
+    /**
+     * Update the request rate of a stream, and return whether a buffer should be prefetched
+     * for it given that it has no free attached buffer left.
      */
-    status_t checkAndFreeBufferOnOtherStreamsLocked(int streamId, int streamSetId);
+    bool updateDemandLocked(StreamSet& streamSet, int streamId, bool needsBuffer,
+            nsecs_t now);
+
+    /**
+     * Allocate a new graphic buffer for a stream. Must be called without mLock held.
+     */
+    static status_t allocateBuffer(const StreamInfo& info, sp<GraphicBuffer>* buffer);
+
+    static bool isCompatible(uint32_t width, uint32_t height, uint32_t format, uint64_t usage,
+            const StreamInfo& info);
+
+    /**
+     * Background allocation of spare buffers.
+     */
+    struct PrefetchRequest {
+        StreamSetId streamSetId;
+        uint32_t generation;
+        StreamInfo info;
+    };
+
+    class PrefetchThread : public Thread {
+      public:
+        explicit PrefetchThread(Camera3BufferManager* parent) : mParent(parent) {}
+      private:
+        bool threadLoop() override { return mParent->processNextPrefetch(); }
+        Camera3BufferManager* mParent;
+    };
+
+    void queuePrefetchLocked(StreamSet& streamSet, int streamSetId, const StreamInfo& info);
+    // Allocates the next queued spare buffer; returns false once the manager is destroyed.
+    bool processNextPrefetch();
+
+    uint32_t mNextGeneration = 1;
+    uint32_t mNextRegistration = 1;
+    std::deque<PrefetchRequest> mPrefetchQueue;
+    Condition mPrefetchSignal;
+    bool mPrefetchExit = false;
+    sp<PrefetchThread> mPrefetchThread;
+
+    // Allocation time as seen by getBufferForStream(), and by the prefetch thread
+    CameraStageHistogram mAllocationLatency;
+    CameraStageHistogram mPrefetchLatency;
 };
 
 } // namespace camera3
@@ -444,6 +444,9 @@ status_t Camera3Device::disconnectImpl() {
 
         flushInflightRequests();
 
+        mPipelineLatency.exportMetrics(mId);
+        mPipelineLatency.reset();
+
         {
             Mutex::Autolock l(mLock);
             mInterface->clear();
@@ -755,7 +758,7 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
         lines.append("      None\n");
     } else {
         for (size_t i = 0; i < mInFlightMap.size(); i++) {
-            InFlightRequest r = mInFlightMap.valueAt(i);
+            const InFlightRequest& r = mInFlightMap.valueAt(i);
             lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
                     " arrived: %s, buffers left: %d\n", mInFlightMap.keyAt(i),
                     r.shutterTimestamp, r.haveResultMetadata ? "true" : "false",
@@ -768,6 +771,7 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
         mRequestThread->dumpCaptureRequestLatency(fd,
                 "    ProcessCaptureRequest latency histogram:");
     }
+    mPipelineLatency.dump(fd, "    Capture pipeline latency:");
 
     {
         lines = String8("    Last request sent:\n");
@@ -1054,12 +1058,14 @@ hardware::Return<void> Camera3Device::processCaptureResult_3_4(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, *mInterface
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, *mInterface
     };
 
     for (const auto& result : results) {
         processOneCaptureResultLocked(states, result.v3_2, result.physicalCameraMetadata);
     }
+    signalQueuedResults(states);
     mProcessCaptureResultLock.unlock();
     return hardware::Void();
 }
@@ -1112,12 +1118,14 @@ hardware::Return<void> Camera3Device::processCaptureResult(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, *mInterface
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, *mInterface
     };
 
     for (const auto& result : results) {
         processOneCaptureResultLocked(states, result, noPhysMetadata);
     }
+    signalQueuedResults(states);
     mProcessCaptureResultLock.unlock();
     return hardware::Void();
 }
@@ -1152,11 +1160,13 @@ hardware::Return<void> Camera3Device::notify(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, *mInterface
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, *mInterface
     };
     for (const auto& msg : msgs) {
         camera3::notify(states, msg);
     }
+    signalQueuedResults(states);
     return hardware::Void();
 }
 
@@ -1627,8 +1637,7 @@ status_t Camera3Device::filterParamsAndConfigureLocked(const CameraMetadata& ses
     camera_metadata_entry_t availableSessionKeys = mDeviceInfo.find(
             ANDROID_REQUEST_AVAILABLE_SESSION_KEYS);
     CameraMetadata filteredParams(availableSessionKeys.count);
-    camera_metadata_t *meta = const_cast<camera_metadata_t *>(
-            filteredParams.getAndLock());
+    camera_metadata_t *meta = filteredParams.getAndLockForUpdate();
     set_camera_metadata_vendor_id(meta, mVendorTagId);
     filteredParams.unlock(meta);
     if (availableSessionKeys.count > 0) {
@@ -2800,6 +2809,7 @@ status_t Camera3Device::registerInFlight(uint32_t frameNumber,
             hasAppCallback, maxExpectedDuration, physicalCameraIds, isStillCapture, isZslCapture,
             rotateAndCropAuto, cameraIdsWithZoom, outputSurfaces));
     if (res < 0) return res;
+    mInFlightMap.editValueAt(res).requestTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
     if (mInFlightMap.size() == 1) {
         // Hold a separate dedicated tracker lock to prevent race with disconnect and also
@@ -3015,8 +3025,8 @@ status_t Camera3Device::HalInterface::constructDefaultRequestSettings(
     return res;
 }
 
-bool Camera3Device::HalInterface::isReconfigurationRequired(CameraMetadata& oldSessionParams,
-        CameraMetadata& newSessionParams) {
+bool Camera3Device::HalInterface::isReconfigurationRequired(
+        const CameraMetadata& oldSessionParams, const CameraMetadata& newSessionParams) {
     // We do reconfiguration by default;
     bool ret = true;
     if ((mHidlSession_3_5 != nullptr) && mIsReconfigurationQuerySupported) {
@@ -3791,6 +3801,7 @@ Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         mPrepareVideoStream(false),
         mConstrainedMode(false),
         mRequestLatency(kRequestLatencyBinSize),
+        mBatchRequestType(CameraPipelineLatency::REQUEST_REGULAR),
         mSessionParamKeys(sessionParamKeys),
         mLatestSessionParams(sessionParamKeys.size()),
         mUseHalBufManager(useHalBufManager) {
@@ -4267,7 +4278,9 @@ bool Camera3Device::RequestThread::threadLoop() {
     }
 
     // Wait for the next batch of requests.
+    nsecs_t tWaitStart = systemTime(SYSTEM_TIME_MONOTONIC);
     waitForNextRequestBatch();
+    nsecs_t tWaitEnd = systemTime(SYSTEM_TIME_MONOTONIC);
     if (mNextRequests.size() == 0) {
         return true;
     }
@@ -4320,7 +4333,9 @@ bool Camera3Device::RequestThread::threadLoop() {
     }
 
     // Prepare a batch of HAL requests and output buffers.
+    nsecs_t tPrepareStart = systemTime(SYSTEM_TIME_MONOTONIC);
     res = prepareHalRequests();
+    nsecs_t tPrepareEnd = systemTime(SYSTEM_TIME_MONOTONIC);
     if (res == TIMED_OUT) {
         // Not a fatal error if getting output buffers time out.
         cleanUpFailedRequests(/*sendRequestError*/ true);
@@ -4367,6 +4382,15 @@ bool Camera3Device::RequestThread::threadLoop() {
 
     nsecs_t tRequestEnd = systemTime(SYSTEM_TIME_MONOTONIC);
     mRequestLatency.add(tRequestStart, tRequestEnd);
+    if (parent != nullptr) {
+        CameraPipelineLatency& latency = parent->mPipelineLatency;
+        latency.add(CameraPipelineLatency::STAGE_WAIT_FOR_REQUEST, mBatchRequestType,
+                tWaitEnd - tWaitStart);
+        latency.add(CameraPipelineLatency::STAGE_PREPARE_REQUEST, mBatchRequestType,
+                tPrepareEnd - tPrepareStart);
+        latency.add(CameraPipelineLatency::STAGE_HAL_SUBMIT, mBatchRequestType,
+                tRequestEnd - tRequestStart);
+    }
 
     if (useFlushLock) {
         mFlushLock.unlock();
@@ -4697,6 +4721,8 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
                 captureRequest->mRotateAndCropAuto, mPrevCameraIdsWithZoom,
                 (mUseHalBufManager) ? uniqueSurfaceIdMap :
                                       SurfaceMap{});
+        mBatchRequestType = CameraPipelineLatency::getRequestType(
+                halRequest->input_buffer != NULL, isStillCapture, isZslCapture);
         ALOGVV("%s: registered in flight requestId = %" PRId32 ", frameNumber = %" PRId64
                ", burstId = %" PRId32 ".",
                 __FUNCTION__,
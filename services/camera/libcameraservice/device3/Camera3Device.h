@@ -54,6 +54,7 @@
 #include "device3/Camera3OfflineSession.h"
 #include "utils/TagMonitor.h"
 #include "utils/LatencyHistogram.h"
+#include "utils/PipelineLatency.h"
 #include <camera_metadata_hidden.h>
 
 using android::camera3::OutputStreamInfo;
@@ -348,8 +349,8 @@ class Camera3Device :
         status_t close();
 
         void signalPipelineDrain(const std::vector<int>& streamIds);
-        bool isReconfigurationRequired(CameraMetadata& oldSessionParams,
-                CameraMetadata& newSessionParams);
+        bool isReconfigurationRequired(const CameraMetadata& oldSessionParams,
+                const CameraMetadata& newSessionParams);
 
         // Upon successful return, HalInterface will return buffer maps needed for offline
         // processing, and clear all its internal buffer maps.
@@ -1010,6 +1011,8 @@ class Camera3Device :
 
         static const int32_t kRequestLatencyBinSize = 40; // in ms
         CameraLatencyHistogram mRequestLatency;
+        // Type of the last request in the current batch, for the pipeline latency stats
+        CameraPipelineLatency::RequestType mBatchRequestType;
 
         Vector<int32_t>    mSessionParamKeys;
         CameraMetadata     mLatestSessionParams;
@@ -1166,6 +1169,10 @@ class Camera3Device :
     // - dumpsys -m 3a is a shortcut for ae/af/awbMode, State, and Triggers
     TagMonitor mTagMonitor;
 
+    // Per-stage latency of the request pipeline, shown in dumpsys and reported to
+    // media.metrics when the device is disconnected
+    CameraPipelineLatency mPipelineLatency;
+
     void monitorMetadata(TagMonitor::eventSource source, int64_t frameNumber,
             nsecs_t timestamp, const CameraMetadata& metadata,
             const std::unordered_map<std::string, CameraMetadata>& physicalMetadata);
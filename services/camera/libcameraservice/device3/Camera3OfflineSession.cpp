@@ -127,9 +127,10 @@ status_t Camera3OfflineSession::initialize(wp<NotificationListener> listener) {
     return OK;
 }
 
-status_t Camera3OfflineSession::dump(int /*fd*/) {
+status_t Camera3OfflineSession::dump(int fd) {
     ATRACE_CALL();
     std::lock_guard<std::mutex> il(mInterfaceLock);
+    mPipelineLatency.dump(fd, "    Offline capture pipeline latency:");
     return OK;
 }
 
@@ -260,13 +261,15 @@ hardware::Return<void> Camera3OfflineSession::processCaptureResult_3_4(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, mBufferRecords
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, mBufferRecords
     };
 
     std::lock_guard<std::mutex> lock(mProcessCaptureResultLock);
     for (const auto& result : results) {
         processOneCaptureResultLocked(states, result.v3_2, result.physicalCameraMetadata);
     }
+    signalQueuedResults(states);
     return hardware::Void();
 }
 
@@ -299,13 +302,15 @@ hardware::Return<void> Camera3OfflineSession::processCaptureResult(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, mBufferRecords
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, mBufferRecords
     };
 
     std::lock_guard<std::mutex> lock(mProcessCaptureResultLock);
     for (const auto& result : results) {
         processOneCaptureResultLocked(states, result, noPhysMetadata);
     }
+    signalQueuedResults(states);
     return hardware::Void();
 }
 
@@ -333,11 +338,13 @@ hardware::Return<void> Camera3OfflineSession::notify(
         mUseHalBufManager, mUsePartialResult, mNeedFixupMonochromeTags,
         mNumPartialResults, mVendorTagId, mDeviceInfo, mPhysicalDeviceInfoMap,
         mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
-        mTagMonitor, mInputStream, mOutputStreams, listener, *this, *this, mBufferRecords
+        mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, listener,
+        *this, *this, mBufferRecords
     };
     for (const auto& msg : msgs) {
         camera3::notify(states, msg);
     }
+    signalQueuedResults(states);
     return hardware::Void();
 }
 
@@ -37,6 +37,7 @@
 #include "device3/ZoomRatioMapper.h"
 #include "utils/TagMonitor.h"
 #include "utils/LatencyHistogram.h"
+#include "utils/PipelineLatency.h"
 #include <camera_metadata_hidden.h>
 
 namespace android {
@@ -216,6 +217,7 @@ class Camera3OfflineSession :
     sp<hardware::camera::device::V3_6::ICameraOfflineSession> mSession;
 
     TagMonitor mTagMonitor;
+    CameraPipelineLatency mPipelineLatency;
     const metadata_vendor_id_t mVendorTagId;
 
     const bool mUseHalBufManager;
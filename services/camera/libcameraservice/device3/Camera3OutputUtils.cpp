@@ -128,8 +128,7 @@ status_t fixupMonochromeTags(
 void insertResultLocked(CaptureOutputStates& states, CaptureResult *result, uint32_t frameNumber) {
     if (result == nullptr) return;
 
-    camera_metadata_t *meta = const_cast<camera_metadata_t *>(
-            result->mMetadata.getAndLock());
+    camera_metadata_t *meta = result->mMetadata.getAndLockForUpdate();
     set_camera_metadata_vendor_id(meta, states.vendorTagId);
     result->mMetadata.unlock(meta);
 
@@ -146,22 +145,23 @@ void insertResultLocked(CaptureOutputStates& states, CaptureResult *result, uint
 
     // Update vendor tag id for physical metadata
     for (auto& physicalMetadata : result->mPhysicalMetadatas) {
-        camera_metadata_t *pmeta = const_cast<camera_metadata_t *>(
-                physicalMetadata.mPhysicalCameraMetadata.getAndLock());
+        camera_metadata_t *pmeta =
+                physicalMetadata.mPhysicalCameraMetadata.getAndLockForUpdate();
         set_camera_metadata_vendor_id(pmeta, states.vendorTagId);
         physicalMetadata.mPhysicalCameraMetadata.unlock(pmeta);
     }
 
-    // Valid result, insert into queue
+    // Valid result, move into queue
     std::list<CaptureResult>::iterator queuedResult =
-            states.resultQueue.insert(states.resultQueue.end(), CaptureResult(*result));
+            states.resultQueue.insert(states.resultQueue.end(), std::move(*result));
     ALOGV("%s: result requestId = %" PRId32 ", frameNumber = %" PRId64
            ", burstId = %" PRId32, __FUNCTION__,
            queuedResult->mResultExtras.requestId,
            queuedResult->mResultExtras.frameNumber,
            queuedResult->mResultExtras.burstId);
 
-    states.resultSignal.notify_one();
+    // The consumer is woken up once per HAL callback by signalQueuedResults()
+    states.resultsQueued = true;
 }
 
 
@@ -185,6 +185,7 @@ void sendPartialCaptureResult(CaptureOutputStates& states,
     insertResultLocked(states, &captureResult, frameNumber);
 }
 
+// Takes over pendingMetadata and physicalMetadatas; they are left empty if the result was sent
 void sendCaptureResult(
         CaptureOutputStates& states,
         CameraMetadata &pendingMetadata,
@@ -193,7 +194,7 @@ void sendCaptureResult(
         uint32_t frameNumber,
         bool reprocess, bool zslStillCapture, bool rotateAndCropAuto,
         const std::set<std::string>& cameraIdsWithZoom,
-        const std::vector<PhysicalCaptureResultInfo>& physicalMetadatas) {
+        std::vector<PhysicalCaptureResultInfo>& physicalMetadatas) {
     ATRACE_CALL();
     if (pendingMetadata.isEmpty())
         return;
@@ -227,10 +228,19 @@ void sendCaptureResult(
         states.nextResultFrameNum = frameNumber + 1;
     }
 
+    // The tag monitor sees the physical metadata before it is corrected below
+    std::unordered_map<std::string, CameraMetadata> monitoredPhysicalMetadata;
+    if (states.tagMonitor.isMonitoring()) {
+        for (auto& m : physicalMetadatas) {
+            monitoredPhysicalMetadata.emplace(String8(m.mPhysicalCameraId).string(),
+                    CameraMetadata(m.mPhysicalCameraMetadata));
+        }
+    }
+
     CaptureResult captureResult;
     captureResult.mResultExtras = resultExtras;
-    captureResult.mMetadata = pendingMetadata;
-    captureResult.mPhysicalMetadatas = physicalMetadatas;
+    captureResult.mMetadata = std::move(pendingMetadata);
+    captureResult.mPhysicalMetadatas = std::move(physicalMetadatas);
 
     // Append any previous partials to form a complete result
     if (states.usePartialResult && !collectedPartialResult.isEmpty()) {
@@ -248,8 +258,9 @@ void sendCaptureResult(
     }
     nsecs_t sensorTimestamp = timestamp.data.i64[0];
 
-    for (auto& physicalMetadata : captureResult.mPhysicalMetadatas) {
-        camera_metadata_entry timestamp =
+    for (const auto& physicalMetadata : captureResult.mPhysicalMetadatas) {
+        // Read-only lookup, so that a buffer shared with the tag monitor isn't copied
+        camera_metadata_ro_entry timestamp =
                 physicalMetadata.mPhysicalCameraMetadata.find(ANDROID_SENSOR_TIMESTAMP);
         if (timestamp.count == 0) {
             SET_ERR("No timestamp provided by HAL for physical camera %s frame %d!",
@@ -335,11 +346,6 @@ void sendCaptureResult(
         }
     }
 
-    std::unordered_map<std::string, CameraMetadata> monitoredPhysicalMetadata;
-    for (auto& m : physicalMetadatas) {
-        monitoredPhysicalMetadata.emplace(String8(m.mPhysicalCameraId).string(),
-                CameraMetadata(m.mPhysicalCameraMetadata));
-    }
     states.tagMonitor.monitorMetadata(TagMonitor::RESULT,
             frameNumber, sensorTimestamp, captureResult.mMetadata,
             monitoredPhysicalMetadata);
@@ -453,6 +459,39 @@ void removeInFlightRequestIfReadyLocked(CaptureOutputStates& states, int idx) {
     states.inflightIntf.checkInflightMapLengthLocked();
 }
 
+// Record the time from the request being registered in flight until now
+void addRequestLatencyLocked(CaptureOutputStates& states, const InFlightRequest& request,
+        CameraPipelineLatency::Stage stage) {
+    if (request.requestTimestamp == 0) return;
+    states.pipelineLatency.add(stage,
+            CameraPipelineLatency::getRequestType(request.hasInputBuffer,
+                    request.stillCapture, request.zslCapture),
+            systemTime(SYSTEM_TIME_MONOTONIC) - request.requestTimestamp);
+}
+
+// Tags that sendCaptureResult and insertResultLocked may add to a final result:
+// frame count, request id and zoom ratio, plus one spare.
+static constexpr size_t kExtraResultEntries = 4;
+
+// Copy the final result metadata from the HAL with room for the collected partial
+// results and the extra tags, so that completing the result patches the copy in
+// place instead of reallocating it.
+static CameraMetadata copyFinalResultMetadata(const camera_metadata_t *result,
+        const CameraMetadata& partialResults) {
+    size_t entryCount = get_camera_metadata_entry_count(result) + kExtraResultEntries;
+    size_t dataCount = get_camera_metadata_data_count(result);
+    const camera_metadata_t *partials = partialResults.getAndLock();
+    if (partials != nullptr) {
+        entryCount += get_camera_metadata_entry_count(partials);
+        dataCount += get_camera_metadata_data_count(partials);
+    }
+    partialResults.unlock(partials);
+
+    CameraMetadata metadata(entryCount, dataCount);
+    metadata.append(result);
+    return metadata;
+}
+
 void processCaptureResult(CaptureOutputStates& states, const camera3_capture_result *result) {
     ATRACE_CALL();
 
@@ -569,6 +608,7 @@ void processCaptureResult(CaptureOutputStates& states, const camera3_capture_res
             }
             request.haveResultMetadata = true;
             request.errorBufStrategy = ERROR_BUF_RETURN_NOTIFY;
+            addRequestLatencyLocked(states, request, CameraPipelineLatency::STAGE_RESULT);
         }
 
         uint32_t numBuffersReturned = result->num_output_buffers;
@@ -588,6 +628,14 @@ void processCaptureResult(CaptureOutputStates& states, const camera3_capture_res
             return;
         }
 
+        if (result->num_output_buffers > 0 && request.requestTimestamp != 0) {
+            nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - request.requestTimestamp;
+            for (uint32_t i = 0; i < result->num_output_buffers; i++) {
+                Camera3Stream *stream = Camera3Stream::cast(result->output_buffers[i].stream);
+                states.pipelineLatency.addBufferReturn(stream->getId(), latency);
+            }
+        }
+
         camera_metadata_ro_entry_t entry;
         res = find_camera_metadata_ro_entry(result->result,
                 ANDROID_SENSOR_TIMESTAMP, &entry);
@@ -613,11 +661,12 @@ void processCaptureResult(CaptureOutputStates& states, const camera3_capture_res
                         physicalMetadata});
             }
             if (shutterTimestamp == 0) {
-                request.pendingMetadata = result->result;
-                request.collectedPartialResult = collectedPartialResult;
+                request.pendingMetadata = copyFinalResultMetadata(result->result,
+                        collectedPartialResult);
+                request.collectedPartialResult.acquire(collectedPartialResult);
             } else if (request.hasCallback) {
-                CameraMetadata metadata;
-                metadata = result->result;
+                CameraMetadata metadata = copyFinalResultMetadata(result->result,
+                        collectedPartialResult);
                 sendCaptureResult(states, metadata, request.resultExtras,
                     collectedPartialResult, frameNumber,
                     hasInputBufferInRequest, request.zslCapture && request.stillCapture,
@@ -795,6 +844,13 @@ void processOneCaptureResultLocked(
     processCaptureResult(states, &r);
 }
 
+void signalQueuedResults(CaptureOutputStates& states) {
+    if (states.resultsQueued) {
+        states.resultsQueued = false;
+        states.resultSignal.notify_one();
+    }
+}
+
 void returnOutputBuffers(
         bool useHalBufManager,
         sp<NotificationListener> listener,
@@ -944,6 +1000,7 @@ void notifyShutter(CaptureOutputStates& states, const camera3_shutter_msg_t &msg
             }
 
             r.shutterTimestamp = msg.timestamp;
+            addRequestLatencyLocked(states, r, CameraPipelineLatency::STAGE_SHUTTER);
             if (r.hasCallback) {
                 ALOGVV("Camera %s: %s: Shutter fired for frame %d (id %d) at %" PRId64,
                     states.cameraId.string(), __FUNCTION__,
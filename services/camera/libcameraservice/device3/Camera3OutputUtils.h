@@ -34,6 +34,7 @@
 #include "device3/Camera3Stream.h"
 #include "device3/Camera3OutputStreamInterface.h"
 #include "utils/TagMonitor.h"
+#include "utils/PipelineLatency.h"
 
 namespace android {
 
@@ -96,12 +97,15 @@ namespace camera3 {
         std::unordered_map<std::string, camera3::ZoomRatioMapper>& zoomRatioMappers;
         std::unordered_map<std::string, camera3::RotateAndCropMapper>& rotateAndCropMappers;
         TagMonitor& tagMonitor;
+        CameraPipelineLatency& pipelineLatency;
         sp<Camera3Stream> inputStream;
         StreamSet& outputStreams;
         sp<NotificationListener> listener;
         SetErrorInterface& setErrIntf;
         InflightRequestUpdateInterface& inflightIntf;
         BufferRecordsInterface& bufferRecordsIntf;
+        // Set when a result is added to resultQueue; see signalQueuedResults()
+        bool resultsQueued = false;
     };
 
     // Handle one capture result. Assume callers hold the lock to serialize all
@@ -116,6 +120,11 @@ namespace camera3 {
     void notify(CaptureOutputStates& states,
             const hardware::camera::device::V3_2::NotifyMsg& msg);
 
+    // Wake up the result consumer if any results were queued since the last call. Called
+    // once after each batch of HAL results or notifications, so that a batch of N results
+    // costs one wakeup instead of N.
+    void signalQueuedResults(CaptureOutputStates& states);
+
     struct RequestBufferStates {
         const String8& cameraId;
         std::mutex& reqBufferLock; // lock to serialize request buffer calls
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include "device3/DistortionMapper.h"
 
@@ -68,6 +69,11 @@ status_t DistortionMapper::setupStaticInfo(const CameraMetadata &deviceInfo) {
     mArrayDiffX = activeX - arrayX;
     mArrayDiffY = activeY - arrayY;
 
+    // Grids depend on the array dimensions as well as the calibration
+    mGridCache.clear();
+    mGrids.reset();
+    mValidGrids = false;
+
     return updateCalibration(deviceInfo);
 }
 
@@ -208,7 +214,7 @@ status_t DistortionMapper::mapRawToCorrected(int32_t *coordPairs, int coordCount
     }
 
     for (int i = 0; i < coordCount * 2; i += 2) {
-        const GridQuad *quad = findEnclosingQuad(coordPairs + i, mDistortedGrid);
+        const GridQuad *quad = mGrids->findEnclosingQuad(coordPairs + i);
         if (quad == nullptr) {
             ALOGE("Raw to corrected mapping failure: No quad found for (%d, %d)",
                     *(coordPairs + i), *(coordPairs + i + 1));
@@ -315,26 +321,37 @@ status_t DistortionMapper::mapCorrectedToRawImpl(T *coordPairs, int coordCount,
 
     float activeCx = mCx - mArrayDiffX;
     float activeCy = mCy - mArrayDiffY;
-    for (int i = 0; i < coordCount * 2; i += 2) {
-        // Move to normalized space from active array space
-        float ywi = (coordPairs[i + 1] - activeCy) * mInvFy;
-        float xwi = (coordPairs[i] - activeCx - mS * ywi) * mInvFx;
-        // Apply distortion model to calculate raw image coordinates
-        float rSq = xwi * xwi + ywi * ywi;
-        float Fr = 1.f + (mK[0] * rSq) + (mK[1] * rSq * rSq) + (mK[2] * rSq * rSq * rSq);
-        float xc = xwi * Fr + (mK[3] * 2 * xwi * ywi) + mK[4] * (rSq + 2 * xwi * xwi);
-        float yc = ywi * Fr + (mK[4] * 2 * xwi * ywi) + mK[3] * (rSq + 2 * ywi * ywi);
-        // Move back to image space
-        float xr = mFx * xc + mS * yc + mCx;
-        float yr = mFy * yc + mCy;
+    // Evaluate the model for a batch of points at a time, with no branches or calls in the
+    // loop, so that it vectorizes; rounding and conversion back to T are done separately.
+    float xr[kBatchSize];
+    float yr[kBatchSize];
+    for (int batch = 0; batch < coordCount; batch += kBatchSize) {
+        const int count = std::min(kBatchSize, coordCount - batch);
+        T *pairs = coordPairs + batch * 2;
+        for (int j = 0; j < count; j++) {
+            // Move to normalized space from active array space
+            float ywi = (pairs[j * 2 + 1] - activeCy) * mInvFy;
+            float xwi = (pairs[j * 2] - activeCx - mS * ywi) * mInvFx;
+            // Apply distortion model to calculate raw image coordinates
+            float rSq = xwi * xwi + ywi * ywi;
+            float Fr = 1.f + (mK[0] * rSq) + (mK[1] * rSq * rSq) + (mK[2] * rSq * rSq * rSq);
+            float xc = xwi * Fr + (mK[3] * 2 * xwi * ywi) + mK[4] * (rSq + 2 * xwi * xwi);
+            float yc = ywi * Fr + (mK[4] * 2 * xwi * ywi) + mK[3] * (rSq + 2 * ywi * ywi);
+            // Move back to image space
+            xr[j] = mFx * xc + mS * yc + mCx;
+            yr[j] = mFy * yc + mCy;
+        }
         // Clamp to within pre-correction active array
         if (clamp) {
-            xr = std::min(mArrayWidth - 1, std::max(0.f, xr));
-            yr = std::min(mArrayHeight - 1, std::max(0.f, yr));
+            for (int j = 0; j < count; j++) {
+                xr[j] = std::min(mArrayWidth - 1, std::max(0.f, xr[j]));
+                yr[j] = std::min(mArrayHeight - 1, std::max(0.f, yr[j]));
+            }
+        }
+        for (int j = 0; j < count; j++) {
+            pairs[j * 2] = static_cast<T>(std::round(xr[j]));
+            pairs[j * 2 + 1] = static_cast<T>(std::round(yr[j]));
         }
-
-        coordPairs[i] = static_cast<T>(std::round(xr));
-        coordPairs[i + 1] = static_cast<T>(std::round(yr));
     }
 
     return OK;
@@ -388,12 +405,29 @@ status_t DistortionMapper::mapCorrectedRectToRaw(int32_t *rects, int rectCount,
     return OK;
 }
 
+DistortionMapper::Calibration DistortionMapper::currentCalibration() const {
+    return Calibration{mFx, mFy, mCx, mCy, mS, mK};
+}
+
 status_t DistortionMapper::buildGrids() {
-    if (mCorrectedGrid.size() != kGridSize * kGridSize) {
-        mCorrectedGrid.resize(kGridSize * kGridSize);
-        mDistortedGrid.resize(kGridSize * kGridSize);
+    const Calibration calibration = currentCalibration();
+
+    // Calibration often alternates between a few values, for example when a logical camera
+    // switches between physical cameras; reuse the grids if they were built recently.
+    for (auto it = mGridCache.begin(); it != mGridCache.end(); it++) {
+        if ((*it)->calibration == calibration) {
+            mGrids = *it;
+            std::rotate(mGridCache.begin(), it, it + 1);
+            mValidGrids = true;
+            return OK;
+        }
     }
 
+    auto grids = std::make_shared<Grids>();
+    grids->calibration = calibration;
+    grids->correctedGrid.resize(kGridSize * kGridSize);
+    grids->distortedGrid.resize(kGridSize * kGridSize);
+
     float gridMargin = mArrayWidth * kGridMargin;
     float gridSpacingX = (mArrayWidth + 2 * gridMargin) / kGridSize;
     float gridSpacingY = (mArrayHeight + 2 * gridMargin) / kGridSize;
@@ -403,62 +437,165 @@ status_t DistortionMapper::buildGrids() {
     for (size_t i = 0; i < kGridSize; i++, x += gridSpacingX) {
         float y = -gridMargin;
         for (size_t j = 0; j < kGridSize; j++, y += gridSpacingY, index++) {
-            mCorrectedGrid[index].src = nullptr;
-            mCorrectedGrid[index].coords = {
+            grids->correctedGrid[index].src = nullptr;
+            grids->correctedGrid[index].coords = {
                 x, y,
                 x + gridSpacingX, y,
                 x + gridSpacingX, y + gridSpacingY,
                 x, y + gridSpacingY
             };
-            mDistortedGrid[index].src = &mCorrectedGrid[index];
-            mDistortedGrid[index].coords = mCorrectedGrid[index].coords;
-            status_t res = mapCorrectedToRawImpl(mDistortedGrid[index].coords.data(), 4,
-                    /*clamp*/false, /*simple*/false);
-            if (res != OK) return res;
+            grids->distortedGrid[index].src = &grids->correctedGrid[index];
         }
     }
 
+    // Map all the corners in one call, so that they go through the model in batches
+    std::vector<float> corners(kGridSize * kGridSize * 8);
+    for (size_t q = 0; q < kGridSize * kGridSize; q++) {
+        std::copy(grids->correctedGrid[q].coords.begin(), grids->correctedGrid[q].coords.end(),
+                corners.begin() + q * 8);
+    }
+    status_t res = mapCorrectedToRawImpl(corners.data(), corners.size() / 2,
+            /*clamp*/false, /*simple*/false);
+    if (res != OK) return res;
+    for (size_t q = 0; q < kGridSize * kGridSize; q++) {
+        std::copy(corners.begin() + q * 8, corners.begin() + (q + 1) * 8,
+                grids->distortedGrid[q].coords.begin());
+    }
+
+    grids->buildIndex();
+
+    mGrids = grids;
+    mGridCache.insert(mGridCache.begin(), mGrids);
+    if (mGridCache.size() > kGridCacheSize) {
+        mGridCache.pop_back();
+    }
     mValidGrids = true;
     return OK;
 }
 
+void DistortionMapper::Grids::buildIndex() {
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxY = std::numeric_limits<float>::lowest();
+    for (const GridQuad& quad : distortedGrid) {
+        for (size_t c = 0; c < 8; c += 2) {
+            minX = std::min(minX, quad.coords[c]);
+            maxX = std::max(maxX, quad.coords[c]);
+            minY = std::min(minY, quad.coords[c + 1]);
+            maxY = std::max(maxY, quad.coords[c + 1]);
+        }
+    }
+    indexMinX = minX - kIndexPadding;
+    indexMinY = minY - kIndexPadding;
+    indexScaleX = kIndexSize / (maxX - minX + 2 * kIndexPadding);
+    indexScaleY = kIndexSize / (maxY - minY + 2 * kIndexPadding);
+
+    // Range of buckets overlapped by each padded quad. A point inside a quad maps to a bucket
+    // in that range, because the bucket of a coordinate is monotonic in the coordinate.
+    auto bucketRange = [](float lo, float hi, float origin, float scale, size_t *first,
+            size_t *last) {
+        *first = static_cast<size_t>(std::max(0.f, (lo - kIndexPadding - origin) * scale));
+        *last = static_cast<size_t>(std::max(0.f, (hi + kIndexPadding - origin) * scale));
+        *first = std::min(*first, kIndexSize - 1);
+        *last = std::min(*last, kIndexSize - 1);
+    };
+    std::vector<std::array<size_t, 4>> ranges(distortedGrid.size());
+    std::array<uint32_t, kIndexSize * kIndexSize> counts{};
+    for (size_t q = 0; q < distortedGrid.size(); q++) {
+        const auto& coords = distortedGrid[q].coords;
+        float qMinX = std::min({coords[0], coords[2], coords[4], coords[6]});
+        float qMaxX = std::max({coords[0], coords[2], coords[4], coords[6]});
+        float qMinY = std::min({coords[1], coords[3], coords[5], coords[7]});
+        float qMaxY = std::max({coords[1], coords[3], coords[5], coords[7]});
+        auto& r = ranges[q];
+        bucketRange(qMinX, qMaxX, indexMinX, indexScaleX, &r[0], &r[1]);
+        bucketRange(qMinY, qMaxY, indexMinY, indexScaleY, &r[2], &r[3]);
+        for (size_t j = r[2]; j <= r[3]; j++) {
+            for (size_t i = r[0]; i <= r[1]; i++) {
+                counts[j * kIndexSize + i]++;
+            }
+        }
+    }
+
+    bucketStart[0] = 0;
+    for (size_t b = 0; b < counts.size(); b++) {
+        bucketStart[b + 1] = bucketStart[b] + counts[b];
+    }
+    bucketQuads.resize(bucketStart[counts.size()]);
+    std::array<uint32_t, kIndexSize * kIndexSize> fill{};
+    // Quads are added in increasing index order, so each bucket stays sorted and lookups find
+    // the same quad as a linear scan of the grid
+    for (size_t q = 0; q < distortedGrid.size(); q++) {
+        const auto& r = ranges[q];
+        for (size_t j = r[2]; j <= r[3]; j++) {
+            for (size_t i = r[0]; i <= r[1]; i++) {
+                size_t b = j * kIndexSize + i;
+                bucketQuads[bucketStart[b] + fill[b]++] = static_cast<uint16_t>(q);
+            }
+        }
+    }
+}
+
+const DistortionMapper::GridQuad* DistortionMapper::Grids::findEnclosingQuad(
+        const int32_t pt[2]) const {
+    const float x = pt[0];
+    const float y = pt[1];
+
+    // Points outside of the padded bounds of the grid can't be in any quad
+    const float bx = (x - indexMinX) * indexScaleX;
+    const float by = (y - indexMinY) * indexScaleY;
+    if (!(bx >= 0 && bx < kIndexSize && by >= 0 && by < kIndexSize)) return nullptr;
+
+    const size_t b = static_cast<size_t>(by) * kIndexSize + static_cast<size_t>(bx);
+    for (size_t k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+        const GridQuad& quad = distortedGrid[bucketQuads[k]];
+        if (quadContains(quad, x, y)) return &quad;
+    }
+    return nullptr;
+}
+
 const DistortionMapper::GridQuad* DistortionMapper::findEnclosingQuad(
         const int32_t pt[2], const std::vector<GridQuad>& grid) {
     const float x = pt[0];
     const float y = pt[1];
 
     for (const GridQuad& quad : grid) {
-        const float &x1 = quad.coords[0];
-        const float &y1 = quad.coords[1];
-        const float &x2 = quad.coords[2];
-        const float &y2 = quad.coords[3];
-        const float &x3 = quad.coords[4];
-        const float &y3 = quad.coords[5];
-        const float &x4 = quad.coords[6];
-        const float &y4 = quad.coords[7];
-
-        // Point-in-quad test:
-
-        // Quad has corners P1-P4; if P is within the quad, then it is on the same side of all the
-        // edges (or on top of one of the edges or corners), traversed in a consistent direction.
-        // This means that the cross product of edge En = Pn->P(n+1 mod 4) and line Ep = Pn->P must
-        // have the same sign (or be zero) for all edges.
-        // For clockwise traversal, the sign should be negative or zero for Ep x En, indicating that
-        // En is to the left of Ep, or overlapping.
-        float s1 = (x - x1) * (y2 - y1) - (y - y1) * (x2 - x1);
-        if (s1 > 0) continue;
-        float s2 = (x - x2) * (y3 - y2) - (y - y2) * (x3 - x2);
-        if (s2 > 0) continue;
-        float s3 = (x - x3) * (y4 - y3) - (y - y3) * (x4 - x3);
-        if (s3 > 0) continue;
-        float s4 = (x - x4) * (y1 - y4) - (y - y4) * (x1 - x4);
-        if (s4 > 0) continue;
-
-        return &quad;
+        if (quadContains(quad, x, y)) return &quad;
     }
     return nullptr;
 }
 
+bool DistortionMapper::quadContains(const GridQuad& quad, float x, float y) {
+    const float &x1 = quad.coords[0];
+    const float &y1 = quad.coords[1];
+    const float &x2 = quad.coords[2];
+    const float &y2 = quad.coords[3];
+    const float &x3 = quad.coords[4];
+    const float &y3 = quad.coords[5];
+    const float &x4 = quad.coords[6];
+    const float &y4 = quad.coords[7];
+
+    // Point-in-quad test:
+
+    // Quad has corners P1-P4; if P is within the quad, then it is on the same side of all the
+    // edges (or on top of one of the edges or corners), traversed in a consistent direction.
+    // This means that the cross product of edge En = Pn->P(n+1 mod 4) and line Ep = Pn->P must
+    // have the same sign (or be zero) for all edges.
+    // For clockwise traversal, the sign should be negative or zero for Ep x En, indicating that
+    // En is to the left of Ep, or overlapping.
+    float s1 = (x - x1) * (y2 - y1) - (y - y1) * (x2 - x1);
+    if (s1 > 0) return false;
+    float s2 = (x - x2) * (y3 - y2) - (y - y2) * (x3 - x2);
+    if (s2 > 0) return false;
+    float s3 = (x - x3) * (y4 - y3) - (y - y3) * (x4 - x3);
+    if (s3 > 0) return false;
+    float s4 = (x - x4) * (y1 - y4) - (y - y4) * (x1 - x4);
+    if (s4 > 0) return false;
+
+    return true;
+}
+
 float DistortionMapper::calculateUorV(const int32_t pt[2], const GridQuad& quad, bool calculateU) {
     const float x = pt[0];
     const float y = pt[1];
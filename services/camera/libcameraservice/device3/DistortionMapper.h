@@ -19,7 +19,9 @@
 
 #include <utils/Errors.h>
 #include <array>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include "camera/CameraMetadata.h"
 #include "device3/CoordinateMapper.h"
@@ -43,7 +45,7 @@ class DistortionMapper : private CoordinateMapper {
             mArrayWidth(other.mArrayWidth), mArrayHeight(other.mArrayHeight),
             mActiveWidth(other.mActiveWidth), mActiveHeight(other.mActiveHeight),
             mArrayDiffX(other.mArrayDiffX), mArrayDiffY(other.mArrayDiffY),
-            mCorrectedGrid(other.mCorrectedGrid), mDistortedGrid(other.mDistortedGrid) {}
+            mGrids(other.mGrids), mGridCache(other.mGridCache) {}
 
     /**
      * Check whether distortion correction is supported by the camera HAL
@@ -133,10 +135,14 @@ class DistortionMapper : private CoordinateMapper {
         std::array<float, 8> coords;
     };
 
-    // Find which grid quad encloses the point; returns null if none do
+    // Find which grid quad encloses the point; returns null if none do.
+    // Tests every quad; the mapper itself uses the bucket index in Grids.
     static const GridQuad* findEnclosingQuad(
             const int32_t pt[2], const std::vector<GridQuad>& grid);
 
+    // Whether the point is within the quad, or on one of its edges
+    static bool quadContains(const GridQuad& quad, float x, float y);
+
     // Calculate 'horizontal' interpolation coordinate for the point and the quad
     // Assumes the point P is within the quad Q.
     // Given quad with points P1-P4, and edges E12-E41, and considering the edge segments as
@@ -159,6 +165,46 @@ class DistortionMapper : private CoordinateMapper {
     constexpr static float kGridMargin = 0.05f;
     // Fuzziness for float inequality tests
     constexpr static float kFloatFuzz = 1e-4;
+    // Number of buckets in each dimension of the lookup index over the distorted grid
+    constexpr static size_t kIndexSize = 16;
+    // Padding of quad bounds in the index, in pixels, to cover rounding in quadContains
+    constexpr static float kIndexPadding = 1.f;
+    // Number of recently used calibrations whose grids are kept
+    constexpr static size_t kGridCacheSize = 4;
+    // Number of points run through the distortion model together, so that the compiler
+    // can vectorize it
+    constexpr static int kBatchSize = 16;
+
+    // Lens calibration fields that the mapping grids depend on
+    struct Calibration {
+        float fx, fy, cx, cy, s;
+        std::array<float, 5> k;
+
+        bool operator==(const Calibration& other) const {
+            return fx == other.fx && fy == other.fy && cx == other.cx && cy == other.cy &&
+                    s == other.s && k == other.k;
+        }
+    };
+
+    // Mapping grids for one calibration, plus a uniform bucket index over the distorted grid
+    // so that a lookup only tests the quads whose bounds overlap the point's bucket.
+    // Immutable once built, so copies of the mapper share them.
+    struct Grids {
+        Calibration calibration;
+        std::vector<GridQuad> correctedGrid;
+        std::vector<GridQuad> distortedGrid;
+
+        // Bucket (i, j) holds distortedGrid indices bucketQuads[bucketStart[b]] up to
+        // bucketQuads[bucketStart[b + 1]], in increasing order, where b = j * kIndexSize + i
+        float indexMinX, indexMinY;
+        float indexScaleX, indexScaleY;
+        std::array<uint32_t, kIndexSize * kIndexSize + 1> bucketStart;
+        std::vector<uint16_t> bucketQuads;
+
+        void buildIndex();
+        // Same result as DistortionMapper::findEnclosingQuad(pt, distortedGrid)
+        const GridQuad* findEnclosingQuad(const int32_t pt[2]) const;
+    };
 
     // Single implementation for various mapCorrectedToRaw methods
     template<typename T>
@@ -170,9 +216,11 @@ class DistortionMapper : private CoordinateMapper {
 
     status_t mapRawToCorrectedSimple(int32_t *coordPairs, int coordCount, bool clamp) const;
 
-    // Utility to create reverse mapping grids
+    // Utility to create reverse mapping grids, or reuse ones built for the same calibration
     status_t buildGrids();
 
+    Calibration currentCalibration() const;
+
 
     bool mValidMapping;
     bool mValidGrids;
@@ -191,8 +239,11 @@ class DistortionMapper : private CoordinateMapper {
     // corner offsets between pre-correction and active arrays
     float mArrayDiffX, mArrayDiffY;
 
-    std::vector<GridQuad> mCorrectedGrid;
-    std::vector<GridQuad> mDistortedGrid;
+    // Grids for the current calibration, valid if mValidGrids
+    std::shared_ptr<const Grids> mGrids;
+    // Grids for recent calibrations, most recently used first. Cleared when the array
+    // dimensions change.
+    std::vector<std::shared_ptr<const Grids>> mGridCache;
 
 }; // class DistortionMapper
 
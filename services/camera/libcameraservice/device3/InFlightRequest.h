@@ -17,10 +17,14 @@
 #ifndef ANDROID_SERVERS_CAMERA3_INFLIGHT_REQUEST_H
 #define ANDROID_SERVERS_CAMERA3_INFLIGHT_REQUEST_H
 
+#include <algorithm>
+#include <deque>
 #include <set>
+#include <utility>
 
 #include <camera/CaptureResult.h>
 #include <camera/CameraMetadata.h>
+#include <utils/Errors.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
 
@@ -118,6 +122,9 @@ struct InFlightRequest {
     // What shared surfaces an output should go to
     SurfaceMap outputSurfaces;
 
+    // Time the request was registered as in flight, for the pipeline latency statistics
+    nsecs_t requestTimestamp;
+
     // TODO: dedupe
     static const nsecs_t kDefaultExpectedDuration = 100000000; // 100 ms
 
@@ -135,7 +142,8 @@ struct InFlightRequest {
             errorBufStrategy(ERROR_BUF_CACHE),
             stillCapture(false),
             zslCapture(false),
-            rotateAndCropAuto(false) {
+            rotateAndCropAuto(false),
+            requestTimestamp(0) {
     }
 
     InFlightRequest(int numBuffers, CaptureResultExtras extras, bool hasInput,
@@ -159,12 +167,82 @@ struct InFlightRequest {
             zslCapture(isZslCapture),
             rotateAndCropAuto(rotateAndCropAuto),
             cameraIdsWithZoom(idsWithZoom),
-            outputSurfaces(outSurfaces) {
+            outputSurfaces(outSurfaces),
+            requestTimestamp(0) {
     }
 };
 
 // Map from frame number to the in-flight request state
-typedef KeyedVector<uint32_t, InFlightRequest> InFlightRequestMap;
+//
+// Requests are registered in increasing frame number order and mostly complete in the
+// same order, so the entries are kept sorted in a deque: lookup is a binary search,
+// registering a request appends at the back, and completing the oldest request pops
+// the front without touching the rest. Entries removed from the middle only move their
+// neighbors. (KeyedVector copy-constructed every entry behind the removed one, deep
+// copying their metadata, while holding the in-flight lock.)
+//
+// The interface follows the subset of KeyedVector used by the callers.
+class InFlightRequestMap {
+  public:
+    size_t size() const { return mEntries.size(); }
+    bool isEmpty() const { return mEntries.empty(); }
+    void clear() { mEntries.clear(); }
+
+    // Returns the index of the entry, or NAME_NOT_FOUND
+    ssize_t indexOfKey(uint32_t frameNumber) const {
+        auto it = lowerBound(frameNumber);
+        if (it == mEntries.end() || it->first != frameNumber) {
+            return NAME_NOT_FOUND;
+        }
+        return it - mEntries.begin();
+    }
+
+    uint32_t keyAt(size_t index) const { return mEntries[index].first; }
+    const InFlightRequest& valueAt(size_t index) const { return mEntries[index].second; }
+    InFlightRequest& editValueAt(size_t index) { return mEntries[index].second; }
+
+    // Adds or replaces the entry for frameNumber, and returns its index
+    ssize_t add(uint32_t frameNumber, InFlightRequest&& request) {
+        if (mEntries.empty() || mEntries.back().first < frameNumber) {
+            mEntries.emplace_back(frameNumber, std::move(request));
+            return mEntries.size() - 1;
+        }
+        auto it = lowerBound(frameNumber);
+        if (it != mEntries.end() && it->first == frameNumber) {
+            it->second = std::move(request);
+        } else {
+            it = mEntries.emplace(it, frameNumber, std::move(request));
+        }
+        return it - mEntries.begin();
+    }
+
+    ssize_t add(uint32_t frameNumber, const InFlightRequest& request) {
+        return add(frameNumber, InFlightRequest(request));
+    }
+
+    ssize_t removeItemsAt(size_t index, size_t count = 1) {
+        auto first = mEntries.begin() + index;
+        mEntries.erase(first, first + count);
+        return index;
+    }
+
+  private:
+    typedef std::deque<std::pair<uint32_t, InFlightRequest>> Entries;
+
+    static bool keyLess(const Entries::value_type& entry, uint32_t frameNumber) {
+        return entry.first < frameNumber;
+    }
+
+    Entries::const_iterator lowerBound(uint32_t frameNumber) const {
+        return std::lower_bound(mEntries.begin(), mEntries.end(), frameNumber, keyLess);
+    }
+
+    Entries::iterator lowerBound(uint32_t frameNumber) {
+        return std::lower_bound(mEntries.begin(), mEntries.end(), frameNumber, keyLess);
+    }
+
+    Entries mEntries;
+};
 
 } // namespace camera3
 
@@ -193,8 +193,7 @@ status_t ZoomRatioMapper::updateCaptureResult(CameraMetadata* result, bool reque
     } else if (!mHalSupportsZoomRatio && !requestedZoomRatioIs1) {
         res = separateZoomFromCropLocked(result, true/*isResult*/);
     } else {
-        camera_metadata_entry_t entry = result->find(ANDROID_CONTROL_ZOOM_RATIO);
-        if (entry.count == 0) {
+        if (!result->exists(ANDROID_CONTROL_ZOOM_RATIO)) {
             float zoomRatio1x = 1.0f;
             result->update(ANDROID_CONTROL_ZOOM_RATIO, &zoomRatio1x, 1);
         }
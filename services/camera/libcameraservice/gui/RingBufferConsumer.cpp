@@ -41,6 +41,9 @@ RingBufferConsumer::RingBufferConsumer(const sp<IGraphicBufferConsumer>& consume
         uint64_t consumerUsage,
         int bufferCount) :
     ConsumerBase(consumer),
+    mBufferItems(bufferCount > 0 ? bufferCount : 1),
+    mHead(0),
+    mCount(0),
     mBufferCount(bufferCount),
     mLatestTimestamp(0)
 {
@@ -66,17 +69,15 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
     sp<PinnedBufferItem> pinnedBuffer;
 
     {
-        List<RingBufferItem>::iterator it, end, accIt;
+        size_t accIndex = 0;
         BufferInfo acc, cur;
         BufferInfo* accPtr = NULL;
 
         Mutex::Autolock _l(mMutex);
 
-        for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-             it != end;
-             ++it) {
+        for (size_t i = 0; i < mCount; i++) {
 
-            const RingBufferItem& item = *it;
+            const RingBufferItem& item = itemAtLocked(i);
 
             cur.mCrop = item.mCrop;
             cur.mTransform = item.mTransform;
@@ -92,7 +93,7 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
             } else if (ret > 0) {
                 acc = cur;
                 accPtr = &acc;
-                accIt = it;
+                accIndex = i;
             } // else acc = acc
         }
 
@@ -100,100 +101,195 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
             return NULL;
         }
 
-        pinnedBuffer = new PinnedBufferItem(this, *accIt);
-        pinBufferLocked(pinnedBuffer->getBufferItem());
+        pinnedBuffer = pinBufferLocked(accIndex);
 
     } // end scope of mMutex autolock
 
     if (waitForFence) {
-        status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
-                "RingBufferConsumer::pinSelectedBuffer");
-        if (err != OK) {
-            BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
-                    strerror(-err), err);
+        waitForBufferFence(pinnedBuffer);
+    }
+
+    return pinnedBuffer;
+}
+
+sp<PinnedBufferItem> RingBufferConsumer::pinBufferByTimestamp(nsecs_t timestamp,
+        bool waitForFence) {
+
+    sp<PinnedBufferItem> pinnedBuffer;
+
+    {
+        Mutex::Autolock _l(mMutex);
+
+        if (mCount == 0) {
+            return NULL;
         }
+
+        // The first exact match, else the last lower timestamp, else the first
+        // (lowest) higher one.
+        size_t index = lowerBoundLocked(timestamp);
+        if (index == mCount || itemAtLocked(index).mTimestamp != timestamp) {
+            index = (index > 0) ? index - 1 : 0;
+        }
+
+        pinnedBuffer = pinBufferLocked(index);
+
+    } // end scope of mMutex autolock
+
+    if (waitForFence) {
+        waitForBufferFence(pinnedBuffer);
     }
 
     return pinnedBuffer;
 }
 
+void RingBufferConsumer::waitForBufferFence(const sp<PinnedBufferItem>& pinnedBuffer) {
+    status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
+            "RingBufferConsumer::pinSelectedBuffer");
+    if (err != OK) {
+        BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
+                strerror(-err), err);
+    }
+}
+
 status_t RingBufferConsumer::clear() {
 
-    status_t err;
+    status_t err = OK;
     Mutex::Autolock _l(mMutex);
 
     BI_LOGV("%s", __FUNCTION__);
 
     // Avoid annoying log warnings by returning early
-    if (mBufferItemList.size() == 0) {
+    if (mCount == 0) {
         return OK;
     }
 
-    do {
-        size_t pinnedFrames = 0;
-        err = releaseOldestBufferLocked(&pinnedFrames);
-
-        if (err == NO_BUFFER_AVAILABLE) {
-            assert(pinnedFrames == mBufferItemList.size());
-            break;
-        }
-
-        if (err == NOT_ENOUGH_DATA) {
-            // Fine. Empty buffer item list.
-            break;
-        }
-
-        if (err != OK) {
+    // Release all the unpinned buffers in one pass, moving the pinned ones
+    // (and any left over after a failure) to the front as we go.
+    size_t kept = 0;
+    for (size_t i = 0; i < mCount; i++) {
+        RingBufferItem& item = itemAtLocked(i);
+        if (item.mPinCount == 0 && err == OK) {
+            err = releaseBufferItemLocked(item);
+            if (err == OK) {
+                continue;
+            }
             BI_LOGE("Clear failed, could not release buffer");
-            return err;
         }
+        if (kept != i) {
+            itemAtLocked(kept) = item;
+        }
+        kept++;
+    }
+    for (size_t i = kept; i < mCount; i++) {
+        itemAtLocked(i) = RingBufferItem();
+    }
+    mCount = kept;
 
-    } while(true);
+    if (err == OK && mCount > 0) {
+        BI_LOGW("All buffers pinned, could not find any to release");
+    }
 
-    return OK;
+    return err;
 }
 
 nsecs_t RingBufferConsumer::getLatestTimestamp() {
     Mutex::Autolock _l(mMutex);
-    if (mBufferItemList.size() == 0) {
+    if (mCount == 0) {
         return 0;
     }
     return mLatestTimestamp;
 }
 
-void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
-    List<RingBufferItem>::iterator it, end;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
+size_t RingBufferConsumer::lowerBoundLocked(nsecs_t timestamp) const {
+    size_t low = 0;
+    size_t high = mCount;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (itemAtLocked(mid).mTimestamp < timestamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
 
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            find.mPinCount++;
-            break;
+ssize_t RingBufferConsumer::findBufferItemLocked(const BufferItem& item) const {
+    for (size_t i = lowerBoundLocked(item.mTimestamp);
+         i < mCount && itemAtLocked(i).mTimestamp == item.mTimestamp;
+         i++) {
+        if (item.mGraphicBuffer == itemAtLocked(i).mGraphicBuffer) {
+            return i;
         }
     }
+    return -1;
+}
 
-    if (it == end) {
-        BI_LOGE("Failed to pin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
-                 item.mTimestamp, item.mFrameNumber);
+void RingBufferConsumer::eraseBufferItemLocked(size_t index) {
+    if (index < mCount / 2) {
+        for (size_t i = index; i > 0; i--) {
+            itemAtLocked(i) = itemAtLocked(i - 1);
+        }
+        itemAtLocked(0) = RingBufferItem();
+        mHead = (mHead + 1) % mBufferItems.size();
     } else {
-        BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
-                item.mFrameNumber, item.mTimestamp);
+        for (size_t i = index; i + 1 < mCount; i++) {
+            itemAtLocked(i) = itemAtLocked(i + 1);
+        }
+        itemAtLocked(mCount - 1) = RingBufferItem();
     }
+    mCount--;
 }
 
-status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
-    status_t err = OK;
+sp<PinnedBufferItem> RingBufferConsumer::pinBufferLocked(size_t index) {
+    RingBufferItem& item = itemAtLocked(index);
+    item.mPinCount++;
+
+    BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
+            item.mFrameNumber, item.mTimestamp);
 
-    List<RingBufferItem>::iterator it, end, accIt;
+    return new PinnedBufferItem(this, item);
+}
+
+status_t RingBufferConsumer::releaseBufferItemLocked(RingBufferItem& item) {
+    // In case the object was never pinned, pass the acquire fence
+    // back to the release fence. If the fence was already waited on,
+    // it'll just be a no-op to wait on it again.
 
-    it = mBufferItemList.begin();
-    end = mBufferItemList.end();
-    accIt = end;
+    // item.mGraphicBuffer was populated with the proper graphic-buffer
+    // at acquire even if it was previously acquired
+    status_t err = addReleaseFenceLocked(item.mSlot,
+            item.mGraphicBuffer, item.mFence);
 
-    if (it == end) {
+    if (err != OK) {
+        BI_LOGE("Failed to add release fence to buffer "
+                "(timestamp %" PRId64 ", framenumber %" PRIu64,
+                item.mTimestamp, item.mFrameNumber);
+        return err;
+    }
+
+    BI_LOGV("Attempting to release buffer timestamp %" PRId64 ", frame %" PRIu64,
+            item.mTimestamp, item.mFrameNumber);
+
+    // item.mGraphicBuffer was populated with the proper graphic-buffer
+    // at acquire even if it was previously acquired
+    err = releaseBufferLocked(item.mSlot, item.mGraphicBuffer,
+                              EGL_NO_DISPLAY,
+                              EGL_NO_SYNC_KHR);
+    if (err != OK) {
+        BI_LOGE("Failed to release buffer: %s (%d)",
+                strerror(-err), err);
+        return err;
+    }
+
+    BI_LOGV("Buffer timestamp %" PRId64 ", frame %" PRIu64 " evicted",
+            item.mTimestamp, item.mFrameNumber);
+
+    return OK;
+}
+
+status_t RingBufferConsumer::releaseOldestBufferLocked() {
+    if (mCount == 0) {
         /**
          * This is fine. We really care about being able to acquire a buffer
          * successfully after this function completes, not about it releasing
@@ -204,66 +300,24 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
         return NOT_ENOUGH_DATA;
     }
 
-    for (; it != end; ++it) {
-        RingBufferItem& find = *it;
-
-        if (find.mPinCount > 0) {
-            if (pinnedFrames != NULL) {
-                ++(*pinnedFrames);
-            }
+    // The items are in timestamp order, so the first unpinned one is the oldest
+    for (size_t i = 0; i < mCount; i++) {
+        RingBufferItem& item = itemAtLocked(i);
+        if (item.mPinCount > 0) {
             // Filter out pinned frame when searching for buffer to release
             continue;
         }
 
-        if (find.mTimestamp < accIt->mTimestamp || accIt == end) {
-            accIt = it;
-        }
-    }
-
-    if (accIt != end) {
-        RingBufferItem& item = *accIt;
-
-        // In case the object was never pinned, pass the acquire fence
-        // back to the release fence. If the fence was already waited on,
-        // it'll just be a no-op to wait on it again.
-
-        // item.mGraphicBuffer was populated with the proper graphic-buffer
-        // at acquire even if it was previously acquired
-        err = addReleaseFenceLocked(item.mSlot,
-                item.mGraphicBuffer, item.mFence);
-
-        if (err != OK) {
-            BI_LOGE("Failed to add release fence to buffer "
-                    "(timestamp %" PRId64 ", framenumber %" PRIu64,
-                    item.mTimestamp, item.mFrameNumber);
-            return err;
-        }
-
-        BI_LOGV("Attempting to release buffer timestamp %" PRId64 ", frame %" PRIu64,
-                item.mTimestamp, item.mFrameNumber);
-
-        // item.mGraphicBuffer was populated with the proper graphic-buffer
-        // at acquire even if it was previously acquired
-        err = releaseBufferLocked(item.mSlot, item.mGraphicBuffer,
-                                  EGL_NO_DISPLAY,
-                                  EGL_NO_SYNC_KHR);
+        status_t err = releaseBufferItemLocked(item);
         if (err != OK) {
-            BI_LOGE("Failed to release buffer: %s (%d)",
-                    strerror(-err), err);
             return err;
         }
-
-        BI_LOGV("Buffer timestamp %" PRId64 ", frame %" PRIu64 " evicted",
-                item.mTimestamp, item.mFrameNumber);
-
-        mBufferItemList.erase(accIt);
-    } else {
-        BI_LOGW("All buffers pinned, could not find any to release");
-        return NO_BUFFER_AVAILABLE;
-
+        eraseBufferItemLocked(i);
+        return OK;
     }
 
-    return OK;
+    BI_LOGW("All buffers pinned, could not find any to release");
+    return NO_BUFFER_AVAILABLE;
 }
 
 void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
@@ -275,8 +329,8 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
         /**
          * Release oldest frame
          */
-        if (mBufferItemList.size() >= (size_t)mBufferCount) {
-            err = releaseOldestBufferLocked(/*pinnedFrames*/NULL);
+        if (mCount >= (size_t)mBufferCount) {
+            err = releaseOldestBufferLocked();
             assert(err != NOT_ENOUGH_DATA);
 
             // TODO: implement the case for NO_BUFFER_AVAILABLE
@@ -288,35 +342,43 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
             // we could've locked but didn't because there was no space
         }
 
-        RingBufferItem& item = *mBufferItemList.insert(mBufferItemList.end(),
-                                                       RingBufferItem());
-
         /**
-         * Acquire new frame
+         * Acquire new frame, directly into the free slot after the newest one
          */
+        RingBufferItem& item = itemAtLocked(mCount);
         err = acquireBufferLocked(&item, 0);
         if (err != OK) {
             if (err != NO_BUFFER_AVAILABLE) {
                 BI_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
             }
 
-            mBufferItemList.erase(--mBufferItemList.end());
+            item = RingBufferItem();
             return;
         }
+        mCount++;
 
         BI_LOGV("New buffer acquired (timestamp %" PRId64 "), "
                 "buffer items %zu out of %d",
                 item.mTimestamp,
-                mBufferItemList.size(), mBufferCount);
+                mCount, mBufferCount);
+
+        item.mGraphicBuffer = mSlots[item.mSlot].mGraphicBuffer;
 
-        if (item.mTimestamp < mLatestTimestamp) {
+        nsecs_t timestamp = item.mTimestamp;
+        if (timestamp < mLatestTimestamp) {
             BI_LOGE("Timestamp  decreases from %" PRId64 " to %" PRId64,
-                    mLatestTimestamp, item.mTimestamp);
+                    mLatestTimestamp, timestamp);
         }
 
-        mLatestTimestamp = item.mTimestamp;
+        // Keep the items in timestamp order. Timestamps normally increase, so
+        // this only moves the new item if one went backwards.
+        for (size_t i = mCount - 1;
+             i > 0 && itemAtLocked(i - 1).mTimestamp > itemAtLocked(i).mTimestamp;
+             i--) {
+            std::swap(itemAtLocked(i - 1), itemAtLocked(i));
+        }
 
-        item.mGraphicBuffer = mSlots[item.mSlot].mGraphicBuffer;
+        mLatestTimestamp = timestamp;
     } // end of mMutex lock
 
     ConsumerBase::onFrameAvailable(item);
@@ -325,37 +387,28 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
 void RingBufferConsumer::unpinBuffer(const BufferItem& item) {
     Mutex::Autolock _l(mMutex);
 
-    List<RingBufferItem>::iterator it, end, accIt;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
-
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            status_t res = addReleaseFenceLocked(item.mSlot,
-                    item.mGraphicBuffer, item.mFence);
-
-            if (res != OK) {
-                BI_LOGE("Failed to add release fence to buffer "
-                        "(timestamp %" PRId64 ", framenumber %" PRIu64,
-                        item.mTimestamp, item.mFrameNumber);
-                return;
-            }
-
-            find.mPinCount--;
-            break;
-        }
-    }
-
-    if (it == end) {
+    ssize_t index = findBufferItemLocked(item);
+    if (index < 0) {
         // This should never happen. If it happens, we have a bug.
         BI_LOGE("Failed to unpin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
                  item.mTimestamp, item.mFrameNumber);
-    } else {
-        BI_LOGV("Unpinned buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
-                 item.mTimestamp, item.mFrameNumber);
+        return;
     }
+
+    status_t res = addReleaseFenceLocked(item.mSlot,
+            item.mGraphicBuffer, item.mFence);
+
+    if (res != OK) {
+        BI_LOGE("Failed to add release fence to buffer "
+                "(timestamp %" PRId64 ", framenumber %" PRIu64,
+                item.mTimestamp, item.mFrameNumber);
+        return;
+    }
+
+    itemAtLocked(index).mPinCount--;
+
+    BI_LOGV("Unpinned buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
+             item.mTimestamp, item.mFrameNumber);
 }
 
 status_t RingBufferConsumer::setDefaultBufferSize(uint32_t w, uint32_t h) {
@@ -21,7 +21,7 @@
 #include <gui/ConsumerBase.h>
 #include <gui/BufferQueue.h>
 
-#include <utils/List.h>
+#include <vector>
 
 #define ANDROID_GRAPHICS_RINGBUFFERCONSUMER_JNI_ID "mRingBufferConsumer"
 
@@ -42,6 +42,10 @@ class String8;
  *
  * Note that the 'oldest' buffer is the one with the smallest timestamp.
  *
+ * The buffer items are kept in a fixed-capacity circular array, ordered by
+ * timestamp, so that dropping the oldest buffer is O(1) and looking up a
+ * buffer by timestamp is O(log n). No memory is allocated per frame.
+ *
  * Edge cases:
  *  - If ringbuffer is not full, no drops occur when a buffer is produced.
  *  - If all the buffers get filled or pinned then there will be no empty
@@ -153,6 +157,16 @@ class RingBufferConsumer : public ConsumerBase,
     sp<PinnedBufferItem> pinSelectedBuffer(const RingBufferComparator& filter,
                                            bool waitForFence = true);
 
+    // Find the buffer whose timestamp best matches the given one, then pin it
+    // before returning it. Match priority from best to worst:
+    //  1) Timestamps match.
+    //  2) Timestamp is closest to the needle (and lower).
+    //  3) Timestamp is closest to the needle (and higher).
+    //
+    // Returns NULL if the ring buffer is empty.
+    sp<PinnedBufferItem> pinBufferByTimestamp(nsecs_t timestamp,
+                                              bool waitForFence = true);
+
     // Release all the non-pinned buffers in the ring buffer
     status_t clear();
 
@@ -164,21 +178,42 @@ class RingBufferConsumer : public ConsumerBase,
     // Override ConsumerBase::onFrameAvailable
     virtual void onFrameAvailable(const BufferItem& item);
 
-    void pinBufferLocked(const BufferItem& item);
-    void unpinBuffer(const BufferItem& item);
-
-    // Releases oldest buffer. Returns NO_BUFFER_AVAILABLE
-    // if all the buffers were pinned.
-    // Returns NOT_ENOUGH_DATA if list was empty.
-    status_t releaseOldestBufferLocked(size_t* pinnedFrames);
-
     struct RingBufferItem : public BufferItem {
         RingBufferItem() : BufferItem(), mPinCount(0) {}
         int mPinCount;
     };
 
-    // List of acquired buffers in our ring buffer
-    List<RingBufferItem>       mBufferItemList;
+    // Pin the item at the given position and wrap it for the caller
+    sp<PinnedBufferItem> pinBufferLocked(size_t index);
+    void unpinBuffer(const BufferItem& item);
+    void waitForBufferFence(const sp<PinnedBufferItem>& pinnedBuffer);
+
+    // Releases oldest buffer. Returns NO_BUFFER_AVAILABLE
+    // if all the buffers were pinned.
+    // Returns NOT_ENOUGH_DATA if list was empty.
+    status_t releaseOldestBufferLocked();
+    // Return the buffer of the item to the BufferQueue. The item itself is left
+    // in the ring buffer for the caller to remove.
+    status_t releaseBufferItemLocked(RingBufferItem& item);
+
+    // Position i in timestamp order, 0 being the oldest buffer
+    RingBufferItem& itemAtLocked(size_t i) {
+        return mBufferItems[(mHead + i) % mBufferItems.size()];
+    }
+    const RingBufferItem& itemAtLocked(size_t i) const {
+        return mBufferItems[(mHead + i) % mBufferItems.size()];
+    }
+    // Position of the first item whose timestamp is not lower than the given one
+    size_t lowerBoundLocked(nsecs_t timestamp) const;
+    // Position of the item holding the same graphic buffer, or -1
+    ssize_t findBufferItemLocked(const BufferItem& item) const;
+    // Remove the item at the given position, closing the gap from the nearer end
+    void eraseBufferItemLocked(size_t index);
+
+    // Acquired buffers in our ring buffer; mCount items starting at mHead
+    std::vector<RingBufferItem> mBufferItems;
+    size_t                     mHead;
+    size_t                     mCount;
     const int                  mBufferCount;
 
     // Timestamp of latest buffer
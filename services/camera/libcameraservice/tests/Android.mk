@@ -25,6 +25,7 @@ LOCAL_SHARED_LIBRARIES := \
     liblog \
     libcamera_client \
     libcamera_metadata \
+    libgui \
     libui \
     libutils \
     libjpeg \
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "Camera3BufferManagerTest"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "../device3/Camera3BufferManager.h"
+#include "../device3/Camera3OutputStream.h"
+
+using namespace android;
+using namespace android::camera3;
+
+namespace {
+
+constexpr int kStreamSetId = 0;
+constexpr uint32_t kWidth = 640;
+constexpr uint32_t kHeight = 480;
+constexpr uint32_t kFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+constexpr uint64_t kUsage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+// Output stream without a consumer. The buffers the test releases to it are what the manager
+// detaches from it.
+class FakeOutputStream : public Camera3OutputStream {
+  public:
+    explicit FakeOutputStream(int id) :
+            Camera3OutputStream(id, kWidth, kHeight, kFormat, kUsage, HAL_DATASPACE_UNKNOWN,
+                    CAMERA3_STREAM_ROTATION_0, /*timestampOffset*/0, String8(), kStreamSetId) {}
+
+    status_t detachBuffer(sp<GraphicBuffer>* buffer, int* fenceFd) override {
+        if (mOnDetach) {
+            mOnDetach();
+        }
+        std::lock_guard<std::mutex> l(mFreeLock);
+        if (mFreeBuffers.empty()) {
+            *buffer = nullptr;
+            return NO_MEMORY;
+        }
+        *buffer = mFreeBuffers.front();
+        mFreeBuffers.pop_front();
+        if (fenceFd != nullptr) {
+            *fenceFd = -1;
+        }
+        mDetachCount++;
+        return OK;
+    }
+
+    void addFreeBuffer(const sp<GraphicBuffer>& buffer) {
+        std::lock_guard<std::mutex> l(mFreeLock);
+        mFreeBuffers.push_back(buffer);
+    }
+
+    bool hasFreeBuffer(const sp<GraphicBuffer>& buffer) {
+        std::lock_guard<std::mutex> l(mFreeLock);
+        return std::find(mFreeBuffers.begin(), mFreeBuffers.end(), buffer) != mFreeBuffers.end();
+    }
+
+    int detachCount() {
+        std::lock_guard<std::mutex> l(mFreeLock);
+        return mDetachCount;
+    }
+
+    // Called by detachBuffer(), which the manager calls with its lock released.
+    std::function<void()> mOnDetach;
+
+  private:
+    std::mutex mFreeLock;
+    std::list<sp<GraphicBuffer>> mFreeBuffers;
+    int mDetachCount = 0;
+};
+
+StreamInfo makeStreamInfo(int streamId, size_t bufferCount) {
+    return StreamInfo(streamId, kStreamSetId, kWidth, kHeight, kFormat, HAL_DATASPACE_UNKNOWN,
+            kUsage, bufferCount, /*configured*/true);
+}
+
+status_t registerStream(const sp<Camera3BufferManager>& manager,
+        const sp<FakeOutputStream>& stream, size_t bufferCount) {
+    wp<Camera3OutputStream> weakStream = stream;
+    return manager->registerStream(weakStream, makeStreamInfo(stream->getId(), bufferCount));
+}
+
+status_t getBuffer(const sp<Camera3BufferManager>& manager, int streamId,
+        sp<GraphicBuffer>* buffer, int* fenceFd = nullptr) {
+    int fd = -1;
+    status_t res = manager->getBufferForStream(streamId, kStreamSetId, buffer, &fd);
+    if (fenceFd != nullptr) {
+        *fenceFd = fd;
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    return res;
+}
+
+std::string dumpToString(const sp<Camera3BufferManager>& manager) {
+    TemporaryFile file;
+    manager->dump(file.fd, Vector<String16>());
+    std::string dump;
+    android::base::ReadFileToString(file.path, &dump);
+    return dump;
+}
+
+bool dumpContains(const sp<Camera3BufferManager>& manager, const std::string& line) {
+    return dumpToString(manager).find(line) != std::string::npos;
+}
+
+// Gives stream 1 two buffers and releases them, then has stream 2 allocate one, so that the
+// next buffer of stream 2 would exceed the water mark of the set and is recycled from stream 1.
+void setUpRecycling(const sp<Camera3BufferManager>& manager,
+        const sp<FakeOutputStream>& stream1, const sp<FakeOutputStream>& stream2,
+        std::vector<sp<GraphicBuffer>>* stream1Buffers) {
+    ASSERT_EQ(OK, registerStream(manager, stream1, 2));
+    ASSERT_EQ(OK, registerStream(manager, stream2, 2));
+    for (int i = 0; i < 2; i++) {
+        sp<GraphicBuffer> buffer;
+        ASSERT_EQ(OK, getBuffer(manager, 1, &buffer));
+        ASSERT_NE(nullptr, buffer);
+        stream1Buffers->push_back(buffer);
+    }
+    for (const sp<GraphicBuffer>& buffer : *stream1Buffers) {
+        bool shouldFreeBuffer = true;
+        ASSERT_EQ(OK, manager->onBufferReleased(1, kStreamSetId, &shouldFreeBuffer));
+        EXPECT_FALSE(shouldFreeBuffer);
+        stream1->addFreeBuffer(buffer);
+    }
+    sp<GraphicBuffer> buffer;
+    ASSERT_EQ(OK, getBuffer(manager, 2, &buffer));
+    EXPECT_EQ(0, stream1->detachCount());
+}
+
+} // namespace
+
+// A stream unregistered while getBufferForStream() allocates with the manager lock released
+// must not leave that buffer counted against its next registration.
+TEST(Camera3BufferManagerTest, UnregisterDuringAllocation) {
+    sp<Camera3BufferManager> manager = new Camera3BufferManager();
+    sp<FakeOutputStream> stream = new FakeOutputStream(1);
+
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(OK, registerStream(manager, stream, 4));
+        std::promise<void> started;
+        std::future<void> startedFuture = started.get_future();
+        std::future<status_t> result = std::async(std::launch::async, [&]() {
+            sp<GraphicBuffer> buffer;
+            started.set_value();
+            return getBuffer(manager, 1, &buffer);
+        });
+        startedFuture.wait();
+        EXPECT_EQ(OK, manager->unregisterStream(1, kStreamSetId));
+        ASSERT_EQ(OK, registerStream(manager, stream, 4));
+        status_t res = result.get();
+        ASSERT_TRUE(res == OK || res == BAD_VALUE) << "iteration " << i << ": " << res;
+        if (res != OK) {
+            EXPECT_TRUE(dumpContains(manager, "stream id: 1, buffer count: 0."))
+                    << "iteration " << i;
+        }
+        ASSERT_EQ(OK, manager->unregisterStream(1, kStreamSetId));
+    }
+}
+
+// The buffer recycled from another stream is detached with the manager lock released: the
+// stream it is for can be unregistered meanwhile, and then doesn't get it.
+TEST(Camera3BufferManagerTest, UnregisterDuringRecycle) {
+    sp<Camera3BufferManager> manager = new Camera3BufferManager();
+    sp<FakeOutputStream> stream1 = new FakeOutputStream(1);
+    sp<FakeOutputStream> stream2 = new FakeOutputStream(2);
+    std::vector<sp<GraphicBuffer>> stream1Buffers;
+    ASSERT_NO_FATAL_FAILURE(setUpRecycling(manager, stream1, stream2, &stream1Buffers));
+
+    std::promise<void> detaching;
+    std::promise<void> unregistered;
+    std::shared_future<void> unregisteredFuture = unregistered.get_future().share();
+    stream1->mOnDetach = [&detaching, unregisteredFuture]() {
+        detaching.set_value();
+        unregisteredFuture.wait();
+    };
+    std::future<status_t> result = std::async(std::launch::async, [&manager]() {
+        sp<GraphicBuffer> buffer;
+        return getBuffer(manager, 2, &buffer);
+    });
+    detaching.get_future().wait();
+
+    std::future<status_t> unregisterResult = std::async(std::launch::async, [&manager]() {
+        return manager->unregisterStream(2, kStreamSetId);
+    });
+    bool unregisterDone =
+            unregisterResult.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+    unregistered.set_value();
+    ASSERT_TRUE(unregisterDone) << "unregisterStream() blocked by a buffer detach";
+    EXPECT_EQ(OK, unregisterResult.get());
+    EXPECT_EQ(BAD_VALUE, result.get());
+
+    // The detached buffer was taken from stream 1 all the same.
+    EXPECT_EQ(1, stream1->detachCount());
+    EXPECT_TRUE(dumpContains(manager, "stream id: 1, attached buffer count: 1."));
+    EXPECT_FALSE(dumpContains(manager, "stream id: 2,"));
+}
+
+// A stream running over the water mark of its set takes over an idle buffer of another
+// compatible stream instead of allocating one.
+TEST(Camera3BufferManagerTest, RecycleBetweenStreams) {
+    sp<Camera3BufferManager> manager = new Camera3BufferManager();
+    sp<FakeOutputStream> stream1 = new FakeOutputStream(1);
+    sp<FakeOutputStream> stream2 = new FakeOutputStream(2);
+    std::vector<sp<GraphicBuffer>> stream1Buffers;
+    ASSERT_NO_FATAL_FAILURE(setUpRecycling(manager, stream1, stream2, &stream1Buffers));
+
+    sp<GraphicBuffer> buffer;
+    int fenceFd = -1;
+    ASSERT_EQ(OK, getBuffer(manager, 2, &buffer, &fenceFd));
+    EXPECT_EQ(-1, fenceFd);
+    EXPECT_EQ(1, stream1->detachCount());
+    EXPECT_TRUE(buffer == stream1Buffers[0] || buffer == stream1Buffers[1]);
+    EXPECT_FALSE(stream1->hasFreeBuffer(buffer));
+
+    std::string dump = dumpToString(manager);
+    EXPECT_NE(std::string::npos, dump.find("recycled from other streams: 1,")) << dump;
+    EXPECT_NE(std::string::npos, dump.find("stream id: 1, attached buffer count: 1.")) << dump;
+    EXPECT_NE(std::string::npos, dump.find("stream id: 2, attached buffer count: 2.")) << dump;
+}
+
+// A stream running out of buffers twice in a row gets one prefetched, and the manager can be
+// destroyed with a prefetch queued or in progress.
+TEST(Camera3BufferManagerTest, PrefetchThreadShutdown) {
+    for (int i = 0; i < 10; i++) {
+        sp<Camera3BufferManager> manager = new Camera3BufferManager();
+        sp<FakeOutputStream> stream = new FakeOutputStream(1);
+        ASSERT_EQ(OK, registerStream(manager, stream, 8));
+        for (int j = 0; j < 2; j++) {
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, getBuffer(manager, 1, &buffer));
+        }
+
+        if (i == 0) {
+            // Let the first prefetch complete.
+            bool prefetched = false;
+            for (int retry = 0; retry < 200 && !prefetched; retry++) {
+                prefetched = dumpContains(manager, "Spare buffer count: 1 (0 being prefetched)");
+                if (!prefetched) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            }
+            EXPECT_TRUE(prefetched) << dumpToString(manager);
+        }
+
+        std::future<void> destroyed = std::async(std::launch::async,
+                [m = std::move(manager)]() mutable { m.clear(); });
+        ASSERT_EQ(std::future_status::ready, destroyed.wait_for(std::chrono::seconds(5)))
+                << "buffer manager destruction blocked, iteration " << i;
+    }
+}
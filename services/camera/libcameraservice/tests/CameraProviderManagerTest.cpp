@@ -25,6 +25,13 @@
 #include <camera_metadata_hidden.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
 using namespace android;
 using namespace android::hardware::camera;
 using android::hardware::camera::common::V1_0::Status;
@@ -91,6 +98,29 @@ struct TestDeviceInterface : public device::V3_2::ICameraDevice {
     }
 };
 
+/**
+ * Holds the providers sharing it in their device enumeration until all of them are enumerating,
+ * which only happens if they are initialized in parallel
+ */
+struct EnumerationBarrier {
+    explicit EnumerationBarrier(size_t count) : mCount(count) {}
+
+    // Returns whether all the providers were enumerating before the timeout, which only bounds
+    // the duration of a failing test
+    bool arriveAndWait() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mArrived++;
+        mCondition.notify_all();
+        return mCondition.wait_for(lock, std::chrono::seconds(5),
+                [this] { return mArrived == mCount; });
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    const size_t mCount;
+    size_t mArrived = 0;
+};
+
 /**
  * Basic test implementation of a camera provider
  */
@@ -142,6 +172,9 @@ struct TestICameraProvider : virtual public provider::V2_5::ICameraProvider {
             const hardware::hidl_vec<hardware::hidl_string>& cameraDeviceNames)>;
     virtual hardware::Return<void> getCameraIdList(getCameraIdList_cb _hidl_cb) override {
         mCalledCounter[GET_CAMERA_ID_LIST]++;
+        if (mEnumerationBarrier != nullptr) {
+            mEnumeratedInParallel = mEnumerationBarrier->arriveAndWait();
+        }
         _hidl_cb(Status::OK, mDeviceNames);
         return hardware::Void();
     }
@@ -183,6 +216,8 @@ struct TestICameraProvider : virtual public provider::V2_5::ICameraProvider {
         METHOD_NAME_COUNT
     };
     int mCalledCounter[METHOD_NAME_COUNT] {0};
+    std::shared_ptr<EnumerationBarrier> mEnumerationBarrier;
+    bool mEnumeratedInParallel = false;
 
     hardware::hidl_bitfield<DeviceState> mCurrentState = 0xFFFFFFFF; // Unlikely to be a real state
 };
@@ -244,6 +279,38 @@ struct TestInteractionProxy : public CameraProviderManager::ServiceInteractionPr
 
 };
 
+/**
+ * Test version of the interaction proxy that lists several providers, by instance name
+ */
+struct MultiProviderInteractionProxy : public CameraProviderManager::ServiceInteractionProxy {
+    std::map<std::string, sp<TestICameraProvider>> mProviders;
+
+    virtual bool registerForNotifications(
+            const std::string &,
+            const sp<hidl::manager::V1_0::IServiceNotification> &) override {
+        return true;
+    }
+
+    virtual sp<hardware::camera::provider::V2_4::ICameraProvider> tryGetService(
+            const std::string &serviceName) override {
+        auto it = mProviders.find(serviceName);
+        return it != mProviders.end() ? it->second : nullptr;
+    }
+
+    virtual sp<hardware::camera::provider::V2_4::ICameraProvider> getService(
+            const std::string &serviceName) override {
+        return tryGetService(serviceName);
+    }
+
+    virtual hardware::hidl_vec<hardware::hidl_string> listServices() override {
+        std::vector<hardware::hidl_string> ret;
+        for (const auto& it : mProviders) {
+            ret.push_back(it.first);
+        }
+        return ret;
+    }
+};
+
 struct TestStatusListener : public CameraProviderManager::StatusListener {
     ~TestStatusListener() {}
 
@@ -300,6 +367,89 @@ TEST(CameraProviderManagerTest, InitializeDynamicDepthTest) {
 
     res = providerManager->initialize(statusListener, &serviceProxy);
     ASSERT_EQ(res, OK) << "Unable to initialize provider manager";
+
+    // The dynamic depth tags are derived on first use
+    CameraMetadata info;
+    res = providerManager->getCameraCharacteristics("0", &info);
+    ASSERT_EQ(res, OK) << "Unable to get camera characteristics";
+    EXPECT_TRUE(info.exists(ANDROID_DEPTH_AVAILABLE_DYNAMIC_DEPTH_STREAM_CONFIGURATIONS));
+}
+
+TEST(CameraProviderManagerTest, ParallelInitializeTest) {
+    const size_t kProviderCount = 4;
+    hardware::hidl_vec<common::V1_0::VendorTagSection> vendorSection;
+    sp<CameraProviderManager> providerManager = new CameraProviderManager();
+    sp<TestStatusListener> statusListener = new TestStatusListener();
+    MultiProviderInteractionProxy serviceProxy;
+    auto barrier = std::make_shared<EnumerationBarrier>(kProviderCount);
+    for (size_t i = 0; i < kProviderCount; i++) {
+        std::string id = std::to_string(i);
+        sp<TestICameraProvider> provider = new TestICameraProvider(
+                {"device@3.2/test/" + id}, vendorSection);
+        provider->mEnumerationBarrier = barrier;
+        serviceProxy.mProviders["test/" + id] = provider;
+    }
+
+    status_t res = providerManager->initialize(statusListener, &serviceProxy);
+    ASSERT_EQ(res, OK) << "Unable to initialize provider manager";
+
+    EXPECT_EQ(providerManager->getCameraDeviceIds().size(), kProviderCount);
+    for (const auto& it : serviceProxy.mProviders) {
+        EXPECT_EQ(it.second->mCalledCounter[TestICameraProvider::GET_CAMERA_ID_LIST], 1);
+        // Each enumeration overlapped with the enumeration of all the other providers
+        EXPECT_TRUE(it.second->mEnumeratedInParallel) << it.first;
+    }
+}
+
+// Characteristics with only a sensor orientation, to tell the providers apart
+static hardware::hidl_vec<uint8_t> orientationCharacteristics(CameraMetadata* meta,
+        int32_t orientation) {
+    meta->update(ANDROID_SENSOR_ORIENTATION, &orientation, 1);
+    camera_metadata_t* metaBuffer = const_cast<camera_metadata_t*>(meta->getAndLock());
+    hardware::hidl_vec<uint8_t> chars;
+    chars.setToExternal(reinterpret_cast<uint8_t*>(metaBuffer),
+            get_camera_metadata_size(metaBuffer));
+    return chars;
+}
+
+static int32_t getSensorOrientation(const sp<CameraProviderManager>& providerManager,
+        const std::string& id) {
+    CameraMetadata info;
+    if (providerManager->getCameraCharacteristics(id, &info) != OK) {
+        return -1;
+    }
+    camera_metadata_entry entry = info.find(ANDROID_SENSOR_ORIENTATION);
+    return entry.count == 1 ? entry.data.i32[0] : -1;
+}
+
+TEST(CameraProviderManagerTest, DuplicateDeviceTest) {
+    hardware::hidl_vec<common::V1_0::VendorTagSection> vendorSection;
+    sp<CameraProviderManager> providerManager = new CameraProviderManager();
+    sp<TestStatusListener> statusListener = new TestStatusListener();
+    MultiProviderInteractionProxy serviceProxy;
+    // Both providers advertise camera 0; the first one listed keeps it. Each provider gives
+    // its devices its own sensor orientation.
+    CameraMetadata meta0, meta1;
+    serviceProxy.mProviders["test/0"] = new TestICameraProvider(
+            {"device@3.2/test/0", "device@3.2/test/1"}, vendorSection,
+            orientationCharacteristics(&meta0, 90));
+    serviceProxy.mProviders["test/1"] = new TestICameraProvider(
+            {"device@3.2/test/0", "device@3.2/test/2"}, vendorSection,
+            orientationCharacteristics(&meta1, 270));
+
+    status_t res = providerManager->initialize(statusListener, &serviceProxy);
+    ASSERT_EQ(res, OK) << "Unable to initialize provider manager";
+
+    auto ids = providerManager->getCameraDeviceIds();
+    std::sort(ids.begin(), ids.end());
+    EXPECT_EQ(ids, (std::vector<std::string>{"0", "1", "2"}));
+    EXPECT_TRUE(providerManager->isValidDevice("0", 3));
+    EXPECT_TRUE(providerManager->isValidDevice("2", 3));
+    EXPECT_FALSE(providerManager->isValidDevice("2", 1));
+
+    EXPECT_EQ(getSensorOrientation(providerManager, "0"), 90) << "camera 0 not from test/0";
+    EXPECT_EQ(getSensorOrientation(providerManager, "1"), 90);
+    EXPECT_EQ(getSensorOrientation(providerManager, "2"), 270);
 }
 
 TEST(CameraProviderManagerTest, InitializeTest) {
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "CaptureRequestTemplateTest"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../api2/CaptureRequestTemplate.h"
+#include "../common/CameraDeviceBase.h"
+
+using namespace android;
+
+// Records the request lists submitted to it; everything else is unsupported.
+class MockCameraDevice : public CameraDeviceBase {
+  public:
+    MockCameraDevice() : mId("0") {}
+
+    metadata_vendor_id_t getVendorTagId() const override { return 0; }
+    status_t initialize(sp<CameraProviderManager>, const String8&) override { return OK; }
+    status_t disconnect() override { return OK; }
+    status_t dump(int, const Vector<String16>&) override { return OK; }
+    const CameraMetadata& info() const override { return mInfo; }
+    const CameraMetadata& infoPhysical(const String8&) const override { return mInfo; }
+    const String8& getId() const override { return mId; }
+    status_t waitForNextFrame(nsecs_t) override { return INVALID_OPERATION; }
+    status_t getNextResult(CaptureResult*) override { return INVALID_OPERATION; }
+
+    status_t capture(CameraMetadata&, int64_t*) override { return INVALID_OPERATION; }
+    status_t captureList(const List<const PhysicalCameraSettingsList> &requests,
+            const std::list<const SurfaceMap> &surfaceMaps, int64_t *lastFrameNumber) override {
+        return record(requests, surfaceMaps, lastFrameNumber, /*streaming*/false);
+    }
+    status_t setStreamingRequest(const CameraMetadata&, int64_t*) override {
+        return INVALID_OPERATION;
+    }
+    status_t setStreamingRequestList(const List<const PhysicalCameraSettingsList> &requests,
+            const std::list<const SurfaceMap> &surfaceMaps, int64_t *lastFrameNumber) override {
+        return record(requests, surfaceMaps, lastFrameNumber, /*streaming*/true);
+    }
+    status_t clearStreamingRequest(int64_t*) override { return OK; }
+    status_t waitUntilRequestReceived(int32_t, nsecs_t) override { return OK; }
+
+    status_t createStream(sp<Surface>, uint32_t, uint32_t, int, android_dataspace,
+            camera3_stream_rotation_t, int*, const String8&, std::vector<int>*, int, bool,
+            uint64_t) override {
+        return INVALID_OPERATION;
+    }
+    status_t createStream(const std::vector<sp<Surface>>&, bool, uint32_t, uint32_t, int,
+            android_dataspace, camera3_stream_rotation_t, int*, const String8&,
+            std::vector<int>*, int, bool, uint64_t) override {
+        return INVALID_OPERATION;
+    }
+    status_t createInputStream(uint32_t, uint32_t, int32_t, int32_t*) override {
+        return INVALID_OPERATION;
+    }
+    status_t getStreamInfo(int, StreamInfo*) override { return INVALID_OPERATION; }
+    status_t setStreamTransform(int, int) override { return INVALID_OPERATION; }
+    status_t deleteStream(int) override { return INVALID_OPERATION; }
+    status_t configureStreams(const CameraMetadata&, int) override { return INVALID_OPERATION; }
+    void getOfflineStreamIds(std::vector<int>*) override {}
+    status_t getInputBufferProducer(sp<IGraphicBufferProducer>*) override {
+        return INVALID_OPERATION;
+    }
+    status_t createDefaultRequest(int, CameraMetadata*) override { return INVALID_OPERATION; }
+    status_t waitUntilDrained() override { return OK; }
+    ssize_t getJpegBufferSize(uint32_t, uint32_t) const override { return 0; }
+    status_t setNotifyCallback(wp<NotificationListener>) override { return OK; }
+    bool willNotify3A() override { return false; }
+    status_t triggerAutofocus(uint32_t) override { return INVALID_OPERATION; }
+    status_t triggerCancelAutofocus(uint32_t) override { return INVALID_OPERATION; }
+    status_t triggerPrecaptureMetering(uint32_t) override { return INVALID_OPERATION; }
+    status_t flush(int64_t*) override { return OK; }
+    status_t prepare(int) override { return INVALID_OPERATION; }
+    status_t tearDown(int) override { return INVALID_OPERATION; }
+    status_t addBufferListenerForStream(int,
+            wp<camera3::Camera3StreamBufferListener>) override {
+        return INVALID_OPERATION;
+    }
+    status_t prepare(int, int) override { return INVALID_OPERATION; }
+    status_t setConsumerSurfaces(int, const std::vector<sp<Surface>>&,
+            std::vector<int>*) override {
+        return INVALID_OPERATION;
+    }
+    status_t updateStream(int, const std::vector<sp<Surface>>&,
+            const std::vector<android::camera3::OutputStreamInfo>&,
+            const std::vector<size_t>&, KeyedVector<sp<Surface>, size_t>*) override {
+        return INVALID_OPERATION;
+    }
+    status_t dropStreamBuffers(bool, int) override { return INVALID_OPERATION; }
+    nsecs_t getExpectedInFlightDuration() override { return 0; }
+    status_t switchToOffline(const std::vector<int32_t>&,
+            sp<CameraOfflineSessionBase>*) override {
+        return INVALID_OPERATION;
+    }
+    status_t setRotateAndCropAutoBehavior(
+            camera_metadata_enum_android_scaler_rotate_and_crop_t) override {
+        return INVALID_OPERATION;
+    }
+    wp<camera3::StatusTracker> getStatusTracker() override { return nullptr; }
+
+    std::vector<PhysicalCameraSettingsList> mRequests;
+    std::vector<SurfaceMap> mSurfaceMaps;
+    int mCaptureListCalls = 0;
+    int mStreamingListCalls = 0;
+
+  private:
+    status_t record(const List<const PhysicalCameraSettingsList> &requests,
+            const std::list<const SurfaceMap> &surfaceMaps, int64_t *lastFrameNumber,
+            bool streaming) {
+        (streaming ? mStreamingListCalls : mCaptureListCalls)++;
+        for (const auto& request : requests) {
+            mRequests.push_back(request);
+        }
+        for (const auto& surfaceMap : surfaceMaps) {
+            mSurfaceMaps.push_back(surfaceMap);
+        }
+        if (lastFrameNumber != nullptr) {
+            *lastFrameNumber = mRequests.size() - 1;
+        }
+        return OK;
+    }
+
+    CameraMetadata mInfo;
+    String8 mId;
+};
+
+static const char kLogicalId[] = "0";
+static const char kPhysicalId[] = "2";
+
+static sp<CaptureRequestTemplate> makeTemplate() {
+    auto targets = std::make_shared<CaptureRequestTargets>();
+    targets->surfaceMap[0] = {0};
+    targets->surfaceMap[3] = {0, 1};
+    targets->outputStreamIds.push_back(0);
+    targets->outputStreamIds.push_back(3);
+    targets->physicalCameraIds = {"", kPhysicalId};
+
+    CameraMetadata logical;
+    uint8_t aeMode = ANDROID_CONTROL_AE_MODE_OFF;
+    int64_t exposureTime = 10000000;
+    int32_t sensitivity = 100;
+    logical.update(ANDROID_CONTROL_AE_MODE, &aeMode, 1);
+    logical.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1);
+    logical.update(ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1);
+    logical.update(ANDROID_REQUEST_OUTPUT_STREAMS, &targets->outputStreamIds[0],
+            targets->outputStreamIds.size());
+
+    CameraMetadata physical;
+    int32_t physicalSensitivity = 200;
+    physical.update(ANDROID_SENSOR_SENSITIVITY, &physicalSensitivity, 1);
+
+    CameraDeviceBase::PhysicalCameraSettingsList settings;
+    settings.push_back({kLogicalId, logical});
+    settings.push_back({kPhysicalId, physical});
+    return new CaptureRequestTemplate(targets, settings, /*isReprocess*/false,
+            /*configGeneration*/1);
+}
+
+static const camera_metadata_t* bufferOf(const CameraMetadata& metadata) {
+    const camera_metadata_t* buffer = metadata.getAndLock();
+    metadata.unlock(buffer);
+    return buffer;
+}
+
+TEST(CaptureRequestTemplateTest, ReservesRequestId) {
+    sp<CaptureRequestTemplate> requestTemplate = makeTemplate();
+    EXPECT_TRUE(requestTemplate->getSettings().begin()->metadata.exists(ANDROID_REQUEST_ID));
+    EXPECT_FALSE(requestTemplate->isReprocess());
+    EXPECT_EQ(1u, requestTemplate->getConfigGeneration());
+}
+
+TEST(CaptureRequestTemplateTest, BurstAppliesDeltas) {
+    sp<CaptureRequestTemplate> requestTemplate = makeTemplate();
+    MockCameraDevice device;
+
+    const int64_t exposureTimes[] = {1000000, 2000000, 4000000, 8000000};
+    std::vector<CameraMetadata> deltas;
+    for (int64_t exposureTime : exposureTimes) {
+        CameraMetadata delta;
+        delta.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1);
+        deltas.push_back(delta);
+    }
+    // A delta may also add tags the template does not have
+    float focusDistance = 2.0f;
+    deltas.back().update(ANDROID_LENS_FOCUS_DISTANCE, &focusDistance, 1);
+
+    int64_t lastFrameNumber = -1;
+    ASSERT_EQ(OK, requestTemplate->submit(&device, deltas, /*requestId*/7, /*streaming*/false,
+            &lastFrameNumber));
+    EXPECT_EQ(1, device.mCaptureListCalls);
+    EXPECT_EQ(0, device.mStreamingListCalls);
+    EXPECT_EQ(3, lastFrameNumber);
+    ASSERT_EQ(deltas.size(), device.mRequests.size());
+    ASSERT_EQ(deltas.size(), device.mSurfaceMaps.size());
+
+    const CameraMetadata& templatePhysical =
+            (++requestTemplate->getSettings().begin())->metadata;
+    for (size_t i = 0; i < deltas.size(); i++) {
+        const auto& request = device.mRequests[i];
+        ASSERT_EQ(2u, request.size());
+        const CameraMetadata& logical = request.begin()->metadata;
+        EXPECT_EQ(kLogicalId, request.begin()->cameraId);
+
+        camera_metadata_ro_entry entry = logical.find(ANDROID_REQUEST_ID);
+        ASSERT_EQ(1u, entry.count);
+        EXPECT_EQ(7, entry.data.i32[0]);
+        entry = logical.find(ANDROID_SENSOR_EXPOSURE_TIME);
+        ASSERT_EQ(1u, entry.count);
+        EXPECT_EQ(exposureTimes[i], entry.data.i64[0]);
+        entry = logical.find(ANDROID_SENSOR_SENSITIVITY);
+        ASSERT_EQ(1u, entry.count);
+        EXPECT_EQ(100, entry.data.i32[0]);
+        entry = logical.find(ANDROID_REQUEST_OUTPUT_STREAMS);
+        ASSERT_EQ(2u, entry.count);
+        EXPECT_EQ(0, entry.data.i32[0]);
+        EXPECT_EQ(3, entry.data.i32[1]);
+        EXPECT_EQ(i + 1 == deltas.size(), logical.exists(ANDROID_LENS_FOCUS_DISTANCE));
+
+        // Untouched physical settings keep sharing the template buffer
+        const auto& physical = *(++request.begin());
+        EXPECT_EQ(kPhysicalId, physical.cameraId);
+        EXPECT_EQ(bufferOf(templatePhysical), bufferOf(physical.metadata));
+
+        EXPECT_EQ(2u, device.mSurfaceMaps[i].size());
+        EXPECT_EQ(std::vector<size_t>({0, 1}), device.mSurfaceMaps[i].at(3));
+    }
+
+    // The template itself is left as compiled
+    const CameraMetadata& templateLogical = requestTemplate->getSettings().begin()->metadata;
+    camera_metadata_ro_entry entry = templateLogical.find(ANDROID_SENSOR_EXPOSURE_TIME);
+    ASSERT_EQ(1u, entry.count);
+    EXPECT_EQ(10000000, entry.data.i64[0]);
+    EXPECT_FALSE(templateLogical.exists(ANDROID_LENS_FOCUS_DISTANCE));
+}
+
+TEST(CaptureRequestTemplateTest, RepeatingBurst) {
+    sp<CaptureRequestTemplate> requestTemplate = makeTemplate();
+    MockCameraDevice device;
+
+    std::vector<CameraMetadata> deltas(2);
+    ASSERT_EQ(OK, requestTemplate->submit(&device, deltas, /*requestId*/3, /*streaming*/true,
+            nullptr));
+    EXPECT_EQ(0, device.mCaptureListCalls);
+    EXPECT_EQ(1, device.mStreamingListCalls);
+    ASSERT_EQ(2u, device.mRequests.size());
+    for (const auto& request : device.mRequests) {
+        camera_metadata_ro_entry entry = request.begin()->metadata.find(ANDROID_REQUEST_ID);
+        ASSERT_EQ(1u, entry.count);
+        EXPECT_EQ(3, entry.data.i32[0]);
+    }
+}
+
+TEST(CaptureRequestTemplateTest, RejectsInvalidSubmissions) {
+    sp<CaptureRequestTemplate> requestTemplate = makeTemplate();
+    MockCameraDevice device;
+
+    EXPECT_EQ(BAD_VALUE, requestTemplate->submit(&device, {}, 0, false, nullptr));
+    EXPECT_EQ(BAD_VALUE, requestTemplate->submit(nullptr, {CameraMetadata()}, 0, false,
+            nullptr));
+    EXPECT_EQ(0, device.mCaptureListCalls);
+
+    CameraMetadata delta;
+    EXPECT_TRUE(CaptureRequestTemplate::isValidDelta(delta));
+    int64_t exposureTime = 1000;
+    delta.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1);
+    EXPECT_TRUE(CaptureRequestTemplate::isValidDelta(delta));
+    for (uint32_t tag : {ANDROID_REQUEST_ID, ANDROID_REQUEST_OUTPUT_STREAMS,
+            ANDROID_REQUEST_INPUT_STREAMS}) {
+        CameraMetadata retargeting(delta);
+        int32_t value = 1;
+        retargeting.update(tag, &value, 1);
+        EXPECT_FALSE(CaptureRequestTemplate::isValidDelta(retargeting));
+    }
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "CaptureResultPathTest"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+
+#include "../device3/Camera3OutputUtils.h"
+
+using namespace android;
+using namespace android::camera3;
+using android::hardware::hidl_vec;
+using android::hardware::camera::device::V3_2::MsgType;
+using android::hardware::camera::device::V3_2::NotifyMsg;
+
+TEST(InFlightRequestMapTest, OrderedByFrameNumber) {
+    InFlightRequestMap map;
+    EXPECT_TRUE(map.isEmpty());
+    for (uint32_t frame : {10, 11, 12, 14}) {
+        ssize_t expectedIndex = map.size();
+        EXPECT_EQ(expectedIndex, map.add(frame, InFlightRequest()));
+    }
+    // Out of order insertion lands in place, re-adding a key replaces the entry
+    EXPECT_EQ(3, map.add(13, InFlightRequest()));
+    InFlightRequest replacement;
+    replacement.numBuffersLeft = 7;
+    EXPECT_EQ(1, map.add(11, replacement));
+    ASSERT_EQ(5u, map.size());
+    for (size_t i = 0; i < map.size(); i++) {
+        EXPECT_EQ(10 + i, map.keyAt(i));
+        EXPECT_EQ(static_cast<ssize_t>(i), map.indexOfKey(10 + i));
+    }
+    EXPECT_EQ(7, map.valueAt(1).numBuffersLeft);
+    EXPECT_EQ(NAME_NOT_FOUND, map.indexOfKey(9));
+    EXPECT_EQ(NAME_NOT_FOUND, map.indexOfKey(15));
+
+    map.editValueAt(map.indexOfKey(14)).numBuffersLeft = 3;
+    map.removeItemsAt(map.indexOfKey(12), 1);
+    map.removeItemsAt(0, 1);
+    ASSERT_EQ(3u, map.size());
+    EXPECT_EQ(11u, map.keyAt(0));
+    EXPECT_EQ(NAME_NOT_FOUND, map.indexOfKey(12));
+    EXPECT_EQ(3, map.valueAt(map.indexOfKey(14)).numBuffersLeft);
+
+    map.clear();
+    EXPECT_TRUE(map.isEmpty());
+}
+
+/**
+ * Stand-in for a HAL delivering shutter notifications and result metadata through the
+ * shared Camera3OutputUtils path, with a consumer thread draining the result queue
+ * the way FrameProcessorBase does.
+ */
+class SyntheticHal : public SetErrorInterface, public InflightRequestUpdateInterface,
+        public BufferRecordsInterface {
+  public:
+    static constexpr size_t kBatchSize = 8;   // 240 fps HFR batches 8 requests
+    static constexpr size_t kPipelineDepth = 32;
+
+    SyntheticHal() {
+        int32_t activeArray[] = {0, 0, 4032, 3024};
+        mDeviceInfo.update(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE, activeArray, 4);
+        mDeviceInfo.update(ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE, activeArray, 4);
+        mZoomRatioMappers[kCameraId] = ZoomRatioMapper(&mDeviceInfo,
+                /*supportNativeZoomRatio*/false, /*usePrecorrectArray*/false);
+
+        // A result of roughly the size a real HAL sends for a preview frame
+        int32_t cropRegion[] = {0, 0, 4032, 3024};
+        mTemplate.update(ANDROID_SCALER_CROP_REGION, cropRegion, 4);
+        uint8_t aeState = ANDROID_CONTROL_AE_STATE_CONVERGED;
+        mTemplate.update(ANDROID_CONTROL_AE_STATE, &aeState, 1);
+        int64_t exposureTime = 4000000;
+        mTemplate.update(ANDROID_SENSOR_EXPOSURE_TIME, &exposureTime, 1);
+        std::vector<float> colorGains(4, 1.5f);
+        mTemplate.update(ANDROID_COLOR_CORRECTION_GAINS, colorGains.data(), colorGains.size());
+        std::vector<int32_t> faceRects(40, 100);
+        mTemplate.update(ANDROID_STATISTICS_FACE_RECTANGLES, faceRects.data(), faceRects.size());
+    }
+
+    // Register a request in flight, as prepareHalRequests does
+    void registerRequest(uint32_t frameNumber) {
+        CaptureResultExtras extras;
+        extras.requestId = 1;
+        extras.frameNumber = frameNumber;
+        std::lock_guard<std::mutex> l(mInFlightLock);
+        mInFlightMap.add(frameNumber, InFlightRequest(/*numBuffers*/0, extras,
+                /*hasInput*/false, /*hasAppCallback*/true, /*maxDuration*/0,
+                mPhysicalCameraIds, /*isStillCapture*/false, /*isZslCapture*/false,
+                /*rotateAndCropAuto*/false, mCameraIdsWithZoom));
+    }
+
+    // Deliver the shutters and then the results for a batch, one HAL callback each
+    void deliverBatch(uint32_t firstFrame, size_t count) {
+        hidl_vec<NotifyMsg> msgs(count);
+        hidl_vec<hardware::camera::device::V3_2::CaptureResult> results(count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t frameNumber = firstFrame + i;
+            int64_t timestamp = timestampForFrame(frameNumber);
+            msgs[i].type = MsgType::SHUTTER;
+            msgs[i].msg.shutter.frameNumber = frameNumber;
+            msgs[i].msg.shutter.timestamp = timestamp;
+
+            CameraMetadata metadata(mTemplate);
+            metadata.update(ANDROID_SENSOR_TIMESTAMP, &timestamp, 1);
+            const camera_metadata_t* buffer = metadata.getAndLock();
+            results[i].frameNumber = frameNumber;
+            results[i].result.resize(get_camera_metadata_size(buffer));
+            memcpy(results[i].result.data(), buffer, results[i].result.size());
+            metadata.unlock(buffer);
+            results[i].fmqResultSize = 0;
+            results[i].partialResult = 1;
+            results[i].inputBuffer.streamId = -1;
+        }
+
+        hidl_vec<hardware::camera::device::V3_4::PhysicalCameraMetadata> noPhysMetadata;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        {
+            CaptureOutputStates states = makeStates();
+            for (const auto& msg : msgs) {
+                notify(states, msg);
+            }
+            signalQueuedResults(states);
+        }
+        nsecs_t shutterDone = systemTime(SYSTEM_TIME_MONOTONIC);
+        {
+            CaptureOutputStates states = makeStates();
+            for (const auto& result : results) {
+                processOneCaptureResultLocked(states, result, noPhysMetadata);
+            }
+            signalQueuedResults(states);
+        }
+        nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+        mCallbackLatencies.push_back(shutterDone - start);
+        mCallbackLatencies.push_back(end - shutterDone);
+    }
+
+    // Drain the result queue until numFrames results arrived; returns false on timeout
+    bool consumeResults(size_t numFrames) {
+        std::unique_lock<std::mutex> l(mOutputLock);
+        while (mConsumed < numFrames) {
+            while (mResultQueue.empty()) {
+                if (mResultSignal.wait_for(l, std::chrono::seconds(5)) ==
+                        std::cv_status::timeout) {
+                    return false;
+                }
+            }
+            mWakeups++;
+            while (!mResultQueue.empty()) {
+                const CaptureResult& result = mResultQueue.front();
+                camera_metadata_ro_entry_t entry = result.mMetadata.find(ANDROID_SENSOR_TIMESTAMP);
+                if (entry.count != 1 ||
+                        entry.data.i64[0] != timestampForFrame(result.mResultExtras.frameNumber) ||
+                        result.mResultExtras.frameNumber != static_cast<int64_t>(mConsumed)) {
+                    mMismatches++;
+                }
+                mResultQueue.pop_front();
+                mConsumed++;
+            }
+        }
+        return true;
+    }
+
+    size_t inFlightCount() {
+        std::lock_guard<std::mutex> l(mInFlightLock);
+        return mInFlightMap.size();
+    }
+
+    // SetErrorInterface
+    void setErrorState(const char *fmt, ...) override { recordError(fmt); }
+    void setErrorStateLocked(const char *fmt, ...) override { recordError(fmt); }
+
+    // InflightRequestUpdateInterface
+    void onInflightEntryRemovedLocked(nsecs_t) override {}
+    void checkInflightMapLengthLocked() override {}
+    void onInflightMapFlushedLocked() override {}
+
+    // BufferRecordsInterface; the synthetic requests have no buffers
+    std::pair<bool, uint64_t> getBufferId(const buffer_handle_t&, int) override {
+        return std::make_pair(false, 0);
+    }
+    status_t popInflightBuffer(int32_t, int32_t, buffer_handle_t **) override {
+        return NAME_NOT_FOUND;
+    }
+    status_t pushInflightRequestBuffer(uint64_t, buffer_handle_t*, int32_t) override {
+        return INVALID_OPERATION;
+    }
+    status_t popInflightRequestBuffer(uint64_t, buffer_handle_t**, int32_t*) override {
+        return NAME_NOT_FOUND;
+    }
+
+    std::atomic<int> mErrors{0};
+    size_t mMismatches = 0;
+    size_t mWakeups = 0;
+    std::vector<nsecs_t> mCallbackLatencies;
+
+  private:
+    static constexpr char kCameraId[] = "0";
+
+    static int64_t timestampForFrame(int64_t frameNumber) {
+        return 1000000000LL + frameNumber * 4166666LL;
+    }
+
+    void recordError(const char *fmt) {
+        ALOGE("%s: %s", __FUNCTION__, fmt);
+        mErrors++;
+    }
+
+    CaptureOutputStates makeStates() {
+        return CaptureOutputStates {
+            mId,
+            mInFlightLock, mLastCompletedRegularFrameNumber,
+            mLastCompletedReprocessFrameNumber, mLastCompletedZslFrameNumber,
+            mInFlightMap, mOutputLock, mResultQueue, mResultSignal,
+            mNextShutterFrameNumber,
+            mNextReprocessShutterFrameNumber, mNextZslStillShutterFrameNumber,
+            mNextResultFrameNumber,
+            mNextReprocessResultFrameNumber, mNextZslStillResultFrameNumber,
+            /*useHalBufManager*/false, /*usePartialResult*/false,
+            /*needFixupMonoChrome*/false, /*numPartialResults*/1,
+            CAMERA_METADATA_INVALID_VENDOR_ID, mDeviceInfo, mPhysicalDeviceInfoMap,
+            mResultMetadataQueue, mDistortionMappers, mZoomRatioMappers, mRotateAndCropMappers,
+            mTagMonitor, mPipelineLatency, mInputStream, mOutputStreams, /*listener*/nullptr,
+            *this, *this, *this
+        };
+    }
+
+    const String8 mId{kCameraId};
+    CameraMetadata mDeviceInfo;
+    CameraMetadata mTemplate;
+    std::set<String8> mPhysicalCameraIds;
+    std::set<std::string> mCameraIdsWithZoom;
+
+    std::mutex mInFlightLock;
+    InFlightRequestMap mInFlightMap;
+    int64_t mLastCompletedRegularFrameNumber = -1;
+    int64_t mLastCompletedReprocessFrameNumber = -1;
+    int64_t mLastCompletedZslFrameNumber = -1;
+
+    std::mutex mOutputLock;
+    std::list<CaptureResult> mResultQueue;
+    std::condition_variable mResultSignal;
+    uint32_t mNextShutterFrameNumber = 0;
+    uint32_t mNextReprocessShutterFrameNumber = 0;
+    uint32_t mNextZslStillShutterFrameNumber = 0;
+    uint32_t mNextResultFrameNumber = 0;
+    uint32_t mNextReprocessResultFrameNumber = 0;
+    uint32_t mNextZslStillResultFrameNumber = 0;
+    size_t mConsumed = 0;
+
+    std::unordered_map<std::string, CameraMetadata> mPhysicalDeviceInfoMap;
+    std::unique_ptr<ResultMetadataQueue> mResultMetadataQueue;
+    std::unordered_map<std::string, DistortionMapper> mDistortionMappers;
+    std::unordered_map<std::string, ZoomRatioMapper> mZoomRatioMappers;
+    std::unordered_map<std::string, RotateAndCropMapper> mRotateAndCropMappers;
+    TagMonitor mTagMonitor;
+    CameraPipelineLatency mPipelineLatency;
+    sp<Camera3Stream> mInputStream;
+    StreamSet mOutputStreams;
+};
+
+TEST(CaptureResultPathTest, HighSpeedBursts) {
+    const size_t kNumFrames = 240 * 10; // 10 seconds of 240 fps
+    SyntheticHal hal;
+
+    std::atomic<bool> consumed{false};
+    std::thread consumer([&hal, &consumed, kNumFrames]() {
+        consumed = hal.consumeResults(kNumFrames);
+    });
+
+    // Keep kPipelineDepth requests in flight, delivering results in HFR sized batches
+    uint32_t nextRegistered = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (uint32_t frame = 0; frame < kNumFrames; frame += SyntheticHal::kBatchSize) {
+        while (nextRegistered < std::min<size_t>(frame + SyntheticHal::kPipelineDepth,
+                kNumFrames)) {
+            hal.registerRequest(nextRegistered++);
+        }
+        hal.deliverBatch(frame, std::min<size_t>(SyntheticHal::kBatchSize, kNumFrames - frame));
+    }
+    consumer.join();
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    ASSERT_TRUE(consumed);
+    EXPECT_EQ(0, hal.mErrors.load());
+    EXPECT_EQ(0u, hal.mMismatches);
+    EXPECT_EQ(0u, hal.inFlightCount());
+
+    std::vector<nsecs_t>& latencies = hal.mCallbackLatencies;
+    std::sort(latencies.begin(), latencies.end());
+    double resultsPerSecond = kNumFrames * 1e9 / elapsed;
+    nsecs_t p50 = latencies[latencies.size() / 2];
+    nsecs_t p99 = latencies[latencies.size() * 99 / 100];
+    ALOGI("%zu results in %" PRId64 " us: %.0f results/s, callback latency p50 %" PRId64
+            " us, p99 %" PRId64 " us, %zu consumer wakeups", kNumFrames, ns2us(elapsed),
+            resultsPerSecond, ns2us(p50), ns2us(p99), hal.mWakeups);
+    RecordProperty("resultsPerSecond", static_cast<int>(resultsPerSecond));
+    RecordProperty("callbackLatencyP50Us", static_cast<int>(ns2us(p50)));
+    RecordProperty("callbackLatencyP99Us", static_cast<int>(ns2us(p99)));
+}
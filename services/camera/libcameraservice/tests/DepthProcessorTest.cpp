@@ -17,10 +17,14 @@
 #define LOG_NDEBUG 0
 #define LOG_TAG "DepthProcessorTest"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <math.h>
 #include <random>
 
 #include <gtest/gtest.h>
+#include <utils/Log.h>
 
 #include "../common/DepthPhotoProcessor.h"
 #include "../utils/ExifUtils.h"
@@ -77,6 +81,155 @@ void generateDepth16Buffer(std::array<uint16_t, kTestBufferDepthSize> *depth16Bu
     }
 }
 
+// Depth samples with a range in [kMinRange, kMaxRange] mm, and a few zero range samples with
+// low confidence, so that near and far are well defined.
+void generateValidDepth16Buffer(std::array<uint16_t, kTestBufferDepthSize> *depth16Buffer /*out*/) {
+    ASSERT_NE(depth16Buffer, nullptr);
+    const int kMinRange = 100;
+    const int kMaxRange = 8000;
+    std::default_random_engine gen(kSeed+2);
+    std::uniform_int_distribution<int> rangeDist(kMinRange, kMaxRange);
+    std::uniform_int_distribution<int> confidenceDist(0, 7);
+    for (size_t i = 0; i < depth16Buffer->size(); i++) {
+        int confidence = confidenceDist(gen);
+        int range = (i % 97 == 0) ? 0 : rangeDist(gen);
+        if (range == 0) {
+            confidence = 1;
+        }
+        (*depth16Buffer)[i] = static_cast<uint16_t>((confidence << 13) | range);
+    }
+}
+
+// Straightforward per-sample version of quantizeDepthMap(), used as the reference.
+void referenceQuantizeDepthMap(const DepthPhotoInputFrame &inputFrame, bool applyOrientation,
+        std::vector<uint8_t> *depth /*out*/, std::vector<uint8_t> *confidence /*out*/,
+        float *near /*out*/, float *far /*out*/) {
+    const float kConfidenceThreshold = .15f;
+    size_t width = inputFrame.mDepthMapWidth;
+    size_t height = inputFrame.mDepthMapHeight;
+    auto orientation = applyOrientation ? inputFrame.mOrientation :
+            DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES;
+    std::vector<uint16_t> samples;
+    for (size_t i = 0; i < width * height; i++) {
+        size_t row, col;
+        switch (orientation) {
+            case DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES:
+                row = height - 1 - i % height; col = i / height; break;
+            case DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES:
+                row = height - 1 - i / width; col = width - 1 - i % width; break;
+            case DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES:
+                row = i % height; col = width - 1 - i / height; break;
+            default:
+                row = i / width; col = i % width; break;
+        }
+        samples.push_back(inputFrame.mDepthMapBuffer[row * inputFrame.mDepthMapStride + col]);
+    }
+
+    std::vector<float> points, confidences;
+    *near = UINT16_MAX;
+    *far = .0f;
+    for (auto sample : samples) {
+        float point = static_cast<float>(sample & 0x1FFF) / 1000.f;
+        int level = (sample >> 13) & 0x7;
+        float normConfidence = (level == 0) ? 1.f : (static_cast<float>(level) - 1) / 7.f;
+        points.push_back(point);
+        confidences.push_back(normConfidence);
+        if (normConfidence >= kConfidenceThreshold) {
+            *near = std::min(*near, point);
+            *far = std::max(*far, point);
+        }
+    }
+    depth->clear();
+    confidence->clear();
+    for (size_t i = 0; i < points.size(); i++) {
+        float point = points[i];
+        if (confidences[i] < kConfidenceThreshold) {
+            point = std::clamp(point, *near, *far);
+        }
+        float value = floorf(((*far * (point - *near)) / (point * (*far - *near))) * 255.0f);
+        depth->push_back(static_cast<uint8_t>(std::min(255.f, std::max(0.f, value))));
+        confidence->push_back(static_cast<uint8_t>(floorf(confidences[i] * 255.0f)));
+    }
+}
+
+TEST(DepthProcessorTest, QuantizeDepthMap) {
+    std::array<uint16_t, kTestBufferDepthSize> depth16Buffer;
+    generateValidDepth16Buffer(&depth16Buffer);
+
+    DepthPhotoOrientation depthOrientations[] = {
+            DepthPhotoOrientation::DEPTH_ORIENTATION_0_DEGREES,
+            DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES,
+            DepthPhotoOrientation::DEPTH_ORIENTATION_180_DEGREES,
+            DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES };
+    for (auto depthOrientation : depthOrientations) {
+        for (bool applyOrientation : {false, true}) {
+            DepthPhotoInputFrame inputFrame;
+            inputFrame.mDepthMapBuffer = depth16Buffer.data();
+            // Use a stride past the width, to make sure the padding is skipped.
+            inputFrame.mDepthMapWidth = kTestBufferWidth - 16;
+            inputFrame.mDepthMapStride = kTestBufferWidth;
+            inputFrame.mDepthMapHeight = kTestBufferHeight;
+            inputFrame.mOrientation = depthOrientation;
+
+            size_t pointCount = inputFrame.mDepthMapWidth * inputFrame.mDepthMapHeight;
+            std::vector<uint8_t> depth(pointCount), confidence(pointCount);
+            float near, far;
+            bool switchDimensions;
+            ASSERT_EQ(quantizeDepthMap(inputFrame, applyOrientation, depth.data(),
+                    confidence.data(), &near, &far, &switchDimensions), OK);
+            ASSERT_EQ(switchDimensions, applyOrientation &&
+                    ((depthOrientation == DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES) ||
+                    (depthOrientation == DepthPhotoOrientation::DEPTH_ORIENTATION_270_DEGREES)));
+
+            std::vector<uint8_t> expectedDepth, expectedConfidence;
+            float expectedNear, expectedFar;
+            referenceQuantizeDepthMap(inputFrame, applyOrientation, &expectedDepth,
+                    &expectedConfidence, &expectedNear, &expectedFar);
+            ASSERT_EQ(near, expectedNear);
+            ASSERT_EQ(far, expectedFar);
+            ASSERT_EQ(depth, expectedDepth);
+            ASSERT_EQ(confidence, expectedConfidence);
+        }
+    }
+}
+
+TEST(DepthProcessorTest, QuantizeDepthMapLatency) {
+    const int kIterations = 20;
+    std::array<uint16_t, kTestBufferDepthSize> depth16Buffer;
+    generateValidDepth16Buffer(&depth16Buffer);
+
+    DepthPhotoInputFrame inputFrame;
+    inputFrame.mDepthMapBuffer = depth16Buffer.data();
+    inputFrame.mDepthMapWidth = inputFrame.mDepthMapStride = kTestBufferWidth;
+    inputFrame.mDepthMapHeight = kTestBufferHeight;
+    inputFrame.mOrientation = DepthPhotoOrientation::DEPTH_ORIENTATION_90_DEGREES;
+
+    std::vector<uint8_t> depth(kTestBufferDepthSize), confidence(kTestBufferDepthSize);
+    float near, far;
+    bool switchDimensions;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        ASSERT_EQ(quantizeDepthMap(inputFrame, /*applyOrientation*/ true, depth.data(),
+                confidence.data(), &near, &far, &switchDimensions), OK);
+    }
+    auto quantizeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count() / kIterations;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        referenceQuantizeDepthMap(inputFrame, /*applyOrientation*/ true, &depth, &confidence,
+                &near, &far);
+    }
+    auto referenceUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count() / kIterations;
+
+    ALOGI("%s: %zux%zu depth map: %lld us, per sample reference: %lld us", __FUNCTION__,
+            kTestBufferWidth, kTestBufferHeight, static_cast<long long>(quantizeUs),
+            static_cast<long long>(referenceUs));
+    RecordProperty("quantizeUs", static_cast<int>(quantizeUs));
+    RecordProperty("referenceUs", static_cast<int>(referenceUs));
+}
+
 TEST(DepthProcessorTest, BadInput) {
     int jpegQuality = 95;
 
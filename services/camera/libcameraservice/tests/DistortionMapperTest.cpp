@@ -374,3 +374,123 @@ TEST(DistortionMapperTest, CompareToOpenCV) {
                 << expCoords[i] << ", " << expCoords[i + 1] << ")";
     }
 }
+
+// Switching back to a previous calibration must give the same mapping as before, whether the
+// grids are rebuilt or reused
+TEST(DistortionMapperTest, CalibrationChanges) {
+    status_t res;
+
+    int32_t *activeArray = testActiveArray;
+    float *intrinsics = testICal;
+    float distortionA[] = {0.1, -0.003, 0.004, 0.02, 0.01};
+    float distortionB[] = {0.05, -0.002, 0.002, 0.01, 0.005};
+
+    DistortionMapper m, mB;
+    setupTestMapper(&m, distortionA, intrinsics, activeArray, testPreCorrActiveArray);
+    setupTestMapper(&mB, distortionB, intrinsics, activeArray, testPreCorrActiveArray);
+
+    std::default_random_engine gen(1234);
+    std::uniform_int_distribution<int> x_dist(0, activeArray[2] - 1);
+    std::uniform_int_distribution<int> y_dist(0, activeArray[3] - 1);
+    std::vector<int32_t> coords(1000 * 2);
+    for (size_t i = 0; i < coords.size(); i += 2) {
+        coords[i] = x_dist(gen);
+        coords[i + 1] = y_dist(gen);
+    }
+
+    auto mappedA = coords;
+    res = m.mapRawToCorrected(mappedA.data(), mappedA.size() / 2, /*clamp*/false,
+            /*simple*/false);
+    ASSERT_EQ(res, OK);
+
+    CameraMetadata result;
+    result.update(ANDROID_LENS_INTRINSIC_CALIBRATION, intrinsics, 5);
+    for (int i = 0; i < 3; i++) {
+        result.update(ANDROID_LENS_DISTORTION, distortionB, 5);
+        ASSERT_EQ(m.updateCalibration(result), OK);
+
+        auto mapped = coords;
+        res = m.mapRawToCorrected(mapped.data(), mapped.size() / 2, /*clamp*/false,
+                /*simple*/false);
+        ASSERT_EQ(res, OK);
+        auto expected = coords;
+        res = mB.mapRawToCorrected(expected.data(), expected.size() / 2, /*clamp*/false,
+                /*simple*/false);
+        ASSERT_EQ(res, OK);
+        EXPECT_EQ(mapped, expected);
+
+        result.update(ANDROID_LENS_DISTORTION, distortionA, 5);
+        ASSERT_EQ(m.updateCalibration(result), OK);
+
+        mapped = coords;
+        res = m.mapRawToCorrected(mapped.data(), mapped.size() / 2, /*clamp*/false,
+                /*simple*/false);
+        ASSERT_EQ(res, OK);
+        EXPECT_EQ(mapped, mappedA);
+    }
+
+    // A copy maps the same way as the original
+    DistortionMapper copy(m);
+    auto mapped = coords;
+    res = copy.mapRawToCorrected(mapped.data(), mapped.size() / 2, /*clamp*/false,
+            /*simple*/false);
+    ASSERT_EQ(res, OK);
+    EXPECT_EQ(mapped, mappedA);
+}
+
+// Throughput of the full mapping in both directions, in the pattern of capture results: a
+// few points at a time, with the calibration alternating between two values
+TEST(DistortionMapperTest, Throughput) {
+    int32_t *activeArray = testActiveArray;
+    float *intrinsics = testICal;
+    float distortionA[] = {0.1, -0.003, 0.004, 0.02, 0.01};
+    float distortionB[] = {0.1, -0.003, 0.004, 0.02, 0.0101};
+
+    DistortionMapper m;
+    setupTestMapper(&m, distortionA, intrinsics, activeArray, testPreCorrActiveArray);
+
+    const size_t coordCount = 1e5;
+    std::default_random_engine gen(1234);
+    std::uniform_int_distribution<int> x_dist(0, activeArray[2] - 1);
+    std::uniform_int_distribution<int> y_dist(0, activeArray[3] - 1);
+    std::vector<int32_t> coords(coordCount * 2);
+    for (size_t i = 0; i < coords.size(); i += 2) {
+        coords[i] = x_dist(gen);
+        coords[i + 1] = y_dist(gen);
+    }
+
+    auto perCoordUs = [](std::chrono::milliseconds duration, size_t count) {
+        return (std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+                duration) / count).count();
+    };
+
+    auto mapped = coords;
+    base::Timer correctedToRawTimer;
+    ASSERT_EQ(m.mapCorrectedToRaw(mapped.data(), coordCount, /*clamp*/false, /*simple*/false),
+            OK);
+    RecordProperty("CorrectedToRawDurationPerCoordUs", base::StringPrintf("%f",
+            perCoordUs(correctedToRawTimer.duration(), coordCount)));
+
+    mapped = coords;
+    base::Timer rawToCorrectedTimer;
+    ASSERT_EQ(m.mapRawToCorrected(mapped.data(), coordCount, /*clamp*/false, /*simple*/false),
+            OK);
+    RecordProperty("RawToCorrectedDurationPerCoordUs", base::StringPrintf("%f",
+            perCoordUs(rawToCorrectedTimer.duration(), coordCount)));
+
+    // Each result maps a crop region and a few metering regions and faces
+    constexpr size_t kPointsPerResult = 16;
+    constexpr size_t kResults = 1000;
+    CameraMetadata result;
+    result.update(ANDROID_LENS_INTRINSIC_CALIBRATION, intrinsics, 5);
+    mapped = coords;
+    base::Timer resultsTimer;
+    for (size_t i = 0; i < kResults; i++) {
+        result.update(ANDROID_LENS_DISTORTION, (i % 2) ? distortionB : distortionA, 5);
+        ASSERT_EQ(m.updateCalibration(result), OK);
+        ASSERT_EQ(m.mapRawToCorrected(mapped.data() + i * kPointsPerResult * 2,
+                kPointsPerResult, /*clamp*/false, /*simple*/false), OK);
+    }
+    RecordProperty("AlternatingCalibrationDurationPerResultUs", base::StringPrintf("%f",
+            perCoordUs(resultsTimer.duration(), kResults)));
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "PipelineLatencyTest"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../utils/PipelineLatency.h"
+
+using namespace android;
+
+TEST(PipelineLatencyTest, BinsAreContiguous) {
+    // Every bin starts where the previous one ends, and each value lands in the bin
+    // whose range contains it.
+    for (size_t i = 1; i < CameraStageHistogram::kBinCount; i++) {
+        int64_t lower = CameraStageHistogram::binLowerBoundUs(i);
+        EXPECT_GT(lower, CameraStageHistogram::binLowerBoundUs(i - 1));
+        EXPECT_EQ(i, CameraStageHistogram::binIndex(lower));
+        EXPECT_EQ(i - 1, CameraStageHistogram::binIndex(lower - 1));
+    }
+    EXPECT_EQ(0u, CameraStageHistogram::binIndex(-5));
+    EXPECT_EQ(CameraStageHistogram::kBinCount - 1,
+            CameraStageHistogram::binIndex(INT64_MAX));
+}
+
+TEST(PipelineLatencyTest, Percentiles) {
+    CameraStageHistogram histogram;
+    EXPECT_EQ(0, histogram.percentileUs(50));
+
+    // 1..1000 us; the log-linear bins are within 25% of the true value.
+    for (int us = 1; us <= 1000; us++) {
+        histogram.add(us2ns(us));
+    }
+    EXPECT_EQ(1000u, histogram.count());
+    EXPECT_EQ(500, histogram.meanUs());
+    EXPECT_EQ(1000, histogram.maxUs());
+    EXPECT_NEAR(500, histogram.percentileUs(50), 125);
+    EXPECT_NEAR(990, histogram.percentileUs(99), 250);
+
+    histogram.reset();
+    EXPECT_EQ(0u, histogram.count());
+    EXPECT_EQ(0, histogram.maxUs());
+}
+
+TEST(PipelineLatencyTest, RequestTypes) {
+    EXPECT_EQ(CameraPipelineLatency::REQUEST_REGULAR,
+            CameraPipelineLatency::getRequestType(false, false, true));
+    EXPECT_EQ(CameraPipelineLatency::REQUEST_STILL,
+            CameraPipelineLatency::getRequestType(false, true, false));
+    EXPECT_EQ(CameraPipelineLatency::REQUEST_ZSL,
+            CameraPipelineLatency::getRequestType(false, true, true));
+    EXPECT_EQ(CameraPipelineLatency::REQUEST_REPROCESS,
+            CameraPipelineLatency::getRequestType(true, true, false));
+}
+
+TEST(PipelineLatencyTest, ConcurrentStreams) {
+    // More streams than slots, each added from its own thread
+    const int kStreams = CameraPipelineLatency::kMaxStreams + 4;
+    const int kSamples = 1000;
+    CameraPipelineLatency latency;
+
+    std::vector<std::thread> threads;
+    for (int stream = 0; stream < kStreams; stream++) {
+        threads.emplace_back([&latency, stream]() {
+            for (int i = 0; i < kSamples; i++) {
+                latency.addBufferReturn(stream, ms2ns(stream + 1));
+                latency.add(CameraPipelineLatency::STAGE_SHUTTER,
+                        CameraPipelineLatency::REQUEST_REGULAR, ms2ns(1));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The first kMaxStreams streams get a line each, the rest are only counted.
+    FILE* f = tmpfile();
+    ASSERT_NE(nullptr, f);
+    latency.dump(fileno(f), "Capture pipeline latency:");
+    fseek(f, 0, SEEK_SET);
+    char line[256];
+    int streamLines = 0;
+    int droppedLines = 0;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        if (strstr(line, "buffer") != nullptr && strstr(line, "stream ") != nullptr) {
+            streamLines++;
+        }
+        if (strstr(line, "buffer samples from streams past") != nullptr) {
+            droppedLines++;
+        }
+    }
+    fclose(f);
+    EXPECT_EQ(static_cast<int>(CameraPipelineLatency::kMaxStreams), streamLines);
+    EXPECT_EQ(1, droppedLines);
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "RingBufferConsumerTest"
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <gui/BufferQueue.h>
+#include <gui/Surface.h>
+#include <hardware/gralloc.h>
+#include <system/window.h>
+
+#include "../gui/RingBufferConsumer.h"
+
+using namespace android;
+
+typedef RingBufferConsumer::PinnedBufferItem PinnedBufferItem;
+
+namespace {
+
+const int kBufferCount = 4;
+
+// Records the timestamps of the ring buffer in the order pinSelectedBuffer visits them,
+// which is the order of the circular array from its head, without selecting any.
+struct RecordingComparator : public RingBufferConsumer::RingBufferComparator {
+    mutable std::vector<int64_t> timestamps;
+    mutable std::vector<bool> pinned;
+
+    int compare(const RingBufferConsumer::BufferInfo* /*i1*/,
+                const RingBufferConsumer::BufferInfo* i2) const override {
+        timestamps.push_back(i2->mTimestamp);
+        pinned.push_back(i2->mPinned);
+        return 0;
+    }
+};
+
+class RingBufferConsumerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&producer, &consumer);
+        mRingBuffer = new RingBufferConsumer(consumer, GRALLOC_USAGE_SW_READ_OFTEN,
+                kBufferCount);
+        mRingBuffer->setName(String8("RingBufferConsumerTest"));
+        ASSERT_EQ(OK, mRingBuffer->setDefaultBufferSize(16, 16));
+        ASSERT_EQ(OK, mRingBuffer->setDefaultBufferFormat(HAL_PIXEL_FORMAT_RGBA_8888));
+
+        mSurface = new Surface(producer);
+        mWindow = mSurface.get();
+        ASSERT_EQ(OK, native_window_api_connect(mWindow, NATIVE_WINDOW_API_CPU));
+    }
+
+    void TearDown() override {
+        native_window_api_disconnect(mWindow, NATIVE_WINDOW_API_CPU);
+        mRingBuffer->abandon();
+    }
+
+    // The ring buffer acquires the frame, and drops its oldest unpinned one if full,
+    // before queueBuffer returns.
+    void queueFrame(int64_t timestamp) {
+        ASSERT_EQ(OK, native_window_set_buffers_timestamp(mWindow, timestamp));
+        ANativeWindowBuffer* buffer;
+        int fenceFd;
+        ASSERT_EQ(OK, mWindow->dequeueBuffer(mWindow, &buffer, &fenceFd));
+        ASSERT_EQ(OK, mWindow->queueBuffer(mWindow, buffer, fenceFd));
+    }
+
+    std::vector<int64_t> timestamps() {
+        RecordingComparator recorder;
+        EXPECT_EQ(nullptr, mRingBuffer->pinSelectedBuffer(recorder, false).get());
+        return recorder.timestamps;
+    }
+
+    std::vector<bool> pinned() {
+        RecordingComparator recorder;
+        mRingBuffer->pinSelectedBuffer(recorder, false);
+        return recorder.pinned;
+    }
+
+    sp<PinnedBufferItem> pin(int64_t timestamp) {
+        return mRingBuffer->pinBufferByTimestamp(timestamp, false);
+    }
+
+    sp<RingBufferConsumer> mRingBuffer;
+    sp<Surface> mSurface;
+    ANativeWindow* mWindow;
+};
+
+} // namespace
+
+TEST_F(RingBufferConsumerTest, WrapsAroundAtCapacity) {
+    EXPECT_TRUE(timestamps().empty());
+    EXPECT_EQ(0, mRingBuffer->getLatestTimestamp());
+
+    // Twice around the circular array, plus one.
+    for (int64_t i = 1; i <= 2 * kBufferCount + 1; i++) {
+        queueFrame(i * 10);
+        std::vector<int64_t> expected;
+        for (int64_t j = std::max<int64_t>(1, i - kBufferCount + 1); j <= i; j++) {
+            expected.push_back(j * 10);
+        }
+        EXPECT_EQ(expected, timestamps()) << "after frame " << i;
+        EXPECT_EQ(i * 10, mRingBuffer->getLatestTimestamp());
+    }
+}
+
+TEST_F(RingBufferConsumerTest, ErasesAtHead) {
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    queueFrame(50);
+    EXPECT_EQ((std::vector<int64_t>{20, 30, 40, 50}), timestamps());
+}
+
+// With the oldest buffer pinned, the next one is dropped, closing the gap from the head.
+TEST_F(RingBufferConsumerTest, ErasesInFirstHalf) {
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    sp<PinnedBufferItem> pinned10 = pin(10);
+    ASSERT_NE(nullptr, pinned10.get());
+    queueFrame(50);
+    EXPECT_EQ((std::vector<int64_t>{10, 30, 40, 50}), timestamps());
+    EXPECT_EQ((std::vector<bool>{true, false, false, false}), pinned());
+    EXPECT_EQ(10, pinned10->getBufferItem().mTimestamp);
+
+    // Unpinning finds the buffer at its new position, so it is dropped next.
+    pinned10.clear();
+    EXPECT_EQ((std::vector<bool>{false, false, false, false}), pinned());
+    queueFrame(60);
+    EXPECT_EQ((std::vector<int64_t>{30, 40, 50, 60}), timestamps());
+}
+
+// With the two oldest buffers pinned, the third one is dropped, closing the gap from the tail.
+TEST_F(RingBufferConsumerTest, ErasesInSecondHalf) {
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    sp<PinnedBufferItem> pinned10 = pin(10);
+    sp<PinnedBufferItem> pinned20 = pin(20);
+    queueFrame(50);
+    EXPECT_EQ((std::vector<int64_t>{10, 20, 40, 50}), timestamps());
+    EXPECT_EQ((std::vector<bool>{true, true, false, false}), pinned());
+
+    pinned20.clear();
+    EXPECT_EQ((std::vector<bool>{true, false, false, false}), pinned());
+    queueFrame(60);
+    EXPECT_EQ((std::vector<int64_t>{10, 40, 50, 60}), timestamps());
+}
+
+TEST_F(RingBufferConsumerTest, ErasesAtTail) {
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    sp<PinnedBufferItem> pinned10 = pin(10);
+    sp<PinnedBufferItem> pinned20 = pin(20);
+    sp<PinnedBufferItem> pinned30 = pin(30);
+    queueFrame(50);
+    EXPECT_EQ((std::vector<int64_t>{10, 20, 30, 50}), timestamps());
+    queueFrame(60);
+    EXPECT_EQ((std::vector<int64_t>{10, 20, 30, 60}), timestamps());
+    EXPECT_EQ((std::vector<bool>{true, true, true, false}), pinned());
+
+    pinned10.clear();
+    pinned20.clear();
+    pinned30.clear();
+    queueFrame(70);
+    EXPECT_EQ((std::vector<int64_t>{20, 30, 60, 70}), timestamps());
+}
+
+// clear() keeps the pinned buffers, in order, at the front of the ring buffer.
+TEST_F(RingBufferConsumerTest, ClearKeepsPinnedBuffers) {
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    queueFrame(50);  // the head is no longer at the start of the array
+    sp<PinnedBufferItem> pinned30 = pin(30);
+    sp<PinnedBufferItem> pinned50 = pin(50);
+    EXPECT_EQ(OK, mRingBuffer->clear());
+    EXPECT_EQ((std::vector<int64_t>{30, 50}), timestamps());
+
+    queueFrame(60);
+    queueFrame(70);
+    EXPECT_EQ((std::vector<int64_t>{30, 50, 60, 70}), timestamps());
+    pinned30.clear();
+    queueFrame(80);
+    EXPECT_EQ((std::vector<int64_t>{50, 60, 70, 80}), timestamps());
+}
+
+// A frame older than the newest one is inserted at its place in timestamp order, so it is
+// dropped before the newer ones.
+TEST_F(RingBufferConsumerTest, ReinsertsOutOfOrderTimestamp) {
+    for (int64_t t : {10, 20, 40}) queueFrame(t);
+    queueFrame(30);
+    EXPECT_EQ((std::vector<int64_t>{10, 20, 30, 40}), timestamps());
+
+    // Also when the ring buffer is full and has wrapped around.
+    queueFrame(50);
+    queueFrame(15);
+    EXPECT_EQ((std::vector<int64_t>{15, 30, 40, 50}), timestamps());
+    queueFrame(60);
+    EXPECT_EQ((std::vector<int64_t>{30, 40, 50, 60}), timestamps());
+
+    // The oldest of all goes to the head.
+    queueFrame(5);
+    EXPECT_EQ((std::vector<int64_t>{5, 40, 50, 60}), timestamps());
+
+    sp<PinnedBufferItem> pinned40 = pin(40);
+    ASSERT_NE(nullptr, pinned40.get());
+    EXPECT_EQ(40, pinned40->getBufferItem().mTimestamp);
+}
+
+// The match priority ZslProcessor relies on: the exact timestamp, else the closest
+// earlier one, else the closest later one.
+TEST_F(RingBufferConsumerTest, PinBufferByTimestamp) {
+    EXPECT_EQ(nullptr, pin(10).get());
+
+    for (int64_t t : {10, 20, 30, 40}) queueFrame(t);
+    queueFrame(50);  // wrapped around: 20, 30, 40, 50
+
+    struct {
+        int64_t needle;
+        int64_t expected;
+    } cases[] = {
+        {30, 30},  // exact
+        {20, 20},  // exact, at the head
+        {50, 50},  // exact, at the tail
+        {35, 30},  // closest earlier
+        {49, 40},
+        {100, 50}, // later than all of them
+        {15, 20},  // earlier than all of them: closest later
+        {0, 20},
+    };
+    for (const auto& c : cases) {
+        sp<PinnedBufferItem> pinned = pin(c.needle);
+        ASSERT_NE(nullptr, pinned.get()) << "needle " << c.needle;
+        EXPECT_EQ(c.expected, pinned->getBufferItem().mTimestamp) << "needle " << c.needle;
+    }
+
+    // All of the pins above were released, so none of them holds a buffer back.
+    EXPECT_EQ((std::vector<bool>{false, false, false, false}), pinned());
+}
+
+TEST_F(RingBufferConsumerTest, PinBufferByTimestampPinsSameBufferTwice) {
+    for (int64_t t : {10, 20, 30}) queueFrame(t);
+    sp<PinnedBufferItem> first = pin(20);
+    sp<PinnedBufferItem> second = pin(25);
+    ASSERT_NE(nullptr, first.get());
+    ASSERT_NE(nullptr, second.get());
+    EXPECT_EQ(first->getBufferItem().mGraphicBuffer, second->getBufferItem().mGraphicBuffer);
+
+    first.clear();
+    EXPECT_EQ((std::vector<bool>{false, true, false}), pinned());
+    second.clear();
+    EXPECT_EQ((std::vector<bool>{false, false, false}), pinned());
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraPipelineLatency"
+#include <inttypes.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+#include <media/MediaMetricsItem.h>
+#include <utils/Log.h>
+
+#include "PipelineLatency.h"
+
+namespace android {
+
+static constexpr char kPipelineMetricsKey[] = "camera.pipeline";
+
+CameraStageHistogram::CameraStageHistogram() {
+    reset();
+}
+
+size_t CameraStageHistogram::binIndex(int64_t us) {
+    if (us < static_cast<int64_t>(kSubBins)) {
+        return us < 0 ? 0 : static_cast<size_t>(us);
+    }
+    // For an octave [2^o, 2^(o+1)), the top two bits below the leading one select the bin.
+    int octave = 63 - __builtin_clzll(static_cast<uint64_t>(us));
+    size_t index = (octave - 1) * kSubBins + ((us >> (octave - 2)) & (kSubBins - 1));
+    return index < kBinCount ? index : kBinCount - 1;
+}
+
+int64_t CameraStageHistogram::binLowerBoundUs(size_t index) {
+    if (index < kSubBins) {
+        return index;
+    }
+    int octave = index / kSubBins + 1;
+    return static_cast<int64_t>(kSubBins + index % kSubBins) << (octave - 2);
+}
+
+void CameraStageHistogram::add(nsecs_t duration) {
+    int64_t us = ns2us(duration);
+    if (us < 0) us = 0;
+    mBins[binIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSumUs.fetch_add(us, std::memory_order_relaxed);
+    int64_t max = mMaxUs.load(std::memory_order_relaxed);
+    while (us > max &&
+            !mMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+void CameraStageHistogram::reset() {
+    for (auto& bin : mBins) {
+        bin.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mSumUs.store(0, std::memory_order_relaxed);
+    mMaxUs.store(0, std::memory_order_relaxed);
+}
+
+uint64_t CameraStageHistogram::count() const {
+    return mCount.load(std::memory_order_relaxed);
+}
+
+int64_t CameraStageHistogram::percentileUs(double percentile) const {
+    // Sum the bins rather than using mCount, since a concurrent add() may have updated one
+    // but not yet the other.
+    uint64_t bins[kBinCount];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBinCount; i++) {
+        bins[i] = mBins[i].load(std::memory_order_relaxed);
+        total += bins[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(total * percentile / 100.0);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBinCount - 1; i++) {
+        seen += bins[i];
+        if (seen > target) {
+            return binLowerBoundUs(i + 1);
+        }
+    }
+    return maxUs();
+}
+
+int64_t CameraStageHistogram::meanUs() const {
+    uint64_t n = count();
+    return n == 0 ? 0 : mSumUs.load(std::memory_order_relaxed) / static_cast<int64_t>(n);
+}
+
+int64_t CameraStageHistogram::maxUs() const {
+    return mMaxUs.load(std::memory_order_relaxed);
+}
+
+const char* CameraPipelineLatency::kStageNames[STAGE_COUNT] = {
+    "waitRequest",
+    "prepare",
+    "halSubmit",
+    "shutter",
+    "result",
+};
+
+const char* CameraPipelineLatency::kRequestTypeNames[REQUEST_TYPE_COUNT] = {
+    "regular",
+    "still",
+    "zsl",
+    "reprocess",
+};
+
+CameraPipelineLatency::CameraPipelineLatency() {
+    for (auto& id : mStreamIds) {
+        id.store(kNoStream, std::memory_order_relaxed);
+    }
+}
+
+CameraPipelineLatency::RequestType CameraPipelineLatency::getRequestType(bool hasInput,
+        bool stillCapture, bool zslCapture) {
+    if (hasInput) return REQUEST_REPROCESS;
+    if (stillCapture) return zslCapture ? REQUEST_ZSL : REQUEST_STILL;
+    return REQUEST_REGULAR;
+}
+
+void CameraPipelineLatency::add(Stage stage, RequestType type, nsecs_t duration) {
+    mStages[stage][type].add(duration);
+}
+
+void CameraPipelineLatency::addBufferReturn(int streamId, nsecs_t duration) {
+    for (size_t i = 0; i < kMaxStreams; i++) {
+        int id = mStreamIds[i].load(std::memory_order_acquire);
+        if (id == kNoStream) {
+            // Claim the slot. If another stream got there first, id now holds its id.
+            if (mStreamIds[i].compare_exchange_strong(id, streamId, std::memory_order_acq_rel)) {
+                id = streamId;
+            }
+        }
+        if (id == streamId) {
+            mBufferReturn[i].add(duration);
+            return;
+        }
+    }
+    mDroppedBufferSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CameraPipelineLatency::reset() {
+    for (auto& stage : mStages) {
+        for (auto& histogram : stage) {
+            histogram.reset();
+        }
+    }
+    for (size_t i = 0; i < kMaxStreams; i++) {
+        mBufferReturn[i].reset();
+        mStreamIds[i].store(kNoStream, std::memory_order_release);
+    }
+    mDroppedBufferSamples.store(0, std::memory_order_relaxed);
+}
+
+void CameraPipelineLatency::dump(int fd, const char* name) const {
+    String8 lines;
+    lines.appendFormat("%s\n", name);
+    lines.appendFormat("      %-12s %-10s %8s %8s %8s %8s %8s %8s (us)\n", "stage", "type",
+            "count", "mean", "p50", "p90", "p99", "max");
+    bool empty = true;
+    auto appendHistogram = [&lines, &empty](const char* stage, const char* type,
+            const CameraStageHistogram& histogram) {
+        if (histogram.count() == 0) return;
+        empty = false;
+        lines.appendFormat("      %-12s %-10s %8" PRIu64 " %8" PRId64 " %8" PRId64 " %8" PRId64
+                " %8" PRId64 " %8" PRId64 "\n", stage, type, histogram.count(),
+                histogram.meanUs(), histogram.percentileUs(50), histogram.percentileUs(90),
+                histogram.percentileUs(99), histogram.maxUs());
+    };
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+        for (size_t t = 0; t < REQUEST_TYPE_COUNT; t++) {
+            appendHistogram(kStageNames[s], kRequestTypeNames[t], mStages[s][t]);
+        }
+    }
+    for (size_t i = 0; i < kMaxStreams; i++) {
+        int id = mStreamIds[i].load(std::memory_order_acquire);
+        if (id == kNoStream) break;
+        String8 streamName = String8::format("stream %d", id);
+        appendHistogram("buffer", streamName.string(), mBufferReturn[i]);
+    }
+    if (empty) {
+        lines.append("      None\n");
+    }
+    uint64_t dropped = mDroppedBufferSamples.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+        lines.appendFormat("      %" PRIu64 " buffer samples from streams past the first %zu\n",
+                dropped, kMaxStreams);
+    }
+    write(fd, lines.string(), lines.size());
+}
+
+void CameraPipelineLatency::exportMetrics(const String8& cameraId) const {
+    std::unique_ptr<mediametrics::Item> item(mediametrics::Item::create(kPipelineMetricsKey));
+    item->setCString("cameraId", cameraId.string());
+
+    bool empty = true;
+    auto setHistogram = [&item, &empty](const std::string& prefix,
+            const CameraStageHistogram& histogram) {
+        if (histogram.count() == 0) return;
+        empty = false;
+        item->setInt64((prefix + ".count").c_str(), histogram.count());
+        item->setInt64((prefix + ".meanUs").c_str(), histogram.meanUs());
+        item->setInt64((prefix + ".p50Us").c_str(), histogram.percentileUs(50));
+        item->setInt64((prefix + ".p99Us").c_str(), histogram.percentileUs(99));
+        item->setInt64((prefix + ".maxUs").c_str(), histogram.maxUs());
+    };
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+        for (size_t t = 0; t < REQUEST_TYPE_COUNT; t++) {
+            setHistogram(std::string(kStageNames[s]) + "." + kRequestTypeNames[t],
+                    mStages[s][t]);
+        }
+    }
+    for (size_t i = 0; i < kMaxStreams; i++) {
+        int id = mStreamIds[i].load(std::memory_order_acquire);
+        if (id == kNoStream) break;
+        setHistogram("buffer.stream" + std::to_string(id), mBufferReturn[i]);
+    }
+
+    if (!empty) {
+        item->selfrecord();
+    }
+}
+
+}; //namespace android
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_PIPELINE_LATENCY_H_
+#define ANDROID_SERVERS_CAMERA_PIPELINE_LATENCY_H_
+
+#include <atomic>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// Latency histogram for one stage of the capture pipeline.
+//
+// Unlike CameraLatencyHistogram, the bins are log-linear in microseconds (4 bins per
+// power of two), so that both sub-millisecond stages and multi-second stalls resolve,
+// and all counters are relaxed atomics so that the request thread and the HAL callback
+// threads can add samples without taking a lock.
+class CameraStageHistogram {
+public:
+    CameraStageHistogram();
+
+    void add(nsecs_t duration);
+    void reset();
+
+    uint64_t count() const;
+    // Upper bound of the bin containing the given percentile, in microseconds
+    int64_t percentileUs(double percentile) const;
+    int64_t meanUs() const;
+    int64_t maxUs() const;
+
+    static constexpr size_t kSubBins = 4;
+    static constexpr size_t kBinCount = 104; // up to 2^26 us, ~67 s
+    static size_t binIndex(int64_t us);
+    static int64_t binLowerBoundUs(size_t index);
+private:
+    std::atomic<uint64_t> mBins[kBinCount];
+    std::atomic<uint64_t> mCount;
+    std::atomic<int64_t> mSumUs;
+    std::atomic<int64_t> mMaxUs;
+}; // class CameraStageHistogram
+
+// Per-stage latency statistics of the Camera3Device request pipeline, split by request
+// type, plus the time until each output stream gets its buffer back from the HAL.
+//
+// The request thread stages are measured around the corresponding calls in
+// RequestThread::threadLoop. The result stages are measured from the moment the request
+// was registered as in flight until the HAL callback arrives.
+class CameraPipelineLatency {
+public:
+    enum Stage {
+        STAGE_WAIT_FOR_REQUEST,  // waitForNextRequestBatch
+        STAGE_PREPARE_REQUEST,   // prepareHalRequests
+        STAGE_HAL_SUBMIT,        // processCaptureRequest(s) into the HAL
+        STAGE_SHUTTER,           // until the shutter notification
+        STAGE_RESULT,            // until the final result metadata
+        STAGE_COUNT
+    };
+
+    enum RequestType {
+        REQUEST_REGULAR,
+        REQUEST_STILL,
+        REQUEST_ZSL,
+        REQUEST_REPROCESS,
+        REQUEST_TYPE_COUNT
+    };
+
+    CameraPipelineLatency();
+
+    static RequestType getRequestType(bool hasInput, bool stillCapture, bool zslCapture);
+
+    void add(Stage stage, RequestType type, nsecs_t duration);
+    void addBufferReturn(int streamId, nsecs_t duration);
+    void reset();
+
+    void dump(int fd, const char* name) const;
+    // Report a summary of the non-empty histograms to media.metrics
+    void exportMetrics(const String8& cameraId) const;
+
+    static constexpr size_t kMaxStreams = 16;
+private:
+    static const char* kStageNames[STAGE_COUNT];
+    static const char* kRequestTypeNames[REQUEST_TYPE_COUNT];
+    static constexpr int kNoStream = -1;
+
+    CameraStageHistogram mStages[STAGE_COUNT][REQUEST_TYPE_COUNT];
+
+    // Stream slots are claimed on first use; streams past kMaxStreams are only counted.
+    std::atomic<int> mStreamIds[kMaxStreams];
+    CameraStageHistogram mBufferReturn[kMaxStreams];
+    std::atomic<uint64_t> mDroppedBufferSamples{0};
+}; // class CameraPipelineLatency
+
+}; // namespace android
+
+#endif // ANDROID_SERVERS_CAMERA_PIPELINE_LATENCY_H_
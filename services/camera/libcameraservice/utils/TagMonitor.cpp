@@ -147,14 +147,13 @@ void TagMonitor::monitorSingleMetadata(eventSource source, int64_t frameNumber,
     camera_metadata_ro_entry entry = metadata.find(tag);
     if (lastValues.isEmpty()) {
         lastValues = CameraMetadata(mMonitoredTagList.size());
-        const camera_metadata_t *metaBuffer =
-                lastValues.getAndLock();
-        set_camera_metadata_vendor_id(
-                const_cast<camera_metadata_t *> (metaBuffer), mVendorTagId);
+        camera_metadata_t *metaBuffer = lastValues.getAndLockForUpdate();
+        set_camera_metadata_vendor_id(metaBuffer, mVendorTagId);
         lastValues.unlock(metaBuffer);
     }
 
-    camera_metadata_entry lastEntry = lastValues.find(tag);
+    camera_metadata_ro_entry lastEntry =
+            static_cast<const CameraMetadata&>(lastValues).find(tag);
 
     if (entry.count > 0) {
         bool isDifferent = false;
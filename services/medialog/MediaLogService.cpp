@@ -20,6 +20,7 @@
 #include <sys/mman.h>
 #include <utils/Log.h>
 #include <binder/PermissionCache.h>
+#include <media/nblog/BinaryDump.h>
 #include <media/nblog/Merger.h>
 #include <media/nblog/NBLog.h>
 #include <mediautils/ServiceUtilities.h>
@@ -131,6 +132,23 @@ status_t MediaLogService::dump(int fd, const Vector<String16>& args __unused)
                 }
             }
             mLock.unlock();
+        } else if (!strcmp(arg0.string(), "--binary")) {
+            // raw entries of each writer, for offline analysis with nblog_analyze
+            if (!dumpTryLock(mLock)) {
+                ALOGW("%s", kDeadlockedString);
+                return NO_ERROR;
+            }
+            std::vector<std::unique_ptr<NBLog::Snapshot>> snapshots;
+            NBLog::BinaryDumpWriter writer;
+            for (const auto &dumpReader : mDumpReaders) {
+                snapshots.push_back(dumpReader->getSnapshot(false /*flush*/));
+                const NBLog::Snapshot &snapshot = *snapshots.back();
+                const uint8_t *begin = snapshot.begin();
+                const uint8_t *end = snapshot.end();
+                writer.addSection(dumpReader->name(), begin, end - begin, snapshot.lost());
+            }
+            mLock.unlock();
+            writer.write(fd);
         } else {
             mMergeReader.dump(fd, args);
         }
@@ -21,6 +21,7 @@
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
 #include <cstring>
+#include <audio_utils/primitives.h>
 #include <utils/Trace.h>
 
 #include "AAudioMixer.h"
@@ -33,6 +34,9 @@ using android::WrappingBuffer;
 using android::FifoBuffer;
 using android::fifo_frames_t;
 
+// Same headroom as the ClipToRange stage of the client flowgraph.
+static constexpr float kMaxHeadroom = 1.41253754f; // +3 dB
+
 AAudioMixer::~AAudioMixer() {
     delete[] mOutputBuffer;
 }
@@ -49,7 +53,8 @@ void AAudioMixer::clear() {
     memset(mOutputBuffer, 0, mBufferSizeInBytes);
 }
 
-int32_t AAudioMixer::mix(int streamIndex, FifoBuffer *fifo, bool allowUnderflow) {
+int32_t AAudioMixer::mix(int streamIndex, FifoBuffer *fifo, bool allowUnderflow,
+                         float startGain, float endGain) {
     WrappingBuffer wrappingBuffer;
     float *destination = mOutputBuffer;
 
@@ -80,6 +85,9 @@ int32_t AAudioMixer::mix(int streamIndex, FifoBuffer *fifo, bool allowUnderflow)
     if (!allowUnderflow && fullFrames < framesDesired) {
         framesDesired = fullFrames; // just use what is available then stop
     }
+    const float gainIncrement = (framesDesired > 0)
+            ? (endGain - startGain) / framesDesired
+            : 0.0f;
 
     // Mix data in one or two parts.
     int partIndex = 0;
@@ -92,7 +100,9 @@ int32_t AAudioMixer::mix(int streamIndex, FifoBuffer *fifo, bool allowUnderflow)
                 framesToMixFromPart = framesAvailableFromPart;
             }
             mixPart(destination, (float *)wrappingBuffer.data[partIndex],
-                    framesToMixFromPart);
+                    framesToMixFromPart,
+                    startGain + gainIncrement * (framesDesired - framesLeft),
+                    gainIncrement);
 
             destination += framesToMixFromPart * mSamplesPerFrame;
             framesLeft -= framesToMixFromPart;
@@ -108,12 +118,38 @@ int32_t AAudioMixer::mix(int streamIndex, FifoBuffer *fifo, bool allowUnderflow)
     return (framesDesired - framesLeft); // framesRead
 }
 
-void AAudioMixer::mixPart(float *destination, float *source, int32_t numFrames) {
+void AAudioMixer::mixPart(float *destination, float *source, int32_t numFrames,
+                          float startGain, float gainIncrement) {
+    if (startGain == 1.0f && gainIncrement == 0.0f) {
+        mKernels.accumulate(destination, source, numFrames * mSamplesPerFrame);
+    } else {
+        mKernels.accumulateRamp(destination, source, numFrames, mSamplesPerFrame,
+                                startGain, gainIncrement);
+    }
+}
+
+aaudio_result_t AAudioMixer::convertOutput(void *destination, audio_format_t format,
+                                           int32_t numFrames) {
     int32_t numSamples = numFrames * mSamplesPerFrame;
-    // TODO maybe optimize using SIMD
-    for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++) {
-        *destination++ += *source++;
+    switch (format) {
+        case AUDIO_FORMAT_PCM_FLOAT:
+            mKernels.clamp(mOutputBuffer, numSamples, kMaxHeadroom);
+            if (destination != mOutputBuffer) {
+                memcpy(destination, mOutputBuffer, numSamples * sizeof(float));
+            }
+            break;
+        // The integer conversions saturate at full scale.
+        case AUDIO_FORMAT_PCM_16_BIT:
+            memcpy_to_i16_from_float((int16_t *) destination, mOutputBuffer, numSamples);
+            break;
+        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+            memcpy_to_p24_from_float((uint8_t *) destination, mOutputBuffer, numSamples);
+            break;
+        default:
+            ALOGE("%s() unsupported format = 0x%08x", __func__, format);
+            return AAUDIO_ERROR_UNIMPLEMENTED;
     }
+    return AAUDIO_OK;
 }
 
 float *AAudioMixer::getOutputBuffer() {
@@ -21,6 +21,9 @@
 
 #include <aaudio/AAudio.h>
 #include <fifo/FifoBuffer.h>
+#include <system/audio.h>
+
+#include "AAudioMixerKernels.h"
 
 class AAudioMixer {
 public:
@@ -36,17 +39,34 @@ public:
      * @param streamIndex for marking stream variables in systrace
      * @param fifo to read from
      * @param allowUnderflow if true then allow mixer to advance read index past the write index
+     * @param startGain gain applied to the first frame of the burst
+     * @param endGain gain reached at the end of the burst, ramped linearly from startGain
      * @return frames read from this stream
      */
-    int32_t mix(int streamIndex, android::FifoBuffer *fifo, bool allowUnderflow);
+    int32_t mix(int streamIndex, android::FifoBuffer *fifo, bool allowUnderflow,
+                float startGain = 1.0f, float endGain = 1.0f);
+
+    /**
+     * Clamp the mix and convert it to the format of the endpoint.
+     * The destination may be the output buffer itself, as all the conversions are narrowing.
+     * @param destination buffer with room for numFrames in the given format
+     * @param format AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT
+     *               or AUDIO_FORMAT_PCM_24_BIT_PACKED
+     * @param numFrames no more than getFramesPerBurst()
+     * @return AAUDIO_OK or AAUDIO_ERROR_UNIMPLEMENTED
+     */
+    aaudio_result_t convertOutput(void *destination, audio_format_t format, int32_t numFrames);
 
     float *getOutputBuffer();
 
     int32_t getFramesPerBurst() const { return mFramesPerBurst; }
 
 private:
-    void mixPart(float *destination, float *source, int32_t numFrames);
+    void mixPart(float *destination, float *source, int32_t numFrames,
+                 float startGain, float gainIncrement);
 
+    // Selected once here so the mixer thread does not pay for it.
+    const aaudio::AAudioMixerKernels &mKernels = aaudio::AAudioMixerKernels::get();
     float   *mOutputBuffer = nullptr;
     int32_t  mSamplesPerFrame = 0;
     int32_t  mFramesPerBurst = 0;
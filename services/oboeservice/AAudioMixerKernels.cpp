@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AAUDIO_MIXER_USE_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AAUDIO_MIXER_USE_NEON
+#endif
+
+#include "AAudioMixerKernels.h"
+
+using namespace aaudio;
+
+// ------------------------------------------------------------------------------------------------
+// Portable kernels, also used for the samples left over by the vector kernels.
+
+static void accumulateScalar(float *destination, const float *source, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        destination[i] += source[i];
+    }
+}
+
+static void accumulateRampScalar(float *destination, const float *source,
+                                 int32_t numFrames, int32_t samplesPerFrame,
+                                 float startGain, float gainIncrement) {
+    for (int32_t frame = 0; frame < numFrames; frame++) {
+        const float gain = startGain + gainIncrement * frame;
+        for (int32_t channel = 0; channel < samplesPerFrame; channel++) {
+            *destination++ += *source++ * gain;
+        }
+    }
+}
+
+static void clampScalar(float *buffer, int32_t numSamples, float limit) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        buffer[i] = std::min(std::max(buffer[i], -limit), limit);
+    }
+}
+
+// Finish a ramp that a vector kernel started. sampleIndex must be at a frame boundary.
+static void accumulateRampTail(float *destination, const float *source,
+                               int32_t numFrames, int32_t samplesPerFrame,
+                               float startGain, float gainIncrement, int32_t sampleIndex) {
+    const int32_t frame = sampleIndex / samplesPerFrame;
+    accumulateRampScalar(destination + sampleIndex, source + sampleIndex,
+                         numFrames - frame, samplesPerFrame,
+                         startGain + gainIncrement * frame, gainIncrement);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Vector kernels. The ramp kernels need whole frames in each vector, so they fall back to the
+// scalar kernel for channel counts that do not divide the vector width.
+
+#ifdef AAUDIO_MIXER_USE_X86
+
+static void accumulateSse(float *destination, const float *source, int32_t numSamples) {
+    int32_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_loadu_ps(source + i));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(destination + i + 4), _mm_loadu_ps(source + i + 4));
+        _mm_storeu_ps(destination + i, a);
+        _mm_storeu_ps(destination + i + 4, b);
+    }
+    accumulateScalar(destination + i, source + i, numSamples - i);
+}
+
+static void accumulateRampSse(float *destination, const float *source,
+                              int32_t numFrames, int32_t samplesPerFrame,
+                              float startGain, float gainIncrement) {
+    constexpr int32_t kLanes = 4;
+    if (kLanes % samplesPerFrame != 0) {
+        accumulateRampScalar(destination, source, numFrames, samplesPerFrame,
+                             startGain, gainIncrement);
+        return;
+    }
+    const int32_t numSamples = numFrames * samplesPerFrame;
+    const int32_t framesPerVector = kLanes / samplesPerFrame;
+    float lanes[kLanes];
+    for (int32_t lane = 0; lane < kLanes; lane++) {
+        lanes[lane] = startGain + gainIncrement * (lane / samplesPerFrame);
+    }
+    __m128 gain = _mm_loadu_ps(lanes);
+    const __m128 step = _mm_set1_ps(gainIncrement * framesPerVector);
+    int32_t i = 0;
+    for (; i + kLanes <= numSamples; i += kLanes) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(destination + i),
+                                _mm_mul_ps(_mm_loadu_ps(source + i), gain));
+        _mm_storeu_ps(destination + i, sum);
+        gain = _mm_add_ps(gain, step);
+    }
+    accumulateRampTail(destination, source, numFrames, samplesPerFrame,
+                       startGain, gainIncrement, i);
+}
+
+static void clampSse(float *buffer, int32_t numSamples, float limit) {
+    const __m128 maximum = _mm_set1_ps(limit);
+    const __m128 minimum = _mm_set1_ps(-limit);
+    int32_t i = 0;
+    for (; i + 4 <= numSamples; i += 4) {
+        _mm_storeu_ps(buffer + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(buffer + i), minimum),
+                                             maximum));
+    }
+    clampScalar(buffer + i, numSamples - i, limit);
+}
+
+__attribute__((target("avx2")))
+static void accumulateAvx2(float *destination, const float *source, int32_t numSamples) {
+    int32_t i = 0;
+    for (; i + 16 <= numSamples; i += 16) {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(destination + i),
+                                 _mm256_loadu_ps(source + i));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(destination + i + 8),
+                                 _mm256_loadu_ps(source + i + 8));
+        _mm256_storeu_ps(destination + i, a);
+        _mm256_storeu_ps(destination + i + 8, b);
+    }
+    accumulateScalar(destination + i, source + i, numSamples - i);
+}
+
+__attribute__((target("avx2")))
+static void accumulateRampAvx2(float *destination, const float *source,
+                               int32_t numFrames, int32_t samplesPerFrame,
+                               float startGain, float gainIncrement) {
+    constexpr int32_t kLanes = 8;
+    if (kLanes % samplesPerFrame != 0) {
+        accumulateRampSse(destination, source, numFrames, samplesPerFrame,
+                          startGain, gainIncrement);
+        return;
+    }
+    const int32_t numSamples = numFrames * samplesPerFrame;
+    const int32_t framesPerVector = kLanes / samplesPerFrame;
+    float lanes[kLanes];
+    for (int32_t lane = 0; lane < kLanes; lane++) {
+        lanes[lane] = startGain + gainIncrement * (lane / samplesPerFrame);
+    }
+    __m256 gain = _mm256_loadu_ps(lanes);
+    const __m256 step = _mm256_set1_ps(gainIncrement * framesPerVector);
+    int32_t i = 0;
+    for (; i + kLanes <= numSamples; i += kLanes) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(destination + i),
+                                   _mm256_mul_ps(_mm256_loadu_ps(source + i), gain));
+        _mm256_storeu_ps(destination + i, sum);
+        gain = _mm256_add_ps(gain, step);
+    }
+    accumulateRampTail(destination, source, numFrames, samplesPerFrame,
+                       startGain, gainIncrement, i);
+}
+
+__attribute__((target("avx2")))
+static void clampAvx2(float *buffer, int32_t numSamples, float limit) {
+    const __m256 maximum = _mm256_set1_ps(limit);
+    const __m256 minimum = _mm256_set1_ps(-limit);
+    int32_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        _mm256_storeu_ps(buffer + i,
+                         _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(buffer + i), minimum),
+                                       maximum));
+    }
+    clampScalar(buffer + i, numSamples - i, limit);
+}
+
+static const AAudioMixerKernels sSseKernels = {
+        accumulateSse, accumulateRampSse, clampSse, "sse" };
+static const AAudioMixerKernels sAvx2Kernels = {
+        accumulateAvx2, accumulateRampAvx2, clampAvx2, "avx2" };
+
+#endif // AAUDIO_MIXER_USE_X86
+
+#ifdef AAUDIO_MIXER_USE_NEON
+
+static void accumulateNeon(float *destination, const float *source, int32_t numSamples) {
+    int32_t i = 0;
+    for (; i + 8 <= numSamples; i += 8) {
+        float32x4_t a = vaddq_f32(vld1q_f32(destination + i), vld1q_f32(source + i));
+        float32x4_t b = vaddq_f32(vld1q_f32(destination + i + 4), vld1q_f32(source + i + 4));
+        vst1q_f32(destination + i, a);
+        vst1q_f32(destination + i + 4, b);
+    }
+    accumulateScalar(destination + i, source + i, numSamples - i);
+}
+
+static void accumulateRampNeon(float *destination, const float *source,
+                               int32_t numFrames, int32_t samplesPerFrame,
+                               float startGain, float gainIncrement) {
+    constexpr int32_t kLanes = 4;
+    if (kLanes % samplesPerFrame != 0) {
+        accumulateRampScalar(destination, source, numFrames, samplesPerFrame,
+                             startGain, gainIncrement);
+        return;
+    }
+    const int32_t numSamples = numFrames * samplesPerFrame;
+    const int32_t framesPerVector = kLanes / samplesPerFrame;
+    float lanes[kLanes];
+    for (int32_t lane = 0; lane < kLanes; lane++) {
+        lanes[lane] = startGain + gainIncrement * (lane / samplesPerFrame);
+    }
+    float32x4_t gain = vld1q_f32(lanes);
+    const float32x4_t step = vdupq_n_f32(gainIncrement * framesPerVector);
+    int32_t i = 0;
+    for (; i + kLanes <= numSamples; i += kLanes) {
+        vst1q_f32(destination + i,
+                  vmlaq_f32(vld1q_f32(destination + i), vld1q_f32(source + i), gain));
+        gain = vaddq_f32(gain, step);
+    }
+    accumulateRampTail(destination, source, numFrames, samplesPerFrame,
+                       startGain, gainIncrement, i);
+}
+
+static void clampNeon(float *buffer, int32_t numSamples, float limit) {
+    const float32x4_t maximum = vdupq_n_f32(limit);
+    const float32x4_t minimum = vdupq_n_f32(-limit);
+    int32_t i = 0;
+    for (; i + 4 <= numSamples; i += 4) {
+        vst1q_f32(buffer + i, vminq_f32(vmaxq_f32(vld1q_f32(buffer + i), minimum), maximum));
+    }
+    clampScalar(buffer + i, numSamples - i, limit);
+}
+
+static const AAudioMixerKernels sNeonKernels = {
+        accumulateNeon, accumulateRampNeon, clampNeon, "neon" };
+
+#endif // AAUDIO_MIXER_USE_NEON
+
+static const AAudioMixerKernels sScalarKernels = {
+        accumulateScalar, accumulateRampScalar, clampScalar, "scalar" };
+
+// ------------------------------------------------------------------------------------------------
+
+static const AAudioMixerKernels &selectKernels() {
+#if defined(AAUDIO_MIXER_USE_X86)
+    // SSE2 is part of the x86 and x86_64 Android ABIs; AVX2 is optional.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return sAvx2Kernels;
+    }
+    return sSseKernels;
+#elif defined(AAUDIO_MIXER_USE_NEON)
+    // NEON is required by the arm64-v8a ABI and by every armeabi-v7a device that ships
+    // with a NEON enabled build, so it does not need a run time check.
+    return sNeonKernels;
+#else
+    return sScalarKernels;
+#endif
+}
+
+const AAudioMixerKernels &AAudioMixerKernels::get() {
+    static const AAudioMixerKernels &kernels = selectKernels();
+    return kernels;
+}
+
+const AAudioMixerKernels &AAudioMixerKernels::getScalar() {
+    return sScalarKernels;
+}
+
+std::vector<const AAudioMixerKernels *> AAudioMixerKernels::getSupported() {
+    std::vector<const AAudioMixerKernels *> supported = { &sScalarKernels };
+#if defined(AAUDIO_MIXER_USE_X86)
+    supported.push_back(&sSseKernels);
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        supported.push_back(&sAvx2Kernels);
+    }
+#elif defined(AAUDIO_MIXER_USE_NEON)
+    supported.push_back(&sNeonKernels);
+#endif
+    return supported;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAUDIO_AAUDIO_MIXER_KERNELS_H
+#define AAUDIO_AAUDIO_MIXER_KERNELS_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace aaudio {
+
+/**
+ * Inner loops of the AAudioMixer.
+ *
+ * There is one set of kernels for each supported instruction set. get() selects
+ * the best set for the CPU the first time it is called, so the choice costs
+ * one indirect call per mixed part.
+ *
+ * These have no dependencies on the rest of the service so that they can be
+ * benchmarked on the host.
+ */
+struct AAudioMixerKernels {
+    /**
+     * destination[i] += source[i]
+     */
+    void (*accumulate)(float *destination, const float *source, int32_t numSamples);
+
+    /**
+     * destination[i] += source[i] * gain, where the gain starts at startGain
+     * and increases by gainIncrement after each frame.
+     */
+    void (*accumulateRamp)(float *destination, const float *source,
+                           int32_t numFrames, int32_t samplesPerFrame,
+                           float startGain, float gainIncrement);
+
+    /**
+     * Limit each sample to the range [-limit, limit], in place.
+     */
+    void (*clamp)(float *buffer, int32_t numSamples, float limit);
+
+    const char *name;
+
+    /**
+     * @return the fastest kernels supported by this CPU
+     */
+    static const AAudioMixerKernels &get();
+
+    /**
+     * @return portable kernels, for reference and testing
+     */
+    static const AAudioMixerKernels &getScalar();
+
+    /**
+     * @return every set of kernels this CPU can run, the portable one included, for testing
+     */
+    static std::vector<const AAudioMixerKernels *> getSupported();
+};
+
+} /* namespace aaudio */
+
+#endif //AAUDIO_AAUDIO_MIXER_KERNELS_H
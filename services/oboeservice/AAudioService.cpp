@@ -275,6 +275,15 @@ aaudio_result_t AAudioService::unregisterAudioThread(aaudio_handle_t streamHandl
     return serviceStream->unregisterAudioThread(clientThreadId);
 }
 
+aaudio_result_t AAudioService::setStreamVolume(aaudio_handle_t streamHandle, float volume) {
+    sp<AAudioServiceStreamBase> serviceStream = convertHandleToServiceStream(streamHandle);
+    if (serviceStream.get() == nullptr) {
+        ALOGW("%s(), invalid streamHandle = 0x%0x", __func__, streamHandle);
+        return AAUDIO_ERROR_INVALID_HANDLE;
+    }
+    return serviceStream->setVolume(volume);
+}
+
 aaudio_result_t AAudioService::startClient(aaudio_handle_t streamHandle,
                                            const android::AudioClient& client,
                                            const audio_attributes_t *attr,
@@ -80,6 +80,9 @@ public:
     aaudio_result_t unregisterAudioThread(aaudio::aaudio_handle_t streamHandle,
                                                   pid_t tid) override;
 
+    aaudio_result_t setStreamVolume(aaudio::aaudio_handle_t streamHandle,
+                                    float volume) override;
+
     aaudio_result_t startClient(aaudio::aaudio_handle_t streamHandle,
                                 const android::AudioClient& client,
                                 const audio_attributes_t *attr,
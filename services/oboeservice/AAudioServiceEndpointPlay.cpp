@@ -41,6 +41,9 @@ using namespace aaudio;   // TODO just import names needed
 
 #define BURSTS_PER_BUFFER_DEFAULT   2
 
+// Time for the mixer to apply a full scale change in a stream volume, as in the client.
+static constexpr int32_t kVolumeRampMSec = 10;
+
 AAudioServiceEndpointPlay::AAudioServiceEndpointPlay(AAudioService &audioService)
     : AAudioServiceEndpointShared(
         (AudioStreamInternal *)(new AudioStreamInternalPlay(audioService, true))) {
@@ -51,6 +54,11 @@ aaudio_result_t AAudioServiceEndpointPlay::open(const aaudio::AAudioStreamReques
     if (result == AAUDIO_OK) {
         mMixer.allocate(getStreamInternal()->getSamplesPerFrame(),
                         getStreamInternal()->getFramesPerBurst());
+        // Sample rate is constrained to common values by now and should not overflow.
+        const int32_t rampFrames = kVolumeRampMSec * getStreamInternal()->getSampleRate()
+                / AAUDIO_MILLIS_PER_SECOND;
+        mMaxGainChangePerBurst = std::min(1.0f,
+                (float) getStreamInternal()->getFramesPerBurst() / std::max(1, rampFrames));
 
         int32_t burstsPerBuffer = AAudioProperty_getMixerBursts();
         if (burstsPerBuffer == 0) {
@@ -111,7 +119,14 @@ void *AAudioServiceEndpointPlay::callbackLoop() {
                         int64_t positionOffset = mmapFramesWritten - clientFramesRead;
                         streamShared->setTimestampPositionOffset(positionOffset);
 
-                        int32_t framesMixed = mMixer.mix(index, fifo, allowUnderflow);
+                        // Ramp towards the stream volume, no faster than the client would.
+                        const float startGain = streamShared->getMixerGain();
+                        const float endGain = startGain + std::clamp(
+                                streamShared->getVolume() - startGain,
+                                -mMaxGainChangePerBurst, mMaxGainChangePerBurst);
+                        int32_t framesMixed = mMixer.mix(index, fifo, allowUnderflow,
+                                                         startGain, endGain);
+                        streamShared->setMixerGain(endGain);
 
                         if (streamShared->isFlowing()) {
                             // Consider it an underflow if we got less than a burst
@@ -141,6 +156,13 @@ void *AAudioServiceEndpointPlay::callbackLoop() {
             }
         }
 
+        // Convert the mix in place to the format the stream expects.
+        result = mMixer.convertOutput(mMixer.getOutputBuffer(),
+                                      getStreamInternal()->getFormat(), getFramesPerBurst());
+        if (result != AAUDIO_OK) {
+            break;
+        }
+
         // Write mixer output to stream using a blocking write.
         result = getStreamInternal()->write(mMixer.getOutputBuffer(),
                                             getFramesPerBurst(), timeoutNanos);
@@ -47,6 +47,7 @@ public:
 private:
     bool                     mLatencyTuningEnabled = false; // TODO implement tuning
     AAudioMixer              mMixer;    //
+    float                    mMaxGainChangePerBurst = 1.0f;
 };
 
 } /* namespace aaudio */
@@ -123,6 +123,13 @@ public:
         return AAUDIO_ERROR_UNAVAILABLE;
     }
 
+    /**
+     * Set the volume applied by the mixer. Only shared streams are mixed in the service.
+     */
+    virtual aaudio_result_t setVolume(float volume __unused) {
+        return AAUDIO_ERROR_UNIMPLEMENTED;
+    }
+
     aaudio_result_t registerAudioThread(pid_t clientThreadId, int priority);
 
     aaudio_result_t unregisterAudioThread(pid_t clientThreadId);
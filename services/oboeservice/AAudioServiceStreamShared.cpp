@@ -44,7 +44,8 @@ using namespace aaudio;
 AAudioServiceStreamShared::AAudioServiceStreamShared(AAudioService &audioService)
     : AAudioServiceStreamBase(audioService)
     , mTimestampPositionOffset(0)
-    , mXRunCount(0) {
+    , mXRunCount(0)
+    , mVolume(1.0f) {
 }
 
 std::string AAudioServiceStreamShared::dumpHeader() {
@@ -237,6 +238,16 @@ void AAudioServiceStreamShared::markTransferTime(Timestamp &timestamp) {
     mAtomicStreamTimestamp.write(timestamp);
 }
 
+aaudio_result_t AAudioServiceStreamShared::setVolume(float volume) {
+    // Also rejects NaN.
+    if (!(volume >= 0.0f && volume <= 1.0f)) {
+        ALOGE("%s() illegal volume = %f", __func__, volume);
+        return AAUDIO_ERROR_ILLEGAL_ARGUMENT;
+    }
+    mVolume.store(volume);
+    return AAUDIO_OK;
+}
+
 // Get timestamp that was written by mixer or distributor.
 aaudio_result_t AAudioServiceStreamShared::getFreeRunningPosition(int64_t *positionFrames,
                                                                   int64_t *timeNanos) {
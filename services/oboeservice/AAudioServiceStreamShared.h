@@ -87,6 +87,20 @@ public:
         return mXRunCount.load();
     }
 
+    aaudio_result_t setVolume(float volume) override;
+
+    float getVolume() const {
+        return mVolume.load();
+    }
+
+    /**
+     * The gain the mixer reached at the end of the last burst, on its way to getVolume().
+     * This must only be used by the mixer thread.
+     */
+    float getMixerGain() const { return mMixerGain; }
+
+    void setMixerGain(float gain) { mMixerGain = gain; }
+
     const char *getTypeText() const override { return "Shared"; }
 
 protected:
@@ -112,6 +126,9 @@ private:
     std::atomic<int64_t>     mTimestampPositionOffset;
     std::atomic<int32_t>     mXRunCount;
 
+    std::atomic<float>       mVolume;
+    float                    mMixerGain = 1.0f;
+
 };
 
 } /* namespace aaudio */
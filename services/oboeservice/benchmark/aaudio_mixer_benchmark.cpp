@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures one burst of the shared MMAP mixer: accumulate every stream, at unity gain
+// or ramping its volume, then convert the mix to the endpoint format as
+// AAudioMixer::convertOutput() does.
+//
+// Run on the host with:
+//   aaudio_mixer_benchmark --benchmark_filter=BM_Mix
+// The "scalar" variants use the portable kernels for comparison.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <audio_utils/primitives.h>
+#include <benchmark/benchmark.h>
+
+#include "AAudioMixerKernels.h"
+
+using aaudio::AAudioMixerKernels;
+
+static constexpr int32_t kFramesPerBurst = 192;   // 4 msec at 48000 Hz
+static constexpr int32_t kSamplesPerFrame = 2;
+static constexpr int32_t kSamplesPerBurst = kFramesPerBurst * kSamplesPerFrame;
+
+enum class Gain {
+    UNITY,
+    RAMP,
+};
+
+enum class Output {
+    FLOAT,  // clamped in place
+    I16,
+};
+
+static constexpr float kMaxHeadroom = 1.41253754f; // +3 dB, as in AAudioMixer
+
+static std::vector<std::vector<float>> makeStreams(int32_t numStreams) {
+    std::vector<std::vector<float>> streams(numStreams, std::vector<float>(kSamplesPerBurst));
+    unsigned seed = 42;
+    for (auto &stream : streams) {
+        for (float &sample : stream) {
+            sample = (rand_r(&seed) / (float) RAND_MAX - 0.5f) * 0.25f;
+        }
+    }
+    return streams;
+}
+
+static void mixBurst(const AAudioMixerKernels &kernels, Gain gain,
+                     const std::vector<std::vector<float>> &streams, float *output) {
+    memset(output, 0, kSamplesPerBurst * sizeof(float));
+    for (const auto &stream : streams) {
+        if (gain == Gain::UNITY) {
+            kernels.accumulate(output, stream.data(), kSamplesPerBurst);
+        } else {
+            kernels.accumulateRamp(output, stream.data(), kFramesPerBurst, kSamplesPerFrame,
+                                   0.5f, 0.25f / kFramesPerBurst);
+        }
+    }
+}
+
+static void BM_Mix(benchmark::State& state, bool scalar, Gain gain, Output format) {
+    const AAudioMixerKernels &kernels = scalar
+            ? AAudioMixerKernels::getScalar() : AAudioMixerKernels::get();
+    const int32_t numStreams = state.range(0);
+    const auto streams = makeStreams(numStreams);
+    std::vector<float> output(kSamplesPerBurst);
+
+    for (auto _ : state) {
+        mixBurst(kernels, gain, streams, output.data());
+        if (format == Output::FLOAT) {
+            kernels.clamp(output.data(), kSamplesPerBurst, kMaxHeadroom);
+        } else {
+            memcpy_to_i16_from_float((int16_t *) output.data(), output.data(),
+                                     kSamplesPerBurst);
+        }
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+
+    // Checksum of the last mix, so the variants can be compared for correctness.
+    mixBurst(kernels, gain, streams, output.data());
+    double sum = 0;
+    for (float sample : output) {
+        sum += sample;
+    }
+    state.counters["checksum"] = sum;
+    state.counters["ns_per_frame"] = benchmark::Counter(
+            state.iterations() * kFramesPerBurst,
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.SetLabel(kernels.name);
+}
+
+static void BM_Clamp(benchmark::State& state, bool scalar) {
+    const AAudioMixerKernels &kernels = scalar
+            ? AAudioMixerKernels::getScalar() : AAudioMixerKernels::get();
+    std::vector<float> output(kSamplesPerBurst);
+    for (int32_t i = 0; i < kSamplesPerBurst; i++) {
+        output[i] = (i % 7) * 0.5f - 1.5f;
+    }
+    for (auto _ : state) {
+        kernels.clamp(output.data(), kSamplesPerBurst, kMaxHeadroom);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(kernels.name);
+}
+
+static void StreamCounts(benchmark::internal::Benchmark *b) {
+    for (int numStreams : {1, 2, 4, 8, 16, 32}) {
+        b->Arg(numStreams);
+    }
+}
+
+BENCHMARK_CAPTURE(BM_Mix, unity_float, false, Gain::UNITY, Output::FLOAT)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Mix, unity_float_scalar, true, Gain::UNITY, Output::FLOAT)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Mix, ramp_float, false, Gain::RAMP, Output::FLOAT)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Mix, ramp_float_scalar, true, Gain::RAMP, Output::FLOAT)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Mix, ramp_i16, false, Gain::RAMP, Output::I16)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Mix, ramp_i16_scalar, true, Gain::RAMP, Output::I16)
+        ->Apply(StreamCounts);
+BENCHMARK_CAPTURE(BM_Clamp, vector, false);
+BENCHMARK_CAPTURE(BM_Clamp, scalar, true);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test the AAudioMixer kernels against the portable ones,
+ * and the gain ramp and output conversion of the AAudioMixer.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <audio_utils/primitives.h>
+#include <gtest/gtest.h>
+
+#include "AAudioMixer.h"
+#include "AAudioMixerKernels.h"
+
+using aaudio::AAudioMixerKernels;
+using android::FifoBuffer;
+
+static constexpr float kMaxHeadroom = 1.41253754f; // +3 dB
+
+static std::vector<float> makeSamples(int32_t numSamples, unsigned seed) {
+    std::vector<float> samples(numSamples);
+    for (float &sample : samples) {
+        sample = (rand_r(&seed) / (float) RAND_MAX - 0.5f) * 2.0f;
+    }
+    return samples;
+}
+
+TEST(test_mixer_kernels, selected_kernels_are_supported) {
+    const auto supported = AAudioMixerKernels::getSupported();
+    ASSERT_FALSE(supported.empty());
+    EXPECT_EQ(&AAudioMixerKernels::getScalar(), supported.front());
+    EXPECT_EQ(&AAudioMixerKernels::get(), supported.back());
+}
+
+// Every length up to a few vectors, so that the vector loops and the tails are covered,
+// at every alignment of a vector of 8 floats.
+TEST(test_mixer_kernels, accumulate_matches_scalar) {
+    constexpr int32_t kMaxSamples = 67;
+    constexpr int32_t kMaxOffset = 8;
+    const AAudioMixerKernels &scalar = AAudioMixerKernels::getScalar();
+    const std::vector<float> source = makeSamples(kMaxSamples + kMaxOffset, 1);
+    const std::vector<float> initial = makeSamples(kMaxSamples + kMaxOffset, 2);
+
+    for (const AAudioMixerKernels *kernels : AAudioMixerKernels::getSupported()) {
+        for (int32_t offset = 0; offset < kMaxOffset; offset++) {
+            for (int32_t numSamples = 0; numSamples <= kMaxSamples; numSamples++) {
+                std::vector<float> expected = initial;
+                std::vector<float> actual = initial;
+                scalar.accumulate(&expected[offset], &source[kMaxOffset - 1 - offset],
+                                  numSamples);
+                kernels->accumulate(&actual[offset], &source[kMaxOffset - 1 - offset],
+                                    numSamples);
+                // Also checks that nothing is written outside of the destination.
+                ASSERT_EQ(expected, actual) << kernels->name << ", offset " << offset
+                                            << ", " << numSamples << " samples";
+            }
+        }
+    }
+}
+
+// The vector kernels step the gain by whole vectors, so they may round differently.
+// Channel counts that do not divide a vector take the fallback paths.
+TEST(test_mixer_kernels, accumulate_ramp_matches_scalar) {
+    constexpr int32_t kMaxChannels = 8;
+    constexpr int32_t kMaxFrames = 37;
+    constexpr int32_t kMaxSamples = kMaxChannels * kMaxFrames;
+    constexpr int32_t kGuard = 8;
+    const AAudioMixerKernels &scalar = AAudioMixerKernels::getScalar();
+    const std::vector<float> source = makeSamples(kMaxSamples, 3);
+    const std::vector<float> initial = makeSamples(kMaxSamples + kGuard, 4);
+    const float ramps[][2] = { { 0.0f, 1.0f }, { 1.0f, 0.25f }, { 0.5f, 0.5f } };
+
+    for (const AAudioMixerKernels *kernels : AAudioMixerKernels::getSupported()) {
+        for (int32_t channels = 1; channels <= kMaxChannels; channels++) {
+            for (int32_t numFrames = 0; numFrames <= kMaxFrames; numFrames++) {
+                for (const auto &ramp : ramps) {
+                    const float increment = (ramp[1] - ramp[0]) / kMaxFrames;
+                    std::vector<float> expected = initial;
+                    std::vector<float> actual = initial;
+                    scalar.accumulateRamp(expected.data(), source.data(), numFrames, channels,
+                                          ramp[0], increment);
+                    kernels->accumulateRamp(actual.data(), source.data(), numFrames, channels,
+                                            ramp[0], increment);
+                    for (size_t i = 0; i < actual.size(); i++) {
+                        ASSERT_NEAR(expected[i], actual[i], 1e-5f)
+                                << kernels->name << ", " << channels << " channels, "
+                                << numFrames << " frames, sample " << i;
+                    }
+                    const int32_t numSamples = numFrames * channels;
+                    ASSERT_TRUE(std::equal(actual.begin() + numSamples, actual.end(),
+                                           initial.begin() + numSamples))
+                            << kernels->name << " wrote past the end";
+                }
+            }
+        }
+    }
+}
+
+TEST(test_mixer_kernels, clamp_matches_scalar) {
+    constexpr int32_t kMaxSamples = 67;
+    std::vector<float> initial = makeSamples(kMaxSamples, 5);
+    for (float &sample : initial) {
+        sample *= 2.0f;
+    }
+    initial[3] = kMaxHeadroom;
+    initial[4] = -kMaxHeadroom;
+    const AAudioMixerKernels &scalar = AAudioMixerKernels::getScalar();
+
+    for (const AAudioMixerKernels *kernels : AAudioMixerKernels::getSupported()) {
+        for (int32_t numSamples = 0; numSamples <= kMaxSamples; numSamples++) {
+            std::vector<float> expected = initial;
+            std::vector<float> actual = initial;
+            scalar.clamp(expected.data(), numSamples, kMaxHeadroom);
+            kernels->clamp(actual.data(), numSamples, kMaxHeadroom);
+            ASSERT_EQ(expected, actual) << kernels->name << ", " << numSamples << " samples";
+        }
+    }
+    std::vector<float> clamped = initial;
+    scalar.clamp(clamped.data(), kMaxSamples, kMaxHeadroom);
+    for (size_t i = 0; i < clamped.size(); i++) {
+        EXPECT_LE(std::abs(clamped[i]), kMaxHeadroom);
+        if (std::abs(initial[i]) <= kMaxHeadroom) {
+            EXPECT_EQ(initial[i], clamped[i]);
+        }
+    }
+}
+
+// The ramp continues across the wrap of the FIFO and ends where the next burst starts.
+TEST(test_mixer_kernels, mixer_ramps_gain_across_parts) {
+    constexpr int32_t kChannels = 2;
+    constexpr int32_t kFramesPerBurst = 96;
+    constexpr int32_t kCapacity = 128;
+    AAudioMixer mixer;
+    mixer.allocate(kChannels, kFramesPerBurst);
+    FifoBuffer fifo(kChannels * sizeof(float), kCapacity);
+    const std::vector<float> ones(kChannels * kFramesPerBurst, 1.0f);
+    std::vector<float> discard(kChannels * kFramesPerBurst);
+    ASSERT_EQ(kFramesPerBurst, fifo.write(ones.data(), kFramesPerBurst));
+    ASSERT_EQ(kFramesPerBurst, fifo.read(discard.data(), kFramesPerBurst));
+    ASSERT_EQ(kFramesPerBurst, fifo.write(ones.data(), kFramesPerBurst));
+
+    mixer.clear();
+    ASSERT_EQ(kFramesPerBurst, mixer.mix(0, &fifo, false, 0.25f, 0.75f));
+    const float *output = mixer.getOutputBuffer();
+    for (int32_t frame = 0; frame < kFramesPerBurst; frame++) {
+        const float gain = 0.25f + 0.5f * frame / kFramesPerBurst;
+        for (int32_t channel = 0; channel < kChannels; channel++) {
+            ASSERT_NEAR(gain, output[frame * kChannels + channel], 1e-6f) << "frame " << frame;
+        }
+    }
+}
+
+TEST(test_mixer_kernels, mixer_unity_gain_accumulates) {
+    constexpr int32_t kChannels = 2;
+    constexpr int32_t kFramesPerBurst = 48;
+    AAudioMixer mixer;
+    mixer.allocate(kChannels, kFramesPerBurst);
+    FifoBuffer fifo(kChannels * sizeof(float), 2 * kFramesPerBurst);
+    const std::vector<float> source = makeSamples(kChannels * kFramesPerBurst, 6);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(kFramesPerBurst, fifo.write(source.data(), kFramesPerBurst));
+    }
+
+    mixer.clear();
+    mixer.mix(0, &fifo, false);
+    mixer.mix(1, &fifo, false);
+    const float *output = mixer.getOutputBuffer();
+    for (size_t i = 0; i < source.size(); i++) {
+        ASSERT_EQ(source[i] + source[i], output[i]);
+    }
+}
+
+class MixerConvertOutputTest : public ::testing::Test {
+protected:
+    static constexpr int32_t kChannels = 2;
+    static constexpr int32_t kFramesPerBurst = 33;
+    static constexpr int32_t kSamples = kChannels * kFramesPerBurst;
+
+    // Fill the mix with values from -2 to 2, beyond full scale and the float headroom.
+    void SetUp() override {
+        mMixer.allocate(kChannels, kFramesPerBurst);
+        mMixer.clear();
+        FifoBuffer fifo(kChannels * sizeof(float), kFramesPerBurst);
+        mMix.resize(kSamples);
+        for (int32_t i = 0; i < kSamples; i++) {
+            mMix[i] = -2.0f + 4.0f * i / (kSamples - 1);
+        }
+        ASSERT_EQ(kFramesPerBurst, fifo.write(mMix.data(), kFramesPerBurst));
+        ASSERT_EQ(kFramesPerBurst, mMixer.mix(0, &fifo, false));
+    }
+
+    AAudioMixer mMixer;
+    std::vector<float> mMix;
+};
+
+TEST_F(MixerConvertOutputTest, float_is_clamped_in_place) {
+    float *output = mMixer.getOutputBuffer();
+    ASSERT_EQ(AAUDIO_OK, mMixer.convertOutput(output, AUDIO_FORMAT_PCM_FLOAT, kFramesPerBurst));
+    for (int32_t i = 0; i < kSamples; i++) {
+        EXPECT_EQ(std::min(std::max(mMix[i], -kMaxHeadroom), kMaxHeadroom), output[i]);
+    }
+}
+
+TEST_F(MixerConvertOutputTest, float_to_separate_buffer) {
+    std::vector<float> output(kSamples + 1, 9.0f);
+    ASSERT_EQ(AAUDIO_OK, mMixer.convertOutput(output.data(), AUDIO_FORMAT_PCM_FLOAT,
+                                               kFramesPerBurst));
+    for (int32_t i = 0; i < kSamples; i++) {
+        EXPECT_EQ(std::min(std::max(mMix[i], -kMaxHeadroom), kMaxHeadroom), output[i]);
+    }
+    EXPECT_EQ(9.0f, output[kSamples]);
+}
+
+TEST_F(MixerConvertOutputTest, i16_saturates) {
+    std::vector<int16_t> expected(kSamples);
+    memcpy_to_i16_from_float(expected.data(), mMix.data(), kSamples);
+    int16_t *output = (int16_t *) mMixer.getOutputBuffer();
+    ASSERT_EQ(AAUDIO_OK, mMixer.convertOutput(output, AUDIO_FORMAT_PCM_16_BIT,
+                                               kFramesPerBurst));
+    for (int32_t i = 0; i < kSamples; i++) {
+        EXPECT_EQ(expected[i], output[i]) << "sample " << i;
+    }
+    EXPECT_EQ(INT16_MIN, output[0]);
+    EXPECT_EQ(INT16_MAX, output[kSamples - 1]);
+}
+
+TEST_F(MixerConvertOutputTest, p24_saturates) {
+    std::vector<uint8_t> expected(kSamples * 3);
+    memcpy_to_p24_from_float(expected.data(), mMix.data(), kSamples);
+    uint8_t *output = (uint8_t *) mMixer.getOutputBuffer();
+    ASSERT_EQ(AAUDIO_OK, mMixer.convertOutput(output, AUDIO_FORMAT_PCM_24_BIT_PACKED,
+                                               kFramesPerBurst));
+    EXPECT_EQ(0, memcmp(expected.data(), output, expected.size()));
+}
+
+TEST_F(MixerConvertOutputTest, unsupported_format) {
+    EXPECT_EQ(AAUDIO_ERROR_UNIMPLEMENTED,
+              mMixer.convertOutput(mMixer.getOutputBuffer(), AUDIO_FORMAT_PCM_32_BIT,
+                                   kFramesPerBurst));
+}